@@ -0,0 +1,329 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/hrtimer.c
+ * @brief High-resolution timers on a per-CPU rbtree
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <aerosync/hrtimer.h>
+#include <aerosync/classes.h>
+#include <aerosync/export.h>
+#include <aerosync/sysintf/ic.h>
+#include <aerosync/timer.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/percpu.h>
+#include <arch/x86_64/smp.h>
+#include <arch/x86_64/tsc.h>
+#include <arch/x86_64/requests.h>
+#include <lib/printk.h>
+#include <lib/string.h>
+#include <linux/container_of.h>
+
+/*
+ * Events closer than this are programmed at this distance: the interrupt
+ * would otherwise race with the write to the timer register.
+ */
+#define HRTIMER_MIN_DELTA_NS   2000ULL
+
+/*
+ * Far events are split: the LAPIC counter only holds a few seconds worth of
+ * ticks, and an early wakeup just reprograms for the rest.
+ */
+#define HRTIMER_MAX_DELTA_NS   (1000000000ULL)
+
+/* Expiry passes in one interrupt before giving up and reprogramming */
+#define HRTIMER_MAX_RETRIES    3
+
+static DEFINE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
+
+static bool hrtimer_hres_enabled = true;
+static bool hrtimer_use_tsc_deadline;
+
+void hrtimers_init(void) {
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct hrtimer_cpu_base *base = per_cpu_ptr(hrtimer_bases, cpu);
+    spinlock_init(&base->lock);
+    base->active = RB_ROOT_CACHED;
+    base->running = nullptr;
+    base->expires_next = KTIME_MAX;
+    base->hres_active = false;
+    base->in_hrtirq = false;
+    base->cpu = cpu;
+    base->nr_events = 0;
+    base->nr_retries = 0;
+  }
+
+#ifdef CONFIG_HIGH_RES_TIMERS
+  char buf[8];
+  if (cmdline_find_option(current_cmdline, "highres", buf, sizeof(buf)) > 0 && !strcmp(buf, "off"))
+    hrtimer_hres_enabled = false;
+#else
+  hrtimer_hres_enabled = false;
+#endif
+
+  hrtimer_use_tsc_deadline = ic_timer_has_tsc_deadline() && tsc_freq_get() != 0;
+}
+
+/* --- Event device --- */
+
+static void hrtimer_program_event(struct hrtimer_cpu_base *base, uint64_t expires) {
+  base->expires_next = expires;
+  if (expires == KTIME_MAX)
+    return;
+
+  uint64_t now = get_time_ns();
+  uint64_t delta = expires > now ? expires - now : 0;
+
+  if (delta < HRTIMER_MIN_DELTA_NS)
+    delta = HRTIMER_MIN_DELTA_NS;
+  if (delta > HRTIMER_MAX_DELTA_NS)
+    delta = HRTIMER_MAX_DELTA_NS;
+
+  if (hrtimer_use_tsc_deadline) {
+    unsigned __int128 cycles = (unsigned __int128) tsc_freq_get() * delta;
+    ic_timer_tsc_deadline(rdtsc() + (uint64_t) (cycles / 1000000000ULL));
+  } else {
+    uint64_t us = (delta + 999) / 1000;
+    ic_timer_oneshot((uint32_t) us);
+  }
+}
+
+bool hrtimer_switch_to_hres(void) {
+  struct hrtimer_cpu_base *base = this_cpu_ptr(hrtimer_bases);
+
+  if (!hrtimer_hres_enabled || !ic_timer_has_oneshot())
+    return false;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
+  ic_timer_stop();
+  base->hres_active = true;
+  base->expires_next = KTIME_MAX;
+
+  if (rb_first_cached(&base->active)) {
+    struct hrtimer *first = rb_entry(rb_first_cached(&base->active), struct hrtimer, node);
+    hrtimer_program_event(base, first->expires);
+  }
+  spinlock_unlock_irqrestore(&base->lock, flags);
+
+  if (smp_get_id() == 0) {
+    printk(KERN_INFO TIME_CLASS "High-resolution timers active (%s)\n",
+           hrtimer_use_tsc_deadline ? "TSC-deadline" : "LAPIC one-shot");
+  }
+  return true;
+}
+
+bool hrtimer_hres_active(void) {
+  return this_cpu_ptr(hrtimer_bases)->hres_active;
+}
+
+/* --- Queue management (base->lock held) --- */
+
+static bool hrtimer_less(struct rb_node *a, const struct rb_node *b) {
+  return rb_entry(a, struct hrtimer, node)->expires < rb_entry(b, struct hrtimer, node)->expires;
+}
+
+/* Returns true if @timer became the earliest timer of @base */
+static bool enqueue_hrtimer(struct hrtimer *timer, struct hrtimer_cpu_base *base) {
+  __atomic_store_n(&timer->state, HRTIMER_STATE_ENQUEUED, __ATOMIC_RELAXED);
+  return rb_add_cached(&timer->node, &base->active, hrtimer_less) != nullptr;
+}
+
+static void __remove_hrtimer(struct hrtimer *timer, struct hrtimer_cpu_base *base) {
+  rb_erase_cached(&timer->node, &base->active);
+  RB_CLEAR_NODE(&timer->node);
+  __atomic_store_n(&timer->state, HRTIMER_STATE_INACTIVE, __ATOMIC_RELAXED);
+  /*
+   * Removing the earliest timer leaves the event device armed for it; the
+   * spurious interrupt finds nothing due and reprograms.
+   */
+}
+
+static uint64_t __hrtimer_next_event(struct hrtimer_cpu_base *base) {
+  struct rb_node *first = rb_first_cached(&base->active);
+  return first ? rb_entry(first, struct hrtimer, node)->expires : KTIME_MAX;
+}
+
+static struct hrtimer_cpu_base *lock_hrtimer_base(struct hrtimer *timer, irq_flags_t *flags) {
+  for (;;) {
+    struct hrtimer_cpu_base *base = __atomic_load_n(&timer->base, __ATOMIC_ACQUIRE);
+
+    *flags = spinlock_lock_irqsave(&base->lock);
+    if (base == timer->base)
+      return base;
+    spinlock_unlock_irqrestore(&base->lock, *flags);
+  }
+}
+
+/* --- API --- */
+
+void hrtimer_init(struct hrtimer *timer, enum hrtimer_restart (*function)(struct hrtimer *)) {
+  memset(timer, 0, sizeof(*timer));
+  RB_CLEAR_NODE(&timer->node);
+  timer->function = function;
+  timer->base = this_cpu_ptr(hrtimer_bases);
+  timer->state = HRTIMER_STATE_INACTIVE;
+}
+EXPORT_SYMBOL(hrtimer_init);
+
+void hrtimer_start(struct hrtimer *timer, uint64_t tim, enum hrtimer_mode mode) {
+  irq_flags_t flags;
+  struct hrtimer_cpu_base *base = lock_hrtimer_base(timer, &flags);
+  struct hrtimer_cpu_base *new_base = this_cpu_ptr(hrtimer_bases);
+
+  if (mode == HRTIMER_MODE_REL)
+    tim += get_time_ns();
+
+  if (timer->state == HRTIMER_STATE_ENQUEUED)
+    __remove_hrtimer(timer, base);
+
+  /*
+   * Queue on the local CPU so the event device we may have to reprogram is
+   * our own. A timer whose callback is running stays where it is; that CPU
+   * reprograms once the callback returns.
+   */
+  if (base != new_base && base->running != timer) {
+    __atomic_store_n(&timer->base, new_base, __ATOMIC_RELEASE);
+    spinlock_unlock(&base->lock);
+    spinlock_lock(&new_base->lock);
+    base = new_base;
+    if (timer->state == HRTIMER_STATE_ENQUEUED)
+      __remove_hrtimer(timer, base);
+  }
+
+  timer->expires = tim;
+  bool leftmost = enqueue_hrtimer(timer, base);
+
+  if (leftmost && base == new_base && base->hres_active && !base->in_hrtirq &&
+      tim < base->expires_next)
+    hrtimer_program_event(base, tim);
+
+  spinlock_unlock_irqrestore(&base->lock, flags);
+}
+EXPORT_SYMBOL(hrtimer_start);
+
+int hrtimer_try_to_cancel(struct hrtimer *timer) {
+  irq_flags_t flags;
+  struct hrtimer_cpu_base *base = lock_hrtimer_base(timer, &flags);
+  int ret = 0;
+
+  if (base->running == timer) {
+    ret = -1;
+  } else if (timer->state == HRTIMER_STATE_ENQUEUED) {
+    __remove_hrtimer(timer, base);
+    ret = 1;
+  }
+
+  spinlock_unlock_irqrestore(&base->lock, flags);
+  return ret;
+}
+EXPORT_SYMBOL(hrtimer_try_to_cancel);
+
+int hrtimer_cancel(struct hrtimer *timer) {
+  for (;;) {
+    int ret = hrtimer_try_to_cancel(timer);
+    if (ret >= 0)
+      return ret;
+    cpu_relax();
+  }
+}
+EXPORT_SYMBOL(hrtimer_cancel);
+
+uint64_t hrtimer_forward(struct hrtimer *timer, uint64_t now, uint64_t interval) {
+  if (timer->expires > now || !interval)
+    return 0;
+
+  uint64_t overrun = (now - timer->expires) / interval + 1;
+  timer->expires += overrun * interval;
+  return overrun;
+}
+EXPORT_SYMBOL(hrtimer_forward);
+
+uint64_t hrtimer_next_event(void) {
+  struct hrtimer_cpu_base *base = this_cpu_ptr(hrtimer_bases);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
+  uint64_t next = __hrtimer_next_event(base);
+  spinlock_unlock_irqrestore(&base->lock, flags);
+  return next;
+}
+
+/* --- Expiry --- */
+
+static void __no_cfi __run_hrtimer(struct hrtimer_cpu_base *base, struct hrtimer *timer) {
+  enum hrtimer_restart (*func)(struct hrtimer *) = timer->function;
+
+  __remove_hrtimer(timer, base);
+  base->running = timer;
+  spinlock_unlock(&base->lock);
+
+  enum hrtimer_restart restart = func ? func(timer) : HRTIMER_NORESTART;
+
+  spinlock_lock(&base->lock);
+
+  /* The callback (or another CPU) may have re-armed it already */
+  if (restart == HRTIMER_RESTART && timer->state == HRTIMER_STATE_INACTIVE)
+    enqueue_hrtimer(timer, base);
+
+  base->running = nullptr;
+}
+
+static void __hrtimer_run_queues(struct hrtimer_cpu_base *base, uint64_t now) {
+  struct rb_node *node;
+
+  while ((node = rb_first_cached(&base->active))) {
+    struct hrtimer *timer = rb_entry(node, struct hrtimer, node);
+    if (timer->expires > now)
+      break;
+    __run_hrtimer(base, timer);
+  }
+}
+
+/* Event device interrupt in high-resolution mode, interrupts disabled */
+void hrtimer_interrupt(void) {
+  struct hrtimer_cpu_base *base = this_cpu_ptr(hrtimer_bases);
+
+  spinlock_lock(&base->lock);
+  base->nr_events++;
+  base->in_hrtirq = true;
+  base->expires_next = KTIME_MAX;
+
+  uint64_t next;
+  for (int retries = 0;; retries++) {
+    __hrtimer_run_queues(base, get_time_ns());
+
+    next = __hrtimer_next_event(base);
+    /* Callbacks took long enough that the next timer is already due? */
+    if (next > get_time_ns() || retries >= HRTIMER_MAX_RETRIES)
+      break;
+    base->nr_retries++;
+  }
+
+  base->in_hrtirq = false;
+  hrtimer_program_event(base, next);
+  spinlock_unlock(&base->lock);
+}
+
+/* Low-resolution mode: called from the periodic tick */
+void hrtimer_run_queues(void) {
+  struct hrtimer_cpu_base *base = this_cpu_ptr(hrtimer_bases);
+
+  if (!rb_first_cached(&base->active))
+    return;
+
+  spinlock_lock(&base->lock);
+  __hrtimer_run_queues(base, get_time_ns());
+  spinlock_unlock(&base->lock);
+}
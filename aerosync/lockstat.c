@@ -0,0 +1,350 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/lockstat.c
+ * @brief Lock contention statistics
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <aerosync/lockstat.h>
+#include <aerosync/export.h>
+#include <aerosync/errno.h>
+#include <aerosync/ksymtab.h>
+#include <arch/x86_64/atomic.h>
+#include <arch/x86_64/tsc.h>
+#include <fs/vfs.h>
+#include <fs/procfs.h>
+#include <lib/string.h>
+#include <lib/vsprintf.h>
+#include <mm/slub.h>
+
+#ifdef CONFIG_LOCK_STAT
+
+/*
+ * Everything here runs inside lock and unlock paths, so it must not take a
+ * lock itself: classes are registered and statistics updated with atomics
+ * only.
+ */
+
+struct lockstat_point {
+  unsigned long ip;
+  uint64_t count;
+};
+
+struct lockstat_stats {
+  uint64_t acquisitions;
+  uint64_t contentions;
+  uint64_t wait_total;
+  uint64_t wait_max;
+  uint64_t holds;
+  uint64_t hold_total;
+  uint64_t hold_max;
+  uint64_t other_points; /* Contentions lost to racing points[] updates */
+  struct lockstat_point points[LOCKSTAT_CONTENTION_POINTS];
+};
+
+/* Slot 0 means "not registered yet"; the last slot collects the overflow */
+#define LOCKSTAT_OTHER_ID (LOCKSTAT_MAX_CLASSES - 1)
+#define LOCKSTAT_HASH_SIZE (2 * LOCKSTAT_MAX_CLASSES)
+
+static struct lockstat_stats lockstat_stats[LOCKSTAT_MAX_CLASSES];
+static struct lock_class *lockstat_classes[LOCKSTAT_MAX_CLASSES];
+static int lockstat_nr_ids; /* Ids handed out so far */
+
+static struct lock_class lockstat_other_class = {
+  .name = "<other>",
+  .id = LOCKSTAT_OTHER_ID,
+};
+
+/* Runtime locks that skipped their init function share one class */
+static struct lock_class lockstat_unclassed_class = {
+  .name = "<unclassed>",
+};
+
+extern char _kernel_vma_start[], _kernel_vma_end[];
+
+/* Classes of statically initialised locks, keyed by lock address */
+static struct lock_class lockstat_addr_classes[LOCKSTAT_MAX_CLASSES];
+static int lockstat_nr_addr_classes;
+static struct lock_class *lockstat_addr_hash[LOCKSTAT_HASH_SIZE];
+
+static inline void lockstat_max(uint64_t *max, uint64_t val) {
+  uint64_t old = READ_ONCE(*max);
+  while (val > old && !try_cmpxchg(max, &old, val))
+    ;
+}
+
+static int lockstat_register(struct lock_class *class) {
+  int id = READ_ONCE(class->id);
+  if (likely(id > 0))
+    return id;
+
+  /* -1 marks a registration in flight; count into <other> meanwhile */
+  id = 0;
+  if (!try_cmpxchg(&class->id, &id, -1))
+    return id > 0 ? id : LOCKSTAT_OTHER_ID;
+
+  id = __atomic_add_fetch(&lockstat_nr_ids, 1, __ATOMIC_RELAXED);
+  if (id >= LOCKSTAT_OTHER_ID) {
+    id = LOCKSTAT_OTHER_ID;
+  } else {
+    lockstat_classes[id] = class;
+  }
+  smp_store_release(&class->id, id);
+  return id;
+}
+
+static struct lock_class *lockstat_addr_class(const void *key) {
+  unsigned long h = ((unsigned long)key >> 3) * 0x9E3779B97F4A7C15UL;
+  unsigned int slot = (unsigned int)(h >> 53) % LOCKSTAT_HASH_SIZE;
+
+  for (unsigned int n = 0; n < LOCKSTAT_HASH_SIZE; n++) {
+    struct lock_class **bucket = &lockstat_addr_hash[slot];
+    struct lock_class *class = READ_ONCE(*bucket);
+
+    if (!class) {
+      int idx = __atomic_fetch_add(&lockstat_nr_addr_classes, 1, __ATOMIC_RELAXED);
+      if (idx >= LOCKSTAT_MAX_CLASSES)
+        return &lockstat_other_class;
+
+      /* A racing insert for the same key wastes this entry; that is fine */
+      struct lock_class *new = &lockstat_addr_classes[idx];
+      new->key = key;
+      if (try_cmpxchg(bucket, &class, new))
+        return new;
+    }
+
+    if (class->key == key)
+      return class;
+    slot = (slot + 1) % LOCKSTAT_HASH_SIZE;
+  }
+
+  return &lockstat_other_class;
+}
+
+/*
+ * Only locks in the kernel image can be statically initialised. A lock
+ * elsewhere without a class is heap memory that never went through its
+ * init function; keying those by address would let short-lived objects
+ * use up the class table.
+ */
+static bool lockstat_is_static(const void *addr) {
+  return (const char *)addr >= _kernel_vma_start && (const char *)addr < _kernel_vma_end;
+}
+
+static struct lockstat_stats *lockstat_get(struct lockstat_map *map) {
+  struct lock_class *class = READ_ONCE(map->class);
+
+  if (unlikely(!class)) {
+    class = lockstat_is_static(map) ? lockstat_addr_class(map) : &lockstat_unclassed_class;
+    WRITE_ONCE(map->class, class);
+  }
+  return &lockstat_stats[lockstat_register(class)];
+}
+
+void lockstat_contended(struct lockstat_map *map, uint64_t start, unsigned long ip) {
+  struct lockstat_stats *st = lockstat_get(map);
+  uint64_t wait = lockstat_clock() - start;
+
+  __atomic_fetch_add(&st->contentions, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&st->wait_total, wait, __ATOMIC_RELAXED);
+  lockstat_max(&st->wait_max, wait);
+
+  struct lockstat_point *victim = nullptr;
+  for (int i = 0; i < LOCKSTAT_CONTENTION_POINTS; i++) {
+    struct lockstat_point *pt = &st->points[i];
+    unsigned long cur = READ_ONCE(pt->ip);
+
+    if (!cur && try_cmpxchg(&pt->ip, &cur, ip))
+      cur = ip;
+    if (cur == ip) {
+      __atomic_fetch_add(&pt->count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if (!victim || READ_ONCE(pt->count) < READ_ONCE(victim->count))
+      victim = pt;
+  }
+
+  /*
+   * Table full: space-saving replacement. The new site takes over the
+   * least-counted slot and inherits its count, so a hot site that shows up
+   * late still gets in; counts become upper bounds for their site.
+   */
+  unsigned long old = READ_ONCE(victim->ip);
+  if (old != ip && try_cmpxchg(&victim->ip, &old, ip)) {
+    __atomic_fetch_add(&victim->count, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_fetch_add(&st->other_points, 1, __ATOMIC_RELAXED);
+}
+EXPORT_SYMBOL(lockstat_contended);
+
+void lockstat_acquired(struct lockstat_map *map, bool exclusive) {
+  struct lockstat_stats *st = lockstat_get(map);
+
+  __atomic_fetch_add(&st->acquisitions, 1, __ATOMIC_RELAXED);
+  if (exclusive)
+    map->acquired_at = lockstat_clock();
+}
+EXPORT_SYMBOL(lockstat_acquired);
+
+void lockstat_released(struct lockstat_map *map) {
+  uint64_t start = map->acquired_at;
+  if (!start)
+    return;
+
+  uint64_t hold = lockstat_clock() - start;
+  map->acquired_at = 0;
+
+  struct lockstat_stats *st = lockstat_get(map);
+  __atomic_fetch_add(&st->holds, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&st->hold_total, hold, __ATOMIC_RELAXED);
+  lockstat_max(&st->hold_max, hold);
+}
+EXPORT_SYMBOL(lockstat_released);
+
+/* --- /proc/lock_stat --- */
+
+#define LOCKSTAT_BUF_SIZE (64 * 1024)
+
+static uint64_t lockstat_ns(uint64_t cycles) {
+  uint64_t freq = tsc_freq_get();
+  if (!freq)
+    return cycles;
+  return (cycles / freq) * 1000000000ULL + (cycles % freq) * 1000000000ULL / freq;
+}
+
+static struct lock_class *lockstat_class_of(int id) {
+  if (id == LOCKSTAT_OTHER_ID)
+    return &lockstat_other_class;
+  return READ_ONCE(lockstat_classes[id]);
+}
+
+static int lockstat_show_name(char *kbuf, int len, struct lock_class *class) {
+  if (class->name)
+    return snprintf(kbuf + len, LOCKSTAT_BUF_SIZE - len, "%-40s", class->name);
+
+  uintptr_t off = 0;
+  const char *sym = lookup_ksymbol_by_addr((uintptr_t)class->key, &off);
+  char name[64];
+
+  if (!sym)
+    snprintf(name, sizeof(name), "0x%lx", (unsigned long)class->key);
+  else if (off)
+    snprintf(name, sizeof(name), "%s+0x%lx", sym, (unsigned long)off);
+  else
+    snprintf(name, sizeof(name), "%s", sym);
+  return snprintf(kbuf + len, LOCKSTAT_BUF_SIZE - len, "%-40s", name);
+}
+
+static int lockstat_show_class(char *kbuf, int len, int id) {
+  struct lockstat_stats *st = &lockstat_stats[id];
+  uint64_t contentions = READ_ONCE(st->contentions);
+  uint64_t holds = READ_ONCE(st->holds);
+
+  len += lockstat_show_name(kbuf, len, lockstat_class_of(id));
+  if (len >= LOCKSTAT_BUF_SIZE)
+    return len;
+  len += snprintf(kbuf + len, LOCKSTAT_BUF_SIZE - len,
+                  " %11lu %12lu %10lu %10lu %13lu %10lu %10lu %13lu\n",
+                  contentions, READ_ONCE(st->acquisitions),
+                  contentions ? lockstat_ns(READ_ONCE(st->wait_total) / contentions) : 0,
+                  lockstat_ns(READ_ONCE(st->wait_max)),
+                  lockstat_ns(READ_ONCE(st->wait_total)),
+                  holds ? lockstat_ns(READ_ONCE(st->hold_total) / holds) : 0,
+                  lockstat_ns(READ_ONCE(st->hold_max)),
+                  lockstat_ns(READ_ONCE(st->hold_total)));
+
+  for (int i = 0; i < LOCKSTAT_CONTENTION_POINTS && len < LOCKSTAT_BUF_SIZE; i++) {
+    unsigned long ip = READ_ONCE(st->points[i].ip);
+    if (!ip)
+      break;
+
+    uintptr_t off = 0;
+    const char *sym = lookup_ksymbol_by_addr(ip, &off);
+    len += snprintf(kbuf + len, LOCKSTAT_BUF_SIZE - len,
+                    "  %11lu  [<%p>] %s+0x%lx\n", READ_ONCE(st->points[i].count),
+                    (void *)ip, sym ? sym : "?", (unsigned long)off);
+  }
+
+  uint64_t other = READ_ONCE(st->other_points);
+  if (other && len < LOCKSTAT_BUF_SIZE)
+    len += snprintf(kbuf + len, LOCKSTAT_BUF_SIZE - len,
+                    "  %11lu  (other call sites)\n", other);
+  return len;
+}
+
+static ssize_t proc_lock_stat_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  char *kbuf = kmalloc(LOCKSTAT_BUF_SIZE);
+  short *order = kmalloc(LOCKSTAT_MAX_CLASSES * sizeof(*order));
+  if (!kbuf || !order) {
+    kfree(kbuf);
+    kfree(order);
+    return -ENOMEM;
+  }
+
+  /* Most contended first; classes never acquired are left out */
+  int nr = 0;
+  for (int id = 1; id <= LOCKSTAT_OTHER_ID; id++) {
+    if (!lockstat_class_of(id) || !READ_ONCE(lockstat_stats[id].acquisitions))
+      continue;
+
+    uint64_t c = READ_ONCE(lockstat_stats[id].contentions);
+    int pos = nr++;
+    while (pos > 0 && READ_ONCE(lockstat_stats[order[pos - 1]].contentions) < c) {
+      order[pos] = order[pos - 1];
+      pos--;
+    }
+    order[pos] = (short)id;
+  }
+
+  int len = snprintf(kbuf, LOCKSTAT_BUF_SIZE,
+                     "lock_stat version 0.1 (times in ns; write to reset)\n"
+                     "%-40s %11s %12s %10s %10s %13s %10s %10s %13s\n",
+                     "class", "contentions", "acquisitions", "wait-avg", "wait-max",
+                     "wait-total", "hold-avg", "hold-max", "hold-total");
+
+  for (int i = 0; i < nr && len < LOCKSTAT_BUF_SIZE; i++)
+    len = lockstat_show_class(kbuf, len, order[i]);
+
+  if (len > LOCKSTAT_BUF_SIZE)
+    len = LOCKSTAT_BUF_SIZE;
+
+  ssize_t ret = simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+  kfree(order);
+  kfree(kbuf);
+  return ret;
+}
+
+/* Counters are cleared in place; updates racing with the reset may survive */
+static ssize_t proc_lock_stat_write(struct file *file, const char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  (void) buf;
+  (void) ppos;
+  memset(lockstat_stats, 0, sizeof(lockstat_stats));
+  return (ssize_t) count;
+}
+
+static const struct file_operations proc_lock_stat_fops = {
+  .read = proc_lock_stat_read,
+  .write = proc_lock_stat_write,
+};
+
+void lockstat_init(void) {
+  proc_create("lock_stat", &proc_lock_stat_fops);
+}
+
+#endif /* CONFIG_LOCK_STAT */
@@ -22,59 +22,152 @@
 #include <aerosync/sched/sched.h>
 #include <aerosync/wait.h>
 #include <aerosync/fkx/fkx.h>
+#include <arch/x86_64/percpu.h>
 #include <linux/container_of.h>
 
-void mutex_init(mutex_t *m) {
-  spinlock_init(&m->lock);
-  m->count = 1; /* Unlocked */
-  m->owner = nullptr;
-  init_waitqueue_head(&m->wait_q);
+struct mutex_waiter {
+  struct list_head list;
+  struct task_struct *task;
+};
+
+void (mutex_init)(mutex_t *m) {
+  m->owner = 0;
+  spinlock_init(&m->wait_lock);
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+  mcs_lock_init(&m->osq);
+#endif
   INIT_LIST_HEAD(&m->waiters);
   m->pi_enabled = true;
 }
 EXPORT_SYMBOL(mutex_init);
 
-void mutex_lock(mutex_t *m) {
+static inline unsigned long mutex_self(void) {
   struct task_struct *curr = current;
-  wait_queue_entry_t wait;
+  return curr ? (unsigned long)curr : MUTEX_OWNER_EARLY;
+}
+
+/* Take the mutex if it is free, keeping whatever flags are set */
+static bool __mutex_trylock(mutex_t *m, unsigned long self) {
+  unsigned long owner = READ_ONCE(m->owner);
+
+  for (;;) {
+    if (owner & ~MUTEX_FLAGS)
+      return false;
+    if (try_cmpxchg(&m->owner, &owner, self | owner))
+      return true;
+  }
+}
+
+static inline void __mutex_set_flag(mutex_t *m, unsigned long flag) {
+  __atomic_fetch_or(&m->owner, flag, __ATOMIC_RELAXED);
+}
+
+static inline void __mutex_clear_flag(mutex_t *m, unsigned long flag) {
+  __atomic_fetch_and(&m->owner, ~flag, __ATOMIC_RELAXED);
+}
+
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+
+DEFINE_PER_CPU(struct mcs_lock_node, mutex_spin_node);
+
+/*
+ * Spin for the mutex while its owner is running: it is likely to release
+ * it sooner than a sleep/wakeup round trip would take. Spinners queue on
+ * the MCS lock so only one of them polls the owner word.
+ */
+static bool mutex_optimistic_spin(mutex_t *m, struct task_struct *curr) {
+  struct mcs_lock_node *node;
+  bool acquired = false;
+
+  preempt_disable();
+  node = this_cpu_ptr(mutex_spin_node);
+  mcs_spin_lock(&m->osq, node);
+
+  for (;;) {
+    unsigned long owner = READ_ONCE(m->owner);
+
+    if (!(owner & ~MUTEX_FLAGS)) {
+      if (__mutex_trylock(m, (unsigned long)curr)) {
+        acquired = true;
+        break;
+      }
+      continue;
+    }
+
+    /* A starving waiter gets the lock next; don't compete with it */
+    if (owner & MUTEX_FLAG_HANDOFF)
+      break;
+    unsigned long task = owner & ~MUTEX_FLAGS;
+    if (task == MUTEX_OWNER_EARLY || !task_on_cpu((struct task_struct *)task))
+      break;
+    if (this_cpu_read(need_resched))
+      break;
+
+    cpu_relax();
+  }
+
+  mcs_spin_unlock(&m->osq, node);
+  preempt_enable();
+  return acquired;
+}
+
+#endif /* CONFIG_MUTEX_SPIN_ON_OWNER */
+
+static void __noinline mutex_lock_slowpath(mutex_t *m) {
+  struct task_struct *curr = current;
+  struct mutex_waiter waiter;
+  bool woken = false;
 
   if (unlikely(!curr)) {
     /* Early boot: no scheduler yet. Spin until lock acquired. */
-    irq_flags_t flags = spinlock_lock_irqsave(&m->lock);
-    while (m->count == 0) {
-      spinlock_unlock_irqrestore(&m->lock, flags);
+    while (!__mutex_trylock(m, MUTEX_OWNER_EARLY))
       cpu_relax();
-      flags = spinlock_lock_irqsave(&m->lock);
-    }
-    m->count = 0;
-    m->owner = nullptr;
-    spinlock_unlock_irqrestore(&m->lock, flags);
     return;
   }
 
-  init_wait(&wait);
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+  if (mutex_optimistic_spin(m, curr))
+    return;
+#endif
 
-  irq_flags_t flags = spinlock_lock_irqsave(&m->lock);
+  irq_flags_t flags = spinlock_lock_irqsave(&m->wait_lock);
 
-  while (m->count == 0) {
-    struct task_struct *owner = m->owner;
+  waiter.task = curr;
+  list_add_tail(&waiter.list, &m->waiters);
+  __mutex_set_flag(m, MUTEX_FLAG_WAITERS);
+
+  for (;;) {
+    /* mutex_unlock() may have handed the lock straight to us */
+    if ((READ_ONCE(m->owner) & ~MUTEX_FLAGS) == (unsigned long)curr)
+      break;
+    if (__mutex_trylock(m, (unsigned long)curr))
+      break;
+
+    /*
+     * Woken up and beaten to it again by a spinner: make the next unlock
+     * hand the mutex to the first waiter instead of letting it be stolen.
+     */
+    if (woken &&
+        list_first_entry(&m->waiters, struct mutex_waiter, list) == &waiter)
+      __mutex_set_flag(m, MUTEX_FLAG_HANDOFF);
 
     /* PI Logic: Boost owner's priority */
+    struct task_struct *owner = mutex_owner(m);
     if (m->pi_enabled && owner) {
       curr->pi_blocked_on = m;
       pi_boost_prio(owner, curr);
     }
 
-    /* Slow path: block and wait */
-    prepare_to_wait(&m->wait_q, &wait, TASK_UNINTERRUPTIBLE);
-
-    if (m->count != 0) {
+    /* The lock may have been released while flags were being set */
+    if (__mutex_trylock(m, (unsigned long)curr))
       break;
-    }
 
-    spinlock_unlock_irqrestore(&m->lock, flags);
+    set_current_state(TASK_UNINTERRUPTIBLE);
+    spinlock_unlock_irqrestore(&m->wait_lock, flags);
     schedule();
-    flags = spinlock_lock_irqsave(&m->lock);
+    flags = spinlock_lock_irqsave(&m->wait_lock);
+    __set_current_state(TASK_RUNNING);
+    woken = true;
   }
 
   /* Cleanup PI state if we were blocked */
@@ -82,21 +175,37 @@ void mutex_lock(mutex_t *m) {
     curr->pi_blocked_on = nullptr;
   }
 
-  m->count = 0;
-  m->owner = curr;
+  bool first =
+      list_first_entry(&m->waiters, struct mutex_waiter, list) == &waiter;
+  list_del(&waiter.list);
+  if (list_empty(&m->waiters))
+    __mutex_clear_flag(m, MUTEX_FLAG_WAITERS | MUTEX_FLAG_HANDOFF);
+  else if (first)
+    __mutex_clear_flag(m, MUTEX_FLAG_HANDOFF);
 
-  finish_wait(&m->wait_q, &wait);
-  spinlock_unlock_irqrestore(&m->lock, flags);
+  spinlock_unlock_irqrestore(&m->wait_lock, flags);
 }
-EXPORT_SYMBOL(mutex_lock);
 
-void mutex_unlock(mutex_t *m) {
-  irq_flags_t flags = spinlock_lock_irqsave(&m->lock);
-  struct task_struct *curr = current;
+void mutex_lock(mutex_t *m) {
+  unsigned long unlocked = 0;
 
-  if (curr && m->owner != curr) {
-    /* Warning handled in professional kernels by BUG_ON or similar */
+#ifdef CONFIG_LOCK_STAT
+  if (unlikely(!try_cmpxchg(&m->owner, &unlocked, mutex_self()))) {
+    uint64_t start = lockstat_clock();
+    mutex_lock_slowpath(m);
+    lockstat_contended(&m->dep, start, LOCKSTAT_RET_IP);
   }
+  lockstat_acquired(&m->dep, true);
+#else
+  if (likely(try_cmpxchg(&m->owner, &unlocked, mutex_self())))
+    return;
+  mutex_lock_slowpath(m);
+#endif
+}
+EXPORT_SYMBOL(mutex_lock);
+
+static void __noinline mutex_unlock_slowpath(mutex_t *m) {
+  struct task_struct *curr = current;
 
   /* PI Logic: Restore priority if we were boosted */
   if (curr && m->pi_enabled) {
@@ -116,28 +225,50 @@ void mutex_unlock(mutex_t *m) {
     spinlock_unlock_irqrestore(&curr->pi_lock, pflags);
   }
 
-  m->count = 1;
-  m->owner = nullptr;
+  /* Release unless a waiter asked for a handoff; keep it marked waited on */
+  unsigned long owner = READ_ONCE(m->owner);
+  for (;;) {
+    if (owner & MUTEX_FLAG_HANDOFF)
+      break;
+    if (try_cmpxchg(&m->owner, &owner, owner & MUTEX_FLAG_WAITERS))
+      break;
+  }
+
+  irq_flags_t flags = spinlock_lock_irqsave(&m->wait_lock);
+
+  if (!list_empty(&m->waiters)) {
+    struct mutex_waiter *w =
+        list_first_entry(&m->waiters, struct mutex_waiter, list);
 
-  /* Wake up one waiter */
-  wake_up_nr(&m->wait_q, 1);
+    /* Flags only change under wait_lock while the mutex is held */
+    if (owner & MUTEX_FLAG_HANDOFF)
+      smp_store_release(&m->owner, (unsigned long)w->task | MUTEX_FLAG_WAITERS);
 
-  spinlock_unlock_irqrestore(&m->lock, flags);
+    /* Wake up one waiter */
+    task_wake_up(w->task);
+  } else if (owner & MUTEX_FLAG_HANDOFF) {
+    smp_store_release(&m->owner, 0UL);
+  }
+
+  spinlock_unlock_irqrestore(&m->wait_lock, flags);
 }
-EXPORT_SYMBOL(mutex_unlock);
 
-int mutex_trylock(mutex_t *m) {
-  irq_flags_t flags = spinlock_lock_irqsave(&m->lock);
-  struct task_struct *curr = current;
+void mutex_unlock(mutex_t *m) {
+  unsigned long self = mutex_self();
 
-  if (m->count == 1) {
-    m->count = 0;
-    m->owner = curr;
-    spinlock_unlock_irqrestore(&m->lock, flags);
-    return 1;
-  }
+  lockstat_released(&m->dep);
+
+  /* Owner only, no waiters: nothing else to do */
+  if (likely(try_cmpxchg(&m->owner, &self, 0UL)))
+    return;
+  mutex_unlock_slowpath(m);
+}
+EXPORT_SYMBOL(mutex_unlock);
 
-  spinlock_unlock_irqrestore(&m->lock, flags);
-  return 0;
+int mutex_trylock(mutex_t *m) {
+  if (!__mutex_trylock(m, mutex_self()))
+    return 0;
+  lockstat_acquired(&m->dep, true);
+  return 1;
 }
 EXPORT_SYMBOL(mutex_trylock);
@@ -0,0 +1,324 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/qspinlock.c
+ * @brief Queued spinlock slowpath
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <aerosync/qspinlock.h>
+#include <aerosync/export.h>
+#include <arch/x86_64/percpu.h>
+#include <arch/x86_64/smp.h>
+#ifdef CONFIG_SPINLOCK_BENCH
+#include <aerosync/classes.h>
+#include <aerosync/completion.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sched/process.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/timer.h>
+#include <lib/printk.h>
+#endif
+
+struct qspinlock_node {
+  struct qspinlock_node *next;
+  int locked; /* Set by the predecessor when we become queue head */
+  int count;  /* Nesting depth, only used in node 0 */
+};
+
+/* One cache line per CPU; nested acquisitions take the next node */
+DEFINE_PER_CPU_ALIGNED(struct qspinlock_node, qnodes[QSPINLOCK_MAX_NODES], 64);
+
+static __always_inline uint32_t encode_tail(int cpu, int idx) {
+  return ((uint32_t)(cpu + 1) << _Q_TAIL_CPU_OFFSET) |
+         ((uint32_t)idx << _Q_TAIL_IDX_OFFSET);
+}
+
+static __always_inline struct qspinlock_node *decode_tail(uint32_t tail) {
+  int cpu = (int)(tail >> _Q_TAIL_CPU_OFFSET) - 1;
+  int idx = (tail & _Q_TAIL_IDX_MASK) >> _Q_TAIL_IDX_OFFSET;
+
+  return per_cpu_ptr(qnodes[idx], cpu);
+}
+
+/* Publish @tail and return the previous one; locked/pending are untouched */
+static __always_inline uint32_t xchg_tail(struct qspinlock *lock, uint32_t tail) {
+  return (uint32_t)xchg(&lock->tail, (uint16_t)(tail >> 16)) << 16;
+}
+
+/*
+ * queued_spin_lock_slowpath - Acquire a contended lock
+ * @val: Lock word seen by the failed fastpath cmpxchg
+ *
+ * (queue tail, pending, locked):
+ *   (0,0,1) -> (0,1,1) -> (0,1,0) -> (0,0,1)   pending waiter
+ *   (*,*,*) -> (t,*,*) -> (t,0,0) -> (*,0,1)   queued waiter
+ */
+void queued_spin_lock_slowpath(struct qspinlock *lock, uint32_t val) {
+  struct qspinlock_node *node, *prev, *next;
+  uint32_t old, tail;
+  int idx;
+
+  /* A pending waiter is about to take over; give it a moment */
+  if (val == _Q_PENDING_VAL) {
+    int cnt = 512;
+    while ((val = READ_ONCE(lock->val)) == _Q_PENDING_VAL && --cnt)
+      cpu_relax();
+  }
+
+  /* Anyone pending or queued already: get in line */
+  if (val & ~_Q_LOCKED_MASK)
+    goto queue;
+
+  /* Claim the pending bit and wait next to the owner */
+  val = __atomic_fetch_or(&lock->val, _Q_PENDING_VAL, __ATOMIC_ACQUIRE);
+  if (unlikely(val & ~_Q_LOCKED_MASK)) {
+    /* Lost the race; undo the bit only if it was ours */
+    if (!(val & _Q_PENDING_MASK))
+      WRITE_ONCE(lock->pending, 0);
+    goto queue;
+  }
+
+  if (val & _Q_LOCKED_MASK) {
+    while (READ_ONCE(lock->locked))
+      cpu_relax();
+  }
+
+  /* (0,1,0) -> (0,0,1); nobody else may touch locked/pending now */
+  WRITE_ONCE(lock->locked_pending, _Q_LOCKED_VAL);
+  return;
+
+queue:
+  /* No per-CPU nodes before the areas exist; spin on the word instead */
+  if (unlikely(!percpu_ready())) {
+    while (!queued_spin_trylock(lock))
+      cpu_relax();
+    return;
+  }
+
+  node = this_cpu_ptr(qnodes[0]);
+  idx = node->count++;
+  tail = encode_tail((int)smp_get_id(), idx);
+
+  /* Deeper nesting than we have nodes for (NMI in NMI); just spin */
+  if (unlikely(idx >= QSPINLOCK_MAX_NODES)) {
+    while (!queued_spin_trylock(lock))
+      cpu_relax();
+    goto release;
+  }
+
+  node += idx;
+  cbarrier();
+  node->locked = 0;
+  node->next = nullptr;
+
+  /* The owner may have left while we set up the node */
+  if (queued_spin_trylock(lock))
+    goto release;
+
+  /* Node contents must be visible before the tail points at it */
+  smp_wmb();
+  old = xchg_tail(lock, tail);
+  next = nullptr;
+
+  if (old & _Q_TAIL_MASK) {
+    prev = decode_tail(old);
+    WRITE_ONCE(prev->next, node);
+
+    while (!READ_ONCE(node->locked))
+      cpu_relax();
+
+    next = READ_ONCE(node->next);
+    if (next)
+      __builtin_prefetch(next, 1);
+  }
+
+  /* Queue head: wait for the owner and any pending waiter to go */
+  while ((val = READ_ONCE(lock->val)) & _Q_LOCKED_PENDING_MASK)
+    cpu_relax();
+
+  /* Last in the queue: clear the tail and take the lock in one go */
+  if ((val & _Q_TAIL_MASK) == tail) {
+    if (try_cmpxchg(&lock->val, &val, _Q_LOCKED_VAL))
+      goto release;
+  }
+
+  /* Others queued behind us; they will not touch the locked byte */
+  WRITE_ONCE(lock->locked, _Q_LOCKED_VAL);
+
+  if (!next) {
+    while (!(next = READ_ONCE(node->next)))
+      cpu_relax();
+  }
+  WRITE_ONCE(next->locked, 1);
+
+release:
+  this_cpu_ptr(qnodes[0])->count--;
+}
+EXPORT_SYMBOL(queued_spin_lock_slowpath);
+
+#ifdef CONFIG_SPINLOCK_BENCH
+
+#define LOCKBENCH_ITERS       100000
+#define LOCKBENCH_MAX_THREADS 64
+#define LOCKBENCH_THINK       16 /* cpu_relax() between acquisitions */
+
+/* Reference ticket lock, independent of which spinlock_t is configured */
+struct lockbench_ticket {
+  uint16_t owner;
+  uint16_t next;
+};
+
+static inline void lockbench_ticket_lock(struct lockbench_ticket *t) {
+  uint16_t ticket = __atomic_fetch_add(&t->next, 1, __ATOMIC_RELAXED);
+  while (READ_ONCE(t->owner) != ticket)
+    cpu_relax();
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void lockbench_ticket_unlock(struct lockbench_ticket *t) {
+  __atomic_fetch_add(&t->owner, 1, __ATOMIC_RELEASE);
+}
+
+enum { LOCKBENCH_TICKET, LOCKBENCH_QUEUED };
+
+static struct {
+  int kind;
+  int nr_threads;
+  int go;
+  atomic_t arrived;
+  atomic_t running;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  struct completion done;
+
+  /* The lock and the data it protects share a line, as they usually do */
+  alignas(64) struct {
+    union {
+      struct lockbench_ticket ticket;
+      struct qspinlock queued;
+    };
+    uint64_t counter;
+  } shared;
+} lockbench;
+
+static void lockbench_arrive(void) {
+  if (atomic_inc_return(&lockbench.arrived) == lockbench.nr_threads) {
+    lockbench.start_ns = get_time_ns();
+    WRITE_ONCE(lockbench.go, 1);
+  }
+}
+
+static void lockbench_leave(void) {
+  if (atomic_dec_and_test(&lockbench.running)) {
+    lockbench.end_ns = get_time_ns();
+    complete(&lockbench.done);
+  }
+}
+
+static int lockbench_worker(void *data) {
+  (void)data;
+
+  lockbench_arrive();
+  while (!READ_ONCE(lockbench.go))
+    cpu_relax();
+
+  for (int i = 0; i < LOCKBENCH_ITERS; i++) {
+    irq_flags_t flags = local_irq_save();
+    if (lockbench.kind == LOCKBENCH_TICKET) {
+      lockbench_ticket_lock(&lockbench.shared.ticket);
+      lockbench.shared.counter++;
+      lockbench_ticket_unlock(&lockbench.shared.ticket);
+    } else {
+      queued_spin_lock(&lockbench.shared.queued);
+      lockbench.shared.counter++;
+      queued_spin_unlock(&lockbench.shared.queued);
+    }
+    local_irq_restore(flags);
+
+    for (int d = 0; d < LOCKBENCH_THINK; d++)
+      cpu_relax();
+  }
+
+  lockbench_leave();
+  return 0;
+}
+
+/* Returns ns per acquisition, 0 if the run was broken */
+static uint64_t lockbench_run(int kind, int nr_threads) {
+  lockbench.kind = kind;
+  lockbench.nr_threads = nr_threads;
+  lockbench.go = 0;
+  lockbench.shared.ticket = (struct lockbench_ticket){0, 0};
+  lockbench.shared.queued = (struct qspinlock)QSPINLOCK_INIT;
+  lockbench.shared.counter = 0;
+  atomic_set(&lockbench.arrived, 0);
+  atomic_set(&lockbench.running, nr_threads);
+  init_completion(&lockbench.done);
+
+  int started = 0;
+  for (int cpu = 0; cpu < nr_threads; cpu++) {
+    struct task_struct *task =
+        kthread_create(lockbench_worker, nullptr, "lockbench/%d", cpu);
+    if (!task) {
+      lockbench_arrive();
+      lockbench_leave();
+      continue;
+    }
+
+    cpumask_clear(&task->cpus_allowed);
+    cpumask_set_cpu(cpu, &task->cpus_allowed);
+    task->nr_cpus_allowed = 1;
+    set_task_cpu(task, cpu);
+    kthread_run(task);
+    started++;
+  }
+
+  wait_for_completion(&lockbench.done);
+
+  if (!started ||
+      lockbench.shared.counter != (uint64_t)started * LOCKBENCH_ITERS) {
+    printk(KERN_ERR SYNC_CLASS "lockbench: %s run broken (%llu/%llu)\n",
+           kind == LOCKBENCH_TICKET ? "ticket" : "queued",
+           lockbench.shared.counter, (uint64_t)started * LOCKBENCH_ITERS);
+    return 0;
+  }
+
+  return (lockbench.end_ns - lockbench.start_ns) /
+         ((uint64_t)started * LOCKBENCH_ITERS);
+}
+
+void spinlock_bench(void) {
+  int cpus = (int)smp_get_cpu_count();
+  if (cpus > LOCKBENCH_MAX_THREADS)
+    cpus = LOCKBENCH_MAX_THREADS;
+
+  printk(KERN_INFO SYNC_CLASS "lockbench: %d iterations per thread\n",
+         LOCKBENCH_ITERS);
+
+  for (int n = 1;; n = n * 2 > cpus ? cpus : n * 2) {
+    uint64_t ticket = lockbench_run(LOCKBENCH_TICKET, n);
+    uint64_t queued = lockbench_run(LOCKBENCH_QUEUED, n);
+
+    printk(KERN_INFO SYNC_CLASS
+           "lockbench: %2d threads: ticket %4llu ns/op, queued %4llu ns/op\n",
+           n, ticket, queued);
+
+    if (n == cpus)
+      break;
+  }
+}
+
+#endif /* CONFIG_SPINLOCK_BENCH */
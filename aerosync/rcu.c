@@ -12,13 +12,21 @@
 #include <aerosync/sched/sched.h>
 #include <aerosync/sched/process.h>
 #include <aerosync/spinlock.h>
+#include <aerosync/mutex.h>
 #include <aerosync/wait.h>
+#include <aerosync/workqueue.h>
 #include <aerosync/panic.h>
 #include <aerosync/export.h>
+#include <aerosync/completion.h>
+#include <aerosync/timer.h>
+#include <arch/x86_64/smp.h>
+#include <arch/x86_64/requests.h>
 #include <lib/printk.h>
 #include <lib/string.h>
+#include <linux/container_of.h>
 #include <aerosync/classes.h>
 #include <mm/slub.h>
+#include <mm/zone.h>
 #include <vsprintf.h>
 
 struct rcu_state rcu_state;
@@ -30,6 +38,47 @@ static int rcu_lvl_cnt[4];
 
 /* Forward declarations */
 static void rcu_process_callbacks(void);
+static void rcu_exp_report(struct rcu_data *rdp);
+static void kfree_rcu_init(void);
+
+#ifdef CONFIG_RCU_NOCB_CPU
+/*
+ * Callbacks of the CPUs named by "rcu_nocbs=" are never run on those CPUs.
+ * One rcuog kthread per NUMA node advances and invokes them instead; it is
+ * an ordinary kthread allowed on the node's remaining CPUs, so the
+ * scheduler places it and ResDomain can move it like any other task.
+ */
+struct rcu_nocb_group {
+  wait_queue_head_t wait;
+  struct cpumask cpus;     /* nocb CPUs served by this group */
+  struct task_struct *task;
+#ifdef CONFIG_RCU_BENCH
+  uint64_t cb_ns;          /* Time spent invoking callbacks */
+#endif
+};
+
+static struct rcu_nocb_group rcu_nocb_groups[MAX_NUMNODES];
+static struct cpumask rcu_nocb_mask;
+
+static void rcu_nocb_init(void);
+static void rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head);
+static void rcu_nocb_gp_done(void);
+static void rcu_nocb_spawn_kthreads(void);
+#endif
+
+/*
+ * Expedited grace periods run one at a time and do not touch the tree:
+ * every online CPU but the initiator owes one report, counted down in
+ * @remaining. @seq is odd while one is running, so a caller can tell
+ * whether a grace period started after it arrived has already completed.
+ */
+static struct {
+  mutex_t mutex;
+  unsigned long seq;
+  atomic_t remaining;
+  wait_queue_head_t wait;
+  struct cpumask cpus;
+} rcu_exp;
 
 /**
  * rcu_init_node_hierarchy - Build the RCU node tree
@@ -99,6 +148,7 @@ static void rcu_init_node_hierarchy(void) {
 void rcu_check_callbacks(void) {
   if (preemptible()) {
     rcu_qs();
+    rcu_exp_report(this_cpu_ptr(rcu_data));
   }
   rcu_process_callbacks();
 }
@@ -122,6 +172,9 @@ void rcu_init(void) {
   init_waitqueue_head(&rcu_state.gp_wait);
   spinlock_init(&rcu_state.gp_lock);
 
+  mutex_init(&rcu_exp.mutex);
+  init_waitqueue_head(&rcu_exp.wait);
+
   int cpu;
   for_each_possible_cpu(cpu) {
     struct rcu_data *rdp = per_cpu_ptr(rcu_data, cpu);
@@ -136,6 +189,11 @@ void rcu_init(void) {
     rdp->mynode = &rcu_state.nodes[leaf_idx];
   }
 
+  kfree_rcu_init();
+#ifdef CONFIG_RCU_NOCB_CPU
+  rcu_nocb_init();
+#endif
+
   printk(KERN_INFO SYNC_CLASS "Tree RCU Initialized (early)\n");
 }
 
@@ -146,6 +204,10 @@ void rcu_spawn_kthreads(void) {
    */
   for_each_online_cpu(cpu) {
     struct rcu_data *rdp = per_cpu_ptr(rcu_data, cpu);
+#ifdef CONFIG_RCU_NOCB_CPU
+    if (rdp->nocb)
+      continue;
+#endif
     char name[16];
     snprintf(name, sizeof(name), "rcu/%d", cpu);
     rdp->rcu_kthread = kthread_create(rcu_cpu_kthread, rdp, name);
@@ -154,6 +216,10 @@ void rcu_spawn_kthreads(void) {
     }
   }
   printk(KERN_INFO SYNC_CLASS "RCU kthreads spawned for online CPUs\n");
+
+#ifdef CONFIG_RCU_NOCB_CPU
+  rcu_nocb_spawn_kthreads();
+#endif
 }
 
 /**
@@ -202,6 +268,9 @@ static void rcu_report_qs_rnp(uint64_t mask, struct rcu_node *rnp, unsigned long
       rcu_state.completed_seq = gp_seq;
       spinlock_unlock_irqrestore(&rnp->lock, flags);
       wake_up_all(&rcu_state.gp_wait);
+#ifdef CONFIG_RCU_NOCB_CPU
+      rcu_nocb_gp_done();
+#endif
       return;
     }
 
@@ -239,6 +308,15 @@ void rcu_qs(void) {
   }
 }
 
+bool rcu_needs_cpu(void) {
+  struct rcu_data *rdp = this_cpu_ptr(rcu_data);
+#ifdef CONFIG_RCU_NOCB_CPU
+  if (rdp->nocb)
+    return rdp->qs_pending;
+#endif
+  return rdp->qs_pending || rdp->callbacks || rdp->wait_callbacks;
+}
+
 static void rcu_start_gp(void) {
   if (rcu_state.gp_seq != rcu_state.completed_seq)
     return;
@@ -302,6 +380,14 @@ void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head)) {
   irq_flags_t flags = local_irq_save();
   struct rcu_data *rdp = this_cpu_ptr(rcu_data);
 
+#ifdef CONFIG_RCU_NOCB_CPU
+  if (rdp->nocb) {
+    rcu_nocb_enqueue(rdp, head);
+    local_irq_restore(flags);
+    return;
+  }
+#endif
+
   *rdp->callbacks_tail = head;
   rdp->callbacks_tail = &head->next;
 
@@ -312,6 +398,11 @@ static void __no_cfi rcu_process_callbacks(void) {
   struct rcu_head *list = nullptr;
   struct rcu_data *rdp = this_cpu_ptr(rcu_data);
 
+#ifdef CONFIG_RCU_NOCB_CPU
+  if (rdp->nocb)
+    return;
+#endif
+
   /* 1. If current wait list finished its GP, move to local list for execution */
   if (rdp->wait_callbacks && rcu_state.completed_seq >= rdp->gp_seq) {
     list = rdp->wait_callbacks;
@@ -336,11 +427,18 @@ static void __no_cfi rcu_process_callbacks(void) {
   }
 
   /* 3. Execute ready callbacks */
+#ifdef CONFIG_RCU_BENCH
+  uint64_t start = list ? get_time_ns() : 0;
+#endif
   while (list) {
     struct rcu_head *next = list->next;
     list->func(list);
     list = next;
   }
+#ifdef CONFIG_RCU_BENCH
+  if (start)
+    rdp->cb_local_ns += get_time_ns() - start;
+#endif
 }
 
 void synchronize_rcu(void) {
@@ -355,11 +453,485 @@ void synchronize_rcu(void) {
   wait_event(rcu_state.gp_wait, rcu_state.completed_seq >= wait_gp);
 }
 
-void synchronize_rcu_expedited(void) {
-  /* For now, just an alias for synchronize_rcu, but technically 
-   * it should avoid the waitqueue and use IPIs for faster QS reporting.
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/* ========================================================================
+ * Callback offloading
+ * ======================================================================== */
+
+/* Parse a CPU list such as "1-3,6" into @mask */
+static void rcu_nocb_parse(const char *s, struct cpumask *mask) {
+  while (*s) {
+    int first = 0, last;
+
+    if (*s < '0' || *s > '9')
+      break;
+    while (*s >= '0' && *s <= '9')
+      first = first * 10 + (*s++ - '0');
+
+    last = first;
+    if (*s == '-') {
+      s++;
+      last = 0;
+      while (*s >= '0' && *s <= '9')
+        last = last * 10 + (*s++ - '0');
+    }
+
+    for (int cpu = first; cpu <= last && cpu < MAX_CPUS; cpu++)
+      cpumask_set_cpu(cpu, mask);
+
+    if (*s != ',')
+      break;
+    s++;
+  }
+}
+
+static void rcu_nocb_init(void) {
+  char buf[128];
+
+  for (int nid = 0; nid < MAX_NUMNODES; nid++) {
+    init_waitqueue_head(&rcu_nocb_groups[nid].wait);
+    cpumask_clear(&rcu_nocb_groups[nid].cpus);
+  }
+
+  cpumask_clear(&rcu_nocb_mask);
+  if (!get_cmdline_request()->response ||
+      cmdline_find_option(current_cmdline, "rcu_nocbs", buf, sizeof(buf)) <= 0)
+    return;
+
+  rcu_nocb_parse(buf, &rcu_nocb_mask);
+
+  /*
+   * Callbacks queued before the kthreads exist simply wait for them;
+   * nothing in early boot depends on a callback having run.
    */
-  synchronize_rcu();
+  int cpu;
+  for_each_cpu(cpu, &rcu_nocb_mask) {
+    struct rcu_data *rdp = per_cpu_ptr(rcu_data, cpu);
+    spinlock_init(&rdp->nocb_lock);
+    rdp->nocb = true;
+  }
+
+  printk(KERN_INFO SYNC_CLASS "RCU: offloading callbacks of %d CPUs\n",
+         cpumask_weight(&rcu_nocb_mask));
+}
+
+static void rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head) {
+  spinlock_lock(&rdp->nocb_lock);
+  bool was_empty = !rdp->callbacks;
+  *rdp->callbacks_tail = head;
+  rdp->callbacks_tail = &head->next;
+  spinlock_unlock(&rdp->nocb_lock);
+
+  /* The kthread picks up later arrivals together with the first one */
+  if (was_empty && rdp->nocb_group)
+    wake_up_all(&rdp->nocb_group->wait);
+}
+
+static void rcu_nocb_gp_done(void) {
+  for (int nid = 0; nid < MAX_NUMNODES; nid++) {
+    if (rcu_nocb_groups[nid].task)
+      wake_up_all(&rcu_nocb_groups[nid].wait);
+  }
+}
+
+/*
+ * Grace period that covers callbacks queued now. One already in progress
+ * may have started before they were queued, so they need the one after.
+ * Called with gp_lock held.
+ */
+static unsigned long rcu_nocb_gp_target(void) {
+  if (rcu_state.gp_seq != rcu_state.completed_seq)
+    return rcu_state.gp_seq + 1;
+
+  rcu_start_gp();
+  return rcu_state.gp_seq;
+}
+
+static bool rcu_nocb_cpu_has_work(struct rcu_data *rdp) {
+  if (READ_ONCE(rdp->wait_callbacks))
+    return READ_ONCE(rcu_state.completed_seq) >= READ_ONCE(rdp->nocb_gp_seq) ||
+           READ_ONCE(rcu_state.gp_seq) == READ_ONCE(rcu_state.completed_seq);
+
+  return READ_ONCE(rdp->callbacks) != nullptr;
+}
+
+static bool rcu_nocb_group_has_work(struct rcu_nocb_group *grp) {
+  int cpu;
+  for_each_cpu(cpu, &grp->cpus) {
+    if (rcu_nocb_cpu_has_work(per_cpu_ptr(rcu_data, cpu)))
+      return true;
+  }
+  return false;
+}
+
+static void __no_cfi rcu_nocb_do_cpu(struct rcu_nocb_group *grp, struct rcu_data *rdp) {
+  struct rcu_head *list = nullptr;
+  irq_flags_t flags = spinlock_lock_irqsave(&rdp->nocb_lock);
+
+  if (rdp->wait_callbacks) {
+    if (rcu_state.completed_seq >= rdp->nocb_gp_seq) {
+      list = rdp->wait_callbacks;
+      rdp->wait_callbacks = nullptr;
+      rdp->wait_tail = &rdp->wait_callbacks;
+    } else {
+      /* Our target is the GP after the one that was running; start it */
+      spinlock_lock(&rcu_state.gp_lock);
+      rcu_start_gp();
+      spinlock_unlock(&rcu_state.gp_lock);
+    }
+  }
+
+  if (!rdp->wait_callbacks && rdp->callbacks) {
+    rdp->wait_callbacks = rdp->callbacks;
+    rdp->wait_tail = rdp->callbacks_tail;
+    rdp->callbacks = nullptr;
+    rdp->callbacks_tail = &rdp->callbacks;
+
+    spinlock_lock(&rcu_state.gp_lock);
+    rdp->nocb_gp_seq = rcu_nocb_gp_target();
+    spinlock_unlock(&rcu_state.gp_lock);
+  }
+
+  spinlock_unlock_irqrestore(&rdp->nocb_lock, flags);
+
+#ifdef CONFIG_RCU_BENCH
+  uint64_t start = list ? get_time_ns() : 0;
+#else
+  (void) grp;
+#endif
+  while (list) {
+    struct rcu_head *next = list->next;
+    list->func(list);
+    list = next;
+  }
+#ifdef CONFIG_RCU_BENCH
+  if (start)
+    grp->cb_ns += get_time_ns() - start;
+#endif
+}
+
+static int rcu_nocb_kthread(void *data) {
+  struct rcu_nocb_group *grp = data;
+
+  for (;;) {
+    wait_event(grp->wait, rcu_nocb_group_has_work(grp));
+
+    int cpu;
+    for_each_cpu(cpu, &grp->cpus)
+      rcu_nocb_do_cpu(grp, per_cpu_ptr(rcu_data, cpu));
+  }
+  return 0;
+}
+
+static void rcu_nocb_spawn_kthreads(void) {
+  int cpu, nid;
+
+  if (cpumask_empty(&rcu_nocb_mask))
+    return;
+
+  for_each_cpu(cpu, &rcu_nocb_mask) {
+    nid = cpu_to_node(cpu);
+    if (nid < 0 || nid >= MAX_NUMNODES)
+      nid = 0;
+    cpumask_set_cpu(cpu, &rcu_nocb_groups[nid].cpus);
+    per_cpu_ptr(rcu_data, cpu)->nocb_group = &rcu_nocb_groups[nid];
+  }
+
+  for (nid = 0; nid < MAX_NUMNODES; nid++) {
+    struct rcu_nocb_group *grp = &rcu_nocb_groups[nid];
+    if (cpumask_empty(&grp->cpus))
+      continue;
+
+    grp->task = kthread_create(rcu_nocb_kthread, grp, "rcuog/%d", nid);
+    if (!grp->task) {
+      printk(KERN_ERR SYNC_CLASS "RCU: no offload kthread for node %d\n", nid);
+      continue;
+    }
+
+    /* Keep off the CPUs we are offloading: the node's others, else any */
+    struct cpumask allowed;
+    cpumask_clear(&allowed);
+    for_each_online_cpu(cpu) {
+      if (!cpumask_test_cpu(cpu, &rcu_nocb_mask) && cpu_to_node(cpu) == nid)
+        cpumask_set_cpu(cpu, &allowed);
+    }
+    if (cpumask_empty(&allowed)) {
+      for_each_online_cpu(cpu) {
+        if (!cpumask_test_cpu(cpu, &rcu_nocb_mask))
+          cpumask_set_cpu(cpu, &allowed);
+      }
+    }
+
+    if (!cpumask_empty(&allowed)) {
+      grp->task->cpus_allowed = allowed;
+      grp->task->nr_cpus_allowed = cpumask_weight(&allowed);
+      set_task_cpu(grp->task, cpumask_first(&allowed));
+    }
+    kthread_run(grp->task);
+
+    /* Pick up whatever was queued before we existed */
+    wake_up_all(&grp->wait);
+  }
+
+  printk(KERN_INFO SYNC_CLASS "RCU: offload kthreads spawned\n");
+}
+
+#endif /* CONFIG_RCU_NOCB_CPU */
+
+/* ========================================================================
+ * Expedited grace periods
+ * ======================================================================== */
+
+static void rcu_exp_report(struct rcu_data *rdp) {
+  if (!READ_ONCE(rdp->exp_pending))
+    return;
+
+  /* Full barrier: the CPU's earlier reads happen before the GP ends */
+  if (!__atomic_exchange_n(&rdp->exp_pending, false, __ATOMIC_SEQ_CST))
+    return;
+
+  if (atomic_dec_and_test(&rcu_exp.remaining))
+    wake_up_all(&rcu_exp.wait);
+}
+
+void rcu_note_context_switch(void) {
+  irq_flags_t flags = local_irq_save();
+  struct rcu_data *rdp = this_cpu_ptr(rcu_data);
+
+  rcu_exp_report(rdp);
+  if (rdp->qs_pending)
+    rcu_qs();
+
+  local_irq_restore(flags);
+}
+
+/*
+ * Runs in the IPI on every CPU the grace period waits for. The interrupted
+ * context holds preemption disabled if, and only if, it may be a reader;
+ * such a CPU reports once the reader's preempt_enable() reschedules.
+ */
+static void rcu_exp_handler(void *info) {
+  (void) info;
+  struct rcu_data *rdp = this_cpu_ptr(rcu_data);
+
+  if (!READ_ONCE(rdp->exp_pending))
+    return;
+
+  if (preemptible())
+    rcu_exp_report(rdp);
+  else
+    set_need_resched();
+}
+
+/* Sequence number whose completion covers a grace period requested now */
+static unsigned long rcu_exp_snap(void) {
+  smp_mb();
+  return (READ_ONCE(rcu_exp.seq) + 3) & ~1UL;
+}
+
+static bool rcu_exp_done(unsigned long snap) {
+  return (long) (READ_ONCE(rcu_exp.seq) - snap) >= 0;
+}
+
+void synchronize_rcu_expedited(void) {
+  /* Non-preemptible RCU: with one CPU, a caller that may sleep is alone */
+  if (!smp_is_active() || smp_get_cpu_count() == 1) {
+    smp_mb();
+    return;
+  }
+
+  unsigned long snap = rcu_exp_snap();
+
+  mutex_lock(&rcu_exp.mutex);
+  if (rcu_exp_done(snap)) {
+    /* Someone else's grace period covered ours while we waited */
+    mutex_unlock(&rcu_exp.mutex);
+    return;
+  }
+
+  WRITE_ONCE(rcu_exp.seq, rcu_exp.seq + 1);
+  smp_mb();
+
+  /* The initiator's own CPU is not in a reader: it is running us */
+  atomic_set(&rcu_exp.remaining, 1);
+  cpumask_clear(&rcu_exp.cpus);
+
+  preempt_disable();
+  int this_cpu = (int) smp_get_id();
+  int cpu;
+  for_each_online_cpu(cpu) {
+    if (cpu == this_cpu)
+      continue;
+    atomic_inc(&rcu_exp.remaining);
+    __atomic_store_n(&per_cpu_ptr(rcu_data, cpu)->exp_pending, true, __ATOMIC_SEQ_CST);
+    cpumask_set_cpu(cpu, &rcu_exp.cpus);
+  }
+  preempt_enable();
+
+  smp_call_function_many(&rcu_exp.cpus, rcu_exp_handler, nullptr, true);
+
+  if (!atomic_dec_and_test(&rcu_exp.remaining))
+    wait_event(rcu_exp.wait, atomic_read(&rcu_exp.remaining) == 0);
+
+  smp_mb();
+  WRITE_ONCE(rcu_exp.seq, rcu_exp.seq + 1);
+  mutex_unlock(&rcu_exp.mutex);
+}
+
+/* ========================================================================
+ * kfree_rcu batching
+ * ======================================================================== */
+
+/* A page of pointers that wait for the same grace period */
+struct kvfree_rcu_bulk_data {
+  struct kvfree_rcu_bulk_data *next;
+  unsigned long nr_records;
+  void *records[];
+};
+
+#define KVFREE_BULK_MAX_ENTR \
+  ((PAGE_SIZE - sizeof(struct kvfree_rcu_bulk_data)) / sizeof(void *))
+
+/*
+ * Objects queued on a CPU collect in @bulk (or, when no page could be had,
+ * are chained through their own rcu_head in @head, the pointer kept in
+ * ->func). At most one batch per CPU waits for a grace period; whatever
+ * arrives meanwhile forms the next batch, so batches grow with load.
+ */
+struct kfree_rcu_cpu {
+  spinlock_t lock;
+  struct kvfree_rcu_bulk_data *bulk;
+  struct rcu_head *head;
+
+  /* The batch waiting for the grace period */
+  struct kvfree_rcu_bulk_data *bulk_free;
+  struct rcu_head *head_free;
+  bool in_flight;
+
+  struct kvfree_rcu_bulk_data *spare; /* Cached page for the next batch */
+  struct rcu_head rcu;
+  struct work_struct work;
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, kfree_rcu_cpu);
+
+/* Objects freed so far, for the benchmark */
+static atomic_long_t kfree_rcu_freed;
+
+static void kfree_rcu_gp_done(struct rcu_head *rcu) {
+  struct kfree_rcu_cpu *krcp = container_of(rcu, struct kfree_rcu_cpu, rcu);
+
+  /* RCU callbacks may run from the tick; vfree() and friends may not */
+  schedule_work(&krcp->work);
+}
+
+static void kfree_rcu_queue_batch(struct kfree_rcu_cpu *krcp) {
+  krcp->bulk_free = krcp->bulk;
+  krcp->head_free = krcp->head;
+  krcp->bulk = nullptr;
+  krcp->head = nullptr;
+  krcp->in_flight = true;
+
+  call_rcu(&krcp->rcu, kfree_rcu_gp_done);
+}
+
+static void kfree_rcu_put_page(struct kfree_rcu_cpu *krcp, struct kvfree_rcu_bulk_data *bnode) {
+  irq_flags_t flags = spinlock_lock_irqsave(&krcp->lock);
+  if (!krcp->spare) {
+    krcp->spare = bnode;
+    bnode = nullptr;
+  }
+  spinlock_unlock_irqrestore(&krcp->lock, flags);
+
+  if (bnode)
+    __free_page(virt_to_page(bnode));
+}
+
+static void kfree_rcu_work(struct work_struct *work) {
+  struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu, work);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&krcp->lock);
+  struct kvfree_rcu_bulk_data *bnode = krcp->bulk_free;
+  struct rcu_head *head = krcp->head_free;
+  krcp->bulk_free = nullptr;
+  krcp->head_free = nullptr;
+
+  /* Start the next grace period before freeing so the two overlap */
+  if (krcp->bulk || krcp->head)
+    kfree_rcu_queue_batch(krcp);
+  else
+    krcp->in_flight = false;
+  spinlock_unlock_irqrestore(&krcp->lock, flags);
+
+  while (bnode) {
+    struct kvfree_rcu_bulk_data *next = bnode->next;
+
+    kfree_bulk(bnode->nr_records, bnode->records);
+    atomic_long_add((long) bnode->nr_records, &kfree_rcu_freed);
+    kfree_rcu_put_page(krcp, bnode);
+    bnode = next;
+  }
+
+  while (head) {
+    struct rcu_head *next = head->next;
+
+    kfree((void *) head->func);
+    atomic_long_inc(&kfree_rcu_freed);
+    head = next;
+  }
+}
+
+static bool kfree_rcu_add_ptr(struct kfree_rcu_cpu *krcp, void *ptr) {
+  struct kvfree_rcu_bulk_data *bnode = krcp->bulk;
+
+  if (!bnode || bnode->nr_records == KVFREE_BULK_MAX_ENTR) {
+    bnode = krcp->spare;
+    krcp->spare = nullptr;
+
+    if (!bnode) {
+      struct folio *folio = alloc_pages(GFP_ATOMIC | __GFP_NOWARN | ___GFP_NO_CHARGE, 0);
+      if (!folio)
+        return false;
+      bnode = folio_address(folio);
+    }
+
+    bnode->nr_records = 0;
+    bnode->next = krcp->bulk;
+    krcp->bulk = bnode;
+  }
+
+  bnode->records[bnode->nr_records++] = ptr;
+  return true;
+}
+
+void kvfree_call_rcu(struct rcu_head *head, void *ptr) {
+  irq_flags_t flags = local_irq_save();
+  struct kfree_rcu_cpu *krcp = this_cpu_ptr(kfree_rcu_cpu);
+
+  spinlock_lock(&krcp->lock);
+
+  if (!kfree_rcu_add_ptr(krcp, ptr)) {
+    head->func = (void (*)(struct rcu_head *)) ptr;
+    head->next = krcp->head;
+    krcp->head = head;
+  }
+
+  if (!krcp->in_flight)
+    kfree_rcu_queue_batch(krcp);
+
+  spinlock_unlock(&krcp->lock);
+  local_irq_restore(flags);
+}
+
+static void kfree_rcu_init(void) {
+  int cpu;
+  for_each_possible_cpu(cpu) {
+    struct kfree_rcu_cpu *krcp = per_cpu_ptr(kfree_rcu_cpu, cpu);
+    memset(krcp, 0, sizeof(*krcp));
+    spinlock_init(&krcp->lock);
+    INIT_WORK(&krcp->work, kfree_rcu_work);
+  }
 }
 
 struct rcu_test_data {
@@ -408,4 +980,310 @@ void rcu_test(void) {
 EXPORT_SYMBOL(call_rcu);
 EXPORT_SYMBOL(synchronize_rcu);
 EXPORT_SYMBOL(synchronize_rcu_expedited);
+EXPORT_SYMBOL(kvfree_call_rcu);
+EXPORT_SYMBOL(rcu_note_context_switch);
 EXPORT_SYMBOL(rcu_qs);
+
+#ifdef CONFIG_RCU_BENCH
+
+#define RCU_BENCH_EXP_ITERS     1000
+#define RCU_BENCH_NORMAL_ITERS  20
+#define RCU_BENCH_OBJS          10000 /* Per producer */
+#define RCU_BENCH_MAX_THREADS   64
+#define RCU_BENCH_TIMEOUT_NS    (10ULL * 1000000000ULL)
+#define RCU_BENCH_HEAVY_NS      2000 /* Work done by each "heavy" callback */
+
+enum rcu_bench_mode {
+  RCU_BENCH_CALL_RCU,
+  RCU_BENCH_KFREE_RCU,
+  RCU_BENCH_HEAVY_CB, /* call_rcu() with callbacks that take a while */
+};
+
+static const char *const rcu_bench_mode_name[] = {
+  [RCU_BENCH_CALL_RCU] = "call_rcu",
+  [RCU_BENCH_KFREE_RCU] = "kfree_rcu",
+  [RCU_BENCH_HEAVY_CB] = "heavy call_rcu",
+};
+
+struct rcu_bench_obj {
+  struct rcu_head rcu;
+  uint64_t payload[4];
+};
+
+static struct {
+  int nr_threads;
+  int go;
+  int stop;
+  enum rcu_bench_mode mode;
+  atomic_t arrived;
+  atomic_t running;
+  atomic_long_t freed;
+  uint64_t start_ns;
+  struct completion done;
+} rcu_bench_state;
+
+static void rcu_bench_arrive(void) {
+  if (atomic_inc_return(&rcu_bench_state.arrived) == rcu_bench_state.nr_threads) {
+    rcu_bench_state.start_ns = get_time_ns();
+    WRITE_ONCE(rcu_bench_state.go, 1);
+  }
+}
+
+static void rcu_bench_leave(void) {
+  if (atomic_dec_and_test(&rcu_bench_state.running))
+    complete(&rcu_bench_state.done);
+}
+
+static bool rcu_bench_spawn(int (*threadfn)(void *), const char *name, int skip_cpu) {
+  int started = 0;
+
+  rcu_bench_state.go = 0;
+  rcu_bench_state.stop = 0;
+  atomic_set(&rcu_bench_state.arrived, 0);
+  atomic_set(&rcu_bench_state.running, rcu_bench_state.nr_threads);
+  init_completion(&rcu_bench_state.done);
+
+  for (int cpu = 0; cpu < rcu_bench_state.nr_threads + (skip_cpu >= 0); cpu++) {
+    if (cpu == skip_cpu)
+      continue;
+
+    struct task_struct *task =
+        kthread_create(threadfn, (void *) (uintptr_t) cpu, "%s/%d", name, cpu);
+    if (!task) {
+      rcu_bench_arrive();
+      rcu_bench_leave();
+      continue;
+    }
+
+    cpumask_clear(&task->cpus_allowed);
+    cpumask_set_cpu(cpu, &task->cpus_allowed);
+    task->nr_cpus_allowed = 1;
+    set_task_cpu(task, cpu);
+    kthread_run(task);
+    started++;
+  }
+
+  return started > 0;
+}
+
+static void rcu_bench_exp_latency(const char *load) {
+  uint64_t min = UINT64_MAX, max = 0, total = 0;
+
+  for (int i = 0; i < RCU_BENCH_EXP_ITERS; i++) {
+    uint64_t t0 = get_time_ns();
+    synchronize_rcu_expedited();
+    uint64_t t = get_time_ns() - t0;
+
+    total += t;
+    if (t < min)
+      min = t;
+    if (t > max)
+      max = t;
+  }
+
+  printk(KERN_INFO SYNC_CLASS
+         "rcubench: expedited, %s: min %llu us, avg %llu us, max %llu us\n",
+         load, min / 1000, total / RCU_BENCH_EXP_ITERS / 1000, max / 1000);
+}
+
+static void rcu_bench_normal_latency(void) {
+  uint64_t total = 0, max = 0;
+
+  for (int i = 0; i < RCU_BENCH_NORMAL_ITERS; i++) {
+    uint64_t t0 = get_time_ns();
+    synchronize_rcu();
+    uint64_t t = get_time_ns() - t0;
+
+    total += t;
+    if (t > max)
+      max = t;
+  }
+
+  printk(KERN_INFO SYNC_CLASS
+         "rcubench: normal, idle: avg %llu us, max %llu us\n",
+         total / RCU_BENCH_NORMAL_ITERS / 1000, max / 1000);
+}
+
+/* Keeps its CPU inside short read-side critical sections */
+static int rcu_bench_reader(void *data) {
+  (void) data;
+
+  rcu_bench_arrive();
+  while (!READ_ONCE(rcu_bench_state.stop)) {
+    rcu_read_lock();
+    for (int d = 0; d < 64; d++)
+      cpu_relax();
+    rcu_read_unlock();
+  }
+
+  rcu_bench_leave();
+  return 0;
+}
+
+static void rcu_bench_free_cb(struct rcu_head *head) {
+  kfree(container_of(head, struct rcu_bench_obj, rcu));
+  atomic_long_inc(&rcu_bench_state.freed);
+}
+
+static void rcu_bench_heavy_cb(struct rcu_head *head) {
+  uint64_t end = get_time_ns() + RCU_BENCH_HEAVY_NS;
+  while (get_time_ns() < end)
+    cpu_relax();
+  rcu_bench_free_cb(head);
+}
+
+static int rcu_bench_producer(void *data) {
+  (void) data;
+
+  rcu_bench_arrive();
+  while (!READ_ONCE(rcu_bench_state.go))
+    cpu_relax();
+
+  for (int i = 0; i < RCU_BENCH_OBJS; i++) {
+    struct rcu_bench_obj *obj = kmalloc(sizeof(*obj));
+    if (!obj)
+      break;
+
+    if (rcu_bench_state.mode == RCU_BENCH_KFREE_RCU)
+      kfree_rcu(obj, rcu);
+    else if (rcu_bench_state.mode == RCU_BENCH_HEAVY_CB)
+      call_rcu(&obj->rcu, rcu_bench_heavy_cb);
+    else
+      call_rcu(&obj->rcu, rcu_bench_free_cb);
+  }
+
+  rcu_bench_leave();
+  return 0;
+}
+
+static bool rcu_bench_throughput(enum rcu_bench_mode mode) {
+  const char *name = rcu_bench_mode_name[mode];
+  bool use_kfree_rcu = mode == RCU_BENCH_KFREE_RCU;
+  long target = (long) rcu_bench_state.nr_threads * RCU_BENCH_OBJS;
+
+  rcu_bench_state.mode = mode;
+  atomic_long_set(&rcu_bench_state.freed, 0);
+  long base = atomic_long_read(&kfree_rcu_freed);
+
+  if (!rcu_bench_spawn(rcu_bench_producer, "rcubench", -1)) {
+    printk(KERN_ERR SYNC_CLASS "rcubench: %s: no producers\n", name);
+    return false;
+  }
+  wait_for_completion(&rcu_bench_state.done);
+
+  /* Producers are done queueing; wait for the frees to catch up */
+  long freed = 0;
+  while (get_time_ns() - rcu_bench_state.start_ns < RCU_BENCH_TIMEOUT_NS) {
+    freed = use_kfree_rcu ? atomic_long_read(&kfree_rcu_freed) - base
+                          : atomic_long_read(&rcu_bench_state.freed);
+    if (freed >= target)
+      break;
+    schedule_timeout(NSEC_PER_MSEC);
+  }
+
+  uint64_t us = (get_time_ns() - rcu_bench_state.start_ns) / 1000;
+  if (freed < target) {
+    printk(KERN_ERR SYNC_CLASS "rcubench: %s: only %ld of %ld objects freed\n",
+           name, freed, target);
+    return false;
+  }
+
+  printk(KERN_INFO SYNC_CLASS
+         "rcubench: %s, %d producers: %ld objects in %llu us, %llu objects/s\n",
+         name, rcu_bench_state.nr_threads, target, us,
+         (uint64_t) target * 1000000ULL / (us ? us : 1));
+  return true;
+}
+
+/*
+ * Where callback time goes under a call_rcu() flood: on the CPUs that
+ * queued the callbacks, or in the offload kthreads for "rcu_nocbs=" CPUs.
+ */
+static void rcu_bench_cb_time(void) {
+  static uint64_t before[MAX_CPUS];
+  int cpu;
+
+  for_each_online_cpu(cpu)
+    before[cpu] = READ_ONCE(per_cpu_ptr(rcu_data, cpu)->cb_local_ns);
+#ifdef CONFIG_RCU_NOCB_CPU
+  uint64_t offload_before = 0;
+  for (int nid = 0; nid < MAX_NUMNODES; nid++)
+    offload_before += READ_ONCE(rcu_nocb_groups[nid].cb_ns);
+#endif
+
+  if (!rcu_bench_throughput(RCU_BENCH_HEAVY_CB))
+    return;
+
+  uint64_t nocb_ns = 0, local_ns = 0, offload_ns = 0;
+  int nr_nocb = 0, nr_local = 0;
+
+  for_each_online_cpu(cpu) {
+    struct rcu_data *rdp = per_cpu_ptr(rcu_data, cpu);
+    uint64_t t = READ_ONCE(rdp->cb_local_ns) - before[cpu];
+#ifdef CONFIG_RCU_NOCB_CPU
+    if (rdp->nocb) {
+      nocb_ns += t;
+      nr_nocb++;
+      continue;
+    }
+#endif
+    local_ns += t;
+    nr_local++;
+  }
+#ifdef CONFIG_RCU_NOCB_CPU
+  for (int nid = 0; nid < MAX_NUMNODES; nid++)
+    offload_ns += READ_ONCE(rcu_nocb_groups[nid].cb_ns);
+  offload_ns -= offload_before;
+#endif
+
+  printk(KERN_INFO SYNC_CLASS
+         "rcubench: callback time per CPU: %llu us on %d nocb CPUs, "
+         "%llu us on %d others, %llu us in offload kthreads\n",
+         nr_nocb ? nocb_ns / nr_nocb / 1000 : 0, nr_nocb,
+         nr_local ? local_ns / nr_local / 1000 : 0, nr_local, offload_ns / 1000);
+}
+
+void rcu_bench(void) {
+  int cpus = (int) smp_get_cpu_count();
+  if (cpus > RCU_BENCH_MAX_THREADS)
+    cpus = RCU_BENCH_MAX_THREADS;
+
+  printk(KERN_INFO SYNC_CLASS "rcubench: %d CPUs\n", cpus);
+
+  rcu_bench_exp_latency("idle");
+  rcu_bench_normal_latency();
+
+  if (cpus > 1) {
+    preempt_disable();
+    int this_cpu = (int) smp_get_id();
+    preempt_enable();
+
+    /* The initiator stays on its CPU; readers take all the others */
+    cpumask_t old_mask = current->cpus_allowed;
+    int old_nr = current->nr_cpus_allowed;
+    cpumask_clear(&current->cpus_allowed);
+    cpumask_set_cpu(this_cpu, &current->cpus_allowed);
+    current->nr_cpus_allowed = 1;
+
+    rcu_bench_state.nr_threads = cpus - 1;
+    if (rcu_bench_spawn(rcu_bench_reader, "rcureader", this_cpu)) {
+      while (atomic_read(&rcu_bench_state.arrived) < rcu_bench_state.nr_threads)
+        schedule_timeout(NSEC_PER_MSEC);
+
+      rcu_bench_exp_latency("readers on other CPUs");
+
+      WRITE_ONCE(rcu_bench_state.stop, 1);
+      wait_for_completion(&rcu_bench_state.done);
+    }
+
+    current->cpus_allowed = old_mask;
+    current->nr_cpus_allowed = old_nr;
+  }
+
+  rcu_bench_state.nr_threads = cpus;
+  rcu_bench_throughput(RCU_BENCH_CALL_RCU);
+  rcu_bench_throughput(RCU_BENCH_KFREE_RCU);
+  rcu_bench_cb_time();
+}
+
+#endif /* CONFIG_RCU_BENCH */
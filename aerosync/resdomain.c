@@ -11,6 +11,7 @@
 #include <aerosync/resdomain.h>
 #include <aerosync/sched/process.h>
 #include <aerosync/errno.h>
+#include <aerosync/export.h>
 #include <aerosync/timer.h>
 #include <mm/slub.h>
 #include <lib/string.h>
@@ -159,6 +160,8 @@ static struct rd_subsys cpu_subsys = {
 
 /* --- Memory Controller Ops --- */
 
+static void rd_high_work(struct work_struct *work);
+
 static ssize_t resfs_mem_max_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
   struct resdomain *rd = file->f_inode->i_fs_info;
   struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
@@ -206,6 +209,63 @@ static const struct file_operations resfs_mem_current_fops = {
   .read = resfs_mem_current_read,
 };
 
+static ssize_t resfs_mem_high_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  struct resdomain *rd = file->f_inode->i_fs_info;
+  struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
+  char kbuf[32];
+  int len;
+  if (ms->high == (uint64_t) -1)
+    len = snprintf(kbuf, sizeof(kbuf), "max\n");
+  else
+    len = snprintf(kbuf, sizeof(kbuf), "%llu\n", (unsigned long long) ms->high);
+  return simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+}
+
+static ssize_t resfs_mem_high_write(struct file *file, const char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) ppos;
+  struct resdomain *rd = file->f_inode->i_fs_info;
+  struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
+  char kbuf[32];
+  if (count >= sizeof(kbuf)) return -EINVAL;
+  if (copy_from_user(kbuf, buf, count)) return -EFAULT;
+  kbuf[count] = 0;
+  unsigned long long val;
+  if (strncmp(kbuf, "max", 3) == 0) {
+    val = (uint64_t) -1;
+  } else {
+    if (kstrtoull(kbuf, 10, &val)) return -EINVAL;
+  }
+  ms->high = (uint64_t) val;
+
+  /* Start pulling usage down right away instead of on the next charge */
+  if ((uint64_t) atomic64_read(&ms->usage) > ms->high && system_unbound_wq) {
+    resdomain_get(rd);
+    if (!queue_work(system_unbound_wq, &ms->high_work))
+      resdomain_put(rd);
+  }
+  return (ssize_t) count;
+}
+
+static const struct file_operations resfs_mem_high_fops = {
+  .read = resfs_mem_high_read,
+  .write = resfs_mem_high_write,
+};
+
+static ssize_t resfs_mem_events_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  struct resdomain *rd = file->f_inode->i_fs_info;
+  struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
+  char kbuf[96];
+  int len = snprintf(kbuf, sizeof(kbuf), "high %llu\nmax %llu\noom %llu\n",
+                     (unsigned long long) atomic64_read(&ms->events[RD_MEM_EVENT_HIGH]),
+                     (unsigned long long) atomic64_read(&ms->events[RD_MEM_EVENT_MAX]),
+                     (unsigned long long) atomic64_read(&ms->events[RD_MEM_EVENT_OOM]));
+  return simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+}
+
+static const struct file_operations resfs_mem_events_fops = {
+  .read = resfs_mem_events_read,
+};
+
 static void mem_populate(struct resdomain *rd, struct pseudo_node *dir) {
   extern struct pseudo_fs_info resfs_info;
   extern void resfs_init_inode(struct inode *inode, struct pseudo_node *pnode);
@@ -214,6 +274,10 @@ static void mem_populate(struct resdomain *rd, struct pseudo_node *dir) {
   if (node) node->init_inode = resfs_init_inode;
   node = pseudo_fs_create_file(&resfs_info, dir, "memory.current", &resfs_mem_current_fops, rd);
   if (node) node->init_inode = resfs_init_inode;
+  node = pseudo_fs_create_file(&resfs_info, dir, "memory.high", &resfs_mem_high_fops, rd);
+  if (node) node->init_inode = resfs_init_inode;
+  node = pseudo_fs_create_file(&resfs_info, dir, "memory.events", &resfs_mem_events_fops, rd);
+  if (node) node->init_inode = resfs_init_inode;
 }
 
 static struct resdomain_subsys_state *mem_css_alloc(struct resdomain *rd) {
@@ -221,6 +285,7 @@ static struct resdomain_subsys_state *mem_css_alloc(struct resdomain *rd) {
   if (!ms) return nullptr;
   ms->max = (uint64_t) -1;
   ms->high = (uint64_t) -1;
+  INIT_WORK(&ms->high_work, rd_high_work);
   return &ms->css;
 }
 
@@ -397,6 +462,267 @@ struct rd_subsys *rd_subsys_list[RD_SUBSYS_COUNT] = {
   [RD_SUBSYS_IO] = &io_subsys,
 };
 
+/* --- Memory charging --- */
+
+#ifndef RD_CHARGE_BATCH
+#ifndef CONFIG_RESDOMAIN_MEM_CHARGE_BATCH
+#define RD_CHARGE_BATCH (64 * PAGE_SIZE)
+#else
+#define RD_CHARGE_BATCH CONFIG_RESDOMAIN_MEM_CHARGE_BATCH
+#endif
+#endif
+
+/* Longest a charging task is throttled for being above memory.high */
+#define RD_HIGH_DELAY_MAX_NS 200000000ULL
+
+extern size_t try_to_free_pages(struct pglist_data *pgdat, size_t nr_to_reclaim, gfp_t gfp_mask);
+
+struct rd_stock {
+  struct resdomain *cached; /* Holds a reference */
+  uint64_t nr_bytes;        /* Charged to cached's hierarchy, not yet used */
+  struct work_struct drain_work;
+};
+
+static DEFINE_PER_CPU(struct rd_stock, rd_stocks);
+
+static struct mem_rd_state *rd_mem(struct resdomain *rd) {
+  return (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
+}
+
+static bool rd_can_sleep(void) {
+  return preemptible() && !irqs_disabled() && system_wq;
+}
+
+static void rd_uncharge_hier(struct resdomain *rd, struct resdomain *stop, uint64_t bytes) {
+  for (; rd != stop; rd = rd->parent) {
+    struct mem_rd_state *ms = rd_mem(rd);
+    if (ms) atomic64_sub(bytes, &ms->usage);
+  }
+}
+
+/*
+ * Charge @bytes to @rd and every ancestor, or to none of them.
+ * @return 0, or -ENOMEM with *@limited set to the domain whose max was hit
+ */
+static int rd_try_charge_hier(struct resdomain *rd, uint64_t bytes, bool force,
+                              struct resdomain **limited) {
+  for (struct resdomain *pos = rd; pos; pos = pos->parent) {
+    struct mem_rd_state *ms = rd_mem(pos);
+    if (!ms) continue;
+
+    uint64_t usage = (uint64_t) atomic64_add_return((long) bytes, &ms->usage);
+    if (!force && ms->max != (uint64_t) -1 && usage > ms->max) {
+      atomic64_sub(bytes, &ms->usage);
+      atomic64_inc(&ms->events[RD_MEM_EVENT_MAX]);
+      rd_uncharge_hier(rd, pos, bytes);
+      *limited = pos;
+      return -ENOMEM;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Called with interrupts disabled. Returns the reference the stock held,
+ * to be dropped once interrupts are back on: freeing a domain can end up
+ * uncharging into this very stock.
+ */
+static struct resdomain *drain_stock(struct rd_stock *stock) {
+  struct resdomain *old = stock->cached;
+
+  if (old && stock->nr_bytes)
+    rd_uncharge_hier(old, nullptr, stock->nr_bytes);
+  stock->nr_bytes = 0;
+  stock->cached = nullptr;
+  return old;
+}
+
+static bool consume_stock(struct resdomain *rd, uint64_t bytes) {
+  bool ret = false;
+
+  if (bytes > RD_CHARGE_BATCH) return false;
+
+  irq_flags_t flags = local_irq_save();
+  struct rd_stock *stock = this_cpu_ptr(rd_stocks);
+  if (stock->cached == rd && stock->nr_bytes >= bytes) {
+    stock->nr_bytes -= bytes;
+    ret = true;
+  }
+  local_irq_restore(flags);
+  return ret;
+}
+
+/* Put bytes that are charged to @rd's hierarchy into the local stock */
+static void refill_stock(struct resdomain *rd, uint64_t bytes) {
+  struct resdomain *old = nullptr, *full = nullptr;
+  irq_flags_t flags = local_irq_save();
+  struct rd_stock *stock = this_cpu_ptr(rd_stocks);
+
+  if (stock->cached != rd) {
+    old = drain_stock(stock);
+    resdomain_get(rd);
+    stock->cached = rd;
+  }
+  stock->nr_bytes += bytes;
+  if (stock->nr_bytes > RD_CHARGE_BATCH)
+    full = drain_stock(stock);
+  local_irq_restore(flags);
+
+  resdomain_put(old);
+  resdomain_put(full);
+}
+
+static void drain_local_stock(struct work_struct *work) {
+  (void) work;
+  irq_flags_t flags = local_irq_save();
+  struct resdomain *old = drain_stock(this_cpu_ptr(rd_stocks));
+  local_irq_restore(flags);
+
+  resdomain_put(old);
+}
+
+void resdomain_drain_stocks(struct resdomain *rd) {
+  int this_cpu = (int) smp_get_id();
+  int cpu;
+
+  drain_local_stock(nullptr);
+
+  if (!system_wq) return;
+
+  for_each_online_cpu(cpu) {
+    struct rd_stock *stock = per_cpu_ptr(rd_stocks, cpu);
+    struct resdomain *cached = READ_ONCE(stock->cached);
+
+    if (cpu == this_cpu || !cached || !READ_ONCE(stock->nr_bytes)) continue;
+    if (rd && !resdomain_is_descendant(rd, cached)) continue;
+    schedule_work_on(cpu, &stock->drain_work);
+  }
+
+  for_each_online_cpu(cpu) {
+    if (cpu != this_cpu)
+      flush_work(&per_cpu_ptr(rd_stocks, cpu)->drain_work);
+  }
+}
+
+EXPORT_SYMBOL(resdomain_drain_stocks);
+
+static void rd_reclaim(uint64_t bytes) {
+  size_t nr_to_reclaim = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+  for (int i = 0; i < MAX_NUMNODES; i++) {
+    if (node_data[i])
+      try_to_free_pages(node_data[i], nr_to_reclaim, GFP_KERNEL);
+  }
+}
+
+/* Background reclaim towards memory.high */
+static void rd_high_work(struct work_struct *work) {
+  struct mem_rd_state *ms = container_of(work, struct mem_rd_state, high_work);
+
+  for (int retries = 0; retries < 4; retries++) {
+    uint64_t usage = (uint64_t) atomic64_read(&ms->usage);
+    uint64_t high = READ_ONCE(ms->high);
+
+    if (usage <= high) break;
+    rd_reclaim(usage - high);
+  }
+  resdomain_put(ms->css.rd);
+}
+
+/*
+ * Kick background reclaim for every ancestor above memory.high and
+ * throttle the charging task in proportion to the worst overage.
+ */
+static void rd_handle_high(struct resdomain *rd) {
+  uint64_t worst = 0;
+
+  for (struct resdomain *pos = rd; pos; pos = pos->parent) {
+    struct mem_rd_state *ms = rd_mem(pos);
+    if (!ms || ms->high == (uint64_t) -1) continue;
+
+    uint64_t usage = (uint64_t) atomic64_read(&ms->usage);
+    if (usage <= ms->high) continue;
+
+    atomic64_inc(&ms->events[RD_MEM_EVENT_HIGH]);
+    if (system_unbound_wq) {
+      resdomain_get(pos);
+      if (!queue_work(system_unbound_wq, &ms->high_work))
+        resdomain_put(pos);
+    }
+
+    /* Overage relative to high, 1024 meaning 100% above */
+    uint64_t ratio = ((usage - ms->high) << 10) / (ms->high ? ms->high : 1);
+    if (ratio > worst) worst = ratio;
+  }
+
+  if (!worst || !rd_can_sleep()) return;
+
+  /* Grows with the square of the overage: ~1ms at 3%, capped at 200ms */
+  uint64_t delay_ns = worst * worst * 1000ULL;
+  if (worst > 16384 || delay_ns > RD_HIGH_DELAY_MAX_NS) delay_ns = RD_HIGH_DELAY_MAX_NS;
+  set_current_state(TASK_UNINTERRUPTIBLE);
+  schedule_timeout(delay_ns);
+}
+
+int __no_cfi resdomain_charge_mem(struct resdomain *rd, uint64_t bytes, bool force) {
+  if (!rd) rd = &root_resdomain;
+  if (!rd_mem(rd) || !bytes) return 0;
+
+  if (consume_stock(rd, bytes)) return 0;
+
+  struct resdomain *limited = nullptr;
+  uint64_t batch = bytes < RD_CHARGE_BATCH ? RD_CHARGE_BATCH : bytes;
+  bool drained = false;
+
+retry:
+  if (rd_try_charge_hier(rd, batch, force, &limited) == 0)
+    goto charged;
+  if (batch > bytes) {
+    /* Close to a limit: no pre-charging */
+    batch = bytes;
+    goto retry;
+  }
+
+  /* HARD LIMIT ENFORCEMENT: other CPUs may sit on charged bytes */
+  if (!drained && rd_can_sleep()) {
+    resdomain_drain_stocks(limited);
+    drained = true;
+    goto retry;
+  }
+
+#ifdef CONFIG_MM_RESDOMAIN_DIRECT_RECLAIM
+  /*
+   * DIRECT RECLAIM:
+   * We call into the memory management system to attempt to free pages.
+   */
+  if (rd_can_sleep()) {
+    rd_reclaim(bytes);
+    if (rd_try_charge_hier(rd, bytes, force, &limited) == 0)
+      goto charged;
+  }
+#endif
+
+  atomic64_inc(&rd_mem(limited)->events[RD_MEM_EVENT_OOM]);
+  return -ENOMEM;
+
+charged:
+  if (batch > bytes)
+    refill_stock(rd, batch - bytes);
+  rd_handle_high(rd);
+  return 0;
+}
+
+void resdomain_uncharge_mem(struct resdomain *rd, uint64_t bytes) {
+  if (!rd) rd = &root_resdomain;
+  if (!rd_mem(rd) || !bytes) return;
+
+  if (bytes > RD_CHARGE_BATCH) {
+    rd_uncharge_hier(rd, nullptr, bytes);
+    return;
+  }
+  refill_stock(rd, bytes);
+}
+
 /* --- Core Management --- */
 
 static int __no_cfi resdomain_init_subsys(struct resdomain *rd, int subsys_id) {
@@ -419,6 +745,9 @@ void resdomain_init(void) {
   root_resdomain.subtree_control = (1 << RD_SUBSYS_CPU) | (1 << RD_SUBSYS_MEM) | (1 << RD_SUBSYS_PID) | (
                                      1 << RD_SUBSYS_IO);
   root_resdomain.child_subsys_mask = root_resdomain.subtree_control;
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    INIT_WORK(&per_cpu_ptr(rd_stocks, cpu)->drain_work, drain_local_stock);
+  }
   for (int i = 0; i < RD_SUBSYS_COUNT; i++) {
     resdomain_init_subsys(&root_resdomain, i);
   }
@@ -521,63 +850,6 @@ int __no_cfi resdomain_attach_task(struct resdomain *rd, struct task_struct *tas
   return 0;
 }
 
-int __no_cfi resdomain_charge_mem(struct resdomain *rd, uint64_t bytes, bool force) {
-  if (!rd) rd = &root_resdomain;
-  struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
-  if (!ms) return 0;
-
-  uint64_t usage = atomic64_read(&ms->usage);
-  
-  /* 
-   * HARD LIMIT ENFORCEMENT:
-   * If we exceed the limit, try direct reclaim before failing.
-   */
-  if (!force && (ms->max != (uint64_t) -1) && (usage + bytes > ms->max)) {
-#ifdef CONFIG_MM_RESDOMAIN_DIRECT_RECLAIM
-    /* 
-     * DIRECT RECLAIM:
-     * We call into the memory management system to attempt to free pages.
-     */
-    extern size_t try_to_free_pages(struct pglist_data *pgdat, size_t nr_to_reclaim, gfp_t gfp_mask);
-    
-    size_t nr_to_reclaim = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT;
-    /* Try to reclaim from all online nodes */
-    for (int i = 0; i < MAX_NUMNODES; i++) {
-        if (node_data[i]) {
-            try_to_free_pages(node_data[i], nr_to_reclaim, GFP_KERNEL);
-        }
-    }
-
-    /* Re-check usage after reclaim */
-    usage = atomic64_read(&ms->usage);
-    if (usage + bytes > ms->max) {
-        return -ENOMEM;
-    }
-#else
-    return -ENOMEM;
-#endif
-  }
-
-  atomic64_add(bytes, &ms->usage);
-  if (rd->parent) {
-    if (resdomain_charge_mem(rd->parent, bytes, force) < 0) {
-      atomic64_sub(bytes, &ms->usage);
-      return -ENOMEM;
-    }
-  }
-  return 0;
-}
-
-void resdomain_uncharge_mem(struct resdomain *rd, uint64_t bytes) {
-  if (!rd) rd = &root_resdomain;
-  struct mem_rd_state *ms = (struct mem_rd_state *) rd->subsys[RD_SUBSYS_MEM];
-  if (!ms) return;
-  atomic64_sub(bytes, &ms->usage);
-  if (rd->parent) {
-    resdomain_uncharge_mem(rd->parent, bytes);
-  }
-}
-
 int resdomain_can_fork(struct resdomain *rd) {
   if (!rd) rd = &root_resdomain;
   struct pid_rd_state *ps = (struct pid_rd_state *) rd->subsys[RD_SUBSYS_PID];
@@ -672,6 +944,7 @@ int resdomain_io_throttle(struct resdomain *rd, uint64_t bytes) {
     if (wait_ns > 100000000ULL) wait_ns = 100000000ULL; /* 100ms max sleep per check */
 
     /* Sleep */
+    set_current_state(TASK_UNINTERRUPTIBLE);
     schedule_timeout(wait_ns);
 
     /* Retry */
@@ -22,89 +22,521 @@
 #include <aerosync/wait.h>
 #include <aerosync/sched/sched.h>
 #include <aerosync/atomic.h>
+#include <aerosync/export.h>
+#include <arch/x86_64/percpu.h>
+#ifdef CONFIG_RWSEM_BENCH
+#include <aerosync/classes.h>
+#include <aerosync/completion.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sched/process.h>
+#include <aerosync/timer.h>
+#include <arch/x86_64/smp.h>
+#include <lib/printk.h>
+#endif
 
-/**
- * Simple RW-Semaphore implementation.
- * Note: This implementation is functional but can be further optimized
- * with architecture-specific atomics if needed.
+/*
+ * count layout:
+ *   bit 0:  a writer holds the semaphore
+ *   bit 1:  wait_list is non-empty
+ *   bit 2:  the next release is reserved for the first waiter
+ *   bits 8+: number of readers holding it (plus readers on their way into
+ *            the slow path, whose bias is removed under wait_lock)
+ *
+ * Readers add their bias first and back out in the slow path, so an
+ * uncontended down_read()/up_read() is a single atomic add each.
  */
 
-void rwsem_init(struct rw_semaphore *sem) {
-    atomic_set(&sem->count, RWSEM_UNLOCKED_VALUE);
+enum rwsem_waiter_type {
+    RWSEM_WAITING_FOR_WRITE,
+    RWSEM_WAITING_FOR_READ,
+};
+
+struct rwsem_waiter {
+    struct list_head list;
+    struct task_struct *task; /* Cleared by the waker once a reader is granted */
+    enum rwsem_waiter_type type;
+};
+
+void (rwsem_init)(struct rw_semaphore *sem) {
+    sem->count = RWSEM_UNLOCKED_VALUE;
+    sem->owner = nullptr;
     spinlock_init(&sem->wait_lock);
-    init_waitqueue_head(&sem->wait_list);
+    INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+    mcs_lock_init(&sem->osq);
+#endif
 }
+EXPORT_SYMBOL(rwsem_init);
 
 int rwsem_is_write_locked(const struct rw_semaphore *sem) {
-    return atomic_read(&sem->count) == -1;
+    return (READ_ONCE(sem->count) & RWSEM_WRITER_LOCKED) != 0;
 }
+EXPORT_SYMBOL(rwsem_is_write_locked);
 
 int rwsem_is_locked(const struct rw_semaphore *sem) {
-    return atomic_read(&sem->count) < 0;
+    return (READ_ONCE(sem->count) & RWSEM_LOCK_MASK) != 0;
+}
+EXPORT_SYMBOL(rwsem_is_locked);
+
+/*
+ * Wake the head of the queue; caller holds wait_lock. A writer at the head
+ * is woken to take the lock itself. Readers at the head are granted the
+ * lock right here, all of them up to the next writer in one batch.
+ */
+static void rwsem_mark_wake(struct rw_semaphore *sem, bool readers_only) {
+    struct rwsem_waiter *waiter, *tmp;
+    unsigned long nr_readers = 0;
+
+    if (list_empty(&sem->wait_list))
+        return;
+
+    waiter = list_first_entry(&sem->wait_list, struct rwsem_waiter, list);
+    if (waiter->type == RWSEM_WAITING_FOR_WRITE) {
+        if (!readers_only)
+            task_wake_up(waiter->task);
+        return;
+    }
+
+    list_for_each_entry(waiter, &sem->wait_list, list) {
+        if (waiter->type == RWSEM_WAITING_FOR_WRITE)
+            break;
+        nr_readers++;
+    }
+
+    unsigned long adjust = nr_readers * RWSEM_READER_BIAS;
+    unsigned long old = __atomic_fetch_add(&sem->count, adjust, __ATOMIC_ACQUIRE);
+    if (old & RWSEM_WRITER_LOCKED) {
+        /*
+         * A spinning writer got in first. Back out and reserve the next
+         * release for the readers; its up_write() comes back here.
+         */
+        __atomic_fetch_sub(&sem->count, adjust, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&sem->count, RWSEM_FLAG_HANDOFF, __ATOMIC_RELAXED);
+        return;
+    }
+
+    list_for_each_entry_safe(waiter, tmp, &sem->wait_list, list) {
+        if (waiter->type == RWSEM_WAITING_FOR_WRITE)
+            break;
+
+        /* The waiter re-checks under wait_lock, so its stack stays put */
+        list_del(&waiter->list);
+        task_wake_up(waiter->task);
+        WRITE_ONCE(waiter->task, nullptr);
+    }
+
+    unsigned long clear = RWSEM_FLAG_HANDOFF;
+    if (list_empty(&sem->wait_list))
+        clear |= RWSEM_FLAG_WAITERS;
+    __atomic_fetch_and(&sem->count, ~clear, __ATOMIC_RELAXED);
+}
+
+static void __noinline rwsem_wake(struct rw_semaphore *sem, bool readers_only) {
+    irq_flags_t flags = spinlock_lock_irqsave(&sem->wait_lock);
+    rwsem_mark_wake(sem, readers_only);
+    spinlock_unlock_irqrestore(&sem->wait_lock, flags);
+}
+
+static void __noinline rwsem_down_read_slowpath(struct rw_semaphore *sem) {
+    struct rwsem_waiter waiter;
+    unsigned long cnt;
+
+    irq_flags_t flags = spinlock_lock_irqsave(&sem->wait_lock);
+
+    /* Everyone ahead of us is gone and no writer holds it: our bias wins */
+    cnt = READ_ONCE(sem->count);
+    if (list_empty(&sem->wait_list) &&
+        !(cnt & (RWSEM_WRITER_LOCKED | RWSEM_FLAG_HANDOFF))) {
+        spinlock_unlock_irqrestore(&sem->wait_lock, flags);
+        return;
+    }
+
+    waiter.task = current;
+    waiter.type = RWSEM_WAITING_FOR_READ;
+    list_add_tail(&waiter.list, &sem->wait_list);
+    __atomic_fetch_or(&sem->count, RWSEM_FLAG_WAITERS, __ATOMIC_RELAXED);
+
+    /* Dropping our bias may have been what kept the lock busy */
+    cnt = __atomic_sub_fetch(&sem->count, RWSEM_READER_BIAS, __ATOMIC_RELEASE);
+    if (!(cnt & RWSEM_LOCK_MASK))
+        rwsem_mark_wake(sem, false);
+
+    while (READ_ONCE(waiter.task)) {
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        spinlock_unlock_irqrestore(&sem->wait_lock, flags);
+        schedule();
+        flags = spinlock_lock_irqsave(&sem->wait_lock);
+        __set_current_state(TASK_RUNNING);
+    }
+
+    spinlock_unlock_irqrestore(&sem->wait_lock, flags);
 }
 
 void down_read(struct rw_semaphore *sem) {
-    while (1) {
-        int old = atomic_read(&sem->count);
-        if (old >= 0) {
-            if (atomic_cmpxchg(&sem->count, old, old + 1) == old)
-                return;
-        }
-        
-        // Wait for it to become positive
-        wait_queue_entry_t wait;
-        init_wait(&wait);
-        prepare_to_wait(&sem->wait_list, &wait, TASK_UNINTERRUPTIBLE);
-        if (atomic_read(&sem->count) < 0) {
-            schedule();
-        }
-        finish_wait(&sem->wait_list, &wait);
+    unsigned long cnt =
+        __atomic_add_fetch(&sem->count, RWSEM_READER_BIAS, __ATOMIC_ACQUIRE);
+
+    if (unlikely(cnt & RWSEM_READ_FAILED_MASK)) {
+#ifdef CONFIG_LOCK_STAT
+        uint64_t start = lockstat_clock();
+        rwsem_down_read_slowpath(sem);
+        lockstat_contended(&sem->dep, start, LOCKSTAT_RET_IP);
+#else
+        rwsem_down_read_slowpath(sem);
+#endif
     }
+    lockstat_acquired(&sem->dep, false);
 }
+EXPORT_SYMBOL(down_read);
 
 int down_read_trylock(struct rw_semaphore *sem) {
-    int old = atomic_read(&sem->count);
-    if (old >= 0) {
-        if (atomic_cmpxchg(&sem->count, old, old + 1) == old)
+    unsigned long cnt = READ_ONCE(sem->count);
+
+    while (!(cnt & RWSEM_READ_FAILED_MASK)) {
+        if (try_cmpxchg(&sem->count, &cnt, cnt + RWSEM_READER_BIAS)) {
+            lockstat_acquired(&sem->dep, false);
             return 1;
+        }
     }
     return 0;
 }
+EXPORT_SYMBOL(down_read_trylock);
 
 void up_read(struct rw_semaphore *sem) {
-    int old = atomic_dec_return(&sem->count);
-    if (old == 0) {
-        wake_up(&sem->wait_list);
+    unsigned long cnt =
+        __atomic_sub_fetch(&sem->count, RWSEM_READER_BIAS, __ATOMIC_RELEASE);
+
+    /* Last reader out with somebody queued */
+    if (unlikely((cnt & (RWSEM_READER_MASK | RWSEM_FLAG_WAITERS)) ==
+                 RWSEM_FLAG_WAITERS))
+        rwsem_wake(sem, false);
+}
+EXPORT_SYMBOL(up_read);
+
+/* Take the write lock if free; a pending handoff belongs to the first waiter */
+static bool rwsem_try_write_lock(struct rw_semaphore *sem, bool first) {
+    unsigned long cnt = READ_ONCE(sem->count);
+
+    for (;;) {
+        if (cnt & RWSEM_LOCK_MASK)
+            return false;
+        if ((cnt & RWSEM_FLAG_HANDOFF) && !first)
+            return false;
+
+        unsigned long new = (cnt | RWSEM_WRITER_LOCKED) & ~RWSEM_FLAG_HANDOFF;
+        if (try_cmpxchg(&sem->count, &cnt, new))
+            return true;
     }
 }
 
-void down_write(struct rw_semaphore *sem) {
-    while (1) {
-        if (atomic_cmpxchg(&sem->count, 0, -1) == 0)
-            return;
-
-        wait_queue_entry_t wait;
-        init_wait(&wait);
-        prepare_to_wait(&sem->wait_list, &wait, TASK_UNINTERRUPTIBLE);
-        if (atomic_read(&sem->count) != 0) {
-            schedule();
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+
+DEFINE_PER_CPU(struct mcs_lock_node, rwsem_spin_node);
+
+/*
+ * Spin for the write lock while the writer holding it is running. Readers
+ * give no owner to watch, so a read-held semaphore ends the spin.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem) {
+    struct mcs_lock_node *node;
+    bool acquired = false;
+
+    preempt_disable();
+    node = this_cpu_ptr(rwsem_spin_node);
+    mcs_spin_lock(&sem->osq, node);
+
+    for (;;) {
+        unsigned long cnt = READ_ONCE(sem->count);
+
+        if (!(cnt & (RWSEM_LOCK_MASK | RWSEM_FLAG_HANDOFF))) {
+            if (try_cmpxchg(&sem->count, &cnt, cnt | RWSEM_WRITER_LOCKED)) {
+                acquired = true;
+                break;
+            }
+            continue;
         }
-        finish_wait(&sem->wait_list, &wait);
+
+        if (cnt & (RWSEM_FLAG_HANDOFF | RWSEM_READER_MASK))
+            break;
+
+        /* The owner is published just after the count; keep going if unset */
+        struct task_struct *owner = READ_ONCE(sem->owner);
+        if (owner && !task_on_cpu(owner))
+            break;
+        if (this_cpu_read(need_resched))
+            break;
+
+        cpu_relax();
+    }
+
+    mcs_spin_unlock(&sem->osq, node);
+    preempt_enable();
+    return acquired;
+}
+
+#endif /* CONFIG_RWSEM_SPIN_ON_OWNER */
+
+static void __noinline rwsem_down_write_slowpath(struct rw_semaphore *sem) {
+    struct rwsem_waiter waiter;
+    bool woken = false;
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+    if (rwsem_optimistic_spin(sem))
+        return;
+#endif
+
+    irq_flags_t flags = spinlock_lock_irqsave(&sem->wait_lock);
+
+    waiter.task = current;
+    waiter.type = RWSEM_WAITING_FOR_WRITE;
+    list_add_tail(&waiter.list, &sem->wait_list);
+    __atomic_fetch_or(&sem->count, RWSEM_FLAG_WAITERS, __ATOMIC_RELAXED);
+
+    for (;;) {
+        bool first = list_first_entry(&sem->wait_list, struct rwsem_waiter,
+                                      list) == &waiter;
+
+        if (rwsem_try_write_lock(sem, first))
+            break;
+
+        /* Woken and beaten to it again: reserve the next release */
+        if (woken && first)
+            __atomic_fetch_or(&sem->count, RWSEM_FLAG_HANDOFF, __ATOMIC_RELAXED);
+
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        spinlock_unlock_irqrestore(&sem->wait_lock, flags);
+        schedule();
+        flags = spinlock_lock_irqsave(&sem->wait_lock);
+        __set_current_state(TASK_RUNNING);
+        woken = true;
     }
+
+    list_del(&waiter.list);
+    if (list_empty(&sem->wait_list))
+        __atomic_fetch_and(&sem->count, ~(RWSEM_FLAG_WAITERS | RWSEM_FLAG_HANDOFF),
+                           __ATOMIC_RELAXED);
+
+    spinlock_unlock_irqrestore(&sem->wait_lock, flags);
 }
 
+void down_write(struct rw_semaphore *sem) {
+    unsigned long unlocked = RWSEM_UNLOCKED_VALUE;
+
+    if (unlikely(!try_cmpxchg(&sem->count, &unlocked, RWSEM_WRITER_LOCKED))) {
+#ifdef CONFIG_LOCK_STAT
+        uint64_t start = lockstat_clock();
+        rwsem_down_write_slowpath(sem);
+        lockstat_contended(&sem->dep, start, LOCKSTAT_RET_IP);
+#else
+        rwsem_down_write_slowpath(sem);
+#endif
+    }
+    WRITE_ONCE(sem->owner, current);
+    lockstat_acquired(&sem->dep, true);
+}
+EXPORT_SYMBOL(down_write);
+
 int down_write_trylock(struct rw_semaphore *sem) {
-    if (atomic_cmpxchg(&sem->count, 0, -1) == 0)
-        return 1;
+    unsigned long cnt = READ_ONCE(sem->count);
+
+    while (!(cnt & (RWSEM_LOCK_MASK | RWSEM_FLAG_HANDOFF))) {
+        if (try_cmpxchg(&sem->count, &cnt, cnt | RWSEM_WRITER_LOCKED)) {
+            WRITE_ONCE(sem->owner, current);
+            lockstat_acquired(&sem->dep, true);
+            return 1;
+        }
+    }
     return 0;
 }
+EXPORT_SYMBOL(down_write_trylock);
 
 void up_write(struct rw_semaphore *sem) {
-    atomic_set(&sem->count, 0);
-    wake_up_all(&sem->wait_list);
+    unsigned long locked = RWSEM_WRITER_LOCKED;
+
+    lockstat_released(&sem->dep);
+    WRITE_ONCE(sem->owner, nullptr);
+    if (likely(try_cmpxchg(&sem->count, &locked, RWSEM_UNLOCKED_VALUE)))
+        return;
+
+    unsigned long cnt =
+        __atomic_fetch_and(&sem->count, ~RWSEM_WRITER_LOCKED, __ATOMIC_RELEASE);
+    if (cnt & RWSEM_FLAG_WAITERS)
+        rwsem_wake(sem, false);
 }
+EXPORT_SYMBOL(up_write);
 
 void downgrade_write(struct rw_semaphore *sem) {
-    atomic_set(&sem->count, 1);
-    wake_up_all(&sem->wait_list);
+    lockstat_released(&sem->dep);
+    WRITE_ONCE(sem->owner, nullptr);
+
+    /* Writer bit out, one reader bias in, flags untouched */
+    unsigned long cnt = __atomic_add_fetch(
+        &sem->count, RWSEM_READER_BIAS - RWSEM_WRITER_LOCKED, __ATOMIC_RELEASE);
+
+    /* Only readers can run alongside us now */
+    if (cnt & RWSEM_FLAG_WAITERS)
+        rwsem_wake(sem, true);
 }
+EXPORT_SYMBOL(downgrade_write);
+
+#ifdef CONFIG_RWSEM_BENCH
+
+#define RWSEM_BENCH_OPS         20000
+#define RWSEM_BENCH_MAX_THREADS 64
+#define RWSEM_BENCH_THINK       32 /* cpu_relax() between operations */
+
+static const int rwsem_bench_write_pct[] = {0, 10, 50, 90, 100};
+
+static struct {
+    struct rw_semaphore sem;
+    int write_pct;
+    int nr_threads;
+    int go;
+    atomic_t arrived;
+    atomic_t running;
+    atomic_t errors;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t nr_writes;      /* Updated under the write lock */
+    uint64_t max_write_wait; /* ns, updated under the write lock */
+    struct completion done;
+
+    /* Writers keep a == b; readers must never see them differ */
+    uint64_t a;
+    uint64_t b;
+} rwsem_bench_state;
+
+static void rwsem_bench_arrive(void) {
+    if (atomic_inc_return(&rwsem_bench_state.arrived) ==
+        rwsem_bench_state.nr_threads) {
+        rwsem_bench_state.start_ns = get_time_ns();
+        WRITE_ONCE(rwsem_bench_state.go, 1);
+    }
+}
+
+static void rwsem_bench_leave(void) {
+    if (atomic_dec_and_test(&rwsem_bench_state.running)) {
+        rwsem_bench_state.end_ns = get_time_ns();
+        complete(&rwsem_bench_state.done);
+    }
+}
+
+static void rwsem_bench_check(void) {
+    if (READ_ONCE(rwsem_bench_state.a) != READ_ONCE(rwsem_bench_state.b))
+        atomic_inc(&rwsem_bench_state.errors);
+}
+
+static int rwsem_bench_worker(void *data) {
+    struct rw_semaphore *sem = &rwsem_bench_state.sem;
+    uint64_t seed = (uint64_t)(uintptr_t)data * 2654435761ULL + 1;
+
+    rwsem_bench_arrive();
+    while (!READ_ONCE(rwsem_bench_state.go))
+        cpu_relax();
+
+    for (int i = 0; i < RWSEM_BENCH_OPS; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        if ((int)((seed >> 33) % 100) < rwsem_bench_state.write_pct) {
+            uint64_t t0 = get_time_ns();
+            down_write(sem);
+            uint64_t wait = get_time_ns() - t0;
+
+            if (wait > rwsem_bench_state.max_write_wait)
+                rwsem_bench_state.max_write_wait = wait;
+            rwsem_bench_state.nr_writes++;
+            WRITE_ONCE(rwsem_bench_state.a, rwsem_bench_state.a + 1);
+            WRITE_ONCE(rwsem_bench_state.b, rwsem_bench_state.b + 1);
+
+            if ((i & 7) == 0) {
+                downgrade_write(sem);
+                rwsem_bench_check();
+                up_read(sem);
+            } else {
+                up_write(sem);
+            }
+        } else {
+            down_read(sem);
+            rwsem_bench_check();
+            up_read(sem);
+        }
+
+        for (int d = 0; d < RWSEM_BENCH_THINK; d++)
+            cpu_relax();
+    }
+
+    rwsem_bench_leave();
+    return 0;
+}
+
+static void rwsem_bench_run(int write_pct, int nr_threads) {
+    rwsem_init(&rwsem_bench_state.sem);
+    rwsem_bench_state.write_pct = write_pct;
+    rwsem_bench_state.nr_threads = nr_threads;
+    rwsem_bench_state.go = 0;
+    rwsem_bench_state.nr_writes = 0;
+    rwsem_bench_state.max_write_wait = 0;
+    rwsem_bench_state.a = 0;
+    rwsem_bench_state.b = 0;
+    atomic_set(&rwsem_bench_state.arrived, 0);
+    atomic_set(&rwsem_bench_state.running, nr_threads);
+    atomic_set(&rwsem_bench_state.errors, 0);
+    init_completion(&rwsem_bench_state.done);
+
+    int started = 0;
+    for (int cpu = 0; cpu < nr_threads; cpu++) {
+        struct task_struct *task =
+            kthread_create(rwsem_bench_worker, (void *)(uintptr_t)cpu,
+                           "rwsembench/%d", cpu);
+        if (!task) {
+            rwsem_bench_arrive();
+            rwsem_bench_leave();
+            continue;
+        }
+
+        cpumask_clear(&task->cpus_allowed);
+        cpumask_set_cpu(cpu, &task->cpus_allowed);
+        task->nr_cpus_allowed = 1;
+        set_task_cpu(task, cpu);
+        kthread_run(task);
+        started++;
+    }
+
+    wait_for_completion(&rwsem_bench_state.done);
+
+    if (!started || atomic_read(&rwsem_bench_state.errors) ||
+        rwsem_bench_state.a != rwsem_bench_state.nr_writes ||
+        rwsem_is_locked(&rwsem_bench_state.sem)) {
+        printk(KERN_ERR SYNC_CLASS
+               "rwsembench: %3d%% writes run broken (%d errors, %llu/%llu)\n",
+               write_pct, atomic_read(&rwsem_bench_state.errors),
+               rwsem_bench_state.a, rwsem_bench_state.nr_writes);
+        return;
+    }
+
+    uint64_t ms = (rwsem_bench_state.end_ns - rwsem_bench_state.start_ns) /
+                  1000000ULL;
+    uint64_t ops = (uint64_t)started * RWSEM_BENCH_OPS;
+
+    printk(KERN_INFO SYNC_CLASS
+           "rwsembench: %2d threads, %3d%% writes: %llu ops/ms, "
+           "max write wait %llu us\n",
+           started, write_pct, ops / (ms ? ms : 1),
+           rwsem_bench_state.max_write_wait / 1000);
+}
+
+void rwsem_bench(void) {
+    int cpus = (int)smp_get_cpu_count();
+    if (cpus > RWSEM_BENCH_MAX_THREADS)
+        cpus = RWSEM_BENCH_MAX_THREADS;
+
+    printk(KERN_INFO SYNC_CLASS "rwsembench: %d operations per thread\n",
+           RWSEM_BENCH_OPS);
+
+    for (size_t i = 0;
+         i < sizeof(rwsem_bench_write_pct) / sizeof(rwsem_bench_write_pct[0]);
+         i++)
+        rwsem_bench_run(rwsem_bench_write_pct[i], cpus);
+}
+
+#endif /* CONFIG_RWSEM_BENCH */
@@ -21,6 +21,7 @@
 #include <arch/x86_64/cpu.h>
 #include <arch/x86_64/fpu.h>
 #include <arch/x86_64/mm/vmm.h>
+#include <arch/x86_64/mm/tlb.h>
 #include <arch/x86_64/percpu.h>
 #include <arch/x86_64/smp.h>
 #include <arch/x86_64/tsc.h>
@@ -31,15 +32,21 @@
 #include <aerosync/sched/cpumask.h>
 #include <aerosync/sched/process.h>
 #include <aerosync/sched/sched.h>
+#include <aerosync/sysintf/bio.h>
 #include <aerosync/sysintf/ic.h>
 #include <aerosync/mutex.h>
+#include <aerosync/rcu.h>
 #include <aerosync/softirq.h>
 #include <lib/printk.h>
 #include <lib/string.h>
 #include <linux/container_of.h>
 #include <mm/slub.h>
+#include <mm/numa_balancing.h>
 #include <mm/vma.h>
 #include <aerosync/timer.h>
+#include <aerosync/hrtimer.h>
+#include <aerosync/tick.h>
+#include <aerosync/workqueue.h>
 #include <vsprintf.h>
 #include <aerosync/resdomain.h>
 #include <arch/x86_64/gdt/gdt.h>
@@ -193,22 +200,21 @@ void __no_cfi sched_move_task(struct task_struct *p) {
 
 EXPORT_SYMBOL(sched_move_task);
 
+/*
+ * The arch layer tracks what is really loaded in CR3: @prev may differ from
+ * it when a lazy CPU was kicked back to the kernel page table by a
+ * shootdown, so same-mm switches are not short-circuited here.
+ */
 static void switch_mm(struct mm_struct *prev, struct mm_struct *next,
                       struct task_struct *tsk) {
-  int cpu = smp_get_id();
-  if (prev == next)
+  (void) prev;
+  if (!tsk->mm) {
+    /* Kernel thread: keep borrowing the previous address space */
+    tlb_enter_lazy();
     return;
-
-  if (prev) {
-    cpumask_clear_cpu(cpu, &prev->cpu_mask);
   }
 
-  if (next && next->pml_root) {
-    cpumask_set_cpu(cpu, &next->cpu_mask);
-    vmm_switch_pml_root((uint64_t) next->pml_root);
-  } else {
-    vmm_switch_pml_root(g_kernel_pml_root);
-  }
+  tlb_switch_mm(next);
 }
 
 /*
@@ -319,8 +325,10 @@ void __no_cfi __update_task_prio(struct task_struct *p) {
     spinlock_unlock(&rq->lock);
 
     /* Propagate if this task is also blocked on a mutex */
-    if (p->pi_blocked_on && p->pi_blocked_on->owner) {
-      pi_boost_prio(p->pi_blocked_on->owner, p);
+    if (p->pi_blocked_on) {
+      struct task_struct *owner = mutex_owner(p->pi_blocked_on);
+      if (owner)
+        pi_boost_prio(owner, p);
     }
   }
 }
@@ -415,7 +423,46 @@ long schedule_timeout(uint64_t ns) {
 
   schedule();
 
-  timer_del(&timer);
+  /* The timer lives on our stack: wait out a handler running elsewhere */
+  timer_del_sync(&timer);
+
+  long remaining = (long) (expire - get_time_ns());
+  return remaining < 0 ? 0 : remaining;
+}
+
+struct hrtimer_sleeper {
+  struct hrtimer timer;
+  struct task_struct *task;
+};
+
+static enum hrtimer_restart hrtimer_wakeup(struct hrtimer *timer) {
+  struct hrtimer_sleeper *sl = container_of(timer, struct hrtimer_sleeper, timer);
+  struct task_struct *task = sl->task;
+
+  sl->task = nullptr;
+  if (task)
+    task_wake_up(task);
+  return HRTIMER_NORESTART;
+}
+
+long schedule_hrtimeout(uint64_t ns) {
+  struct hrtimer_sleeper sl;
+  uint64_t expire;
+
+  if (ns == 0) {
+    schedule();
+    return 0;
+  }
+
+  expire = get_time_ns() + ns;
+
+  hrtimer_init(&sl.timer, hrtimer_wakeup);
+  sl.task = get_current();
+  hrtimer_start(&sl.timer, expire, HRTIMER_MODE_ABS);
+
+  schedule();
+
+  hrtimer_cancel(&sl.timer);
 
   long remaining = (long) (expire - get_time_ns());
   return remaining < 0 ? 0 : remaining;
@@ -561,6 +608,17 @@ void __no_cfi schedule(void) {
     return;
   }
 
+  /* Passing through here is a quiescent state for RCU */
+  rcu_note_context_switch();
+
+  /* Don't sit on plugged block I/O while sleeping */
+  if (unlikely(current->plug) && current->state != TASK_RUNNING)
+    blk_flush_plug(current->plug);
+
+  /* A blocking workqueue worker may have to hand its queue to an idle one */
+  if ((current->flags & PF_WQ_WORKER) && current->state != TASK_RUNNING)
+    wq_worker_sleeping(current);
+
   irq_flags_t flags = spinlock_lock_irqsave(&rq->lock);
   prev_task = rq->curr;
 
@@ -606,6 +664,10 @@ void __no_cfi schedule(void) {
     rq->curr = next_task;
     set_current(next_task);
 
+    /* Leaving idle (possibly straight from an interrupt): restart the tick */
+    if (prev_task == rq->idle)
+      tick_nohz_idle_exit();
+
     /* Switch MM */
     unmet_cond_crit(!prev_task);
     if (next_task->mm) {
@@ -632,16 +694,32 @@ void __no_cfi schedule(void) {
     schedule_tail(prev_task);
 
     restore_irq_flags(flags);
+    if (current->flags & PF_WQ_WORKER)
+      wq_worker_running(current);
     return;
   }
 
   spinlock_unlock_irqrestore(&rq->lock, flags);
+  if (current->flags & PF_WQ_WORKER)
+    wq_worker_running(current);
 }
 
 void __noreturn idle_loop(void) {
   while (1) {
     check_preempt();
-    cpu_hlt();
+
+    /*
+     * Decide about the tick and halt with interrupts disabled, so a wakeup
+     * or a new timer arriving in between is not slept through.
+     */
+    cpu_cli();
+    if (this_cpu_read(need_resched)) {
+      cpu_sti();
+      continue;
+    }
+    if (this_rq()->nr_running == 0)
+      tick_nohz_idle_stop_tick();
+    cpu_safe_halt();
   }
 }
 
@@ -719,7 +797,7 @@ static struct rq *find_busiest_queue(struct sched_group *group, int this_cpu) {
   return busiest;
 }
 
-#ifdef SCHED_AUTO_BALANCE
+#ifdef CONFIG_SCHED_AUTO_BALANCE
 /**
  * load_balance - Hierarchical load balancing across domains
  */
@@ -778,25 +856,34 @@ static void load_balance(void) {
       /* Equalize load by moving tasks */
       unsigned long imbalance = (max_load - this_load) / 2;
       unsigned long moved_load = 0;
-      int loop_limit = 32;
 
-      struct rb_node *n = rb_first(&src_rq->cfs.tasks_timeline);
-      while (n && moved_load < imbalance && loop_limit-- > 0) {
-        struct sched_entity *se = rb_entry(n, struct sched_entity, run_node);
-        struct task_struct *t = container_of(se, struct task_struct, se);
-
-        n = rb_next(n);
-
-        if (t == src_rq->curr) continue;
-        if (!task_can_run_on(t, this_cpu)) continue;
-
-        /* Move the task to our runqueue */
-        __move_task_to_rq_locked(t, this_cpu);
-        moved_load += se->load.weight;
-        pulled++;
-
-        /* Stop if we've pulled enough to satisfy imbalance */
-        if (pulled >= 4 && moved_load >= imbalance) break;
+      /*
+       * First pull tasks whose preferred NUMA node is ours, then anything
+       * that would not be dragged away from its preferred node.
+       */
+      for (int pass = 0; pass < 2 && moved_load < imbalance; pass++) {
+        int loop_limit = 32;
+
+        struct rb_node *n = rb_first(&src_rq->cfs.tasks_timeline);
+        while (n && moved_load < imbalance && loop_limit-- > 0) {
+          struct sched_entity *se = rb_entry(n, struct sched_entity, run_node);
+          struct task_struct *t = container_of(se, struct task_struct, se);
+
+          n = rb_next(n);
+
+          if (t == src_rq->curr) continue;
+          if (!task_can_run_on(t, this_cpu)) continue;
+          if (pass == 0 && !task_numa_improves_locality(t, src_rq->cpu, this_cpu)) continue;
+          if (pass == 1 && task_numa_degrades_locality(t, src_rq->cpu, this_cpu)) continue;
+
+          /* Move the task to our runqueue */
+          __move_task_to_rq_locked(t, this_cpu);
+          moved_load += se->load.weight;
+          pulled++;
+
+          /* Stop if we've pulled enough to satisfy imbalance */
+          if (pulled >= 4 && moved_load >= imbalance) break;
+        }
       }
 
       if (pulled) {
@@ -949,7 +1036,7 @@ static_assert(MAX_RT_PRIO == 100, "MAX_RT_PRIO != 100");
 void sched_init(void) {
   pid_allocator_init();
 
-#ifdef SCHED_AUTO_BALANCE
+#ifdef CONFIG_SCHED_AUTO_BALANCE
   /* Register softirq for load balancing */
   open_softirq(SCHED_SOFTIRQ, run_rebalance_domains);
 #endif
@@ -23,6 +23,7 @@
 #include <arch/x86_64/mm/paging.h>
 #include <arch/x86_64/mm/pmm.h>
 #include <arch/x86_64/mm/vmm.h>
+#include <arch/x86_64/mm/tlb.h>
 #include <aerosync/elf.h>
 #include <aerosync/errno.h>
 #include <aerosync/sched/process.h>
@@ -195,7 +196,9 @@ static int load_elf_binary(struct task_struct *p, struct linux_binprm *bprm) {
 
   // If we are loading into 'current', we must switch PML4 immediately
   if (p == get_current()) {
-    vmm_switch_pml_root((uint64_t) p->mm->pml_root);
+    irq_flags_t flags = local_irq_save();
+    tlb_switch_mm(p->mm);
+    local_irq_restore(flags);
     if (old_mm && old_mm != &init_mm) mm_destroy(old_mm);
   }
 
@@ -240,7 +243,7 @@ int do_execve_file(struct file *file, const char *name, char **argv, char **envp
 
   /* Read ELF header into buffer for verification */
   vfs_loff_t pos = 0;
-  if (vfs_read(file, bprm.buf, sizeof(bprm.buf), &pos) < (ssize_t) sizeof(Elf64_Ehdr)) {
+  if (kernel_read(file, bprm.buf, sizeof(bprm.buf), &pos) < (ssize_t) sizeof(Elf64_Ehdr)) {
     return -EIO;
   }
 
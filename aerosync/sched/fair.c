@@ -13,6 +13,7 @@
 #include <aerosync/sched/sched.h>
 #include <linux/container_of.h>
 #include <linux/rbtree.h>
+#include <mm/numa_balancing.h>
 #include <mm/vma.h>
 
 #define NS_PER_MS 1000000ULL
@@ -550,6 +551,8 @@ static int select_task_rq_fair(struct task_struct *p, int cpu, int wake_flags) {
   if (p->nr_cpus_allowed == 1)
     return cpumask_first(&p->cpus_allowed);
 
+  int target = -1;
+
   /*
    * For wakeups, try to find an idle sibling to reduce latency.
    * 'cpu' passed here is usually the waker's CPU.
@@ -557,14 +560,19 @@ static int select_task_rq_fair(struct task_struct *p, int cpu, int wake_flags) {
   if (wake_flags & ENQUEUE_WAKEUP) {
     int new_cpu = select_idle_sibling(p, p->cpu, cpu);
     if (cpumask_test_cpu(new_cpu, &p->cpus_allowed))
-      return new_cpu;
+      target = new_cpu;
   }
 
   /* Fallback: Stick to previous CPU if allowed */
-  if (cpumask_test_cpu(p->cpu, &p->cpus_allowed))
-    return p->cpu;
+  if (target < 0)
+    target = cpumask_test_cpu(p->cpu, &p->cpus_allowed) ? p->cpu : cpumask_first(&p->cpus_allowed);
+
+  /* Keep the task near its memory if its preferred node has room */
+  int numa_cpu = task_numa_select_cpu(p, p->cpu, target);
+  if (numa_cpu >= 0)
+    return numa_cpu;
 
-  return cpumask_first(&p->cpus_allowed);
+  return target;
 }
 
 /*
@@ -32,6 +32,7 @@
 #include <lib/id_alloc.h>
 #include <lib/string.h>
 #include <mm/slub.h>
+#include <mm/numa_balancing.h>
 #include <mm/vma.h>
 #include <mm/vmalloc.h>
 #include <lib/vsprintf.h>
@@ -237,6 +238,7 @@ struct task_struct *copy_process(uint64_t clone_flags,
     }
   }
   p->active_mm = p->mm ? p->mm : parent->active_mm;
+  task_numa_init(p, parent, clone_flags & CLONE_VM);
 
   /* Initialize ResDomain for MM */
   if (p->mm && p->mm != parent->mm) {
@@ -0,0 +1,721 @@
+///SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/sysintf/bio.c
+ * @brief Asynchronous bio submission, request merging, plugging and completion
+ * @copyright (C) 2025-2026 assembler-0
+ */
+
+#include <aerosync/classes.h>
+#include <aerosync/completion.h>
+#include <aerosync/errno.h>
+#include <aerosync/fkx/fkx.h>
+#include <aerosync/percpu.h>
+#include <aerosync/resdomain.h>
+#include <aerosync/sched/process.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/softirq.h>
+#include <aerosync/sysintf/bio.h>
+#include <aerosync/sysintf/block.h>
+#include <aerosync/timer.h>
+#include <arch/x86_64/cpu.h>
+#include <lib/printk.h>
+#include <lib/string.h>
+#include <mm/slub.h>
+
+#ifndef BLK_NR_REQUESTS
+#ifndef CONFIG_UDM_BLOCK_NR_REQUESTS
+#define BLK_NR_REQUESTS 128
+#else
+#define BLK_NR_REQUESTS CONFIG_UDM_BLOCK_NR_REQUESTS
+#endif
+#endif
+
+#ifndef BLK_MAX_SECTORS_KB
+#ifndef CONFIG_UDM_BLOCK_MAX_SECTORS_KB
+#define BLK_MAX_SECTORS_KB 512
+#else
+#define BLK_MAX_SECTORS_KB CONFIG_UDM_BLOCK_MAX_SECTORS_KB
+#endif
+#endif
+
+#ifndef BLK_PLUG_MAX
+#ifndef CONFIG_UDM_BLOCK_PLUG_MAX
+#define BLK_PLUG_MAX 32
+#else
+#define BLK_PLUG_MAX CONFIG_UDM_BLOCK_PLUG_MAX
+#endif
+#endif
+
+/* How many plugged requests to look back at when merging */
+#define BLK_PLUG_MERGE_SCAN 8
+
+static kmem_cache_t *bio_cache;
+static kmem_cache_t *request_cache;
+
+static DEFINE_PER_CPU(struct llist_head, blk_cpu_done);
+
+/* --- Bio lifecycle --- */
+
+struct bio *bio_alloc(struct block_device *bdev, uint16_t nr_vecs, uint32_t opf) {
+  if (unlikely(!bio_cache))
+    return nullptr;
+
+  if (nr_vecs > BIO_MAX_VECS)
+    nr_vecs = BIO_MAX_VECS;
+
+  struct bio *bio = kmem_cache_alloc(bio_cache);
+  if (!bio)
+    return nullptr;
+
+  memset(bio, 0, sizeof(*bio));
+  bio->bi_bdev = bdev;
+  bio->bi_opf = opf;
+
+  if (nr_vecs <= BIO_INLINE_VECS) {
+    bio->bi_io_vec = bio->bi_inline_vecs;
+    bio->bi_max_vecs = BIO_INLINE_VECS;
+  } else {
+    bio->bi_io_vec = kmalloc(nr_vecs * sizeof(struct bio_vec));
+    if (!bio->bi_io_vec) {
+      kmem_cache_free(bio_cache, bio);
+      return nullptr;
+    }
+    bio->bi_max_vecs = nr_vecs;
+  }
+
+  return bio;
+}
+EXPORT_SYMBOL(bio_alloc);
+
+void bio_put(struct bio *bio) {
+  if (!bio)
+    return;
+  if (bio->bi_io_vec != bio->bi_inline_vecs)
+    kfree(bio->bi_io_vec);
+  kmem_cache_free(bio_cache, bio);
+}
+EXPORT_SYMBOL(bio_put);
+
+uint32_t bio_add_page(struct bio *bio, struct page *page, uint32_t len, uint32_t offset) {
+  if (!len || (bio->bi_bdev && len % bio->bi_bdev->block_size))
+    return 0;
+
+  /* Extend the previous segment when the new one directly follows it */
+  if (bio->bi_vcnt) {
+    struct bio_vec *prev = &bio->bi_io_vec[bio->bi_vcnt - 1];
+    if (page_to_phys(prev->bv_page) + prev->bv_offset + prev->bv_len ==
+        page_to_phys(page) + offset) {
+      prev->bv_len += len;
+      bio->bi_size += len;
+      return len;
+    }
+  }
+
+  if (bio->bi_vcnt >= bio->bi_max_vecs)
+    return 0;
+
+  struct bio_vec *bv = &bio->bi_io_vec[bio->bi_vcnt++];
+  bv->bv_page = page;
+  bv->bv_len = len;
+  bv->bv_offset = offset;
+  bio->bi_size += len;
+  return len;
+}
+EXPORT_SYMBOL(bio_add_page);
+
+bool bio_add_folio(struct bio *bio, struct folio *folio) {
+  uint32_t len = (uint32_t) folio_size(folio);
+  return bio_add_page(bio, &folio->page, len, 0) == len;
+}
+EXPORT_SYMBOL(bio_add_folio);
+
+void __no_cfi bio_endio(struct bio *bio) {
+  if (bio->bi_end_io)
+    bio->bi_end_io(bio);
+}
+EXPORT_SYMBOL(bio_endio);
+
+static inline uint32_t bio_sectors(struct request_queue *q, struct bio *bio) {
+  return bio->bi_size / q->block_size;
+}
+
+/* --- Requests --- */
+
+static void blk_free_request(struct request_queue *q, struct request *rq) {
+  kmem_cache_free(request_cache, rq);
+  atomic_dec(&q->nr_allocated);
+  wake_up(&q->congestion_wait);
+}
+
+/**
+ * blk_get_request - Allocate a request for @bio, throttling on congestion
+ *
+ * Before sleeping on a congested queue the caller's own plug is flushed,
+ * otherwise the requests we are holding back could be the ones we wait on.
+ */
+static struct request *blk_get_request(struct request_queue *q, struct bio *bio) {
+  while (atomic_read(&q->nr_allocated) >= (int) q->nr_requests && !in_interrupt()) {
+    if (current && current->plug)
+      blk_flush_plug(current->plug);
+    wait_event(q->congestion_wait,
+               atomic_read(&q->nr_allocated) < (int) q->nr_requests);
+  }
+
+  struct request *rq = kmem_cache_alloc(request_cache);
+  if (!rq)
+    return nullptr;
+  atomic_inc(&q->nr_allocated);
+
+  memset(rq, 0, sizeof(*rq));
+  INIT_LIST_HEAD(&rq->queuelist);
+  rq->q = q;
+  rq->cmd_flags = bio->bi_opf;
+  rq->sector = bio->bi_sector;
+  rq->nr_sectors = bio_sectors(q, bio);
+  rq->nr_segments = bio->bi_vcnt;
+  rq->bio = bio;
+  rq->biotail = bio;
+  rq->start_ns = get_time_ns();
+  return rq;
+}
+
+/* --- Merging --- */
+
+enum blk_merge {
+  BLK_NO_MERGE = 0,
+  BLK_BACK_MERGE,
+  BLK_FRONT_MERGE,
+};
+
+static enum blk_merge blk_try_merge(struct request *rq, struct bio *bio) {
+  struct request_queue *q = rq->q;
+  uint32_t sectors = bio_sectors(q, bio);
+
+  if ((rq->cmd_flags | bio->bi_opf) & REQ_NOMERGE)
+    return BLK_NO_MERGE;
+  if (rq_op(rq) != bio_op(bio) || rq_op(rq) == REQ_OP_FLUSH)
+    return BLK_NO_MERGE;
+  if (rq->nr_sectors + sectors > q->max_sectors)
+    return BLK_NO_MERGE;
+  if (rq->nr_segments + bio->bi_vcnt > q->max_segments)
+    return BLK_NO_MERGE;
+
+  if (rq->sector + rq->nr_sectors == bio->bi_sector)
+    return BLK_BACK_MERGE;
+  if (bio->bi_sector + sectors == rq->sector)
+    return BLK_FRONT_MERGE;
+  return BLK_NO_MERGE;
+}
+
+static bool blk_attempt_merge(struct request *rq, struct bio *bio) {
+  struct request_queue *q = rq->q;
+
+  switch (blk_try_merge(rq, bio)) {
+  case BLK_BACK_MERGE:
+    rq->biotail->bi_next = bio;
+    rq->biotail = bio;
+    atomic_long_inc(&q->nr_back_merges);
+    break;
+  case BLK_FRONT_MERGE:
+    bio->bi_next = rq->bio;
+    rq->bio = bio;
+    rq->sector = bio->bi_sector;
+    atomic_long_inc(&q->nr_front_merges);
+    break;
+  default:
+    return false;
+  }
+
+  rq->nr_sectors += bio_sectors(q, bio);
+  rq->nr_segments += bio->bi_vcnt;
+  rq->cmd_flags |= bio->bi_opf & REQ_SYNC;
+  return true;
+}
+
+/* Called with q->lock held */
+static bool blk_queue_merge(struct request_queue *q, struct bio *bio) {
+  if (q->last_merge && blk_attempt_merge(q->last_merge, bio))
+    return true;
+
+  struct request *rq;
+  list_for_each_entry(rq, &q->queue, queuelist) {
+    if (rq->sector > bio->bi_sector + bio_sectors(q, bio))
+      break; /* Sorted: nothing further can be adjacent */
+    if (blk_attempt_merge(rq, bio)) {
+      q->last_merge = rq;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Called with q->lock held */
+static void blk_insert_request(struct request_queue *q, struct request *rq) {
+  struct request *pos;
+
+  list_for_each_entry(pos, &q->queue, queuelist) {
+    if (pos->sector > rq->sector)
+      break;
+  }
+  list_add_tail(&rq->queuelist, &pos->queuelist);
+  q->nr_pending++;
+  q->last_merge = rq;
+}
+
+/* --- Plugging --- */
+
+void blk_start_plug(struct blk_plug *plug) {
+  struct task_struct *tsk = current;
+
+  INIT_LIST_HEAD(&plug->list);
+  plug->count = 0;
+
+  /* Nested plugs are folded into the outermost one */
+  if (tsk && !tsk->plug)
+    tsk->plug = plug;
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+void blk_flush_plug(struct blk_plug *plug) {
+  struct request_queue *kick = nullptr;
+
+  while (!list_empty(&plug->list)) {
+    struct request *rq = list_first_entry(&plug->list, struct request, queuelist);
+    struct request_queue *q = rq->q;
+    list_del_init(&rq->queuelist);
+
+    if (kick && kick != q)
+      wake_up(&kick->dispatch_wait);
+    kick = q;
+
+    irq_flags_t flags = spinlock_lock_irqsave(&q->lock);
+    blk_insert_request(q, rq);
+    spinlock_unlock_irqrestore(&q->lock, flags);
+  }
+  plug->count = 0;
+
+  if (kick)
+    wake_up(&kick->dispatch_wait);
+}
+EXPORT_SYMBOL(blk_flush_plug);
+
+void blk_finish_plug(struct blk_plug *plug) {
+  struct task_struct *tsk = current;
+
+  blk_flush_plug(plug);
+  if (tsk && tsk->plug == plug)
+    tsk->plug = nullptr;
+}
+EXPORT_SYMBOL(blk_finish_plug);
+
+static bool blk_plug_merge(struct blk_plug *plug, struct request_queue *q, struct bio *bio) {
+  struct request *rq;
+  int scanned = 0;
+
+  list_for_each_entry_reverse(rq, &plug->list, queuelist) {
+    if (++scanned > BLK_PLUG_MERGE_SCAN)
+      break;
+    if (rq->q == q && blk_attempt_merge(rq, bio))
+      return true;
+  }
+  return false;
+}
+
+/* --- Submission --- */
+
+/**
+ * blk_execute_direct - Synchronous fallback for disks without a queue
+ */
+static void __no_cfi blk_execute_direct(struct block_device *bdev, struct bio *bio) {
+  uint64_t sector = bio->bi_sector;
+  struct bio_vec *bv;
+  int i, ret = 0;
+
+  mutex_lock(&bdev->lock);
+  if (bio_op(bio) == REQ_OP_FLUSH) {
+    ret = bdev->ops->flush ? bdev->ops->flush(bdev) : 0;
+  } else {
+    bio_for_each_bvec(bv, bio, i) {
+      void *addr = (uint8_t *) page_address(bv->bv_page) + bv->bv_offset;
+      uint32_t count = bv->bv_len / bdev->block_size;
+      ret = bio_data_dir(bio) ? bdev->ops->write(bdev, addr, sector, count)
+                              : bdev->ops->read(bdev, addr, sector, count);
+      if (ret)
+        break;
+      sector += count;
+    }
+  }
+  mutex_unlock(&bdev->lock);
+
+  bio->bi_status = ret;
+  bio_endio(bio);
+}
+
+void submit_bio(struct bio *bio) {
+  struct block_device *bdev = bio->bi_bdev;
+
+  if (unlikely(!bdev)) {
+    bio->bi_status = -EINVAL;
+    bio_endio(bio);
+    return;
+  }
+
+  /* Remap partitions onto the parent disk */
+  if (bdev->parent_disk) {
+    bio->bi_sector += bdev->partition_offset;
+    bdev = bdev->parent_disk;
+    bio->bi_bdev = bdev;
+  }
+
+  if (bio_op(bio) != REQ_OP_FLUSH) {
+    uint64_t sectors = bio->bi_size / bdev->block_size;
+    if (!bio->bi_size || bio->bi_size % bdev->block_size ||
+        bio->bi_sector + sectors > bdev->sector_count) {
+      bio->bi_status = -ERANGE;
+      bio_endio(bio);
+      return;
+    }
+    if (bio_data_dir(bio) && !bdev->ops->write) {
+      bio->bi_status = -ENOSYS;
+      bio_endio(bio);
+      return;
+    }
+
+    if (current && current->rd)
+      resdomain_io_throttle(current->rd, bio->bi_size);
+  }
+
+  struct request_queue *q = bdev->queue;
+  if (!q) {
+    blk_execute_direct(bdev, bio);
+    return;
+  }
+
+  atomic_long_inc(&q->nr_bios);
+
+  struct blk_plug *plug = current ? current->plug : nullptr;
+  if (plug && bio_op(bio) != REQ_OP_FLUSH) {
+    if (blk_plug_merge(plug, q, bio))
+      return;
+
+    struct request *rq = blk_get_request(q, bio);
+    if (!rq) {
+      bio->bi_status = -ENOMEM;
+      bio_endio(bio);
+      return;
+    }
+
+    list_add_tail(&rq->queuelist, &plug->list);
+    if (++plug->count >= BLK_PLUG_MAX)
+      blk_flush_plug(plug);
+    return;
+  }
+
+  irq_flags_t flags = spinlock_lock_irqsave(&q->lock);
+  bool merged = blk_queue_merge(q, bio);
+  spinlock_unlock_irqrestore(&q->lock, flags);
+  if (merged)
+    return;
+
+  struct request *rq = blk_get_request(q, bio);
+  if (!rq) {
+    bio->bi_status = -ENOMEM;
+    bio_endio(bio);
+    return;
+  }
+
+  flags = spinlock_lock_irqsave(&q->lock);
+  blk_insert_request(q, rq);
+  spinlock_unlock_irqrestore(&q->lock, flags);
+
+  wake_up(&q->dispatch_wait);
+}
+EXPORT_SYMBOL(submit_bio);
+
+static void submit_bio_wait_endio(struct bio *bio) {
+  complete(bio->bi_private);
+}
+
+int submit_bio_wait(struct bio *bio) {
+  struct completion done;
+
+  init_completion(&done);
+  bio->bi_private = &done;
+  bio->bi_end_io = submit_bio_wait_endio;
+  bio->bi_opf |= REQ_SYNC;
+
+  submit_bio(bio);
+  if (current && current->plug)
+    blk_flush_plug(current->plug);
+
+  wait_for_completion(&done);
+  return bio->bi_status;
+}
+EXPORT_SYMBOL(submit_bio_wait);
+
+/* --- Dispatch --- */
+
+/**
+ * blk_pick_request - C-LOOK selection with synchronous requests first
+ * Called with q->lock held and q->nr_pending > 0.
+ */
+static struct request *blk_pick_request(struct request_queue *q) {
+  struct request *rq, *ahead = nullptr;
+
+  list_for_each_entry(rq, &q->queue, queuelist) {
+    if (rq->cmd_flags & REQ_SYNC)
+      return rq;
+    if (!ahead && rq->sector >= q->head_pos)
+      ahead = rq;
+  }
+
+  return ahead ? ahead : list_first_entry(&q->queue, struct request, queuelist);
+}
+
+/**
+ * blk_execute_sync - Run a request through the synchronous read/write ops
+ *
+ * Physically contiguous segments are coalesced so each driver call moves
+ * as much data as the request allows.
+ */
+static int __no_cfi blk_execute_sync(struct block_device *dev, struct request *rq) {
+  bool write = rq_op(rq) == REQ_OP_WRITE;
+  uint64_t sector = rq->sector;
+  uint8_t *run = nullptr;
+  uint32_t run_len = 0;
+  int ret = 0;
+
+  mutex_lock(&dev->lock);
+
+  if (rq_op(rq) == REQ_OP_FLUSH) {
+    ret = dev->ops->flush ? dev->ops->flush(dev) : 0;
+    mutex_unlock(&dev->lock);
+    return ret;
+  }
+
+  for (struct bio *bio = rq->bio; bio && !ret; bio = bio->bi_next) {
+    struct bio_vec *bv;
+    int i;
+
+    bio_for_each_bvec(bv, bio, i) {
+      uint8_t *addr = (uint8_t *) page_address(bv->bv_page) + bv->bv_offset;
+
+      if (run && run + run_len == addr) {
+        run_len += bv->bv_len;
+        continue;
+      }
+
+      if (run) {
+        uint32_t count = run_len / dev->block_size;
+        ret = write ? dev->ops->write(dev, run, sector, count)
+                    : dev->ops->read(dev, run, sector, count);
+        if (ret)
+          break;
+        sector += count;
+      }
+      run = addr;
+      run_len = bv->bv_len;
+    }
+  }
+
+  if (!ret && run) {
+    uint32_t count = run_len / dev->block_size;
+    ret = write ? dev->ops->write(dev, run, sector, count)
+                : dev->ops->read(dev, run, sector, count);
+  }
+
+  mutex_unlock(&dev->lock);
+  return ret;
+}
+
+static void __no_cfi blk_execute_request(struct request_queue *q, struct request *rq) {
+  struct block_device *dev = q->bdev;
+
+  if (dev->ops->queue_rq) {
+    int ret = dev->ops->queue_rq(dev, rq);
+    if (ret)
+      blk_end_request(rq, ret);
+    return;
+  }
+
+  blk_end_request(rq, blk_execute_sync(dev, rq));
+}
+
+static bool blk_dispatch_ready(struct request_queue *q) {
+  return q->dying || (q->nr_pending && q->in_flight < q->queue_depth);
+}
+
+static int blk_dispatch_thread(void *data) {
+  struct request_queue *q = data;
+  irq_flags_t flags;
+
+  while (1) {
+    wait_event(q->dispatch_wait, blk_dispatch_ready(q));
+
+    flags = spinlock_lock_irqsave(&q->lock);
+    if (q->dying)
+      break;
+
+    while (q->nr_pending && q->in_flight < q->queue_depth) {
+      struct request *rq = blk_pick_request(q);
+      list_del_init(&rq->queuelist);
+      q->nr_pending--;
+      q->in_flight++;
+      q->head_pos = rq->sector + rq->nr_sectors;
+      if (q->last_merge == rq)
+        q->last_merge = nullptr;
+      spinlock_unlock_irqrestore(&q->lock, flags);
+
+      atomic_long_inc(&q->nr_dispatched);
+      blk_execute_request(q, rq);
+
+      flags = spinlock_lock_irqsave(&q->lock);
+    }
+    spinlock_unlock_irqrestore(&q->lock, flags);
+  }
+
+  /* Queue is going away: fail everything that never reached the driver */
+  while (!list_empty(&q->queue)) {
+    struct request *rq = list_first_entry(&q->queue, struct request, queuelist);
+    list_del_init(&rq->queuelist);
+    q->nr_pending--;
+    q->in_flight++;
+    blk_end_request(rq, -ENODEV);
+  }
+  q->last_merge = nullptr;
+  spinlock_unlock_irqrestore(&q->lock, flags);
+
+  wait_event(q->dispatch_wait, READ_ONCE(q->in_flight) == 0);
+  flags = spinlock_lock_irqsave(&q->lock);
+  spinlock_unlock_irqrestore(&q->lock, flags);
+  kfree(q);
+  return 0;
+}
+
+/* --- Completion --- */
+
+void blk_end_request(struct request *rq, int status) {
+  rq->status = status;
+
+  irq_flags_t flags = local_irq_save();
+  llist_add(&rq->done_node, this_cpu_ptr(blk_cpu_done));
+  raise_softirq(BLOCK_SOFTIRQ);
+  restore_irq_flags(flags);
+}
+EXPORT_SYMBOL(blk_end_request);
+
+static void blk_complete_request(struct request *rq) {
+  struct request_queue *q = rq->q;
+  struct bio *bio = rq->bio;
+
+  while (bio) {
+    struct bio *next = bio->bi_next;
+    bio->bi_next = nullptr;
+    if (rq->status && !bio->bi_status)
+      bio->bi_status = rq->status;
+    bio_endio(bio);
+    bio = next;
+  }
+
+  atomic_long_inc(&q->nr_completed);
+  atomic_long_add((long) (get_time_ns() - rq->start_ns), &q->total_latency_ns);
+
+  /*
+   * Wake the dispatcher under q->lock: a dying queue is only freed once the
+   * dispatcher has reacquired the lock, so we never touch freed memory.
+   */
+  irq_flags_t flags = spinlock_lock_irqsave(&q->lock);
+  q->in_flight--;
+  blk_free_request(q, rq);
+  wake_up(&q->dispatch_wait);
+  spinlock_unlock_irqrestore(&q->lock, flags);
+}
+
+static void blk_done_softirq(struct softirq_action *h) {
+  (void) h;
+  struct llist_node *entries = llist_del_all(this_cpu_ptr(blk_cpu_done));
+  struct request *rq, *tmp;
+
+  entries = llist_reverse_order(entries);
+  llist_for_each_entry_safe(rq, tmp, entries, done_node) {
+    blk_complete_request(rq);
+  }
+}
+
+/* --- Queue setup --- */
+
+struct request_queue *blk_init_queue(struct block_device *bdev) {
+  struct request_queue *q = kzalloc(sizeof(struct request_queue));
+  if (!q)
+    return nullptr;
+
+  spinlock_init(&q->lock);
+  INIT_LIST_HEAD(&q->queue);
+  init_waitqueue_head(&q->dispatch_wait);
+  init_waitqueue_head(&q->congestion_wait);
+
+  q->bdev = bdev;
+  q->block_size = bdev->block_size ? bdev->block_size : 512;
+  q->max_sectors = (BLK_MAX_SECTORS_KB * 1024) / q->block_size;
+  if (!q->max_sectors)
+    q->max_sectors = 1;
+  q->max_segments = BIO_MAX_VECS;
+  q->nr_requests = BLK_NR_REQUESTS;
+  /* Synchronous drivers execute one request at a time from the dispatcher */
+  q->queue_depth = bdev->ops->queue_rq ? BLK_NR_REQUESTS : 1;
+
+  q->dispatcher = kthread_create(blk_dispatch_thread, q, "kblockd/%s",
+                                 bdev->dev.name ? bdev->dev.name : bdev->name);
+  if (!q->dispatcher) {
+    kfree(q);
+    return nullptr;
+  }
+  kthread_run(q->dispatcher);
+
+  return q;
+}
+EXPORT_SYMBOL(blk_init_queue);
+
+void blk_cleanup_queue(struct request_queue *q) {
+  if (!q)
+    return;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&q->lock);
+  q->dying = true;
+  spinlock_unlock_irqrestore(&q->lock, flags);
+
+  /* The dispatcher fails pending requests and frees the queue */
+  wake_up(&q->dispatch_wait);
+}
+EXPORT_SYMBOL(blk_cleanup_queue);
+
+void blk_queue_dump_stats(struct request_queue *q) {
+  long completed = atomic_long_read(&q->nr_completed);
+
+  printk(KERN_INFO BLOCK_CLASS
+         "%s: bios %ld, back merges %ld, front merges %ld, dispatched %ld, "
+         "completed %ld, avg latency %ld ns\n",
+         q->bdev->dev.name ? q->bdev->dev.name : q->bdev->name,
+         atomic_long_read(&q->nr_bios), atomic_long_read(&q->nr_back_merges),
+         atomic_long_read(&q->nr_front_merges), atomic_long_read(&q->nr_dispatched),
+         completed, completed ? atomic_long_read(&q->total_latency_ns) / completed : 0);
+}
+EXPORT_SYMBOL(blk_queue_dump_stats);
+
+void blk_softirq_init(void) {
+  static bool initialized = false;
+  if (initialized)
+    return;
+
+  bio_cache = kmem_cache_create("bio", sizeof(struct bio), 0, 0);
+  request_cache = kmem_cache_create("blk_request", sizeof(struct request), 0, 0);
+  if (!bio_cache || !request_cache) {
+    printk(KERN_ERR BLOCK_CLASS "failed to create bio caches\n");
+    return;
+  }
+
+  open_softirq(BLOCK_SOFTIRQ, blk_done_softirq);
+  initialized = true;
+}
@@ -20,6 +20,9 @@
 #include <lib/vsprintf.h> /* For snprintf */
 #include <aerosync/resdomain.h>
 #include <aerosync/sched/process.h>
+#include <arch/x86_64/mm/layout.h>
+#include <arch/x86_64/mm/pmm.h>
+#include <lib/math.h>
 
 static struct class block_class = {
     .name = "block",
@@ -66,6 +69,7 @@ static struct device_driver block_driver = {
 static void block_init_subsystem(void) {
   static int initialized = 0;
   if (!initialized) {
+    blk_softirq_init();
     class_register(&block_class);
     class_register(&ide_class);
     class_register(&sata_class);
@@ -108,6 +112,16 @@ int block_device_register(struct block_device *dev) {
     strncpy(dev->name, dev->dev.name, BLOCK_NAME_MAX);
   }
 
+  /* Partitions share the request queue of their disk */
+  if (!dev->parent_disk && !dev->queue) {
+    dev->queue = blk_init_queue(dev);
+    if (!dev->queue) {
+      printk(KERN_WARNING BLOCK_CLASS
+             "'%s': no request queue, bios will be executed synchronously\n",
+             dev->dev.name);
+    }
+  }
+
   printk(KERN_INFO BLOCK_CLASS
          "Registered block device '%s' (%llu sectors, %u bytes/sector)\n",
          dev->dev.name, dev->sector_count, dev->block_size);
@@ -303,58 +317,101 @@ EXPORT_SYMBOL(blkdev_lookup);
 
 /* --- Dispatchers --- */
 
-int __no_cfi block_read(struct block_device *dev, void *buffer, uint64_t start_sector,
+/* Upper bound on a single bio built by block_read()/block_write() */
+#define BLOCK_RW_MAX_BYTES (128 * 1024)
+
+/**
+ * block_rw - Move a kernel buffer through the request queue
+ *
+ * Direct-map buffers are physically contiguous and are described in place
+ * as a single segment. Anything else (vmalloc, kernel image) is staged
+ * through a kmalloc bounce buffer one bio at a time.
+ */
+static int block_rw(struct block_device *dev, void *buffer, uint64_t start_sector,
+                    uint32_t sector_count, uint32_t opf) {
+  uint32_t bsz = dev->block_size;
+  uint32_t max_count = BLOCK_RW_MAX_BYTES / bsz;
+  uint64_t len = (uint64_t) sector_count * bsz;
+  bool direct = is_pmm_addr((uint64_t) buffer) &&
+                is_pmm_addr((uint64_t) buffer + len - 1);
+  uint8_t *bounce = nullptr;
+  int ret = 0;
+
+  if (!max_count)
+    max_count = 1;
+
+  if (!direct) {
+    bounce = kmalloc((size_t) min(sector_count, max_count) * bsz);
+    if (!bounce)
+      return -ENOMEM;
+  }
+
+  while (sector_count) {
+    uint32_t count = min(sector_count, max_count);
+    uint32_t bytes = count * bsz;
+    uint8_t *data = direct ? buffer : bounce;
+
+    if (!direct && opf == REQ_OP_WRITE)
+      memcpy(bounce, buffer, bytes);
+
+    struct bio *bio = bio_alloc(dev, 1, opf);
+    if (!bio) {
+      ret = -ENOMEM;
+      break;
+    }
+    bio->bi_sector = start_sector;
+    if (bio_add_page(bio, virt_to_page(data), bytes, offset_in_page(data)) != bytes) {
+      bio_put(bio);
+      ret = -EINVAL;
+      break;
+    }
+
+    ret = submit_bio_wait(bio);
+    bio_put(bio);
+    if (ret)
+      break;
+
+    if (!direct && opf == REQ_OP_READ)
+      memcpy(buffer, bounce, bytes);
+
+    buffer = (uint8_t *) buffer + bytes;
+    start_sector += count;
+    sector_count -= count;
+  }
+
+  kfree(bounce);
+  return ret;
+}
+
+int block_read(struct block_device *dev, void *buffer, uint64_t start_sector,
                uint32_t sector_count) {
   if (!dev || !buffer)
     return -EINVAL;
-    
-  /* Handle partitions: redirect to parent with offset */
-  if (dev->parent_disk) {
-      /* Recursively call block_read on parent to handle nested partitions if needed,
-       * or just add offset. Here we add offset and switch dev. */
-      start_sector += dev->partition_offset;
-      dev = dev->parent_disk;
-  }
-    
+  if (!sector_count)
+    return 0;
+
+  /* For partitions this bounds the access to the partition itself */
   if (start_sector + sector_count > dev->sector_count)
     return -ERANGE;
 
-  if (current && current->rd) {
-      resdomain_io_throttle(current->rd, sector_count * dev->block_size);
-  }
-
-  mutex_lock(&dev->lock);
-  int ret = dev->ops->read(dev, buffer, start_sector, sector_count);
-  mutex_unlock(&dev->lock);
-
-  return ret;
+  return block_rw(dev, buffer, start_sector, sector_count, REQ_OP_READ);
 }
 EXPORT_SYMBOL(block_read);
 
-int __no_cfi block_write(struct block_device *dev, const void *buffer,
+int block_write(struct block_device *dev, const void *buffer,
                 uint64_t start_sector, uint32_t sector_count) {
   if (!dev || !buffer)
     return -EINVAL;
-    
-  if (dev->parent_disk) {
-      start_sector += dev->partition_offset;
-      dev = dev->parent_disk;
-  }
-    
-  if (!dev->ops->write)
+  if (!sector_count)
+    return 0;
+
+  struct block_device *disk = dev->parent_disk ? dev->parent_disk : dev;
+  if (!disk->ops->write)
     return -ENOSYS;
   if (start_sector + sector_count > dev->sector_count)
     return -ERANGE;
 
-  if (current && current->rd) {
-      resdomain_io_throttle(current->rd, sector_count * dev->block_size);
-  }
-
-  mutex_lock(&dev->lock);
-  int ret = dev->ops->write(dev, buffer, start_sector, sector_count);
-  mutex_unlock(&dev->lock);
-
-  return ret;
+  return block_rw(dev, (void *) buffer, start_sector, sector_count, REQ_OP_WRITE);
 }
 EXPORT_SYMBOL(block_write);
 
@@ -18,6 +18,7 @@
 #include <linux/list.h>
 #include <fs/devfs.h>
 #include <aerosync/sysintf/char.h>
+#include <lib/uaccess.h>
 
 /* --- Core Algorithm Management --- */
 
@@ -166,7 +167,7 @@ static int crypto_dev_open(struct inode *inode, struct file *file) {
 }
 
 static ssize_t crypto_dev_read(struct file *file, char *buf, size_t count, off_t *off) {
-  (void)file; (void)off;
+  (void)off;
   uint8_t *tmp = kmalloc(count);
   if (!tmp) return -ENOMEM;
   struct crypto_tfm *tfm = crypto_alloc_tfm("hw_rng", CRYPTO_ALG_TYPE_RNG);
@@ -178,9 +179,13 @@ static ssize_t crypto_dev_read(struct file *file, char *buf, size_t count, off_t
     kfree(tmp);
     return -ENODEV;
   }
-  memcpy(buf, tmp, count);
+  ssize_t ret = count;
+  if (file->f_mode & FMODE_KERNEL)
+    memcpy(buf, tmp, count);
+  else if (copy_to_user(buf, tmp, count) != 0)
+    ret = -EFAULT;
   kfree(tmp);
-  return count;
+  return ret;
 }
 
 static struct file_operations crypto_fops = {
@@ -229,6 +229,11 @@ void __no_cfi ic_timer_oneshot(uint32_t microseconds) {
 }
 EXPORT_SYMBOL(ic_timer_oneshot);
 
+int ic_timer_has_oneshot(void) {
+  return current_ops && current_ops->timer_oneshot && current_ops->timer_stop;
+}
+EXPORT_SYMBOL(ic_timer_has_oneshot);
+
 void __no_cfi ic_timer_tsc_deadline(uint64_t deadline) {
   if (current_ops && current_ops->timer_tsc_deadline)
     current_ops->timer_tsc_deadline(deadline);
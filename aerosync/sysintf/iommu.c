@@ -15,56 +15,147 @@
 #include <mm/slub.h>
 #include <aerosync/errno.h>
 #include <lib/string.h>
+#include <aerosync/mutex.h>
 
 #include <aerosync/export.h>
 
 static const struct iommu_ops *s_registered_ops = nullptr;
 static const struct dma_map_ops *s_iommu_dma_ops = nullptr;
+static struct iommu_domain *s_identity_domain = nullptr;
+
+/* Devices probed before any IOMMU driver registered */
+struct iommu_early_dev {
+  struct list_head node;
+  struct device *dev;
+};
+
+static LIST_HEAD(s_early_devices);
+static DEFINE_MUTEX(s_iommu_lock);
+
+static struct iommu_domain *__iommu_domain_alloc(enum iommu_domain_type type) {
+  auto domain = (struct iommu_domain *)kmalloc(sizeof(struct iommu_domain));
+  if (!domain) return nullptr;
+
+  memset(domain, 0, sizeof(*domain));
+  domain->ops = s_registered_ops;
+  domain->type = type;
+
+  if (domain->ops->domain_init && domain->ops->domain_init(domain) != 0) {
+    kfree(domain);
+    return nullptr;
+  }
+
+  return domain;
+}
+
+/* Called with s_iommu_lock held */
+static int __iommu_probe_device(struct device *dev, enum iommu_domain_type type) {
+  struct iommu_domain *domain;
+  int ret;
+
+  if (s_registered_ops->probe_device && s_registered_ops->probe_device(dev) != 0)
+    return -ENODEV;
+
+  if (type == IOMMU_DOMAIN_IDENTITY) {
+    if (!s_identity_domain)
+      s_identity_domain = __iommu_domain_alloc(IOMMU_DOMAIN_IDENTITY);
+    domain = s_identity_domain;
+  } else {
+    domain = __iommu_domain_alloc(type);
+  }
+  if (!domain) return -ENOMEM;
+
+  ret = iommu_attach_device(domain, dev);
+  if (ret) {
+    if (domain != s_identity_domain)
+      iommu_domain_free(domain);
+    return ret;
+  }
+
+  dev->iommu_domain = domain;
+  if (type == IOMMU_DOMAIN_DMA && s_iommu_dma_ops)
+    dev->dma_ops = (struct dma_map_ops *)s_iommu_dma_ops;
+  else
+    dev->dma_ops = (struct dma_map_ops *)&direct_dma_ops;
+
+  return 0;
+}
 
 int iommu_register_ops(const struct iommu_ops *ops, const struct dma_map_ops *dma_ops) {
+  mutex_lock(&s_iommu_lock);
   if (s_registered_ops) {
+    mutex_unlock(&s_iommu_lock);
     printk(KERN_WARNING IOMMU_CLASS "IOMMU ops already registered\n");
     return -EBUSY;
   }
   s_registered_ops = ops;
   s_iommu_dma_ops = dma_ops;
+
+  struct iommu_early_dev *early, *tmp;
+  list_for_each_entry_safe(early, tmp, &s_early_devices, node) {
+    __iommu_probe_device(early->dev, IOMMU_DOMAIN_IDENTITY);
+    list_del(&early->node);
+    put_device(early->dev);
+    kfree(early);
+  }
+  mutex_unlock(&s_iommu_lock);
+
   printk(KERN_INFO IOMMU_CLASS "Generic IOMMU abstraction layer initialized\n");
   return 0;
 }
 EXPORT_SYMBOL(iommu_register_ops);
 
 int iommu_probe_device(struct device *dev) {
-  if (!s_registered_ops) return -ENODEV;
-  
-  /* If the IOMMU driver is active, attach its DMA ops to the device */
-  if (s_iommu_dma_ops) {
-    dev->dma_ops = (struct dma_map_ops *)s_iommu_dma_ops;
+  int ret;
+
+  mutex_lock(&s_iommu_lock);
+  if (!s_registered_ops) {
+    auto early = (struct iommu_early_dev *)kmalloc(sizeof(struct iommu_early_dev));
+    if (early) {
+      early->dev = get_device(dev);
+      list_add_tail(&early->node, &s_early_devices);
+    }
+    mutex_unlock(&s_iommu_lock);
+    return -ENODEV;
   }
 
-  return 0; 
+#ifdef CONFIG_IOMMU_DEFAULT_PASSTHROUGH
+  ret = __iommu_probe_device(dev, IOMMU_DOMAIN_IDENTITY);
+#else
+  ret = __iommu_probe_device(dev, IOMMU_DOMAIN_DMA);
+#endif
+  mutex_unlock(&s_iommu_lock);
+  return ret;
 }
 EXPORT_SYMBOL(iommu_probe_device);
 
 void iommu_release_device(struct device *dev) {
-  (void)dev;
+  mutex_lock(&s_iommu_lock);
+
+  struct iommu_early_dev *early, *tmp;
+  list_for_each_entry_safe(early, tmp, &s_early_devices, node) {
+    if (early->dev == dev) {
+      list_del(&early->node);
+      put_device(dev);
+      kfree(early);
+    }
+  }
+
+  struct iommu_domain *domain = dev->iommu_domain;
+  if (domain) {
+    iommu_detach_device(domain, dev);
+    if (domain != s_identity_domain)
+      iommu_domain_free(domain);
+    dev->iommu_domain = nullptr;
+    dev->dma_ops = nullptr;
+  }
+  mutex_unlock(&s_iommu_lock);
 }
 EXPORT_SYMBOL(iommu_release_device);
 
 struct iommu_domain *iommu_domain_alloc(void) {
   if (!s_registered_ops) return nullptr;
-
-  auto domain = (struct iommu_domain *)kmalloc(sizeof(struct iommu_domain));
-  if (!domain) return nullptr;
-
-  memset(domain, 0, sizeof(*domain));
-  domain->ops = s_registered_ops;
-
-  if (domain->ops->domain_init && domain->ops->domain_init(domain) != 0) {
-    kfree(domain);
-    return nullptr;
-  }
-
-  return domain;
+  return __iommu_domain_alloc(IOMMU_DOMAIN_UNMANAGED);
 }
 EXPORT_SYMBOL(iommu_domain_alloc);
 
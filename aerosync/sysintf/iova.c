@@ -0,0 +1,447 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/sysintf/iova.c
+ * @brief I/O virtual address allocator with per-CPU magazine caches
+ * @copyright (C) 2025-2026 assembler-0
+ */
+
+#include <aerosync/sysintf/iova.h>
+#include <aerosync/percpu.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/errno.h>
+#include <aerosync/export.h>
+#include <arch/x86_64/smp.h>
+#include <mm/slub.h>
+#include <lib/string.h>
+
+#define IOVA_ANCHOR (~0UL)
+
+struct iova_magazine {
+  unsigned long size;
+  unsigned long pfns[IOVA_MAG_SIZE];
+};
+
+struct iova_cpu_rcache {
+  spinlock_t lock;
+  struct iova_magazine *loaded;
+  struct iova_magazine *prev;
+};
+
+static struct iova *to_iova(struct rb_node *node) {
+  return rb_entry(node, struct iova, node);
+}
+
+/* Smallest power of two >= @size */
+static unsigned long iova_size_round(unsigned long size) {
+  if (size <= 1)
+    return 1;
+  return 1UL << (64 - __builtin_clzl(size - 1));
+}
+
+static unsigned long iova_align_mask(unsigned long size) {
+  return ~0UL << (64 - __builtin_clzl(iova_size_round(size)) - 1);
+}
+
+/* --- rbtree allocator --- */
+
+/* Lowest node whose range starts at or above @limit_pfn (at worst the anchor) */
+static struct rb_node *iova_find_limit(struct iova_domain *iovad, unsigned long limit_pfn) {
+  struct rb_node *node = iovad->rbroot.rb_node, *next;
+
+  while (to_iova(node)->pfn_hi < limit_pfn)
+    node = node->rb_right;
+
+search_left:
+  while (node->rb_left && to_iova(node->rb_left)->pfn_lo >= limit_pfn)
+    node = node->rb_left;
+
+  if (!node->rb_left)
+    return node;
+
+  next = node->rb_left;
+  while (next->rb_right) {
+    next = next->rb_right;
+    if (to_iova(next)->pfn_lo >= limit_pfn) {
+      node = next;
+      goto search_left;
+    }
+  }
+  return node;
+}
+
+static void iova_insert_rbtree(struct rb_root *root, struct iova *iova) {
+  struct rb_node **link = &root->rb_node, *parent = nullptr;
+
+  while (*link) {
+    parent = *link;
+    if (iova->pfn_lo < to_iova(parent)->pfn_lo)
+      link = &parent->rb_left;
+    else
+      link = &parent->rb_right;
+  }
+  rb_link_node(&iova->node, parent, link);
+  rb_insert_color(&iova->node, root);
+}
+
+static struct iova *iova_find(struct iova_domain *iovad, unsigned long pfn) {
+  struct rb_node *node = iovad->rbroot.rb_node;
+
+  while (node) {
+    struct iova *iova = to_iova(node);
+
+    if (pfn < iova->pfn_lo)
+      node = node->rb_left;
+    else if (pfn > iova->pfn_hi)
+      node = node->rb_right;
+    else
+      return iova;
+  }
+  return nullptr;
+}
+
+/* Called with iovad->lock held */
+static void __iova_remove(struct iova_domain *iovad, struct iova *iova) {
+  struct iova *cached = to_iova(iovad->cached_node);
+
+  /* Searches start from above the hole so it gets reused */
+  if (iova->pfn_lo >= cached->pfn_lo)
+    iovad->cached_node = rb_next(&iova->node);
+  rb_erase(&iova->node, &iovad->rbroot);
+}
+
+/*
+ * Walk down from the cached position (or from @limit_pfn) looking for a
+ * size-aligned gap. Free space left above the cached position is only
+ * found by the second pass.
+ */
+static unsigned long iova_alloc_range(struct iova_domain *iovad, unsigned long size,
+                                      unsigned long limit_pfn) {
+  struct iova *new = kmalloc(sizeof(*new));
+  if (!new)
+    return 0;
+
+  unsigned long align_mask = iova_align_mask(size);
+  unsigned long high_pfn, new_pfn;
+  struct rb_node *curr;
+  bool from_cache;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iovad->lock);
+
+  curr = iovad->cached_node;
+  from_cache = to_iova(curr)->pfn_lo <= limit_pfn + 1;
+  if (!from_cache)
+    curr = iova_find_limit(iovad, limit_pfn + 1);
+
+retry:
+  high_pfn = limit_pfn + 1;
+  do {
+    struct iova *curr_iova = to_iova(curr);
+
+    if (curr_iova->pfn_lo < high_pfn)
+      high_pfn = curr_iova->pfn_lo;
+    new_pfn = (high_pfn - size) & align_mask;
+    curr = rb_prev(curr);
+  } while (curr && new_pfn <= to_iova(curr)->pfn_hi && new_pfn >= iovad->start_pfn);
+
+  if (high_pfn < size || new_pfn < iovad->start_pfn) {
+    if (from_cache) {
+      from_cache = false;
+      curr = iova_find_limit(iovad, limit_pfn + 1);
+      goto retry;
+    }
+    spinlock_unlock_irqrestore(&iovad->lock, flags);
+    kfree(new);
+    return 0;
+  }
+
+  new->pfn_lo = new_pfn;
+  new->pfn_hi = new_pfn + size - 1;
+  iova_insert_rbtree(&iovad->rbroot, new);
+  iovad->cached_node = &new->node;
+
+  spinlock_unlock_irqrestore(&iovad->lock, flags);
+  return new_pfn;
+}
+
+static void iova_free_range(struct iova_domain *iovad, unsigned long pfn) {
+  irq_flags_t flags = spinlock_lock_irqsave(&iovad->lock);
+  struct iova *iova = iova_find(iovad, pfn);
+
+  if (iova)
+    __iova_remove(iovad, iova);
+  spinlock_unlock_irqrestore(&iovad->lock, flags);
+
+  kfree(iova);
+}
+
+int reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo, unsigned long pfn_hi) {
+  struct iova *iova = kmalloc(sizeof(*iova));
+  if (!iova)
+    return -ENOMEM;
+
+  iova->pfn_lo = pfn_lo;
+  iova->pfn_hi = pfn_hi;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iovad->lock);
+  iova_insert_rbtree(&iovad->rbroot, iova);
+  spinlock_unlock_irqrestore(&iovad->lock, flags);
+  return 0;
+}
+
+EXPORT_SYMBOL(reserve_iova);
+
+/* --- Magazine caches --- */
+
+static struct iova_magazine *iova_magazine_alloc(void) {
+  struct iova_magazine *mag = kmalloc(sizeof(*mag));
+  if (mag)
+    mag->size = 0;
+  return mag;
+}
+
+static void iova_magazine_free_pfns(struct iova_magazine *mag, struct iova_domain *iovad) {
+  for (unsigned long i = 0; i < mag->size; i++)
+    iova_free_range(iovad, mag->pfns[i]);
+  mag->size = 0;
+}
+
+/* Take a PFN at or below @limit_pfn, 0 if the magazine has none */
+static unsigned long iova_magazine_pop(struct iova_magazine *mag, unsigned long limit_pfn) {
+  long i;
+
+  for (i = (long) mag->size - 1; i >= 0; i--) {
+    if (mag->pfns[i] <= limit_pfn)
+      break;
+  }
+  if (i < 0)
+    return 0;
+
+  unsigned long pfn = mag->pfns[i];
+  mag->pfns[i] = mag->pfns[--mag->size];
+  return pfn;
+}
+
+static int iova_size_order(unsigned long size) {
+  return 63 - __builtin_clzl(size);
+}
+
+static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn, unsigned long size) {
+  struct iova_rcache *rcache = &iovad->rcaches[iova_size_order(size)];
+  struct iova_magazine *spill = nullptr;
+  bool ok = true;
+
+  irq_flags_t flags = local_irq_save();
+  struct iova_cpu_rcache *cpu_rcache = this_cpu_ptr(*rcache->cpu_rcaches);
+  spinlock_lock(&cpu_rcache->lock);
+
+  if (cpu_rcache->loaded && cpu_rcache->loaded->size < IOVA_MAG_SIZE) {
+    /* Fast path */
+  } else if (cpu_rcache->prev && cpu_rcache->prev->size < IOVA_MAG_SIZE) {
+    struct iova_magazine *tmp = cpu_rcache->loaded;
+    cpu_rcache->loaded = cpu_rcache->prev;
+    cpu_rcache->prev = tmp;
+  } else {
+    struct iova_magazine *fresh = iova_magazine_alloc();
+
+    if (!fresh) {
+      ok = false;
+    } else {
+      /* Hand the full magazine to the depot, or drain it if that is full too */
+      struct iova_magazine *full = cpu_rcache->loaded;
+
+      if (full) {
+        spinlock_lock(&rcache->lock);
+        if (rcache->depot_size < IOVA_DEPOT_MAX)
+          rcache->depot[rcache->depot_size++] = full;
+        else
+          spill = full;
+        spinlock_unlock(&rcache->lock);
+      }
+      cpu_rcache->loaded = fresh;
+    }
+  }
+
+  if (ok)
+    cpu_rcache->loaded->pfns[cpu_rcache->loaded->size++] = pfn;
+
+  spinlock_unlock(&cpu_rcache->lock);
+  local_irq_restore(flags);
+
+  if (spill) {
+    iova_magazine_free_pfns(spill, iovad);
+    kfree(spill);
+  }
+  return ok;
+}
+
+static unsigned long iova_rcache_get(struct iova_domain *iovad, unsigned long size,
+                                     unsigned long limit_pfn) {
+  struct iova_rcache *rcache = &iovad->rcaches[iova_size_order(size)];
+  unsigned long pfn = 0;
+
+  irq_flags_t flags = local_irq_save();
+  struct iova_cpu_rcache *cpu_rcache = this_cpu_ptr(*rcache->cpu_rcaches);
+  spinlock_lock(&cpu_rcache->lock);
+
+  if (!cpu_rcache->loaded || !cpu_rcache->loaded->size) {
+    if (cpu_rcache->prev && cpu_rcache->prev->size) {
+      struct iova_magazine *tmp = cpu_rcache->loaded;
+      cpu_rcache->loaded = cpu_rcache->prev;
+      cpu_rcache->prev = tmp;
+    } else {
+      spinlock_lock(&rcache->lock);
+      if (rcache->depot_size) {
+        struct iova_magazine *empty = cpu_rcache->loaded;
+
+        cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+        spinlock_unlock(&rcache->lock);
+        kfree(empty);
+      } else {
+        spinlock_unlock(&rcache->lock);
+      }
+    }
+  }
+
+  if (cpu_rcache->loaded)
+    pfn = iova_magazine_pop(cpu_rcache->loaded, limit_pfn);
+
+  spinlock_unlock(&cpu_rcache->lock);
+  local_irq_restore(flags);
+  return pfn;
+}
+
+/* Give every cached range back to the tree */
+static void iova_rcache_flush(struct iova_domain *iovad) {
+  for (int i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+    struct iova_rcache *rcache = &iovad->rcaches[i];
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+      struct iova_cpu_rcache *cpu_rcache = per_cpu_ptr(*rcache->cpu_rcaches, cpu);
+      irq_flags_t flags = spinlock_lock_irqsave(&cpu_rcache->lock);
+
+      if (cpu_rcache->loaded)
+        iova_magazine_free_pfns(cpu_rcache->loaded, iovad);
+      if (cpu_rcache->prev)
+        iova_magazine_free_pfns(cpu_rcache->prev, iovad);
+      spinlock_unlock_irqrestore(&cpu_rcache->lock, flags);
+    }
+
+    irq_flags_t flags = spinlock_lock_irqsave(&rcache->lock);
+    while (rcache->depot_size) {
+      struct iova_magazine *mag = rcache->depot[--rcache->depot_size];
+
+      iova_magazine_free_pfns(mag, iovad);
+      kfree(mag);
+    }
+    spinlock_unlock_irqrestore(&rcache->lock, flags);
+  }
+}
+
+unsigned long alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
+                              unsigned long limit_pfn) {
+  unsigned long pfn;
+
+  if (!size)
+    return 0;
+
+  size = iova_size_round(size);
+  if (iova_size_order(size) < IOVA_RANGE_CACHE_MAX_SIZE) {
+    pfn = iova_rcache_get(iovad, size, limit_pfn);
+    if (pfn)
+      return pfn;
+  }
+
+  pfn = iova_alloc_range(iovad, size, limit_pfn);
+  if (!pfn) {
+    /* The space may just be fragmented into cached ranges */
+    iova_rcache_flush(iovad);
+    pfn = iova_alloc_range(iovad, size, limit_pfn);
+  }
+  return pfn;
+}
+
+EXPORT_SYMBOL(alloc_iova_fast);
+
+void free_iova_fast(struct iova_domain *iovad, unsigned long pfn, unsigned long size) {
+  size = iova_size_round(size);
+  if (iova_size_order(size) < IOVA_RANGE_CACHE_MAX_SIZE &&
+      iova_rcache_insert(iovad, pfn, size))
+    return;
+
+  iova_free_range(iovad, pfn);
+}
+
+EXPORT_SYMBOL(free_iova_fast);
+
+int iova_domain_init(struct iova_domain *iovad, unsigned long start_pfn) {
+  memset(iovad, 0, sizeof(*iovad));
+  spinlock_init(&iovad->lock);
+  iovad->rbroot = RB_ROOT;
+  iovad->start_pfn = start_pfn ? start_pfn : 1;
+  iovad->anchor.pfn_lo = iovad->anchor.pfn_hi = IOVA_ANCHOR;
+  iova_insert_rbtree(&iovad->rbroot, &iovad->anchor);
+  iovad->cached_node = &iovad->anchor.node;
+
+  for (int i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+    struct iova_rcache *rcache = &iovad->rcaches[i];
+    int cpu;
+
+    spinlock_init(&rcache->lock);
+    rcache->cpu_rcaches = alloc_percpu(struct iova_cpu_rcache);
+    if (!rcache->cpu_rcaches) {
+      iova_domain_destroy(iovad);
+      return -ENOMEM;
+    }
+
+    for_each_possible_cpu(cpu) {
+      struct iova_cpu_rcache *cpu_rcache = per_cpu_ptr(*rcache->cpu_rcaches, cpu);
+
+      spinlock_init(&cpu_rcache->lock);
+      cpu_rcache->loaded = nullptr;
+      cpu_rcache->prev = nullptr;
+    }
+  }
+  return 0;
+}
+
+EXPORT_SYMBOL(iova_domain_init);
+
+void iova_domain_destroy(struct iova_domain *iovad) {
+  for (int i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; i++) {
+    struct iova_rcache *rcache = &iovad->rcaches[i];
+    int cpu;
+
+    if (!rcache->cpu_rcaches)
+      continue;
+
+    for_each_possible_cpu(cpu) {
+      struct iova_cpu_rcache *cpu_rcache = per_cpu_ptr(*rcache->cpu_rcaches, cpu);
+
+      kfree(cpu_rcache->loaded);
+      kfree(cpu_rcache->prev);
+    }
+    free_percpu(rcache->cpu_rcaches);
+    rcache->cpu_rcaches = nullptr;
+
+    for (unsigned int d = 0; d < rcache->depot_size; d++)
+      kfree(rcache->depot[d]);
+    rcache->depot_size = 0;
+  }
+
+  /* Cached PFNs are covered by their tree nodes; free those */
+  struct rb_node *node = rb_first(&iovad->rbroot);
+  while (node) {
+    struct rb_node *next = rb_next(node);
+    struct iova *iova = to_iova(node);
+
+    rb_erase(node, &iovad->rbroot);
+    if (iova != &iovad->anchor)
+      kfree(iova);
+    node = next;
+  }
+}
+
+EXPORT_SYMBOL(iova_domain_destroy);
@@ -0,0 +1,154 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file aerosync/tick.c
+ * @brief Scheduler tick and tickless (NO_HZ) idle
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <aerosync/tick.h>
+#include <aerosync/timer.h>
+#include <aerosync/rcu.h>
+#include <aerosync/softirq.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/classes.h>
+#include <arch/x86_64/percpu.h>
+#include <arch/x86_64/requests.h>
+#include <lib/printk.h>
+#include <lib/string.h>
+#include <linux/container_of.h>
+
+/*
+ * Upper bound for one tickless idle period. Keeps timekeeping-related
+ * bookkeeping (rq clocks, load averages) from going stale for too long.
+ */
+#ifndef TICK_NOHZ_MAX_IDLE_NS
+#define TICK_NOHZ_MAX_IDLE_NS (1000000000ULL)
+#endif
+
+static DEFINE_PER_CPU(struct tick_sched, tick_cpu_sched);
+
+static bool tick_nohz_enabled;
+
+/* First tick boundary strictly after @now */
+static __always_inline uint64_t tick_next_period(uint64_t now) {
+  return (now / TICK_NSEC + 1) * TICK_NSEC;
+}
+
+void tick_handle_periodic(void) {
+  run_local_timers();
+  scheduler_tick();
+}
+
+static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer) {
+  struct tick_sched *ts = container_of(timer, struct tick_sched, sched_timer);
+
+  tick_handle_periodic();
+
+  /*
+   * With the tick stopped this was a wheel timer or the idle bound; the
+   * idle loop decides whether and when the next tick happens.
+   */
+  if (ts->tick_stopped)
+    return HRTIMER_NORESTART;
+
+  hrtimer_forward(timer, get_time_ns(), TICK_NSEC);
+  return HRTIMER_RESTART;
+}
+
+void tick_setup_cpu(void) {
+  struct tick_sched *ts = this_cpu_ptr(tick_cpu_sched);
+
+  memset(ts, 0, sizeof(*ts));
+  hrtimer_init(&ts->sched_timer, tick_sched_timer);
+
+  if (!hrtimer_switch_to_hres())
+    return; /* Periodic hardware tick, timer_handler() drives everything */
+
+#ifdef CONFIG_NO_HZ_IDLE
+  if (smp_get_id() == 0) {
+    char buf[8];
+    tick_nohz_enabled = !(cmdline_find_option(current_cmdline, "nohz", buf, sizeof(buf)) > 0 &&
+                          !strcmp(buf, "off"));
+    if (tick_nohz_enabled)
+      printk(KERN_INFO TIME_CLASS "NO_HZ: tickless idle enabled\n");
+  }
+#endif
+
+  hrtimer_start(&ts->sched_timer, tick_next_period(get_time_ns()), HRTIMER_MODE_ABS);
+}
+
+bool tick_nohz_tick_stopped(void) {
+  return this_cpu_ptr(tick_cpu_sched)->tick_stopped;
+}
+
+static void tick_nohz_restart(struct tick_sched *ts, uint64_t now) {
+  ts->tick_stopped = false;
+  ts->idle_sleeptime_ns += now - ts->idle_entrytime;
+  hrtimer_start(&ts->sched_timer, tick_next_period(now), HRTIMER_MODE_ABS);
+}
+
+/* Anything that needs this CPU's tick to make progress? */
+static bool tick_nohz_cpu_busy(void) {
+  return this_cpu_read(softirq_pending) || rcu_needs_cpu();
+}
+
+void tick_nohz_idle_stop_tick(void) {
+  struct tick_sched *ts = this_cpu_ptr(tick_cpu_sched);
+
+  if (!tick_nohz_enabled || !hrtimer_hres_active())
+    return;
+
+  uint64_t now = get_time_ns();
+  ts->idle_calls++;
+
+  uint64_t next = KTIME_MAX;
+  if (!tick_nohz_cpu_busy()) {
+    next = timer_next_event_ns();
+    if (next > now + TICK_NOHZ_MAX_IDLE_NS)
+      next = now + TICK_NOHZ_MAX_IDLE_NS;
+  }
+
+  /* Not worth it if something is due within the next tick anyway */
+  if (next == KTIME_MAX || next < tick_next_period(now) + TICK_NSEC) {
+    if (ts->tick_stopped)
+      tick_nohz_restart(ts, now);
+    return;
+  }
+
+  if (!ts->tick_stopped) {
+    ts->tick_stopped = true;
+    ts->idle_entrytime = now;
+    ts->idle_sleeps++;
+  }
+
+  /*
+   * Other hrtimers stay queued and keep programming the event device for
+   * themselves; only the periodic tick moves out to the next wheel timer.
+   */
+  if (!hrtimer_is_queued(&ts->sched_timer) || hrtimer_get_expires(&ts->sched_timer) != next)
+    hrtimer_start(&ts->sched_timer, next, HRTIMER_MODE_ABS);
+}
+
+void tick_nohz_idle_exit(void) {
+  struct tick_sched *ts = this_cpu_ptr(tick_cpu_sched);
+
+  if (!ts->tick_stopped)
+    return;
+
+  irq_flags_t flags = local_irq_save();
+  tick_nohz_restart(ts, get_time_ns());
+  local_irq_restore(flags);
+}
@@ -5,6 +5,9 @@
 #include <fs/vfs.h>
 #include <aerosync/panic.h>
 #include <linux/container_of.h>
+#include <aerosync/hrtimer.h>
+#include <aerosync/tick.h>
+#include <aerosync/export.h>
 
 /* Wall-clock timekeeping state */
 static struct {
@@ -31,103 +34,354 @@ void ktime_get_real_ts64(struct timespec *ts) {
   ts->tv_nsec = ns % NSEC_PER_SEC;
 }
 
+/*
+ * Hierarchical timer wheel
+ *
+ * LVL_DEPTH levels of LVL_SIZE buckets. Level 0 has tick granularity and
+ * every further level is LVL_CLK_DIV times coarser, so a timer is filed
+ * once, in the level whose range covers its timeout, and expires straight
+ * from there (no cascading). A per-level bitmap of non-empty buckets makes
+ * finding the next expiry a handful of word operations, which NO_HZ idle
+ * uses to decide how long the tick may stay stopped.
+ *
+ * Timer expiry is expressed in ticks: tick = ceil(expires_ns / TICK_NSEC).
+ * Bucket expiry in the outer levels is rounded up, so timers never fire
+ * early; at 100 Hz level 7 covers timeouts of roughly 5 days.
+ */
+#define LVL_CLK_SHIFT 3
+#define LVL_CLK_DIV   (1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK  (LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)  ((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)   (1UL << LVL_SHIFT(n))
+
+#define LVL_BITS      6
+#define LVL_SIZE      (1UL << LVL_BITS)
+#define LVL_MASK      (LVL_SIZE - 1)
+#define LVL_OFFS(n)   ((n) * LVL_SIZE)
+
+#define LVL_DEPTH     8
+#define WHEEL_SIZE    (LVL_SIZE * LVL_DEPTH)
+
+/* First tick delta handled by level n */
+#define LVL_START(n)  ((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define WHEEL_TIMEOUT_CUTOFF  LVL_START(LVL_DEPTH)
+#define WHEEL_TIMEOUT_MAX     (WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+#define TIMER_NO_EXPIRY       UINT64_MAX
+
+static_assert(LVL_SIZE == 64, "pending_map assumes one word per level");
+
 struct timer_cpu_base {
-  struct list_head active_timers;
   spinlock_t lock;
+  struct timer_list *running_timer;
+  uint64_t clk;                  /* Next tick to process */
+  uint64_t next_expiry;          /* Earliest bucket expiry (may be early, never late) */
+  uint64_t pending_map[LVL_DEPTH];
+  struct list_head vectors[WHEEL_SIZE];
 };
 
 DEFINE_PER_CPU(struct timer_cpu_base, timer_bases);
 
+static bool timer_wheel_ready;
+
+static __always_inline uint64_t ns_to_tick(uint64_t ns) {
+  return (ns + TICK_NSEC - 1) / TICK_NSEC;
+}
+
 void timer_init_subsystem(void) {
+  uint64_t now_tick = get_time_ns() / TICK_NSEC;
+
   for (int i = 0; i < MAX_CPUS; i++) {
     struct timer_cpu_base *base = per_cpu_ptr(timer_bases, i);
-    INIT_LIST_HEAD(&base->active_timers);
     spinlock_init(&base->lock);
+    base->running_timer = nullptr;
+    base->clk = now_tick;
+    base->next_expiry = TIMER_NO_EXPIRY;
+    for (int lvl = 0; lvl < LVL_DEPTH; lvl++)
+      base->pending_map[lvl] = 0;
+    for (unsigned long idx = 0; idx < WHEEL_SIZE; idx++)
+      INIT_LIST_HEAD(&base->vectors[idx]);
+  }
+
+  hrtimers_init();
+
+  /* The boot CPU's tick; APs start theirs from smp_ap_entry() */
+  tick_setup_cpu();
+
+  __atomic_store_n(&timer_wheel_ready, true, __ATOMIC_RELEASE);
+}
+
+bool timer_subsystem_ready(void) {
+  return __atomic_load_n(&timer_wheel_ready, __ATOMIC_ACQUIRE);
+}
+EXPORT_SYMBOL(timer_subsystem_ready);
+
+static __always_inline unsigned int calc_index(uint64_t expires, unsigned int lvl,
+                                               uint64_t *bucket_expiry) {
+  /*
+   * Outer levels truncate the expiry to their granularity: round up so the
+   * bucket is never processed before the timer is due.
+   */
+  if (lvl > 0)
+    expires = (expires >> LVL_SHIFT(lvl)) + 1;
+  *bucket_expiry = expires << LVL_SHIFT(lvl);
+  return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(uint64_t expires, uint64_t clk, uint64_t *bucket_expiry) {
+  if ((int64_t) (expires - clk) < 0) {
+    /* Already due: the bucket processed next */
+    *bucket_expiry = clk;
+    return clk & LVL_MASK;
+  }
+
+  uint64_t delta = expires - clk;
+  for (unsigned int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+    if (delta < LVL_START(lvl + 1))
+      return calc_index(expires, lvl, bucket_expiry);
+  }
+
+  return calc_index(clk + WHEEL_TIMEOUT_MAX, LVL_DEPTH - 1, bucket_expiry);
+}
+
+/*
+ * Earliest expiry of a non-empty bucket. Level n is visited when the low
+ * n * LVL_CLK_SHIFT bits of clk are zero, so its own clock is base->clk
+ * rounded up to its granularity; the bucket holding that position is the
+ * next one due at this level.
+ */
+static uint64_t __next_timer_interrupt(struct timer_cpu_base *base) {
+  uint64_t next = TIMER_NO_EXPIRY;
+
+  for (unsigned int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+    uint64_t map = base->pending_map[lvl];
+    if (!map)
+      continue;
+
+    uint64_t lvl_clk = (base->clk + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+    unsigned int start = lvl_clk & LVL_MASK;
+    uint64_t rot = start ? (map >> start) | (map << (LVL_SIZE - start)) : map;
+    uint64_t expiry = (lvl_clk + (uint64_t) __builtin_ctzll(rot)) << LVL_SHIFT(lvl);
+
+    if (expiry < next)
+      next = expiry;
   }
+
+  return next;
+}
+
+static void enqueue_timer(struct timer_cpu_base *base, struct timer_list *timer) {
+  uint64_t bucket_expiry;
+  unsigned int idx = calc_wheel_index(ns_to_tick(timer->expires), base->clk, &bucket_expiry);
+
+  timer->idx = idx;
+  list_add_tail(&timer->entry, &base->vectors[idx]);
+  base->pending_map[idx / LVL_SIZE] |= 1ULL << (idx % LVL_SIZE);
+
+  if (bucket_expiry < base->next_expiry)
+    base->next_expiry = bucket_expiry;
+}
+
+static void detach_timer(struct timer_cpu_base *base, struct timer_list *timer) {
+  unsigned int idx = timer->idx;
+
+  list_del_init(&timer->entry);
+  if (list_empty(&base->vectors[idx]))
+    base->pending_map[idx / LVL_SIZE] &= ~(1ULL << (idx % LVL_SIZE));
+  /* next_expiry may now be early, which only costs an empty wheel pass */
+}
+
+/*
+ * After the tick was stopped, base->clk lags behind real time. Move it
+ * forward (never past a due bucket) so new timers are filed relative to
+ * now and not into needlessly coarse levels.
+ */
+static void forward_timer_base(struct timer_cpu_base *base) {
+  uint64_t now_tick = get_time_ns() / TICK_NSEC;
+
+  if (now_tick <= base->clk)
+    return;
+
+  base->clk = base->next_expiry < now_tick ? base->next_expiry : now_tick;
 }
 
-static void __timer_reprogram(struct timer_cpu_base *base) {
-  (void) base;
-  // In periodic mode, we don't need to reprogram the hardware timer.
-  // Software timers will be checked on every tick.
+static struct timer_cpu_base *lock_timer_base(struct timer_list *timer, irq_flags_t *flags) {
+  for (;;) {
+    uint32_t cpu = __atomic_load_n(&timer->cpu, __ATOMIC_ACQUIRE);
+    struct timer_cpu_base *base = per_cpu_ptr(timer_bases, cpu);
+
+    *flags = spinlock_lock_irqsave(&base->lock);
+    if (timer->cpu == cpu)
+      return base;
+    spinlock_unlock_irqrestore(&base->lock, *flags);
+  }
 }
 
 void timer_setup(struct timer_list *timer, void (*function)(struct timer_list *), void *data) {
   timer->function = function;
   timer->data = data;
   timer->cpu = smp_get_id();
+  timer->idx = 0;
   INIT_LIST_HEAD(&timer->entry);
 }
+EXPORT_SYMBOL(timer_setup);
 
 void timer_add(struct timer_list *timer, uint64_t expires_ns) {
+  irq_flags_t flags;
+  struct timer_cpu_base *base = lock_timer_base(timer, &flags);
+
+  /* Re-arming a pending timer moves it */
+  if (!list_empty(&timer->entry))
+    detach_timer(base, timer);
+
+  struct timer_cpu_base *new_base = this_cpu_ptr(timer_bases);
+  if (base != new_base && base->running_timer != timer) {
+    /* Migrate to the local wheel; nobody can find it while both are unlocked */
+    __atomic_store_n(&timer->cpu, smp_get_id(), __ATOMIC_RELEASE);
+    spinlock_unlock(&base->lock);
+    spinlock_lock(&new_base->lock);
+    base = new_base;
+    if (!list_empty(&timer->entry))
+      detach_timer(base, timer);
+  }
+
   timer->expires = expires_ns;
-  int cpu = smp_get_id();
-  timer->cpu = cpu;
-  struct timer_cpu_base *base = this_cpu_ptr(timer_bases);
+  forward_timer_base(base);
+  enqueue_timer(base, timer);
 
-  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
+  spinlock_unlock_irqrestore(&base->lock, flags);
+}
+EXPORT_SYMBOL(timer_add);
 
-  struct timer_list *pos;
-  struct list_head *insert_after = &base->active_timers;
+int timer_del(struct timer_list *timer) {
+  irq_flags_t flags;
+  struct timer_cpu_base *base = lock_timer_base(timer, &flags);
+  int ret = 0;
 
-  list_for_each_entry(pos, &base->active_timers, entry) {
-    if (pos->expires > expires_ns) {
-      break;
-    }
-    insert_after = &pos->entry;
+  if (!list_empty(&timer->entry)) {
+    detach_timer(base, timer);
+    ret = 1;
   }
 
-  list_add_tail(&timer->entry, insert_after);
+  spinlock_unlock_irqrestore(&base->lock, flags);
+  return ret;
+}
+EXPORT_SYMBOL(timer_del);
+
+void timer_del_sync(struct timer_list *timer) {
+  for (;;) {
+    irq_flags_t flags;
+    struct timer_cpu_base *base = lock_timer_base(timer, &flags);
+
+    if (!list_empty(&timer->entry))
+      detach_timer(base, timer);
+
+    bool running = base->running_timer == timer;
+    spinlock_unlock_irqrestore(&base->lock, flags);
 
-  // If we are the new head, reprogram
-  if (base->active_timers.next == &timer->entry) {
-    __timer_reprogram(base);
+    if (!running)
+      return;
+    cpu_relax();
   }
+}
+EXPORT_SYMBOL(timer_del_sync);
 
-  spinlock_unlock_irqrestore(&base->lock, flags);
+int timer_pending(const struct timer_list *timer) {
+  return !list_empty(&timer->entry);
 }
+EXPORT_SYMBOL(timer_pending);
 
-void timer_del(struct timer_list *timer) {
-  struct timer_cpu_base *base = per_cpu_ptr(timer_bases, timer->cpu);
+/* Move the due buckets of every level into @heads; returns how many were taken */
+static int collect_expired_timers(struct timer_cpu_base *base, struct list_head *heads) {
+  uint64_t clk = base->clk;
+  int levels = 0;
 
-  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
-  if (!list_empty(&timer->entry)) {
-    int was_head = (base->active_timers.next == &timer->entry);
-    list_del_init(&timer->entry);
-    if (was_head) {
-      __timer_reprogram(base);
+  for (unsigned int lvl = 0; lvl < LVL_DEPTH; lvl++) {
+    unsigned int idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
+    uint64_t bit = 1ULL << (idx % LVL_SIZE);
+
+    if (base->pending_map[lvl] & bit) {
+      base->pending_map[lvl] &= ~bit;
+      list_splice_init(&base->vectors[idx], &heads[levels++]);
     }
+
+    /* Is it time to look at the next level? */
+    if (clk & LVL_CLK_MASK)
+      break;
+    clk >>= LVL_CLK_SHIFT;
   }
-  spinlock_unlock_irqrestore(&base->lock, flags);
+
+  return levels;
 }
 
-void __no_cfi timer_handler(void) {
+static void __no_cfi expire_timers(struct timer_cpu_base *base, struct list_head *head) {
+  while (!list_empty(head)) {
+    struct timer_list *timer = list_first_entry(head, struct timer_list, entry);
+    void (*func)(struct timer_list *) = timer->function;
+
+    list_del_init(&timer->entry);
+    base->running_timer = timer;
+    spinlock_unlock(&base->lock);
+
+    if (func)
+      func(timer);
+
+    spinlock_lock(&base->lock);
+    base->running_timer = nullptr;
+  }
+}
+
+/* Called from the tick with interrupts disabled */
+void run_local_timers(void) {
   struct timer_cpu_base *base = this_cpu_ptr(timer_bases);
-  uint64_t now = get_time_ns();
+  struct list_head heads[LVL_DEPTH];
+  uint64_t now_tick = get_time_ns() / TICK_NSEC;
 
-  // 1. Process expired timers
-  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
-  while (!list_empty(&base->active_timers)) {
-    struct timer_list *timer = list_first_entry(&base->active_timers, struct timer_list, entry);
-    if (timer->expires > now) {
-      break;
-    }
+  for (int i = 0; i < LVL_DEPTH; i++)
+    INIT_LIST_HEAD(&heads[i]);
 
-    list_del_init(&timer->entry);
-    spinlock_unlock_irqrestore(&base->lock, flags);
+  spinlock_lock(&base->lock);
 
-    if (timer->function) {
-      timer->function(timer);
+  while (now_tick >= base->clk) {
+    if (base->next_expiry > base->clk) {
+      /* Nothing due before next_expiry: skip the empty ticks */
+      base->clk = base->next_expiry <= now_tick ? base->next_expiry : now_tick + 1;
+      continue;
     }
 
-    flags = spinlock_lock_irqsave(&base->lock);
+    int levels = collect_expired_timers(base, heads);
+    base->clk++;
+    base->next_expiry = __next_timer_interrupt(base);
+
+    while (levels--)
+      expire_timers(base, &heads[levels]);
   }
 
-  // 2. Reprogram for next timer
-  __timer_reprogram(base);
+  spinlock_unlock(&base->lock);
+}
+
+uint64_t timer_next_event_ns(void) {
+  struct timer_cpu_base *base = this_cpu_ptr(timer_bases);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&base->lock);
+  base->next_expiry = __next_timer_interrupt(base);
+  uint64_t next = base->next_expiry;
   spinlock_unlock_irqrestore(&base->lock, flags);
 
-  // 3. Scheduler tick
-  scheduler_tick();
+  if (next == TIMER_NO_EXPIRY)
+    return TIMER_NO_EXPIRY;
+  return next * TICK_NSEC;
+}
+
+void __no_cfi timer_handler(void) {
+  if (hrtimer_hres_active()) {
+    // One-shot mode: the tick is an hrtimer
+    hrtimer_interrupt();
+  } else {
+    hrtimer_run_queues();
+    tick_handle_periodic();
+  }
+
   check_preempt();
 }
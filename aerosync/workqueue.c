@@ -3,88 +3,785 @@
  * AeroSync monolithic kernel
  *
  * @file aerosync/workqueue.c
- * @brief Workqueue implementation for asynchronous kernel tasks
+ * @brief Concurrency-managed workqueues on per-CPU and unbound worker pools
+ *
+ * Each CPU has a normal and a high-priority worker pool, each NUMA node an
+ * unbound pair. Per-CPU pools keep exactly one worker running as long as
+ * there is work: the scheduler tells us when a busy worker blocks
+ * (wq_worker_sleeping) so an idle one can continue with the queue, and a
+ * pool always keeps one idle worker in reserve so that hand-over never has
+ * to wait for thread creation. Surplus idle workers exit after a timeout.
  */
 
 #include <aerosync/workqueue.h>
 #include <aerosync/sched/sched.h>
 #include <aerosync/sched/process.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/export.h>
 #include <linux/container_of.h>
 #include <mm/slub.h>
+#include <mm/zone.h>
 #include <lib/printk.h>
+#include <lib/vsprintf.h>
+#include <lib/string.h>
 #include <aerosync/wait.h>
 #include <aerosync/classes.h>
+#include <aerosync/errno.h>
 #include <aerosync/sysintf/panic.h>
+#include <fs/vfs.h>
+#include <fs/procfs.h>
 
-static struct workqueue_struct *system_wq;
+#ifndef WQ_MAX_WORKERS
+#ifndef CONFIG_WQ_MAX_WORKERS
+#define WQ_MAX_WORKERS 32
+#else
+#define WQ_MAX_WORKERS CONFIG_WQ_MAX_WORKERS
+#endif
+#endif
 
-static int __no_cfi worker_thread(void *data) {
-  struct workqueue_struct *wq = data;
+/* Idle workers beyond the reserve exit after this long */
+#define WQ_IDLE_WORKER_TIMEOUT_NS (300ULL * NSEC_PER_SEC)
+
+/* Always keep this many idle workers, and one per 4 busy ones beyond that */
+#define WQ_MIN_IDLE_WORKERS 2
+#define WQ_MAX_IDLE_WORKERS_RATIO 4
+
+#define NR_STD_WORKER_POOLS 2 /* normal, highpri */
+
+/* pool->flags */
+#define POOL_UNBOUND        (1 << 0)
+#define POOL_MANAGER_ACTIVE (1 << 1)
+
+/* worker->flags */
+#define WORKER_IDLE     (1 << 0)
+#define WORKER_RUNNING  (1 << 1) /* Counted in pool->nr_running */
+#define WORKER_SLEEPING (1 << 2) /* Blocked inside a work item */
+
+struct worker_pool {
+  spinlock_t lock;
+  int cpu;                     /* Bound CPU, -1 for unbound pools */
+  int node;
+  unsigned int flags;
+  bool highpri;
+  struct cpumask cpus;         /* Where the workers may run */
+
+  struct list_head worklist;
+  struct list_head idle_list;  /* Most recently active first */
+  struct list_head workers;
+  int nr_workers;
+  int nr_idle;
+  int next_worker_id;
+  atomic_t nr_running;         /* Busy, not blocked workers (per-CPU pools) */
+
+  wait_queue_head_t done_wait; /* flush_work() waiters */
+
+  /* Statistics */
+  uint64_t nr_queued;
+  uint64_t nr_executed;
+  uint32_t depth;              /* Work items on the worklist */
+  uint32_t max_depth;
+  uint64_t lat_total_ns;       /* Queue to start of execution */
+  uint64_t lat_max_ns;
+  uint64_t exec_total_ns;
+  uint64_t nr_workers_created;
+};
+
+struct worker {
+  struct list_head node;       /* pool->idle_list while idle */
+  struct list_head all;        /* pool->workers */
+  struct task_struct *task;
+  struct worker_pool *pool;
+  unsigned int flags;
+  struct work_struct *current_work;
+  work_func_t current_func;
+  uint64_t last_active;
+  int id;
+};
+
+static DEFINE_PER_CPU(struct worker_pool, cpu_worker_pools[NR_STD_WORKER_POOLS]);
+static struct worker_pool unbound_pools[MAX_NUMNODES][NR_STD_WORKER_POOLS];
+
+static LIST_HEAD(workqueues);
+static DEFINE_SPINLOCK(workqueues_lock);
+
+struct workqueue_struct *system_wq;
+struct workqueue_struct *system_highpri_wq;
+struct workqueue_struct *system_unbound_wq;
+EXPORT_SYMBOL(system_wq);
+EXPORT_SYMBOL(system_highpri_wq);
+EXPORT_SYMBOL(system_unbound_wq);
+
+static struct worker_pool *cpu_pool(int cpu, bool highpri) {
+  return &(*per_cpu_ptr(cpu_worker_pools, cpu))[highpri];
+}
+
+static struct worker_pool *unbound_pool(int node, bool highpri) {
+  if (node < 0 || node >= MAX_NUMNODES)
+    node = 0;
+  return &unbound_pools[node][highpri];
+}
+
+/* --- Pool state (pool->lock held) --- */
+
+static bool need_more_worker(struct worker_pool *pool) {
+  if (list_empty(&pool->worklist))
+    return false;
+  return (pool->flags & POOL_UNBOUND) || atomic_read(&pool->nr_running) == 0;
+}
+
+/* Would a worker that starts now leave an idle one behind? */
+static bool may_start_working(struct worker_pool *pool) {
+  return pool->nr_idle > 0;
+}
+
+static bool keep_working(struct worker_pool *pool) {
+  if (list_empty(&pool->worklist))
+    return false;
+  return (pool->flags & POOL_UNBOUND) || atomic_read(&pool->nr_running) <= 1;
+}
+
+static bool too_many_workers(struct worker_pool *pool) {
+  int nr_idle = pool->nr_idle;
+  int nr_busy = pool->nr_workers - nr_idle;
+
+  return nr_idle > WQ_MIN_IDLE_WORKERS &&
+         (nr_idle - WQ_MIN_IDLE_WORKERS) * WQ_MAX_IDLE_WORKERS_RATIO >= nr_busy;
+}
+
+static void wake_up_worker(struct worker_pool *pool) {
+  if (list_empty(&pool->idle_list))
+    return; /* Not started yet, or every worker busy and at the limit */
+
+  struct worker *worker = list_first_entry(&pool->idle_list, struct worker, node);
+  task_wake_up(worker->task);
+}
+
+static void worker_set_running(struct worker *worker) {
+  if ((worker->pool->flags & POOL_UNBOUND) || (worker->flags & WORKER_RUNNING))
+    return;
+  worker->flags |= WORKER_RUNNING;
+  atomic_inc(&worker->pool->nr_running);
+}
+
+static void worker_clr_running(struct worker *worker) {
+  if (!(worker->flags & WORKER_RUNNING))
+    return;
+  worker->flags &= ~WORKER_RUNNING;
+  atomic_dec(&worker->pool->nr_running);
+}
+
+static void worker_enter_idle(struct worker *worker) {
+  struct worker_pool *pool = worker->pool;
+
+  worker_clr_running(worker);
+  worker->flags |= WORKER_IDLE;
+  worker->last_active = get_time_ns();
+  pool->nr_idle++;
+  list_add(&worker->node, &pool->idle_list);
+}
+
+static void worker_leave_idle(struct worker *worker) {
+  struct worker_pool *pool = worker->pool;
+
+  if (!(worker->flags & WORKER_IDLE))
+    return;
+  worker->flags &= ~WORKER_IDLE;
+  pool->nr_idle--;
+  list_del_init(&worker->node);
+}
+
+static struct worker *find_worker_executing_work(struct worker_pool *pool,
+                                                 struct work_struct *work) {
+  struct worker *worker;
+
+  list_for_each_entry(worker, &pool->workers, all) {
+    if (worker->current_work == work && worker->current_func == work->func)
+      return worker;
+  }
+  return nullptr;
+}
+
+static void insert_work(struct worker_pool *pool, struct work_struct *work) {
+  work->queued_ns = get_time_ns();
+  list_add_tail(&work->entry, &pool->worklist);
+
+  pool->nr_queued++;
+  if (++pool->depth > pool->max_depth)
+    pool->max_depth = pool->depth;
+
+  if (need_more_worker(pool))
+    wake_up_worker(pool);
+}
+
+/* --- Workers --- */
+
+static int worker_thread(void *data);
+
+static void worker_bind(struct task_struct *task, struct worker_pool *pool) {
+  cpumask_copy(&task->cpus_allowed, &pool->cpus);
+  task->nr_cpus_allowed = cpumask_weight(&pool->cpus);
+  set_task_cpu(task, pool->cpu >= 0 ? pool->cpu : cpumask_first(&pool->cpus));
+}
+
+/* Not started yet, so the scheduling entity can be set up directly */
+static void worker_set_highpri(struct task_struct *task) {
+  task->nice = MIN_NICE;
+  task->static_prio = MAX_RT_PRIO + NICE_TO_PRIO_OFFSET + MIN_NICE;
+  task->normal_prio = task->static_prio;
+  task->prio = task->static_prio;
+  task->se.load.weight = prio_to_weight[MIN_NICE + NICE_TO_PRIO_OFFSET];
+  task->se.load.inv_weight = 0;
+}
 
-  while (1) {
-    wait_event(wq->wait, !list_empty(&wq->worklist));
+/* Called without pool->lock; the new worker starts out idle */
+static struct worker *create_worker(struct worker_pool *pool) {
+  struct worker *worker = kzalloc(sizeof(*worker));
+  if (!worker)
+    return nullptr;
+
+  INIT_LIST_HEAD(&worker->node);
+  INIT_LIST_HEAD(&worker->all);
+  worker->pool = pool;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&pool->lock);
+  worker->id = pool->next_worker_id++;
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+
+  struct task_struct *task;
+  if (pool->cpu >= 0)
+    task = kthread_create(worker_thread, worker, "kworker/%d:%d%s", pool->cpu,
+                          worker->id, pool->highpri ? "H" : "");
+  else
+    task = kthread_create(worker_thread, worker, "kworker/u%d:%d%s", pool->node,
+                          worker->id, pool->highpri ? "H" : "");
+  if (!task) {
+    kfree(worker);
+    return nullptr;
+  }
+
+  task->flags |= PF_WQ_WORKER | PF_NO_SETAFFINITY;
+  task->worker = worker;
+  worker_bind(task, pool);
+  if (pool->highpri)
+    worker_set_highpri(task);
+  worker->task = task;
+
+  flags = spinlock_lock_irqsave(&pool->lock);
+  list_add_tail(&worker->all, &pool->workers);
+  pool->nr_workers++;
+  pool->nr_workers_created++;
+  worker_enter_idle(worker);
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+
+  kthread_run(task);
+  return worker;
+}
+
+/*
+ * Replenish the idle reserve before starting on the queue. Drops and
+ * retakes pool->lock; returns true if the pool state may have changed.
+ */
+static bool manage_workers(struct worker *worker, irq_flags_t *flags) {
+  struct worker_pool *pool = worker->pool;
+
+  if ((pool->flags & POOL_MANAGER_ACTIVE) || pool->nr_workers >= WQ_MAX_WORKERS)
+    return false;
+
+  pool->flags |= POOL_MANAGER_ACTIVE;
+  spinlock_unlock_irqrestore(&pool->lock, *flags);
 
-    irq_flags_t flags = spinlock_lock_irqsave(&wq->lock);
-    while (!list_empty(&wq->worklist)) {
-      struct work_struct *work = list_first_entry(&wq->worklist, struct work_struct, entry);
-      list_del_init(&work->entry);
-      __atomic_and_fetch(&work->flags, ~WORK_STRUCT_PENDING, __ATOMIC_RELEASE);
+  bool created = create_worker(pool) != nullptr;
 
-      spinlock_unlock_irqrestore(&wq->lock, flags);
+  *flags = spinlock_lock_irqsave(&pool->lock);
+  pool->flags &= ~POOL_MANAGER_ACTIVE;
+  return created;
+}
+
+/* Called and returns with pool->lock held */
+static void __no_cfi process_one_work(struct worker *worker, struct work_struct *work,
+                                      irq_flags_t *flags) {
+  struct worker_pool *pool = worker->pool;
+  struct workqueue_struct *wq = work->wq;
+  uint64_t start = get_time_ns();
+  uint64_t lat = start - work->queued_ns;
+
+  list_del_init(&work->entry);
+  pool->depth--;
+  pool->lat_total_ns += lat;
+  if (lat > pool->lat_max_ns)
+    pool->lat_max_ns = lat;
+
+  worker->current_work = work;
+  worker->current_func = work->func;
+
+  /* From here on the work may be queued again, even while it runs */
+  __atomic_and_fetch(&work->flags, ~WORK_STRUCT_PENDING, __ATOMIC_RELEASE);
+  spinlock_unlock_irqrestore(&pool->lock, *flags);
+
+  /* @work may be freed by its own function */
+  if (worker->current_func)
+    worker->current_func(work);
+
+  *flags = spinlock_lock_irqsave(&pool->lock);
+  pool->exec_total_ns += get_time_ns() - start;
+  pool->nr_executed++;
+  worker->current_work = nullptr;
+  worker->current_func = nullptr;
+
+  if (waitqueue_active(&pool->done_wait))
+    wake_up_all(&pool->done_wait);
+  if (wq && atomic_dec_and_test(&wq->nr_in_flight))
+    wake_up_all(&wq->flush_wait);
+}
+
+static bool worker_should_retire(struct worker *worker) {
+  struct worker_pool *pool = worker->pool;
+
+  return (worker->flags & WORKER_IDLE) && list_empty(&pool->worklist) &&
+         too_many_workers(pool) &&
+         get_time_ns() - worker->last_active >= WQ_IDLE_WORKER_TIMEOUT_NS;
+}
+
+static int __no_cfi worker_thread(void *data) {
+  struct worker *worker = data;
+  struct worker_pool *pool = worker->pool;
+  irq_flags_t flags = spinlock_lock_irqsave(&pool->lock);
 
-      if (work->func) {
-        work->func(work);
-      }
+  for (;;) {
+    worker_leave_idle(worker);
 
-      flags = spinlock_lock_irqsave(&wq->lock);
+    while (need_more_worker(pool)) {
+      if (!may_start_working(pool) && manage_workers(worker, &flags))
+        continue;
+
+      worker_set_running(worker);
+      do {
+        struct work_struct *work = list_first_entry(&pool->worklist, struct work_struct, entry);
+        process_one_work(worker, work, &flags);
+      } while (keep_working(pool));
+      break;
     }
-    spinlock_unlock_irqrestore(&wq->lock, flags);
+
+    worker_enter_idle(worker);
+    set_current_state(TASK_INTERRUPTIBLE);
+    spinlock_unlock_irqrestore(&pool->lock, flags);
+
+    schedule_timeout(WQ_IDLE_WORKER_TIMEOUT_NS);
+
+    flags = spinlock_lock_irqsave(&pool->lock);
+    if (worker_should_retire(worker))
+      break;
   }
+
+  worker_leave_idle(worker);
+  list_del(&worker->all);
+  pool->nr_workers--;
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+
+  current->flags &= ~PF_WQ_WORKER;
+  current->worker = nullptr;
+  kfree(worker);
   return 0;
 }
 
-struct workqueue_struct *create_workqueue(const char *name) {
-  struct workqueue_struct *wq = kzalloc(sizeof(struct workqueue_struct));
-  if (!wq) return nullptr;
+/* --- Scheduler hooks --- */
 
-  wq->name = name;
-  INIT_LIST_HEAD(&wq->worklist);
-  spinlock_init(&wq->lock);
-  init_waitqueue_head(&wq->wait);
+void wq_worker_sleeping(struct task_struct *task) {
+  struct worker *worker = task->worker;
 
-  wq->worker = kthread_create(worker_thread, wq, "wq/%s", name);
-  if (!wq->worker) {
-    kfree(wq);
-    return nullptr;
+  if (!worker || !(worker->flags & WORKER_RUNNING))
+    return;
+
+  struct worker_pool *pool = worker->pool;
+  worker->flags &= ~WORKER_RUNNING;
+  worker->flags |= WORKER_SLEEPING;
+
+  /* The last running worker blocked: let an idle one carry on */
+  irq_flags_t flags = spinlock_lock_irqsave(&pool->lock);
+  if (atomic_dec_and_test(&pool->nr_running) && !list_empty(&pool->worklist))
+    wake_up_worker(pool);
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+}
+
+void wq_worker_running(struct task_struct *task) {
+  struct worker *worker = task->worker;
+
+  if (!worker || !(worker->flags & WORKER_SLEEPING))
+    return;
+
+  worker->flags &= ~WORKER_SLEEPING;
+  worker->flags |= WORKER_RUNNING;
+  atomic_inc(&worker->pool->nr_running);
+}
+
+/* --- Queueing --- */
+
+/* Caller owns WORK_STRUCT_PENDING */
+static void __queue_work(int cpu, struct workqueue_struct *wq, struct work_struct *work) {
+  bool highpri = wq->flags & WQ_HIGHPRI;
+  struct worker_pool *pool, *last;
+  irq_flags_t flags;
+
+  if (cpu == WORK_CPU_UNBOUND || !cpumask_test_cpu(cpu, &cpu_online_mask))
+    cpu = (int) smp_get_id();
+
+  if (wq->flags & WQ_UNBOUND)
+    pool = unbound_pool(cpu_to_node(cpu), highpri);
+  else
+    pool = cpu_pool(cpu, highpri);
+
+  /*
+   * A work item never runs concurrently with itself: if it is still
+   * running in another pool, queue it behind that instance.
+   */
+  last = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE);
+  if (last && last != pool) {
+    flags = spinlock_lock_irqsave(&last->lock);
+    if (find_worker_executing_work(last, work)) {
+      pool = last;
+    } else {
+      spinlock_unlock(&last->lock);
+      spinlock_lock(&pool->lock);
+    }
+  } else {
+    flags = spinlock_lock_irqsave(&pool->lock);
   }
 
-  wq->worker->flags |= PF_WQ_WORKER;
-  kthread_run(wq->worker);
+  __atomic_store_n(&work->pool, pool, __ATOMIC_RELEASE);
+  work->wq = wq;
+  atomic_inc(&wq->nr_in_flight);
+  insert_work(pool, work);
 
-  return wq;
+  spinlock_unlock_irqrestore(&pool->lock, flags);
 }
 
-bool queue_work(struct workqueue_struct *wq, struct work_struct *work) {
-  if (__atomic_test_and_set(&work->flags, __ATOMIC_ACQUIRE)) {
+static bool test_and_set_pending(struct work_struct *work) {
+  return __atomic_fetch_or(&work->flags, WORK_STRUCT_PENDING, __ATOMIC_ACQUIRE) &
+         WORK_STRUCT_PENDING;
+}
+
+static void clear_pending(struct work_struct *work) {
+  __atomic_and_fetch(&work->flags, ~WORK_STRUCT_PENDING, __ATOMIC_RELEASE);
+}
+
+bool queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work) {
+  if (test_and_set_pending(work))
     return false; // Already pending
-  }
 
-  irq_flags_t flags = spinlock_lock_irqsave(&wq->lock);
-  list_add_tail(&work->entry, &wq->worklist);
-  spinlock_unlock_irqrestore(&wq->lock, flags);
+  __queue_work(cpu, wq, work);
+  return true;
+}
+EXPORT_SYMBOL(queue_work_on);
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work) {
+  return queue_work_on(WORK_CPU_UNBOUND, wq, work);
+}
+EXPORT_SYMBOL(queue_work);
+
+void delayed_work_timer_fn(struct timer_list *timer) {
+  struct delayed_work *dwork = container_of(timer, struct delayed_work, timer);
+
+  __queue_work(dwork->cpu, dwork->wq, &dwork->work);
+}
+EXPORT_SYMBOL(delayed_work_timer_fn);
+
+bool queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
+                           struct delayed_work *dwork, uint64_t delay_ns) {
+  struct work_struct *work = &dwork->work;
+
+  if (test_and_set_pending(work))
+    return false;
 
-  wake_up(&wq->wait);
+  if (!delay_ns) {
+    __queue_work(cpu, wq, work);
+    return true;
+  }
+
+  dwork->wq = wq;
+  dwork->cpu = cpu;
+  timer_add(&dwork->timer, get_time_ns() + delay_ns);
   return true;
 }
+EXPORT_SYMBOL(queue_delayed_work_on);
+
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+                        uint64_t delay_ns) {
+  return queue_delayed_work_on(WORK_CPU_UNBOUND, wq, dwork, delay_ns);
+}
+EXPORT_SYMBOL(queue_delayed_work);
 
 bool schedule_work(struct work_struct *work) {
   return queue_work(system_wq, work);
 }
+EXPORT_SYMBOL(schedule_work);
+
+bool schedule_work_on(int cpu, struct work_struct *work) {
+  return queue_work_on(cpu, system_wq, work);
+}
+EXPORT_SYMBOL(schedule_work_on);
+
+bool schedule_delayed_work(struct delayed_work *dwork, uint64_t delay_ns) {
+  return queue_delayed_work(system_wq, dwork, delay_ns);
+}
+EXPORT_SYMBOL(schedule_delayed_work);
+
+/* --- Flush and cancel --- */
+
+static bool work_busy_on(struct worker_pool *pool, struct work_struct *work) {
+  irq_flags_t flags = spinlock_lock_irqsave(&pool->lock);
+  bool busy = (work->pool == pool && !list_empty(&work->entry)) ||
+              find_worker_executing_work(pool, work);
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+  return busy;
+}
+
+bool flush_work(struct work_struct *work) {
+  struct worker_pool *pool = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE);
+
+  if (!pool || !work_busy_on(pool, work))
+    return false;
+
+  wait_event(pool->done_wait, !work_busy_on(pool, work));
+  return true;
+}
+EXPORT_SYMBOL(flush_work);
+
+bool flush_delayed_work(struct delayed_work *dwork) {
+  if (timer_del(&dwork->timer))
+    __queue_work(dwork->cpu, dwork->wq, &dwork->work);
+  return flush_work(&dwork->work);
+}
+EXPORT_SYMBOL(flush_delayed_work);
+
+void flush_workqueue(struct workqueue_struct *wq) {
+  wait_event(wq->flush_wait, atomic_read(&wq->nr_in_flight) == 0);
+}
+EXPORT_SYMBOL(flush_workqueue);
+
+/*
+ * try_to_grab_pending - Take ownership of WORK_STRUCT_PENDING
+ *
+ * @return 1 if @work was pending and has been dequeued, 0 if it was idle,
+ * -EAGAIN if it is in flux (being queued by its timer or another CPU).
+ * On success the caller owns PENDING, so nobody can queue @work.
+ */
+static int try_to_grab_pending(struct work_struct *work, bool is_dwork) {
+  if (is_dwork && timer_del(&to_delayed_work(work)->timer))
+    return 1;
+
+  if (!test_and_set_pending(work))
+    return 0;
+
+  struct worker_pool *pool = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE);
+  if (!pool)
+    return -EAGAIN;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&pool->lock);
+  if (work->pool == pool && !list_empty(&work->entry)) {
+    struct workqueue_struct *wq = work->wq;
+
+    list_del_init(&work->entry);
+    pool->depth--;
+    spinlock_unlock_irqrestore(&pool->lock, flags);
+
+    if (wq && atomic_dec_and_test(&wq->nr_in_flight))
+      wake_up_all(&wq->flush_wait);
+    return 1;
+  }
+  spinlock_unlock_irqrestore(&pool->lock, flags);
+  return -EAGAIN;
+}
+
+static bool __cancel_work(struct work_struct *work, bool is_dwork, bool sync) {
+  int ret;
+
+  while ((ret = try_to_grab_pending(work, is_dwork)) < 0)
+    cpu_relax();
+
+  /* Nobody can queue it while we hold PENDING; wait out a running instance */
+  if (sync)
+    flush_work(work);
+
+  clear_pending(work);
+  return ret;
+}
+
+bool cancel_work_sync(struct work_struct *work) {
+  return __cancel_work(work, false, true);
+}
+EXPORT_SYMBOL(cancel_work_sync);
+
+bool cancel_delayed_work(struct delayed_work *dwork) {
+  return __cancel_work(&dwork->work, true, false);
+}
+EXPORT_SYMBOL(cancel_delayed_work);
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork) {
+  return __cancel_work(&dwork->work, true, true);
+}
+EXPORT_SYMBOL(cancel_delayed_work_sync);
+
+/* --- Workqueues --- */
+
+struct workqueue_struct *alloc_workqueue(const char *name, unsigned int flags) {
+  struct workqueue_struct *wq = kzalloc(sizeof(struct workqueue_struct));
+  if (!wq) return nullptr;
+
+  wq->name = name;
+  wq->flags = flags;
+  atomic_set(&wq->nr_in_flight, 0);
+  init_waitqueue_head(&wq->flush_wait);
+
+  irq_flags_t irq = spinlock_lock_irqsave(&workqueues_lock);
+  list_add_tail(&wq->list, &workqueues);
+  spinlock_unlock_irqrestore(&workqueues_lock, irq);
+
+  return wq;
+}
+EXPORT_SYMBOL(alloc_workqueue);
+
+struct workqueue_struct *create_workqueue(const char *name) {
+  return alloc_workqueue(name, 0);
+}
+EXPORT_SYMBOL(create_workqueue);
+
+void destroy_workqueue(struct workqueue_struct *wq) {
+  flush_workqueue(wq);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&workqueues_lock);
+  list_del(&wq->list);
+  spinlock_unlock_irqrestore(&workqueues_lock, flags);
+
+  kfree(wq);
+}
+EXPORT_SYMBOL(destroy_workqueue);
+
+/* --- /proc/workqueues --- */
+
+#define WQ_PROC_BUF_SIZE 8192
+
+static int wq_proc_show_pool(char *kbuf, int len, const char *name, struct worker_pool *pool) {
+  uint64_t queued = READ_ONCE(pool->nr_queued);
+  uint64_t executed = READ_ONCE(pool->nr_executed);
+
+  if (!pool->nr_workers && !queued)
+    return 0;
+
+  uint64_t avg_lat = executed ? READ_ONCE(pool->lat_total_ns) / executed : 0;
+  uint64_t avg_exec = executed ? READ_ONCE(pool->exec_total_ns) / executed : 0;
+
+  return snprintf(kbuf + len, WQ_PROC_BUF_SIZE - len,
+                  "%-8s %4s %7d %4d %7d %5u %8u %10lu %10lu %10lu %10lu %10lu\n",
+                  name, pool->highpri ? "high" : "norm", READ_ONCE(pool->nr_workers),
+                  READ_ONCE(pool->nr_idle), atomic_read(&pool->nr_running),
+                  READ_ONCE(pool->depth), READ_ONCE(pool->max_depth), queued, executed,
+                  avg_lat / 1000, READ_ONCE(pool->lat_max_ns) / 1000, avg_exec / 1000);
+}
+
+static ssize_t proc_workqueues_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  char name[16];
+  int cpu;
+
+  char *kbuf = kmalloc(WQ_PROC_BUF_SIZE);
+  if (!kbuf)
+    return -ENOMEM;
+
+  int len = snprintf(kbuf, WQ_PROC_BUF_SIZE,
+                     "pool     prio workers idle running depth maxdepth     queued   executed"
+                     " avg_lat_us max_lat_us avg_run_us\n");
+
+  for_each_online_cpu(cpu) {
+    snprintf(name, sizeof(name), "cpu%d", cpu);
+    for (int i = 0; i < NR_STD_WORKER_POOLS && len < WQ_PROC_BUF_SIZE; i++)
+      len += wq_proc_show_pool(kbuf, len, name, cpu_pool(cpu, i));
+  }
+
+  for (int node = 0; node < MAX_NUMNODES; node++) {
+    snprintf(name, sizeof(name), "node%d", node);
+    for (int i = 0; i < NR_STD_WORKER_POOLS && len < WQ_PROC_BUF_SIZE; i++)
+      len += wq_proc_show_pool(kbuf, len, name, unbound_pool(node, i));
+  }
+
+  if (len > WQ_PROC_BUF_SIZE)
+    len = WQ_PROC_BUF_SIZE;
+
+  ssize_t ret = simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+  kfree(kbuf);
+  return ret;
+}
+
+static const struct file_operations proc_workqueues_fops = {
+  .read = proc_workqueues_read,
+};
+
+/* --- Initialization --- */
+
+static void init_worker_pool(struct worker_pool *pool, int cpu, int node, bool highpri) {
+  memset(pool, 0, sizeof(*pool));
+  spinlock_init(&pool->lock);
+  pool->cpu = cpu;
+  pool->node = node;
+  pool->highpri = highpri;
+  pool->flags = cpu < 0 ? POOL_UNBOUND : 0;
+  INIT_LIST_HEAD(&pool->worklist);
+  INIT_LIST_HEAD(&pool->idle_list);
+  INIT_LIST_HEAD(&pool->workers);
+  atomic_set(&pool->nr_running, 0);
+  init_waitqueue_head(&pool->done_wait);
+  if (cpu >= 0)
+    cpumask_set_cpu(cpu, &pool->cpus);
+}
+
+void workqueue_init_early(void) {
+  int cpu;
+
+  for_each_possible_cpu(cpu) {
+    for (int i = 0; i < NR_STD_WORKER_POOLS; i++)
+      init_worker_pool(cpu_pool(cpu, i), cpu, 0, i);
+  }
+
+  for (int node = 0; node < MAX_NUMNODES; node++) {
+    for (int i = 0; i < NR_STD_WORKER_POOLS; i++)
+      init_worker_pool(unbound_pool(node, i), -1, node, i);
+  }
+
+  system_wq = alloc_workqueue("events", 0);
+  system_highpri_wq = alloc_workqueue("events_highpri", WQ_HIGHPRI);
+  system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND);
+  if (!system_wq || !system_highpri_wq || !system_unbound_wq) {
+    panic("Failed to create system workqueues");
+  }
+}
 
 void workqueue_init(void) {
-  system_wq = create_workqueue("system");
-  if (!system_wq) {
-    panic("Failed to create system workqueue");
+  int cpu, nr_nodes = 0;
+
+  for_each_online_cpu(cpu) {
+    for (int i = 0; i < NR_STD_WORKER_POOLS; i++) {
+      struct worker_pool *pool = cpu_pool(cpu, i);
+      pool->node = cpu_to_node(cpu);
+      if (!create_worker(pool))
+        panic("Failed to create worker for CPU %d", cpu);
+    }
+
+    struct worker_pool *upool = unbound_pool(cpu_to_node(cpu), false);
+    cpumask_set_cpu(cpu, &upool->cpus);
+    cpumask_set_cpu(cpu, &unbound_pool(cpu_to_node(cpu), true)->cpus);
+  }
+
+  for (int node = 0; node < MAX_NUMNODES; node++) {
+    if (cpumask_empty(&unbound_pool(node, false)->cpus))
+      continue;
+    nr_nodes++;
+    for (int i = 0; i < NR_STD_WORKER_POOLS; i++) {
+      if (!create_worker(unbound_pool(node, i)))
+        panic("Failed to create unbound worker for node %d", node);
+    }
   }
-  printk(KERN_INFO KERN_CLASS "System workqueue initialized.\n");
+
+  proc_create("workqueues", &proc_workqueues_fops);
+
+  printk(KERN_INFO KERN_CLASS "Workqueues initialized (%d CPU pools, %d unbound pools).\n",
+         smp_get_cpu_count() * NR_STD_WORKER_POOLS, nr_nodes * NR_STD_WORKER_POOLS);
 }
@@ -31,6 +31,9 @@
 #include <arch/x86_64/entry.h>
 #include <fs/file.h>
 #include <fs/vfs.h>
+#include <fs/uio.h>
+#include <fs/pipe.h>
+#include <fs/eventpoll.h>
 #include <mm/slub.h>
 #include <lib/bitmap.h>
 #include <aerosync/signal.h>
@@ -55,59 +58,14 @@ static void sys_ni_syscall(struct syscall_regs *regs) {
   REGS_RETURN_VAL(regs, -1);
 }
 
-static void sys_read(struct syscall_regs *regs) {
+static void sys_read_handler(struct syscall_regs *regs) {
   int fd = (int) regs->rdi;
   char *buf = (char *) regs->rsi;
   size_t count = (size_t) regs->rdx;
-
-  struct file *file = fget(fd);
-  if (!file) {
-    REGS_RETURN_VAL(regs, -EBADF);
-    return;
-  }
-
-  if ((file->f_flags & O_ACCMODE) == O_WRONLY) {
-    fput(file);
-    REGS_RETURN_VAL(regs, -EBADF);
-    return;
-  }
-
-  size_t total_read = 0;
-  char *kbuf = kmalloc(4096);
-  if (!kbuf) {
-    fput(file);
-    REGS_RETURN_VAL(regs, -ENOMEM);
-    return;
-  }
-
-  while (count > 0) {
-    size_t to_read = (count > 4096) ? 4096 : count;
-    vfs_loff_t pos = file->f_pos;
-    ssize_t ret = vfs_read(file, kbuf, to_read, &pos);
-
-    if (ret < 0) {
-      if (total_read == 0) total_read = ret;
-      break;
-    }
-    if (ret == 0) break;
-
-    if (copy_to_user(buf + total_read, kbuf, ret) != 0) {
-      if (total_read == 0) total_read = -EFAULT;
-      break;
-    }
-
-    file->f_pos = pos;
-    total_read += ret;
-    count -= ret;
-    if (ret < (ssize_t) to_read) break;
-  }
-
-  kfree(kbuf);
-  fput(file);
-  REGS_RETURN_VAL(regs, total_read);
+  REGS_RETURN_VAL(regs, sys_read(fd, buf, count));
 }
 
-static void sys_write(struct syscall_regs *regs) {
+static void sys_write_handler(struct syscall_regs *regs) {
   int fd = (int) regs->rdi;
   const char *buf = (const char *) regs->rsi;
   size_t count = (size_t) regs->rdx;
@@ -140,49 +98,71 @@ static void sys_write(struct syscall_regs *regs) {
   }
 #endif
 
-  struct file *file = fget(fd);
-  if (!file) {
-    REGS_RETURN_VAL(regs, -EBADF);
-    return;
-  }
+  REGS_RETURN_VAL(regs, sys_write(fd, buf, count));
+}
 
-  if ((file->f_flags & O_ACCMODE) == O_RDONLY) {
-    fput(file);
-    REGS_RETURN_VAL(regs, -EBADF);
-    return;
-  }
+static void sys_pread64_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  char *buf = (char *) regs->rsi;
+  size_t count = (size_t) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  REGS_RETURN_VAL(regs, sys_pread64(fd, buf, count, pos));
+}
 
-  size_t total_written = 0;
-  char *kbuf = kmalloc(4096);
-  if (!kbuf) {
-    fput(file);
-    REGS_RETURN_VAL(regs, -ENOMEM);
-    return;
-  }
+static void sys_pwrite64_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const char *buf = (const char *) regs->rsi;
+  size_t count = (size_t) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  REGS_RETURN_VAL(regs, sys_pwrite64(fd, buf, count, pos));
+}
 
-  while (count > 0) {
-    size_t to_write = (count > 4096) ? 4096 : count;
-    if (copy_from_user(kbuf, buf + total_written, to_write) != 0) {
-      if (total_written == 0) total_written = -EFAULT;
-      break;
-    }
+static void sys_readv_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  REGS_RETURN_VAL(regs, sys_readv(fd, vec, vlen));
+}
 
-    vfs_loff_t pos = file->f_pos;
-    ssize_t ret = vfs_write(file, kbuf, to_write, &pos);
-    if (ret < 0) {
-      if (total_written == 0) total_written = ret;
-      break;
-    }
+static void sys_writev_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  REGS_RETURN_VAL(regs, sys_writev(fd, vec, vlen));
+}
 
-    file->f_pos = pos;
-    total_written += ret;
-    count -= ret;
-    if (ret < (ssize_t) to_write) break;
-  }
+static void sys_preadv_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  REGS_RETURN_VAL(regs, sys_preadv(fd, vec, vlen, pos));
+}
 
-  kfree(kbuf);
-  fput(file);
-  REGS_RETURN_VAL(regs, total_written);
+static void sys_pwritev_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  REGS_RETURN_VAL(regs, sys_pwritev(fd, vec, vlen, pos));
+}
+
+static void sys_preadv2_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  int flags = (int) regs->r9;
+  REGS_RETURN_VAL(regs, sys_preadv2(fd, vec, vlen, pos, flags));
+}
+
+static void sys_pwritev2_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  int vlen = (int) regs->rdx;
+  vfs_loff_t pos = (vfs_loff_t) regs->r10;
+  int flags = (int) regs->r9;
+  REGS_RETURN_VAL(regs, sys_pwritev2(fd, vec, vlen, pos, flags));
 }
 
 static void sys_open(struct syscall_regs *regs) {
@@ -533,7 +513,6 @@ static void sys_pipe(struct syscall_regs *regs) {
   int *pipefd_user = (int *) regs->rdi;
   int pipefd[2];
 
-  extern int do_pipe(int pipefd[2]);
   int ret = do_pipe(pipefd);
 
   if (ret == 0) {
@@ -547,6 +526,68 @@ static void sys_pipe(struct syscall_regs *regs) {
   REGS_RETURN_VAL(regs, ret);
 }
 
+static void sys_splice_handler(struct syscall_regs *regs) {
+  int fd_in = (int) regs->rdi;
+  vfs_loff_t *off_in = (vfs_loff_t *) regs->rsi;
+  int fd_out = (int) regs->rdx;
+  vfs_loff_t *off_out = (vfs_loff_t *) regs->r10;
+  size_t len = (size_t) regs->r8;
+  unsigned int flags = (unsigned int) regs->r9;
+  REGS_RETURN_VAL(regs, sys_splice(fd_in, off_in, fd_out, off_out, len, flags));
+}
+
+static void sys_tee_handler(struct syscall_regs *regs) {
+  int fd_in = (int) regs->rdi;
+  int fd_out = (int) regs->rsi;
+  size_t len = (size_t) regs->rdx;
+  unsigned int flags = (unsigned int) regs->r10;
+  REGS_RETURN_VAL(regs, sys_tee(fd_in, fd_out, len, flags));
+}
+
+static void sys_epoll_create_handler(struct syscall_regs *regs) {
+  int size = (int) regs->rdi;
+  /* @size is only a hint, but must be positive */
+  REGS_RETURN_VAL(regs, size <= 0 ? -EINVAL : sys_epoll_create1(0));
+}
+
+static void sys_epoll_create1_handler(struct syscall_regs *regs) {
+  REGS_RETURN_VAL(regs, sys_epoll_create1((int) regs->rdi));
+}
+
+static void sys_epoll_ctl_handler(struct syscall_regs *regs) {
+  int epfd = (int) regs->rdi;
+  int op = (int) regs->rsi;
+  int fd = (int) regs->rdx;
+  struct epoll_event *event = (struct epoll_event *) regs->r10;
+  REGS_RETURN_VAL(regs, sys_epoll_ctl(epfd, op, fd, event));
+}
+
+static void sys_epoll_wait_handler(struct syscall_regs *regs) {
+  int epfd = (int) regs->rdi;
+  struct epoll_event *events = (struct epoll_event *) regs->rsi;
+  int maxevents = (int) regs->rdx;
+  int timeout = (int) regs->r10;
+  REGS_RETURN_VAL(regs, sys_epoll_pwait(epfd, events, maxevents, timeout, nullptr, 0));
+}
+
+static void sys_epoll_pwait_handler(struct syscall_regs *regs) {
+  int epfd = (int) regs->rdi;
+  struct epoll_event *events = (struct epoll_event *) regs->rsi;
+  int maxevents = (int) regs->rdx;
+  int timeout = (int) regs->r10;
+  const sigset_t *sigmask = (const sigset_t *) regs->r8;
+  size_t sigsetsize = (size_t) regs->r9;
+  REGS_RETURN_VAL(regs, sys_epoll_pwait(epfd, events, maxevents, timeout, sigmask, sigsetsize));
+}
+
+static void sys_vmsplice_handler(struct syscall_regs *regs) {
+  int fd = (int) regs->rdi;
+  const struct iovec *vec = (const struct iovec *) regs->rsi;
+  unsigned long nr_segs = (unsigned long) regs->rdx;
+  unsigned int flags = (unsigned int) regs->r10;
+  REGS_RETURN_VAL(regs, sys_vmsplice(fd, vec, nr_segs, flags));
+}
+
 static void sys_mkdir_handler(struct syscall_regs *regs) {
   const char *path = (const char *) regs->rdi;
   vfs_mode_t mode = (vfs_mode_t) regs->rsi;
@@ -636,8 +677,8 @@ static void sys_mount_handler(struct syscall_regs *regs) {
 }
 
 static sys_call_ptr_t syscall_table[] = {
-  [0] = sys_read,
-  [1] = sys_write,
+  [0] = sys_read_handler,
+  [1] = sys_write_handler,
   [2] = sys_open,
   [3] = sys_close,
   [4] = sys_stat,
@@ -651,6 +692,10 @@ static sys_call_ptr_t syscall_table[] = {
   [14] = sys_rt_sigprocmask,
   [15] = sys_rt_sigreturn,
   [16] = sys_ioctl,
+  [17] = sys_pread64_handler,
+  [18] = sys_pwrite64_handler,
+  [19] = sys_readv_handler,
+  [20] = sys_writev_handler,
   [32] = sys_dup_handler,
   [33] = sys_dup2_handler,
   [72] = sys_fcntl_handler,
@@ -677,7 +722,19 @@ static sys_call_ptr_t syscall_table[] = {
   [133] = sys_mknod_handler,
   [165] = sys_mount_handler,
   [200] = sys_tkill,
+  [213] = sys_epoll_create_handler,
+  [232] = sys_epoll_wait_handler,
+  [233] = sys_epoll_ctl_handler,
   [234] = sys_tgkill,
+  [275] = sys_splice_handler,
+  [276] = sys_tee_handler,
+  [278] = sys_vmsplice_handler,
+  [281] = sys_epoll_pwait_handler,
+  [291] = sys_epoll_create1_handler,
+  [295] = sys_preadv_handler,
+  [296] = sys_pwritev_handler,
+  [327] = sys_preadv2_handler,
+  [328] = sys_pwritev2_handler,
 };
 
 #define NR_SYSCALLS (sizeof(syscall_table) / sizeof(sys_call_ptr_t))
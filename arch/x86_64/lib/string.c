@@ -0,0 +1,609 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file arch/x86_64/lib/string.c
+ * @brief x86_64 memory copy/fill variants and their boot-time selection
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/x86_64/string.h>
+#include <arch/x86_64/static_call.h>
+#include <arch/x86_64/features/features.h>
+#include <arch/x86_64/fpu.h>
+#include <arch/x86_64/tsc.h>
+#include <arch/x86_64/mm/pmm.h>
+#include <aerosync/classes.h>
+#include <aerosync/export.h>
+#include <aerosync/softirq.h>
+#include <lib/printk.h>
+#include <lib/string.h>
+#include <mm/gfp.h>
+#include <mm/page.h>
+#include <mm/zone.h>
+
+/* Below this, ERMS without FSRM loses to the unrolled C loop */
+#define ERMS_MIN_SIZE 64
+
+/* Copy loops in arch/x86_64/lib/uaccess.asm */
+extern size_t __copy_user_bytes(void *to, const void *from, size_t n);
+extern size_t __copy_user_movsq(void *to, const void *from, size_t n);
+extern size_t __copy_user_erms(void *to, const void *from, size_t n);
+extern size_t __copy_user(void *to, const void *from, size_t n);
+
+/* --- memcpy --- */
+
+static void *memcpy_movsq(void *d, const void *s, size_t n) {
+  void *ret = d;
+  size_t quads = n >> 3;
+
+  __asm__ volatile("cld\n\t"
+                   "rep movsq\n\t"
+                   "movq %[tail], %%rcx\n\t"
+                   "rep movsb"
+                   : "+D"(d), "+S"(s), "+c"(quads)
+                   : [tail] "r"(n & 7)
+                   : "memory");
+  return ret;
+}
+
+static void *memcpy_erms(void *d, const void *s, size_t n) {
+  void *ret = d;
+
+  if (n < ERMS_MIN_SIZE)
+    return memcpy_generic(d, s, n);
+
+  __asm__ volatile("cld\n\t"
+                   "rep movsb"
+                   : "+D"(d), "+S"(s), "+c"(n)
+                   :
+                   : "memory");
+  return ret;
+}
+
+static void *memcpy_fsrm(void *d, const void *s, size_t n) {
+  void *ret = d;
+
+  __asm__ volatile("cld\n\t"
+                   "rep movsb"
+                   : "+D"(d), "+S"(s), "+c"(n)
+                   :
+                   : "memory");
+  return ret;
+}
+
+/* --- memset --- */
+
+static void *memset_stosq(void *s, int c, size_t n) {
+  void *ret = s;
+  size_t quads = n >> 3;
+  uint64_t pattern = 0x0101010101010101ULL * (unsigned char)c;
+
+  __asm__ volatile("cld\n\t"
+                   "rep stosq\n\t"
+                   "movq %[tail], %%rcx\n\t"
+                   "rep stosb"
+                   : "+D"(s), "+c"(quads)
+                   : "a"(pattern), [tail] "r"(n & 7)
+                   : "memory");
+  return ret;
+}
+
+static void *memset_erms(void *s, int c, size_t n) {
+  void *ret = s;
+
+  if (n < ERMS_MIN_SIZE)
+    return memset_generic(s, c, n);
+
+  __asm__ volatile("cld\n\t"
+                   "rep stosb"
+                   : "+D"(s), "+c"(n)
+                   : "a"((unsigned char)c)
+                   : "memory");
+  return ret;
+}
+
+static void *memset_fsrm(void *s, int c, size_t n) {
+  void *ret = s;
+
+  __asm__ volatile("cld\n\t"
+                   "rep stosb"
+                   : "+D"(s), "+c"(n)
+                   : "a"((unsigned char)c)
+                   : "memory");
+  return ret;
+}
+
+/* --- memmove --- */
+
+/* Backward rep movsb for overlapping dest > src; everything else is memcpy */
+static void *memmove_erms(void *dest, const void *src, size_t n) {
+  if (dest <= src || (const char *)src + n <= (char *)dest)
+    return memcpy(dest, src, n);
+  if (n < ERMS_MIN_SIZE)
+    return memmove_generic(dest, src, n);
+
+  void *d_end = (char *)dest + n - 1;
+  const void *s_end = (const char *)src + n - 1;
+  __asm__ volatile("std\n\t"
+                   "rep movsb\n\t"
+                   "cld"
+                   : "+D"(d_end), "+S"(s_end), "+c"(n)
+                   :
+                   : "memory");
+  return dest;
+}
+
+/* --- copy_page --- */
+
+static __used void copy_page_movsq(void *to, const void *from) {
+  size_t quads = PAGE_SIZE / 8;
+
+  __asm__ volatile("cld\n\t"
+                   "rep movsq"
+                   : "+D"(to), "+S"(from), "+c"(quads)
+                   :
+                   : "memory");
+}
+
+static void copy_page_erms(void *to, const void *from) {
+  size_t n = PAGE_SIZE;
+
+  __asm__ volatile("cld\n\t"
+                   "rep movsb"
+                   : "+D"(to), "+S"(from), "+c"(n)
+                   :
+                   : "memory");
+}
+
+/* Non-temporal stores: the copy does not evict the caller's working set */
+static void copy_page_nt(void *to, const void *from) {
+  unsigned int lines = PAGE_SIZE / 64;
+
+  __asm__ volatile("1:\n\t"
+                   "movq 0(%[s]), %%rax\n\t"
+                   "movq 8(%[s]), %%rdx\n\t"
+                   "movq 16(%[s]), %%r8\n\t"
+                   "movq 24(%[s]), %%r9\n\t"
+                   "movnti %%rax, 0(%[d])\n\t"
+                   "movnti %%rdx, 8(%[d])\n\t"
+                   "movnti %%r8, 16(%[d])\n\t"
+                   "movnti %%r9, 24(%[d])\n\t"
+                   "movq 32(%[s]), %%rax\n\t"
+                   "movq 40(%[s]), %%rdx\n\t"
+                   "movq 48(%[s]), %%r8\n\t"
+                   "movq 56(%[s]), %%r9\n\t"
+                   "movnti %%rax, 32(%[d])\n\t"
+                   "movnti %%rdx, 40(%[d])\n\t"
+                   "movnti %%r8, 48(%[d])\n\t"
+                   "movnti %%r9, 56(%[d])\n\t"
+                   "addq $64, %[s]\n\t"
+                   "addq $64, %[d]\n\t"
+                   "decl %[n]\n\t"
+                   "jnz 1b\n\t"
+                   "sfence"
+                   : [d] "+r"(to), [s] "+r"(from), [n] "+r"(lines)
+                   :
+                   : "rax", "rdx", "r8", "r9", "cc", "memory");
+}
+
+/*
+ * Interrupt handlers may hit this while a task is inside kernel_fpu_begin(),
+ * and the FPU section does not nest; they take the integer path instead.
+ */
+__attribute__((target("avx2")))
+static void copy_page_avx2(void *to, const void *from) {
+  unsigned int chunks = PAGE_SIZE / 128;
+
+  if (unlikely(in_interrupt())) {
+    copy_page_movsq(to, from);
+    return;
+  }
+
+  kernel_fpu_begin();
+  __asm__ volatile("1:\n\t"
+                   "vmovdqa 0(%[s]), %%ymm0\n\t"
+                   "vmovdqa 32(%[s]), %%ymm1\n\t"
+                   "vmovdqa 64(%[s]), %%ymm2\n\t"
+                   "vmovdqa 96(%[s]), %%ymm3\n\t"
+                   "vmovdqa %%ymm0, 0(%[d])\n\t"
+                   "vmovdqa %%ymm1, 32(%[d])\n\t"
+                   "vmovdqa %%ymm2, 64(%[d])\n\t"
+                   "vmovdqa %%ymm3, 96(%[d])\n\t"
+                   "addq $128, %[s]\n\t"
+                   "addq $128, %[d]\n\t"
+                   "decl %[n]\n\t"
+                   "jnz 1b\n\t"
+                   "vzeroupper"
+                   : [d] "+r"(to), [s] "+r"(from), [n] "+r"(chunks)
+                   :
+                   : "xmm0", "xmm1", "xmm2", "xmm3", "cc", "memory");
+  kernel_fpu_end();
+}
+
+/* --- clear_page --- */
+
+static __used void clear_page_stosq(void *page) {
+  size_t quads = PAGE_SIZE / 8;
+
+  __asm__ volatile("cld\n\t"
+                   "rep stosq"
+                   : "+D"(page), "+c"(quads)
+                   : "a"(0ULL)
+                   : "memory");
+}
+
+static void clear_page_erms(void *page) {
+  size_t n = PAGE_SIZE;
+
+  __asm__ volatile("cld\n\t"
+                   "rep stosb"
+                   : "+D"(page), "+c"(n)
+                   : "a"(0)
+                   : "memory");
+}
+
+/* Bypasses the cache: for pages that will not be touched again soon */
+void clear_page_nocache(void *page) {
+  unsigned int lines = PAGE_SIZE / 64;
+
+  __asm__ volatile("xorl %%eax, %%eax\n\t"
+                   "1:\n\t"
+                   "movnti %%rax, 0(%[d])\n\t"
+                   "movnti %%rax, 8(%[d])\n\t"
+                   "movnti %%rax, 16(%[d])\n\t"
+                   "movnti %%rax, 24(%[d])\n\t"
+                   "movnti %%rax, 32(%[d])\n\t"
+                   "movnti %%rax, 40(%[d])\n\t"
+                   "movnti %%rax, 48(%[d])\n\t"
+                   "movnti %%rax, 56(%[d])\n\t"
+                   "addq $64, %[d]\n\t"
+                   "decl %[n]\n\t"
+                   "jnz 1b\n\t"
+                   "sfence"
+                   : [d] "+r"(page), [n] "+r"(lines)
+                   :
+                   : "rax", "cc", "memory");
+}
+
+__attribute__((target("avx2")))
+static void clear_page_avx2(void *page) {
+  unsigned int chunks = PAGE_SIZE / 128;
+
+  if (unlikely(in_interrupt())) {
+    clear_page_stosq(page);
+    return;
+  }
+
+  kernel_fpu_begin();
+  __asm__ volatile("vpxor %%ymm0, %%ymm0, %%ymm0\n\t"
+                   "1:\n\t"
+                   "vmovdqa %%ymm0, 0(%[d])\n\t"
+                   "vmovdqa %%ymm0, 32(%[d])\n\t"
+                   "vmovdqa %%ymm0, 64(%[d])\n\t"
+                   "vmovdqa %%ymm0, 96(%[d])\n\t"
+                   "addq $128, %[d]\n\t"
+                   "decl %[n]\n\t"
+                   "jnz 1b\n\t"
+                   "vzeroupper"
+                   : [d] "+r"(page), [n] "+r"(chunks)
+                   :
+                   : "xmm0", "cc", "memory");
+  kernel_fpu_end();
+}
+
+/* --- Static calls --- */
+
+DEFINE_STATIC_CALL(memcpy, memcpy_generic);
+DEFINE_STATIC_CALL(memset, memset_generic);
+DEFINE_STATIC_CALL(memmove, memmove_generic);
+DEFINE_STATIC_CALL(copy_page, copy_page_movsq);
+DEFINE_STATIC_CALL(clear_page, clear_page_stosq);
+DEFINE_STATIC_CALL(__copy_user, __copy_user_bytes);
+
+EXPORT_SYMBOL(copy_page);
+EXPORT_SYMBOL(clear_page);
+EXPORT_SYMBOL(clear_page_nocache);
+
+/* --- Selection --- */
+
+#define STRING_NEEDS_ERMS (1U << 0)
+#define STRING_NEEDS_FSRM (1U << 1)
+#define STRING_NEEDS_AVX2 (1U << 2)
+
+struct string_impl {
+  const char *name;
+  void *func;
+  unsigned int needs;
+};
+
+enum string_op {
+  STRING_MEMCPY,
+  STRING_MEMSET,
+  STRING_MEMMOVE,
+  STRING_COPY_PAGE,
+  STRING_CLEAR_PAGE,
+  STRING_COPY_USER,
+  NR_STRING_OPS,
+};
+
+#define STRING_MAX_IMPLS 4
+
+struct string_op_desc {
+  const char *name;
+  void *tramp;
+  bool paged; /* Takes whole pages, no length */
+  struct string_impl impls[STRING_MAX_IMPLS];
+};
+
+static const struct string_op_desc string_ops[NR_STRING_OPS] = {
+  [STRING_MEMCPY] = {
+    "memcpy", (void *)memcpy, false, {
+      {"generic", (void *)memcpy_generic, 0},
+      {"movsq", (void *)memcpy_movsq, 0},
+      {"erms", (void *)memcpy_erms, STRING_NEEDS_ERMS},
+      {"fsrm", (void *)memcpy_fsrm, STRING_NEEDS_FSRM},
+    }},
+  [STRING_MEMSET] = {
+    "memset", (void *)memset, false, {
+      {"generic", (void *)memset_generic, 0},
+      {"stosq", (void *)memset_stosq, 0},
+      {"erms", (void *)memset_erms, STRING_NEEDS_ERMS},
+      {"fsrm", (void *)memset_fsrm, STRING_NEEDS_FSRM},
+    }},
+  [STRING_MEMMOVE] = {
+    "memmove", (void *)memmove, false, {
+      {"generic", (void *)memmove_generic, 0},
+      {"erms", (void *)memmove_erms, STRING_NEEDS_ERMS},
+    }},
+  [STRING_COPY_PAGE] = {
+    "copy_page", (void *)copy_page, true, {
+      {"movsq", (void *)copy_page_movsq, 0},
+      {"erms", (void *)copy_page_erms, STRING_NEEDS_ERMS},
+      {"nt", (void *)copy_page_nt, 0},
+      {"avx2", (void *)copy_page_avx2, STRING_NEEDS_AVX2},
+    }},
+  [STRING_CLEAR_PAGE] = {
+    "clear_page", (void *)clear_page, true, {
+      {"stosq", (void *)clear_page_stosq, 0},
+      {"erms", (void *)clear_page_erms, STRING_NEEDS_ERMS},
+      {"nt", (void *)clear_page_nocache, 0},
+      {"avx2", (void *)clear_page_avx2, STRING_NEEDS_AVX2},
+    }},
+  [STRING_COPY_USER] = {
+    "copy_user", (void *)__copy_user, false, {
+      {"bytes", (void *)__copy_user_bytes, 0},
+      {"movsq", (void *)__copy_user_movsq, 0},
+      {"erms", (void *)__copy_user_erms, STRING_NEEDS_ERMS},
+    }},
+};
+
+static bool string_impl_usable(const struct string_impl *impl) {
+  cpu_features_t *features = get_cpu_features();
+
+  if (!impl->func)
+    return false;
+  if ((impl->needs & STRING_NEEDS_ERMS) && !features->erms)
+    return false;
+  if ((impl->needs & STRING_NEEDS_FSRM) && !features->fsrm)
+    return false;
+  if ((impl->needs & STRING_NEEDS_AVX2) &&
+      !(features->avx2 && features->osxsave))
+    return false;
+  return true;
+}
+
+typedef void *(*string_copy_t)(void *, const void *, size_t);
+typedef void *(*string_set_t)(void *, int, size_t);
+typedef void (*string_copy_page_t)(void *, const void *);
+typedef void (*string_clear_page_t)(void *);
+typedef size_t (*string_copy_user_t)(void *, const void *, size_t);
+
+/*
+ * TSC cycles for @iters calls of @func. memmove is timed on an overlapping
+ * backward move within @src, the case it exists for, so @src needs room for
+ * @size plus 64 bytes.
+ */
+static __noinline uint64_t string_time(enum string_op op, void *func,
+                                       char *dst, char *src, size_t size,
+                                       int iters) {
+  uint64_t start = rdtsc();
+
+  for (int i = 0; i < iters; i++) {
+    switch (op) {
+    case STRING_MEMCPY:
+      ((string_copy_t)func)(dst, src, size);
+      break;
+    case STRING_MEMSET:
+      ((string_set_t)func)(dst, 0x5a, size);
+      break;
+    case STRING_MEMMOVE:
+      ((string_copy_t)func)(src + 64, src, size);
+      break;
+    case STRING_COPY_PAGE:
+      ((string_copy_page_t)func)(dst, src);
+      break;
+    case STRING_CLEAR_PAGE:
+      ((string_clear_page_t)func)(dst);
+      break;
+    case STRING_COPY_USER:
+      ((string_copy_user_t)func)(dst, src, size);
+      break;
+    default:
+      break;
+    }
+  }
+
+  return rdtsc() - start;
+}
+
+/* Best of a few runs, so a stray interrupt does not decide the outcome */
+static uint64_t string_time_best(enum string_op op, void *func, char *dst,
+                                 char *src, size_t size, int iters) {
+  uint64_t best = UINT64_MAX;
+
+  for (int run = 0; run < 3; run++) {
+    uint64_t t = string_time(op, func, dst, src, size, iters);
+    if (t < best)
+      best = t;
+  }
+  return best ? best : 1;
+}
+
+/* Weighted towards the small copies the kernel mostly does */
+#define STRING_SELECT_NR_SIZES 5
+static const size_t string_select_sizes[STRING_SELECT_NR_SIZES] = {
+    8, 32, 128, 512, 4096};
+#define STRING_SELECT_ITERS 256
+#define STRING_BUF_ORDER    1 /* Two pages: room for the memmove overlap */
+
+static int string_select(enum string_op op, char *dst, char *src) {
+  const struct string_op_desc *desc = &string_ops[op];
+  int nr_sizes = desc->paged ? 1 : STRING_SELECT_NR_SIZES;
+  uint64_t cost[STRING_MAX_IMPLS][STRING_SELECT_NR_SIZES];
+  uint64_t best[STRING_SELECT_NR_SIZES];
+  int choice = 0;
+  uint64_t choice_score = UINT64_MAX;
+
+  for (int s = 0; s < nr_sizes; s++)
+    best[s] = UINT64_MAX;
+
+  for (int i = 0; i < STRING_MAX_IMPLS; i++) {
+    if (!string_impl_usable(&desc->impls[i]))
+      continue;
+    for (int s = 0; s < nr_sizes; s++) {
+      size_t size = desc->paged ? PAGE_SIZE : string_select_sizes[s];
+      cost[i][s] = string_time_best(op, desc->impls[i].func, dst, src, size,
+                                    STRING_SELECT_ITERS);
+      if (cost[i][s] < best[s])
+        best[s] = cost[i][s];
+    }
+  }
+
+  /* Sum of slowdowns against the best variant at each size */
+  for (int i = 0; i < STRING_MAX_IMPLS; i++) {
+    uint64_t score = 0;
+
+    if (!string_impl_usable(&desc->impls[i]))
+      continue;
+    for (int s = 0; s < nr_sizes; s++)
+      score += cost[i][s] * 1000 / best[s];
+    if (score < choice_score) {
+      choice_score = score;
+      choice = i;
+    }
+  }
+
+  return choice;
+}
+
+void string_ops_init(void) {
+#ifdef CONFIG_OPTIMIZED_STRING
+  struct folio *dst_folio = alloc_pages(GFP_KERNEL, STRING_BUF_ORDER);
+  struct folio *src_folio = alloc_pages(GFP_KERNEL, STRING_BUF_ORDER);
+
+  if (!dst_folio || !src_folio) {
+    printk(KERN_WARNING CPU_CLASS
+           "string: no memory to benchmark, keeping generic routines\n");
+    goto out;
+  }
+
+  char *dst = folio_address(dst_folio);
+  char *src = folio_address(src_folio);
+  memset(src, 0xa5, PAGE_SIZE << STRING_BUF_ORDER);
+  memset(dst, 0, PAGE_SIZE << STRING_BUF_ORDER);
+
+  for (int op = 0; op < NR_STRING_OPS; op++) {
+    const struct string_op_desc *desc = &string_ops[op];
+    int choice = string_select((enum string_op)op, dst, src);
+
+    __static_call_update(desc->tramp, desc->impls[choice].func);
+    printk(KERN_INFO CPU_CLASS "string: %s -> %s\n", desc->name,
+           desc->impls[choice].name);
+  }
+
+out:
+  if (dst_folio)
+    __free_pages(&dst_folio->page, STRING_BUF_ORDER);
+  if (src_folio)
+    __free_pages(&src_folio->page, STRING_BUF_ORDER);
+#endif
+}
+
+#ifdef CONFIG_STRING_BENCH
+
+#define STRING_BENCH_NR_SIZES 6
+static const size_t string_bench_sizes[STRING_BENCH_NR_SIZES] = {
+    64, 256, 1024, 4096, 16384, 65536};
+#define STRING_BENCH_ORDER 5 /* 128KB buffers */
+#define STRING_BENCH_BYTES (64ULL << 20) /* Moved per measurement */
+
+/* Hundredths of a GB/s for @bytes moved in @cycles */
+static uint64_t string_bench_rate(uint64_t bytes, uint64_t cycles) {
+  uint64_t freq = tsc_freq_get();
+
+  if (!freq || !cycles)
+    return 0;
+  /* MB/s = bytes * freq / cycles / 1e6, scaled down first to stay in range */
+  return (bytes / 1000) * (freq / 1000) / cycles / 10;
+}
+
+void string_bench(void) {
+  struct folio *dst_folio = alloc_pages(GFP_KERNEL, STRING_BENCH_ORDER);
+  struct folio *src_folio = alloc_pages(GFP_KERNEL, STRING_BENCH_ORDER);
+
+  if (!dst_folio || !src_folio) {
+    printk(KERN_ERR CPU_CLASS "stringbench: out of memory\n");
+    goto out;
+  }
+
+  char *dst = folio_address(dst_folio);
+  char *src = folio_address(src_folio);
+  memset(src, 0xa5, PAGE_SIZE << STRING_BENCH_ORDER);
+  memset(dst, 0, PAGE_SIZE << STRING_BENCH_ORDER);
+
+  for (int op = 0; op < NR_STRING_OPS; op++) {
+    const struct string_op_desc *desc = &string_ops[op];
+    void *bound = static_call_target(desc->tramp);
+    int nr_sizes = desc->paged ? 1 : STRING_BENCH_NR_SIZES;
+
+    for (int i = 0; i < STRING_MAX_IMPLS; i++) {
+      const struct string_impl *impl = &desc->impls[i];
+
+      if (!string_impl_usable(impl))
+        continue;
+
+      for (int s = 0; s < nr_sizes; s++) {
+        size_t size = desc->paged ? PAGE_SIZE : string_bench_sizes[s];
+        int iters = (int)(STRING_BENCH_BYTES / size);
+        uint64_t cycles = string_time_best((enum string_op)op, impl->func,
+                                           dst, src, size, iters);
+        uint64_t rate = string_bench_rate((uint64_t)iters * size, cycles);
+
+        printk(KERN_INFO CPU_CLASS
+               "stringbench: %-10s %-7s %6zu bytes: %3llu.%02llu GB/s%s\n",
+               desc->name, impl->name, size, rate / 100, rate % 100,
+               impl->func == bound ? " *" : "");
+      }
+    }
+  }
+
+out:
+  if (dst_folio)
+    __free_pages(&dst_folio->page, STRING_BENCH_ORDER);
+  if (src_folio)
+    __free_pages(&src_folio->page, STRING_BENCH_ORDER);
+}
+
+#endif /* CONFIG_STRING_BENCH */
@@ -5,11 +5,17 @@
 ; @file arch/x86_64/lib/uaccess.asm
 ; @brief User memory access routines with exception handling
 ; @copyright (C) 2025-2026 assembler-0
+;
+; Each routine copies n bytes in either direction and returns the number of
+; bytes left uncopied. A fault on any marked instruction lands in the fixup,
+; which works the remainder out from the string registers. The __copy_user
+; static call (arch/x86_64/lib/string.c) is bound to one of them at boot.
 
 section .text
 
-global __copy_from_user
-global __copy_to_user
+global __copy_user_bytes
+global __copy_user_movsq
+global __copy_user_erms
 
 extern g_cpu_features
 
@@ -27,17 +33,18 @@ extern g_cpu_features
 %%skip:
 %endmacro
 
-; size_t __copy_from_user(void *to [rdi], const void *from [rsi], size_t n [rdx])
-__copy_from_user:
+; size_t __copy_user_bytes(void *to [rdi], const void *from [rsi], size_t n [rdx])
+__copy_user_bytes:
     test rdx, rdx
     jz .done
-    
+
     SMAP_ALLOW
     mov rcx, rdx
 .loop:
-.copy_in:
+.load:
     mov al, byte [rsi]       ; Fault can happen here (reading user memory)
-    mov byte [rdi], al
+.store:
+    mov byte [rdi], al       ; Fault can happen here (writing user memory)
     inc rsi
     inc rdi
     dec rcx
@@ -54,38 +61,61 @@ __copy_from_user:
     ret
 
 section __ex_table alloc align=4
-    dd (.copy_in - $)
-    dd (__copy_from_user.fixup - $)
+    dd (__copy_user_bytes.load - $)
+    dd (__copy_user_bytes.fixup - $)
+    dd (__copy_user_bytes.store - $)
+    dd (__copy_user_bytes.fixup - $)
 section .text
 
-; size_t __copy_to_user(void *to [rdi], const void *from [rsi], size_t n [rdx])
-__copy_to_user:
-    test rdx, rdx
-    jz .done_to
-    
+; size_t __copy_user_movsq(void *to [rdi], const void *from [rsi], size_t n [rdx])
+__copy_user_movsq:
     SMAP_ALLOW
+    cld
     mov rcx, rdx
-.loop_to:
-    mov al, byte [rsi]
-.copy_out:
-    mov byte [rdi], al       ; Fault can happen here (writing user memory)
-    inc rsi
-    inc rdi
-    dec rcx
-    jnz .loop_to
+    shr rcx, 3
+    and edx, 7
+.quads:
+    rep movsq
+    mov ecx, edx
+.tail:
+    rep movsb
     SMAP_DENY
+    xor eax, eax
+    ret
 
-.done_to:
-    xor rax, rax
+.fixup_quads:                ; rcx quadwords and rdx tail bytes left
+    SMAP_DENY
+    lea rax, [rdx + rcx * 8]
     ret
 
-.fixup_to:
-    SMAP_DENY                ; Ensure SMAP is re-enabled on fault
+.fixup_tail:
+    SMAP_DENY
     mov rax, rcx
     ret
 
 section __ex_table
+    dd (__copy_user_movsq.quads - $)
+    dd (__copy_user_movsq.fixup_quads - $)
+    dd (__copy_user_movsq.tail - $)
+    dd (__copy_user_movsq.fixup_tail - $)
+section .text
+
+; size_t __copy_user_erms(void *to [rdi], const void *from [rsi], size_t n [rdx])
+__copy_user_erms:
+    SMAP_ALLOW
+    cld
+    mov rcx, rdx
+.bytes:
+    rep movsb
+    SMAP_DENY
+    xor eax, eax
+    ret
 
-    dd (.copy_out - $)
+.fixup:
+    SMAP_DENY
+    mov rax, rcx
+    ret
 
-    dd (__copy_to_user.fixup_to - $)
+section __ex_table
+    dd (__copy_user_erms.bytes - $)
+    dd (__copy_user_erms.fixup - $)
@@ -19,8 +19,13 @@
  */
 
 #include <aerosync/classes.h>
+#include <aerosync/completion.h>
 #include <aerosync/errno.h>
 #include <aerosync/fkx/fkx.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sched/process.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/timer.h>
 #include <arch/x86_64/features/features.h>
 #include <arch/x86_64/mm/pmm.h>
 #include <arch/x86_64/mm/vmm.h>
@@ -96,10 +101,413 @@ find_memmap_location(struct limine_memmap_response *memmap,
 extern void numa_init(void *rsdp);
 
 extern int pfn_to_nid(uint64_t pfn);
+extern const struct cpumask *cpumask_of_node(int node);
 
 uint64_t empty_zero_page = 0;
 EXPORT_SYMBOL(empty_zero_page);
 
+/* Kept for deferred init; bootloader-reclaimable memory is never reused */
+static struct limine_memmap_response *pmm_boot_memmap;
+static uint64_t pmm_mm_start_pfn;
+static uint64_t pmm_mm_end_pfn;
+
+/*
+ * Feed usable [start_pfn, end_pfn) to the buddy allocator.
+ *
+ * Find the largest naturally-aligned power-of-2 block that fits, stamp the
+ * minimal per-page metadata (node, zone), batch the present_pages
+ * accounting, and hand the block to __free_pages_boot_core() which bypasses
+ * the PCP/deferred paths.  @locked is set once other CPUs may be allocating
+ * from the zones.  Returns the number of pages freed.
+ */
+static uint64_t pmm_free_range(uint64_t start_pfn, uint64_t end_pfn,
+                               bool locked) {
+  uint64_t freed = 0;
+  uint64_t cur_pfn = start_pfn;
+  while (cur_pfn < end_pfn) {
+    /* Jump past the mem_map region in O(1) instead of O(region_size). */
+    if (cur_pfn >= pmm_mm_start_pfn && cur_pfn < pmm_mm_end_pfn) {
+      cur_pfn = pmm_mm_end_pfn;
+      continue;
+    }
+
+    // Find largest order that fits and is aligned
+    unsigned int order = 0;
+    uint64_t max_count = end_pfn - cur_pfn;
+
+    // We also must stop before hitting the mem_map region
+    if (cur_pfn < pmm_mm_start_pfn && (cur_pfn + max_count) > pmm_mm_start_pfn) {
+      max_count = pmm_mm_start_pfn - cur_pfn;
+    }
+
+    for (unsigned int o = 0; o < MAX_ORDER - 1; o++) {
+      uint64_t next_size = 1UL << (o + 1);
+      if ((cur_pfn & (next_size - 1)) != 0)
+        break;
+      if (next_size > max_count)
+        break;
+
+      /* Check if the entire next_size block is on the same node and in the same zone */
+      int start_nid = pfn_to_nid(cur_pfn);
+      int end_nid = pfn_to_nid(cur_pfn + next_size - 1);
+      if (start_nid != end_nid)
+        break;
+
+      /* 
+       * ZONE boundaries are at 16MB (4096) and 4GB (1048576).
+       * Both are 1GB aligned or larger, so a naturally aligned 1GB block
+       * will NEVER cross these boundaries unless it starts before and ends after.
+       * But a 1GB aligned block starts at N*1GB.
+       * 16MB is NOT 1GB aligned. 4GB IS 1GB aligned.
+       * So a block starting at 3GB and ending at 4GB is fine.
+       * A block starting at 0 and ending at 1GB crosses 16MB.
+       */
+      int start_z = (cur_pfn < 4096) ? ZONE_DMA : (cur_pfn < 1048576 ? ZONE_DMA32 : ZONE_NORMAL);
+      int end_z = ((cur_pfn + next_size - 1) < 4096) ? ZONE_DMA : ((cur_pfn + next_size - 1) < 1048576 ? ZONE_DMA32 : ZONE_NORMAL);
+      if (start_z != end_z)
+        break;
+
+      order = o + 1;
+    }
+
+    int nid = pfn_to_nid(cur_pfn);
+    struct pglist_data *pgdat = node_data[nid];
+    if (!pgdat) {
+      nid = 0;
+      pgdat = node_data[0];
+    }
+
+    /*
+     * Determine zone for the head PFN.  Blocks from the buddy's
+     * order-finding loop above never cross zone boundaries because
+     * zone thresholds (4096, 1048576) are power-of-2 aligned and
+     * blocks are naturally aligned.  If a block did span a boundary,
+     * the max_count limiter or alignment constraint would have
+     * truncated it.  We can therefore set zone once per block.
+     */
+    int z_idx;
+    if (cur_pfn < 4096)
+      z_idx = ZONE_DMA;
+    else if (cur_pfn < 1048576)
+      z_idx = ZONE_DMA32;
+    else
+      z_idx = ZONE_NORMAL;
+
+    uint64_t count = 1UL << order;
+
+    /*
+     * Stamp minimal per-page metadata.
+     * Only node and zone need to be set (migratetype is already 0 =
+     * MIGRATE_UNMOVABLE from memset).  We deliberately write just
+     * two uint32_t fields per page struct for cache efficiency.
+     */
+    for (uint64_t p = cur_pfn; p < cur_pfn + count; p++) {
+      mem_map[p].node = nid;
+      mem_map[p].zone = z_idx;
+    }
+
+    struct zone *zone = &pgdat->node_zones[z_idx];
+    if (locked) {
+      irq_flags_t flags = spinlock_lock_irqsave(&zone->lock);
+      zone->present_pages += count;
+      __free_pages_boot_core(&mem_map[cur_pfn], order);
+      spinlock_unlock_irqrestore(&zone->lock, flags);
+    } else {
+      /* Batch present_pages accounting — one add per block. */
+      zone->present_pages += count;
+      __free_pages_boot_core(&mem_map[cur_pfn], order);
+    }
+
+    freed += count;
+    cur_pfn += count;
+  }
+
+  return freed;
+}
+
+#ifdef CONFIG_MM_PMM_DEFERRED_INIT
+
+#ifndef PMM_DEFERRED_EARLY_MB
+#ifndef CONFIG_MM_PMM_DEFERRED_INIT_EARLY_MB
+#define PMM_DEFERRED_EARLY_MB 1024
+#else
+#define PMM_DEFERRED_EARLY_MB CONFIG_MM_PMM_DEFERRED_INIT_EARLY_MB
+#endif
+#endif
+
+/*
+ * Deferred memory is handed out in max-order (1GB) chunks, aligned to the
+ * largest buddy block, so a merge never looks at the struct pages of a
+ * chunk nobody has zeroed yet.
+ */
+#define PMM_DEFERRED_CHUNK_PAGES (1UL << (MAX_ORDER - 1))
+
+struct pmm_deferred_node {
+  atomic_t nr_workers;
+  atomic_long_t nr_pages;
+  uint64_t start_ns;
+};
+
+static struct pmm_deferred_node pmm_deferred_nodes[MAX_NUMNODES];
+static atomic_t pmm_deferred_nr_workers;
+static struct completion pmm_deferred_done;
+
+/*
+ * Per node, everything below 4GB plus PMM_DEFERRED_EARLY_MB above it is
+ * initialized by pmm_init(); the rest of the node span is deferred.
+ */
+static void pmm_deferred_setup(void) {
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    struct pglist_data *pgdat = node_data[n];
+    if (!pgdat)
+      continue;
+
+    spinlock_init(&pgdat->deferred_lock);
+    pgdat->first_deferred_pfn = 0;
+    pgdat->deferred_end_pfn = 0;
+    if (!pgdat->node_spanned_pages || pgdat->node_start_pfn >= pmm_max_pages)
+      continue;
+
+    uint64_t node_end = pgdat->node_start_pfn + pgdat->node_spanned_pages;
+    if (node_end > pmm_max_pages)
+      node_end = pmm_max_pages;
+
+    uint64_t first = pgdat->node_start_pfn < 1048576 ? 1048576
+                                                     : pgdat->node_start_pfn;
+    first += (uint64_t)PMM_DEFERRED_EARLY_MB << (20 - PAGE_SHIFT);
+    first = (first + PMM_DEFERRED_CHUNK_PAGES - 1) &
+            ~(PMM_DEFERRED_CHUNK_PAGES - 1);
+    if (first > node_end)
+      first = node_end;
+
+    pgdat->first_deferred_pfn = first;
+    pgdat->deferred_end_pfn = node_end;
+  }
+}
+
+/*
+ * If @pfn lies in a not yet initialized range, store the range end in
+ * *@stop and return true. Otherwise clamp *@stop to the start of the next
+ * such range above @pfn.
+ */
+static bool pmm_deferred_lookup(uint64_t pfn, uint64_t *stop) {
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    struct pglist_data *pgdat = node_data[n];
+    if (!pgdat || pgdat->first_deferred_pfn >= pgdat->deferred_end_pfn)
+      continue;
+
+    if (pfn >= pgdat->first_deferred_pfn && pfn < pgdat->deferred_end_pfn) {
+      *stop = pgdat->deferred_end_pfn;
+      return true;
+    }
+    if (pgdat->first_deferred_pfn > pfn && pgdat->first_deferred_pfn < *stop)
+      *stop = pgdat->first_deferred_pfn;
+  }
+  return false;
+}
+
+static bool pmm_deferred_claim(struct pglist_data *pgdat, uint64_t *start_pfn,
+                               uint64_t *end_pfn) {
+  bool claimed = false;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&pgdat->deferred_lock);
+  if (pgdat->first_deferred_pfn < pgdat->deferred_end_pfn) {
+    *start_pfn = pgdat->first_deferred_pfn;
+    *end_pfn = *start_pfn + PMM_DEFERRED_CHUNK_PAGES;
+    if (*end_pfn > pgdat->deferred_end_pfn)
+      *end_pfn = pgdat->deferred_end_pfn;
+    pgdat->first_deferred_pfn = *end_pfn;
+    claimed = true;
+  }
+  spinlock_unlock_irqrestore(&pgdat->deferred_lock, flags);
+
+  return claimed;
+}
+
+/* Zero the struct pages of a claimed chunk and free its usable memory */
+static void pmm_deferred_init_chunk(struct pglist_data *pgdat,
+                                    uint64_t start_pfn, uint64_t end_pfn) {
+  uint64_t freed = 0;
+
+  memset(&mem_map[start_pfn], 0, (end_pfn - start_pfn) * sizeof(struct page));
+
+  for (uint64_t i = 0; i < pmm_boot_memmap->entry_count; i++) {
+    struct limine_memmap_entry *entry = pmm_boot_memmap->entries[i];
+    if (entry->type != LIMINE_MEMMAP_USABLE)
+      continue;
+
+    uint64_t s = PHYS_TO_PFN(PAGE_ALIGN_UP(entry->base));
+    uint64_t e = PHYS_TO_PFN(PAGE_ALIGN_DOWN(entry->base + entry->length));
+    if (s < start_pfn)
+      s = start_pfn;
+    if (e > end_pfn)
+      e = end_pfn;
+    if (s < e)
+      freed += pmm_free_range(s, e, true);
+  }
+
+  atomic_long_add(freed, &pmm_deferred_nodes[pgdat->node_id].nr_pages);
+}
+
+bool pmm_deferred_grow(struct pglist_data *pgdat) {
+  uint64_t start_pfn, end_pfn;
+
+  if (READ_ONCE(pgdat->first_deferred_pfn) >= pgdat->deferred_end_pfn)
+    return false;
+  if (!pmm_deferred_claim(pgdat, &start_pfn, &end_pfn))
+    return false;
+
+  pmm_deferred_init_chunk(pgdat, start_pfn, end_pfn);
+  return true;
+}
+
+/* Worker memory bandwidth saturates well before a node runs out of CPUs */
+#define PMM_DEFERRED_MAX_WORKERS 8
+
+static void pmm_deferred_put(struct pglist_data *pgdat) {
+  struct pmm_deferred_node *dn = &pmm_deferred_nodes[pgdat->node_id];
+
+  if (atomic_dec_and_test(&dn->nr_workers)) {
+    uint64_t ms = (get_time_ns() - dn->start_ns) / 1000000;
+    printk(KERN_INFO PMM_CLASS "node %d: %lu pages initialized in %llu ms\n",
+           pgdat->node_id, atomic_long_read(&dn->nr_pages), ms);
+  }
+
+  if (atomic_dec_and_test(&pmm_deferred_nr_workers))
+    complete(&pmm_deferred_done);
+}
+
+static int pmm_deferred_worker(void *data) {
+  struct pglist_data *pgdat = data;
+  uint64_t start_pfn, end_pfn;
+
+  while (pmm_deferred_claim(pgdat, &start_pfn, &end_pfn)) {
+    pmm_deferred_init_chunk(pgdat, start_pfn, end_pfn);
+    if (this_cpu_read(need_resched))
+      schedule();
+  }
+
+  pmm_deferred_put(pgdat);
+  return 0;
+}
+
+static void pmm_setup_watermarks(void);
+
+void pmm_deferred_init(void) {
+  bool deferred = false;
+
+  init_completion(&pmm_deferred_done);
+  atomic_set(&pmm_deferred_nr_workers, 1);
+
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    struct pglist_data *pgdat = node_data[n];
+    if (!pgdat || pgdat->first_deferred_pfn >= pgdat->deferred_end_pfn)
+      continue;
+
+    const struct cpumask *mask = cpumask_of_node(n);
+    if (cpumask_empty(mask))
+      mask = &cpu_online_mask;
+
+    /*
+     * Both counts hold a bias until every worker of the node is running,
+     * so a fast worker cannot report the node or signal completion early.
+     */
+    struct pmm_deferred_node *dn = &pmm_deferred_nodes[n];
+    dn->start_ns = get_time_ns();
+    atomic_set(&dn->nr_workers, 1);
+    atomic_inc(&pmm_deferred_nr_workers);
+    deferred = true;
+
+    int cpu, nr = 0;
+    for_each_cpu(cpu, mask) {
+      if (nr >= PMM_DEFERRED_MAX_WORKERS)
+        break;
+      if (!cpumask_test_cpu(cpu, &cpu_online_mask))
+        continue;
+
+      struct task_struct *task =
+          kthread_create(pmm_deferred_worker, pgdat, "pgdatinit%d/%d", n, cpu);
+      if (!task)
+        continue;
+
+      cpumask_copy(&task->cpus_allowed, mask);
+      task->nr_cpus_allowed = cpumask_weight(mask);
+      set_task_cpu(task, cpu);
+
+      atomic_inc(&dn->nr_workers);
+      atomic_inc(&pmm_deferred_nr_workers);
+      kthread_run(task);
+      nr++;
+    }
+
+    /* Finish here whatever no worker could be spawned for */
+    if (!nr) {
+      while (pmm_deferred_grow(pgdat))
+        ;
+    }
+    pmm_deferred_put(pgdat);
+  }
+
+  if (!atomic_dec_and_test(&pmm_deferred_nr_workers))
+    wait_for_completion(&pmm_deferred_done);
+
+  if (deferred)
+    pmm_setup_watermarks();
+}
+
+#else
+
+static inline void pmm_deferred_setup(void) {}
+static inline bool pmm_deferred_lookup(uint64_t pfn, uint64_t *stop) {
+  (void)pfn;
+  (void)stop;
+  return false;
+}
+void pmm_deferred_init(void) {}
+
+#endif /* CONFIG_MM_PMM_DEFERRED_INIT */
+
+/* Feed an early usable range, leaving deferred memory to the workers */
+static void pmm_free_early(uint64_t start_pfn, uint64_t end_pfn) {
+  uint64_t cur_pfn = start_pfn;
+
+  while (cur_pfn < end_pfn) {
+    uint64_t stop = end_pfn;
+    if (!pmm_deferred_lookup(cur_pfn, &stop))
+      pmm_free_range(cur_pfn, stop, false);
+    cur_pfn = stop;
+  }
+}
+
+/* Derive zone watermarks from present_pages and log the zone summary */
+static void pmm_setup_watermarks(void) {
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    if (!node_data[n])
+      continue;
+    struct pglist_data *pgdat = node_data[n];
+
+    for (int i = 0; i < MAX_NR_ZONES; i++) {
+      struct zone *z = &pgdat->node_zones[i];
+      if (z->present_pages > 0) {
+        z->watermark[WMARK_MIN] = z->present_pages / 100;
+        z->watermark[WMARK_LOW] = z->present_pages * 3 / 100;
+        z->watermark[WMARK_HIGH] = z->present_pages * 5 / 100;
+        z->watermark[WMARK_PROMO] = z->present_pages * 7 / 100;
+
+#ifdef CONFIG_MM_PMM_HIGHATOMIC
+        z->nr_reserved_highatomic =
+            (CONFIG_MM_PMM_HIGHATOMIC_RESERVE_KB * 1024) / PAGE_SIZE;
+        if (z->nr_reserved_highatomic > z->present_pages / 20)
+          z->nr_reserved_highatomic = z->present_pages / 20;
+#endif
+
+        printk(KERN_DEBUG PMM_CLASS "node %d Zone %s: %lu pages\n", n, z->name,
+               z->present_pages);
+      }
+    }
+  }
+}
+
 int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
   struct limine_memmap_response *memmap =
       (struct limine_memmap_response *)memmap_response_ptr;
@@ -110,6 +518,7 @@ int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
   }
 
   g_hhdm_offset = hhdm_offset;
+  pmm_boot_memmap = memmap;
 
   volatile struct limine_executable_address_request *exec_addr = get_executable_address_request();
   if (exec_addr->response) {
@@ -181,26 +590,6 @@ int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
   uint64_t mm_phys = PAGE_ALIGN_DOWN(mm_region->base + mm_region->length - memmap_size);
   mem_map = (struct page *)pmm_phys_to_virt(mm_phys);
 
-  /*
-   * Zero the entire mem_map in one shot.
-   *
-   * This is sufficient default initialization:
-   *   - flags = 0:        Not reserved, not buddy, not slab.  Pages with
-   *                        flags=0 that are never placed on a free list are
-   *                        implicitly non-allocatable — the buddy allocator
-   *                        only hands out pages from its free lists.
-   *   - list.next/prev=0: Will be properly set by list_add() or
-   *                        INIT_LIST_HEAD() when a page enters a free list.
-   *   - order = 0, migratetype = 0 (MIGRATE_UNMOVABLE), node = 0, zone = 0,
-   *     ptl = zeroed: All correct defaults.
-   *
-   * We intentionally do NOT walk every page struct to stamp PG_reserved.
-   * The old code wasted ~1 second doing 1.3M individual stores.  Since
-   * no code path returns an uninitialized page (the allocator only removes
-   * from free list), the zero state is safe.
-   */
-  memset(mem_map, 0, memmap_size);
-
   // Initialize allocator zones
   free_area_init();
 
@@ -254,16 +643,44 @@ int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
     pgdat->node_zones[ZONE_NORMAL].present_pages = 0;
   }
 
+  pmm_deferred_setup();
+
+  /*
+   * Zero the mem_map in as few shots as possible.
+   *
+   * This is sufficient default initialization:
+   *   - flags = 0:        Not reserved, not buddy, not slab.  Pages with
+   *                        flags=0 that are never placed on a free list are
+   *                        implicitly non-allocatable — the buddy allocator
+   *                        only hands out pages from its free lists.
+   *   - list.next/prev=0: Will be properly set by list_add() or
+   *                        INIT_LIST_HEAD() when a page enters a free list.
+   *   - order = 0, migratetype = 0 (MIGRATE_UNMOVABLE), node = 0, zone = 0,
+   *     ptl = zeroed: All correct defaults.
+   *
+   * We intentionally do NOT walk every page struct to stamp PG_reserved.
+   * The old code wasted ~1 second doing 1.3M individual stores.  Since
+   * no code path returns an uninitialized page (the allocator only removes
+   * from free list), the zero state is safe.
+   *
+   * Struct pages of deferred memory are left alone; the deferred init
+   * workers zero them chunk by chunk on node-local CPUs.
+   */
+  for (uint64_t pfn = 0; pfn < pmm_max_pages;) {
+    uint64_t stop = pmm_max_pages;
+    if (!pmm_deferred_lookup(pfn, &stop))
+      memset(&mem_map[pfn], 0, (stop - pfn) * sizeof(struct page));
+    pfn = stop;
+  }
+
   /*
    * Pass 2: Feed free pages to the buddy allocator.
    *
-   * For each usable memory region, find the largest naturally-aligned
-   * power-of-2 block that fits, stamp the minimal per-page metadata
-   * (node, zone), batch the present_pages accounting, and hand the
-   * block to __free_pages_boot() which bypasses the PCP/deferred paths.
+   * Memory past each node's deferred frontier is skipped here and fed by
+   * pmm_deferred_init() once the other CPUs can help.
    */
-  uint64_t mm_start_pfn = PHYS_TO_PFN(mm_phys);
-  uint64_t mm_end_pfn = mm_start_pfn + (PAGE_ALIGN_UP(memmap_size) / PAGE_SIZE);
+  pmm_mm_start_pfn = PHYS_TO_PFN(mm_phys);
+  pmm_mm_end_pfn = pmm_mm_start_pfn + (PAGE_ALIGN_UP(memmap_size) / PAGE_SIZE);
 
   for (uint64_t i = 0; i < memmap->entry_count; i++) {
     struct limine_memmap_entry *entry = memmap->entries[i];
@@ -278,95 +695,7 @@ int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
     if (start_pfn == 0)
       start_pfn = 1;
 
-    uint64_t cur_pfn = start_pfn;
-    while (cur_pfn < end_pfn) {
-      /* Jump past the mem_map region in O(1) instead of O(region_size). */
-      if (cur_pfn >= mm_start_pfn && cur_pfn < mm_end_pfn) {
-        cur_pfn = mm_end_pfn;
-        continue;
-      }
-
-      // Find largest order that fits and is aligned
-      unsigned int order = 0;
-      uint64_t max_count = end_pfn - cur_pfn;
-
-      // We also must stop before hitting the mem_map region
-      if (cur_pfn < mm_start_pfn && (cur_pfn + max_count) > mm_start_pfn) {
-        max_count = mm_start_pfn - cur_pfn;
-      }
-
-      for (unsigned int o = 0; o < MAX_ORDER - 1; o++) {
-        uint64_t next_size = 1UL << (o + 1);
-        if ((cur_pfn & (next_size - 1)) != 0)
-          break;
-        if (next_size > max_count)
-          break;
-
-        /* Check if the entire next_size block is on the same node and in the same zone */
-        int start_nid = pfn_to_nid(cur_pfn);
-        int end_nid = pfn_to_nid(cur_pfn + next_size - 1);
-        if (start_nid != end_nid)
-          break;
-
-        /* 
-         * ZONE boundaries are at 16MB (4096) and 4GB (1048576).
-         * Both are 1GB aligned or larger, so a naturally aligned 1GB block
-         * will NEVER cross these boundaries unless it starts before and ends after.
-         * But a 1GB aligned block starts at N*1GB.
-         * 16MB is NOT 1GB aligned. 4GB IS 1GB aligned.
-         * So a block starting at 3GB and ending at 4GB is fine.
-         * A block starting at 0 and ending at 1GB crosses 16MB.
-         */
-        int start_z = (cur_pfn < 4096) ? ZONE_DMA : (cur_pfn < 1048576 ? ZONE_DMA32 : ZONE_NORMAL);
-        int end_z = ((cur_pfn + next_size - 1) < 4096) ? ZONE_DMA : ((cur_pfn + next_size - 1) < 1048576 ? ZONE_DMA32 : ZONE_NORMAL);
-        if (start_z != end_z)
-          break;
-
-        order = o + 1;
-      }
-
-      int nid = pfn_to_nid(cur_pfn);
-      struct pglist_data *pgdat = node_data[nid];
-      if (!pgdat) {
-        nid = 0;
-        pgdat = node_data[0];
-      }
-
-      /*
-       * Determine zone for the head PFN.  Blocks from the buddy's
-       * order-finding loop above never cross zone boundaries because
-       * zone thresholds (4096, 1048576) are power-of-2 aligned and
-       * blocks are naturally aligned.  If a block did span a boundary,
-       * the max_count limiter or alignment constraint would have
-       * truncated it.  We can therefore set zone once per block.
-       */
-      int z_idx;
-      if (cur_pfn < 4096)
-        z_idx = ZONE_DMA;
-      else if (cur_pfn < 1048576)
-        z_idx = ZONE_DMA32;
-      else
-        z_idx = ZONE_NORMAL;
-
-      uint64_t count = 1UL << order;
-
-      /* Batch present_pages accounting — one add per block. */
-      pgdat->node_zones[z_idx].present_pages += count;
-
-      /*
-       * Stamp minimal per-page metadata.
-       * Only node and zone need to be set (migratetype is already 0 =
-       * MIGRATE_UNMOVABLE from memset).  We deliberately write just
-       * two uint32_t fields per page struct for cache efficiency.
-       */
-      for (uint64_t p = cur_pfn; p < cur_pfn + count; p++) {
-        mem_map[p].node = nid;
-        mem_map[p].zone = z_idx;
-      }
-
-      __free_pages_boot_core(&mem_map[cur_pfn], order);
-      cur_pfn += count;
-    }
+    pmm_free_early(start_pfn, end_pfn);
   }
 
   pmm_initialized = true;
@@ -381,32 +710,8 @@ int pmm_init(void *memmap_response_ptr, uint64_t hhdm_offset, void *rsdp) {
     SetPageReserved(&mem_map[PHYS_TO_PFN(empty_zero_page)]);
   }
 
-  // Calculate watermarks and log summary
-  for (int n = 0; n < MAX_NUMNODES; n++) {
-    if (!node_data[n])
-      continue;
-    struct pglist_data *pgdat = node_data[n];
-
-    for (int i = 0; i < MAX_NR_ZONES; i++) {
-      struct zone *z = &pgdat->node_zones[i];
-      if (z->present_pages > 0) {
-        z->watermark[WMARK_MIN] = z->present_pages / 100;
-        z->watermark[WMARK_LOW] = z->present_pages * 3 / 100;
-        z->watermark[WMARK_HIGH] = z->present_pages * 5 / 100;
-        z->watermark[WMARK_PROMO] = z->present_pages * 7 / 100;
-
-#ifdef CONFIG_MM_PMM_HIGHATOMIC
-        z->nr_reserved_highatomic =
-            (CONFIG_MM_PMM_HIGHATOMIC_RESERVE_KB * 1024) / PAGE_SIZE;
-        if (z->nr_reserved_highatomic > z->present_pages / 20)
-          z->nr_reserved_highatomic = z->present_pages / 20;
-#endif
+  pmm_setup_watermarks();
 
-        printk(KERN_DEBUG PMM_CLASS "node %d Zone %s: %lu pages\n", n, z->name,
-               z->present_pages);
-      }
-    }
-  }
   // Stats
   pmm_stats.total_pages = total_usable_bytes / PAGE_SIZE; // Approximate
   pmm_stats.highest_address = highest_addr;
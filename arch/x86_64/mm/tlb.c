@@ -21,7 +21,14 @@
 #include <arch/x86_64/features/features.h>
 #include <arch/x86_64/mm/paging.h>
 #include <arch/x86_64/mm/tlb.h>
+#include <arch/x86_64/mm/vmm.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/percpu.h>
 #include <arch/x86_64/smp.h>
+#include <aerosync/classes.h>
+#include <aerosync/export.h>
+#include <aerosync/sched/cpumask.h>
+#include <lib/printk.h>
 #include <mm/mm_types.h>
 #include <mm/vma.h>
 
@@ -36,6 +43,163 @@ static inline void __invpcid(uint64_t type, uint16_t pcid, uint64_t addr) {
   __asm__ volatile("invpcid %1, %0" : : "r"(type), "m"(desc) : "memory");
 }
 
+/*
+ * Per-CPU ASID cache.
+ *
+ * Each CPU keeps up to TLB_NR_DYN_ASIDS address spaces tagged in its TLB.
+ * A slot remembers which mm it belongs to (ctx_id, never reused) and the
+ * mm's tlb_gen the TLB contents are known to be current with. Every
+ * shootdown of an mm bumps mm->tlb_gen, so a CPU that switches back to an
+ * mm whose slot generation lags behind simply reloads CR3 without NOFLUSH;
+ * slots whose generation is current are switched to without any flush.
+ * When all slots are taken the next one is recycled round-robin.
+ */
+struct tlb_context {
+  uint64_t ctx_id;
+  uint64_t tlb_gen;
+};
+
+struct cpu_tlbstate {
+  struct mm_struct *loaded_mm; /* mm whose page tables are in CR3 */
+  uint16_t loaded_asid;
+  uint16_t next_asid;          /* Round-robin victim for recycling */
+  bool is_lazy;                /* A kernel thread borrows loaded_mm */
+  bool invalidate_other;       /* Kernel range flushed in the current ASID only */
+  struct tlb_context ctxs[TLB_NR_DYN_ASIDS];
+};
+
+static DEFINE_PER_CPU(struct cpu_tlbstate, cpu_tlbstate);
+
+static atomic64_t next_ctx_id;
+static bool tlb_use_pcid;
+
+static __always_inline uint16_t asid_to_pcid(uint16_t asid) { return asid + 1; }
+
+static __always_inline bool tlb_is_user_mm(struct mm_struct *mm) {
+  return mm && mm != &init_mm && mm->pml_root;
+}
+
+void tlb_init_mm_context(struct mm_struct *mm) {
+  mm->ctx_id = atomic64_inc_return(&next_ctx_id);
+  atomic64_set(&mm->tlb_gen, 1);
+}
+EXPORT_SYMBOL(tlb_init_mm_context);
+
+static void load_mm_cr3(struct mm_struct *mm, uint16_t asid, bool need_flush) {
+  if (!tlb_use_pcid) {
+    vmm_switch_pml_root((uint64_t) mm->pml_root);
+    return;
+  }
+  vmm_switch_pml_root_pcid((uint64_t) mm->pml_root, asid_to_pcid(asid), !need_flush);
+}
+
+/* Forget every cached ASID except the loaded one */
+static void clear_asid_other(struct cpu_tlbstate *ts) {
+  for (uint16_t asid = 0; asid < TLB_NR_DYN_ASIDS; asid++) {
+    if (asid != ts->loaded_asid)
+      ts->ctxs[asid].ctx_id = 0;
+  }
+  ts->invalidate_other = false;
+}
+
+static void choose_new_asid(struct cpu_tlbstate *ts, struct mm_struct *next, uint64_t next_gen,
+                            uint16_t *new_asid, bool *need_flush) {
+  if (!tlb_use_pcid) {
+    *new_asid = 0;
+    *need_flush = true;
+    return;
+  }
+
+  if (ts->invalidate_other)
+    clear_asid_other(ts);
+
+  for (uint16_t asid = 0; asid < TLB_NR_DYN_ASIDS; asid++) {
+    if (ts->ctxs[asid].ctx_id != next->ctx_id)
+      continue;
+    *new_asid = asid;
+    *need_flush = ts->ctxs[asid].tlb_gen < next_gen;
+    return;
+  }
+
+  *new_asid = ts->next_asid;
+  if (++ts->next_asid >= TLB_NR_DYN_ASIDS)
+    ts->next_asid = 0;
+  *need_flush = true;
+}
+
+/* Drop to the kernel page table; the old ASID stays cached and tracked by generation */
+static void tlb_leave_mm(struct cpu_tlbstate *ts) {
+  struct mm_struct *mm = ts->loaded_mm;
+
+  ts->is_lazy = false;
+  if (!tlb_is_user_mm(mm))
+    return;
+
+  vmm_switch_pml_root(g_kernel_pml_root);
+  ts->loaded_mm = &init_mm;
+  cpumask_clear_cpu_atomic(smp_get_id(), &mm->cpu_mask);
+}
+
+void tlb_switch_mm(struct mm_struct *next) {
+  struct cpu_tlbstate *ts = this_cpu_ptr(cpu_tlbstate);
+  struct mm_struct *real_prev = ts->loaded_mm;
+  int cpu = smp_get_id();
+
+  ts->is_lazy = false;
+
+  if (!tlb_is_user_mm(next)) {
+    tlb_leave_mm(ts);
+    if (!real_prev)
+      vmm_switch_pml_root(g_kernel_pml_root);
+    return;
+  }
+
+  if (real_prev == next && ts->ctxs[ts->loaded_asid].ctx_id == next->ctx_id) {
+    /*
+     * Back from lazy mode (or a redundant switch). Shootdowns that happened
+     * meanwhile were delivered to us, but catch up in case one raced with
+     * the switch itself.
+     */
+    struct tlb_context *ctx = &ts->ctxs[ts->loaded_asid];
+    uint64_t next_gen = atomic64_read(&next->tlb_gen);
+    if (ctx->tlb_gen < next_gen) {
+      load_mm_cr3(next, ts->loaded_asid, true);
+      ctx->tlb_gen = next_gen;
+    }
+    return;
+  }
+
+  if (tlb_is_user_mm(real_prev))
+    cpumask_clear_cpu_atomic(cpu, &real_prev->cpu_mask);
+
+  /*
+   * Publish ourselves in cpu_mask before sampling tlb_gen (the locked RMW is
+   * a full barrier). A concurrent shootdown either sees us in the mask and
+   * IPIs us, or bumped the generation before we read it and we flush here.
+   */
+  cpumask_set_cpu_atomic(cpu, &next->cpu_mask);
+  uint64_t next_gen = atomic64_read(&next->tlb_gen);
+
+  uint16_t asid;
+  bool need_flush;
+  choose_new_asid(ts, next, next_gen, &asid, &need_flush);
+
+  ts->ctxs[asid].ctx_id = next->ctx_id;
+  ts->ctxs[asid].tlb_gen = next_gen;
+  ts->loaded_asid = asid;
+  ts->loaded_mm = next;
+
+  load_mm_cr3(next, asid, need_flush);
+}
+EXPORT_SYMBOL(tlb_switch_mm);
+
+void tlb_enter_lazy(void) {
+  struct cpu_tlbstate *ts = this_cpu_ptr(cpu_tlbstate);
+  if (tlb_is_user_mm(ts->loaded_mm))
+    ts->is_lazy = true;
+}
+EXPORT_SYMBOL(tlb_enter_lazy);
+
 void vmm_tlb_flush_local(uint64_t addr) {
   // invlpg is sufficient for the current PCID and for Global pages
   cpu_invlpg(addr);
@@ -60,28 +224,78 @@ void vmm_tlb_flush_all_local(void) {
     __asm__ volatile("mov %0, %%cr4" : : "r"(cr4 & ~(1ULL << 7)) : "memory");
     __asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
   } else {
-    /* Fallback: Standard CR3 reload (non-global only) */
+    /* Fallback: Standard CR3 reload (non-global only, current PCID only) */
     uint64_t cr3;
     __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
-    __asm__ volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    __asm__ volatile("mov %0, %%cr3" : : "r"(cr3 & ~CR3_NOFLUSH) : "memory");
+    if (tlb_use_pcid)
+      this_cpu_ptr(cpu_tlbstate)->invalidate_other = true;
   }
 }
 
 struct tlb_shootdown_info {
+  struct mm_struct *mm;
   uint64_t start;
   uint64_t end;
+  uint64_t new_gen;
   bool full_flush;
 };
 
+static void tlb_flush_kernel_range(struct tlb_shootdown_info *si) {
+  if (si->full_flush) {
+    vmm_tlb_flush_all_local();
+    return;
+  }
+
+  for (uint64_t addr = si->start; addr < si->end; addr += PAGE_SIZE) {
+    vmm_tlb_flush_local(addr);
+  }
+
+  /* invlpg only hits non-global entries of the current PCID */
+  if (tlb_use_pcid)
+    this_cpu_ptr(cpu_tlbstate)->invalidate_other = true;
+}
+
 static void tlb_shootdown_callback(void *info) {
   struct tlb_shootdown_info *si = info;
 
-  if (si->full_flush) {
-    vmm_tlb_flush_all_local();
-  } else {
+  if (!tlb_is_user_mm(si->mm)) {
+    tlb_flush_kernel_range(si);
+    return;
+  }
+
+  struct cpu_tlbstate *ts = this_cpu_ptr(cpu_tlbstate);
+
+  /*
+   * Not running this mm: a cached ASID for it (if any) is now behind
+   * mm->tlb_gen and gets flushed when the mm is switched to again.
+   */
+  if (ts->loaded_mm != si->mm)
+    return;
+
+  /* Lazy kernel threads never touch user addresses, stop tracking the mm */
+  if (ts->is_lazy) {
+    tlb_leave_mm(ts);
+    return;
+  }
+
+  struct tlb_context *ctx = &ts->ctxs[ts->loaded_asid];
+  uint64_t mm_gen = atomic64_read(&si->mm->tlb_gen);
+  if (ctx->tlb_gen >= mm_gen)
+    return; /* Already caught up by a full flush */
+
+  /*
+   * A ranged flush is only enough when this is the single generation we
+   * are missing; otherwise flush the whole ASID and catch up to mm_gen.
+   */
+  if (!si->full_flush && ctx->tlb_gen + 1 == si->new_gen && si->new_gen == mm_gen) {
     for (uint64_t addr = si->start; addr < si->end; addr += PAGE_SIZE) {
       vmm_tlb_flush_local(addr);
     }
+    ctx->tlb_gen = si->new_gen;
+  } else {
+    load_mm_cr3(si->mm, ts->loaded_asid, true);
+    ctx->tlb_gen = mm_gen;
   }
 }
 
@@ -93,6 +307,7 @@ void tlb_ipi_handler(void *regs) {
 
 void vmm_tlb_shootdown(struct mm_struct *mm, uint64_t start, uint64_t end) {
   struct tlb_shootdown_info info;
+  info.mm = mm;
   info.start = start & PAGE_MASK;
   info.end = PAGE_ALIGN_UP(end);
 
@@ -106,13 +321,22 @@ void vmm_tlb_shootdown(struct mm_struct *mm, uint64_t start, uint64_t end) {
   /* Memory barrier to ensure page table updates are visible before TLB flush */
   __atomic_thread_fence(__ATOMIC_RELEASE);
 
+  /*
+   * Bump the generation before looking at cpu_mask: CPUs that are not
+   * running the mm right now (including ones that only keep its ASID
+   * cached) notice the new generation on their next switch.
+   */
+  info.new_gen = tlb_is_user_mm(mm) ? (uint64_t) atomic64_inc_return(&mm->tlb_gen) : 0;
+
   // 1. Flush local TLB first to minimize the window where this CPU sees old
   // data
+  irq_flags_t flags = local_irq_save();
   tlb_shootdown_callback(&info);
+  local_irq_restore(flags);
 
   // 2. Send IPI only if SMP is active and there are other CPUs to notify
   if (smp_is_active() && smp_get_cpu_count() > 1) {
-    if (!mm || mm == &init_mm) {
+    if (!tlb_is_user_mm(mm)) {
       // Global shootdown (kernel space) - target all online CPUs
       smp_call_function(tlb_shootdown_callback, &info, true);
     } else {
@@ -122,7 +346,7 @@ void vmm_tlb_shootdown(struct mm_struct *mm, uint64_t start, uint64_t end) {
        */
       int current_cpu = smp_get_id();
       if (cpumask_weight(&mm->cpu_mask) > 1 ||
-          !cpumask_test_cpu(current_cpu, &mm->cpu_mask)) {
+          (!cpumask_empty(&mm->cpu_mask) && !cpumask_test_cpu(current_cpu, &mm->cpu_mask))) {
         smp_call_function_many(&mm->cpu_mask, tlb_shootdown_callback, &info,
                                true);
       }
@@ -133,8 +357,31 @@ void vmm_tlb_shootdown(struct mm_struct *mm, uint64_t start, uint64_t end) {
   __atomic_thread_fence(__ATOMIC_ACQUIRE);
 }
 
+static void tlb_release_callback(void *info) {
+  struct cpu_tlbstate *ts = this_cpu_ptr(cpu_tlbstate);
+  if (ts->loaded_mm == info)
+    tlb_leave_mm(ts);
+}
+
+void tlb_release_mm(struct mm_struct *mm) {
+  if (!tlb_is_user_mm(mm))
+    return;
+
+  irq_flags_t flags = local_irq_save();
+  tlb_release_callback(mm);
+  local_irq_restore(flags);
+
+  if (smp_is_active() && smp_get_cpu_count() > 1 && !cpumask_empty(&mm->cpu_mask))
+    smp_call_function_many(&mm->cpu_mask, tlb_release_callback, mm, true);
+}
+EXPORT_SYMBOL(tlb_release_mm);
+
 void vmm_tlb_init(void) {
-  // Registered via irq_install_handler in irq.c or here,
-  // But TLB_FLUSH_IPI_VECTOR needs to be handled in irq_common_stub if not
-  // standard IRQ
+#ifdef CONFIG_X86_PCID
+  cpu_features_t *features = get_cpu_features();
+  tlb_use_pcid = features && features->pcid;
+#endif
+  printk(VMM_CLASS "TLB: %s, %d dynamic ASIDs per CPU\n",
+         tlb_use_pcid ? "PCID tagged address spaces" : "PCID disabled",
+         tlb_use_pcid ? TLB_NR_DYN_ASIDS : 1);
 }
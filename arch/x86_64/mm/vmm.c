@@ -70,7 +70,7 @@ static uint64_t pgt_cache_alloc(int nid) {
   if (!folio) return 0;
 
   uint64_t phys = folio_to_phys(folio);
-  memset(phys_to_virt(phys), 0, PAGE_SIZE);
+  clear_page(phys_to_virt(phys));
   return phys;
 }
 
@@ -84,7 +84,7 @@ void pgt_cache_refill(void) {
     if (!folio) break;
 
     uint64_t phys = folio_to_phys(folio);
-    memset(phys_to_virt(phys), 0, PAGE_SIZE);
+    clear_page(phys_to_virt(phys));
     cache->pages[cache->count++] = phys;
   }
   preempt_enable();
@@ -412,11 +412,23 @@ void vmm_merge_range(struct mm_struct *mm, uint64_t start, uint64_t end) {
   }
 }
 
+/*
+ * A leaf armed by the NUMA scanner is non-present but still owns its data
+ * page reference, so page-table walkers must treat it like a present leaf.
+ */
+static inline bool vmm_pte_is_numa_hint(uint64_t entry) {
+  return !(entry & PTE_PRESENT) && (entry & PTE_NUMA_HINT);
+}
+
 static void vmm_free_level(uint64_t table_phys, int level) {
   uint64_t *table = (uint64_t *) phys_to_virt(table_phys);
   int entries = (level == vmm_get_paging_levels()) ? 256 : 512;
   for (int i = 0; i < entries; i++) {
     uint64_t entry = table[i];
+    if (vmm_pte_is_numa_hint(entry)) {
+      put_page(phys_to_page(PTE_GET_ADDR(entry)));
+      continue;
+    }
     if (!(entry & PTE_PRESENT)) continue;
     if (level > 1 && !(entry & PTE_HUGE)) {
       vmm_free_level(PTE_GET_ADDR(entry), level - 1);
@@ -1044,8 +1056,8 @@ static int vmm_copy_level(uint64_t src_table_phys, uint64_t dst_table_phys, int
   int entries = (level == vmm_get_paging_levels()) ? 256 : 512;
   for (int i = 0; i < entries; i++) {
     uint64_t entry = src_table[i];
-    if (!(entry & PTE_PRESENT)) continue;
-    if (level > 1 && !(entry & PTE_HUGE)) {
+    if (!(entry & PTE_PRESENT) && !vmm_pte_is_numa_hint(entry)) continue;
+    if (level > 1 && !(entry & PTE_HUGE) && !vmm_pte_is_numa_hint(entry)) {
       uint64_t new_table_phys = vmm_alloc_table_node(nid);
       if (!new_table_phys) return -ENOMEM;
       dst_table[i] = new_table_phys | PTE_PRESENT | PTE_RW | PTE_USER;
@@ -1057,7 +1069,7 @@ static int vmm_copy_level(uint64_t src_table_phys, uint64_t dst_table_phys, int
       irq_flags_t flags = spinlock_lock_irqsave(&src_page->ptl);
 
       entry = src_table[i];
-      if (entry & PTE_PRESENT) {
+      if ((entry & PTE_PRESENT) || vmm_pte_is_numa_hint(entry)) {
         if (entry & PTE_RW) {
           entry &= ~PTE_RW;
           src_table[i] = entry;
@@ -1111,7 +1123,7 @@ int vmm_handle_cow(struct mm_struct *mm, uint64_t virt) {
   }
   uint64_t new_phys = folio_to_phys(new_folio);
 
-  memcpy(phys_to_virt(new_phys), phys_to_virt(PTE_GET_ADDR(entry)), PAGE_SIZE);
+  copy_page(phys_to_virt(new_phys), phys_to_virt(PTE_GET_ADDR(entry)));
 
   flags = spinlock_lock_irqsave(&table_page->ptl);
   /* Re-check entry hasn't changed during allocation */
@@ -1364,3 +1376,80 @@ void vmm_set_numa_hint(struct mm_struct *mm, uint64_t virt) {
   /* We MUST flush TLB so the CPU sees the 'not present' state */
   vmm_tlb_shootdown(mm, virt, virt + PAGE_SIZE);
 }
+
+size_t vmm_set_numa_hint_range(struct mm_struct *mm, uint64_t start, uint64_t end) {
+  if (!mm) mm = &init_mm;
+  size_t armed = 0;
+  uint64_t virt = start & PAGE_MASK;
+
+  while (virt < end) {
+    uint64_t next = (virt + VMM_PAGE_SIZE_2M) & ~(VMM_PAGE_SIZE_2M - 1);
+    if (next > end || next < virt) next = end;
+
+    /* Missing tables and huge mappings are skipped a whole PD entry at a time */
+    int level = 0;
+    uint64_t *pte_p = vmm_get_pte_ptr(mm, virt, false, -1, &level);
+    if (!pte_p || level != 1) {
+      virt = next;
+      continue;
+    }
+
+    irq_flags_t flags;
+    uint64_t *table = vmm_lock_table((uint64_t *) ((uint64_t) pte_p & PAGE_MASK), &flags);
+    for (; virt < next; virt += PAGE_SIZE) {
+      uint64_t *entry_p = &table[PT_INDEX(virt)];
+      uint64_t entry = *entry_p;
+
+      if ((entry & (PTE_PRESENT | PTE_USER)) != (PTE_PRESENT | PTE_USER))
+        continue;
+      if (PTE_GET_ADDR(entry) == empty_zero_page)
+        continue;
+
+      __atomic_store_n(entry_p, (entry & ~PTE_PRESENT) | PTE_NUMA_HINT, __ATOMIC_RELEASE);
+      armed++;
+    }
+    vmm_unlock_table(table, flags);
+  }
+
+  if (armed)
+    vmm_tlb_shootdown(mm, start & PAGE_MASK, end);
+  return armed;
+}
+
+/*
+ * Rewrite the non-present entry at @virt if it refers to @old_phys and its
+ * hint bit matches @hint. Non-present to present needs no shootdown.
+ */
+static bool vmm_numa_rewrite(struct mm_struct *mm, uint64_t virt, bool hint, uint64_t old_phys,
+                             uint64_t new_phys, uint64_t set, uint64_t clear) {
+  if (!mm) mm = &init_mm;
+  int level = 0;
+  uint64_t *pte_p = vmm_get_pte_ptr(mm, virt, false, -1, &level);
+  if (!pte_p || level != 1) return false;
+
+  bool done = false;
+  irq_flags_t flags;
+  uint64_t *table = vmm_lock_table((uint64_t *) ((uint64_t) pte_p & PAGE_MASK), &flags);
+
+  uint64_t entry = *pte_p;
+  if (!(entry & PTE_PRESENT) && !!(entry & PTE_NUMA_HINT) == hint && PTE_GET_ADDR(entry) == old_phys) {
+    entry = (entry & ~(PTE_ADDR_MASK | clear)) | new_phys | set;
+    __atomic_store_n(pte_p, entry, __ATOMIC_RELEASE);
+    done = true;
+  }
+
+  vmm_unlock_table(table, flags);
+  return done;
+}
+
+bool vmm_numa_restore(struct mm_struct *mm, uint64_t virt, uint64_t old_phys, uint64_t new_phys) {
+  return vmm_numa_rewrite(mm, virt, true, old_phys, new_phys, PTE_PRESENT, PTE_NUMA_HINT);
+}
+
+bool vmm_numa_freeze(struct mm_struct *mm, uint64_t virt, uint64_t phys) {
+  return vmm_numa_rewrite(mm, virt, true, phys, phys, 0, PTE_NUMA_HINT);
+}
+
+bool vmm_numa_unfreeze(struct mm_struct *mm, uint64_t virt, uint64_t old_phys, uint64_t new_phys) {
+  return vmm_numa_rewrite(mm, virt, false, old_phys, new_phys, PTE_PRESENT, 0);
+}
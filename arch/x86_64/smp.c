@@ -37,6 +37,7 @@
 #include <limine/limine.h>
 #include <mm/slub.h>
 #include <aerosync/timer.h>
+#include <aerosync/tick.h>
 #include <linux/container_of.h>
 #include <aerosync/errno.h>
 #include <arch/x86_64/requests.h>
@@ -116,6 +117,7 @@ static void smp_ap_entry(struct limine_mp_info *info) {
   detect_cpu_topology();
 
   ic_set_timer(IC_DEFAULT_TICK);
+  tick_setup_cpu();
 
   // Initialize GDT and TSS for this AP
   gdt_init_ap();
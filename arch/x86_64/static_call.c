@@ -0,0 +1,67 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file arch/x86_64/static_call.c
+ * @brief Boot-time patching of static call trampolines
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/x86_64/static_call.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/mm/pmm.h>
+#include <arch/x86_64/mm/vmm.h>
+#include <aerosync/classes.h>
+#include <aerosync/export.h>
+#include <aerosync/panic.h>
+
+#define JMP32_OPCODE 0xe9
+#define JMP32_SIZE   5
+
+/*
+ * Kernel text is mapped read-only; write through the direct map instead.
+ * The displacement is naturally contained in one aligned 8-byte block, so a
+ * single 32-bit store updates it.
+ */
+static void static_call_poke(void *tramp, int32_t disp) {
+  uint64_t phys = vmm_virt_to_phys(nullptr, (uint64_t)tramp + 1);
+
+  if (!phys)
+    panic(CPU_CLASS "static_call: trampoline %p is not mapped", tramp);
+
+  WRITE_ONCE(*(int32_t *)pmm_phys_to_virt(phys), disp);
+
+  /* The write went through another alias; make sure we refetch the jump */
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(0, &eax, &ebx, &ecx, &edx);
+}
+
+void __static_call_update(void *tramp, void *target) {
+  int64_t disp = (int64_t)((uintptr_t)target - ((uintptr_t)tramp + JMP32_SIZE));
+
+  if (*(uint8_t *)tramp != JMP32_OPCODE)
+    panic(CPU_CLASS "static_call: %p is not a trampoline", tramp);
+  if (disp != (int32_t)disp)
+    panic(CPU_CLASS "static_call: target %p out of reach", target);
+
+  static_call_poke(tramp, (int32_t)disp);
+}
+EXPORT_SYMBOL(__static_call_update);
+
+void *static_call_target(void *tramp) {
+  int32_t disp = READ_ONCE(*(int32_t *)((uintptr_t)tramp + 1));
+
+  return (void *)((uintptr_t)tramp + JMP32_SIZE + disp);
+}
+EXPORT_SYMBOL(static_call_target);
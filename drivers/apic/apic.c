@@ -255,9 +255,14 @@ static void apic_timer_calibrate(const struct apic_timer_regs *regs) {
 }
 
 static int detect_tsc_deadline(void) {
-  uint32_t eax, ebx, ecx, edx;
-  cpuid(1, &eax, &ebx, &ecx, &edx);
-  return (ecx & (1 << 24)) != 0;
+  /* Cached: this sits on the hrtimer reprogramming path and CPUID traps under virtualization */
+  static int tsc_deadline_supported = -1;
+  if (tsc_deadline_supported < 0) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    tsc_deadline_supported = (ecx & (1 << 24)) != 0;
+  }
+  return tsc_deadline_supported;
 }
 
 int apic_has_tsc_deadline(void) {
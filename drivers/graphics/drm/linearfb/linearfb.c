@@ -27,6 +27,7 @@
 #include <arch/x86_64/mm/pmm.h>
 #include <arch/x86_64/requests.h>
 #include <lib/linearfb/psf.h>
+#include <lib/log.h>
 #include <lib/math.h>
 #include <lib/string.h>
 #include <lib/uaccess.h>
@@ -50,45 +51,102 @@ static volatile struct limine_framebuffer_request *framebuffer_request = nullptr
 
 /* --- Dirty Tracking --- */
 
+static uint64_t linearfb_rect_area(const struct linearfb_rect *r) {
+  return (uint64_t) (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static struct linearfb_rect linearfb_rect_union(const struct linearfb_rect *a, const struct linearfb_rect *b) {
+  return (struct linearfb_rect) {
+    .x0 = min(a->x0, b->x0), .y0 = min(a->y0, b->y0),
+    .x1 = max(a->x1, b->x1), .y1 = max(a->y1, b->y1),
+  };
+}
+
+/*
+ * Damage is a short list of rectangles rather than one bounding box, so a
+ * glyph in one corner and a glyph in the other don't dirty the whole
+ * screen. A new rectangle joins an existing one when their union covers no
+ * more than the two did apart (adjacent glyphs, consecutive text rows);
+ * once the list is full it joins whichever one grows least.
+ */
 static void linearfb_mark_dirty(struct linearfb_device *dev, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
   if (!dev) return;
-  if (!dev->is_dirty) {
-    dev->dirty_x0 = x;
-    dev->dirty_y0 = y;
-    dev->dirty_x1 = x + w;
-    dev->dirty_y1 = y + h;
-    dev->is_dirty = true;
-  } else {
-    dev->dirty_x0 = min(dev->dirty_x0, x);
-    dev->dirty_y0 = min(dev->dirty_y0, y);
-    dev->dirty_x1 = max(dev->dirty_x1, x + w);
-    dev->dirty_y1 = max(dev->dirty_y1, y + h);
+
+  struct linearfb_rect r = {
+    .x0 = x, .y0 = y,
+    .x1 = min(x + w, dev->limine_fb->width),
+    .y1 = min(y + h, dev->limine_fb->height),
+  };
+  if (r.x1 <= r.x0 || r.y1 <= r.y0) return;
+
+  uint64_t r_area = linearfb_rect_area(&r);
+  struct linearfb_rect *best = nullptr;
+  uint64_t best_growth = UINT64_MAX;
+
+  for (uint32_t i = 0; i < dev->nr_damage; i++) {
+    struct linearfb_rect *d = &dev->damage[i];
+    struct linearfb_rect u = linearfb_rect_union(d, &r);
+    uint64_t d_area = linearfb_rect_area(d);
+    uint64_t u_area = linearfb_rect_area(&u);
+
+    if (u_area <= d_area + r_area) {
+      *d = u;
+      return;
+    }
+    if (u_area - d_area < best_growth) {
+      best = d;
+      best_growth = u_area - d_area;
+    }
   }
+
+  if (dev->nr_damage < LINEARFB_MAX_DAMAGE) {
+    dev->damage[dev->nr_damage++] = r;
+    return;
+  }
+
+  *best = linearfb_rect_union(best, &r);
 }
 
 void linearfb_dev_flush(struct linearfb_device *dev) {
-  if (!dev || !dev->is_dirty || !dev->vram || !dev->shadow_fb) return;
+  if (!dev || !dev->nr_damage || !dev->vram || !dev->shadow_fb) return;
 
-  uint32_t x0 = dev->dirty_x0;
-  uint32_t y0 = dev->dirty_y0;
-  uint32_t x1 = min(dev->dirty_x1, dev->limine_fb->width);
-  uint32_t y1 = min(dev->dirty_y1, dev->limine_fb->height);
+  uint32_t bpp_bytes = dev->limine_fb->bpp / 8;
 
-  if (x1 <= x0 || y1 <= y0) {
-    dev->is_dirty = false;
-    return;
+  for (uint32_t i = 0; i < dev->nr_damage; i++) {
+    const struct linearfb_rect *d = &dev->damage[i];
+    uint32_t line_size = (d->x1 - d->x0) * bpp_bytes;
+
+    for (uint32_t y = d->y0; y < d->y1; y++) {
+      void *dst = (uint8_t *) dev->vram + y * dev->limine_fb->pitch + d->x0 * bpp_bytes;
+      const void *src = linearfb_shadow_line(dev, y) + d->x0 * bpp_bytes;
+      memcpy(dst, src, line_size);
+    }
   }
 
-  uint32_t bpp_bytes = dev->limine_fb->bpp / 8;
-  uint32_t line_size = (x1 - x0) * bpp_bytes;
+  dev->nr_damage = 0;
+}
 
-  for (uint32_t y = y0; y < y1; y++) {
-    void *dst = (uint8_t *) dev->vram + y * dev->limine_fb->pitch + x0 * bpp_bytes;
-    const void *src = (uint8_t *) dev->shadow_fb + y * dev->limine_fb->pitch + x0 * bpp_bytes;
-    memcpy(dst, src, line_size);
+static void linearfb_flush_timer_fn(struct timer_list *timer) {
+  struct linearfb_device *dev = timer->data;
+  irq_flags_t flags = spinlock_lock_irqsave(&dev->lock);
+  linearfb_dev_flush(dev);
+  spinlock_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * Console output is copied to VRAM by flush_timer, at most once per
+ * LINEARFB_FLUSH_INTERVAL_NS however many characters arrive meanwhile.
+ * Before the timer wheel runs, and during a panic when it never will
+ * again, it is copied right away. Called with dev->lock held.
+ */
+static void linearfb_dev_kick_flush(struct linearfb_device *dev) {
+  if (log_in_panic() || !timer_subsystem_ready()) {
+    linearfb_dev_flush(dev);
+    return;
   }
 
-  dev->is_dirty = false;
+  if (dev->nr_damage && !timer_pending(&dev->flush_timer))
+    timer_add(&dev->flush_timer, get_time_ns() + LINEARFB_FLUSH_INTERVAL_NS);
 }
 
 /* --- Optimized Primitives --- */
@@ -97,7 +155,7 @@ void linearfb_dev_put_pixel(struct linearfb_device *dev, uint32_t x, uint32_t y,
   if (!dev || x >= dev->limine_fb->width || y >= dev->limine_fb->height) return;
 
   uint32_t bpp_bytes = dev->limine_fb->bpp / 8;
-  uint8_t *p = (uint8_t *) dev->shadow_fb + y * dev->limine_fb->pitch + x * bpp_bytes;
+  uint8_t *p = linearfb_shadow_line(dev, y) + x * bpp_bytes;
 
   if (dev->limine_fb->bpp == 32) {
     *(uint32_t *) p = color;
@@ -119,13 +177,13 @@ void linearfb_dev_fill_rect(struct linearfb_device *dev, uint32_t x, uint32_t y,
 
   if (dev->limine_fb->bpp == 32) {
     for (uint32_t i = 0; i < h; i++) {
-      uint32_t *p = (uint32_t *) ((uint8_t *) dev->shadow_fb + (y + i) * dev->limine_fb->pitch + x * 4);
+      uint32_t *p = (uint32_t *) (linearfb_shadow_line(dev, y + i) + x * 4);
       memset32(p, color, w);
     }
   } else {
     for (uint32_t i = 0; i < h; i++) {
       for (uint32_t j = 0; j < w; j++) {
-        uint8_t *p = (uint8_t *) dev->shadow_fb + (y + i) * dev->limine_fb->pitch + (x + j) * bpp_bytes;
+        uint8_t *p = linearfb_shadow_line(dev, y + i) + (x + j) * bpp_bytes;
         memcpy(p, &color, bpp_bytes);
       }
     }
@@ -196,8 +254,101 @@ static struct char_operations linearfb_char_ops = {
   .mmap = linearfb_char_mmap,
 };
 
+/* --- Glyph Cache --- */
+
+/*
+ * 32bpp console glyphs, expanded to pixels once per (fg, bg) pair so that
+ * drawing a character is one row copy per font line. Glyphs are expanded
+ * on first use; the least recently used colour pair is recycled.
+ * Lookups run under primary_fb->lock.
+ */
+#define LINEARFB_GLYPH_CACHE_COLORS 4
+
+struct linearfb_glyph_cache {
+  uint32_t fg, bg;
+  bool valid;
+  uint64_t last_used;
+  uint32_t *pixels;  /* font_glyph_count glyphs of width * height */
+  uint8_t *expanded; /* Per glyph: pixels filled in for fg/bg */
+};
+
+static struct linearfb_glyph_cache glyph_cache[LINEARFB_GLYPH_CACHE_COLORS];
+static uint64_t glyph_cache_clock;
+
+static void linearfb_glyph_cache_release(struct linearfb_glyph_cache *caches) {
+  for (int i = 0; i < LINEARFB_GLYPH_CACHE_COLORS; i++) {
+    if (caches[i].pixels) vfree(caches[i].pixels);
+    if (caches[i].expanded) kfree(caches[i].expanded);
+    caches[i] = (struct linearfb_glyph_cache) {0};
+  }
+}
+
+/* Allocate caches sized for the current font into @caches */
+static void linearfb_glyph_cache_alloc(struct linearfb_glyph_cache *caches) {
+  size_t glyph_pixels = (size_t) fb_font.width * fb_font.height;
+  if (!fb_font.data || !glyph_pixels || !font_glyph_count) return;
+
+  for (int i = 0; i < LINEARFB_GLYPH_CACHE_COLORS; i++) {
+    caches[i].pixels = vmalloc(glyph_pixels * font_glyph_count * sizeof(uint32_t));
+    caches[i].expanded = kzalloc(font_glyph_count);
+    if (!caches[i].pixels || !caches[i].expanded) {
+      /* Drawing falls back to expanding bits for missing slots */
+      if (caches[i].pixels) vfree(caches[i].pixels);
+      if (caches[i].expanded) kfree(caches[i].expanded);
+      caches[i].pixels = nullptr;
+      caches[i].expanded = nullptr;
+    }
+  }
+}
+
+static const uint32_t *linearfb_glyph_lookup(uint32_t fg, uint32_t bg, uint8_t ch) {
+  struct linearfb_glyph_cache *c = nullptr, *victim = nullptr;
+
+  for (int i = 0; i < LINEARFB_GLYPH_CACHE_COLORS; i++) {
+    struct linearfb_glyph_cache *s = &glyph_cache[i];
+    if (!s->pixels) continue;
+    if (s->valid && s->fg == fg && s->bg == bg) {
+      c = s;
+      break;
+    }
+    if (!victim || s->last_used < victim->last_used) victim = s;
+  }
+
+  if (!c) {
+    if (!victim) return nullptr;
+    c = victim;
+    c->fg = fg;
+    c->bg = bg;
+    c->valid = true;
+    memset(c->expanded, 0, font_glyph_count);
+  }
+  c->last_used = ++glyph_cache_clock;
+
+  uint32_t w = fb_font.width, h = fb_font.height;
+  uint32_t *px = c->pixels + (size_t) ch * w * h;
+
+  if (!c->expanded[ch]) {
+    const uint8_t *glyph = fb_font.data + ch * h * fb_font.pitch;
+    for (uint32_t r = 0; r < h; ++r) {
+      const uint8_t *row_data = glyph + r * fb_font.pitch;
+      for (uint32_t cx = 0; cx < w; ++cx)
+        px[r * w + cx] = (row_data[cx / 8] & (1 << (7 - (cx % 8)))) ? fg : bg;
+    }
+    c->expanded[ch] = 1;
+  }
+
+  return px;
+}
+
 /* --- Console Implementation --- */
 
+/*
+ * consolebench baseline: per-bit glyph expansion, a full-screen copy on
+ * every scroll and a VRAM flush after every character, as the console
+ * rendered before the glyph cache, line ring and timed flush.
+ */
+static bool linearfb_legacy_render;
+
 static void linearfb_dev_draw_glyph(struct linearfb_device *dev, uint32_t col, uint32_t row, char c) {
   if (!dev || !fb_font.data) return;
   if (col >= dev->console_cols || row >= dev->console_rows) return;
@@ -211,9 +362,16 @@ static void linearfb_dev_draw_glyph(struct linearfb_device *dev, uint32_t col, u
   const uint8_t *glyph = fb_font.data + ch * fb_font.height * stride;
 
   if (dev->limine_fb->bpp == 32) {
+    const uint32_t *cached = linearfb_legacy_render ? nullptr
+                                                    : linearfb_glyph_lookup(dev->console_fg, dev->console_bg, ch);
+
     for (uint32_t r = 0; r < fb_font.height; ++r) {
+      uint32_t *sp = (uint32_t *) (linearfb_shadow_line(dev, py + r) + px * 4);
+      if (cached) {
+        memcpy(sp, cached + r * fb_font.width, fb_font.width * sizeof(uint32_t));
+        continue;
+      }
       const uint8_t *row_data = glyph + r * stride;
-      uint32_t *sp = (uint32_t *) ((uint8_t *) dev->shadow_fb + (py + r) * dev->limine_fb->pitch + px * 4);
       for (uint32_t cx = 0; cx < fb_font.width; ++cx) {
         sp[cx] = (row_data[cx / 8] & (1 << (7 - (cx % 8)))) ? dev->console_fg : dev->console_bg;
       }
@@ -243,16 +401,25 @@ void linearfb_dev_scroll(struct linearfb_device *dev) {
     memset(dev->console_buffer + copy_chars, ' ', line_chars);
   }
 
-  /* Scroll shadow buffer */
+  /*
+   * Scroll shadow buffer: rotate the line ring by one text row rather than
+   * moving the screen's worth of pixels above it.
+   */
   uint32_t font_h = fb_font.height;
-  uint32_t pitch = dev->limine_fb->pitch;
   uint32_t height = dev->limine_fb->height;
 
-  memmove(dev->shadow_fb, (uint8_t *) dev->shadow_fb + font_h * pitch, (height - font_h) * pitch);
+  if (linearfb_legacy_render) {
+    /* Move every pixel line up, as the memmove scroll did */
+    for (uint32_t y = 0; y + font_h < height; y++)
+      memcpy(linearfb_shadow_line(dev, y), linearfb_shadow_line(dev, y + font_h), dev->limine_fb->pitch);
+  } else {
+    dev->shadow_yoff += font_h;
+    if (dev->shadow_yoff >= height) dev->shadow_yoff -= height;
+  }
 
-  /* Clear last line */
-  for (uint32_t i = 0; i < font_h; i++) {
-    void *line = (uint8_t *) dev->shadow_fb + (height - font_h + i) * pitch;
+  /* Clear last text row and whatever strip is left below it */
+  for (uint32_t y = (dev->console_rows - 1) * font_h; y < height; y++) {
+    void *line = linearfb_shadow_line(dev, y);
     if (dev->limine_fb->bpp == 32) {
       memset32(line, dev->console_bg, dev->limine_fb->width);
     } else {
@@ -264,9 +431,10 @@ void linearfb_dev_scroll(struct linearfb_device *dev) {
     }
   }
 
-  /* Full screen dirty */
+  /* Every line moved: one full screen rectangle replaces the list */
+  dev->nr_damage = 0;
   linearfb_mark_dirty(dev, 0, 0, dev->limine_fb->width, dev->limine_fb->height);
-  linearfb_dev_flush(dev);
+  if (linearfb_legacy_render) linearfb_dev_flush(dev);
 
   dev->console_row = dev->console_rows - 1;
   dev->console_col = 0;
@@ -282,14 +450,12 @@ void linearfb_console_putc(char c) {
     if (++dev->console_row >= dev->console_rows) {
       linearfb_dev_scroll(dev);
     }
-    spinlock_unlock_irqrestore(&dev->lock, flags);
-    return;
+    goto out;
   }
 
   if (c == '\r') {
     dev->console_col = 0;
-    spinlock_unlock_irqrestore(&dev->lock, flags);
-    return;
+    goto out;
   }
 
   if (dev->console_buffer && dev->console_row * dev->console_cols + dev->console_col < dev->console_buffer_size) {
@@ -305,12 +471,31 @@ void linearfb_console_putc(char c) {
     }
   }
 
-  /* Immediate flush for console output to ensure visibility during panic/boot */
-  linearfb_dev_flush(dev);
-
+out:
+  if (linearfb_legacy_render)
+    linearfb_dev_flush(dev);
+  else
+    linearfb_dev_kick_flush(dev);
   spinlock_unlock_irqrestore(&dev->lock, flags);
 }
 
+/* printk ->flush: push batched console output to VRAM now */
+static void linearfb_console_flush(void) {
+  if (!primary_fb) return;
+  irq_flags_t flags = spinlock_lock_irqsave(&primary_fb->lock);
+  linearfb_dev_flush(primary_fb);
+  spinlock_unlock_irqrestore(&primary_fb->lock, flags);
+}
+
+/* printk ->bench_legacy: switch to the pre-cache renderer for a baseline */
+static void linearfb_console_bench_legacy(bool on) {
+  if (!primary_fb) return;
+  irq_flags_t flags = spinlock_lock_irqsave(&primary_fb->lock);
+  linearfb_dev_flush(primary_fb);
+  linearfb_legacy_render = on;
+  spinlock_unlock_irqrestore(&primary_fb->lock, flags);
+}
+
 /* --- Public API Wrappers (for Primary FB) --- */
 
 int linearfb_is_initialized(void) { return fb_initialized; }
@@ -324,7 +509,7 @@ uint32_t linearfb_get_pixel(uint32_t x, uint32_t y) {
   if (!primary_fb || x >= primary_fb->limine_fb->width || y >= primary_fb->limine_fb->height) return 0;
   uint32_t color = 0;
   uint32_t bpp_bytes = primary_fb->limine_fb->bpp / 8;
-  const void *p = (uint8_t *) primary_fb->shadow_fb + y * primary_fb->limine_fb->pitch + x * bpp_bytes;
+  const void *p = linearfb_shadow_line(primary_fb, y) + x * bpp_bytes;
   memcpy(&color, p, bpp_bytes);
   return color;
 }
@@ -361,7 +546,7 @@ void linearfb_draw_text(const char *text, uint32_t x, uint32_t y, uint32_t color
       for (uint32_t r = 0; r < fb_font.height; ++r) {
         if (cy + r >= primary_fb->limine_fb->height) break;
         const uint8_t *row_data = glyph + r * stride;
-        uint32_t *sp = (uint32_t *) ((uint8_t *) primary_fb->shadow_fb + (cy + r) * primary_fb->limine_fb->pitch + cx * 4);
+        uint32_t *sp = (uint32_t *) (linearfb_shadow_line(primary_fb, cy + r) + cx * 4);
 
         for (uint32_t gx = 0; gx < fb_font.width; ++gx) {
           if (cx + gx >= primary_fb->limine_fb->width) break;
@@ -549,6 +734,7 @@ static int linearfb_device_init(struct limine_framebuffer *lfb, int index) {
   memset(dev->shadow_fb, 0, dev->size);
 
   spinlock_init(&dev->lock);
+  timer_setup(&dev->flush_timer, linearfb_flush_timer_fn, dev);
   dev->console_fg = 0xFFFFFFFF;
   dev->console_bg = 0x00000000;
 
@@ -590,6 +776,8 @@ int linearfb_init_standard(void *data) {
     font_glyph_count = psf.num_glyphs;
   }
 
+  linearfb_glyph_cache_alloc(glyph_cache);
+
   for (uint64_t i = 0; i < framebuffer_request->response->framebuffer_count; i++) {
     linearfb_device_init(framebuffer_request->response->framebuffers[i], (int)i);
   }
@@ -605,6 +793,7 @@ int linearfb_init_standard(void *data) {
 void linearfb_cleanup(void) {
   struct linearfb_device *dev, *tmp;
   list_for_each_entry_safe(dev, tmp, &linearfb_devices, list) {
+    if (timer_subsystem_ready()) timer_del_sync(&dev->flush_timer);
     fb_unregister_device(dev->cdev);
     vfree(dev->shadow_fb);
     if (dev->console_buffer) kfree(dev->console_buffer);
@@ -613,6 +802,7 @@ void linearfb_cleanup(void) {
   }
   primary_fb = nullptr;
   fb_initialized = 0;
+  linearfb_glyph_cache_release(glyph_cache);
 }
 
 /* printk backend glue */
@@ -620,6 +810,8 @@ static printk_backend_t fb_backend = {
   .name = "linearfb",
   .priority = 100,
   .putc = linearfb_console_putc,
+  .flush = linearfb_console_flush,
+  .bench_legacy = linearfb_console_bench_legacy,
   .probe = linearfb_probe,
   .init = linearfb_init_standard,
   .cleanup = linearfb_cleanup,
@@ -687,8 +879,23 @@ void linearfb_blit(linearfb_surface_t *dst, linearfb_surface_t *src, uint32_t dx
 
 int linearfb_load_font(const linearfb_font_t* font, uint32_t count) {
   if (!font) return -EINVAL;
+
+  /* Swap the font in with no caches installed, then size new ones for it */
+  struct linearfb_glyph_cache old[LINEARFB_GLYPH_CACHE_COLORS], fresh[LINEARFB_GLYPH_CACHE_COLORS] = {0};
+  struct linearfb_device *dev = primary_fb;
+  irq_flags_t flags = dev ? spinlock_lock_irqsave(&dev->lock) : 0;
+  memcpy(old, glyph_cache, sizeof(old));
+  memset(glyph_cache, 0, sizeof(glyph_cache));
   fb_font = *font;
   font_glyph_count = count;
+  if (dev) spinlock_unlock_irqrestore(&dev->lock, flags);
+
+  linearfb_glyph_cache_release(old);
+  linearfb_glyph_cache_alloc(fresh);
+
+  if (dev) flags = spinlock_lock_irqsave(&dev->lock);
+  memcpy(glyph_cache, fresh, sizeof(fresh));
+  if (dev) spinlock_unlock_irqrestore(&dev->lock, flags);
   return 0;
 }
 
@@ -12,14 +12,26 @@
 #include <aerosync/types.h>
 #include <aerosync/spinlock.h>
 #include <aerosync/sysintf/char.h>
+#include <aerosync/timer.h>
 #include <limine/limine.h>
 #include <lib/linearfb/linearfb.h>
 #include <linux/list.h>
 
+/* Damaged areas kept apart before the closest two are merged */
+#define LINEARFB_MAX_DAMAGE 16
+
+/* Console output reaches VRAM at most this often (~60 Hz) */
+#define LINEARFB_FLUSH_INTERVAL_NS (16ULL * 1000ULL * 1000ULL)
+
+struct linearfb_rect {
+  uint32_t x0, y0, x1, y1; /* Exclusive bottom-right corner */
+};
+
 struct linearfb_device {
   struct limine_framebuffer *limine_fb;
   void *vram;           /* Write-combined mapping of VRAM */
   void *shadow_fb;      /* Main memory copy for fast reads/blending */
+  uint32_t shadow_yoff; /* Shadow line holding screen line 0; scrolling rotates it */
   size_t size;
   struct char_device *cdev;
 
@@ -30,9 +42,10 @@ struct linearfb_device {
   char *console_buffer;
   size_t console_buffer_size;
 
-  /* Dirty tracking */
-  uint32_t dirty_x0, dirty_y0, dirty_x1, dirty_y1;
-  bool is_dirty;
+  /* Damage not yet copied to VRAM, and the timer that copies it */
+  struct linearfb_rect damage[LINEARFB_MAX_DAMAGE];
+  uint32_t nr_damage;
+  struct timer_list flush_timer;
 
   spinlock_t lock;
   struct list_head list;
@@ -41,6 +54,14 @@ struct linearfb_device {
 extern struct list_head linearfb_devices;
 extern struct linearfb_device *primary_fb;
 
+/* Shadow framebuffer line that currently shows screen line @y */
+static inline uint8_t *linearfb_shadow_line(struct linearfb_device *dev, uint32_t y) {
+  y += dev->shadow_yoff;
+  if (y >= dev->limine_fb->height)
+    y -= dev->limine_fb->height;
+  return (uint8_t *) dev->shadow_fb + (size_t) y * dev->limine_fb->pitch;
+}
+
 /* Optimized internal primitives */
 void linearfb_dev_put_pixel(struct linearfb_device *dev, uint32_t x, uint32_t y, uint32_t color);
 void linearfb_dev_fill_rect(struct linearfb_device *dev, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color);
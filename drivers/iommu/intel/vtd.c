@@ -10,13 +10,19 @@
 #include <drivers/iommu/intel-iommu.h>
 #include <aerosync/sysintf/dmar.h>
 #include <aerosync/sysintf/device.h>
+#include <aerosync/sysintf/bus.h>
 #include <aerosync/sysintf/dma.h>
 #include <aerosync/sysintf/iommu.h>
+#include <aerosync/sysintf/iova.h>
 #include <aerosync/sysintf/pci.h>
+#include <aerosync/sched/cpumask.h>
 #include <aerosync/classes.h>
 #include <aerosync/fkx/fkx.h>
+#include <aerosync/percpu.h>
+#include <aerosync/errno.h>
 #include <arch/x86_64/cpu.h>
 #include <lib/printk.h>
+#include <lib/id_alloc.h>
 #include <mm/vmalloc.h>
 #include <mm/slub.h>
 #include <mm/vma.h>
@@ -24,15 +30,37 @@
 #include <arch/x86_64/mm/pmm.h>
 #include <lib/string.h>
 
+#ifndef IOMMU_LAZY_FLUSH_THRESHOLD
+#ifndef CONFIG_IOMMU_LAZY_FLUSH_THRESHOLD
+#define IOMMU_LAZY_FLUSH_THRESHOLD 256
+#else
+#define IOMMU_LAZY_FLUSH_THRESHOLD CONFIG_IOMMU_LAZY_FLUSH_THRESHOLD
+#endif
+#endif
+
+#define VTD_LEVEL_STRIDE    9
+#define VTD_DMA32_LIMIT_PFN ((1UL << (32 - PAGE_SHIFT)) - 1)
+#define VTD_MSI_BASE_PFN    (0xfee00000UL >> PAGE_SHIFT)
+#define VTD_MSI_LAST_PFN    (0xfeefffffUL >> PAGE_SHIFT)
+#define VTD_FQ_TIMEOUT_NS   (10ULL * 1000 * 1000)
+
 static LIST_HEAD(s_iommus);
+static struct intel_iommu *s_iommu_by_id[DMAR_UNITS_MAX];
+static int s_nr_iommus;
+static struct ida s_domain_ida;
+
+/* Lowest common denominator of all units */
+static int s_levels = 4;         /* Page table levels */
+static int s_sp_level = 3;       /* Highest leaf level: 1 (4K), 2 (2M) or 3 (1G) */
+static int s_nr_domain_ids = 1 << 16;
+static bool s_coherent = true;   /* Page walks snoop the CPU caches */
+static bool s_pass_through = true;
 
 static inline unsigned int vtd_get_order(size_t size) {
+  size_t count = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
   unsigned int order = 0;
-  size = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
-  while (size > 1) {
-    size >>= 1;
+  while ((1UL << order) < count)
     order++;
-  }
   return order;
 }
 
@@ -44,42 +72,546 @@ static inline uint32_t vtd_read32(struct intel_iommu *iommu, uint32_t reg) {
   return *(volatile uint32_t *)((uintptr_t)iommu->reg_virt + reg);
 }
 
+static inline void vtd_write64(struct intel_iommu *iommu, uint32_t reg, uint64_t val) {
+  *(volatile uint64_t *)((uintptr_t)iommu->reg_virt + reg) = val;
+}
+
 static inline uint64_t vtd_read64(struct intel_iommu *iommu, uint32_t reg) {
   return *(volatile uint64_t *)((uintptr_t)iommu->reg_virt + reg);
 }
 
+static void vtd_gcmd_update(struct intel_iommu *iommu, uint32_t bit, bool enable) {
+  if (enable)
+    iommu->gcmd |= bit;
+  else
+    iommu->gcmd &= ~bit;
+  vtd_write32(iommu, DMAR_GCMD_REG, iommu->gcmd);
+  while (!!(vtd_read32(iommu, DMAR_GSTS_REG) & bit) != enable)
+    cpu_relax();
+}
+
+/* Make table updates visible to units that don't snoop */
+static void vtd_flush_cache(void *addr, size_t size) {
+  if (s_coherent)
+    return;
+
+  uintptr_t end = (uintptr_t)addr + size;
+  for (uintptr_t p = (uintptr_t)addr & ~63UL; p < end; p += 64)
+    __asm__ volatile("clflush (%0)" ::"r"(p) : "memory");
+  __asm__ volatile("mfence" ::: "memory");
+}
+
 struct intel_iommu *find_iommu_for_device(uint16_t segment, uint8_t bus, uint8_t devfn) {
-  struct intel_iommu *iommu;
+  struct intel_iommu *iommu, *catch_all = nullptr;
+
   list_for_each_entry(iommu, &s_iommus, node) {
-    if (iommu->segment == segment) {
-       return iommu;
+    if (iommu->segment != segment)
+      continue;
+    if (iommu->drhd->flags & DMAR_INCLUDE_PCI_ALL) {
+      catch_all = iommu;
+      continue;
+    }
+
+    dmar_dev_t *scope;
+    list_for_each_entry(scope, &iommu->drhd->devices, node) {
+      if (scope->bus == bus && scope->devfn == devfn)
+        return iommu;
+    }
+  }
+  return catch_all;
+}
+
+static struct pci_dev *vtd_pci_dev(struct device *dev) {
+  if (!dev->bus || !dev->bus->name || strcmp(dev->bus->name, "pci") != 0)
+    return nullptr;
+  return to_pci_dev(dev);
+}
+
+/* --- Invalidation --- */
+
+enum vtd_tlb_gran {
+  VTD_TLB_GLOBAL,
+  VTD_TLB_DSI, /* Domain-selective */
+  VTD_TLB_PSI, /* Page-selective */
+};
+
+/* Queue @lo/@hi followed by a wait descriptor and spin until it completes */
+static void qi_submit_sync(struct intel_iommu *iommu, uint64_t lo, uint64_t hi) {
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->qi_lock);
+  uint32_t idx = iommu->qi_tail;
+  uint32_t wait_idx = (idx + 1) % QI_LENGTH;
+
+  iommu->qi_ring[idx * 2] = lo;
+  iommu->qi_ring[idx * 2 + 1] = hi;
+
+  iommu->qi_status = QI_STATUS_BUSY;
+  iommu->qi_ring[wait_idx * 2] = QI_IWD_TYPE | QI_IWD_STATUS_WRITE | QI_IWD_FENCE |
+                                 QI_IWD_STATUS_DATA(QI_STATUS_DONE);
+  iommu->qi_ring[wait_idx * 2 + 1] = pmm_virt_to_phys((void *)&iommu->qi_status);
+
+  iommu->qi_tail = (wait_idx + 1) % QI_LENGTH;
+  smp_wmb();
+  vtd_write64(iommu, DMAR_IQT_REG, (uint64_t)iommu->qi_tail << 4);
+
+  while (READ_ONCE(iommu->qi_status) != QI_STATUS_DONE) {
+    if (vtd_read32(iommu, DMAR_FSTS_REG) & DMAR_FSTS_IQE) {
+      printk(KERN_ERR IOMMU_CLASS "Invalidation queue error on unit @ 0x%llx\n", iommu->reg_phys);
+      vtd_write32(iommu, DMAR_FSTS_REG, DMAR_FSTS_IQE);
+      break;
+    }
+    cpu_relax();
+  }
+  spinlock_unlock_irqrestore(&iommu->qi_lock, flags);
+}
+
+static void vtd_flush_context_global(struct intel_iommu *iommu) {
+  if (iommu->qi_ring) {
+    qi_submit_sync(iommu, QI_CC_TYPE | QI_CC_GRAN_GLOBAL, 0);
+    return;
+  }
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->qi_lock);
+  vtd_write64(iommu, DMAR_CCMD_REG, DMA_CCMD_ICC | DMA_CCMD_GLOBAL_INVL);
+  while (vtd_read64(iommu, DMAR_CCMD_REG) & DMA_CCMD_ICC)
+    cpu_relax();
+  spinlock_unlock_irqrestore(&iommu->qi_lock, flags);
+}
+
+static void vtd_flush_iotlb(struct intel_iommu *iommu, uint16_t did, enum vtd_tlb_gran gran,
+                            unsigned long pfn, unsigned int am) {
+  if (gran == VTD_TLB_PSI && (!CAP_PSI(iommu->cap) || am > CAP_MAMV(iommu->cap)))
+    gran = VTD_TLB_DSI;
+
+  if (iommu->qi_ring) {
+    static const uint64_t qi_gran[] = {QI_IOTLB_GRAN_GLOBAL, QI_IOTLB_GRAN_DSI, QI_IOTLB_GRAN_PSI};
+    uint64_t hi = 0;
+
+    if (gran == VTD_TLB_PSI)
+      hi = ((uint64_t)pfn << PAGE_SHIFT) | QI_IOTLB_AM(am);
+    qi_submit_sync(iommu, QI_IOTLB_TYPE | qi_gran[gran] | QI_IOTLB_DID(did), hi);
+    return;
+  }
+
+  static const uint64_t reg_gran[] = {DMA_TLB_GLOBAL_FLUSH, DMA_TLB_DSI_FLUSH, DMA_TLB_PSI_FLUSH};
+  uint32_t tlb_reg = ECAP_IRO(iommu->ecap) * 16;
+  uint64_t cmd = DMA_TLB_IVT | reg_gran[gran];
+
+  if (gran != VTD_TLB_GLOBAL)
+    cmd |= DMA_TLB_DID(did);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->qi_lock);
+  if (gran == VTD_TLB_PSI)
+    vtd_write64(iommu, tlb_reg + DMAR_IVA_REG, ((uint64_t)pfn << PAGE_SHIFT) | am);
+  vtd_write64(iommu, tlb_reg + DMAR_IOTLB_REG, cmd);
+  while (vtd_read64(iommu, tlb_reg + DMAR_IOTLB_REG) & DMA_TLB_IVT)
+    cpu_relax();
+  spinlock_unlock_irqrestore(&iommu->qi_lock, flags);
+}
+
+static void vtd_flush_write_buffer(struct intel_iommu *iommu) {
+  if (!CAP_RWBF(iommu->cap))
+    return;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->qi_lock);
+  vtd_write32(iommu, DMAR_GCMD_REG, iommu->gcmd | DMAR_GCMD_WBF);
+  while (vtd_read32(iommu, DMAR_GSTS_REG) & DMAR_GSTS_WBFS)
+    cpu_relax();
+  spinlock_unlock_irqrestore(&iommu->qi_lock, flags);
+}
+
+static void domain_flush_iotlb_dsi(struct dmar_domain *dom) {
+  for (int i = 0; i < s_nr_iommus; i++) {
+    if (READ_ONCE(dom->iommu_refcnt[i]))
+      vtd_flush_iotlb(s_iommu_by_id[i], dom->id, VTD_TLB_DSI, 0, 0);
+  }
+}
+
+static void domain_flush_iotlb_psi(struct dmar_domain *dom, unsigned long pfn,
+                                   unsigned long npages) {
+  unsigned long last = pfn + (npages ? npages : 1) - 1;
+
+  /*
+   * The smallest aligned block holding both ends: an unaligned range can
+   * straddle a 2^am boundary even when npages alone fits in 2^am.
+   */
+  unsigned int am = last == pfn ? 0 : 64 - __builtin_clzl(pfn ^ last);
+
+  pfn &= ~((1UL << am) - 1);
+  for (int i = 0; i < s_nr_iommus; i++) {
+    if (READ_ONCE(dom->iommu_refcnt[i]))
+      vtd_flush_iotlb(s_iommu_by_id[i], dom->id, VTD_TLB_PSI, pfn, am);
+  }
+}
+
+/* New mappings only need flushing where the unit caches non-present entries */
+static void domain_flush_map(struct dmar_domain *dom, unsigned long pfn, unsigned long npages) {
+  for (int i = 0; i < s_nr_iommus; i++) {
+    struct intel_iommu *iommu = s_iommu_by_id[i];
+
+    if (!READ_ONCE(dom->iommu_refcnt[i]))
+      continue;
+    if (CAP_CM(iommu->cap))
+      domain_flush_iotlb_psi(dom, pfn, npages);
+    else
+      vtd_flush_write_buffer(iommu);
+  }
+}
+
+/* --- Second-level page tables --- */
+
+static inline unsigned long level_pages(int level) {
+  return 1UL << ((level - 1) * VTD_LEVEL_STRIDE);
+}
+
+static inline unsigned int pfn_level_index(unsigned long pfn, int level) {
+  return (pfn >> ((level - 1) * VTD_LEVEL_STRIDE)) & ((1U << VTD_LEVEL_STRIDE) - 1);
+}
+
+static inline bool vtd_pte_present(uint64_t pte) {
+  return pte & (VTD_PTE_R | VTD_PTE_W);
+}
+
+static uint64_t *vtd_alloc_table(void) {
+  auto folio = alloc_pages(GFP_ATOMIC | ___GFP_ZERO, 0);
+  if (!folio) return nullptr;
+
+  uint64_t *table = page_address(&folio->page);
+  vtd_flush_cache(table, PAGE_SIZE);
+  return table;
+}
+
+static void vtd_free_pgtable(uint64_t *table, int level) {
+  if (level > 1) {
+    for (int i = 0; i < (1 << VTD_LEVEL_STRIDE); i++) {
+      uint64_t pte = table[i];
+      if (vtd_pte_present(pte) && !(pte & VTD_PTE_PS))
+        vtd_free_pgtable(pmm_phys_to_virt(pte & VTD_PTE_ADDR_MASK), level - 1);
+    }
+  }
+  __free_pages(virt_to_page(table), 0);
+}
+
+/* Replace the superpage at @pte (a level @level leaf) with a table of smaller pages */
+static uint64_t *vtd_split_superpage(uint64_t *pte, int level) {
+  uint64_t *table = vtd_alloc_table();
+  if (!table) return nullptr;
+
+  uint64_t val = *pte;
+  uint64_t attr = (val & (VTD_PTE_R | VTD_PTE_W)) | (level - 1 > 1 ? VTD_PTE_PS : 0);
+  uint64_t base = val & VTD_PTE_ADDR_MASK;
+  uint64_t step = level_pages(level - 1) << PAGE_SHIFT;
+
+  for (int i = 0; i < (1 << VTD_LEVEL_STRIDE); i++)
+    table[i] = (base + i * step) | attr;
+  vtd_flush_cache(table, PAGE_SIZE);
+
+  WRITE_ONCE(*pte, pmm_virt_to_phys(table) | VTD_PTE_R | VTD_PTE_W);
+  vtd_flush_cache(pte, sizeof(*pte));
+  return table;
+}
+
+/*
+ * Entry for @pfn at @*level. With @alloc, missing tables are created and
+ * superpages above @*level split on the way down. Without, the walk stops
+ * at the first leaf or hole and @*level reports where.
+ * Called with dom->lock held.
+ */
+static uint64_t *vtd_pte_walk(struct dmar_domain *dom, unsigned long pfn, int *level, bool alloc) {
+  uint64_t *table = dom->pgtbl;
+
+  for (int l = dom->addr_width;; l--) {
+    uint64_t *pte = &table[pfn_level_index(pfn, l)];
+    if (l == *level)
+      return pte;
+
+    uint64_t val = READ_ONCE(*pte);
+    if (vtd_pte_present(val) && !(val & VTD_PTE_PS)) {
+      table = pmm_phys_to_virt(val & VTD_PTE_ADDR_MASK);
+      continue;
+    }
+
+    if (!alloc) {
+      *level = l;
+      return pte;
+    }
+
+    if (vtd_pte_present(val)) {
+      table = vtd_split_superpage(pte, l);
+    } else {
+      table = vtd_alloc_table();
+      if (table) {
+        WRITE_ONCE(*pte, pmm_virt_to_phys(table) | VTD_PTE_R | VTD_PTE_W);
+        vtd_flush_cache(pte, sizeof(*pte));
+      }
+    }
+    if (!table) return nullptr;
+  }
+}
+
+static int vtd_domain_map(struct dmar_domain *dom, unsigned long pfn, unsigned long phys_pfn,
+                          unsigned long npages, uint64_t attr) {
+  int ret = 0;
+  irq_flags_t flags = spinlock_lock_irqsave(&dom->lock);
+
+  while (npages) {
+    int level = s_sp_level;
+    uint64_t *pte;
+
+    /* Largest page that alignment and length allow */
+    while (level > 1 && (((pfn | phys_pfn) & (level_pages(level) - 1)) ||
+                         npages < level_pages(level)))
+      level--;
+
+    for (;;) {
+      int want = level;
+      pte = vtd_pte_walk(dom, pfn, &want, true);
+      if (!pte) {
+        ret = -ENOMEM;
+        goto out;
+      }
+      /* Never drop a populated table for a superpage */
+      if (level > 1 && vtd_pte_present(*pte) && !(*pte & VTD_PTE_PS)) {
+        level--;
+        continue;
+      }
+      break;
+    }
+
+    WRITE_ONCE(*pte, (phys_pfn << PAGE_SHIFT) | attr | (level > 1 ? VTD_PTE_PS : 0));
+    vtd_flush_cache(pte, sizeof(*pte));
+
+    pfn += level_pages(level);
+    phys_pfn += level_pages(level);
+    npages -= level_pages(level);
+  }
+out:
+  spinlock_unlock_irqrestore(&dom->lock, flags);
+  return ret;
+}
+
+/* Clear leaves in the range, splitting superpages it only partly covers */
+static unsigned long vtd_domain_unmap(struct dmar_domain *dom, unsigned long pfn,
+                                      unsigned long npages) {
+  unsigned long unmapped = 0;
+  irq_flags_t flags = spinlock_lock_irqsave(&dom->lock);
+
+  while (npages) {
+    int level = 1;
+    uint64_t *pte = vtd_pte_walk(dom, pfn, &level, false);
+    unsigned long span = level_pages(level);
+    unsigned long off = pfn & (span - 1);
+
+    if (!vtd_pte_present(*pte)) {
+      unsigned long skip = span - off < npages ? span - off : npages;
+      pfn += skip;
+      npages -= skip;
+      continue;
+    }
+
+    if (level > 1 && (off || npages < span)) {
+      if (!vtd_split_superpage(pte, level))
+        break;
+      continue;
     }
+
+    WRITE_ONCE(*pte, 0);
+    vtd_flush_cache(pte, sizeof(*pte));
+    unmapped += span;
+    pfn += span;
+    npages -= span;
+  }
+
+  spinlock_unlock_irqrestore(&dom->lock, flags);
+  return unmapped;
+}
+
+static unsigned long vtd_identity_pages(void) {
+  unsigned long pages = PAGE_ALIGN_UP(pmm_get_stats()->highest_address) >> PAGE_SHIFT;
+  unsigned long max = 1UL << (s_levels * VTD_LEVEL_STRIDE);
+
+  return pages < max ? pages : max;
+}
+
+/* Firmware-reserved (RMRR) ranges stay 1:1 for the devices that use them */
+static void vtd_map_rmrrs(struct dmar_domain *dom, uint16_t segment, uint8_t bus, uint8_t devfn) {
+  dmar_reserved_region_t *rmrr;
+
+  list_for_each_entry(rmrr, dmar_get_reserved_regions(), node) {
+    if (rmrr->segment != segment)
+      continue;
+
+    dmar_dev_t *scope;
+    list_for_each_entry(scope, &rmrr->devices, node) {
+      if (scope->bus != bus || scope->devfn != devfn)
+        continue;
+
+      unsigned long lo = rmrr->base_address >> PAGE_SHIFT;
+      unsigned long hi = rmrr->end_address >> PAGE_SHIFT;
+
+      if (dom->domain->type == IOMMU_DOMAIN_DMA)
+        reserve_iova(&dom->iovad, lo, hi);
+      vtd_domain_map(dom, lo, lo, hi - lo + 1, VTD_PTE_R | VTD_PTE_W);
+    }
+  }
+}
+
+/* --- Deferred IOTLB flushing --- */
+
+#ifdef CONFIG_IOMMU_LAZY_FLUSH
+static void vtd_fq_flush_iotlb(struct dmar_domain *dom) {
+  atomic64_inc(&dom->flush_start_cnt);
+  domain_flush_iotlb_dsi(dom);
+  atomic64_inc(&dom->flush_finish_cnt);
+}
+
+/* Free IOVAs whose unmap a finished flush has covered. Called with fq->lock held */
+static void vtd_fq_release(struct dmar_domain *dom, struct dmar_flush_queue *fq) {
+  uint64_t done = atomic64_read(&dom->flush_finish_cnt);
+  unsigned int i = 0;
+
+  while (i < fq->count && fq->entries[i].counter < done) {
+    free_iova_fast(&dom->iovad, fq->entries[i].pfn, fq->entries[i].npages);
+    i++;
+  }
+
+  if (i) {
+    fq->count -= i;
+    memmove(fq->entries, fq->entries + i, fq->count * sizeof(*fq->entries));
+  }
+}
+
+static void vtd_fq_queue(struct dmar_domain *dom, unsigned long pfn, unsigned long npages) {
+  irq_flags_t flags = local_irq_save();
+  struct dmar_flush_queue *fq = this_cpu_ptr(*dom->fq);
+  spinlock_lock(&fq->lock);
+
+  vtd_fq_release(dom, fq);
+  if (fq->count == IOMMU_LAZY_FLUSH_THRESHOLD) {
+    vtd_fq_flush_iotlb(dom);
+    vtd_fq_release(dom, fq);
   }
-  return nullptr;
+
+  fq->entries[fq->count++] = (struct dmar_fq_entry){
+    .pfn = pfn,
+    .npages = npages,
+    .counter = atomic64_read(&dom->flush_start_cnt),
+  };
+
+  spinlock_unlock(&fq->lock);
+  local_irq_restore(flags);
+
+  if (system_wq && !work_pending(&dom->fq_work.work))
+    schedule_delayed_work(&dom->fq_work, VTD_FQ_TIMEOUT_NS);
 }
 
+static void vtd_fq_work(struct work_struct *work) {
+  struct dmar_domain *dom = container_of(to_delayed_work(work), struct dmar_domain, fq_work);
+  bool pending = false;
+  int cpu;
+
+  vtd_fq_flush_iotlb(dom);
+
+  for_each_possible_cpu(cpu) {
+    struct dmar_flush_queue *fq = per_cpu_ptr(*dom->fq, cpu);
+    irq_flags_t flags = spinlock_lock_irqsave(&fq->lock);
+
+    vtd_fq_release(dom, fq);
+    if (fq->count)
+      pending = true;
+    spinlock_unlock_irqrestore(&fq->lock, flags);
+  }
+
+  if (pending)
+    schedule_delayed_work(&dom->fq_work, VTD_FQ_TIMEOUT_NS);
+}
+#endif
+
 /* --- DMA Ops implementation --- */
 
+static struct dmar_domain *vtd_dev_dma_domain(struct device *dev) {
+  struct iommu_domain *domain = dev ? dev->iommu_domain : nullptr;
+
+  if (!domain || domain->type != IOMMU_DOMAIN_DMA)
+    return nullptr;
+  return domain->priv;
+}
+
+static inline unsigned long vtd_nr_pages(uint64_t addr, size_t size) {
+  return ((addr & ~PAGE_MASK) + size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+}
+
+static uint64_t vtd_dir_to_attr(enum dma_data_direction dir) {
+  switch (dir) {
+  case DMA_TO_DEVICE:
+    return VTD_PTE_R;
+  case DMA_FROM_DEVICE:
+    return VTD_PTE_W;
+  default:
+    return VTD_PTE_R | VTD_PTE_W;
+  }
+}
+
+static dma_addr_t __vtd_map(struct device *dev, uint64_t phys, size_t size, uint64_t attr) {
+  struct dmar_domain *dom = vtd_dev_dma_domain(dev);
+  if (!dom) return phys;
+
+  unsigned long npages = vtd_nr_pages(phys, size);
+  unsigned long pfn = alloc_iova_fast(&dom->iovad, npages, VTD_DMA32_LIMIT_PFN);
+  if (!pfn) return (dma_addr_t)-1;
+
+  if (vtd_domain_map(dom, pfn, phys >> PAGE_SHIFT, npages, attr)) {
+    vtd_domain_unmap(dom, pfn, npages);
+    free_iova_fast(&dom->iovad, pfn, npages);
+    return (dma_addr_t)-1;
+  }
+  domain_flush_map(dom, pfn, npages);
+
+  return ((dma_addr_t)pfn << PAGE_SHIFT) | (phys & ~PAGE_MASK);
+}
+
+static void __vtd_unmap(struct device *dev, dma_addr_t dma_addr, size_t size) {
+  struct dmar_domain *dom = vtd_dev_dma_domain(dev);
+  if (!dom) return;
+
+  unsigned long pfn = dma_addr >> PAGE_SHIFT;
+  unsigned long npages = vtd_nr_pages(dma_addr, size);
+
+  vtd_domain_unmap(dom, pfn, npages);
+#ifdef CONFIG_IOMMU_LAZY_FLUSH
+  vtd_fq_queue(dom, pfn, npages);
+#else
+  domain_flush_iotlb_psi(dom, pfn, npages);
+  free_iova_fast(&dom->iovad, pfn, npages);
+#endif
+}
+
 static void *vtd_alloc_coherent(struct device *dev, size_t size, dma_addr_t *dma_handle, gfp_t gfp) {
-  auto folio = alloc_pages(gfp | ___GFP_ZERO, vtd_get_order(size));
+  unsigned int order = vtd_get_order(size);
+  auto folio = alloc_pages(gfp | ___GFP_ZERO, order);
   if (!folio) return nullptr;
 
-  *dma_handle = folio_to_phys(folio);
+  dma_addr_t handle = __vtd_map(dev, folio_to_phys(folio), size, VTD_PTE_R | VTD_PTE_W);
+  if (handle == (dma_addr_t)-1) {
+    __free_pages(&folio->page, order);
+    return nullptr;
+  }
+
+  *dma_handle = handle;
   return page_address(&folio->page);
 }
 
 static void vtd_free_coherent(struct device *dev, size_t size, void *cpu_addr, dma_addr_t dma_handle) {
-  (void)dev;
-  __free_pages(phys_to_page((uintptr_t)cpu_addr), vtd_get_order(size));
+  __vtd_unmap(dev, dma_handle, size);
+  __free_pages(virt_to_page(cpu_addr), vtd_get_order(size));
 }
 
 static dma_addr_t vtd_map_page(struct device *dev, struct page *page, unsigned long offset, size_t size, enum dma_data_direction dir) {
-  (void)dev; (void)size; (void)dir;
-  return page_to_phys(page) + offset;
+  return __vtd_map(dev, page_to_phys(page) + offset, size, vtd_dir_to_attr(dir));
 }
 
 static void vtd_unmap_page(struct device *dev, dma_addr_t dma_addr, size_t size, enum dma_data_direction dir) {
-  (void)dev; (void)dma_addr; (void)size; (void)dir;
+  (void)dir;
+  __vtd_unmap(dev, dma_addr, size);
 }
 
 static const struct dma_map_ops vtd_dma_ops = {
@@ -91,39 +623,263 @@ static const struct dma_map_ops vtd_dma_ops = {
 
 /* --- IOMMU Ops implementation --- */
 
-static int vtd_domain_init(struct iommu_domain *domain) {
-  auto folio = alloc_pages(GFP_KERNEL | ___GFP_ZERO, 0);
-  if (!folio) return -ENOMEM;
+static int vtd_dma_domain_init(struct dmar_domain *dom) {
+  int ret = iova_domain_init(&dom->iovad, 1);
+  if (ret) return ret;
+
+  /* Interrupt messages never reach the page tables */
+  reserve_iova(&dom->iovad, VTD_MSI_BASE_PFN, VTD_MSI_LAST_PFN);
+
+#ifdef CONFIG_IOMMU_LAZY_FLUSH
+  INIT_DELAYED_WORK(&dom->fq_work, vtd_fq_work);
+  atomic64_set(&dom->flush_start_cnt, 0);
+  atomic64_set(&dom->flush_finish_cnt, 0);
 
-  domain->pgtable = (uintptr_t)page_address(&folio->page);
+  dom->fq = alloc_percpu(struct dmar_flush_queue);
+  if (!dom->fq) return -ENOMEM;
+
+  int cpu;
+  for_each_possible_cpu(cpu) {
+    struct dmar_flush_queue *fq = per_cpu_ptr(*dom->fq, cpu);
+
+    spinlock_init(&fq->lock);
+    fq->count = 0;
+    fq->entries = kmalloc(sizeof(struct dmar_fq_entry) * IOMMU_LAZY_FLUSH_THRESHOLD);
+    if (!fq->entries) return -ENOMEM;
+  }
+#endif
   return 0;
 }
 
 static void vtd_domain_free(struct iommu_domain *domain) {
-  if (domain->pgtable) {
-    __free_pages(phys_to_page(domain->pgtable), 0);
+  struct dmar_domain *dom = domain->priv;
+  if (!dom) return;
+
+  if (domain->type == IOMMU_DOMAIN_DMA) {
+#ifdef CONFIG_IOMMU_LAZY_FLUSH
+    if (dom->fq) {
+      int cpu;
+
+      cancel_delayed_work_sync(&dom->fq_work);
+      for_each_possible_cpu(cpu)
+        kfree(per_cpu_ptr(*dom->fq, cpu)->entries);
+      free_percpu(dom->fq);
+    }
+#endif
+    iova_domain_destroy(&dom->iovad);
+  }
+
+  if (dom->pgtbl)
+    vtd_free_pgtable(dom->pgtbl, dom->addr_width);
+  if (dom->id > 0)
+    ida_free(&s_domain_ida, dom->id);
+
+  kfree(dom);
+  domain->priv = nullptr;
+  domain->pgtable = 0;
+}
+
+static int vtd_domain_init(struct iommu_domain *domain) {
+  auto dom = (struct dmar_domain *)kzalloc(sizeof(struct dmar_domain));
+  if (!dom) return -ENOMEM;
+
+  dom->domain = domain;
+  dom->addr_width = s_levels;
+  spinlock_init(&dom->lock);
+  domain->priv = dom;
+
+  int ret = -ENOSPC;
+  dom->id = ida_alloc_min(&s_domain_ida, 1);
+  if (dom->id < 0)
+    goto fail;
+
+  if (domain->type == IOMMU_DOMAIN_IDENTITY && s_pass_through) {
+    dom->pass_through = true;
+    return 0;
+  }
+
+  ret = -ENOMEM;
+  dom->pgtbl = vtd_alloc_table();
+  if (!dom->pgtbl)
+    goto fail;
+  dom->pgtbl_phys = pmm_virt_to_phys(dom->pgtbl);
+  domain->pgtable = (uintptr_t)dom->pgtbl;
+
+  if (domain->type == IOMMU_DOMAIN_IDENTITY)
+    ret = vtd_domain_map(dom, 0, 0, vtd_identity_pages(), VTD_PTE_R | VTD_PTE_W);
+  else if (domain->type == IOMMU_DOMAIN_DMA)
+    ret = vtd_dma_domain_init(dom);
+  else
+    ret = 0;
+  if (ret)
+    goto fail;
+
+  return 0;
+
+fail:
+  vtd_domain_free(domain);
+  return ret;
+}
+
+static int vtd_probe_device(struct device *dev) {
+  struct pci_dev *pdev = vtd_pci_dev(dev);
+  if (!pdev) return -ENODEV;
+
+  return find_iommu_for_device(pdev->handle.segment, pdev->handle.bus, pdev->devfn) ? 0 : -ENODEV;
+}
+
+static struct context_entry *vtd_context_entry(struct intel_iommu *iommu, uint8_t bus, uint8_t devfn) {
+  struct root_entry *root = &iommu->root_entry[bus];
+  struct context_entry *table;
+
+  if (root->lo & ROOT_PRESENT) {
+    table = pmm_phys_to_virt(root->lo & CONTEXT_ADDR_MASK);
+  } else {
+    table = (struct context_entry *)vtd_alloc_table();
+    if (!table) return nullptr;
+    WRITE_ONCE(root->lo, pmm_virt_to_phys(table) | ROOT_PRESENT);
+    vtd_flush_cache(root, sizeof(*root));
   }
+  return &table[devfn];
 }
 
 static int vtd_attach_dev(struct iommu_domain *domain, struct device *dev) {
-  (void)domain; (void)dev;
+  struct dmar_domain *dom = domain->priv;
+  struct pci_dev *pdev = vtd_pci_dev(dev);
+  if (!pdev) return -ENODEV;
+
+  uint8_t bus = pdev->handle.bus, devfn = pdev->devfn;
+  struct intel_iommu *iommu = find_iommu_for_device(pdev->handle.segment, bus, devfn);
+  if (!iommu) return -ENODEV;
+
+  if (!dom->pass_through)
+    vtd_map_rmrrs(dom, pdev->handle.segment, bus, devfn);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->lock);
+  struct context_entry *ctx = vtd_context_entry(iommu, bus, devfn);
+  if (!ctx) {
+    spinlock_unlock_irqrestore(&iommu->lock, flags);
+    return -ENOMEM;
+  }
+
+  if (ctx->lo & CONTEXT_PRESENT) {
+    WRITE_ONCE(ctx->lo, 0);
+    vtd_flush_cache(ctx, sizeof(*ctx));
+  }
+
+  uint64_t lo = CONTEXT_PRESENT;
+  if (dom->pass_through)
+    lo |= CONTEXT_TT_PASSTHROUGH;
+  else
+    lo |= (dom->pgtbl_phys & CONTEXT_ADDR_MASK) | CONTEXT_TT_MULTI_LEVEL;
+
+  WRITE_ONCE(ctx->hi, CONTEXT_DID(dom->id) |
+                      (dom->addr_width == 4 ? CONTEXT_AW_4LEVEL : CONTEXT_AW_3LEVEL));
+  smp_wmb();
+  WRITE_ONCE(ctx->lo, lo);
+  vtd_flush_cache(ctx, sizeof(*ctx));
+
+  dom->iommu_refcnt[iommu->seq_id]++;
+  spinlock_unlock_irqrestore(&iommu->lock, flags);
+
+  vtd_flush_context_global(iommu);
+  vtd_flush_iotlb(iommu, 0, VTD_TLB_GLOBAL, 0, 0);
   return 0;
 }
 
+static void vtd_detach_dev(struct iommu_domain *domain, struct device *dev) {
+  struct dmar_domain *dom = domain->priv;
+  struct pci_dev *pdev = vtd_pci_dev(dev);
+  if (!pdev) return;
+
+  uint8_t bus = pdev->handle.bus, devfn = pdev->devfn;
+  struct intel_iommu *iommu = find_iommu_for_device(pdev->handle.segment, bus, devfn);
+  if (!iommu) return;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&iommu->lock);
+  struct context_entry *ctx = vtd_context_entry(iommu, bus, devfn);
+  if (ctx && (ctx->lo & CONTEXT_PRESENT)) {
+    WRITE_ONCE(ctx->lo, 0);
+    WRITE_ONCE(ctx->hi, 0);
+    vtd_flush_cache(ctx, sizeof(*ctx));
+    if (dom->iommu_refcnt[iommu->seq_id])
+      dom->iommu_refcnt[iommu->seq_id]--;
+  }
+  spinlock_unlock_irqrestore(&iommu->lock, flags);
+
+  vtd_flush_context_global(iommu);
+  vtd_flush_iotlb(iommu, dom->id, VTD_TLB_DSI, 0, 0);
+}
+
+static uint64_t vtd_prot_to_attr(int prot) {
+  uint64_t attr = 0;
+
+  if (prot & IOMMU_READ)
+    attr |= VTD_PTE_R;
+  if (prot & IOMMU_WRITE)
+    attr |= VTD_PTE_W;
+  return attr;
+}
+
 static int vtd_map(struct iommu_domain *domain, uint64_t iova, uint64_t paddr, size_t size, int prot) {
-  (void)domain; (void)iova; (void)paddr; (void)size; (void)prot;
+  struct dmar_domain *dom = domain->priv;
+  uint64_t attr = vtd_prot_to_attr(prot);
+
+  if (dom->pass_through || !attr)
+    return -EINVAL;
+
+  unsigned long pfn = iova >> PAGE_SHIFT;
+  unsigned long npages = vtd_nr_pages(iova, size);
+  int ret = vtd_domain_map(dom, pfn, paddr >> PAGE_SHIFT, npages, attr);
+  if (ret)
+    return ret;
+
+  domain_flush_map(dom, pfn, npages);
   return 0;
 }
 
+static size_t vtd_unmap(struct iommu_domain *domain, uint64_t iova, size_t size) {
+  struct dmar_domain *dom = domain->priv;
+  if (dom->pass_through) return 0;
+
+  unsigned long pfn = iova >> PAGE_SHIFT;
+  unsigned long npages = vtd_nr_pages(iova, size);
+  unsigned long unmapped = vtd_domain_unmap(dom, pfn, npages);
+
+  domain_flush_iotlb_psi(dom, pfn, npages);
+  return unmapped << PAGE_SHIFT;
+}
+
+static uint64_t vtd_iova_to_phys(struct iommu_domain *domain, uint64_t iova) {
+  struct dmar_domain *dom = domain->priv;
+  if (dom->pass_through) return iova;
+
+  int level = 1;
+  irq_flags_t flags = spinlock_lock_irqsave(&dom->lock);
+  uint64_t pte = *vtd_pte_walk(dom, iova >> PAGE_SHIFT, &level, false);
+  spinlock_unlock_irqrestore(&dom->lock, flags);
+
+  if (!vtd_pte_present(pte))
+    return 0;
+  return (pte & VTD_PTE_ADDR_MASK) + (iova & ((level_pages(level) << PAGE_SHIFT) - 1));
+}
+
 static const struct iommu_ops vtd_iommu_ops = {
+  .probe_device = vtd_probe_device,
   .domain_init = vtd_domain_init,
   .domain_free = vtd_domain_free,
   .attach_dev = vtd_attach_dev,
+  .detach_dev = vtd_detach_dev,
   .map = vtd_map,
+  .unmap = vtd_unmap,
+  .iova_to_phys = vtd_iova_to_phys,
 };
 
 /**
  * @brief Initialize a single IOMMU hardware unit
+ *
+ * Translation stays off until every unit is ready and the devices found
+ * so far have context entries, see vtd_mod_init().
  */
 static int iommu_init_unit(struct intel_iommu *iommu) {
   iommu->reg_virt = ioremap(iommu->reg_phys, PAGE_SIZE);
@@ -132,24 +888,61 @@ static int iommu_init_unit(struct intel_iommu *iommu) {
   iommu->cap = vtd_read64(iommu, DMAR_CAP_REG);
   iommu->ecap = vtd_read64(iommu, DMAR_ECAP_REG);
 
+  if (!(CAP_SAGAW(iommu->cap) & (SAGAW_3LEVEL | SAGAW_4LEVEL))) {
+    printk(KERN_ERR IOMMU_CLASS "Unit @ 0x%llx supports no usable address width\n", iommu->reg_phys);
+    return -ENODEV;
+  }
+
+  /* Firmware may have left translation or queued invalidation running */
+  iommu->gcmd = vtd_read32(iommu, DMAR_GSTS_REG) & DMAR_GSTS_ONE_SHOT_MASK;
+  if (iommu->gcmd & DMAR_GCMD_TE)
+    vtd_gcmd_update(iommu, DMAR_GCMD_TE, false);
+  if (iommu->gcmd & DMAR_GCMD_QIE)
+    vtd_gcmd_update(iommu, DMAR_GCMD_QIE, false);
+
   auto folio = alloc_pages(GFP_KERNEL | ___GFP_ZERO, 0);
   if (!folio) return -ENOMEM;
 
   iommu->root_entry = (struct root_entry *)page_address(&folio->page);
-  auto root_phys = folio_to_phys(folio);
-
-  vtd_write32(iommu, DMAR_RTADDR_REG, (uint32_t)root_phys);
-  vtd_write32(iommu, DMAR_RTADDR_REG + 4, (uint32_t)(root_phys >> 32));
-  vtd_write32(iommu, DMAR_GCMD_REG, DMAR_GCMD_SRTP);
+  vtd_flush_cache(iommu->root_entry, PAGE_SIZE);
 
+  vtd_write64(iommu, DMAR_RTADDR_REG, folio_to_phys(folio));
+  vtd_write32(iommu, DMAR_GCMD_REG, iommu->gcmd | DMAR_GCMD_SRTP);
   while (!(vtd_read32(iommu, DMAR_GSTS_REG) & DMAR_GSTS_RTPS)) cpu_relax();
 
-  vtd_write32(iommu, DMAR_GCMD_REG, DMAR_GCMD_TE);
-  while (!(vtd_read32(iommu, DMAR_GSTS_REG) & DMAR_GSTS_TES)) cpu_relax();
+  if (ECAP_QI(iommu->ecap)) {
+    auto qi = alloc_pages(GFP_KERNEL | ___GFP_ZERO, 0);
+    if (qi) {
+      iommu->qi_ring = page_address(&qi->page);
+      iommu->qi_tail = 0;
+      vtd_write64(iommu, DMAR_IQT_REG, 0);
+      vtd_write64(iommu, DMAR_IQA_REG, folio_to_phys(qi)); /* QS = 0: 256 entries */
+      vtd_gcmd_update(iommu, DMAR_GCMD_QIE, true);
+    }
+  }
 
+  vtd_flush_context_global(iommu);
+  vtd_flush_iotlb(iommu, 0, VTD_TLB_GLOBAL, 0, 0);
   return 0;
 }
 
+static void vtd_account_caps(struct intel_iommu *iommu) {
+  uint64_t cap = iommu->cap, ecap = iommu->ecap;
+  int sp_level = (CAP_SLLPS(cap) & 0x2) ? 3 : (CAP_SLLPS(cap) & 0x1) ? 2 : 1;
+  int nr_ids = 1 << (4 + 2 * CAP_ND(cap));
+
+  if (!(CAP_SAGAW(cap) & SAGAW_4LEVEL))
+    s_levels = 3;
+  if (sp_level < s_sp_level)
+    s_sp_level = sp_level;
+  if (nr_ids < s_nr_domain_ids)
+    s_nr_domain_ids = nr_ids;
+  if (!ECAP_C(ecap))
+    s_coherent = false;
+  if (!ECAP_PT(ecap))
+    s_pass_through = false;
+}
+
 static int vtd_mod_init(void) {
   auto units = dmar_get_units();
   if (list_empty(units)) {
@@ -159,27 +952,56 @@ static int vtd_mod_init(void) {
 
   dmar_unit_t *dmar_unit;
   list_for_each_entry(dmar_unit, units, node) {
+    if (s_nr_iommus == DMAR_UNITS_MAX) {
+      printk(KERN_WARNING IOMMU_CLASS "Too many VT-d units, ignoring the rest\n");
+      break;
+    }
+
     auto iommu = (struct intel_iommu *)kmalloc(sizeof(struct intel_iommu));
     if (!iommu) continue;
 
     memset(iommu, 0, sizeof(*iommu));
     iommu->reg_phys = dmar_unit->address;
     iommu->segment = dmar_unit->segment;
+    iommu->drhd = dmar_unit;
     spinlock_init(&iommu->lock);
+    spinlock_init(&iommu->qi_lock);
 
     if (iommu_init_unit(iommu) == 0) {
+      iommu->seq_id = s_nr_iommus;
+      s_iommu_by_id[s_nr_iommus++] = iommu;
+      vtd_account_caps(iommu);
       list_add_tail(&iommu->node, &s_iommus);
-      printk(KERN_INFO IOMMU_CLASS "Intel VT-d Unit @ 0x%llx initialized\n", iommu->reg_phys);
+      printk(KERN_INFO IOMMU_CLASS "Intel VT-d Unit @ 0x%llx initialized (%s invalidation)\n",
+             iommu->reg_phys, iommu->qi_ring ? "queued" : "register");
     } else {
       kfree(iommu);
     }
   }
 
-  if (!list_empty(&s_iommus)) {
-    iommu_register_ops(&vtd_iommu_ops, &vtd_dma_ops);
-  }
+  if (list_empty(&s_iommus))
+    return -ENODEV;
+
+  ida_init(&s_domain_ida, s_nr_domain_ids);
 
-  return list_empty(&s_iommus) ? -ENODEV : 0;
+  /* Devices enumerated so far get their context entries here */
+  int ret = iommu_register_ops(&vtd_iommu_ops, &vtd_dma_ops);
+  if (ret)
+    return ret;
+
+  struct intel_iommu *iommu;
+  list_for_each_entry(iommu, &s_iommus, node)
+    vtd_gcmd_update(iommu, DMAR_GCMD_TE, true);
+
+  printk(KERN_INFO IOMMU_CLASS "DMA remapping enabled: %d-level tables, %s pages, %s\n",
+         s_levels, s_sp_level == 3 ? "1G/2M" : s_sp_level == 2 ? "2M" : "4K",
+#ifdef CONFIG_IOMMU_LAZY_FLUSH
+         "lazy IOTLB flush"
+#else
+         "strict IOTLB flush"
+#endif
+  );
+  return 0;
 }
 
 FKX_MODULE_DEFINE(
@@ -0,0 +1,445 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file fs/dcache.c
+ * @brief Hashed dentry cache
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <fs/vfs.h>
+#include <lib/string.h>
+#include <mm/slub.h>
+#include <linux/rculist.h>
+#include <linux/llist.h>
+#include <aerosync/rcu.h>
+#include <aerosync/seqlock.h>
+#include <aerosync/spinlock.h>
+#include <aerosync/workqueue.h>
+#include <aerosync/export.h>
+
+/*
+ * Every hashed dentry sits on a chain keyed by (parent, name hash) and on
+ * its parent's d_subdirs, and holds a reference on the parent.
+ *
+ * dcache_lock serializes all changes to the tree, the LRU and the 0 <-> 1
+ * transitions of d_count. Lockless walkers only ever see dentries through
+ * RCU-protected hash chains and validate what they saw against dcache_seq,
+ * which is bumped whenever a dentry is unhashed, renamed, killed or
+ * instantiated. Dentries are freed one grace period after being killed.
+ *
+ * An unused dentry is killed right away unless its filesystem is the
+ * dentry tree itself (SB_DCACHE_RETAIN): there, positive dentries stay
+ * hashed and negative ones go to an LRU bounded by VFS_DCACHE_SIZE.
+ */
+
+#ifndef VFS_DCACHE_SIZE
+#ifndef CONFIG_VFS_DCACHE_SIZE
+#define VFS_DCACHE_SIZE 4096
+#else
+#define VFS_DCACHE_SIZE CONFIG_VFS_DCACHE_SIZE
+#endif
+#endif
+
+#define D_HASH_BITS 12
+#define D_HASH_SIZE (1U << D_HASH_BITS)
+#define D_SHRINK_BATCH 32
+
+static struct list_head dentry_hashtable[D_HASH_SIZE];
+static DEFINE_SPINLOCK(dcache_lock);
+static seqlock_t dcache_seq = SEQLOCK_INIT;
+
+static LIST_HEAD(dentry_lru);
+static unsigned long nr_unused;
+
+static LLIST_HEAD(dentry_free_list);
+static void dentry_free_workfn(struct work_struct *work);
+static struct work_struct dentry_free_work = {
+  .entry = LIST_HEAD_INIT(dentry_free_work.entry),
+  .func = dentry_free_workfn,
+};
+
+/* FNV-1a */
+uint32_t d_hash_name(const unsigned char *name, uint32_t len) {
+  uint32_t hash = 2166136261u;
+
+  for (uint32_t i = 0; i < len; i++) {
+    hash ^= name[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+EXPORT_SYMBOL(d_hash_name);
+
+static struct list_head *d_hash(const struct dentry *parent, uint32_t hash) {
+  uint64_t key = (uint64_t) (uintptr_t) parent ^ hash;
+  return &dentry_hashtable[(key * 0x9E3779B97F4A7C15ULL) >> (64 - D_HASH_BITS)];
+}
+
+/*
+ * The name is compared up to the terminator of the dentry's own copy, so a
+ * lockless reader racing with d_move() never reads past the old buffer.
+ */
+static bool d_name_eq(const struct dentry *dentry, const struct qstr *name) {
+  const unsigned char *dname = READ_ONCE(dentry->d_name.name);
+
+  for (uint32_t i = 0; i < name->len; i++) {
+    if (dname[i] != name->name[i])
+      return false;
+  }
+  return dname[name->len] == '\0';
+}
+
+static bool d_matches(const struct dentry *dentry, const struct dentry *parent,
+                      const struct qstr *name, uint32_t hash) {
+  return READ_ONCE(dentry->d_parent) == parent &&
+         READ_ONCE(dentry->d_name.hash) == hash &&
+         d_name_eq(dentry, name);
+}
+
+static bool d_retained(const struct dentry *dentry) {
+  return (dentry->d_flags & DCACHE_HASHED) && dentry->d_sb &&
+         (dentry->d_sb->s_flags & SB_DCACHE_RETAIN);
+}
+
+/* Called with dcache_lock held */
+static void __d_lru_del(struct dentry *dentry) {
+  if (dentry->d_flags & DCACHE_LRU) {
+    list_del_init(&dentry->d_lru);
+    dentry->d_flags &= ~DCACHE_LRU;
+    nr_unused--;
+  }
+}
+
+/* Called with dcache_lock held */
+static void __dget_locked(struct dentry *dentry) {
+  if (atomic_inc_return(&dentry->d_count) == 1)
+    __d_lru_del(dentry);
+}
+
+/*
+ * Take @dentry off its hash chain and its parent's d_subdirs.
+ * Called with dcache_lock held; returns the parent reference to drop.
+ */
+static struct dentry *__d_unhash(struct dentry *dentry) {
+  struct dentry *parent = dentry->d_parent;
+
+  if (!(dentry->d_flags & DCACHE_HASHED))
+    return nullptr;
+
+  write_seqlock(&dcache_seq);
+  list_del_rcu(&dentry->d_hash);
+  spinlock_lock(&parent->d_lock);
+  list_del_init(&dentry->d_child);
+  spinlock_unlock(&parent->d_lock);
+  dentry->d_flags &= ~DCACHE_HASHED;
+  write_sequnlock(&dcache_seq);
+
+  return parent;
+}
+
+/* Called with dcache_lock held */
+static void __d_rehash(struct dentry *dentry) {
+  struct dentry *parent = dentry->d_parent;
+
+  atomic_inc(&parent->d_count);
+
+  write_seqlock(&dcache_seq);
+  spinlock_lock(&parent->d_lock);
+  list_add_tail(&dentry->d_child, &parent->d_subdirs);
+  spinlock_unlock(&parent->d_lock);
+  list_add_rcu(&dentry->d_hash, d_hash(parent, dentry->d_name.hash));
+  dentry->d_flags |= DCACHE_HASHED;
+  write_sequnlock(&dcache_seq);
+}
+
+/*
+ * Mark an unused dentry dead and unlink it from everything.
+ * Called with dcache_lock held; returns the parent reference to drop.
+ */
+static struct dentry *__d_kill(struct dentry *dentry) {
+  dentry->d_flags |= DCACHE_DEAD;
+  struct dentry *parent = __d_unhash(dentry);
+
+  __d_lru_del(dentry);
+  if (!list_empty(&dentry->i_list))
+    list_del_init(&dentry->i_list);
+  return parent;
+}
+
+static void __d_free(struct dentry *dentry) {
+  if (dentry->d_inode)
+    iput(dentry->d_inode);
+  kfree((void *) dentry->d_name.name);
+  kfree(dentry);
+}
+
+static void dentry_free_workfn(struct work_struct *work) {
+  (void) work;
+  struct llist_node *batch = llist_del_all(&dentry_free_list);
+  struct dentry *dentry, *tmp;
+
+  if (!batch)
+    return;
+
+  /* Lockless walkers may still be looking at the whole batch */
+  synchronize_rcu();
+
+  llist_for_each_entry_safe(dentry, tmp, batch, d_free) {
+    __d_free(dentry);
+  }
+}
+
+/* Free a killed dentry once no lockless walker can reach it */
+static void dentry_free(struct dentry *dentry) {
+  if (!system_wq) {
+    /* Early boot: nobody walks locklessly yet */
+    __d_free(dentry);
+    return;
+  }
+
+  llist_add(&dentry->d_free, &dentry_free_list);
+  schedule_work(&dentry_free_work);
+}
+
+/* Kill unused negative dentries from the cold end of the LRU */
+static void __d_shrink(struct list_head *dispose) {
+  int budget = D_SHRINK_BATCH;
+
+  while (nr_unused > VFS_DCACHE_SIZE && budget-- > 0) {
+    struct dentry *dentry = list_last_entry(&dentry_lru, struct dentry, d_lru);
+    struct dentry *parent = __d_kill(dentry);
+
+    /* d_lru is free now; d_parent is still the reference to drop */
+    dentry->d_parent = parent;
+    list_add(&dentry->d_lru, dispose);
+  }
+}
+
+static void d_dispose(struct list_head *dispose) {
+  struct dentry *dentry, *tmp;
+
+  list_for_each_entry_safe(dentry, tmp, dispose, d_lru) {
+    struct dentry *parent = dentry->d_parent;
+
+    list_del_init(&dentry->d_lru);
+    dentry_free(dentry);
+    dput(parent);
+  }
+}
+
+struct dentry *dget(struct dentry *dentry) {
+  if (dentry) {
+    atomic_inc(&dentry->d_count);
+  }
+  return dentry;
+}
+
+EXPORT_SYMBOL(dget);
+
+bool dget_unless_dead(struct dentry *dentry) {
+  if (atomic_inc_not_zero(&dentry->d_count))
+    return true;
+
+  bool ok = false;
+  spinlock_lock(&dcache_lock);
+  if (!(dentry->d_flags & DCACHE_DEAD)) {
+    __dget_locked(dentry);
+    ok = true;
+  }
+  spinlock_unlock(&dcache_lock);
+  return ok;
+}
+
+EXPORT_SYMBOL(dget_unless_dead);
+
+void dput(struct dentry *dentry) {
+  while (dentry) {
+    if (atomic_add_unless(&dentry->d_count, -1, 1))
+      return;
+
+    spinlock_lock(&dcache_lock);
+    if (!atomic_dec_and_test(&dentry->d_count)) {
+      spinlock_unlock(&dcache_lock);
+      return;
+    }
+
+    if (d_retained(dentry)) {
+      LIST_HEAD(dispose);
+
+      if (!dentry->d_inode) {
+        list_add(&dentry->d_lru, &dentry_lru);
+        dentry->d_flags |= DCACHE_LRU;
+        nr_unused++;
+        __d_shrink(&dispose);
+      }
+      spinlock_unlock(&dcache_lock);
+      d_dispose(&dispose);
+      return;
+    }
+
+    struct dentry *parent = __d_kill(dentry);
+    spinlock_unlock(&dcache_lock);
+
+    dentry_free(dentry);
+    dentry = parent;
+  }
+}
+
+EXPORT_SYMBOL(dput);
+
+/* Called with dcache_lock held */
+static struct dentry *__d_find(struct dentry *parent, const struct qstr *name, uint32_t hash) {
+  struct dentry *dentry;
+
+  list_for_each_entry(dentry, d_hash(parent, hash), d_hash) {
+    if (d_matches(dentry, parent, name, hash))
+      return dentry;
+  }
+  return nullptr;
+}
+
+struct dentry *d_lookup(struct dentry *parent, const struct qstr *name) {
+  uint32_t hash = d_hash_name(name->name, name->len);
+
+  spinlock_lock(&dcache_lock);
+  struct dentry *dentry = __d_find(parent, name, hash);
+  if (dentry)
+    __dget_locked(dentry);
+  spinlock_unlock(&dcache_lock);
+
+  return dentry;
+}
+
+EXPORT_SYMBOL(d_lookup);
+
+struct dentry *__d_lookup_rcu(const struct dentry *parent, const struct qstr *name) {
+  uint32_t hash = d_hash_name(name->name, name->len);
+  struct dentry *dentry;
+
+  list_for_each_entry_rcu(dentry, d_hash(parent, hash), d_hash) {
+    if (d_matches(dentry, parent, name, hash))
+      return dentry;
+  }
+  return nullptr;
+}
+
+EXPORT_SYMBOL(__d_lookup_rcu);
+
+/*
+ * Evict whatever currently answers to @dentry's name under its new parent.
+ * Called with dcache_lock held; unused aliases are killed onto @dispose,
+ * the parent reference of a busy one is returned.
+ */
+static struct dentry *__d_evict_alias(struct dentry *dentry, struct dentry *parent,
+                                      const struct qstr *name, struct list_head *dispose) {
+  struct dentry *alias = __d_find(parent, name, d_hash_name(name->name, name->len));
+
+  if (!alias || alias == dentry)
+    return nullptr;
+
+  if (atomic_read(&alias->d_count) == 0) {
+    alias->d_parent = __d_kill(alias);
+    list_add(&alias->d_lru, dispose);
+    return nullptr;
+  }
+  return __d_unhash(alias);
+}
+
+void d_attach(struct dentry *dentry) {
+  LIST_HEAD(dispose);
+  struct dentry *put = nullptr;
+
+  spinlock_lock(&dcache_lock);
+  if (dentry->d_flags & DCACHE_HASHED) {
+    /* Instantiated in place: lockless walkers may have seen it negative */
+    write_seqlock(&dcache_seq);
+    write_sequnlock(&dcache_seq);
+  } else {
+    put = __d_evict_alias(dentry, dentry->d_parent, &dentry->d_name, &dispose);
+    __d_rehash(dentry);
+  }
+  spinlock_unlock(&dcache_lock);
+
+  d_dispose(&dispose);
+  dput(put);
+}
+
+EXPORT_SYMBOL(d_attach);
+
+void d_drop(struct dentry *dentry) {
+  spinlock_lock(&dcache_lock);
+  struct dentry *parent = __d_unhash(dentry);
+  spinlock_unlock(&dcache_lock);
+
+  dput(parent);
+}
+
+EXPORT_SYMBOL(d_drop);
+
+void d_move(struct dentry *dentry, struct dentry *target) {
+  char *new_name = kstrdup((const char *) target->d_name.name);
+  if (!new_name) {
+    /* Keep the tree consistent: the old name no longer exists */
+    d_drop(dentry);
+    return;
+  }
+
+  LIST_HEAD(dispose);
+  struct dentry *put[3];
+  const unsigned char *old_name;
+
+  spinlock_lock(&dcache_lock);
+  put[0] = __d_unhash(target);
+  put[1] = __d_evict_alias(dentry, target->d_parent, &target->d_name, &dispose);
+  put[2] = __d_unhash(dentry);
+
+  write_seqlock(&dcache_seq);
+  old_name = dentry->d_name.name;
+  WRITE_ONCE(dentry->d_name.name, (const unsigned char *) new_name);
+  dentry->d_name.len = target->d_name.len;
+  dentry->d_name.hash = d_hash_name(dentry->d_name.name, dentry->d_name.len);
+  dentry->d_parent = target->d_parent;
+  write_sequnlock(&dcache_seq);
+
+  __d_rehash(dentry);
+  spinlock_unlock(&dcache_lock);
+
+  d_dispose(&dispose);
+  for (int i = 0; i < 3; i++)
+    dput(put[i]);
+
+  synchronize_rcu();
+  kfree((void *) old_name);
+}
+
+EXPORT_SYMBOL(d_move);
+
+unsigned int dcache_seq_begin(void) {
+  return read_seqbegin(&dcache_seq);
+}
+
+EXPORT_SYMBOL(dcache_seq_begin);
+
+bool dcache_seq_retry(unsigned int seq) {
+  return read_seqretry(&dcache_seq, seq);
+}
+
+EXPORT_SYMBOL(dcache_seq_retry);
+
+void dcache_init(void) {
+  for (uint32_t i = 0; i < D_HASH_SIZE; i++)
+    INIT_LIST_HEAD(&dentry_hashtable[i]);
+}
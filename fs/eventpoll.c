@@ -0,0 +1,757 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file fs/eventpoll.c
+ * @brief epoll: scalable I/O event notification
+ * @copyright (C) 2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <fs/eventpoll.h>
+#include <fs/file.h>
+#include <fs/vfs.h>
+#include <mm/slub.h>
+#include <aerosync/mutex.h>
+#include <aerosync/wait.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/errno.h>
+#include <aerosync/export.h>
+#include <aerosync/signal.h>
+#include <aerosync/timer.h>
+#include <linux/container_of.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <lib/uaccess.h>
+
+#ifdef CONFIG_EPOLL_BENCH
+#include <aerosync/classes.h>
+#include <fs/pipe.h>
+#include <lib/printk.h>
+#endif
+
+/*
+ * Locking, outermost first:
+ *   epmutex         - closing a watched file against freeing an instance
+ *   ep->mtx         - ep_ctl() and event collection on one instance
+ *   ep_file_lock    - file->f_ep lists
+ *   wait queue lock - held by the wakeup that runs ep_poll_callback()
+ *   ep->lock        - the ready list, taken inside the callback
+ */
+
+/* Bits of epitem->event.events that are flags rather than events */
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* What EPOLLEXCLUSIVE may be combined with */
+#define EPOLLEXCLUSIVE_OK_BITS \
+  (EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP | EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Events handed back per epoll_wait() call; the rest stay queued */
+#define EP_WAIT_BATCH 256
+
+struct eventpoll {
+  mutex_t mtx;
+  spinlock_t lock;
+  struct list_head rdllist;    /* Items that may have events */
+  wait_queue_head_t wq;        /* ep_wait() callers, queued exclusive */
+  wait_queue_head_t poll_wait; /* poll() on the epoll file itself */
+  struct rb_root rbr;          /* All items, by (file, fd) */
+  unsigned int nr_items;
+};
+
+/* One wait queue that a watched file's ->poll hooked us into */
+struct eppoll_entry {
+  struct eppoll_entry *next;
+  struct epitem *epi;
+  wait_queue_entry_t wait;
+  wait_queue_head_t *whead;
+};
+
+struct epitem {
+  struct rb_node rbn;
+  struct list_head rdllink;    /* On ep->rdllist (or a collector's list) */
+  struct hlist_node fllink;    /* On file->f_ep */
+  struct eventpoll *ep;
+  struct file *file;
+  int fd;
+  int nwait;                   /* Queues hooked, -1 if one could not be */
+  struct eppoll_entry *pwqlist;
+  struct epoll_event event;
+};
+
+/* The poll_table a watched file sees while being added */
+struct ep_pqueue {
+  poll_table pt;
+  struct epitem *epi;
+};
+
+static DEFINE_MUTEX(epmutex);
+static spinlock_t ep_file_lock = SPINLOCK_INIT;
+
+static struct file_operations eventpoll_fops;
+
+static inline bool is_file_epoll(struct file *file) {
+  return file->f_op == &eventpoll_fops;
+}
+
+/* ========================================================================
+ * Items
+ * ======================================================================== */
+
+static int ep_cmp(struct file *f1, int fd1, struct file *f2, int fd2) {
+  if (f1 != f2)
+    return f1 > f2 ? 1 : -1;
+  return fd1 - fd2;
+}
+
+static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd) {
+  struct rb_node *rbp = ep->rbr.rb_node;
+
+  while (rbp) {
+    struct epitem *epi = rb_entry(rbp, struct epitem, rbn);
+    int cmp = ep_cmp(file, fd, epi->file, epi->fd);
+
+    if (cmp > 0)
+      rbp = rbp->rb_right;
+    else if (cmp < 0)
+      rbp = rbp->rb_left;
+    else
+      return epi;
+  }
+  return nullptr;
+}
+
+static void ep_rbtree_insert(struct eventpoll *ep, struct epitem *epi) {
+  struct rb_node **p = &ep->rbr.rb_node, *parent = nullptr;
+
+  while (*p) {
+    parent = *p;
+    struct epitem *epic = rb_entry(parent, struct epitem, rbn);
+    if (ep_cmp(epi->file, epi->fd, epic->file, epic->fd) > 0)
+      p = &parent->rb_right;
+    else
+      p = &parent->rb_left;
+  }
+  rb_link_node(&epi->rbn, parent, p);
+  rb_insert_color(&epi->rbn, &ep->rbr);
+}
+
+/* Queue @epi and wake a waiter; called with ep->lock held */
+static bool ep_mark_ready(struct eventpoll *ep, struct epitem *epi) {
+  bool woke = false;
+
+  if (list_empty(&epi->rdllink))
+    list_add_tail(&epi->rdllink, &ep->rdllist);
+
+  if (waitqueue_active(&ep->wq)) {
+    wake_up(&ep->wq);
+    woke = true;
+  }
+  if (waitqueue_active(&ep->poll_wait))
+    wake_up_all(&ep->poll_wait);
+
+  return woke;
+}
+
+/*
+ * Runs from the watched file's wakeup, under its wait queue lock and
+ * possibly in interrupt context. Only queues the item: the file is polled
+ * again when the events are collected.
+ */
+static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key) {
+  struct eppoll_entry *pwq = container_of(wait, struct eppoll_entry, wait);
+  struct epitem *epi = pwq->epi;
+  struct eventpoll *ep = epi->ep;
+  uint32_t pollflags = (uint32_t) (uintptr_t) key;
+  int ewake = 0;
+  (void) mode;
+  (void) sync;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+
+  /* Disarmed by EPOLLONESHOT until EPOLL_CTL_MOD */
+  if (!(epi->event.events & ~EP_PRIVATE_BITS))
+    goto out;
+
+  /* Keyed wakeups tell us what happened; skip what nobody asked for */
+  if (pollflags && !(pollflags & epi->event.events))
+    goto out;
+
+  ewake = ep_mark_ready(ep, epi);
+
+out:
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  /*
+   * An exclusive entry only consumes the wakeup if it woke a waiter, so
+   * the file's wakeup moves on to the next instance when this one is busy.
+   */
+  if (!(epi->event.events & EPOLLEXCLUSIVE))
+    ewake = 1;
+  return ewake;
+}
+
+static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead, poll_table *pt) {
+  struct ep_pqueue *epq = container_of(pt, struct ep_pqueue, pt);
+  struct epitem *epi = epq->epi;
+  (void) file;
+
+  if (epi->nwait < 0)
+    return;
+
+  struct eppoll_entry *pwq = kmalloc(sizeof(*pwq));
+  if (!pwq) {
+    epi->nwait = -1;
+    return;
+  }
+
+  init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
+  pwq->whead = whead;
+  pwq->epi = epi;
+  if (epi->event.events & EPOLLEXCLUSIVE)
+    add_wait_queue_exclusive(whead, &pwq->wait);
+  else
+    add_wait_queue(whead, &pwq->wait);
+
+  pwq->next = epi->pwqlist;
+  epi->pwqlist = pwq;
+  epi->nwait++;
+}
+
+static uint32_t ep_item_poll(struct epitem *epi, poll_table *pt) {
+  return vfs_poll(epi->file, pt) & epi->event.events;
+}
+
+/* Once this returns, ep_poll_callback() can no longer run for @epi */
+static void ep_unregister_pollwait(struct epitem *epi) {
+  struct eppoll_entry *pwq = epi->pwqlist;
+
+  while (pwq) {
+    struct eppoll_entry *next = pwq->next;
+    remove_wait_queue(pwq->whead, &pwq->wait);
+    kfree(pwq);
+    pwq = next;
+  }
+  epi->pwqlist = nullptr;
+}
+
+/* Called with ep->mtx held */
+static void ep_remove(struct eventpoll *ep, struct epitem *epi) {
+  ep_unregister_pollwait(epi);
+
+  spinlock_lock(&ep_file_lock);
+  hlist_del_init(&epi->fllink);
+  spinlock_unlock(&ep_file_lock);
+
+  rb_erase(&epi->rbn, &ep->rbr);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+  if (!list_empty(&epi->rdllink))
+    list_del_init(&epi->rdllink);
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  ep->nr_items--;
+  kfree(epi);
+}
+
+/* Called with ep->mtx held */
+static int ep_insert(struct eventpoll *ep, const struct epoll_event *event, struct file *file,
+                     int fd) {
+  struct epitem *epi = kzalloc(sizeof(*epi));
+  if (!epi)
+    return -ENOMEM;
+
+  INIT_LIST_HEAD(&epi->rdllink);
+  epi->ep = ep;
+  epi->file = file;
+  epi->fd = fd;
+  epi->event = *event;
+
+  spinlock_lock(&ep_file_lock);
+  hlist_add_head(&epi->fllink, &file->f_ep);
+  spinlock_unlock(&ep_file_lock);
+
+  ep_rbtree_insert(ep, epi);
+  ep->nr_items++;
+
+  /* Hooks us into the file's wait queues and tells us where it stands */
+  struct ep_pqueue epq = {.pt = {._qproc = ep_ptable_queue_proc}, .epi = epi};
+  uint32_t revents = ep_item_poll(epi, &epq.pt);
+
+  if (epi->nwait < 0) {
+    ep_remove(ep, epi);
+    return -ENOMEM;
+  }
+
+  if (revents) {
+    irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+    ep_mark_ready(ep, epi);
+    spinlock_unlock_irqrestore(&ep->lock, flags);
+  }
+
+  return 0;
+}
+
+/* Called with ep->mtx held */
+static int ep_modify(struct eventpoll *ep, struct epitem *epi, const struct epoll_event *event) {
+  irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+  epi->event = *event;
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  /* Rearming may find the file already ready: report it, edge or not */
+  if (ep_item_poll(epi, nullptr)) {
+    flags = spinlock_lock_irqsave(&ep->lock);
+    ep_mark_ready(ep, epi);
+    spinlock_unlock_irqrestore(&ep->lock, flags);
+  }
+
+  return 0;
+}
+
+/* ========================================================================
+ * Instances
+ * ======================================================================== */
+
+struct eventpoll *ep_alloc(void) {
+  struct eventpoll *ep = kzalloc(sizeof(*ep));
+  if (!ep)
+    return nullptr;
+
+  mutex_init(&ep->mtx);
+  spinlock_init(&ep->lock);
+  INIT_LIST_HEAD(&ep->rdllist);
+  init_waitqueue_head(&ep->wq);
+  init_waitqueue_head(&ep->poll_wait);
+  ep->rbr = RB_ROOT;
+  return ep;
+}
+EXPORT_SYMBOL(ep_alloc);
+
+void ep_free(struct eventpoll *ep) {
+  struct rb_node *rbp;
+
+  mutex_lock(&epmutex);
+  mutex_lock(&ep->mtx);
+  while ((rbp = rb_first(&ep->rbr)))
+    ep_remove(ep, rb_entry(rbp, struct epitem, rbn));
+  mutex_unlock(&ep->mtx);
+  mutex_unlock(&epmutex);
+
+  kfree(ep);
+}
+EXPORT_SYMBOL(ep_free);
+
+void eventpoll_release_file(struct file *file) {
+  mutex_lock(&epmutex);
+  for (;;) {
+    spinlock_lock(&ep_file_lock);
+    struct hlist_node *node = file->f_ep.first;
+    spinlock_unlock(&ep_file_lock);
+    if (!node)
+      break;
+
+    /* epmutex keeps the instance alive while we take its mutex */
+    struct epitem *epi = hlist_entry(node, struct epitem, fllink);
+    struct eventpoll *ep = epi->ep;
+    mutex_lock(&ep->mtx);
+    ep_remove(ep, epi);
+    mutex_unlock(&ep->mtx);
+  }
+  mutex_unlock(&epmutex);
+}
+
+int ep_ctl(struct eventpoll *ep, int op, int fd, struct file *file, struct epoll_event *event) {
+  struct epoll_event epds = {};
+  int error;
+
+  /* Without ->poll there is no wait queue to hook */
+  if (!file->f_op || !file->f_op->poll)
+    return -EPERM;
+
+  /* Nesting would need loop and depth checks; not supported */
+  if (is_file_epoll(file))
+    return -EINVAL;
+
+  if (op != EPOLL_CTL_DEL) {
+    if (!event)
+      return -EFAULT;
+    epds = *event;
+
+    if (epds.events & EPOLLEXCLUSIVE) {
+      if (op == EPOLL_CTL_MOD)
+        return -EINVAL;
+      if (epds.events & ~EPOLLEXCLUSIVE_OK_BITS)
+        return -EINVAL;
+    }
+
+    /* Always reported, whether asked for or not */
+    epds.events |= EPOLLERR | EPOLLHUP;
+  }
+
+  mutex_lock(&ep->mtx);
+  struct epitem *epi = ep_find(ep, file, fd);
+
+  switch (op) {
+    case EPOLL_CTL_ADD:
+      error = epi ? -EEXIST : ep_insert(ep, &epds, file, fd);
+      break;
+    case EPOLL_CTL_DEL:
+      error = -ENOENT;
+      if (epi) {
+        ep_remove(ep, epi);
+        error = 0;
+      }
+      break;
+    case EPOLL_CTL_MOD:
+      error = -ENOENT;
+      if (epi)
+        error = (epi->event.events & EPOLLEXCLUSIVE) ? -EINVAL : ep_modify(ep, epi, &epds);
+      break;
+    default:
+      error = -EINVAL;
+      break;
+  }
+
+  mutex_unlock(&ep->mtx);
+  return error;
+}
+EXPORT_SYMBOL(ep_ctl);
+
+/*
+ * Move queued items to a private list and poll each one. An item is taken
+ * off that list before it is polled, so a wakeup racing with the poll
+ * queues it again instead of being lost. Level-triggered items that still
+ * have events go back on the ready list for the next call.
+ */
+static int ep_send_events(struct eventpoll *ep, struct epoll_event *events, int maxevents) {
+  LIST_HEAD(txlist);
+  int res = 0;
+
+  mutex_lock(&ep->mtx);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+  list_splice_init(&ep->rdllist, &txlist);
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  while (!list_empty(&txlist) && res < maxevents) {
+    struct epitem *epi = list_first_entry(&txlist, struct epitem, rdllink);
+
+    flags = spinlock_lock_irqsave(&ep->lock);
+    list_del_init(&epi->rdllink);
+    spinlock_unlock_irqrestore(&ep->lock, flags);
+
+    uint32_t revents = ep_item_poll(epi, nullptr);
+    if (!revents)
+      continue;
+
+    events[res].events = revents;
+    events[res].data = epi->event.data;
+    res++;
+
+    flags = spinlock_lock_irqsave(&ep->lock);
+    if (epi->event.events & EPOLLONESHOT)
+      epi->event.events &= EP_PRIVATE_BITS;
+    else if (!(epi->event.events & EPOLLET) && list_empty(&epi->rdllink))
+      list_add_tail(&epi->rdllink, &ep->rdllist);
+    spinlock_unlock_irqrestore(&ep->lock, flags);
+  }
+
+  /* Whatever did not fit goes back first in line */
+  flags = spinlock_lock_irqsave(&ep->lock);
+  list_splice(&txlist, &ep->rdllist);
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  mutex_unlock(&ep->mtx);
+  return res;
+}
+
+int ep_wait(struct eventpoll *ep, struct epoll_event *events, int maxevents,
+            uint64_t timeout_ns) {
+  uint64_t deadline = 0;
+
+  if (timeout_ns && timeout_ns != (uint64_t) -1)
+    deadline = get_time_ns() + timeout_ns;
+
+  for (;;) {
+    int res = ep_send_events(ep, events, maxevents);
+    if (res || !timeout_ns)
+      return res;
+
+    if (signal_pending(current))
+      return -EINTR;
+
+    /* Exclusive: one event wakes one waiter, not every thread in the loop */
+    DECLARE_WAITQUEUE(wait, current);
+    add_wait_queue_exclusive(&ep->wq, &wait);
+    set_current_state(TASK_INTERRUPTIBLE);
+
+    irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+    bool eavail = !list_empty(&ep->rdllist);
+    spinlock_unlock_irqrestore(&ep->lock, flags);
+
+    bool timed_out = false;
+    if (!eavail && !signal_pending(current)) {
+      if (deadline) {
+        uint64_t now = get_time_ns();
+        if (now >= deadline)
+          timed_out = true;
+        else
+          schedule_hrtimeout(deadline - now);
+      } else {
+        schedule();
+      }
+    }
+
+    __set_current_state(TASK_RUNNING);
+    remove_wait_queue(&ep->wq, &wait);
+
+    if (timed_out)
+      return 0;
+  }
+}
+EXPORT_SYMBOL(ep_wait);
+
+/* ========================================================================
+ * The epoll file
+ * ======================================================================== */
+
+static uint32_t ep_eventpoll_poll(struct file *file, poll_table *pt) {
+  struct eventpoll *ep = file->private_data;
+
+  poll_wait(file, &ep->poll_wait, pt);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&ep->lock);
+  bool ready = !list_empty(&ep->rdllist);
+  spinlock_unlock_irqrestore(&ep->lock, flags);
+
+  return ready ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static int ep_eventpoll_release(struct inode *inode, struct file *file) {
+  (void) inode;
+  ep_free(file->private_data);
+  return 0;
+}
+
+static struct file_operations eventpoll_fops = {
+  .poll = ep_eventpoll_poll,
+  .release = ep_eventpoll_release,
+};
+
+/* ========================================================================
+ * System calls
+ * ======================================================================== */
+
+int sys_epoll_create1(int flags) {
+  if (flags & ~EPOLL_CLOEXEC)
+    return -EINVAL;
+
+  struct eventpoll *ep = ep_alloc();
+  if (!ep)
+    return -ENOMEM;
+
+  struct file *file = kzalloc(sizeof(struct file));
+  if (!file) {
+    ep_free(ep);
+    return -ENOMEM;
+  }
+
+  atomic_set(&file->f_count, 1);
+  file->f_op = &eventpoll_fops;
+  file->private_data = ep;
+  file->f_mode = FMODE_READ;
+  file->f_flags = O_RDWR;
+
+  int fd = get_unused_fd_flags(flags);
+  if (fd < 0) {
+    fput(file);
+    return fd;
+  }
+
+  fd_install(fd, file);
+  return fd;
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+  struct epoll_event epds;
+
+  if (op != EPOLL_CTL_DEL && copy_from_user(&epds, event, sizeof(epds)))
+    return -EFAULT;
+
+  struct file *file = fget(epfd);
+  if (!file)
+    return -EBADF;
+
+  struct file *tfile = fget(fd);
+  if (!tfile) {
+    fput(file);
+    return -EBADF;
+  }
+
+  int error = -EINVAL;
+  if (is_file_epoll(file))
+    error = ep_ctl(file->private_data, op, fd, tfile, &epds);
+
+  fput(tfile);
+  fput(file);
+  return error;
+}
+
+int sys_epoll_pwait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms,
+                    const sigset_t *sigmask, size_t sigsetsize) {
+  sigset_t ksigmask = 0, saved = 0;
+
+  if (maxevents <= 0 || (size_t) maxevents > EP_MAX_EVENTS)
+    return -EINVAL;
+  if (!access_ok(events, (size_t) maxevents * sizeof(struct epoll_event)))
+    return -EFAULT;
+
+  if (sigmask) {
+    if (sigsetsize != sizeof(sigset_t))
+      return -EINVAL;
+    if (copy_from_user(&ksigmask, sigmask, sizeof(sigset_t)))
+      return -EFAULT;
+    ksigmask &= ~(sigmask(SIGKILL) | sigmask(SIGSTOP));
+  }
+
+  struct file *file = fget(epfd);
+  if (!file)
+    return -EBADF;
+  if (!is_file_epoll(file)) {
+    fput(file);
+    return -EINVAL;
+  }
+
+  int batch = maxevents < EP_WAIT_BATCH ? maxevents : EP_WAIT_BATCH;
+  struct epoll_event *kevents = kmalloc((size_t) batch * sizeof(struct epoll_event));
+  if (!kevents) {
+    fput(file);
+    return -ENOMEM;
+  }
+
+  uint64_t timeout_ns = (uint64_t) -1;
+  if (timeout_ms >= 0)
+    timeout_ns = (uint64_t) timeout_ms * 1000000ULL;
+
+  /*
+   * The caller's mask comes back before we return, so a signal that only
+   * @sigmask unblocked stays pending rather than being delivered here.
+   */
+  if (sigmask) {
+    saved = current->blocked;
+    current->blocked = ksigmask;
+  }
+
+  int res = ep_wait(file->private_data, kevents, batch, timeout_ns);
+
+  if (sigmask)
+    current->blocked = saved;
+
+  if (res > 0 && copy_to_user(events, kevents, (size_t) res * sizeof(struct epoll_event)))
+    res = -EFAULT;
+
+  kfree(kevents);
+  fput(file);
+  return res;
+}
+
+#ifdef CONFIG_EPOLL_BENCH
+
+#define EPOLL_BENCH_MAX_PIPES 10000
+#define EPOLL_BENCH_ACTIVE    4
+#define EPOLL_BENCH_ROUNDS    1000
+
+static const int epoll_bench_sizes[] = {10, 100, 1000, EPOLL_BENCH_MAX_PIPES};
+
+/*
+ * Watches a growing set of pipes and makes the same few active each round.
+ * epoll_wait() cost should stay flat; the scan column is what poll() pays
+ * per wakeup, one ->poll call per watched file.
+ */
+void epoll_bench(void) {
+  struct file **pipes = kzalloc(2 * EPOLL_BENCH_MAX_PIPES * sizeof(struct file *));
+  struct eventpoll *ep = ep_alloc();
+  struct epoll_event events[EPOLL_BENCH_ACTIVE * 2];
+  int nr_pipes = 0;
+
+  if (!pipes || !ep) {
+    printk(KERN_ERR VFS_CLASS "epollbench: out of memory\n");
+    goto out;
+  }
+
+  for (size_t s = 0; s < sizeof(epoll_bench_sizes) / sizeof(epoll_bench_sizes[0]); s++) {
+    int size = epoll_bench_sizes[s];
+
+    while (nr_pipes < size) {
+      struct file **pair = &pipes[2 * nr_pipes];
+      struct epoll_event ev = {.events = EPOLLIN, .data = (uint64_t) nr_pipes};
+
+      if (create_pipe_files(pair))
+        goto fail;
+      nr_pipes++;
+      if (ep_ctl(ep, EPOLL_CTL_ADD, nr_pipes - 1, pair[0], &ev))
+        goto fail;
+    }
+
+    uint64_t wait_ns = 0, scan_ns = 0;
+    int missed = 0;
+
+    for (int r = 0; r < EPOLL_BENCH_ROUNDS; r++) {
+      char c = 'x';
+
+      for (int a = 0; a < EPOLL_BENCH_ACTIVE; a++) {
+        struct file *wr = pipes[2 * ((a * size / EPOLL_BENCH_ACTIVE + r) % size) + 1];
+        vfs_loff_t pos = 0;
+        kernel_write(wr, &c, 1, &pos);
+      }
+
+      uint64_t t0 = get_time_ns();
+      int n = ep_wait(ep, events, EPOLL_BENCH_ACTIVE * 2, 0);
+      wait_ns += get_time_ns() - t0;
+
+      t0 = get_time_ns();
+      for (int i = 0; i < size; i++)
+        vfs_poll(pipes[2 * i], nullptr);
+      scan_ns += get_time_ns() - t0;
+
+      if (n != EPOLL_BENCH_ACTIVE)
+        missed++;
+
+      /* Drain, so level-triggered items drop off on the next pass */
+      for (int i = 0; i < n; i++) {
+        vfs_loff_t pos = 0;
+        kernel_read(pipes[2 * events[i].data], &c, 1, &pos);
+      }
+      ep_wait(ep, events, EPOLL_BENCH_ACTIVE * 2, 0);
+    }
+
+    printk(KERN_INFO VFS_CLASS
+           "epollbench: %5d pipes, %d active: epoll_wait %llu ns, poll scan %llu ns%s\n",
+           size, EPOLL_BENCH_ACTIVE, wait_ns / EPOLL_BENCH_ROUNDS,
+           scan_ns / EPOLL_BENCH_ROUNDS, missed ? " (missed events)" : "");
+  }
+  goto out;
+
+fail:
+  printk(KERN_ERR VFS_CLASS "epollbench: stopped at %d pipes\n", nr_pipes);
+out:
+  if (ep)
+    ep_free(ep);
+  if (pipes) {
+    for (int i = 0; i < 2 * nr_pipes; i++)
+      fput(pipes[i]);
+    kfree(pipes);
+  }
+}
+
+#endif /* CONFIG_EPOLL_BENCH */
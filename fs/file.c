@@ -20,6 +20,7 @@
 
 #include <fs/vfs.h>
 #include <fs/file.h>
+#include <fs/pipe.h>
 #include <mm/slub.h>
 #include <aerosync/sched/sched.h>
 #include <aerosync/spinlock.h>
@@ -136,6 +137,15 @@ int sys_fcntl(int fd, unsigned int cmd, unsigned long arg) {
     return -EBADF;
   }
 
+  /* May sleep and allocate, so not under file_lock */
+  if (cmd == F_SETPIPE_SZ || cmd == F_GETPIPE_SZ) {
+    struct file *file = fget(fd);
+    if (!file) return -EBADF;
+    long pret = pipe_fcntl(file, cmd, arg);
+    fput(file);
+    return (int) pret;
+  }
+
   int ret = -EINVAL;
   spinlock_lock(&files->file_lock);
 
@@ -16,6 +16,7 @@
 #include <fs/fs_struct.h>
 #include <aerosync/errno.h>
 #include <aerosync/export.h>
+#include <aerosync/rcu.h>
 
 struct dentry *root_dentry = nullptr;
 
@@ -51,8 +52,7 @@ int vfs_create(struct inode *dir, struct dentry *dentry, vfs_mode_t mode) {
 
   int ret = dir->i_op->create(dir, dentry, mode);
   if (ret == 0) {
-    if (list_empty(&dentry->d_child))
-        list_add_tail(&dentry->d_child, &dentry->d_parent->d_subdirs);
+    d_attach(dentry);
     vfs_notify_change(dentry, VFS_EVENT_CREATE);
   }
   return ret;
@@ -66,8 +66,7 @@ int vfs_mkdir(struct inode *dir, struct dentry *dentry, vfs_mode_t mode) {
 
   int ret = dir->i_op->mkdir(dir, dentry, mode);
   if (ret == 0) {
-    if (list_empty(&dentry->d_child))
-        list_add_tail(&dentry->d_child, &dentry->d_parent->d_subdirs);
+    d_attach(dentry);
     vfs_notify_change(dentry, VFS_EVENT_CREATE);
   }
   return ret;
@@ -80,9 +79,8 @@ int vfs_mknod(struct inode *dir, struct dentry *dentry, vfs_mode_t mode, dev_t d
     return -EPERM;
 
   int ret = dir->i_op->create(dir, dentry, mode);
-  if (ret == 0 && list_empty(&dentry->d_child)) {
-    list_add_tail(&dentry->d_child, &dentry->d_parent->d_subdirs);
-  }
+  if (ret == 0)
+    d_attach(dentry);
   return ret;
 }
 
@@ -95,8 +93,7 @@ int vfs_unlink(struct inode *dir, struct dentry *dentry) {
   int ret = dir->i_op->unlink(dir, dentry);
   if (ret == 0) {
     vfs_notify_change(dentry, VFS_EVENT_DELETE);
-    if (!list_empty(&dentry->d_child))
-      list_del_init(&dentry->d_child);
+    d_drop(dentry);
   }
   return ret;
 }
@@ -110,8 +107,7 @@ int vfs_rmdir(struct inode *dir, struct dentry *dentry) {
   int ret = dir->i_op->rmdir(dir, dentry);
   if (ret == 0) {
     vfs_notify_change(dentry, VFS_EVENT_DELETE);
-    if (!list_empty(&dentry->d_child))
-      list_del_init(&dentry->d_child);
+    d_drop(dentry);
   }
   return ret;
 }
@@ -128,12 +124,8 @@ int vfs_rename(struct inode *old_dir, struct dentry *old_dentry,
     vfs_notify_change(old_dentry, VFS_EVENT_DELETE);
     vfs_notify_change(new_dentry, VFS_EVENT_CREATE);
 
-    /* Update parent and subdirs list */
-    if (!list_empty(&old_dentry->d_child))
-      list_del_init(&old_dentry->d_child);
-    
-    old_dentry->d_parent = new_dentry->d_parent;
-    list_add_tail(&old_dentry->d_child, &old_dentry->d_parent->d_subdirs);
+    /* Rehash under the new name and parent */
+    d_move(old_dentry, new_dentry);
   }
   return ret;
 }
@@ -146,8 +138,7 @@ int vfs_symlink(struct inode *dir, struct dentry *dentry, const char *oldname) {
 
   int ret = dir->i_op->symlink(dir, dentry, oldname);
   if (ret == 0) {
-    if (list_empty(&dentry->d_child))
-        list_add_tail(&dentry->d_child, &dentry->d_parent->d_subdirs);
+    d_attach(dentry);
     vfs_notify_change(dentry, VFS_EVENT_CREATE);
   }
   return ret;
@@ -224,8 +215,95 @@ static const char *get_next_component(const char *path, char *name) {
   return path;
 }
 
+/*
+ * RCU-walk: resolve @path from the dentry cache alone, without touching
+ * reference counts, and validate the result against the dcache sequence.
+ * Anything the cache cannot answer (a miss, a symlink to follow, a racing
+ * rename) makes it give up, and the caller falls back to the ref-walk.
+ * @return true if *@result is the answer, possibly nullptr for not-found
+ */
+static bool rcu_path_walk(const char *path, unsigned int flags, struct dentry **result) {
+  char component[256];
+  const char *next = path;
+  struct dentry *curr;
+  bool done = false;
+
+  rcu_read_lock();
+  unsigned int seq = dcache_seq_begin();
+
+  if (path[0] != '/' && current && current->fs && current->fs->pwd)
+    curr = READ_ONCE(current->fs->pwd);
+  else
+    curr = READ_ONCE(root_dentry);
+  if (!curr)
+    goto out;
+
+  while ((next = get_next_component(next, component)) != nullptr) {
+    char next_comp[256];
+    bool last = get_next_component(next, next_comp) == nullptr;
+
+    if (last && (flags & LOOKUP_PARENT))
+      goto found; /* Like the ref-walk, the parent is returned as is */
+
+    if (strcmp(component, ".") == 0)
+      continue;
+
+    if (strcmp(component, "..") == 0) {
+      struct dentry *parent = READ_ONCE(curr->d_parent);
+      if (parent)
+        curr = parent;
+      continue;
+    }
+
+    curr = follow_mount(curr);
+
+    struct inode *dir = READ_ONCE(curr->d_inode);
+    if (!dir || !dir->i_op || !dir->i_op->lookup) {
+      /* Negative or not a directory: a definitive miss if nothing moved */
+      if (!dcache_seq_retry(seq)) {
+        *result = nullptr;
+        done = true;
+      }
+      goto out;
+    }
+
+    struct qstr qname = {.name = (const unsigned char *) component, .len = (uint32_t) strlen(component)};
+    struct dentry *child = __d_lookup_rcu(curr, &qname);
+    if (!child)
+      goto out;
+
+    struct inode *inode = READ_ONCE(child->d_inode);
+    if (inode && S_ISLNK(inode->i_mode) && (!last || (flags & LOOKUP_FOLLOW)))
+      goto out;
+
+    curr = child;
+  }
+
+  curr = follow_mount(curr);
+found:
+  if (!dget_unless_dead(curr))
+    goto out;
+  if (dcache_seq_retry(seq)) {
+    rcu_read_unlock();
+    dput(curr);
+    return false;
+  }
+
+  *result = curr;
+  done = true;
+out:
+  rcu_read_unlock();
+  return done;
+}
+
 struct dentry *vfs_path_lookup(const char *path, unsigned int flags) {
+  struct dentry *dentry;
   int depth = 0;
+
+  if (!path) return nullptr;
+
+  if (rcu_path_walk(path, flags, &dentry))
+    return dentry;
   return link_path_walk(path, flags, &depth);
 }
 
@@ -289,20 +367,9 @@ static struct dentry *link_path_walk(const char *path, unsigned int flags, int *
 
     struct qstr qname = {.name = (const unsigned char *) component, .len = (uint32_t) strlen(component)};
 
-    /* Check if it's already in dentry cache subdirs */
-    struct dentry *child;
-    bool found = false;
-    list_for_each_entry(child, &curr->d_subdirs, d_child) {
-      if (strcmp((const char *) child->d_name.name, component) == 0) {
-        struct dentry *old = curr;
-        curr = dget(child);
-        dput(old);
-        found = true;
-        break;
-      }
-    }
+    struct dentry *child = d_lookup(curr, &qname);
 
-    if (!found) {
+    if (!child) {
       struct dentry *new_dentry = d_alloc_pseudo(curr->d_inode->i_sb, &qname);
       if (!new_dentry) {
         dput(curr);
@@ -320,18 +387,16 @@ static struct dentry *link_path_walk(const char *path, unsigned int flags, int *
 
       if (result != new_dentry) {
         dput(new_dentry);
-        struct dentry *old = curr;
-        curr = dget(result);
-        dput(old);
+        child = dget(result);
       } else {
-        list_add_tail(&new_dentry->d_child, &curr->d_subdirs);
-        struct dentry *old = curr;
-        curr = dget(new_dentry);
-        dput(old);
-        dput(new_dentry);
+        d_attach(new_dentry);
+        child = new_dentry;
       }
     }
 
+    dput(curr);
+    curr = child;
+
     /* If it's a symlink, follow it unless it's the last component and !LOOKUP_FOLLOW */
     if (curr->d_inode && S_ISLNK(curr->d_inode->i_mode)) {
       const char *peek = next;
@@ -362,9 +427,17 @@ struct dentry *d_alloc_pseudo(struct super_block *sb, const struct qstr *name) {
   if (!dentry) return nullptr;
 
   dentry->d_name.name = (unsigned char *) kstrdup((const char *) name->name);
+  if (!dentry->d_name.name) {
+    kfree(dentry);
+    return nullptr;
+  }
   dentry->d_name.len = name->len;
+  dentry->d_name.hash = d_hash_name(name->name, name->len);
+  dentry->d_sb = sb;
   spinlock_init(&dentry->d_lock);
   atomic_set(&dentry->d_count, 1);
+  INIT_LIST_HEAD(&dentry->d_hash);
+  INIT_LIST_HEAD(&dentry->d_lru);
   INIT_LIST_HEAD(&dentry->d_subdirs);
   INIT_LIST_HEAD(&dentry->d_child);
   INIT_LIST_HEAD(&dentry->i_list);
@@ -20,64 +20,151 @@
 
 #include <fs/vfs.h>
 #include <fs/file.h>
+#include <fs/pipe.h>
 #include <mm/slub.h>
+#include <mm/page.h>
+#include <mm/zone.h>
 #include <aerosync/mutex.h>
 #include <aerosync/wait.h>
 #include <aerosync/errno.h>
+#include <aerosync/export.h>
+#include <lib/string.h>
 #include <lib/uaccess.h>
 
-#define PIPE_BUF_SIZE 65536
-
-struct pipe_inode_info {
-  mutex_t lock;
-  wait_queue_head_t rd_wait;
-  wait_queue_head_t wr_wait;
-  char *buffer;
-  uint32_t head;
-  uint32_t tail;
-  uint32_t readers;
-  uint32_t writers;
-};
+static struct file_operations pipe_rd_fops;
+static struct file_operations pipe_wr_fops;
+
+struct pipe_inode_info *get_pipe_info(struct file *file) {
+  if (file && (file->f_op == &pipe_rd_fops || file->f_op == &pipe_wr_fops))
+    return file->private_data;
+  return nullptr;
+}
+EXPORT_SYMBOL(get_pipe_info);
+
+void pipe_buf_release(struct pipe_inode_info *pipe, struct pipe_buffer *buf) {
+  struct page *page = buf->page;
+
+  buf->page = nullptr;
+  /* Recycle our own page if nobody else (tee, splice) still looks at it */
+  if ((buf->flags & PIPE_BUF_FLAG_CAN_MERGE) && !pipe->tmp_page &&
+      page_ref_count(page) == 1)
+    pipe->tmp_page = page;
+  else
+    put_page(page);
+}
+EXPORT_SYMBOL(pipe_buf_release);
+
+static struct page *pipe_alloc_page(struct pipe_inode_info *pipe) {
+  struct page *page = pipe->tmp_page;
+
+  if (page) {
+    pipe->tmp_page = nullptr;
+    return page;
+  }
+  struct folio *folio = alloc_page(GFP_KERNEL);
+  return folio ? &folio->page : nullptr;
+}
+
+static bool pipe_readable(const struct pipe_inode_info *pipe) {
+  return !pipe_empty(pipe) || __atomic_load_n(&pipe->writers, __ATOMIC_RELAXED) == 0;
+}
+
+static bool pipe_writable(const struct pipe_inode_info *pipe) {
+  return !pipe_full(pipe) || __atomic_load_n(&pipe->readers, __ATOMIC_RELAXED) == 0;
+}
+
+int pipe_wait_readable(struct pipe_inode_info *pipe, bool nonblock) {
+  while (pipe_empty(pipe) && pipe->writers) {
+    if (nonblock)
+      return -EAGAIN;
+    mutex_unlock(&pipe->lock);
+    int ret = wait_event_interruptible(pipe->rd_wait, pipe_readable(pipe));
+    mutex_lock(&pipe->lock);
+    if (ret)
+      return -EINTR;
+  }
+  return 0;
+}
+EXPORT_SYMBOL(pipe_wait_readable);
+
+int pipe_wait_writable(struct pipe_inode_info *pipe, bool nonblock) {
+  for (;;) {
+    if (!pipe->readers)
+      return -EPIPE;
+    if (!pipe_full(pipe))
+      return 0;
+    if (nonblock)
+      return -EAGAIN;
+    mutex_unlock(&pipe->lock);
+    int ret = wait_event_interruptible(pipe->wr_wait, pipe_writable(pipe));
+    mutex_lock(&pipe->lock);
+    if (ret)
+      return -EINTR;
+  }
+}
+EXPORT_SYMBOL(pipe_wait_writable);
 
 static void free_pipe_info(struct pipe_inode_info *pipe) {
   if (!pipe) return;
-  if (pipe->buffer) kfree(pipe->buffer);
+  if (pipe->bufs) {
+    while (!pipe_empty(pipe)) {
+      struct pipe_buffer *buf = pipe_buf(pipe, pipe->tail++);
+      if (buf->page) put_page(buf->page);
+    }
+    kfree(pipe->bufs);
+  }
+  if (pipe->tmp_page) put_page(pipe->tmp_page);
   kfree(pipe);
 }
 
+static int pipe_copy_out(struct file *file, char *dst, const void *src, size_t n) {
+  if (file->f_mode & FMODE_KERNEL) {
+    memcpy(dst, src, n);
+    return 0;
+  }
+  return copy_to_user(dst, src, n) ? -EFAULT : 0;
+}
+
+static int pipe_copy_in(struct file *file, void *dst, const char *src, size_t n) {
+  if (file->f_mode & FMODE_KERNEL) {
+    memcpy(dst, src, n);
+    return 0;
+  }
+  return copy_from_user(dst, src, n) ? -EFAULT : 0;
+}
+
 static ssize_t pipe_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
   (void) ppos;
   struct pipe_inode_info *pipe = file->private_data;
   ssize_t ret = 0;
 
+  if (!count)
+    return 0;
+
   mutex_lock(&pipe->lock);
-  while (pipe->head == pipe->tail) {
-    if (pipe->writers == 0) {
-      mutex_unlock(&pipe->lock);
-      return 0;
-    }
-    if (file->f_flags & O_NONBLOCK) {
-      mutex_unlock(&pipe->lock);
-      return -EAGAIN;
-    }
+  int err = pipe_wait_readable(pipe, file->f_flags & O_NONBLOCK);
+  if (err) {
     mutex_unlock(&pipe->lock);
-    wait_event_interruptible(pipe->rd_wait, pipe->head != pipe->tail || pipe->writers == 0);
-    mutex_lock(&pipe->lock);
+    return err;
   }
 
-  size_t available = (pipe->head - pipe->tail) % PIPE_BUF_SIZE;
-  if (count > available) count = available;
+  /* One bulk copy per slot; return whatever was there, like any pipe */
+  while ((size_t) ret < count && !pipe_empty(pipe)) {
+    struct pipe_buffer *pbuf = pipe_buf(pipe, pipe->tail);
+    size_t n = count - ret < pbuf->len ? count - ret : pbuf->len;
 
-  for (size_t i = 0; i < count; i++) {
-    char c = pipe->buffer[pipe->tail];
-    if (file->f_mode & FMODE_KERNEL) {
-      buf[i] = c;
-    } else if (copy_to_user(buf + i, &c, 1) != 0) {
+    if (pipe_copy_out(file, buf + ret, page_address(pbuf->page) + pbuf->offset, n)) {
       if (ret == 0) ret = -EFAULT;
       break;
     }
-    pipe->tail = (pipe->tail + 1) % PIPE_BUF_SIZE;
-    ret++;
+    pbuf->offset += n;
+    pbuf->len -= n;
+    ret += n;
+
+    if (!pbuf->len) {
+      pipe_buf_release(pipe, pbuf);
+      pipe->tail++;
+    }
   }
 
   if (ret > 0)
@@ -89,42 +176,74 @@ static ssize_t pipe_read(struct file *file, char *buf, size_t count, vfs_loff_t
 static ssize_t pipe_write(struct file *file, const char *buf, size_t count, vfs_loff_t *ppos) {
   (void) ppos;
   struct pipe_inode_info *pipe = file->private_data;
+  bool nonblock = file->f_flags & O_NONBLOCK;
   ssize_t ret = 0;
 
+  if (!count)
+    return 0;
+
   mutex_lock(&pipe->lock);
-  if (pipe->readers == 0) {
-    mutex_unlock(&pipe->lock);
-    return -EPIPE;
-  }
+  while ((size_t) ret < count) {
+    size_t left = count - ret;
 
-  while (((pipe->head + 1) % PIPE_BUF_SIZE) == pipe->tail) {
-    if (file->f_flags & O_NONBLOCK) {
-      mutex_unlock(&pipe->lock);
-      return -EAGAIN;
+    if (!pipe->readers) {
+      if (ret == 0) ret = -EPIPE;
+      break;
     }
-    mutex_unlock(&pipe->lock);
-    wait_event_interruptible(pipe->wr_wait, ((pipe->head + 1) % PIPE_BUF_SIZE) != pipe->tail || pipe->readers == 0);
-    mutex_lock(&pipe->lock);
-    if (pipe->readers == 0) {
-      mutex_unlock(&pipe->lock);
-      return -EPIPE;
+
+    /*
+     * Top up the last page first. A write of at most PIPE_BUF bytes must
+     * not be split, so it only merges when it fits entirely.
+     */
+    if (!pipe_empty(pipe)) {
+      struct pipe_buffer *last = pipe_buf(pipe, pipe->head - 1);
+      size_t end = last->offset + last->len;
+
+      if ((last->flags & PIPE_BUF_FLAG_CAN_MERGE) && end < PAGE_SIZE &&
+          (count > PIPE_BUF || PAGE_SIZE - end >= left)) {
+        size_t n = PAGE_SIZE - end < left ? PAGE_SIZE - end : left;
+        if (pipe_copy_in(file, page_address(last->page) + end, buf + ret, n)) {
+          if (ret == 0) ret = -EFAULT;
+          break;
+        }
+        last->len += n;
+        ret += n;
+        continue;
+      }
     }
-  }
 
-  size_t free_space = (pipe->tail - pipe->head - 1 + PIPE_BUF_SIZE) % PIPE_BUF_SIZE;
-  if (count > free_space) count = free_space;
+    if (!pipe_full(pipe)) {
+      struct page *page = pipe_alloc_page(pipe);
+      if (!page) {
+        if (ret == 0) ret = -ENOMEM;
+        break;
+      }
+
+      size_t n = left < PAGE_SIZE ? left : PAGE_SIZE;
+      if (pipe_copy_in(file, page_address(page), buf + ret, n)) {
+        pipe->tmp_page = page;
+        if (ret == 0) ret = -EFAULT;
+        break;
+      }
+
+      struct pipe_buffer *pbuf = pipe_buf(pipe, pipe->head);
+      pbuf->page = page;
+      pbuf->offset = 0;
+      pbuf->len = n;
+      pbuf->flags = PIPE_BUF_FLAG_CAN_MERGE;
+      pipe->head++;
+      ret += n;
+      continue;
+    }
 
-  for (size_t i = 0; i < count; i++) {
-    char c;
-    if (file->f_mode & FMODE_KERNEL) {
-      c = buf[i];
-    } else if (copy_from_user(&c, buf + i, 1) != 0) {
-      if (ret == 0) ret = -EFAULT;
+    /* Full: let readers drain what we queued so far, then wait for room */
+    if (ret > 0)
+      wake_up(&pipe->rd_wait);
+    int err = pipe_wait_writable(pipe, nonblock);
+    if (err) {
+      if (ret == 0) ret = err;
       break;
     }
-    pipe->buffer[pipe->head] = c;
-    pipe->head = (pipe->head + 1) % PIPE_BUF_SIZE;
-    ret++;
   }
 
   if (ret > 0)
@@ -133,13 +252,67 @@ static ssize_t pipe_write(struct file *file, const char *buf, size_t count, vfs_
   return ret;
 }
 
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg) {
+  if (arg > PIPE_MAX_SIZE)
+    return -EPERM;
+
+  uint32_t nr_slots = 1;
+  while ((unsigned long) nr_slots * PAGE_SIZE < arg)
+    nr_slots <<= 1;
+
+  struct pipe_buffer *bufs = kzalloc(nr_slots * sizeof(struct pipe_buffer));
+  if (!bufs)
+    return -ENOMEM;
+
+  mutex_lock(&pipe->lock);
+  uint32_t used = pipe_occupancy(pipe);
+  if (used > nr_slots) {
+    mutex_unlock(&pipe->lock);
+    kfree(bufs);
+    return -EBUSY;
+  }
+
+  for (uint32_t i = 0; i < used; i++)
+    bufs[i] = *pipe_buf(pipe, pipe->tail + i);
+
+  kfree(pipe->bufs);
+  pipe->bufs = bufs;
+  pipe->ring_size = nr_slots;
+  pipe->tail = 0;
+  pipe->head = used;
+
+  /* A larger ring may have made room */
+  wake_up(&pipe->wr_wait);
+  mutex_unlock(&pipe->lock);
+  return (long) nr_slots * PAGE_SIZE;
+}
+
+long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg) {
+  struct pipe_inode_info *pipe = get_pipe_info(file);
+  if (!pipe)
+    return -EBADF;
+
+  switch (cmd) {
+    case F_SETPIPE_SZ:
+      return pipe_set_size(pipe, arg);
+    case F_GETPIPE_SZ:
+      return (long) pipe->ring_size * PAGE_SIZE;
+    default:
+      return -EINVAL;
+  }
+}
+EXPORT_SYMBOL(pipe_fcntl);
+
 static uint32_t pipe_poll(struct file *file, poll_table *pt) {
   struct pipe_inode_info *pipe = file->private_data;
   uint32_t mask = 0;
 
+  if (file->f_mode & FMODE_READ) poll_wait(file, &pipe->rd_wait, pt);
+  if (file->f_mode & FMODE_WRITE) poll_wait(file, &pipe->wr_wait, pt);
+
   mutex_lock(&pipe->lock);
-  if (pipe->head != pipe->tail) mask |= POLLIN | POLLPRI;
-  if (((pipe->head + 1) % PIPE_BUF_SIZE) != pipe->tail) mask |= POLLOUT;
+  if (!pipe_empty(pipe)) mask |= POLLIN | POLLPRI;
+  if (!pipe_full(pipe)) mask |= POLLOUT;
   if (pipe->writers == 0) mask |= POLLHUP;
   if (pipe->readers == 0) mask |= POLLERR;
   mutex_unlock(&pipe->lock);
@@ -178,12 +351,13 @@ static struct file_operations pipe_wr_fops = {
   .release = pipe_release,
 };
 
-int do_pipe(int pipefd[2]) {
+int create_pipe_files(struct file *res[2]) {
   struct pipe_inode_info *pipe = kzalloc(sizeof(*pipe));
   if (!pipe) return -ENOMEM;
 
-  pipe->buffer = kmalloc(PIPE_BUF_SIZE);
-  if (!pipe->buffer) {
+  pipe->ring_size = PIPE_DEF_BUFFERS;
+  pipe->bufs = kzalloc(PIPE_DEF_BUFFERS * sizeof(struct pipe_buffer));
+  if (!pipe->bufs) {
     kfree(pipe);
     return -ENOMEM;
   }
@@ -207,11 +381,24 @@ int do_pipe(int pipefd[2]) {
   f_rd->f_op = &pipe_rd_fops;
   f_rd->private_data = pipe;
   f_rd->f_mode = FMODE_READ;
+  f_rd->f_flags = O_RDONLY;
 
   atomic_set(&f_wr->f_count, 1);
   f_wr->f_op = &pipe_wr_fops;
   f_wr->private_data = pipe;
   f_wr->f_mode = FMODE_WRITE;
+  f_wr->f_flags = O_WRONLY;
+
+  res[0] = f_rd;
+  res[1] = f_wr;
+  return 0;
+}
+EXPORT_SYMBOL(create_pipe_files);
+
+int do_pipe(int pipefd[2]) {
+  struct file *files[2];
+  int ret = create_pipe_files(files);
+  if (ret) return ret;
 
   int fd0 = get_unused_fd_flags(0);
   int fd1 = get_unused_fd_flags(0);
@@ -219,14 +406,13 @@ int do_pipe(int pipefd[2]) {
   if (fd0 < 0 || fd1 < 0) {
     if (fd0 >= 0) put_unused_fd(fd0);
     if (fd1 >= 0) put_unused_fd(fd1);
-    kfree(f_rd);
-    kfree(f_wr);
-    free_pipe_info(pipe);
+    fput(files[0]);
+    fput(files[1]);
     return -EMFILE;
   }
 
-  fd_install(fd0, f_rd);
-  fd_install(fd1, f_wr);
+  fd_install(fd0, files[0]);
+  fd_install(fd1, files[1]);
 
   pipefd[0] = fd0;
   pipefd[1] = fd1;
@@ -10,11 +10,13 @@
 #include <printk.h>
 #include <aerosync/classes.h>
 #include <fs/pseudo_fs.h>
+#include <fs/procfs.h>
 #include <aerosync/sched/process.h>
 #include <lib/vsprintf.h>
 #include <aerosync/timer.h>
 #include <mm/vm_object.h>
 #include <arch/x86_64/mm/pmm.h>
+#include <mm/zone.h>
 
 static struct pseudo_fs_info procfs_info = {
   .name = "proc",
@@ -29,15 +31,33 @@ static ssize_t proc_meminfo_read(struct file *file, char *buf, size_t count, vfs
   
   unsigned long total = stats->total_pages;
   unsigned long free = stats->free_pages;
+  unsigned long avail = free;
+
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+  /* Pre-zeroed pages sit outside the buddy lists but are free all the same */
+  struct zero_pool_stats zp;
+  zero_pool_get_stats(&zp);
+  avail += zp.nr_pages;
+#endif
 
   int len = snprintf(kbuf, sizeof(kbuf),
                      "MemTotal:       %lu kB\n"
                      "MemFree:        %lu kB\n"
                      "MemAvailable:   %lu kB\n"
                      "ShadowObjects:  %ld\n",
-                     total * 4, free * 4, free * 4,
+                     total * 4, free * 4, avail * 4,
                      atomic_long_read(&nr_shadow_objects));
 
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+  len += snprintf(kbuf + len, sizeof(kbuf) - (size_t) len,
+                  "ZeroPool:       %lu kB\n"
+                  "ZeroPoolHits:   %lu\n"
+                  "ZeroPoolMisses: %lu\n"
+                  "ZeroPoolFilled: %lu\n"
+                  "ZeroPoolDrained:%lu\n",
+                  zp.nr_pages * 4, zp.hits, zp.misses, zp.filled, zp.drained);
+#endif
+
   return simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
 }
 
@@ -60,6 +80,10 @@ static const struct file_operations proc_uptime_fops = {
   .read = proc_uptime_read,
 };
 
+struct pseudo_node *proc_create(const char *name, const struct file_operations *fops) {
+  return pseudo_fs_create_file(&procfs_info, nullptr, name, fops, nullptr);
+}
+
 void procfs_init(void) {
   pseudo_fs_register(&procfs_info);
 
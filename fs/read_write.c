@@ -0,0 +1,362 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file fs/read_write.c
+ * @brief read/write, positional and vectored I/O system calls
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <fs/vfs.h>
+#include <fs/file.h>
+#include <fs/uio.h>
+#include <mm/slub.h>
+#include <lib/uaccess.h>
+#include <aerosync/errno.h>
+#include <aerosync/export.h>
+#ifdef CONFIG_VFS_RW_TEST
+#include <aerosync/classes.h>
+#include <aerosync/panic.h>
+#include <lib/printk.h>
+#endif
+
+/*
+ * User buffers go straight to the file operations, which copy to and from
+ * user memory themselves (filemap_read() copies each UBC page directly).
+ * A request is handed down in one piece, up to MAX_RW_COUNT.
+ */
+
+static bool file_readable(const struct file *file) {
+  return (file->f_flags & O_ACCMODE) != O_WRONLY;
+}
+
+static bool file_writable(const struct file *file) {
+  return (file->f_flags & O_ACCMODE) != O_RDONLY;
+}
+
+/* Positional I/O needs an offset that means something */
+static bool file_seekable(const struct file *file) {
+  if (!file->f_inode)
+    return false; /* Pipes */
+  return !S_ISFIFO(file->f_inode->i_mode) && !S_ISSOCK(file->f_inode->i_mode);
+}
+
+static ssize_t do_read(struct file *file, char *buf, size_t count, vfs_loff_t *pos) {
+  if (!file_readable(file))
+    return -EBADF;
+  if (!count)
+    return 0;
+  if (count > MAX_RW_COUNT)
+    count = MAX_RW_COUNT;
+  if (!access_ok(buf, count))
+    return -EFAULT;
+  if ((int64_t) *pos < 0)
+    return -EINVAL;
+
+  return vfs_read(file, buf, count, pos);
+}
+
+static ssize_t do_write(struct file *file, const char *buf, size_t count, vfs_loff_t *pos) {
+  if (!file_writable(file))
+    return -EBADF;
+  if (!count)
+    return 0;
+  if (count > MAX_RW_COUNT)
+    count = MAX_RW_COUNT;
+  if (!access_ok(buf, count))
+    return -EFAULT;
+  if ((int64_t) *pos < 0)
+    return -EINVAL;
+
+  return vfs_write(file, buf, count, pos);
+}
+
+/* Position for a write through the file position */
+static vfs_loff_t file_write_pos(struct file *file) {
+  if ((file->f_flags & O_APPEND) && file->f_inode)
+    return file->f_inode->i_size;
+  return file->f_pos;
+}
+
+ssize_t sys_read(int fd, char *buf, size_t count) {
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  vfs_loff_t pos = file->f_pos;
+  ssize_t ret = do_read(file, buf, count, &pos);
+  if (ret >= 0)
+    file->f_pos = pos;
+
+  fput(file);
+  return ret;
+}
+EXPORT_SYMBOL(sys_read);
+
+ssize_t sys_write(int fd, const char *buf, size_t count) {
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  vfs_loff_t pos = file_write_pos(file);
+  ssize_t ret = do_write(file, buf, count, &pos);
+  if (ret >= 0)
+    file->f_pos = pos;
+
+  fput(file);
+  return ret;
+}
+EXPORT_SYMBOL(sys_write);
+
+ssize_t sys_pread64(int fd, char *buf, size_t count, vfs_loff_t pos) {
+  if ((int64_t) pos < 0)
+    return -EINVAL;
+
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  ssize_t ret = file_seekable(file) ? do_read(file, buf, count, &pos) : -ESPIPE;
+
+  fput(file);
+  return ret;
+}
+EXPORT_SYMBOL(sys_pread64);
+
+ssize_t sys_pwrite64(int fd, const char *buf, size_t count, vfs_loff_t pos) {
+  if ((int64_t) pos < 0)
+    return -EINVAL;
+
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  ssize_t ret = file_seekable(file) ? do_write(file, buf, count, &pos) : -ESPIPE;
+
+  fput(file);
+  return ret;
+}
+EXPORT_SYMBOL(sys_pwrite64);
+
+/* --- Vectored I/O --- */
+
+/* The total length is clamped to MAX_RW_COUNT by shortening the vectors */
+ssize_t import_iovec(const struct iovec *uvec, int nr, struct iovec *fast,
+                     struct iovec **iovp) {
+  struct iovec *iov = fast;
+  size_t total = 0;
+
+  *iovp = fast;
+  if (nr < 0 || nr > UIO_MAXIOV)
+    return -EINVAL;
+  if (nr == 0)
+    return 0;
+
+  if (nr > UIO_FASTIOV) {
+    iov = kmalloc(nr * sizeof(struct iovec));
+    if (!iov)
+      return -ENOMEM;
+  }
+
+  if (copy_from_user(iov, uvec, nr * sizeof(struct iovec)) != 0) {
+    if (iov != fast)
+      kfree(iov);
+    return -EFAULT;
+  }
+
+  for (int i = 0; i < nr; i++) {
+    size_t len = iov[i].iov_len;
+
+    if ((ssize_t) len < 0) {
+      if (iov != fast)
+        kfree(iov);
+      return -EINVAL;
+    }
+    if (len > MAX_RW_COUNT - total)
+      len = iov[i].iov_len = MAX_RW_COUNT - total;
+    if (!access_ok(iov[i].iov_base, len)) {
+      if (iov != fast)
+        kfree(iov);
+      return -EFAULT;
+    }
+    total += len;
+  }
+
+  *iovp = iov;
+  return (ssize_t) total;
+}
+EXPORT_SYMBOL(import_iovec);
+
+/* Each segment is a single direct transfer; a short one ends the request */
+static ssize_t do_iter_rw(struct file *file, const struct iovec *iov, int nr,
+                          vfs_loff_t *pos, bool write) {
+  ssize_t ret = 0;
+
+  for (int i = 0; i < nr; i++) {
+    size_t len = iov[i].iov_len;
+    if (!len)
+      continue;
+
+    ssize_t n = write ? vfs_write(file, iov[i].iov_base, len, pos)
+                      : vfs_read(file, iov[i].iov_base, len, pos);
+    if (n < 0) {
+      if (!ret)
+        ret = n;
+      break;
+    }
+    ret += n;
+    if ((size_t) n < len)
+      break;
+  }
+  return ret;
+}
+
+static ssize_t vfs_iter_rw(struct file *file, const struct iovec *uvec, int vlen,
+                           vfs_loff_t *pos, bool write) {
+  struct iovec fast[UIO_FASTIOV];
+  struct iovec *iov;
+
+  if (write ? !file_writable(file) : !file_readable(file))
+    return -EBADF;
+  if ((int64_t) *pos < 0)
+    return -EINVAL;
+
+  ssize_t ret = import_iovec(uvec, vlen, fast, &iov);
+  if (ret > 0)
+    ret = do_iter_rw(file, iov, vlen, pos, write);
+
+  if (iov != fast)
+    kfree(iov);
+  return ret;
+}
+
+static ssize_t do_readv_writev(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos,
+                               int flags, bool write) {
+  if (flags & ~(RWF_HIPRI | RWF_APPEND))
+    return -EOPNOTSUPP; /* No synchronous writeback or non-blocking UBC paths */
+  if ((flags & RWF_APPEND) && !write)
+    return -EINVAL;
+
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  ssize_t ret;
+  if ((int64_t) pos == -1) {
+    /* Through the file position, like readv/writev */
+    vfs_loff_t fpos = write ? file_write_pos(file) : file->f_pos;
+    if (write && (flags & RWF_APPEND) && file->f_inode)
+      fpos = file->f_inode->i_size;
+
+    ret = vfs_iter_rw(file, vec, vlen, &fpos, write);
+    if (ret >= 0)
+      file->f_pos = fpos;
+  } else if (!file_seekable(file)) {
+    ret = -ESPIPE;
+  } else {
+    if (write && (flags & RWF_APPEND) && file->f_inode)
+      pos = file->f_inode->i_size;
+    ret = vfs_iter_rw(file, vec, vlen, &pos, write);
+  }
+
+  fput(file);
+  return ret;
+}
+
+ssize_t sys_readv(int fd, const struct iovec *vec, int vlen) {
+  return do_readv_writev(fd, vec, vlen, -1, 0, false);
+}
+EXPORT_SYMBOL(sys_readv);
+
+ssize_t sys_writev(int fd, const struct iovec *vec, int vlen) {
+  return do_readv_writev(fd, vec, vlen, -1, 0, true);
+}
+EXPORT_SYMBOL(sys_writev);
+
+ssize_t sys_preadv(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos) {
+  if ((int64_t) pos < 0)
+    return -EINVAL;
+  return do_readv_writev(fd, vec, vlen, pos, 0, false);
+}
+EXPORT_SYMBOL(sys_preadv);
+
+ssize_t sys_pwritev(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos) {
+  if ((int64_t) pos < 0)
+    return -EINVAL;
+  return do_readv_writev(fd, vec, vlen, pos, 0, true);
+}
+EXPORT_SYMBOL(sys_pwritev);
+
+ssize_t sys_preadv2(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos, int flags) {
+  if ((int64_t) pos < -1)
+    return -EINVAL;
+  return do_readv_writev(fd, vec, vlen, pos, flags, false);
+}
+EXPORT_SYMBOL(sys_preadv2);
+
+ssize_t sys_pwritev2(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos, int flags) {
+  if ((int64_t) pos < -1)
+    return -EINVAL;
+  return do_readv_writev(fd, vec, vlen, pos, flags, true);
+}
+EXPORT_SYMBOL(sys_pwritev2);
+
+#ifdef CONFIG_VFS_RW_TEST
+/*
+ * vfs_loff_t is unsigned, so every offset check has to look at the signed
+ * value. The calls are made on a closed descriptor: an accepted offset gets
+ * as far as fget() and fails with EBADF, a rejected one fails with EINVAL.
+ */
+#define RW_TEST_BADFD (-1)
+
+static void rw_test_expect(const char *call, vfs_loff_t pos, ssize_t ret, ssize_t want) {
+  if (ret != want)
+    panic("rw_test: %s at offset %lld returned %lld, expected %lld", call,
+          (long long) pos, (long long) ret, (long long) want);
+}
+
+void rw_test(void) {
+  static const vfs_loff_t accepted[] = {0, 1, 4096, (vfs_loff_t) INT64_MAX};
+  char buf[8];
+  struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
+
+  printk(KERN_INFO TEST_CLASS "Starting positional I/O offset test...\n");
+
+  for (size_t i = 0; i < sizeof(accepted) / sizeof(accepted[0]); i++) {
+    vfs_loff_t pos = accepted[i];
+
+    rw_test_expect("pread64", pos, sys_pread64(RW_TEST_BADFD, buf, sizeof(buf), pos), -EBADF);
+    rw_test_expect("pwrite64", pos, sys_pwrite64(RW_TEST_BADFD, buf, sizeof(buf), pos), -EBADF);
+    rw_test_expect("preadv", pos, sys_preadv(RW_TEST_BADFD, &iov, 1, pos), -EBADF);
+    rw_test_expect("pwritev", pos, sys_pwritev(RW_TEST_BADFD, &iov, 1, pos), -EBADF);
+    rw_test_expect("preadv2", pos, sys_preadv2(RW_TEST_BADFD, &iov, 1, pos, 0), -EBADF);
+    rw_test_expect("pwritev2", pos, sys_pwritev2(RW_TEST_BADFD, &iov, 1, pos, 0), -EBADF);
+  }
+
+  /* -1 selects the file position for the v2 calls only */
+  vfs_loff_t cur = (vfs_loff_t) -1;
+  rw_test_expect("pread64", cur, sys_pread64(RW_TEST_BADFD, buf, sizeof(buf), cur), -EINVAL);
+  rw_test_expect("preadv", cur, sys_preadv(RW_TEST_BADFD, &iov, 1, cur), -EINVAL);
+  rw_test_expect("preadv2", cur, sys_preadv2(RW_TEST_BADFD, &iov, 1, cur, 0), -EBADF);
+  rw_test_expect("pwritev2", cur, sys_pwritev2(RW_TEST_BADFD, &iov, 1, cur, 0), -EBADF);
+
+  vfs_loff_t neg = (vfs_loff_t) -2;
+  rw_test_expect("pwrite64", neg, sys_pwrite64(RW_TEST_BADFD, buf, sizeof(buf), neg), -EINVAL);
+  rw_test_expect("pwritev", neg, sys_pwritev(RW_TEST_BADFD, &iov, 1, neg), -EINVAL);
+  rw_test_expect("preadv2", neg, sys_preadv2(RW_TEST_BADFD, &iov, 1, neg, 0), -EINVAL);
+  rw_test_expect("pwritev2", neg, sys_pwritev2(RW_TEST_BADFD, &iov, 1, neg, 0), -EINVAL);
+
+  printk(KERN_INFO TEST_CLASS "Positional I/O offset test passed!\n");
+}
+#endif
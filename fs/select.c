@@ -155,7 +155,7 @@ int do_poll(struct pollfd *fds, unsigned int nfds, uint64_t timeout_ns) {
       if (now >= deadline)
         break;
 
-      schedule_timeout(deadline - now);
+      schedule_hrtimeout(deadline - now);
     } else {
       schedule();
     }
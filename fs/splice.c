@@ -0,0 +1,536 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file fs/splice.c
+ * @brief splice, tee and vmsplice: moving page references through pipes
+ * @copyright (C) 2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <fs/vfs.h>
+#include <fs/file.h>
+#include <fs/pipe.h>
+#include <fs/uio.h>
+#include <mm/page.h>
+#include <mm/zone.h>
+#include <mm/slub.h>
+#include <mm/vm_object.h>
+#include <arch/x86_64/mm/pmm.h>
+#include <arch/x86_64/mm/vmm.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/rw_semaphore.h>
+#include <aerosync/errno.h>
+#include <aerosync/export.h>
+#include <lib/uaccess.h>
+
+extern int filemap_fault(struct vm_object *obj, struct vm_area_struct *vma, struct vm_fault *vmf);
+
+#define SPLICE_F_ALL (SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)
+
+static bool file_readable(const struct file *file) {
+  return (file->f_flags & O_ACCMODE) != O_WRONLY;
+}
+
+static bool file_writable(const struct file *file) {
+  return (file->f_flags & O_ACCMODE) != O_RDONLY;
+}
+
+/* Reads served straight from the UBC, the same test vfs_read() makes */
+static bool file_uses_ubc(const struct file *file) {
+  return !(file->f_op && file->f_op->read) && file->f_inode && file->f_inode->i_ubc &&
+         S_ISREG(file->f_inode->i_mode);
+}
+
+static void pipe_double_lock(struct pipe_inode_info *a, struct pipe_inode_info *b) {
+  if (a < b) {
+    mutex_lock(&a->lock);
+    mutex_lock(&b->lock);
+  } else {
+    mutex_lock(&b->lock);
+    mutex_lock(&a->lock);
+  }
+}
+
+/* --- file -> pipe --- */
+
+/* Queue references to the UBC folios backing [*ppos, *ppos + len) */
+static ssize_t splice_ubc_to_pipe(struct file *in, vfs_loff_t *ppos, struct pipe_inode_info *pipe,
+                                  size_t len) {
+  struct inode *inode = in->f_inode;
+  struct vm_object *obj = inode->i_ubc;
+  ssize_t total = 0;
+
+  while ((size_t) total < len && !pipe_full(pipe)) {
+    if (*ppos >= inode->i_size)
+      break;
+
+    uint64_t pgoff = (*ppos) >> PAGE_SHIFT;
+    size_t offset = (*ppos) & (PAGE_SIZE - 1);
+    size_t n = len - total < PAGE_SIZE - offset ? len - total : PAGE_SIZE - offset;
+    if (*ppos + n > inode->i_size)
+      n = inode->i_size - *ppos;
+
+    struct vm_fault vmf = {.pgoff = pgoff, .flags = 0};
+    if (filemap_fault(obj, nullptr, &vmf) != 0) {
+      if (total == 0) total = -EIO;
+      break;
+    }
+
+    /* The reference taken by the fault now belongs to the pipe */
+    struct pipe_buffer *buf = pipe_buf(pipe, pipe->head);
+    buf->page = &vmf.folio->page;
+    buf->offset = offset;
+    buf->len = n;
+    buf->flags = 0;
+    pipe->head++;
+
+    *ppos += n;
+    total += n;
+  }
+  return total;
+}
+
+/* Anything else is read into fresh pipe pages */
+static ssize_t splice_read_to_pipe(struct file *in, vfs_loff_t *ppos, struct pipe_inode_info *pipe,
+                                   size_t len) {
+  ssize_t total = 0;
+
+  while ((size_t) total < len && !pipe_full(pipe)) {
+    struct folio *folio = alloc_page(GFP_KERNEL);
+    if (!folio) {
+      if (total == 0) total = -ENOMEM;
+      break;
+    }
+
+    size_t n = len - total < PAGE_SIZE ? len - total : PAGE_SIZE;
+    ssize_t ret = kernel_read(in, folio_address(folio), n, ppos);
+    if (ret <= 0) {
+      folio_put(folio);
+      if (total == 0) total = ret;
+      break;
+    }
+
+    struct pipe_buffer *buf = pipe_buf(pipe, pipe->head);
+    buf->page = &folio->page;
+    buf->offset = 0;
+    buf->len = ret;
+    buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
+    pipe->head++;
+
+    total += ret;
+    if ((size_t) ret < n)
+      break;
+  }
+  return total;
+}
+
+static ssize_t splice_file_to_pipe(struct file *in, vfs_loff_t *ppos, struct pipe_inode_info *pipe,
+                                   size_t len, bool nonblock) {
+  mutex_lock(&pipe->lock);
+  ssize_t ret = pipe_wait_writable(pipe, nonblock);
+  if (ret == 0) {
+    if (file_uses_ubc(in))
+      ret = splice_ubc_to_pipe(in, ppos, pipe, len);
+    else
+      ret = splice_read_to_pipe(in, ppos, pipe, len);
+  }
+  if (ret > 0)
+    wake_up(&pipe->rd_wait);
+  mutex_unlock(&pipe->lock);
+  return ret;
+}
+
+/* --- pipe -> file --- */
+
+static ssize_t splice_pipe_to_file(struct pipe_inode_info *pipe, struct file *out, vfs_loff_t *ppos,
+                                   size_t len, bool nonblock) {
+  mutex_lock(&pipe->lock);
+  ssize_t total = pipe_wait_readable(pipe, nonblock);
+  if (total) {
+    mutex_unlock(&pipe->lock);
+    return total;
+  }
+
+  while ((size_t) total < len && !pipe_empty(pipe)) {
+    struct pipe_buffer *buf = pipe_buf(pipe, pipe->tail);
+    size_t n = len - total < buf->len ? len - total : buf->len;
+
+    ssize_t ret = kernel_write(out, page_address(buf->page) + buf->offset, n, ppos);
+    if (ret <= 0) {
+      if (total == 0) total = ret;
+      break;
+    }
+
+    buf->offset += ret;
+    buf->len -= ret;
+    total += ret;
+    if (!buf->len) {
+      pipe_buf_release(pipe, buf);
+      pipe->tail++;
+    }
+    if ((size_t) ret < n)
+      break;
+  }
+
+  if (total > 0)
+    wake_up(&pipe->wr_wait);
+  mutex_unlock(&pipe->lock);
+  return total;
+}
+
+/* --- pipe -> pipe --- */
+
+/*
+ * Wait for input in @ipipe and room in @opipe, one at a time.
+ * @return 1 if there is work, 0 at end of input, or an error
+ */
+static int splice_pipe_prep(struct pipe_inode_info *ipipe, struct pipe_inode_info *opipe,
+                            bool nonblock) {
+  mutex_lock(&ipipe->lock);
+  int ret = pipe_wait_readable(ipipe, nonblock);
+  bool eof = pipe_empty(ipipe);
+  mutex_unlock(&ipipe->lock);
+  if (ret)
+    return ret;
+  if (eof)
+    return 0;
+
+  mutex_lock(&opipe->lock);
+  ret = pipe_wait_writable(opipe, nonblock);
+  mutex_unlock(&opipe->lock);
+  return ret ? ret : 1;
+}
+
+/*
+ * Move (or with @link, share) slots from @ipipe to @opipe. Shared pages
+ * lose PIPE_BUF_FLAG_CAN_MERGE on the output side so appends to one pipe
+ * never show up in the other.
+ */
+static ssize_t splice_pipe_to_pipe(struct pipe_inode_info *ipipe, struct pipe_inode_info *opipe,
+                                   size_t len, bool nonblock, bool link) {
+  for (;;) {
+    int ret = splice_pipe_prep(ipipe, opipe, nonblock);
+    if (ret <= 0)
+      return ret;
+
+    pipe_double_lock(ipipe, opipe);
+
+    size_t moved = 0;
+    uint32_t slot = ipipe->tail;
+    while (moved < len && slot != ipipe->head && !pipe_full(opipe) && opipe->readers) {
+      struct pipe_buffer *ibuf = pipe_buf(ipipe, slot);
+      struct pipe_buffer *obuf = pipe_buf(opipe, opipe->head);
+      size_t n = len - moved < ibuf->len ? len - moved : ibuf->len;
+
+      *obuf = *ibuf;
+      obuf->flags &= ~PIPE_BUF_FLAG_CAN_MERGE;
+      obuf->len = n;
+
+      if (link) {
+        get_page(ibuf->page);
+        slot++;
+      } else if (n == ibuf->len) {
+        ibuf->page = nullptr; /* Reference handed over */
+        slot = ++ipipe->tail;
+      } else {
+        get_page(ibuf->page);
+        ibuf->offset += n;
+        ibuf->len -= n;
+      }
+
+      opipe->head++;
+      moved += n;
+    }
+    bool broken = !opipe->readers;
+
+    mutex_unlock(&ipipe->lock);
+    mutex_unlock(&opipe->lock);
+
+    if (moved) {
+      if (!link)
+        wake_up(&ipipe->wr_wait);
+      wake_up(&opipe->rd_wait);
+      return (ssize_t) moved;
+    }
+    if (broken)
+      return -EPIPE;
+  }
+}
+
+/* --- System calls --- */
+
+static ssize_t do_splice(struct file *in, vfs_loff_t *off_in, struct file *out,
+                         vfs_loff_t *off_out, size_t len, unsigned int flags) {
+  struct pipe_inode_info *ipipe = get_pipe_info(in);
+  struct pipe_inode_info *opipe = get_pipe_info(out);
+  bool nonblock = flags & SPLICE_F_NONBLOCK;
+  vfs_loff_t pos;
+  ssize_t ret;
+
+  if (!file_readable(in) || !file_writable(out))
+    return -EBADF;
+
+  if (ipipe && opipe) {
+    if (off_in || off_out)
+      return -ESPIPE;
+    if (ipipe == opipe)
+      return -EINVAL;
+    return splice_pipe_to_pipe(ipipe, opipe, len, nonblock || (in->f_flags & O_NONBLOCK), false);
+  }
+
+  if (ipipe) {
+    if (off_in)
+      return -ESPIPE;
+    if (off_out) {
+      if (copy_from_user(&pos, off_out, sizeof(pos)))
+        return -EFAULT;
+      if ((int64_t) pos < 0)
+        return -EINVAL;
+    } else if ((out->f_flags & O_APPEND) && out->f_inode) {
+      pos = out->f_inode->i_size;
+    } else {
+      pos = out->f_pos;
+    }
+
+    ret = splice_pipe_to_file(ipipe, out, &pos, len, nonblock || (in->f_flags & O_NONBLOCK));
+  } else if (opipe) {
+    if (off_out)
+      return -ESPIPE;
+    if (off_in) {
+      if (copy_from_user(&pos, off_in, sizeof(pos)))
+        return -EFAULT;
+      if ((int64_t) pos < 0)
+        return -EINVAL;
+    } else {
+      pos = in->f_pos;
+    }
+
+    ret = splice_file_to_pipe(in, &pos, opipe, len, nonblock || (out->f_flags & O_NONBLOCK));
+  } else {
+    return -EINVAL;
+  }
+
+  if (ret > 0) {
+    vfs_loff_t *uoff = ipipe ? off_out : off_in;
+    if (uoff) {
+      if (copy_to_user(uoff, &pos, sizeof(pos)))
+        return -EFAULT;
+    } else {
+      (ipipe ? out : in)->f_pos = pos;
+    }
+  }
+  return ret;
+}
+
+ssize_t sys_splice(int fd_in, vfs_loff_t *off_in, int fd_out, vfs_loff_t *off_out,
+                   size_t len, unsigned int flags) {
+  if (flags & ~SPLICE_F_ALL)
+    return -EINVAL;
+  if (!len)
+    return 0;
+  if (len > MAX_RW_COUNT)
+    len = MAX_RW_COUNT;
+
+  struct file *in = fget(fd_in);
+  if (!in)
+    return -EBADF;
+  struct file *out = fget(fd_out);
+  if (!out) {
+    fput(in);
+    return -EBADF;
+  }
+
+  ssize_t ret = do_splice(in, off_in, out, off_out, len, flags);
+
+  fput(out);
+  fput(in);
+  return ret;
+}
+EXPORT_SYMBOL(sys_splice);
+
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+  if (flags & ~SPLICE_F_ALL)
+    return -EINVAL;
+  if (!len)
+    return 0;
+
+  struct file *in = fget(fd_in);
+  if (!in)
+    return -EBADF;
+  struct file *out = fget(fd_out);
+  if (!out) {
+    fput(in);
+    return -EBADF;
+  }
+
+  struct pipe_inode_info *ipipe = get_pipe_info(in);
+  struct pipe_inode_info *opipe = get_pipe_info(out);
+  ssize_t ret;
+
+  if (!ipipe || !opipe || ipipe == opipe)
+    ret = -EINVAL;
+  else if (!file_readable(in) || !file_writable(out))
+    ret = -EBADF;
+  else
+    ret = splice_pipe_to_pipe(ipipe, opipe, len,
+                              (flags & SPLICE_F_NONBLOCK) || (in->f_flags & O_NONBLOCK), true);
+
+  fput(out);
+  fput(in);
+  return ret;
+}
+EXPORT_SYMBOL(sys_tee);
+
+/*
+ * Take a reference on the user page behind @uaddr, faulting it in first.
+ * Returns nullptr for anything that is not an ordinary refcounted page;
+ * the caller copies instead.
+ */
+static struct page *vmsplice_get_user_page(unsigned long uaddr) {
+  struct mm_struct *mm = current->mm;
+  char probe;
+
+  if (!mm || copy_from_user(&probe, (const void *) uaddr, 1))
+    return nullptr;
+
+  down_read(&mm->mmap_lock);
+  uint64_t phys = vmm_virt_to_phys(mm, uaddr & PAGE_MASK);
+  struct page *page = phys ? phys_to_page(phys) : nullptr;
+  if (page && (PageReserved(page) || PageSlab(page)))
+    page = nullptr;
+  if (page)
+    get_page(page);
+  up_read(&mm->mmap_lock);
+
+  return page;
+}
+
+/*
+ * User memory -> pipe. The pages themselves are queued, so the caller must
+ * not modify them until the reader has consumed the data.
+ */
+static ssize_t vmsplice_to_pipe(struct pipe_inode_info *pipe, const struct iovec *iov, int nr,
+                                bool nonblock) {
+  ssize_t total = 0;
+
+  mutex_lock(&pipe->lock);
+  for (int i = 0; i < nr; i++) {
+    unsigned long addr = (unsigned long) iov[i].iov_base;
+    size_t left = iov[i].iov_len;
+
+    while (left) {
+      if (pipe_full(pipe) && total > 0)
+        wake_up(&pipe->rd_wait);
+      int err = pipe_wait_writable(pipe, nonblock);
+      if (err) {
+        if (total == 0) total = err;
+        goto out;
+      }
+
+      size_t offset = addr & (PAGE_SIZE - 1);
+      size_t n = left < PAGE_SIZE - offset ? left : PAGE_SIZE - offset;
+      uint32_t buf_flags = 0;
+
+      struct page *page = vmsplice_get_user_page(addr);
+      if (!page) {
+        struct folio *folio = alloc_page(GFP_KERNEL);
+        if (!folio) {
+          if (total == 0) total = -ENOMEM;
+          goto out;
+        }
+        page = &folio->page;
+        if (copy_from_user(page_address(page) + offset, (const void *) addr, n)) {
+          put_page(page);
+          if (total == 0) total = -EFAULT;
+          goto out;
+        }
+        buf_flags = PIPE_BUF_FLAG_CAN_MERGE;
+      }
+
+      struct pipe_buffer *buf = pipe_buf(pipe, pipe->head);
+      buf->page = page;
+      buf->offset = offset;
+      buf->len = n;
+      buf->flags = buf_flags;
+      pipe->head++;
+
+      addr += n;
+      left -= n;
+      total += n;
+    }
+  }
+
+out:
+  if (total > 0)
+    wake_up(&pipe->rd_wait);
+  mutex_unlock(&pipe->lock);
+  return total;
+}
+
+/* Pipe -> user memory is an ordinary read into each segment */
+static ssize_t vmsplice_to_user(struct file *file, const struct iovec *iov, int nr) {
+  ssize_t total = 0;
+
+  for (int i = 0; i < nr; i++) {
+    if (!iov[i].iov_len)
+      continue;
+
+    vfs_loff_t pos = 0;
+    ssize_t ret = vfs_read(file, iov[i].iov_base, iov[i].iov_len, &pos);
+    if (ret <= 0) {
+      if (total == 0) total = ret;
+      break;
+    }
+    total += ret;
+    if ((size_t) ret < iov[i].iov_len)
+      break;
+  }
+  return total;
+}
+
+ssize_t sys_vmsplice(int fd, const struct iovec *vec, unsigned long nr_segs,
+                     unsigned int flags) {
+  struct iovec fast[UIO_FASTIOV];
+  struct iovec *iov;
+
+  if (flags & ~SPLICE_F_ALL)
+    return -EINVAL;
+  if (nr_segs > UIO_MAXIOV)
+    return -EINVAL;
+
+  struct file *file = fget(fd);
+  if (!file)
+    return -EBADF;
+
+  struct pipe_inode_info *pipe = get_pipe_info(file);
+  if (!pipe) {
+    fput(file);
+    return -EBADF;
+  }
+
+  ssize_t ret = import_iovec(vec, (int) nr_segs, fast, &iov);
+  if (ret > 0) {
+    if (file->f_mode & FMODE_WRITE)
+      ret = vmsplice_to_pipe(pipe, iov, (int) nr_segs,
+                             (flags & SPLICE_F_NONBLOCK) || (file->f_flags & O_NONBLOCK));
+    else
+      ret = vmsplice_to_user(file, iov, (int) nr_segs);
+  }
+
+  if (iov != fast)
+    kfree(iov);
+  fput(file);
+  return ret;
+}
+EXPORT_SYMBOL(sys_vmsplice);
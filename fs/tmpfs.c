@@ -108,6 +108,9 @@ static int tmpfs_iterate(struct file *file, struct dir_context *ctx) {
 
   spinlock_lock(&dentry->d_lock);
   list_for_each_entry(child, &dentry->d_subdirs, d_child) {
+    if (!child->d_inode)
+      continue; /* Cached negative lookup */
+
     if (i >= ctx->pos) {
       unsigned int type = DT_UNKNOWN;
       if (child->d_inode) {
@@ -241,6 +244,7 @@ static int tmpfs_fill_super(struct super_block *sb, void *data) {
   sb->s_blocksize = PAGE_SIZE;
   sb->s_magic = TMPFS_MAGIC;
   sb->s_op = &tmpfs_ops;
+  sb->s_flags |= SB_DCACHE_RETAIN; /* The dentry tree is the only copy */
 
   struct inode *inode = tmpfs_get_inode(sb, nullptr, S_IFDIR | 0755, 0);
   if (!inode) return -ENOMEM;
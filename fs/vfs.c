@@ -37,6 +37,7 @@
 #include <fs/procfs.h>
 #include <fs/fs_struct.h>
 #include <fs/initramfs.h>
+#include <fs/eventpoll.h>
 #include <aerosync/timer.h>
 #include <arch/x86_64/requests.h>
 #include <mm/vm_object.h>
@@ -71,6 +72,7 @@ void vfs_init(void) {
 
   extern void files_init(void);
   files_init();
+  dcache_init();
 
   // Initialize global lists
   INIT_LIST_HEAD(&super_blocks);
@@ -781,6 +783,7 @@ EXPORT_SYMBOL(vfs_write);
 
 int __no_cfi vfs_close(struct file *file) {
   if (!file) return -EINVAL;
+  eventpoll_release(file);
   if (file->f_op && file->f_op->release) {
     file->f_op->release(file->f_inode, file);
   }
@@ -953,16 +956,64 @@ static int __no_cfi chrdev_release(struct inode *inode, struct file *file) {
   return 0;
 }
 
+/*
+ * char_operations work on kernel buffers; user I/O bounces through a page
+ * sized buffer. A short transfer from the driver ends the request.
+ */
 static ssize_t __no_cfi chrdev_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
   struct char_device *cdev = file->private_data;
   if (!cdev || !cdev->ops || !cdev->ops->read) return -EINVAL;
-  return cdev->ops->read(cdev, buf, count, ppos);
+  if (file->f_mode & FMODE_KERNEL) return cdev->ops->read(cdev, buf, count, ppos);
+
+  char *kbuf = kmalloc(count < PAGE_SIZE ? count : PAGE_SIZE);
+  if (!kbuf) return -ENOMEM;
+
+  ssize_t total = 0;
+  while ((size_t) total < count) {
+    size_t chunk = count - total < PAGE_SIZE ? count - total : PAGE_SIZE;
+    ssize_t ret = cdev->ops->read(cdev, kbuf, chunk, ppos);
+    if (ret <= 0) {
+      if (!total) total = ret;
+      break;
+    }
+    if (copy_to_user(buf + total, kbuf, ret) != 0) {
+      if (!total) total = -EFAULT;
+      break;
+    }
+    total += ret;
+    if ((size_t) ret < chunk) break;
+  }
+
+  kfree(kbuf);
+  return total;
 }
 
 static ssize_t __no_cfi chrdev_write(struct file *file, const char *buf, size_t count, vfs_loff_t *ppos) {
   struct char_device *cdev = file->private_data;
   if (!cdev || !cdev->ops || !cdev->ops->write) return -EINVAL;
-  return cdev->ops->write(cdev, buf, count, ppos);
+  if (file->f_mode & FMODE_KERNEL) return cdev->ops->write(cdev, buf, count, ppos);
+
+  char *kbuf = kmalloc(count < PAGE_SIZE ? count : PAGE_SIZE);
+  if (!kbuf) return -ENOMEM;
+
+  ssize_t total = 0;
+  while ((size_t) total < count) {
+    size_t chunk = count - total < PAGE_SIZE ? count - total : PAGE_SIZE;
+    if (copy_from_user(kbuf, buf + total, chunk) != 0) {
+      if (!total) total = -EFAULT;
+      break;
+    }
+    ssize_t ret = cdev->ops->write(cdev, kbuf, chunk, ppos);
+    if (ret <= 0) {
+      if (!total) total = ret;
+      break;
+    }
+    total += ret;
+    if ((size_t) ret < chunk) break;
+  }
+
+  kfree(kbuf);
+  return total;
 }
 
 static int __no_cfi chrdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
@@ -993,56 +1044,94 @@ static int blkdev_release(struct inode *inode, struct file *file) {
   return 0;
 }
 
+/*
+ * Block device files bounce through a buffer of one page (or one block, if
+ * larger), so a read(2) of any size costs a bounded allocation. Unaligned
+ * writes read the covered sectors first and write them back whole.
+ */
+static size_t blkdev_chunk_size(const struct block_device *bdev) {
+  return bdev->block_size > PAGE_SIZE ? bdev->block_size : PAGE_SIZE;
+}
+
 static ssize_t blkdev_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
   struct block_device *bdev = file->private_data;
-  if (!bdev) return -EINVAL;
+  if (!bdev || !bdev->block_size) return -EINVAL;
 
-  uint64_t start_sector = (*ppos) / bdev->block_size;
-  uint32_t sector_count = (count + bdev->block_size - 1) / bdev->block_size;
+  uint32_t bsz = bdev->block_size;
+  uint64_t size = bdev->sector_count * bsz;
+  if (*ppos >= size) return 0;
+  if (count > size - *ppos) count = size - *ppos;
 
-  /* Basic bounce buffer for now (aligned I/O) */
-  void *kbuf = kmalloc(sector_count * bdev->block_size);
+  size_t chunk_size = blkdev_chunk_size(bdev);
+  char *kbuf = kmalloc(chunk_size);
   if (!kbuf) return -ENOMEM;
 
-  int ret = block_read(bdev, kbuf, start_sector, sector_count);
-  if (ret == 0) {
-    size_t to_copy = (count < sector_count * bdev->block_size) ? count : sector_count * bdev->block_size;
-    copy_to_user(buf, kbuf, to_copy);
-    *ppos += to_copy;
-    ret = to_copy;
-  } else {
-    ret = -EIO;
+  ssize_t total = 0;
+  while ((size_t) total < count) {
+    uint64_t sector = *ppos / bsz;
+    size_t skip = *ppos % bsz;
+    size_t n = count - total < chunk_size - skip ? count - total : chunk_size - skip;
+    uint32_t nr_sectors = (uint32_t) ((skip + n + bsz - 1) / bsz);
+
+    if (block_read(bdev, kbuf, sector, nr_sectors) != 0) {
+      if (!total) total = -EIO;
+      break;
+    }
+    if (file->f_mode & FMODE_KERNEL) {
+      memcpy(buf + total, kbuf + skip, n);
+    } else if (copy_to_user(buf + total, kbuf + skip, n) != 0) {
+      if (!total) total = -EFAULT;
+      break;
+    }
+    total += n;
+    *ppos += n;
   }
 
   kfree(kbuf);
-  return ret;
+  return total;
 }
 
 static ssize_t blkdev_write(struct file *file, const char *buf, size_t count, vfs_loff_t *ppos) {
   struct block_device *bdev = file->private_data;
-  if (!bdev) return -EINVAL;
+  if (!bdev || !bdev->block_size) return -EINVAL;
 
-  uint64_t start_sector = (*ppos) / bdev->block_size;
-  uint32_t sector_count = (count + bdev->block_size - 1) / bdev->block_size;
+  uint32_t bsz = bdev->block_size;
+  uint64_t size = bdev->sector_count * bsz;
+  if (*ppos >= size) return count ? -ENOSPC : 0;
+  if (count > size - *ppos) count = size - *ppos;
 
-  void *kbuf = kmalloc(sector_count * bdev->block_size);
+  size_t chunk_size = blkdev_chunk_size(bdev);
+  char *kbuf = kmalloc(chunk_size);
   if (!kbuf) return -ENOMEM;
 
-  if (copy_from_user(kbuf, buf, count) != 0) {
-    kfree(kbuf);
-    return -EFAULT;
-  }
+  ssize_t total = 0;
+  while ((size_t) total < count) {
+    uint64_t sector = *ppos / bsz;
+    size_t skip = *ppos % bsz;
+    size_t n = count - total < chunk_size - skip ? count - total : chunk_size - skip;
+    uint32_t nr_sectors = (uint32_t) ((skip + n + bsz - 1) / bsz);
 
-  int ret = block_write(bdev, kbuf, start_sector, sector_count);
-  if (ret == 0) {
-    *ppos += count;
-    ret = count;
-  } else {
-    ret = -EIO;
+    /* Partial sectors keep the bytes around the written range */
+    if ((skip || (skip + n) % bsz) && block_read(bdev, kbuf, sector, nr_sectors) != 0) {
+      if (!total) total = -EIO;
+      break;
+    }
+    if (file->f_mode & FMODE_KERNEL) {
+      memcpy(kbuf + skip, buf + total, n);
+    } else if (copy_from_user(kbuf + skip, buf + total, n) != 0) {
+      if (!total) total = -EFAULT;
+      break;
+    }
+    if (block_write(bdev, kbuf, sector, nr_sectors) != 0) {
+      if (!total) total = -EIO;
+      break;
+    }
+    total += n;
+    *ppos += n;
   }
 
   kfree(kbuf);
-  return ret;
+  return total;
 }
 
 static struct file_operations def_blk_fops = {
@@ -1145,39 +1234,6 @@ void iput(struct inode *inode) {
 
 EXPORT_SYMBOL(iput);
 
-struct dentry *dget(struct dentry *dentry) {
-  if (dentry) {
-    atomic_inc(&dentry->d_count);
-  }
-  return dentry;
-}
-
-EXPORT_SYMBOL(dget);
-
-void dput(struct dentry *dentry) {
-  if (!dentry) return;
-
-  if (atomic_dec_and_test(&dentry->d_count)) {
-    /* Remove from parent's subdirectory list */
-    if (!list_empty(&dentry->d_child)) {
-      list_del(&dentry->d_child);
-    }
-
-    /* Remove from inode's dentry list */
-    if (!list_empty(&dentry->i_list)) {
-      list_del(&dentry->i_list);
-    }
-
-    if (dentry->d_inode) {
-      iput(dentry->d_inode);
-    }
-    kfree((void *) dentry->d_name.name);
-    kfree(dentry);
-  }
-}
-
-EXPORT_SYMBOL(dput);
-
 ssize_t simple_read_from_buffer(void *to, size_t count, vfs_loff_t *ppos, const void *from, size_t available) {
   vfs_loff_t pos = *ppos;
   if (pos < 0) return -EINVAL;
@@ -0,0 +1,125 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/aerosync/hrtimer.h
+ * @brief High-resolution timers
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * Each CPU keeps its pending hrtimers in an rbtree ordered by expiry, with
+ * the earliest one cached. In high-resolution mode the local APIC runs in
+ * one-shot (or TSC-deadline) mode and is programmed for the earliest
+ * expiry; the periodic tick itself is an hrtimer (see aerosync/tick.h).
+ * Callbacks run in hard interrupt context with interrupts disabled.
+ */
+
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/spinlock.h>
+#include <linux/rbtree.h>
+
+#define KTIME_MAX UINT64_MAX
+
+enum hrtimer_restart {
+  HRTIMER_NORESTART,
+  HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+  HRTIMER_MODE_ABS, /* Expiry is absolute (get_time_ns() clock) */
+  HRTIMER_MODE_REL, /* Expiry is relative to now */
+};
+
+#define HRTIMER_STATE_INACTIVE 0
+#define HRTIMER_STATE_ENQUEUED 1
+
+struct hrtimer_cpu_base;
+
+struct hrtimer {
+  struct rb_node node;
+  uint64_t expires;
+  enum hrtimer_restart (*function)(struct hrtimer *);
+  struct hrtimer_cpu_base *base;
+  uint8_t state;
+};
+
+struct hrtimer_cpu_base {
+  spinlock_t lock;
+  struct rb_root_cached active;
+  struct hrtimer *running;   /* Callback currently executing */
+  uint64_t expires_next;     /* Event programmed into the hardware */
+  bool hres_active;          /* Local APIC in one-shot mode */
+  bool in_hrtirq;            /* Inside hrtimer_interrupt(), defer reprogramming */
+  uint32_t cpu;
+
+  /* Statistics */
+  uint64_t nr_events;
+  uint64_t nr_retries;
+};
+
+/**
+ * hrtimer_init - Prepare a timer for use on the current CPU
+ */
+void hrtimer_init(struct hrtimer *timer, enum hrtimer_restart (*function)(struct hrtimer *));
+
+/**
+ * hrtimer_start - (Re)arm a timer
+ *
+ * An inactive timer is queued on the calling CPU; a timer whose callback is
+ * currently running stays on the CPU running it.
+ */
+void hrtimer_start(struct hrtimer *timer, uint64_t tim, enum hrtimer_mode mode);
+
+/**
+ * hrtimer_try_to_cancel - Dequeue a timer without waiting
+ * @return 1 if it was pending, 0 if inactive, -1 if its callback is running
+ */
+int hrtimer_try_to_cancel(struct hrtimer *timer);
+
+/**
+ * hrtimer_cancel - Dequeue a timer and wait for a running callback to finish
+ * @return 1 if it was pending, 0 otherwise
+ */
+int hrtimer_cancel(struct hrtimer *timer);
+
+/**
+ * hrtimer_forward - Push the expiry of a periodic timer past @now
+ * @return Number of intervals skipped
+ */
+uint64_t hrtimer_forward(struct hrtimer *timer, uint64_t now, uint64_t interval);
+
+static inline bool hrtimer_is_queued(const struct hrtimer *timer) {
+  return __atomic_load_n(&timer->state, __ATOMIC_RELAXED) == HRTIMER_STATE_ENQUEUED;
+}
+
+static inline uint64_t hrtimer_get_expires(const struct hrtimer *timer) {
+  return timer->expires;
+}
+
+/* --- Timer core / interrupt glue --- */
+
+void hrtimers_init(void);
+
+/**
+ * hrtimer_switch_to_hres - Put this CPU's event device into one-shot mode
+ * @return true if high-resolution mode is now active
+ */
+bool hrtimer_switch_to_hres(void);
+
+bool hrtimer_hres_active(void);
+
+/**
+ * hrtimer_interrupt - Event device interrupt in high-resolution mode
+ */
+void hrtimer_interrupt(void);
+
+/**
+ * hrtimer_run_queues - Expire hrtimers from the periodic tick (low-res mode)
+ */
+void hrtimer_run_queues(void);
+
+/**
+ * hrtimer_next_event - Earliest hrtimer expiry on this CPU, or KTIME_MAX
+ */
+uint64_t hrtimer_next_event(void);
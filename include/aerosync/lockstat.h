@@ -0,0 +1,84 @@
+#pragma once
+
+#include <compiler.h>
+#include <aerosync/types.h>
+
+/**
+ * @file include/aerosync/lockstat.h
+ * @brief Lock contention statistics
+ *
+ * With CONFIG_LOCK_STAT every spinlock_t, mutex_t and rw_semaphore belongs to
+ * a lock class: the spinlock_init()/mutex_init()/rwsem_init() call site for
+ * locks set up at runtime, or the lock's own address for statically
+ * initialised ones. Runtime locks that were never initialised share the
+ * "<unclassed>" class. Each class counts acquisitions and contentions, sums
+ * TSC wait and hold times and remembers the call sites that contend most.
+ * /proc/lock_stat shows the table; writing anything to it resets the counts.
+ *
+ * Hold times cover exclusive holders only: readers of an rw_semaphore have no
+ * single acquisition time to measure from.
+ *
+ * Compiled out, the hooks below expand to nothing and lock objects keep
+ * their usual size.
+ */
+
+#ifdef CONFIG_LOCK_STAT
+
+#define LOCKSTAT_MAX_CLASSES       512
+#define LOCKSTAT_CONTENTION_POINTS 4
+
+struct lock_class {
+  const char *name; /* Init-site expression, nullptr if keyed by address */
+  const void *key;  /* Lock address for address-keyed classes */
+  int id;           /* Slot in the statistics table, 0 until first use */
+};
+
+/* Embedded first in every lock so an address key names the lock itself */
+struct lockstat_map {
+  struct lock_class *class; /* nullptr until resolved for static locks */
+  uint64_t acquired_at;     /* TSC of the current exclusive acquisition */
+};
+
+/* Address of the instruction, for inlined lock functions */
+#define LOCKSTAT_THIS_IP                                                       \
+  ({                                                                           \
+    unsigned long __ip;                                                        \
+    __asm__ volatile("leaq 1f(%%rip), %0\n1:" : "=r"(__ip));                   \
+    __ip;                                                                      \
+  })
+
+#define LOCKSTAT_RET_IP ((unsigned long)__builtin_return_address(0))
+
+static __always_inline uint64_t lockstat_clock(void) {
+  return __builtin_ia32_rdtsc();
+}
+
+void lockstat_contended(struct lockstat_map *map, uint64_t start, unsigned long ip);
+void lockstat_acquired(struct lockstat_map *map, bool exclusive);
+void lockstat_released(struct lockstat_map *map);
+
+static inline void lockstat_init_map(struct lockstat_map *map,
+                                     struct lock_class *class) {
+  map->class = class;
+  map->acquired_at = 0;
+}
+
+/* Give @map the class of the calling site, named after the lock expression */
+#define lockstat_init_site(map, lockname)                                      \
+  do {                                                                         \
+    static struct lock_class __lock_class = {.name = lockname};                \
+    lockstat_init_map((map), &__lock_class);                                   \
+  } while (0)
+
+/**
+ * lockstat_init - Publish /proc/lock_stat
+ */
+void lockstat_init(void);
+
+#else /* !CONFIG_LOCK_STAT */
+
+#define lockstat_contended(map, start, ip) do { } while (0)
+#define lockstat_acquired(map, exclusive)  do { } while (0)
+#define lockstat_released(map)             do { } while (0)
+
+#endif /* CONFIG_LOCK_STAT */
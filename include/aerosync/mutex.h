@@ -3,6 +3,7 @@
 #include <aerosync/sched/sched.h>
 #include <aerosync/spinlock.h>
 #include <aerosync/wait.h>
+#include <aerosync/mcs.h>
 
 /**
  * @file include/aerosync/mutex.h
@@ -10,26 +11,37 @@
  *
  * Mutexes are sleeping locks. When a task attempts to acquire a mutex that is
  * already held, it will sleep until the mutex is released.
+ *
+ * The owner word holds the owning task with state flags in its low bits, so
+ * an uncontended lock or unlock is a single cmpxchg. Contenders spin while
+ * the owner is running on another CPU and only then queue up to sleep.
  */
 
 struct mutex {
-  spinlock_t lock; /* Spinlock to protect mutex state */
-  int count; /* 0 = locked, 1 = unlocked */
-  struct task_struct *owner;
-  wait_queue_head_t wait_q;
-  
+#ifdef CONFIG_LOCK_STAT
+  struct lockstat_map dep;
+#endif
+  unsigned long owner;  /* Owning task | MUTEX_FLAG_*, 0 = unlocked */
+  spinlock_t wait_lock; /* Protects waiters */
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+  mcs_lock_t osq; /* Optimistic spinners queue here, one at the owner */
+#endif
+
   /* Priority Inheritance fields */
-  struct list_head waiters; /* List of tasks waiting on this mutex, sorted by priority */
+  struct list_head waiters; /* Sleeping tasks, FIFO */
   bool pi_enabled;
 };
 
 typedef struct mutex mutex_t;
 
+#define MUTEX_FLAG_WAITERS 0x01UL /* Unlock must wake the first waiter */
+#define MUTEX_FLAG_HANDOFF 0x02UL /* First waiter starves: unlock hands over */
+#define MUTEX_FLAGS        0x07UL
+#define MUTEX_OWNER_EARLY  0x08UL /* Held before there is a current task */
+
 #define MUTEX_INITIALIZER(name)                                                \
-  {.lock = 0,                                                                  \
-   .count = 1,                                                                 \
-   .owner = nullptr,                                                              \
-   .wait_q = __WAIT_QUEUE_HEAD_INITIALIZER(name.wait_q),                       \
+  {.owner = 0,                                                                 \
+   .wait_lock = SPINLOCK_INIT,                                                 \
    .waiters = LIST_HEAD_INIT(name.waiters),                                    \
    .pi_enabled = true}
 
@@ -43,6 +55,15 @@ typedef struct mutex mutex_t;
  */
 void mutex_init(mutex_t *m);
 
+#ifdef CONFIG_LOCK_STAT
+#define mutex_init(m)                                                          \
+  do {                                                                         \
+    mutex_t *__m = (m);                                                        \
+    (mutex_init)(__m);                                                         \
+    lockstat_init_site(&__m->dep, #m);                                         \
+  } while (0)
+#endif
+
 /**
  * Lock a mutex (blocks if already held)
  * @param m Mutex to lock
@@ -67,4 +88,16 @@ int mutex_trylock(mutex_t *m);
  * @param m Mutex to check
  * @return 1 if held, 0 if free
  */
-static inline int mutex_is_locked(mutex_t *m) { return m->count == 0; }
\ No newline at end of file
+static inline int mutex_is_locked(mutex_t *m) {
+  return (READ_ONCE(m->owner) & ~MUTEX_FLAGS) != 0;
+}
+
+/**
+ * Get the task holding a mutex
+ * @param m Mutex to check
+ * @return Owning task, nullptr if free or held from early boot
+ */
+static inline struct task_struct *mutex_owner(mutex_t *m) {
+  unsigned long owner = READ_ONCE(m->owner) & ~MUTEX_FLAGS;
+  return owner == MUTEX_OWNER_EARLY ? nullptr : (struct task_struct *)owner;
+}
\ No newline at end of file
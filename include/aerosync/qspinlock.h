@@ -0,0 +1,85 @@
+#pragma once
+
+#include <compiler.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/atomic.h>
+
+/**
+ * @file include/aerosync/qspinlock.h
+ * @brief Queued spinlock
+ *
+ * A 4-byte FIFO spinlock. An uncontended acquire is one cmpxchg. The first
+ * contender sets a pending bit and spins on the lock word next to the owner;
+ * everyone after that queues on one of its CPU's MCS nodes and spins on its
+ * own cache line until the queue head hands over.
+ *
+ * Lock word layout:
+ *   bits  0- 7: locked byte
+ *   bits  8-15: pending byte
+ *   bits 16-17: tail index (which of the CPU's nodes is queued)
+ *   bits 18-31: tail CPU + 1 (0 means the queue is empty)
+ */
+
+struct qspinlock {
+  union {
+    uint32_t val;
+    struct {
+      uint8_t locked;
+      uint8_t pending;
+    };
+    struct {
+      uint16_t locked_pending;
+      uint16_t tail;
+    };
+  };
+};
+
+#define QSPINLOCK_INIT { .val = 0 }
+
+/* One node per nesting level: task, softirq, hardirq, NMI */
+#define QSPINLOCK_MAX_NODES 4
+
+#define _Q_LOCKED_VAL          (1U << 0)
+#define _Q_LOCKED_MASK         0x000000ffU
+#define _Q_PENDING_VAL         (1U << 8)
+#define _Q_PENDING_MASK        0x0000ff00U
+#define _Q_LOCKED_PENDING_MASK 0x0000ffffU
+#define _Q_TAIL_IDX_OFFSET     16
+#define _Q_TAIL_IDX_MASK       0x00030000U
+#define _Q_TAIL_CPU_OFFSET     18
+#define _Q_TAIL_MASK           0xffff0000U
+
+void queued_spin_lock_slowpath(struct qspinlock *lock, uint32_t val);
+
+static __always_inline int queued_spin_trylock(struct qspinlock *lock) {
+  uint32_t val = READ_ONCE(lock->val);
+
+  if (unlikely(val))
+    return 0;
+  return try_cmpxchg(&lock->val, &val, _Q_LOCKED_VAL);
+}
+
+static __always_inline void queued_spin_lock(struct qspinlock *lock) {
+  uint32_t val = 0;
+
+  if (likely(try_cmpxchg(&lock->val, &val, _Q_LOCKED_VAL)))
+    return;
+  queued_spin_lock_slowpath(lock, val);
+}
+
+static __always_inline void queued_spin_unlock(struct qspinlock *lock) {
+  __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static __always_inline int queued_spin_is_locked(struct qspinlock *lock) {
+  return READ_ONCE(lock->val) != 0;
+}
+
+#ifdef CONFIG_SPINLOCK_BENCH
+/**
+ * spinlock_bench - Ticket vs queued lock contention microbenchmark
+ *
+ * Needs the scheduler and all CPUs online; run from kernel_init().
+ */
+void spinlock_bench(void);
+#endif
@@ -42,12 +42,15 @@ struct rcu_state {
     struct task_struct *gp_kthread;
 };
 
+struct rcu_nocb_group;
+
 /**
  * struct rcu_data - Per-CPU RCU state
  */
 struct rcu_data {
     unsigned long gp_seq;      /* GP number this CPU is waiting for */
     bool qs_pending;           /* True if this CPU needs a quiescent state */
+    bool exp_pending;          /* The expedited GP in flight waits for this CPU */
     
     struct rcu_node *mynode;   /* Leaf node for this CPU */
     int cpu;
@@ -60,6 +63,17 @@ struct rcu_data {
     struct rcu_head **wait_tail;
     
     struct task_struct *rcu_kthread;
+
+#ifdef CONFIG_RCU_NOCB_CPU
+    bool nocb;                 /* Callbacks are run by the node's rcuog kthread */
+    spinlock_t nocb_lock;      /* Protects the callback lists of a nocb CPU */
+    unsigned long nocb_gp_seq; /* GP the offloaded wait list is waiting for */
+    struct rcu_nocb_group *nocb_group;
+#endif
+
+#ifdef CONFIG_RCU_BENCH
+    uint64_t cb_local_ns;      /* Time spent invoking callbacks on this CPU */
+#endif
 };
 
 extern struct rcu_state rcu_state;
@@ -73,4 +87,53 @@ void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
 void synchronize_rcu(void);
 void rcu_barrier(void);
 void rcu_qs(void);
+
+/**
+ * rcu_needs_cpu - Does this CPU still owe RCU work that the tick drives?
+ */
+bool rcu_needs_cpu(void);
+
+/**
+ * rcu_note_context_switch - Report quiescent states from schedule()
+ *
+ * schedule() never runs inside a read-side critical section, so entering
+ * it is a quiescent state for both normal and expedited grace periods.
+ */
+void rcu_note_context_switch(void);
+
+/**
+ * synchronize_rcu_expedited - Wait for a grace period, quickly
+ *
+ * IPIs every other online CPU instead of waiting for ticks. CPUs outside a
+ * read-side critical section (idle, user mode, preemptible kernel) report
+ * from the IPI; a CPU inside one reports at its next preempt_enable() that
+ * reschedules. Concurrent callers share grace periods. Costs an IPI per
+ * CPU, so keep it off hot paths that can use synchronize_rcu().
+ */
 void synchronize_rcu_expedited(void);
+
+/**
+ * kvfree_call_rcu - Free an object after a grace period
+ * @head: rcu_head inside the object, used only if no batch slot is left
+ * @ptr: the object, from kmalloc() or vmalloc()
+ *
+ * Pointers are collected in per-CPU page-sized arrays that share one grace
+ * period and are freed with kfree_bulk(). Callable from interrupt context.
+ */
+void kvfree_call_rcu(struct rcu_head *head, void *ptr);
+
+#define kvfree_rcu(ptr, rhf)                                                   \
+    do {                                                                       \
+        typeof(ptr) ___p = (ptr);                                              \
+        if (___p)                                                              \
+            kvfree_call_rcu(&___p->rhf, (void *) ___p);                        \
+    } while (0)
+
+#define kfree_rcu(ptr, rhf) kvfree_rcu(ptr, rhf)
+
+#ifdef CONFIG_RCU_BENCH
+/**
+ * rcu_bench - Expedited grace period latency and callback throughput
+ */
+void rcu_bench(void);
+#endif
@@ -13,6 +13,7 @@
 #include <linux/list.h>
 #include <aerosync/atomic.h>
 #include <aerosync/spinlock.h>
+#include <aerosync/workqueue.h>
 
 struct task_struct;
 struct resdomain;
@@ -116,17 +117,39 @@ void resdomain_task_init(struct task_struct *p, struct task_struct *parent);
 void resdomain_task_exit(struct task_struct *p);
 
 /* --- Memory Controller API --- */
+enum rd_mem_event {
+    RD_MEM_EVENT_HIGH = 0, /* Usage went above memory.high */
+    RD_MEM_EVENT_MAX,      /* A charge hit memory.max */
+    RD_MEM_EVENT_OOM,      /* A charge failed after reclaim */
+    RD_MEM_NR_EVENTS
+};
+
 struct mem_rd_state {
     struct resdomain_subsys_state css;
     uint64_t max;
     uint64_t high;
     uint64_t low;
-    atomic64_t usage;
+    atomic64_t usage;  /* Includes bytes pre-charged to per-CPU stocks */
+    atomic64_t events[RD_MEM_NR_EVENTS];
+    struct work_struct high_work; /* Background reclaim above memory.high */
 };
 
+/*
+ * Charges are served from a per-CPU stock of bytes already charged to the
+ * whole hierarchy, refilled in batches; uncharges go back to the stock.
+ * Stocks are drained when a limit is hit.
+ */
 int resdomain_charge_mem(struct resdomain *rd, uint64_t bytes, bool force);
 void resdomain_uncharge_mem(struct resdomain *rd, uint64_t bytes);
 
+/**
+ * resdomain_drain_stocks - Return every CPU's pre-charged bytes
+ * @rd: Only drain stocks of @rd and its descendants; nullptr for all
+ *
+ * May sleep.
+ */
+void resdomain_drain_stocks(struct resdomain *rd);
+
 /* --- PID Controller API --- */
 struct pid_rd_state {
     struct resdomain_subsys_state css;
@@ -3,28 +3,62 @@
 #include <aerosync/spinlock.h>
 #include <aerosync/atomic.h>
 #include <aerosync/wait.h>
+#include <aerosync/mcs.h>
+#include <linux/list.h>
 
 /**
  * @file include/aerosync/rw_semaphore.h
  * @brief Read-Write Semaphore implementation for AeroSync
+ *
+ * Queued and writer-preferring: once anybody sleeps on the semaphore, new
+ * readers queue behind them instead of barging in. Waiters are woken in
+ * FIFO order, all readers at the head of the queue in one batch. A writer
+ * that keeps losing the race to spinners sets a handoff bit that reserves
+ * the next release for it.
  */
 
+struct task_struct;
+
 struct rw_semaphore {
-    atomic_t count;
-    spinlock_t wait_lock;
-    wait_queue_head_t wait_list;
+#ifdef CONFIG_LOCK_STAT
+    struct lockstat_map dep;
+#endif
+    unsigned long count;        /* Readers << RWSEM_READER_SHIFT | state bits */
+    struct task_struct *owner;  /* Write owner, for optimistic spinning */
+    spinlock_t wait_lock;       /* Protects wait_list */
+    struct list_head wait_list; /* FIFO of sleeping waiters */
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+    mcs_lock_t osq;             /* Spinning writers queue here */
+#endif
 };
 
-#define RWSEM_UNLOCKED_VALUE 0x00000000
-#define RWSEM_ACTIVE_BIAS    0x00000001
-#define RWSEM_WAITING_BIAS   (-0x00010000)
-#define RWSEM_ACTIVE_READ_BIAS RWSEM_ACTIVE_BIAS
-#define RWSEM_ACTIVE_WRITE_BIAS (RWSEM_WAITING_BIAS + RWSEM_ACTIVE_BIAS)
+#define RWSEM_WRITER_LOCKED  (1UL << 0)
+#define RWSEM_FLAG_WAITERS   (1UL << 1)
+#define RWSEM_FLAG_HANDOFF   (1UL << 2)
+#define RWSEM_READER_SHIFT   8
+#define RWSEM_READER_BIAS    (1UL << RWSEM_READER_SHIFT)
+#define RWSEM_READER_MASK    (~(RWSEM_READER_BIAS - 1))
+#define RWSEM_LOCK_MASK      (RWSEM_WRITER_LOCKED | RWSEM_READER_MASK)
+
+/* Anything that sends a reader down the slow path */
+#define RWSEM_READ_FAILED_MASK                                                 \
+    (RWSEM_WRITER_LOCKED | RWSEM_FLAG_WAITERS | RWSEM_FLAG_HANDOFF)
+
+#define RWSEM_UNLOCKED_VALUE 0UL
 
 int rwsem_is_locked(const struct rw_semaphore *sem);
 int rwsem_is_write_locked(const struct rw_semaphore *sem);
 
 void rwsem_init(struct rw_semaphore *sem);
+
+#ifdef CONFIG_LOCK_STAT
+#define rwsem_init(sem)                                                        \
+    do {                                                                       \
+        struct rw_semaphore *__sem = (sem);                                    \
+        (rwsem_init)(__sem);                                                   \
+        lockstat_init_site(&__sem->dep, #sem);                                 \
+    } while (0)
+#endif
 void down_read(struct rw_semaphore *sem);
 int down_read_trylock(struct rw_semaphore *sem);
 void up_read(struct rw_semaphore *sem);
@@ -32,3 +66,12 @@ void down_write(struct rw_semaphore *sem);
 int down_write_trylock(struct rw_semaphore *sem);
 void up_write(struct rw_semaphore *sem);
 void downgrade_write(struct rw_semaphore *sem);
+
+#ifdef CONFIG_RWSEM_BENCH
+/**
+ * rwsem_bench - Mixed reader/writer stress benchmark
+ *
+ * Needs the scheduler and all CPUs online; run from kernel_init().
+ */
+void rwsem_bench(void);
+#endif
@@ -64,6 +64,30 @@ static inline void cpumask_clear_cpu(int cpu, struct cpumask *mask) {
   }
 }
 
+/**
+ * cpumask_set_cpu_atomic - Set a CPU in a mask shared with other CPUs
+ * @cpu: CPU number to set
+ * @mask: Target cpumask
+ *
+ * Locked RMW, also acts as a full memory barrier.
+ */
+static inline void cpumask_set_cpu_atomic(int cpu, struct cpumask *mask) {
+  if (cpu >= 0 && cpu < MAX_CPUS) {
+    __atomic_fetch_or(&mask->bits[cpu / 64], 1ULL << (cpu % 64), __ATOMIC_SEQ_CST);
+  }
+}
+
+/**
+ * cpumask_clear_cpu_atomic - Clear a CPU from a mask shared with other CPUs
+ * @cpu: CPU number to clear
+ * @mask: Target cpumask
+ */
+static inline void cpumask_clear_cpu_atomic(int cpu, struct cpumask *mask) {
+  if (cpu >= 0 && cpu < MAX_CPUS) {
+    __atomic_fetch_and(&mask->bits[cpu / 64], ~(1ULL << (cpu % 64)), __ATOMIC_SEQ_CST);
+  }
+}
+
 /**
  * cpumask_test_cpu - Test if a CPU is set in the mask
  * @cpu: CPU number to test
@@ -12,6 +12,8 @@
 struct sched_class;
 struct fpu_state;
 struct psi_group;
+struct blk_plug;
+struct worker;
 
 /* Task States */
 /* Wait queue sleep states */
@@ -46,6 +48,15 @@ struct psi_group;
 #define SCHED_IDLE 5
 #define SCHED_DEADLINE 6
 
+/* Sizes the per-node NUMA balancing counters; matches mm/zone.h */
+#ifndef MAX_NUMNODES
+#ifndef CONFIG_MAX_NUMNODES
+#define MAX_NUMNODES 8
+#else
+#define MAX_NUMNODES CONFIG_MAX_NUMNODES
+#endif
+#endif
+
 /* Task Flags */
 #define PF_KTHREAD 0x00200000   /* I am a kernel thread */
 #define PF_EXITING 0x00000004   /* Getting shut down */
@@ -231,6 +242,17 @@ struct task_struct {
   int cpu;                     /* Current/last CPU */
   int node_id;                 /* NUMA node ID of the task (usually based on CPU) */
 
+#ifdef CONFIG_MM_NUMA_BALANCING
+  /*
+   * NUMA balancing: hinting faults per memory node, decayed once per scan
+   * pass of the mm, and the node the task is steered towards.
+   */
+  unsigned long numa_faults[MAX_NUMNODES];
+  unsigned long numa_faults_buf[MAX_NUMNODES];
+  int numa_preferred_nid;
+  int numa_scan_seq;
+#endif
+
   /*
    * Priority Inheritance (PI) support
    */
@@ -269,6 +291,16 @@ struct task_struct {
   unsigned long nr_dirtied;
   unsigned long nr_dirtied_pause;
 
+  /*
+   * Block I/O plugging (flushed when the task blocks)
+   */
+  struct blk_plug *plug;
+
+  /*
+   * Workqueue worker this task runs as (PF_WQ_WORKER)
+   */
+  struct worker *worker;
+
   /*
    * Context for context switching
    */
@@ -543,6 +575,8 @@ void task_sleep(void);
 void task_wake_up(struct task_struct *task);
 void task_wake_up_all(void);
 long schedule_timeout(uint64_t ns);
+/* Like schedule_timeout(), but on an hrtimer: no tick rounding */
+long schedule_hrtimeout(uint64_t ns);
 
 /* Priority Inheritance (PI) functions */
 void pi_boost_prio(struct task_struct *owner, struct task_struct *waiter);
@@ -569,6 +603,21 @@ extern void deactivate_task(struct rq *rq, struct task_struct *p, int flags);
 extern struct rq *this_rq(void);
 DECLARE_PER_CPU(struct rq, runqueues);
 
+/**
+ * task_on_cpu - check whether a task is running right now
+ *
+ * Racy by design, for optimistic spinning on lock owners. @p may be a task
+ * that just exited; task_structs live in kmalloc memory that stays mapped,
+ * and a stale cpu only makes the curr check fail.
+ */
+static inline bool task_on_cpu(struct task_struct *p) {
+  int cpu = READ_ONCE(p->cpu);
+
+  if (cpu < 0 || cpu >= MAX_CPUS)
+    return false;
+  return READ_ONCE(per_cpu_ptr(runqueues, cpu)->curr) == p;
+}
+
 /**
  * task_prio - return the priority of the task
  */
@@ -2,6 +2,8 @@
 
 #include <arch/x86_64/cpu.h>
 #include <arch/x86_64/atomic.h>
+#include <aerosync/qspinlock.h>
+#include <aerosync/lockstat.h>
 #ifndef CONFIG_DEBUG_SPINLOCK
 #include <aerosync/errno.h>
 #endif
@@ -9,9 +11,30 @@
 #define DEADLOCK_TIMEOUT_CYCLES 100000000ULL
 #define MAX_BACKOFF_CYCLES 1024
 
-#ifdef CONFIG_TICKET_SPINLOCKS
+#ifdef CONFIG_QUEUED_SPINLOCKS
 
 typedef struct {
+#ifdef CONFIG_LOCK_STAT
+  struct lockstat_map dep;
+#endif
+  struct qspinlock q;
+#ifdef CONFIG_DEBUG_SPINLOCK
+  int owner_cpu;
+#endif
+} spinlock_t;
+
+#ifdef CONFIG_DEBUG_SPINLOCK
+#define SPINLOCK_INIT { .q = QSPINLOCK_INIT, .owner_cpu = -1 }
+#else
+#define SPINLOCK_INIT { .q = QSPINLOCK_INIT }
+#endif
+
+#elif defined(CONFIG_TICKET_SPINLOCKS)
+
+typedef struct {
+#ifdef CONFIG_LOCK_STAT
+  struct lockstat_map dep;
+#endif
   union {
     uint32_t val;
     struct {
@@ -30,10 +53,13 @@ typedef struct {
 #define SPINLOCK_INIT { .val = 0 }
 #endif
 
-#else /* !CONFIG_TICKET_SPINLOCKS */
+#else /* test-and-set */
 
 // A spinlock is a simple integer flag stored inline; pass its address to APIs
 typedef struct {
+#ifdef CONFIG_LOCK_STAT
+  struct lockstat_map dep;
+#endif
   volatile int lock;
 #ifdef CONFIG_DEBUG_SPINLOCK
   int owner_cpu;
@@ -58,11 +84,53 @@ static inline void spinlock_init(spinlock_t *lock) {
   *lock = (spinlock_t)SPINLOCK_INIT;
 }
 
-#ifdef CONFIG_TICKET_SPINLOCKS
+#ifdef CONFIG_LOCK_STAT
+/* Locks initialised at runtime belong to the class of the call site */
+#define spinlock_init(lock)                                                    \
+  do {                                                                         \
+    spinlock_t *__sl = (lock);                                                 \
+    (spinlock_init)(__sl);                                                     \
+    lockstat_init_site(&__sl->dep, #lock);                                     \
+  } while (0)
+#endif
+
+#ifdef CONFIG_QUEUED_SPINLOCKS
 
 extern uint32_t smp_get_id(void);
 
-static inline void spinlock_lock(spinlock_t *lock) {
+static inline void __spinlock_lock(spinlock_t *lock) {
+  queued_spin_lock(&lock->q);
+#ifdef CONFIG_DEBUG_SPINLOCK
+  lock->owner_cpu = (int)smp_get_id();
+#endif
+}
+
+static inline void __spinlock_unlock(spinlock_t *lock) {
+#ifdef CONFIG_DEBUG_SPINLOCK
+  lock->owner_cpu = -1;
+#endif
+  queued_spin_unlock(&lock->q);
+}
+
+static inline int __spinlock_trylock(spinlock_t *lock) {
+  if (queued_spin_trylock(&lock->q)) {
+#ifdef CONFIG_DEBUG_SPINLOCK
+    lock->owner_cpu = (int)smp_get_id();
+#endif
+    return 1;
+  }
+  return 0;
+}
+
+static inline int spinlock_is_locked(spinlock_t *lock) {
+  return queued_spin_is_locked(&lock->q);
+}
+
+#elif defined(CONFIG_TICKET_SPINLOCKS)
+
+extern uint32_t smp_get_id(void);
+
+static inline void __spinlock_lock(spinlock_t *lock) {
   uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
   while (READ_ONCE(lock->owner) != ticket) {
     cpu_relax();
@@ -73,14 +141,14 @@ static inline void spinlock_lock(spinlock_t *lock) {
 #endif
 }
 
-static inline void spinlock_unlock(spinlock_t *lock) {
+static inline void __spinlock_unlock(spinlock_t *lock) {
 #ifdef CONFIG_DEBUG_SPINLOCK
   lock->owner_cpu = -1;
 #endif
   __atomic_fetch_add(&lock->owner, 1, __ATOMIC_RELEASE);
 }
 
-static inline int spinlock_trylock(spinlock_t *lock) {
+static inline int __spinlock_trylock(spinlock_t *lock) {
   uint32_t val = READ_ONCE(lock->val);
   uint16_t owner = (uint16_t)(val & 0xFFFF);
   uint16_t next = (uint16_t)(val >> 16);
@@ -111,10 +179,10 @@ static inline uint32_t spinlock_next(spinlock_t *lock) {
   return READ_ONCE(lock->next);
 }
 
-#else /* !CONFIG_TICKET_SPINLOCKS */
+#else /* test-and-set */
 
 // Advanced spinlock with exponential backoff
-static inline void spinlock_lock(spinlock_t *lock) {
+static inline void __spinlock_lock(spinlock_t *lock) {
   uint32_t backoff = 1;
 
   while (__atomic_test_and_set(&lock->lock, __ATOMIC_ACQUIRE)) {
@@ -132,7 +200,7 @@ static inline void spinlock_lock(spinlock_t *lock) {
 #endif
 }
 
-static inline int spinlock_trylock(spinlock_t *lock) {
+static inline int __spinlock_trylock(spinlock_t *lock) {
   if (!__atomic_test_and_set(&lock->lock, __ATOMIC_ACQUIRE)) {
 #ifdef CONFIG_DEBUG_SPINLOCK
     lock->owner_cpu = (int)smp_get_id();
@@ -146,7 +214,7 @@ static inline int spinlock_is_locked(spinlock_t *lock) {
   return lock->lock;
 }
 
-static inline void spinlock_unlock(spinlock_t *lock) {
+static inline void __spinlock_unlock(spinlock_t *lock) {
 #ifdef CONFIG_DEBUG_SPINLOCK
   lock->owner_cpu = -1;
 #endif
@@ -155,15 +223,45 @@ static inline void spinlock_unlock(spinlock_t *lock) {
 
 #endif
 
+/*
+ * The implementations above only take and drop the lock; statistics are
+ * layered on here. Always inlined so LOCKSTAT_THIS_IP names the caller.
+ */
+static __always_inline void spinlock_lock(spinlock_t *lock) {
+#ifdef CONFIG_LOCK_STAT
+  if (unlikely(!__spinlock_trylock(lock))) {
+    uint64_t start = lockstat_clock();
+    __spinlock_lock(lock);
+    lockstat_contended(&lock->dep, start, LOCKSTAT_THIS_IP);
+  }
+  lockstat_acquired(&lock->dep, true);
+#else
+  __spinlock_lock(lock);
+#endif
+}
+
+static inline int spinlock_trylock(spinlock_t *lock) {
+  if (!__spinlock_trylock(lock))
+    return 0;
+  lockstat_acquired(&lock->dep, true);
+  return 1;
+}
+
+static inline void spinlock_unlock(spinlock_t *lock) {
+  lockstat_released(&lock->dep);
+  __spinlock_unlock(lock);
+}
+
 static inline uint32_t spinlock_get_cpu(spinlock_t *lock) {
-#if CONFIG_DEBUG_SPINLOCK && CONFIG_TICKET_SPINLOCKS
+#if defined(CONFIG_DEBUG_SPINLOCK) && \
+    (defined(CONFIG_TICKET_SPINLOCKS) || defined(CONFIG_QUEUED_SPINLOCKS))
   return READ_ONCE(lock->owner_cpu);
 #else
   return -ENODEV;
 #endif
 }
 
-static inline irq_flags_t spinlock_lock_irqsave(spinlock_t *lock) {
+static __always_inline irq_flags_t spinlock_lock_irqsave(spinlock_t *lock) {
   irq_flags_t flags = save_irq_flags();
   cpu_cli();
   spinlock_lock(lock);
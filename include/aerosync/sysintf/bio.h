@@ -0,0 +1,256 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/aerosync/sysintf/bio.h
+ * @brief Asynchronous block I/O (bio) and request queue interface
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * A bio describes one contiguous range of sectors backed by a list of
+ * page segments. Bios are merged into requests on a per-disk request queue
+ * (back/front merging of adjacent sectors), optionally batched per task
+ * through a plug, dispatched to the driver and completed from BLOCK_SOFTIRQ.
+ */
+
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/atomic.h>
+#include <aerosync/spinlock.h>
+#include <aerosync/wait.h>
+#include <linux/list.h>
+#include <linux/llist.h>
+#include <mm/page.h>
+
+struct block_device;
+struct request_queue;
+struct folio;
+
+#ifndef BIO_INLINE_VECS
+#define BIO_INLINE_VECS 4
+#endif
+
+#ifndef BIO_MAX_VECS
+#define BIO_MAX_VECS 256
+#endif
+
+/* Operations (low byte of bi_opf / cmd_flags) */
+#define REQ_OP_READ   0
+#define REQ_OP_WRITE  1
+#define REQ_OP_FLUSH  2
+#define REQ_OP_MASK   0xff
+
+/* Modifier flags */
+#define REQ_SYNC      (1u << 8)  /* Caller is waiting, dispatch ahead of async I/O */
+#define REQ_NOMERGE   (1u << 9)  /* Never merge this bio with others */
+#define REQ_META      (1u << 10) /* Filesystem metadata */
+
+/* Completion status */
+#define BLK_STS_OK     0
+
+struct bio_vec {
+  struct page *bv_page;
+  uint32_t bv_len;
+  uint32_t bv_offset;
+};
+
+struct bio;
+typedef void (*bio_end_io_t)(struct bio *bio);
+
+/**
+ * struct bio - One in-flight block I/O
+ *
+ * bi_sector is expressed in logical blocks of bi_bdev (block_size bytes).
+ * Partition bios are remapped to the parent disk at submission time.
+ */
+struct bio {
+  struct bio *bi_next;          /* Chain inside a request */
+  struct block_device *bi_bdev;
+  uint32_t bi_opf;              /* REQ_OP_* | REQ_* flags */
+  int bi_status;                /* 0 or negative errno */
+
+  uint64_t bi_sector;
+  uint32_t bi_size;             /* Total payload in bytes */
+
+  uint16_t bi_vcnt;
+  uint16_t bi_max_vecs;
+  struct bio_vec *bi_io_vec;
+
+  bio_end_io_t bi_end_io;
+  void *bi_private;
+
+  struct bio_vec bi_inline_vecs[BIO_INLINE_VECS];
+};
+
+#define bio_op(bio) ((bio)->bi_opf & REQ_OP_MASK)
+#define bio_data_dir(bio) (bio_op(bio) == REQ_OP_WRITE)
+
+#define bio_for_each_bvec(bv, bio, i) \
+  for ((i) = 0, (bv) = (bio)->bi_io_vec; (i) < (bio)->bi_vcnt; (i)++, (bv)++)
+
+/**
+ * struct request - A group of sector-contiguous bios dispatched as one unit
+ */
+struct request {
+  struct list_head queuelist;   /* Node in q->queue or plug->list */
+  struct llist_node done_node;  /* Node in the per-CPU completion list */
+  struct request_queue *q;
+
+  uint32_t cmd_flags;
+  int status;
+  uint64_t sector;
+  uint32_t nr_sectors;
+  uint32_t nr_segments;
+
+  struct bio *bio;
+  struct bio *biotail;
+
+  uint64_t start_ns;            /* Allocation time, for latency stats */
+  void *driver_data;            /* Owned by the driver between queue_rq and end */
+};
+
+#define rq_op(rq) ((rq)->cmd_flags & REQ_OP_MASK)
+
+/**
+ * struct request_queue - Per-disk pending request list and dispatcher state
+ *
+ * Pending requests are kept sorted by sector and dispatched in C-LOOK order
+ * (ascending from the last dispatched position, wrapping at the end).
+ */
+struct request_queue {
+  spinlock_t lock;
+  struct list_head queue;       /* Pending requests, sorted by sector */
+  struct request *last_merge;   /* Merge hint */
+  uint64_t head_pos;            /* Sector following the last dispatch */
+
+  struct block_device *bdev;
+  uint32_t block_size;
+  uint32_t max_sectors;         /* Per-request limit in logical blocks */
+  uint32_t max_segments;
+  uint32_t nr_requests;         /* Allocated request limit (congestion) */
+  uint32_t queue_depth;         /* Requests outstanding at the driver */
+
+  atomic_t nr_allocated;        /* Requests alive (pending, plugged or in flight) */
+  uint32_t nr_pending;          /* Requests on q->queue */
+  uint32_t in_flight;           /* Requests handed to the driver */
+  bool dying;
+
+  wait_queue_head_t dispatch_wait;
+  wait_queue_head_t congestion_wait;
+  struct task_struct *dispatcher;
+
+  /* Statistics */
+  atomic_long_t nr_bios;
+  atomic_long_t nr_back_merges;
+  atomic_long_t nr_front_merges;
+  atomic_long_t nr_dispatched;
+  atomic_long_t nr_completed;
+  atomic_long_t total_latency_ns;
+};
+
+/**
+ * struct blk_plug - Per-task batch of requests not yet visible to the queue
+ *
+ * Bios submitted while a plug is active are merged into plugged requests
+ * and only inserted into their queues on blk_finish_plug(), when the plug
+ * grows beyond its limit, or when the task goes to sleep.
+ */
+struct blk_plug {
+  struct list_head list;
+  uint32_t count;
+};
+
+/* --- Bio lifecycle --- */
+
+/**
+ * bio_alloc - Allocate a bio with room for @nr_vecs segments
+ * @bdev: Target device (disk or partition)
+ * @nr_vecs: Maximum number of segments (clamped to BIO_MAX_VECS)
+ * @opf: REQ_OP_* | REQ_* flags
+ * @return New bio or nullptr on allocation failure
+ */
+struct bio *bio_alloc(struct block_device *bdev, uint16_t nr_vecs, uint32_t opf);
+
+/**
+ * bio_put - Free a bio once its completion has run
+ */
+void bio_put(struct bio *bio);
+
+/**
+ * bio_add_page - Append a page segment to a bio
+ * @return Number of bytes added (0 if the bio is full)
+ */
+uint32_t bio_add_page(struct bio *bio, struct page *page, uint32_t len, uint32_t offset);
+
+/**
+ * bio_add_folio - Append a whole folio to a bio
+ * @return true on success
+ */
+bool bio_add_folio(struct bio *bio, struct folio *folio);
+
+/**
+ * bio_endio - Complete a bio with its current bi_status
+ */
+void bio_endio(struct bio *bio);
+
+/* --- Submission --- */
+
+/**
+ * submit_bio - Queue a bio for asynchronous execution
+ *
+ * The bio's bi_end_io is called from BLOCK_SOFTIRQ (or from the submitter on
+ * immediate failure). May sleep when the target queue is congested.
+ */
+void submit_bio(struct bio *bio);
+
+/**
+ * submit_bio_wait - Submit a bio and sleep until it completes
+ * @return 0 or the bio's negative completion status
+ */
+int submit_bio_wait(struct bio *bio);
+
+/* --- Plugging --- */
+
+void blk_start_plug(struct blk_plug *plug);
+void blk_finish_plug(struct blk_plug *plug);
+
+/**
+ * blk_flush_plug - Push all requests held by @plug to their queues
+ *
+ * Never sleeps; called by the scheduler when a plugged task blocks.
+ */
+void blk_flush_plug(struct blk_plug *plug);
+
+/* --- Queue management (block core / drivers) --- */
+
+/**
+ * blk_init_queue - Create the request queue and dispatcher of a disk
+ */
+struct request_queue *blk_init_queue(struct block_device *bdev);
+
+/**
+ * blk_cleanup_queue - Fail pending requests and free the queue
+ */
+void blk_cleanup_queue(struct request_queue *q);
+
+/**
+ * blk_end_request - Report completion of a request dispatched via queue_rq
+ * @status: 0 or negative errno
+ *
+ * Safe to call from hard IRQ context; bio completions run in BLOCK_SOFTIRQ.
+ */
+void blk_end_request(struct request *rq, int status);
+
+/**
+ * blk_rq_bytes - Payload size of a request in bytes
+ */
+static inline uint64_t blk_rq_bytes(struct request *rq) {
+  return (uint64_t) rq->nr_sectors * rq->q->block_size;
+}
+
+/**
+ * blk_queue_dump_stats - Print merge/dispatch statistics of a queue
+ */
+void blk_queue_dump_stats(struct request_queue *q);
+
+void blk_softirq_init(void);
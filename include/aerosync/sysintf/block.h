@@ -10,6 +10,7 @@
 #pragma once
 
 #include <aerosync/mutex.h>
+#include <aerosync/sysintf/bio.h>
 #include <aerosync/sysintf/device.h>
 #include <aerosync/types.h>
 #include <linux/list.h>
@@ -55,6 +56,18 @@ struct block_operations {
    * Optional: Close/Release the device
    */
   void (*release)(struct block_device *dev);
+
+  /**
+   * Optional: Start a request asynchronously
+   * @param dev The block device
+   * @param rq Request to execute (sector-contiguous bio chain)
+   * @return 0 if accepted, negative error code otherwise
+   *
+   * The driver calls blk_end_request() once the transfer finishes, typically
+   * from its interrupt handler. Drivers without this hook are driven through
+   * read/write by the queue dispatcher, one request at a time.
+   */
+  int (*queue_rq)(struct block_device *dev, struct request *rq);
 };
 
 /**
@@ -75,6 +88,8 @@ struct block_device {
   struct list_head node; // Entry in global block device list
   mutex_t lock;          // Device-level exclusion
 
+  struct request_queue *queue; // Async request queue (disks only)
+
   /* Partition Support */
   struct block_device *parent_disk; /* If this is a partition, points to the master disk */
   uint64_t partition_offset;        /* Offset in sectors from the start of the parent disk */
@@ -117,7 +132,9 @@ int block_partition_scan(struct block_device *dev);
 /* --- High-level I/O API --- */
 
 /**
- * Standardized read/write helpers that handle locking and validation
+ * Standardized read/write helpers that handle validation. The buffer is
+ * wrapped in bios and pushed through submit_bio_wait(), so these calls are
+ * scheduled and merged by the request queue like any other I/O.
  */
 int block_read(struct block_device *dev, void *buffer, uint64_t start_sector,
                uint32_t sector_count);
@@ -20,6 +20,7 @@ struct device_driver;
 struct bus_type;
 struct class;
 struct dma_map_ops;
+struct iommu_domain;
 
 /**
  * struct device_driver - The basic driver structure
@@ -72,6 +73,7 @@ struct device {
   struct list_head class_node; /* node in class->devices list */
 
   struct dma_map_ops *dma_ops;
+  struct iommu_domain *iommu_domain; /* default domain, nullptr if untranslated */
 
   void (*release)(struct device *dev);
 };
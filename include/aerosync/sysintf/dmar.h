@@ -36,6 +36,8 @@ typedef struct {
   } __packed path[];
 } __packed dmar_device_scope_t;
 
+#define DMAR_INCLUDE_PCI_ALL 0x01 /* DRHD flag: unit covers every device of its segment */
+
 /* DRHD Structure */
 typedef struct {
   struct list_head node;
@@ -44,6 +44,13 @@ void ic_disable_irq(uint32_t irq_line);
 void ic_send_eoi(uint32_t interrupt_number);
 void ic_set_timer(uint32_t frequency_hz);
 uint32_t ic_get_frequency(void);
+
+// One-shot timer programming (high-resolution timers)
+void ic_timer_stop(void);
+void ic_timer_oneshot(uint32_t microseconds);
+void ic_timer_tsc_deadline(uint64_t deadline);
+int ic_timer_has_tsc_deadline(void);
+int ic_timer_has_oneshot(void);
 void ic_send_ipi(uint8_t dest_apic_id, uint8_t vector, uint32_t delivery_mode);
 uint8_t ic_lapic_get_id(void);
 void ic_register_lapic_get_id_early();
@@ -22,7 +22,18 @@ enum iommu_cap {
   IOMMU_CAP_INTR_REMAP,      /* IOMMU supports interrupt remapping */
 };
 
+enum iommu_domain_type {
+  IOMMU_DOMAIN_UNMANAGED, /* Owner manages the IOVA space via iommu_map() */
+  IOMMU_DOMAIN_DMA,       /* Backs the DMA API of its devices */
+  IOMMU_DOMAIN_IDENTITY,  /* IOVA == physical address */
+};
+
+/* iommu_map() protection flags */
+#define IOMMU_READ  (1 << 0)
+#define IOMMU_WRITE (1 << 1)
+
 struct iommu_ops {
+  int (*probe_device)(struct device *dev); /* 0 if @dev sits behind this IOMMU */
   int (*domain_init)(struct iommu_domain *domain);
   void (*domain_free)(struct iommu_domain *domain);
   int (*attach_dev)(struct iommu_domain *domain, struct device *dev);
@@ -35,6 +46,7 @@ struct iommu_ops {
 
 struct iommu_domain {
   const struct iommu_ops *ops;
+  enum iommu_domain_type type;
   void *priv; /* Driver private data */
   uint64_t pgtable; /* Root of page table */
 };
@@ -46,6 +58,11 @@ int iommu_register_ops(const struct iommu_ops *ops, const struct dma_map_ops *dm
 
 /**
  * @brief Associate a device with its corresponding IOMMU
+ *
+ * Gives the device a default domain: a private DMA domain, or the shared
+ * identity domain with CONFIG_IOMMU_DEFAULT_PASSTHROUGH. Devices probed
+ * before an IOMMU driver registers are remembered and attached to the
+ * identity domain at registration, as they may already have DMA in flight.
  */
 int iommu_probe_device(struct device *dev);
 
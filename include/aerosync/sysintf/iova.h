@@ -0,0 +1,84 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/aerosync/sysintf/iova.h
+ * @brief I/O virtual address allocator
+ * @copyright (C) 2025-2026 assembler-0
+ */
+
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/spinlock.h>
+#include <linux/rbtree.h>
+#include <compiler.h>
+
+/*
+ * IOVA ranges are handed out in IOMMU page frames (4 KiB), top-down below
+ * a limit, each aligned to its size rounded up to a power of two.
+ *
+ * Allocated ranges live in an rbtree. Ranges of up to
+ * 2^(IOVA_RANGE_CACHE_MAX_SIZE - 1) pages are recycled through per-CPU
+ * magazines backed by a per-size depot of full magazines, so map/unmap
+ * heavy workloads rarely touch the tree or its lock.
+ */
+
+#define IOVA_RANGE_CACHE_MAX_SIZE 6   /* Cached sizes: 1, 2, 4 ... 32 pages */
+#define IOVA_MAG_SIZE             127 /* PFNs per magazine */
+#define IOVA_DEPOT_MAX            32  /* Full magazines kept per size */
+
+struct iova {
+  struct rb_node node;
+  unsigned long pfn_hi; /* Inclusive */
+  unsigned long pfn_lo;
+};
+
+struct iova_magazine;
+struct iova_cpu_rcache;
+
+struct iova_rcache {
+  spinlock_t lock;
+  unsigned int depot_size;
+  struct iova_magazine *depot[IOVA_DEPOT_MAX];
+  struct iova_cpu_rcache __percpu *cpu_rcaches;
+};
+
+struct iova_domain {
+  spinlock_t lock;             /* Protects the rbtree */
+  struct rb_root rbroot;
+  struct rb_node *cached_node; /* Top-down searches start here */
+  unsigned long start_pfn;     /* Lowest allocatable PFN */
+  struct iova anchor;          /* Sentinel above every range */
+  struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];
+};
+
+/**
+ * iova_domain_init - Set up an empty IOVA space
+ * @start_pfn: Lowest PFN ever handed out; 0 is never used
+ */
+int iova_domain_init(struct iova_domain *iovad, unsigned long start_pfn);
+
+/**
+ * iova_domain_destroy - Free all ranges and caches
+ */
+void iova_domain_destroy(struct iova_domain *iovad);
+
+/**
+ * alloc_iova_fast - Allocate @size pages at or below @limit_pfn
+ * @return First PFN of the range, 0 if the space is exhausted
+ */
+unsigned long alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
+                              unsigned long limit_pfn);
+
+/**
+ * free_iova_fast - Return a range from alloc_iova_fast() with the same @size
+ */
+void free_iova_fast(struct iova_domain *iovad, unsigned long pfn, unsigned long size);
+
+/**
+ * reserve_iova - Keep [@pfn_lo, @pfn_hi] from ever being allocated
+ *
+ * Only valid before the first allocation of the range's area.
+ */
+int reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo, unsigned long pfn_hi);
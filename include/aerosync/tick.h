@@ -0,0 +1,53 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/aerosync/tick.h
+ * @brief Scheduler tick and tickless (NO_HZ) idle
+ * @copyright (C) 2025-2026 assembler-0
+ */
+
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/hrtimer.h>
+
+struct tick_sched {
+  struct hrtimer sched_timer;  /* Emulated periodic tick (high-res mode) */
+  bool tick_stopped;           /* NO_HZ: idle with the tick stopped */
+  uint64_t idle_entrytime;
+
+  /* Statistics */
+  uint64_t idle_calls;         /* Idle entries that tried to stop the tick */
+  uint64_t idle_sleeps;        /* ... and succeeded */
+  uint64_t idle_sleeptime_ns;  /* Time spent idle with the tick stopped */
+};
+
+/**
+ * tick_setup_cpu - Start the tick on the calling CPU
+ *
+ * Switches to high-resolution one-shot mode when the interrupt controller
+ * supports it, otherwise keeps the periodic hardware tick.
+ */
+void tick_setup_cpu(void);
+
+/**
+ * tick_handle_periodic - Per-tick work: wheel timers and scheduler tick
+ */
+void tick_handle_periodic(void);
+
+/**
+ * tick_nohz_idle_stop_tick - Stop the tick before halting an idle CPU
+ *
+ * Called with interrupts disabled from the idle loop when the runqueue is
+ * empty. Reprograms the tick for the next pending timer (bounded by
+ * TICK_NOHZ_MAX_IDLE_NS) or keeps it running when an event is due soon.
+ */
+void tick_nohz_idle_stop_tick(void);
+
+/**
+ * tick_nohz_idle_exit - Restart the tick when the CPU leaves idle
+ */
+void tick_nohz_idle_exit(void);
+
+bool tick_nohz_tick_stopped(void);
@@ -3,6 +3,21 @@
 #include <aerosync/types.h>
 #include <linux/list.h>
 #include <aerosync/spinlock.h>
+#include <aerosync/sysintf/ic.h>
+
+/*
+ * Coarse timers live in a per-CPU hierarchical timer wheel with tick
+ * granularity (TICK_NSEC). Insertion and removal are O(1); expiry may be
+ * late by up to 1/8th of the remaining timeout for far-out timers, but a
+ * timer never fires early. Use hrtimers (aerosync/hrtimer.h) for precise
+ * expiry.
+ */
+
+#ifndef TIMER_HZ
+#define TIMER_HZ IC_DEFAULT_TICK
+#endif
+
+#define TICK_NSEC (1000000000ULL / TIMER_HZ)
 
 struct timer_list {
     struct list_head entry;
@@ -10,16 +25,47 @@ struct timer_list {
     void (*function)(struct timer_list *);
     void *data;
     uint32_t cpu;
+    uint32_t idx;     // Wheel bucket while pending
 };
 
 struct timespec;
 
 void timer_init_subsystem(void);
+
+/**
+ * timer_subsystem_ready - Whether timer_add() may be used yet
+ *
+ * For code that also runs before timer_init_subsystem(), such as consoles.
+ */
+bool timer_subsystem_ready(void);
+
 void timer_setup(struct timer_list *timer, void (*function)(struct timer_list *), void *data);
 void timer_add(struct timer_list *timer, uint64_t expires_ns);
-void timer_del(struct timer_list *timer);
+/**
+ * timer_del - Deactivate a timer
+ * @return 1 if it was pending, 0 otherwise
+ */
+int timer_del(struct timer_list *timer);
 int timer_pending(const struct timer_list *timer);
 
+/**
+ * timer_del_sync - Deactivate a timer and wait for a running callback
+ *
+ * Must not be called from the timer's own callback.
+ */
+void timer_del_sync(struct timer_list *timer);
+
+/**
+ * run_local_timers - Expire due wheel timers of this CPU (tick context)
+ */
+void run_local_timers(void);
+
+/**
+ * timer_next_event_ns - Absolute expiry of the earliest wheel timer of this CPU
+ * @return Time in nanoseconds, or UINT64_MAX if no timer is pending
+ */
+uint64_t timer_next_event_ns(void);
+
 // Wall-clock timekeeping
 void timekeeping_init(uint64_t boot_timestamp_sec);
 void ktime_get_real_ts64(struct timespec *ts);
@@ -1,10 +1,28 @@
 #pragma once
 
 #include <aerosync/types.h>
+#include <aerosync/atomic.h>
 #include <aerosync/spinlock.h>
+#include <aerosync/timer.h>
 #include <aerosync/wait.h>
+#include <linux/container_of.h>
+
+/*
+ * Work items are executed by shared worker pools:
+ *
+ *  - every CPU has a normal and a high-priority (nice -20) pool whose
+ *    workers are bound to that CPU. These pools are concurrency managed:
+ *    normally a single worker runs, and when it blocks inside a work item
+ *    an idle worker takes over the rest of the queue.
+ *  - every NUMA node has a normal and a high-priority unbound pool whose
+ *    workers may run on any CPU of the node, for long or CPU-heavy work.
+ *
+ * A workqueue only selects which kind of pool its work goes to.
+ */
 
 struct work_struct;
+struct worker_pool;
+struct workqueue_struct;
 typedef void (*work_func_t)(struct work_struct *work);
 
 struct work_struct {
@@ -12,17 +30,34 @@ struct work_struct {
     work_func_t func;
     void *data;
     uint32_t flags;
+    struct worker_pool *pool;     /* Pool it was last queued on */
+    struct workqueue_struct *wq;  /* Workqueue it was last queued on */
+    uint64_t queued_ns;           /* For queue latency accounting */
 };
 
 #define WORK_STRUCT_PENDING_BIT 0
 #define WORK_STRUCT_PENDING (1 << WORK_STRUCT_PENDING_BIT)
 
+struct delayed_work {
+    struct work_struct work;
+    struct timer_list timer;
+    struct workqueue_struct *wq;  /* Target once the timer fires */
+    int cpu;
+};
+
+/* Workqueue flags */
+#define WQ_UNBOUND (1 << 1) /* Not bound to the queueing CPU */
+#define WQ_HIGHPRI (1 << 4) /* High-priority workers */
+
+/* queue_work_on() target meaning "the local CPU" (or node, for WQ_UNBOUND) */
+#define WORK_CPU_UNBOUND (-1)
+
 struct workqueue_struct {
-    struct list_head worklist;
-    spinlock_t lock;
-    struct task_struct *worker;
-    wait_queue_head_t wait;
+    struct list_head list;        /* On the global workqueue list */
     const char *name;
+    unsigned int flags;
+    atomic_t nr_in_flight;        /* Queued plus running work items */
+    wait_queue_head_t flush_wait;
 };
 
 /**
@@ -33,25 +68,131 @@ struct workqueue_struct {
         INIT_LIST_HEAD(&(_work)->entry); \
         (_work)->func = (_func); \
         (_work)->flags = 0; \
+        (_work)->pool = nullptr; \
+        (_work)->wq = nullptr; \
     } while (0)
 
 /**
- * schedule_work - Queue work on the system default workqueue
+ * INIT_DELAYED_WORK - Initialize a delayed work structure
  */
-bool schedule_work(struct work_struct *work);
+#define INIT_DELAYED_WORK(_dwork, _func) \
+    do { \
+        INIT_WORK(&(_dwork)->work, (_func)); \
+        timer_setup(&(_dwork)->timer, delayed_work_timer_fn, nullptr); \
+        (_dwork)->wq = nullptr; \
+        (_dwork)->cpu = WORK_CPU_UNBOUND; \
+    } while (0)
+
+static inline struct delayed_work *to_delayed_work(struct work_struct *work) {
+    return container_of(work, struct delayed_work, work);
+}
+
+static inline bool work_pending(const struct work_struct *work) {
+    return __atomic_load_n(&work->flags, __ATOMIC_ACQUIRE) & WORK_STRUCT_PENDING;
+}
+
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_highpri_wq;
+extern struct workqueue_struct *system_unbound_wq;
+
+/**
+ * alloc_workqueue - Create a workqueue
+ * @flags: WQ_UNBOUND and/or WQ_HIGHPRI
+ */
+struct workqueue_struct *alloc_workqueue(const char *name, unsigned int flags);
 
 /**
- * create_workqueue - Create a new workqueue
+ * create_workqueue - Create a per-CPU workqueue
  */
 struct workqueue_struct *create_workqueue(const char *name);
 
+/**
+ * destroy_workqueue - Drain and free a workqueue
+ */
+void destroy_workqueue(struct workqueue_struct *wq);
+
+/**
+ * queue_work_on - Queue work on a specific CPU
+ * @cpu: Target CPU, or WORK_CPU_UNBOUND for the local one
+ *
+ * For WQ_UNBOUND workqueues @cpu only selects the NUMA node.
+ * @return false if @work was already pending
+ */
+bool queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work);
+
 /**
  * queue_work - Queue work on a specific workqueue
  */
 bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
 
 /**
- * workqueue_init - Initialize the workqueue system
+ * queue_delayed_work_on - Queue work after a delay
+ * @delay_ns: Delay in nanoseconds; 0 queues immediately
  */
-void workqueue_init(void);
+bool queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
+                           struct delayed_work *dwork, uint64_t delay_ns);
 
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+                        uint64_t delay_ns);
+
+/**
+ * schedule_work - Queue work on the system default workqueue
+ */
+bool schedule_work(struct work_struct *work);
+
+bool schedule_work_on(int cpu, struct work_struct *work);
+
+bool schedule_delayed_work(struct delayed_work *dwork, uint64_t delay_ns);
+
+/**
+ * flush_work - Wait for the last queued instance of @work to finish
+ * @return true if it had to wait
+ */
+bool flush_work(struct work_struct *work);
+
+/**
+ * flush_delayed_work - Queue a pending delayed work now and wait for it
+ */
+bool flush_delayed_work(struct delayed_work *dwork);
+
+/**
+ * flush_workqueue - Wait until every work item queued on @wq has finished
+ */
+void flush_workqueue(struct workqueue_struct *wq);
+
+/**
+ * cancel_work_sync - Cancel @work and wait for a running instance
+ *
+ * On return @work is neither pending nor running, unless it is requeued
+ * by someone else afterwards.
+ * @return true if it was pending
+ */
+bool cancel_work_sync(struct work_struct *work);
+
+/**
+ * cancel_delayed_work - Cancel a delayed work without waiting
+ * @return true if it was pending
+ */
+bool cancel_delayed_work(struct delayed_work *dwork);
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+
+/* Timer callback behind INIT_DELAYED_WORK() */
+void delayed_work_timer_fn(struct timer_list *timer);
+
+/* Scheduler hooks for concurrency-managed workers */
+struct task_struct;
+void wq_worker_sleeping(struct task_struct *task);
+void wq_worker_running(struct task_struct *task);
+
+/**
+ * workqueue_init_early - Set up pools and system workqueues
+ *
+ * Work may be queued from this point on; it runs once workers exist.
+ */
+void workqueue_init_early(void);
+
+/**
+ * workqueue_init - Start workers for all online CPUs and NUMA nodes
+ */
+void workqueue_init(void);
@@ -13,6 +13,8 @@
 #define cpu_hlt() __asm__ __volatile__("hlt" ::: "memory")
 #define cpu_cli() __asm__ __volatile__("cli" ::: "memory")
 #define cpu_sti() __asm__ __volatile__("sti" ::: "memory")
+/* sti only takes effect after the next instruction: no wakeup is lost before hlt */
+#define cpu_safe_halt() __asm__ __volatile__("sti; hlt" ::: "memory")
 #define cpu_invlpg(addr) __asm__ __volatile__("invlpg (%0)" ::"r"(addr) : "memory")
 #define system_hlt()                                                           \
   do {                                                                         \
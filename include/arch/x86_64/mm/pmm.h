@@ -32,6 +32,13 @@ typedef struct {
  */
 int pmm_init(void *memmap_response, uint64_t hhdm_offset, void *rsdp);
 
+/**
+ * Finish deferred struct page initialization with per-node kthreads.
+ * Called once SMP and the scheduler are up; returns when all memory is
+ * in the buddy allocator. A no-op without CONFIG_MM_PMM_DEFERRED_INIT.
+ */
+void pmm_deferred_init(void);
+
 /**
  * Initialize per-CPU PMM state (PCP list).
  * Must be called on each CPU after per-CPU area setup.
@@ -10,9 +10,51 @@
 
 #define TLB_FLUSH_IPI_VECTOR 0xFD
 
+/*
+ * Number of address spaces each CPU keeps tagged in the TLB at once.
+ * PCID 0 is reserved for the kernel page table (and for CPUs without PCID),
+ * dynamic ASID n runs with PCID n + 1.
+ */
+#ifndef TLB_NR_DYN_ASIDS
+#ifndef CONFIG_X86_PCID_NR_ASIDS
+#define TLB_NR_DYN_ASIDS 6
+#else
+#define TLB_NR_DYN_ASIDS CONFIG_X86_PCID_NR_ASIDS
+#endif
+#endif
+
 void vmm_tlb_flush_local(uint64_t addr);
 void vmm_tlb_flush_all_local(void);
 void vmm_tlb_shootdown(struct mm_struct *mm, uint64_t start, uint64_t end);
 void tlb_ipi_handler(void *regs);
 
+/**
+ * tlb_init_mm_context - Give a new mm its address space id and TLB generation
+ */
+void tlb_init_mm_context(struct mm_struct *mm);
+
+/**
+ * tlb_switch_mm - Load @next's page tables on this CPU
+ *
+ * Reuses the ASID @next still owns on this CPU and skips the flush when no
+ * shootdown of @next happened since it was last loaded here. Must be called
+ * with interrupts disabled.
+ */
+void tlb_switch_mm(struct mm_struct *next);
+
+/**
+ * tlb_enter_lazy - Keep the loaded mm while a kernel thread runs
+ *
+ * A lazy CPU stays in the mm's cpu_mask but drops to the kernel page table
+ * on the next shootdown of that mm instead of flushing for it.
+ */
+void tlb_enter_lazy(void);
+
+/**
+ * tlb_release_mm - Make sure no CPU still has @mm's page tables loaded
+ *
+ * Called before the page tables of a dead mm are freed.
+ */
+void tlb_release_mm(struct mm_struct *mm);
+
 void vmm_tlb_init(void);
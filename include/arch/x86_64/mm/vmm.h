@@ -186,6 +186,28 @@ int vmm_is_numa_hint(struct mm_struct *mm, uint64_t virt);
 struct folio *vmm_get_folio(struct mm_struct *mm, uint64_t virt);
 void vmm_set_numa_hint(struct mm_struct *mm, uint64_t virt);
 
+/*
+ * Arm hinting faults on every present 4K user PTE in [start, end), with a
+ * single TLB shootdown. Returns the number of PTEs armed.
+ */
+size_t vmm_set_numa_hint_range(struct mm_struct *mm, uint64_t start, uint64_t end);
+
+/*
+ * Make the hinting PTE at @virt present again, pointing at @new_phys, if it
+ * still refers to @old_phys. Other PTE bits are kept. Returns false if
+ * someone else already resolved the fault.
+ */
+bool vmm_numa_restore(struct mm_struct *mm, uint64_t virt, uint64_t old_phys, uint64_t new_phys);
+
+/*
+ * Page migration: freeze turns the hinting PTE for @phys into a plain
+ * not-present entry, which neither the hint path nor the scanner touches
+ * and which sends other faults to the (locked) VM object. Unfreeze makes it
+ * present again at @new_phys.
+ */
+bool vmm_numa_freeze(struct mm_struct *mm, uint64_t virt, uint64_t phys);
+bool vmm_numa_unfreeze(struct mm_struct *mm, uint64_t virt, uint64_t old_phys, uint64_t new_phys);
+
 /* Smoke test */
 void vmm_test(void);
 
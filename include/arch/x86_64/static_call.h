@@ -0,0 +1,47 @@
+#pragma once
+
+#include <aerosync/types.h>
+#include <compiler.h>
+
+/**
+ * @file include/arch/x86_64/static_call.h
+ * @brief Boot-patched direct calls
+ *
+ * DEFINE_STATIC_CALL(name, target) emits a global function @name consisting
+ * of a single `jmp target` with a 32-bit displacement. static_call_update()
+ * rewrites that displacement, so callers of @name reach the chosen target
+ * through one direct jump: no function pointer load, no per-call feature
+ * test.
+ *
+ * The trampoline is 8-byte aligned so the displacement never straddles a
+ * cache line or a page. Updates write it through the direct-map alias of the
+ * kernel text and are meant for boot, before other CPUs can be executing it.
+ */
+
+#define DEFINE_STATIC_CALL(name, target)                                       \
+  __asm__(".pushsection .text.static_call, \"ax\", @progbits\n"               \
+          ".globl " #name "\n"                                                 \
+          ".type " #name ", @function\n"                                       \
+          ".balign 8\n" #name ":\n"                                            \
+          ".byte 0xe9\n"                                                       \
+          ".long " #target " - (. + 4)\n"                                      \
+          "int3\n"                                                             \
+          "int3\n"                                                             \
+          "int3\n"                                                             \
+          ".size " #name ", . - " #name "\n"                                   \
+          ".popsection\n")
+
+#define static_call_update(name, target)                                       \
+  __static_call_update((void *)&(name), (void *)(target))
+
+/**
+ * __static_call_update - Point a trampoline at a new target
+ * @tramp:  Trampoline emitted by DEFINE_STATIC_CALL()
+ * @target: Function with the same signature
+ */
+void __static_call_update(void *tramp, void *target);
+
+/**
+ * static_call_target - Current target of a trampoline
+ */
+void *static_call_target(void *tramp);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <aerosync/types.h>
+
+/**
+ * @file include/arch/x86_64/string.h
+ * @brief Boot-time selection of memory copy and fill routines
+ *
+ * memcpy(), memset(), memmove(), copy_page(), clear_page() and the user
+ * copy loop behind copy_{to,from}_user() are static calls. Until
+ * string_ops_init() runs they reach the portable versions; it then times
+ * every variant the CPU supports and binds each call to the fastest one.
+ */
+
+/**
+ * string_ops_init - Benchmark and bind the string routines
+ *
+ * Needs the page allocator and the FPU set up, and must run before the
+ * other CPUs are started.
+ */
+void string_ops_init(void);
+
+#ifdef CONFIG_STRING_BENCH
+/**
+ * string_bench - Report GB/s for every variant and size
+ */
+void string_bench(void);
+#endif
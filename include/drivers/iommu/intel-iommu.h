@@ -13,6 +13,12 @@
 #include <aerosync/spinlock.h>
 #include <compiler.h>
 #include <linux/list.h>
+#include <aerosync/sysintf/iova.h>
+#include <aerosync/sysintf/dmar.h>
+#include <aerosync/workqueue.h>
+#include <aerosync/atomic.h>
+
+struct iommu_domain;
 
 /* VT-d Register Offsets */
 #define DMAR_VER_REG            0x00    /* Version Register */
@@ -22,27 +28,80 @@
 #define DMAR_GSTS_REG           0x1c    /* Global Status Register */
 #define DMAR_RTADDR_REG         0x20    /* Root-entry Table Address Register */
 #define DMAR_CCMD_REG           0x28    /* Context Command Register */
+#define DMAR_FSTS_REG           0x34    /* Fault Status Register */
 #define DMAR_IQH_REG            0x80    /* Invalidation Queue Head Register */
 #define DMAR_IQT_REG            0x88    /* Invalidation Queue Tail Register */
 #define DMAR_IQA_REG            0x90    /* Invalidation Queue Address Register */
 #define DMAR_ICS_REG            0x9c    /* Invalidation Completion Status Register */
 #define DMAR_IRTA_REG           0xb8    /* Interrupt Remapping Table Address Register */
+#define DMAR_IVA_REG            0x00    /* Invalidate Address Register (relative to ECAP_REG_IRO) */
 #define DMAR_IOTLB_REG          0x08    /* IOTLB Invalidation Register (relative to ECAP_REG_IRO) */
 
 #define DMAR_GCMD_TE            (1U << 31) /* Translation Enable */
 #define DMAR_GCMD_SRTP          (1U << 30) /* Set Root Table Pointer */
 #define DMAR_GSTS_TES           (1U << 31) /* Translation Enable Status */
 #define DMAR_GSTS_RTPS          (1U << 30) /* Root Table Pointer Status */
+#define DMAR_GCMD_WBF           (1U << 27) /* Write Buffer Flush */
+#define DMAR_GSTS_WBFS          (1U << 27)
+#define DMAR_GCMD_QIE           (1U << 26) /* Queued Invalidation Enable */
+#define DMAR_GSTS_QIES          (1U << 26)
+#define DMAR_GSTS_ONE_SHOT_MASK 0x96ffffffU /* Clears status bits of one-shot commands */
+
+#define DMAR_FSTS_IQE           (1U << 4)  /* Invalidation Queue Error */
+
+/* Context Command Register */
+#define DMA_CCMD_ICC            (1ULL << 63)
+#define DMA_CCMD_GLOBAL_INVL    (1ULL << 61)
+
+/* IOTLB Invalidation Register */
+#define DMA_TLB_IVT             (1ULL << 63)
+#define DMA_TLB_GLOBAL_FLUSH    (1ULL << 60)
+#define DMA_TLB_DSI_FLUSH       (2ULL << 60)
+#define DMA_TLB_PSI_FLUSH       (3ULL << 60)
+#define DMA_TLB_DID(d)          ((uint64_t)(d) << 32)
 
 /* CAP_REG fields */
 #define CAP_ND(c)               ((c) & 0x7ULL)
+#define CAP_RWBF(c)             (((c) >> 4) & 0x1ULL)
+#define CAP_CM(c)               (((c) >> 7) & 0x1ULL)
 #define CAP_SAGAW(c)            (((c) >> 8) & 0x1fULL)
+#define CAP_MGAW(c)             ((((c) >> 16) & 0x3fULL) + 1)
 #define CAP_FRO(c)              (((c) >> 24) & 0x3ffULL)
+#define CAP_SLLPS(c)            (((c) >> 34) & 0xfULL) /* bit0: 2MiB, bit1: 1GiB */
+#define CAP_PSI(c)              (((c) >> 39) & 0x1ULL)
 #define CAP_NFR(c)              (((c) >> 40) & 0xffULL)
+#define CAP_MAMV(c)             (((c) >> 48) & 0x3fULL)
+
+#define SAGAW_3LEVEL            (1ULL << 1) /* 39-bit */
+#define SAGAW_4LEVEL            (1ULL << 2) /* 48-bit */
 
 /* ECAP_REG fields */
+#define ECAP_C(e)               ((e) & 0x1ULL)        /* Page walks are coherent */
+#define ECAP_QI(e)              (((e) >> 1) & 0x1ULL)
+#define ECAP_PT(e)              (((e) >> 6) & 0x1ULL)
 #define ECAP_IRO(e)             (((e) >> 8) & 0x3ffULL)
 
+/* Invalidation queue: one 4 KiB page of 128-bit descriptors */
+#define QI_LENGTH               256
+
+#define QI_CC_TYPE              0x1ULL
+#define QI_IOTLB_TYPE           0x2ULL
+#define QI_IWD_TYPE             0x5ULL
+
+#define QI_CC_GRAN_GLOBAL       (1ULL << 4)
+#define QI_IOTLB_GRAN_GLOBAL    (1ULL << 4)
+#define QI_IOTLB_GRAN_DSI       (2ULL << 4)
+#define QI_IOTLB_GRAN_PSI       (3ULL << 4)
+#define QI_IOTLB_DID(d)         ((uint64_t)(d) << 16)
+#define QI_IOTLB_AM(am)         ((uint64_t)(am))
+
+#define QI_IWD_STATUS_WRITE     (1ULL << 5)
+#define QI_IWD_FENCE            (1ULL << 6)
+#define QI_IWD_STATUS_DATA(d)   ((uint64_t)(d) << 32)
+
+#define QI_STATUS_BUSY          1
+#define QI_STATUS_DONE          2
+
 /* Root Entry */
 struct root_entry {
   uint64_t lo;
@@ -61,14 +120,16 @@ struct context_entry {
 #define CONTEXT_FPD             (1ULL << 1)
 #define CONTEXT_TT_MULTI_LEVEL  (0ULL << 2)
 #define CONTEXT_TT_PASSTHROUGH  (2ULL << 2)
-#define CONTEXT_DID(d)          ((uint64_t)(d) << 8)
 #define CONTEXT_ADDR_MASK       (~0xfffULL)
-#define CONTEXT_AW_3LEVEL       (0ULL << 0)
-#define CONTEXT_AW_4LEVEL       (1ULL << 0)
+/* Upper quadword */
+#define CONTEXT_DID(d)          ((uint64_t)(d) << 8)
+#define CONTEXT_AW_3LEVEL       (1ULL << 0)
+#define CONTEXT_AW_4LEVEL       (2ULL << 0)
 
 /* Page Table Entry */
 #define VTD_PTE_R               (1ULL << 0)
 #define VTD_PTE_W               (1ULL << 1)
+#define VTD_PTE_PS              (1ULL << 7) /* Superpage, levels 2 and 3 */
 #define VTD_PTE_ADDR_MASK       (((1ULL << 52) - 1) & ~0xfffULL)
 
 struct intel_iommu {
@@ -78,18 +139,51 @@ struct intel_iommu {
   uint64_t cap;
   uint64_t ecap;
   uint32_t gcmd;
+  dmar_unit_t *drhd;
+  int seq_id;
 
-  spinlock_t lock;
+  spinlock_t lock; /* Root/context tables and register-based invalidation */
   struct root_entry *root_entry;
+
+  spinlock_t qi_lock; /* Serializes invalidation requests */
+  uint64_t *qi_ring; /* nullptr without queued invalidation */
+  uint32_t qi_tail;
+  volatile uint32_t qi_status;
+
   struct list_head node;
 };
 
+#define DMAR_UNITS_MAX 64
+
+/* An unmapped range waiting for the IOTLB flush that retires its IOVA */
+struct dmar_fq_entry {
+  unsigned long pfn;
+  unsigned long npages;
+  uint64_t counter; /* flush_start_cnt when queued */
+};
+
+struct dmar_flush_queue {
+  spinlock_t lock;
+  unsigned int count;
+  struct dmar_fq_entry *entries;
+};
+
 struct dmar_domain {
+  struct iommu_domain *domain;
   int id;
   uint64_t *pgtbl;
   uint64_t pgtbl_phys;
   int addr_width; /* 3 or 4 level */
-  spinlock_t lock;
+  bool pass_through;
+  spinlock_t lock; /* Page tables */
+  uint16_t iommu_refcnt[DMAR_UNITS_MAX]; /* Attached devices per unit */
+
+  /* DMA domains only */
+  struct iova_domain iovad;
+  struct dmar_flush_queue __percpu *fq;
+  struct delayed_work fq_work;
+  atomic64_t flush_start_cnt;
+  atomic64_t flush_finish_cnt;
 };
 
 struct intel_iommu *find_iommu_for_device(uint16_t segment, uint8_t bus, uint8_t devfn);
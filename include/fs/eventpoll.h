@@ -0,0 +1,103 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/fs/eventpoll.h
+ * @brief epoll: scalable I/O event notification
+ * @copyright (C) 2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * An epoll instance hooks a callback into the wait queues of every file it
+ * watches. A wakeup on one of those queues moves the file's item onto the
+ * instance's ready list, so epoll_wait() only looks at files that reported
+ * activity, however many are registered.
+ */
+
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/signal.h>
+#include <compiler.h>
+#include <fs/vfs.h>
+
+/* Event bits, shared with poll() for the low ones */
+#define EPOLLIN        0x00000001
+#define EPOLLPRI       0x00000002
+#define EPOLLOUT       0x00000004
+#define EPOLLERR       0x00000008
+#define EPOLLHUP       0x00000010
+#define EPOLLNVAL      0x00000020
+#define EPOLLRDNORM    0x00000040
+#define EPOLLRDBAND    0x00000080
+#define EPOLLWRNORM    0x00000100
+#define EPOLLWRBAND    0x00000200
+#define EPOLLMSG       0x00000400
+#define EPOLLRDHUP     0x00002000
+
+/* Input flags, EPOLL_CTL_ADD / EPOLL_CTL_MOD only */
+#define EPOLLEXCLUSIVE (1U << 28) /* Wake one of the instances sharing a file */
+#define EPOLLWAKEUP    (1U << 29) /* Accepted and ignored: no autosleep here */
+#define EPOLLONESHOT   (1U << 30) /* Disable after one event until EPOLL_CTL_MOD */
+#define EPOLLET        (1U << 31) /* Edge triggered */
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLL_CLOEXEC O_CLOEXEC
+
+/* Upper bound for maxevents, as on Linux */
+#define EP_MAX_EVENTS (0x7FFFFFFF / sizeof(struct epoll_event))
+
+/* x86_64 user ABI: packed, 12 bytes */
+struct epoll_event {
+    uint32_t events;
+    uint64_t data;
+} __packed;
+
+struct eventpoll;
+
+/*
+ * Kernel interface, used by the system calls and by in-kernel users that
+ * hold files without fds. @fd only labels the item: (file, fd) is the key.
+ */
+struct eventpoll *ep_alloc(void);
+void ep_free(struct eventpoll *ep);
+int ep_ctl(struct eventpoll *ep, int op, int fd, struct file *file, struct epoll_event *event);
+
+/**
+ * ep_wait - Collect ready events
+ * @events: kernel buffer for up to @maxevents events
+ * @timeout_ns: 0 to return at once, (uint64_t) -1 to wait forever
+ * @return number of events, 0 on timeout, or -EINTR
+ */
+int ep_wait(struct eventpoll *ep, struct epoll_event *events, int maxevents,
+            uint64_t timeout_ns);
+
+void eventpoll_release_file(struct file *file);
+
+/**
+ * eventpoll_release - Drop every epoll item watching @file
+ *
+ * Called by vfs_close() once the last reference is gone, before ->release
+ * tears down the wait queues the items are hooked into.
+ */
+static inline void eventpoll_release(struct file *file) {
+    /* Files nobody ever watched skip the global lock */
+    if (likely(!READ_ONCE(file->f_ep.first)))
+        return;
+    eventpoll_release_file(file);
+}
+
+int sys_epoll_create1(int flags);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int sys_epoll_pwait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms,
+                    const sigset_t *sigmask, size_t sigsetsize);
+
+#ifdef CONFIG_EPOLL_BENCH
+/**
+ * epoll_bench - epoll_wait() cost against the number of watched pipes
+ */
+void epoll_bench(void);
+#endif
@@ -40,6 +40,30 @@ int sys_dup(int oldfd);
 int sys_dup2(int oldfd, int newfd);
 int sys_fcntl(int fd, unsigned int cmd, unsigned long arg);
 
+/*
+ * read/write family. Buffers are user pointers and are handed to the file
+ * operations as they are; no bounce buffer in between.
+ */
+struct iovec;
+ssize_t sys_read(int fd, char *buf, size_t count);
+ssize_t sys_write(int fd, const char *buf, size_t count);
+ssize_t sys_pread64(int fd, char *buf, size_t count, vfs_loff_t pos);
+ssize_t sys_pwrite64(int fd, const char *buf, size_t count, vfs_loff_t pos);
+ssize_t sys_readv(int fd, const struct iovec *vec, int vlen);
+ssize_t sys_writev(int fd, const struct iovec *vec, int vlen);
+ssize_t sys_preadv(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos);
+ssize_t sys_pwritev(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos);
+/* @pos == -1 uses and advances the file position */
+ssize_t sys_preadv2(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos, int flags);
+ssize_t sys_pwritev2(int fd, const struct iovec *vec, int vlen, vfs_loff_t pos, int flags);
+
+#ifdef CONFIG_VFS_RW_TEST
+/**
+ * rw_test - Offset validation smoke test for the positional I/O calls
+ */
+void rw_test(void);
+#endif
+
 /* VFS core functions */
 struct file *vfs_open(const char *path, int flags, int mode);
 ssize_t vfs_read(struct file *file, char *buf, size_t count, vfs_loff_t *pos);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <aerosync/types.h>
+#include <aerosync/mutex.h>
+#include <aerosync/wait.h>
+#include <fs/vfs.h>
+
+struct page;
+struct iovec;
+
+/*
+ * A pipe is a ring of page references. Each slot describes a byte range
+ * of one page; write() fills pipe-owned pages, splice() and vmsplice()
+ * queue references to page cache or user pages without copying them.
+ */
+
+#define PIPE_DEF_BUFFERS 16 /* Slots of a new pipe (64 KiB) */
+#define PIPE_BUF         4096 /* Writes up to this size are atomic */
+
+#ifndef PIPE_MAX_SIZE
+#ifndef CONFIG_PIPE_MAX_SIZE
+#define PIPE_MAX_SIZE (1024 * 1024)
+#else
+#define PIPE_MAX_SIZE CONFIG_PIPE_MAX_SIZE
+#endif
+#endif
+
+/* Anonymous page owned by the pipe: write() may append to it */
+#define PIPE_BUF_FLAG_CAN_MERGE 0x01
+
+struct pipe_buffer {
+    struct page *page;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t flags;
+};
+
+struct pipe_inode_info {
+    mutex_t lock;
+    wait_queue_head_t rd_wait;
+    wait_queue_head_t wr_wait;
+    uint32_t head;          /* Next slot to fill; free running */
+    uint32_t tail;          /* Next slot to drain; free running */
+    uint32_t ring_size;     /* Slots, power of two */
+    uint32_t readers;
+    uint32_t writers;
+    struct page *tmp_page;  /* Drained page kept for the next write */
+    struct pipe_buffer *bufs;
+};
+
+static inline uint32_t pipe_occupancy(const struct pipe_inode_info *pipe) {
+    return pipe->head - pipe->tail;
+}
+
+static inline bool pipe_empty(const struct pipe_inode_info *pipe) {
+    return pipe->head == pipe->tail;
+}
+
+static inline bool pipe_full(const struct pipe_inode_info *pipe) {
+    return pipe_occupancy(pipe) >= pipe->ring_size;
+}
+
+static inline struct pipe_buffer *pipe_buf(const struct pipe_inode_info *pipe, uint32_t slot) {
+    return &pipe->bufs[slot & (pipe->ring_size - 1)];
+}
+
+/* fcntl() commands */
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+
+/* splice() flags */
+#define SPLICE_F_MOVE     0x01 /* Move pages instead of copying (a hint) */
+#define SPLICE_F_NONBLOCK 0x02 /* Don't block on the pipe */
+#define SPLICE_F_MORE     0x04 /* More data will be coming */
+#define SPLICE_F_GIFT     0x08 /* Pages passed in are a gift */
+
+/**
+ * get_pipe_info - Pipe behind an open file
+ * @return nullptr if @file is not a pipe
+ */
+struct pipe_inode_info *get_pipe_info(struct file *file);
+
+/**
+ * pipe_buf_release - Drop the page reference of a drained slot
+ * Called with pipe->lock held.
+ */
+void pipe_buf_release(struct pipe_inode_info *pipe, struct pipe_buffer *buf);
+
+/*
+ * Sleep until the pipe has data (or no writers) / room (or no readers).
+ * Called with pipe->lock held; the lock is dropped while sleeping.
+ * @return 0, -EAGAIN if @nonblock, -EINTR on a signal, and -EPIPE from
+ * pipe_wait_writable() once the last reader is gone.
+ */
+int pipe_wait_readable(struct pipe_inode_info *pipe, bool nonblock);
+int pipe_wait_writable(struct pipe_inode_info *pipe, bool nonblock);
+
+/**
+ * pipe_fcntl - F_SETPIPE_SZ / F_GETPIPE_SZ
+ */
+long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg);
+
+/**
+ * create_pipe_files - New pipe as a read and a write file, not yet in any
+ * fd table
+ * @res: receives the read end in [0] and the write end in [1]
+ */
+int create_pipe_files(struct file *res[2]);
+int do_pipe(int pipefd[2]);
+
+ssize_t sys_splice(int fd_in, vfs_loff_t *off_in, int fd_out, vfs_loff_t *off_out,
+                   size_t len, unsigned int flags);
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+ssize_t sys_vmsplice(int fd, const struct iovec *vec, unsigned long nr_segs,
+                     unsigned int flags);
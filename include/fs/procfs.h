@@ -1,3 +1,13 @@
 #pragma once
 
+struct file_operations;
+struct pseudo_node;
+
 void procfs_init(void);
+
+/**
+ * proc_create - Publish a file at the procfs root for another subsystem
+ * @name: File name under /proc
+ * @fops: Operations (usually just .read)
+ */
+struct pseudo_node *proc_create(const char *name, const struct file_operations *fops);
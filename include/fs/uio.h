@@ -0,0 +1,34 @@
+#pragma once
+
+#include <aerosync/types.h>
+#include <arch/x86_64/mm/paging.h>
+
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+
+#define UIO_FASTIOV 8    /* Vectors copied onto the stack */
+#define UIO_MAXIOV  1024 /* Upper bound for readv/writev vectors */
+
+/* preadv2/pwritev2 flags */
+#define RWF_HIPRI  0x00000001 /* High priority request, poll if possible */
+#define RWF_DSYNC  0x00000002 /* Per-IO O_DSYNC */
+#define RWF_SYNC   0x00000004 /* Per-IO O_SYNC */
+#define RWF_NOWAIT 0x00000008 /* Per-IO, return -EAGAIN if operation would block */
+#define RWF_APPEND 0x00000010 /* Per-IO O_APPEND */
+
+/*
+ * Largest single read/write transfer; larger requests are shortened, as
+ * the return value has to fit a ssize_t on every ABI.
+ */
+#define MAX_RW_COUNT ((size_t) INT_MAX & PAGE_MASK)
+
+/**
+ * import_iovec - Copy a user iovec array in and validate it
+ * @fast: UIO_FASTIOV entries of caller stack, used for small arrays
+ * @iovp: Set to @fast or a kmalloc'ed array the caller must free
+ * @return Total length in bytes (at most MAX_RW_COUNT), or a negative error
+ */
+ssize_t import_iovec(const struct iovec *uvec, int nr, struct iovec *fast,
+                     struct iovec **iovp);
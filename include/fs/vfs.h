@@ -4,6 +4,7 @@
 #include <aerosync/spinlock.h>
 #include <aerosync/atomic.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <aerosync/wait.h>
 
 // Forward declarations for VFS structures
@@ -109,9 +110,16 @@ struct super_block {
     dev_t               s_dev;            // Device identifier
     uint32_t            s_blocksize;      // Block size in bytes
     vfs_loff_t          s_maxbytes;       // Maximum file size
-    // ... more fields like device, flags, etc.
+    uint32_t            s_flags;          // SB_* flags
+    // ... more fields like device, etc.
 };
 
+/*
+ * The dentry tree is the filesystem (tmpfs): unused and negative dentries
+ * stay cached, as they are always up to date.
+ */
+#define SB_DCACHE_RETAIN 0x01
+
 // struct inode: Represents a file or directory
 struct inode {
     struct list_head    i_list;           // All inodes in use list (global)
@@ -139,8 +147,8 @@ struct inode {
 
 // struct dentry: Represents a directory entry (filename in a directory)
 struct dentry {
-    struct list_head    d_hash;           // Hash list for dentry cache
-    struct list_head    d_lru;            // LRU list for dentry cache (if implementing LRU)
+    struct list_head    d_hash;           // Chain in the dentry hash table
+    struct list_head    d_lru;            // Unused dentry LRU
     struct list_head    d_child;          // List of children in parent dentry
     struct list_head    d_subdirs;        // List of subdirectories (if this is a directory dentry)
     struct list_head    i_list;           // Node for inode->i_dentry list
@@ -149,10 +157,17 @@ struct dentry {
     struct inode        *d_inode;         // Inode corresponding to this dentry (or nullptr if negative dentry)
     spinlock_t          d_lock;           // Protects dentry data
     atomic_t            d_count;          // Reference count
-    uint32_t            d_flags;          // Dentry flags
+    uint32_t            d_flags;          // DCACHE_* flags
     struct list_head    d_subscribers;    // VFS Event Subscribers
+    struct super_block  *d_sb;            // Filesystem it belongs to
+    struct llist_node   d_free;           // Deferred free after an RCU grace period
 };
 
+/* d_flags, changed under the dcache lock */
+#define DCACHE_HASHED 0x01 // Hashed and on the parent's d_subdirs; pins the parent
+#define DCACHE_LRU    0x02 // Unused and on the LRU
+#define DCACHE_DEAD   0x04 // Killed, only lockless walkers may still see it
+
 // struct file: Represents an open file description
 struct file {
     struct list_head    f_list;           // List of all open files
@@ -164,6 +179,7 @@ struct file {
     uint32_t            f_flags;          // Open flags (O_RDONLY, O_WRONLY, etc.)
     uint32_t            f_mode;           // Internal mode (FMODE_READ, etc.)
     void                *private_data;    // Filesystem private data for this open file
+    struct hlist_head   f_ep;             // epoll items watching this file
     // ... more fields like reference count, etc.
 };
 
@@ -283,6 +299,15 @@ int vfs_fstat(struct file *file, struct stat *statbuf);
 int vfs_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 uint32_t vfs_poll(struct file *file, poll_table *pt);
 
+/*
+ * ->poll methods call this for every wait queue they will wake when their
+ * readiness changes; @p is nullptr when the caller only wants the mask.
+ */
+static inline void poll_wait(struct file *filp, struct wait_queue_head *wq, poll_table *p) {
+    if (p && p->_qproc && wq)
+        p->_qproc(filp, wq, p);
+}
+
 struct inode *new_inode(struct super_block *sb);
 void iput(struct inode *inode);
 void iget(struct inode *inode);
@@ -291,6 +316,22 @@ void dput(struct dentry *dentry);
 struct dentry *dget(struct dentry *dentry);
 struct dentry *d_alloc_pseudo(struct super_block *sb, const struct qstr *name);
 
+/*
+ * Dentry cache. Children are hashed by (parent, name); a hashed dentry
+ * holds a reference on its parent. Lookups under rcu_read_lock() take no
+ * references and are validated against dcache_seq.
+ */
+uint32_t d_hash_name(const unsigned char *name, uint32_t len);
+struct dentry *d_lookup(struct dentry *parent, const struct qstr *name);
+struct dentry *__d_lookup_rcu(const struct dentry *parent, const struct qstr *name);
+bool dget_unless_dead(struct dentry *dentry);
+void d_attach(struct dentry *dentry);
+void d_drop(struct dentry *dentry);
+void d_move(struct dentry *dentry, struct dentry *target);
+unsigned int dcache_seq_begin(void);
+bool dcache_seq_retry(unsigned int seq);
+void dcache_init(void);
+
 ssize_t simple_read_from_buffer(void *to, size_t count, vfs_loff_t *ppos, const void *from, size_t available);
 struct dentry *simple_lookup(struct inode *dir, struct dentry *dentry, uint32_t flags);
 int simple_rmdir(struct inode *dir, struct dentry *dentry);
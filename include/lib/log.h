@@ -17,15 +17,23 @@ void log_init(log_sink_putc_t backend);
 
 void log_set_console_sink(log_sink_putc_t sink);
 
-/*Mark that the system is panicking to allow bypassing locks*/
+/*Mark that the system is panicking. The first CPU to call this prints every
+later record synchronously, taking the console lock only if it is free.*/
 void log_mark_panic(void);
 
+/*Non-zero once log_mark_panic() ran: consoles that batch output must write
+it out at once, nothing will run their deferred flush any more.*/
+int log_in_panic(void);
+
 /*Write a complete, already formatted message (no implicit newline added)
-Returns number of bytes accepted (may be truncated to ring capacity)*/
+Returns number of bytes accepted (may be truncated to one record). Never
+waits for other writers or for the console: once klogd runs, console output
+happens there (or on the panicking CPU).*/
 int log_write_str(int level, const char *msg);
 
 /*Read next record as a string. Returns length copied or 0 if none available.
-If out_level != nullptr, stores the record level.*/
+If out_level != nullptr, stores the record level. Has its own cursor, so it
+sees every record the console does, minus those overwritten meanwhile.*/
 int log_read(char *out_buf, int out_buf_len, int *out_level);
 
 /*Optional runtime debug control: by default DEBUG may be off even if
@@ -49,4 +57,9 @@ int log_try_init_async(void);
 /*Start asynchronous logging consumer (klogd). Safe to call once after
 scheduler is up. Subsequent calls are no-ops.*/
 void log_init_async(void);
-#endif /* ASYNC_PRINTK */
\ No newline at end of file
+#endif /* ASYNC_PRINTK */
+
+#ifdef CONFIG_PRINTK_BENCH
+/*printk throughput and per-call latency from up to 32 CPUs at once*/
+void printk_bench(void);
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <aerosync/types.h>
+
+/*
+ * LZ4 block format (de)compressor for small buffers (at most 64 KiB).
+ *
+ * The output is a plain LZ4 block (no frame header), compatible with
+ * LZ4_decompress_safe(). The compressor is the single-pass greedy variant
+ * with a 4K-entry position table, tuned for page-sized inputs.
+ */
+
+#define LZ4_MINMATCH        4
+#define LZ4_HASH_LOG        12
+#define LZ4_MAX_INPUT_SIZE  0xFFFF
+
+// Scratch memory needed by lz4_compress()
+#define LZ4_MEM_COMPRESS    (sizeof(uint16_t) << LZ4_HASH_LOG)
+
+// Worst-case output size for incompressible input
+#define LZ4_COMPRESSBOUND(isize) ((isize) + ((isize) / 255) + 16)
+
+// Compress src into dst; returns the compressed size, or 0 if it does not fit in dst_cap
+size_t lz4_compress(const void *src, size_t src_len, void *dst, size_t dst_cap, void *wrkmem);
+
+// Decompress a block; returns the number of bytes produced, or a negative errno on corrupt input
+int lz4_decompress(const void *src, size_t src_len, void *dst, size_t dst_cap);
@@ -7,6 +7,8 @@ typedef struct printk_backend {
   const char *name;
   int priority;              // bigger = preferred
   fn(void, putc, char c);
+  fn(void, flush, void);     // optional: write out output putc batched
+  fn(void, bench_legacy, bool on); // optional: consolebench baseline renderer
   fn(int, probe, void);
   fn(int, init, void *payload);
   fn(void, cleanup, void);
@@ -79,6 +81,11 @@ const printk_backend_t *printk_auto_select_backend(const char *not);
 void printk_init_async(void);
 #endif
 
+#ifdef CONFIG_CONSOLE_BENCH
+/* chars/s of the active console, flushed per character and batched */
+void console_bench(void);
+#endif
+
 typedef struct ratelimit_state {
   spinlock_t lock;
   int interval;      // interval in ms
@@ -43,6 +43,16 @@ int memcmp(const void *s1, const void *s2, size_t n);
 void *memchr(const void *s, int c, size_t n);
 void *memscan(void *addr, int c, size_t size);
 
+/* Whole-page copy and clear; both pointers must be page aligned */
+void copy_page(void *to, const void *from);
+void clear_page(void *page);
+void clear_page_nocache(void *page);
+
+/* Portable fallbacks behind the boot-selected memcpy/memset/memmove */
+void *memcpy_generic(void *d, const void *src, size_t n);
+void *memmove_generic(void *dest, const void *src, size_t n);
+void *memset_generic(void *s, int c, size_t n);
+
 /* Advanced memory functions */
 #ifdef CONFIG_STRING_ADVANCED
 void *memrchr(const void *s, int c, size_t n);
@@ -187,6 +187,19 @@ struct mm_struct {
 
   int preferred_node; /* Default NUMA node for this address space */
 
+#ifdef CONFIG_MM_NUMA_BALANCING
+  /* NUMA balancing scanner state (mm/numa_balancing.c) */
+  struct list_head numa_scan_list; /* Node in knumad's list of address spaces */
+  uint64_t numa_next_scan;         /* Time (ns) the next scan slice is due */
+  uint64_t numa_scan_offset;       /* Where the next slice starts */
+  unsigned int numa_scan_period;   /* ms between slices */
+  int numa_scan_seq;               /* Completed passes over the address space */
+  atomic_long_t numa_faults_local; /* Hinting faults during the current pass */
+  atomic_long_t numa_faults_remote;
+#endif
+
   struct cpumask cpu_mask; /* CPUs currently using this mm */
+  uint64_t ctx_id;         /* Address space id, never reused (tags cached ASIDs) */
+  atomic64_t tlb_gen;      /* Bumped by every TLB shootdown of this mm */
   struct resdomain *rd;    /* Resource domain for this address space */
 };
@@ -2,6 +2,8 @@
 
 #include <mm/mm_types.h>
 
+struct swap_plug;
+
 /**
  * @file include/mm/mmu_gather.h
  * @brief MMU gather structure for batching TLB flushes and page freeing
@@ -19,11 +21,18 @@ struct mmu_gather {
     size_t nr_folios;
     
     bool full_flush;
+
+#ifdef CONFIG_MM_SWAP
+    // Swap-outs to issue once the flush has completed
+    struct swap_plug *swap_plug;
+#endif
 };
 
 void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm, uint64_t start, uint64_t end);
 void tlb_finish_mmu(struct mmu_gather *tlb);
+void tlb_flush_mmu(struct mmu_gather *tlb);
 void tlb_remove_folio(struct mmu_gather *tlb, struct folio *folio, uint64_t virt);
+void tlb_gather_set_mm(struct mmu_gather *tlb, struct mm_struct *mm);
 
 /* Legacy helper */
 static inline void tlb_remove_page(struct mmu_gather *tlb, uint64_t phys, uint64_t virt) {
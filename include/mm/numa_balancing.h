@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file include/mm/numa_balancing.h
+ * @brief Automatic NUMA page and task placement
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * knumad periodically arms NUMA hinting faults over a slice of every user
+ * address space. Each hinting fault records which node the faulting task
+ * touched; a page that is faulted twice in a row from the same remote node
+ * is migrated there, and a task whose faults concentrate on one node gets
+ * that node as its preferred node, which wakeup placement and the load
+ * balancer then respect.
+ */
+
+#pragma once
+
+#include <aerosync/atomic.h>
+#include <aerosync/types.h>
+#include <mm/page.h>
+#include <mm/zone.h>
+
+struct task_struct;
+struct mm_struct;
+
+#ifdef CONFIG_MM_NUMA_BALANCING
+
+/* Counters reported in /proc/vmstat */
+enum numa_stat_item {
+  NUMA_PTE_UPDATES,         /* PTEs armed for a hinting fault */
+  NUMA_HINT_FAULTS,         /* Hinting faults taken */
+  NUMA_HINT_FAULTS_LOCAL,   /* ... on a page already on the faulting node */
+  NUMA_PAGES_MIGRATED,      /* Pages moved to the faulting node */
+  NUMA_MIGRATE_FAILED,      /* Migrations that could not complete */
+  NUMA_MIGRATE_RATELIMITED, /* Migrations skipped by the per-node rate limit */
+  NUMA_PREFERRED_CHANGES,   /* Tasks that switched preferred node */
+  NUMA_TASK_MOVES,          /* Wakeups steered to the preferred node */
+  NR_NUMA_STAT_ITEMS
+};
+
+extern atomic_long_t numa_stats[NR_NUMA_STAT_ITEMS];
+
+static inline void numa_stat_add(enum numa_stat_item item, long nr) {
+  atomic_long_add(nr, &numa_stats[item]);
+}
+
+static inline void numa_stat_inc(enum numa_stat_item item) {
+  atomic_long_inc(&numa_stats[item]);
+}
+
+/*
+ * The node of the last hinting fault on a folio lives in page flag bits
+ * 56-62, stored off by one so that a cleared field reads as "none".
+ */
+#define FOLIO_LAST_NID_SHIFT 56
+#define FOLIO_LAST_NID_MASK 0x7FUL
+
+static_assert(MAX_NUMNODES < FOLIO_LAST_NID_MASK, "last_nid field too narrow");
+
+static inline int folio_last_nid(struct folio *folio) {
+  unsigned long flags = __atomic_load_n(&folio->flags, __ATOMIC_RELAXED);
+  return (int) ((flags >> FOLIO_LAST_NID_SHIFT) & FOLIO_LAST_NID_MASK) - 1;
+}
+
+/* Record @nid and return the previous value */
+static inline int folio_xchg_last_nid(struct folio *folio, int nid) {
+  unsigned long old_flags = __atomic_load_n(&folio->flags, __ATOMIC_RELAXED);
+  unsigned long new_flags;
+
+  do {
+    new_flags = old_flags & ~(FOLIO_LAST_NID_MASK << FOLIO_LAST_NID_SHIFT);
+    new_flags |= (unsigned long) (nid + 1) << FOLIO_LAST_NID_SHIFT;
+  } while (!__atomic_compare_exchange_n(&folio->flags, &old_flags, new_flags,
+                                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  return (int) ((old_flags >> FOLIO_LAST_NID_SHIFT) & FOLIO_LAST_NID_MASK) - 1;
+}
+
+/**
+ * numa_balancing_init - Start knumad and publish /proc/vmstat
+ *
+ * knumad only runs when the firmware described more than one node.
+ */
+void numa_balancing_init(void);
+
+/* Address space lifetime, called from mm_create() and mm_free() */
+void numa_balancing_mm_init(struct mm_struct *mm);
+void numa_balancing_mm_exit(struct mm_struct *mm);
+
+/**
+ * task_numa_init - Set up the placement state of a new task
+ * @p: the new task
+ * @parent: the task it was forked from
+ * @share_mm: @p shares @parent's address space (CLONE_VM)
+ *
+ * Threads inherit the parent's preferred node; separate processes start
+ * without one.
+ */
+void task_numa_init(struct task_struct *p, struct task_struct *parent, bool share_mm);
+
+/**
+ * numa_migrate_check - Decide whether a hinting fault should migrate
+ * @folio: the faulting folio, not on @this_nid
+ * @this_nid: node of the faulting CPU
+ * @speculative: the fault holds no locks and will be retried
+ *
+ * Only a second consecutive fault from the same node qualifies, and a task
+ * with a preferred node only pulls pages to that node. Migrations into a
+ * node are rate limited; the speculative pass only looks and leaves the
+ * budget for the retry.
+ */
+bool numa_migrate_check(struct folio *folio, int this_nid, bool speculative);
+
+/**
+ * task_numa_fault - Account a hinting fault to the current task
+ * @mm: the faulting address space
+ * @mem_nid: node the page was on when the fault was taken
+ * @this_nid: node of the faulting CPU
+ * @migrated: the page was moved to @this_nid
+ */
+void task_numa_fault(struct mm_struct *mm, int mem_nid, int this_nid, bool migrated);
+
+/**
+ * task_numa_select_cpu - Steer a wakeup towards the preferred node
+ * @p: the waking task
+ * @prev_cpu: where it last ran
+ * @target: the CPU chosen so far
+ *
+ * Return: a CPU on @p's preferred node that is idle or less loaded than
+ * @target, or -1 to keep @target.
+ */
+int task_numa_select_cpu(struct task_struct *p, int prev_cpu, int target);
+
+/* Load balancer hints: moving @p from @src_cpu to @dst_cpu ... */
+bool task_numa_improves_locality(struct task_struct *p, int src_cpu, int dst_cpu);
+bool task_numa_degrades_locality(struct task_struct *p, int src_cpu, int dst_cpu);
+
+#else
+
+static inline void numa_balancing_init(void) {}
+static inline void numa_balancing_mm_init(struct mm_struct *mm) { (void) mm; }
+static inline void numa_balancing_mm_exit(struct mm_struct *mm) { (void) mm; }
+
+static inline void task_numa_init(struct task_struct *p, struct task_struct *parent, bool share_mm) {
+  (void) p; (void) parent; (void) share_mm;
+}
+
+static inline int task_numa_select_cpu(struct task_struct *p, int prev_cpu, int target) {
+  (void) p; (void) prev_cpu; (void) target;
+  return -1;
+}
+
+static inline bool task_numa_improves_locality(struct task_struct *p, int src_cpu, int dst_cpu) {
+  (void) p; (void) src_cpu; (void) dst_cpu;
+  return false;
+}
+
+static inline bool task_numa_degrades_locality(struct task_struct *p, int src_cpu, int dst_cpu) {
+  (void) p; (void) src_cpu; (void) dst_cpu;
+  return false;
+}
+
+#endif /* CONFIG_MM_NUMA_BALANCING */
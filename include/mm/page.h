@@ -64,6 +64,7 @@ struct page {
           unsigned frozen : 1;
         };
       };
+      unsigned int slab_cpu; /* CPU the slab is frozen to */
     };
   };
 
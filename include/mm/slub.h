@@ -6,6 +6,7 @@
 #include <arch/x86_64/mm/pmm.h>
 #include <mm/gfp.h>
 #include <mm/page.h>
+#include <linux/llist.h>
 
 #ifndef SLAB_MAX_ORDER
 #ifndef CONFIG_SLAB_MAX_ORDER
@@ -33,6 +34,26 @@
 #define SLAB_HWCACHE_ALIGN 0x00008000UL
 #define SLAB_TYPESAFE_BY_RCU 0x00080000UL /* RCU-free slabs */
 
+/*
+ * Per-CPU event counters, summed over all CPUs when read. They are bumped
+ * without atomics; an update lost to migration now and then is the price
+ * for keeping them off shared cache lines.
+ */
+enum slub_stat_item {
+  ALLOC_FASTPATH,  /* From the CPU freelist */
+  ALLOC_MAGAZINE,  /* From the CPU magazine */
+  ALLOC_REFILL,    /* Magazine refilled from a partial slab */
+  ALLOC_SLOWPATH,  /* Through __slab_alloc() */
+  ALLOC_NODE_MISS, /* Slowpath served from another node's partial list */
+  FREE_FASTPATH,   /* To the CPU freelist */
+  FREE_MAGAZINE,   /* To the CPU magazine */
+  FREE_REMOTE,     /* Queued to the CPU the slab is frozen to */
+  FREE_SLOWPATH,   /* Through __slab_free() */
+  SLAB_ALLOCATED,  /* New slabs from the page allocator */
+  SLAB_FREED,      /* Empty slabs given back */
+  NR_SLUB_STAT_ITEMS
+};
+
 alignas(CACHE_LINE_SIZE) struct kmem_cache_cpu {
   void *freelist;    /* Pointer to next available object */
   unsigned long tid; /* Transaction ID for lockless cmpxchg */
@@ -41,20 +62,17 @@ alignas(CACHE_LINE_SIZE) struct kmem_cache_cpu {
   /* Magazine Layer (BSD/XNU Hybrid) */
   void *mag[SLAB_MAG_SIZE];
   int mag_count;
+
+  /* Objects other CPUs freed into our frozen slab, drained by this CPU */
+  struct llist_head remote_free;
+
+  unsigned long stat[NR_SLUB_STAT_ITEMS];
 };
 
 struct kmem_cache_node {
   spinlock_t list_lock;
   unsigned long nr_partial;
   struct list_head partial;
-  atomic_long_t nr_slabs;
-  atomic_long_t total_objects;
-
-  /* NUMA-aware statistics */
-  atomic_long_t alloc_hits;   /* Allocations from this node */
-  atomic_long_t alloc_misses; /* Allocations that fell back to other nodes */
-  atomic_long_t alloc_from_partial; /* Allocations from partial list */
-  atomic_long_t alloc_refills; /* Number of times partial list was refilled */
 
   /* Node-specific tuning */
   unsigned long min_partial; /* Per-node minimum partial slabs */
@@ -84,20 +102,12 @@ typedef struct kmem_cache {
 
   /* Redzone and poisoning */
   int inuse; /* offset to redzone / end of object */
-
-  /* Management Stats */
-  atomic_long_t active_slabs;
-  atomic_long_t total_objects;
-
-  /* Performance Statistics (for profiling) */
-  atomic_long_t alloc_fastpath;
-  atomic_long_t alloc_slowpath;
-  atomic_long_t free_fastpath;
-  atomic_long_t free_slowpath;
 } kmem_cache_t;
 
 /* API */
 void slab_init(void);
+void slabinfo_init(void);
+void slab_numa_stats(void);
 
 void slab_test(void);
 void slab_verify_all(void);
@@ -111,6 +121,11 @@ void kmem_cache_free(kmem_cache_t *cache, void *obj);
 int kmem_cache_alloc_bulk(kmem_cache_t *s, gfp_t flags, size_t size, void **p);
 void kmem_cache_free_bulk(kmem_cache_t *s, size_t size, void **p);
 
+/* Free @size kmalloc()ed objects; nullptr entries are skipped */
+static inline void kfree_bulk(size_t size, void **p) {
+  kmem_cache_free_bulk(nullptr, size, p);
+}
+
 /* Sheaf bulk allocation API - see mm/slab_sheaf.h for details */
 #define SHEAF_MAX_OBJECTS 64
 
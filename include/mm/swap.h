@@ -28,6 +28,7 @@
 #include <aerosync/spinlock.h>
 #include <aerosync/atomic.h>
 #include <aerosync/rw_semaphore.h>
+#include <aerosync/wait.h>
 #include <mm/page.h>
 
 #include "gfp.h"
@@ -97,11 +98,12 @@ struct swap_cluster_info {
 
 /*
  * Per-CPU swap slot cache for lock-free allocation in the fast path.
+ * Each CPU reserves a run of contiguous slots, so pages reclaimed back to
+ * back on one CPU land next to each other on disk and merge into one write.
  */
 struct swap_slots_cache {
-  unsigned long *slots; /* Array of swap offsets */
-  unsigned int nr; /* Number of cached slots */
-  unsigned int max; /* Maximum slots to cache */
+  unsigned long next; /* First reserved slot */
+  unsigned int nr; /* Reserved slots left in [next, next + nr) */
   spinlock_t lock;
 };
 
@@ -139,12 +141,27 @@ struct swap_info_struct {
   /* Extent mapping (for files) */
   struct list_head extent_list;
 
+  /* Block I/O geometry: slot N lives at start_sector + N * sectors_per_page */
+  uint64_t start_sector;
+  unsigned int sectors_per_page;
+
+  /* Writeback throttling */
+  atomic_t nr_inflight; /* Pages under swap I/O */
+  unsigned int max_inflight; /* Congestion threshold (pages) */
+  wait_queue_head_t inflight_wait;
+  atomic_long_t write_seq; /* Completed swap-outs, bumped under the swap cache lock */
+
   /* Per-CPU slot caches */
   struct swap_slots_cache __percpu *slots_cache;
 
   /* Statistics */
   atomic_long_t inuse_pages;
   atomic_long_t total_pages;
+  atomic_long_t nr_pageouts; /* Pages written */
+  atomic_long_t nr_write_bios; /* Write bios issued (pageouts / this = batch size) */
+  atomic_long_t nr_pageins; /* Pages read, including readahead */
+  atomic_long_t nr_read_bios;
+  atomic_long_t nr_io_errors;
 
   /* Locking */
   spinlock_t lock;
@@ -153,6 +170,9 @@ struct swap_info_struct {
   char name[64]; /* Device/file path */
 };
 
+/* Folio flag: folio is in the swap cache, folio->private holds the entry */
+#define PG_swapcache        (1UL << 20)
+
 /* Swap map special values */
 #define SWAP_MAP_FREE       0       /* Slot is free */
 #define SWAP_MAP_MAX        0xFE    /* Maximum reference count */
@@ -191,6 +211,52 @@ void swap_free(swp_entry_t entry);
 int swap_duplicate(swp_entry_t entry);
 
 /* Swap I/O */
+
+/**
+ * struct swap_plug - Batch of swap-outs waiting for their TLB flush
+ *
+ * Reclaim unmaps folios under a deferred TLB shootdown, so their contents
+ * must not be read by the device until that shootdown has run. Pending
+ * writes are parked here and issued by swap_flush_plug() from
+ * tlb_finish_mmu(), where slot-contiguous folios are coalesced into
+ * multi-page bios.
+ */
+#ifndef SWAP_PLUG_MAX
+#ifndef CONFIG_MM_SWAP_WRITE_BATCH
+#define SWAP_PLUG_MAX 64
+#else
+#define SWAP_PLUG_MAX CONFIG_MM_SWAP_WRITE_BATCH
+#endif
+#endif
+
+struct swap_plug {
+  unsigned int nr;
+  swp_entry_t entries[SWAP_PLUG_MAX];
+  struct folio *folios[SWAP_PLUG_MAX];
+};
+
+static inline void swap_start_plug(struct swap_plug *plug) {
+  plug->nr = 0;
+}
+
+/**
+ * swap_plug_add - Queue a swap-out on @plug
+ * @return true if the plug is full and must be flushed before the next add
+ */
+bool swap_plug_add(struct swap_plug *plug, struct folio *folio, swp_entry_t entry);
+
+/**
+ * swap_flush_plug - Issue all writes queued on @plug
+ */
+void swap_flush_plug(struct swap_plug *plug);
+
+/**
+ * swap_writepage - Write a folio to its swap slot
+ *
+ * The folio must already be in the swap cache. The write is asynchronous;
+ * the swap cache reference is dropped once the data is on the device, or
+ * kept on error so the contents can still be faulted back in.
+ */
 int swap_writepage(struct folio *folio, swp_entry_t entry);
 
 struct folio *swap_readpage(swp_entry_t entry);
@@ -214,7 +280,7 @@ static inline bool swap_is_enabled(void) {
  * folio_swapped - Check if a folio is backed by swap
  */
 static inline bool folio_swapped(struct folio *folio) {
-  return folio && (folio->flags & (1UL << 20)); /* PG_swapcache */
+  return folio && (folio->flags & PG_swapcache);
 }
 
 /* PTE/swap entry conversion */
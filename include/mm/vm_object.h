@@ -27,6 +27,8 @@ struct vm_object_operations {
   int (*fault)(struct vm_object *obj, struct vm_area_struct *vma, struct vm_fault *vmf);
   int (*page_mkwrite)(struct vm_object *obj, struct vm_area_struct *vma, struct vm_fault *vmf);
   int (*read_folio)(struct vm_object *obj, struct folio *folio);
+  /* Optional: read a run of index-contiguous folios (readahead) in one I/O */
+  int (*read_folios)(struct vm_object *obj, struct folio **folios, uint32_t count);
   int (*write_folio)(struct vm_object *obj, struct folio *folio);
   int (*write_folios)(struct vm_object *obj, struct folio **folios, uint32_t count);
   void (*free)(struct vm_object *obj);
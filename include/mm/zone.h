@@ -206,6 +206,27 @@ struct zonelist {
 
 #define MAX_NR_GENS 4
 
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+/* Free order-0 pages already cleared by kzerod, taken off the buddy lists */
+struct zero_pool {
+  spinlock_t lock;
+  struct list_head pages;
+  unsigned long nr_pages;
+
+  /* kzerod refills up to high once the pool drops below low */
+  unsigned long low;
+  unsigned long high;
+
+  wait_queue_head_t wait;
+  struct task_struct *task;
+
+  atomic_long_t hits;
+  atomic_long_t misses;
+  atomic_long_t filled;
+  atomic_long_t drained;
+};
+#endif
+
 struct lrugen {
   /* [generation][anon/file] */
   struct list_head lists[MAX_NR_GENS][2];
@@ -233,6 +254,17 @@ alignas(64) struct pglist_data {
   /* LRU Management */
   spinlock_t lru_lock;
   struct lrugen lrugen;
+
+#ifdef CONFIG_MM_PMM_DEFERRED_INIT
+  /* [first_deferred_pfn, deferred_end_pfn) still awaits struct page init */
+  spinlock_t deferred_lock;
+  unsigned long first_deferred_pfn;
+  unsigned long deferred_end_pfn;
+#endif
+
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+  struct zero_pool zero_pool;
+#endif
 };
 
 extern struct pglist_data *node_data[MAX_NUMNODES];
@@ -266,9 +298,32 @@ void free_pcp_pages(struct zone *zone, int count, struct list_head *list,
 
 void __free_pages(struct page *page, unsigned int order);
 
-/* Boot-only: bypasses poisoning, PCP, locking. Single-threaded init only. */
+/* Boot-only: bypasses poisoning and PCP. Caller owns zone->lock once SMP is up. */
 void __free_pages_boot_core(struct page *page, unsigned int order);
 
+#ifdef CONFIG_MM_PMM_DEFERRED_INIT
+/* Initialize the next deferred chunk of @pgdat now; false if none is left */
+bool pmm_deferred_grow(struct pglist_data *pgdat);
+#endif
+
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+/* Size the pre-zeroed pools and start one kzerod per node */
+void zero_pool_init(void);
+
+struct zero_pool_stats {
+  unsigned long nr_pages;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long filled;
+  unsigned long drained;
+};
+
+/* Totals over all nodes */
+void zero_pool_get_stats(struct zero_pool_stats *stats);
+#else
+static inline void zero_pool_init(void) {}
+#endif
+
 static inline struct folio *alloc_page(gfp_t gfp_mask) {
   return alloc_pages(gfp_mask, 0);
 }
@@ -32,6 +32,9 @@
 #include <aerosync/types.h>
 #include <aerosync/version.h>
 #include <aerosync/rcu.h>
+#include <aerosync/rw_semaphore.h>
+#include <aerosync/lockstat.h>
+#include <aerosync/workqueue.h>
 #include <aerosync/percpu.h>
 #include <arch/x86_64/cpu.h>
 #include <arch/x86_64/entry.h>
@@ -41,9 +44,11 @@
 #include <arch/x86_64/idt/idt.h>
 #include <arch/x86_64/mm/pmm.h>
 #include <arch/x86_64/mm/vmm.h>
+#include <arch/x86_64/mm/tlb.h>
 #include <arch/x86_64/percpu.h>
 #include <arch/x86_64/requests.h>
 #include <arch/x86_64/smp.h>
+#include <arch/x86_64/string.h>
 #include <compiler.h>
 #include <aerosync/crypto.h>
 #include <aerosync/sysintf/device.h>
@@ -51,20 +56,24 @@
 #include <drivers/acpi/power.h>
 #include <drivers/qemu/debugcon/debugcon.h>
 #include <fs/vfs.h>
+#include <fs/file.h>
 #include <lib/log.h>
 #include <lib/printk.h>
 #include <limine/limine.h>
 #include <linux/maple_tree.h>
 #include <linux/radix-tree.h>
+#include <mm/numa_balancing.h>
 #include <mm/shm.h>
 #include <mm/slub.h>
 #include <mm/vm_object.h>
 #include <mm/vma.h>
 #include <mm/vmalloc.h>
 #include <mm/zmm.h>
+#include <mm/swap.h>
 #include <aerosync/resdomain.h>
 #include <aerosync/sysintf/fw.h>
 #include <fs/initramfs.h>
+#include <fs/eventpoll.h>
 #include <uacpi/uacpi.h>
 
 static alignas(16) struct task_struct bsp_task;
@@ -76,6 +85,11 @@ static int __late_init __noreturn __noinline __sysv_abi kernel_init(void *unused
   fkx_init_module_class(FKX_GENERIC_CLASS);
 
   rcu_spawn_kthreads();
+  workqueue_init();
+  pmm_deferred_init();
+#ifdef CONFIG_LOCK_STAT
+  lockstat_init();
+#endif
 
 #ifdef CONFIG_RCU_PERCPU_TEST
   if (cmdline_get_flag("rcutest")) {
@@ -84,9 +98,58 @@ static int __late_init __noreturn __noinline __sysv_abi kernel_init(void *unused
   }
 #endif
 
+#ifdef CONFIG_SPINLOCK_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "lockbench"))
+    spinlock_bench();
+#endif
+
+#ifdef CONFIG_RWSEM_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "rwsembench"))
+    rwsem_bench();
+#endif
+
+#ifdef CONFIG_RCU_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "rcubench"))
+    rcu_bench();
+#endif
+
+#ifdef CONFIG_EPOLL_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "epollbench"))
+    epoll_bench();
+#endif
+
+#ifdef CONFIG_PRINTK_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "printkbench"))
+    printk_bench();
+#endif
+
+#ifdef CONFIG_CONSOLE_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "consolebench"))
+    console_bench();
+#endif
+
+#ifdef CONFIG_STRING_BENCH
+  if (cmdline_find_option_bool(current_cmdline, "stringbench"))
+    string_bench();
+#endif
+
   zmm_init();
+#ifdef CONFIG_MM_SWAP
+  swap_init();
+  {
+    /* swap=<disk name or /path> activates a swap device at boot */
+    char swap_path[64];
+    if (get_cmdline_request()->response &&
+        cmdline_find_option(current_cmdline, "swap", swap_path, sizeof(swap_path)) > 0) {
+      int ret = sys_swapon(swap_path, 0);
+      if (ret < 0)
+        printk(KERN_ERR KERN_CLASS "swapon %s failed (%d)\n", swap_path, ret);
+    }
+  }
+#endif
   shm_init();
   kswapd_init();
+  zero_pool_init();
   kcompactd_init();
   khugepaged_init();
   vm_writeback_init();
@@ -241,6 +304,7 @@ void __no_sanitize __init __noreturn __noinline __sysv_abi start_kernel(void) {
   rcu_init();
 
   smp_prepare_boot_cpu();
+  vmm_tlb_init();
   pmm_init_cpu();
   vmalloc_init();
 
@@ -251,6 +315,7 @@ void __no_sanitize __init __noreturn __noinline __sysv_abi start_kernel(void) {
   syscall_init();
 
   fpu_init();
+  string_ops_init();
   pid_allocator_init();
   sched_init();
   bsp_task.active_mm = &init_mm;
@@ -263,8 +328,15 @@ void __no_sanitize __init __noreturn __noinline __sysv_abi start_kernel(void) {
 #endif
 
   vfs_init();
+  slabinfo_init();
+  numa_balancing_init();
   resdomain_init();
 
+#ifdef CONFIG_VFS_RW_TEST
+  if (cmdline_find_option_bool(current_cmdline, "rwtest"))
+    rw_test();
+#endif
+
 #ifdef INCLUDE_MM_TESTS
   if (cmdline_find_option_bool(current_cmdline, "mtest")) {
     pmm_test();
@@ -304,6 +376,7 @@ void __no_sanitize __init __noreturn __noinline __sysv_abi start_kernel(void) {
   time_calibrate_tsc_system();
 
   timer_init_subsystem();
+  workqueue_init_early();
 
   // -- initialize the rest of uACPI ---
   uacpi_kernel_init_late();
@@ -18,32 +18,65 @@
  * GNU General Public License for more details.
  */
 
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/smp.h>
 #include <arch/x86_64/tsc.h>
 #include <compiler.h>
 #include <aerosync/sched/process.h>
 #include <aerosync/sched/sched.h>
+#include <aerosync/export.h>
 #include <aerosync/spinlock.h>
-#include <aerosync/wait.h>
+#include <aerosync/timer.h>
 #include <lib/log.h>
 #include <lib/printk.h>
-#include <lib/ringbuf.h>
+#include <lib/string.h>
 #include <lib/vsprintf.h>
 
-// Simple global ring buffer for log messages, Linux-like but minimal
+/*
+ * Lockless multi-producer record ring.
+ *
+ * Every message gets a global sequence number from a single fetch-and-add
+ * and owns the fixed-size slot (seq % KLOG_RING_RECORDS) while it copies its
+ * text in. The slot's state word carries the sequence it holds plus a BUSY
+ * bit while the writer is still copying, so writers never wait on each
+ * other or on the console: the worst a writer can do is lose its record
+ * when a later lap of the ring has already claimed the slot.
+ *
+ * Readers (the console and log_read()) keep their own cursor and validate
+ * each copy against the state word, seqlock style; records that were
+ * overwritten under them are counted as lost and skipped.
+ */
 
-#ifndef KLOG_RING_SIZE
-#define KLOG_RING_SIZE (4096)
+#ifndef KLOG_RING_RECORDS
+#define KLOG_RING_RECORDS 256
 #endif
 
-// Flags for klog header
-#define KLOGF_SYNC_EMITTED 0x01 // already emitted to console synchronously
+// 24-byte header plus room for a whole printk() line (256 bytes)
+#define KLOG_RECORD_SIZE 280
+
+static_assert((KLOG_RING_RECORDS & (KLOG_RING_RECORDS - 1)) == 0,
+              "KLOG_RING_RECORDS must be a power of two");
+
+// Slot state: sequence << KLOG_STATE_SHIFT | KLOG_STATE_*
+#define KLOG_STATE_BUSY    0x1 // writer still copying
+#define KLOG_STATE_DROPPED 0x2 // slot published as a hole
+#define KLOG_STATE_SHIFT   2
+
+#define klog_state_seq(state) ((state) >> KLOG_STATE_SHIFT)
+
+struct klog_record {
+  uint64_t state;
+  uint64_t ts_ns;  // producer timestamp in nanoseconds
+  uint16_t len;    // payload length (bytes)
+  uint8_t level;   // log level
+  uint8_t __pad[5];
+  char text[KLOG_RECORD_SIZE - 24];
+};
+
+static_assert(sizeof(struct klog_record) == KLOG_RECORD_SIZE,
+              "klog_record must fill its slot exactly");
 
-typedef struct {
-  uint8_t level;  // log level
-  uint8_t flags;  // see KLOGF_*
-  uint16_t len;   // payload length (bytes)
-  uint64_t ts_ns; // producer timestamp in nanoseconds
-} __packed klog_hdr_t;
+#define KLOG_TEXT_MAX sizeof(((struct klog_record *)nullptr)->text)
 
 #include <arch/x86_64/percpu.h>
 
@@ -55,16 +88,23 @@ DEFINE_PER_CPU(char, printk_safe_buf[PRINTK_SAFE_BUF_SIZE]);
 // Forward declaration for the klogd thread function used when creating kthreads
 static int klogd_thread(void *data);
 
-static uint8_t klog_ring_data[KLOG_RING_SIZE];
-static ringbuf_t klog_ring = {
-    .data = klog_ring_data, .size = KLOG_RING_SIZE, .head = 0, .tail = 0};
+static struct klog_record klog_ring[KLOG_RING_RECORDS] __aligned(64);
+// Next sequence to hand out. Sequence 0 is never used so that a zeroed slot
+// never looks published.
+static uint64_t klog_head __aligned(64) = 1;
 
 static int klog_console_level = KLOG_INFO;
 static log_sink_putc_t klog_console_sink = nullptr; // defaults to ring buffer only
-static DEFINE_SPINLOCK(klog_lock);
 
-// Serialize immediate console output across CPUs to prevent mangled lines
+// Console consumer: serializes output across CPUs and owns the cursor below
 static DEFINE_SPINLOCK(klog_console_lock);
+static uint64_t klog_console_seq = 1;
+static uint64_t klog_console_lost;
+
+// log_read() consumer
+static DEFINE_SPINLOCK(klog_read_lock);
+static uint64_t klog_read_seq = 1;
+
 // Async logging control
 static volatile int klog_async_enabled = 0;
 static struct task_struct *klogd_task = nullptr;
@@ -72,12 +112,17 @@ static struct task_struct *klogd_task = nullptr;
 static int klog_console_sink_async_hint = 0;
 // Debug enablement (independent of numeric KLOG_DEBUG value)
 static int klog_debug_enabled = 0;
-// Panic state: if non-zero, we ignore locks to ensure output
-static volatile int panic_in_progress = 0;
+// CPU that owns the panic and may flush the console synchronously, or -1
+static int klog_panic_cpu = -1;
 
-static DECLARE_WAIT_QUEUE_HEAD(klogd_wait);
+void log_mark_panic(void) {
+  int none = -1;
+  __atomic_compare_exchange_n(&klog_panic_cpu, &none, (int)smp_get_id(), false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
 
-void log_mark_panic(void) { panic_in_progress = 1; }
+int log_in_panic(void) { return READ_ONCE(klog_panic_cpu) >= 0; }
+EXPORT_SYMBOL(log_in_panic);
 
 // klogd drain budgeting to avoid monopolizing CPU on slow sinks (e.g.,
 // linearfb)
@@ -91,26 +136,119 @@ void log_mark_panic(void) { panic_in_progress = 1; }
 // Time budget per active drain slice (~2 ms)
 #define KLOGD_MAX_SLICE_NS (2ULL * 1000ULL * 1000ULL)
 #endif
+// Writers never wake klogd (they may hold scheduler locks), so it polls,
+// backing off from 1 ms to 16 ms while the ring stays empty.
+#ifndef KLOGD_MIN_IDLE_NS
+#define KLOGD_MIN_IDLE_NS (1ULL * 1000ULL * 1000ULL)
+#endif
+#ifndef KLOGD_MAX_IDLE_NS
+#define KLOGD_MAX_IDLE_NS (16ULL * 1000ULL * 1000ULL)
+#endif
 
-static void drop_oldest(uint32_t need) {
-  while (ringbuf_space(&klog_ring) < need) {
-    klog_hdr_t hdr;
-    if (ringbuf_peek(&klog_ring, &hdr, sizeof(hdr)) < sizeof(hdr))
-      break;
-    uint32_t drop = sizeof(hdr) + hdr.len;
-    ringbuf_skip(&klog_ring, drop);
+static void klog_store(int level, const char *msg, size_t len, bool newline,
+                       uint64_t ts_ns) {
+  uint64_t seq = __atomic_fetch_add(&klog_head, 1, __ATOMIC_RELAXED);
+  struct klog_record *r = &klog_ring[seq & (KLOG_RING_RECORDS - 1)];
+  uint64_t busy = (seq << KLOG_STATE_SHIFT) | KLOG_STATE_BUSY;
+  uint64_t old = __atomic_load_n(&r->state, __ATOMIC_RELAXED);
+
+  do {
+    // A later lap already owns the slot: this record is lost
+    if (klog_state_seq(old) >= seq)
+      return;
+  } while (!__atomic_compare_exchange_n(&r->state, &old, busy, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  if (old & KLOG_STATE_BUSY) {
+    // The previous lap is still copying into this slot. Leave the payload
+    // to it and publish a hole so readers don't wait for us.
+    __atomic_compare_exchange_n(&r->state, &busy,
+                                (seq << KLOG_STATE_SHIFT) | KLOG_STATE_DROPPED,
+                                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    return;
   }
+
+  smp_wmb();
+  r->ts_ns = ts_ns;
+  r->len = (uint16_t)len;
+  r->level = (uint8_t)level;
+  memcpy(r->text, msg, len);
+  if (newline)
+    r->text[len - 1] = '\n';
+
+  // Fails only if a later lap took the slot while we were copying
+  __atomic_compare_exchange_n(&r->state, &busy, seq << KLOG_STATE_SHIFT, false,
+                              __ATOMIC_RELEASE, __ATOMIC_RELAXED);
 }
 
-void log_init(const log_sink_putc_t backend) {
-  // We don't re-initialize the ringbuffer here if it already has data
-  // ringbuf_init would reset head/tail.
-  // If ringbuffer was somehow not setup (shouldn't happen with static init), do
-  // it.
-  if (klog_ring.data == nullptr) {
-    ringbuf_init(&klog_ring, klog_ring_data, KLOG_RING_SIZE);
+/*
+ * Copy the record at *cursor into @out and advance. Returns false when the
+ * next record has not been published yet. Caller serializes per cursor.
+ */
+static bool klog_read_record(uint64_t *cursor, struct klog_record *out,
+                             uint64_t *lost) {
+  for (;;) {
+    uint64_t seq = *cursor;
+    uint64_t head = __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE);
+
+    if (seq >= head)
+      return false;
+
+    // Everything older than one lap has been overwritten
+    if (head - seq > KLOG_RING_RECORDS) {
+      *lost += head - KLOG_RING_RECORDS - seq;
+      seq = head - KLOG_RING_RECORDS;
+      *cursor = seq;
+    }
+
+    struct klog_record *r = &klog_ring[seq & (KLOG_RING_RECORDS - 1)];
+    uint64_t state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+
+    // Reserved but not claimed yet, or still being copied
+    if (klog_state_seq(state) < seq ||
+        state == ((seq << KLOG_STATE_SHIFT) | KLOG_STATE_BUSY))
+      return false;
+
+    if (state == seq << KLOG_STATE_SHIFT) {
+      size_t len = READ_ONCE(r->len);
+      if (len > KLOG_TEXT_MAX)
+        len = KLOG_TEXT_MAX;
+
+      out->ts_ns = READ_ONCE(r->ts_ns);
+      out->level = READ_ONCE(r->level);
+      memcpy(out->text, r->text, len);
+      smp_rmb();
+
+      if (__atomic_load_n(&r->state, __ATOMIC_RELAXED) == state) {
+        out->len = (uint16_t)len;
+        *cursor = seq + 1;
+        return true;
+      }
+    }
+
+    // A hole, overwritten by a later lap, or torn while we copied
+    (*lost)++;
+    *cursor = seq + 1;
   }
+}
+
+// True if the console cursor sits on a record that can be consumed now
+static bool klog_console_ready(void) {
+  uint64_t seq = READ_ONCE(klog_console_seq);
+  uint64_t head = __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE);
 
+  if (seq >= head)
+    return false;
+  if (head - seq > KLOG_RING_RECORDS)
+    return true;
+
+  uint64_t state = __atomic_load_n(
+      &klog_ring[seq & (KLOG_RING_RECORDS - 1)].state, __ATOMIC_ACQUIRE);
+  return klog_state_seq(state) > seq ||
+         (klog_state_seq(state) == seq && !(state & KLOG_STATE_BUSY));
+}
+
+void log_init(const log_sink_putc_t backend) {
   klog_console_sink = backend;
 }
 
@@ -197,7 +335,80 @@ static void __no_cfi console_emit_prefix_ts(int level, uint64_t ts_ns) {
   }
 }
 
-static int klog_sync_threshold = KLOG_ERR; // ERR and above stay synchronous
+static void __no_cfi console_emit_str(const char *s, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    klog_console_sink(s[i]);
+}
+
+/*
+ * Consume one record from the console cursor and print it if its level
+ * passes. Returns the bytes consumed, or -1 if nothing was ready.
+ * Called with klog_console_lock held (or busted, during panic).
+ */
+static int __no_cfi klog_console_emit_next(void) {
+  struct klog_record rec;
+
+  if (!klog_read_record(&klog_console_seq, &rec, &klog_console_lost))
+    return -1;
+
+  log_sink_putc_t sink = klog_console_sink;
+  if (!sink)
+    return rec.len;
+
+  // Recompute effective console level here so the consumer honors the
+  // runtime debug enable flag.
+  int effective_console_level = klog_console_level;
+  if (klog_debug_enabled)
+    effective_console_level = KLOG_DEBUG;
+
+  if (klog_console_lost && KLOG_WARNING <= effective_console_level) {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "** %llu printk messages dropped **\n",
+                     klog_console_lost);
+    console_emit_prefix_ts(KLOG_WARNING, rec.ts_ns);
+    console_emit_str(buf, (size_t)n);
+    klog_console_lost = 0;
+  }
+
+  if (rec.level <= effective_console_level) {
+    console_emit_prefix_ts(rec.level, rec.ts_ns);
+    console_emit_str(rec.text, rec.len);
+  }
+  return rec.len;
+}
+
+/*
+ * Writer-side flush used before klogd exists. Never waits: if another CPU
+ * holds the console it prints our record too, and it rechecks after
+ * dropping the lock so a record published meanwhile is not stranded.
+ */
+static void klog_console_try_flush(void) {
+  do {
+    irq_flags_t f = local_irq_save();
+    if (!spinlock_trylock(&klog_console_lock)) {
+      local_irq_restore(f);
+      return;
+    }
+    while (klog_console_emit_next() >= 0)
+      ;
+    spinlock_unlock(&klog_console_lock);
+    local_irq_restore(f);
+    smp_mb();
+  } while (klog_console_ready());
+}
+
+/*
+ * Panic flush: the panicking CPU prints whatever is pending, taking the
+ * console lock if it can and ignoring it otherwise - its holder may be a
+ * CPU that will never run again.
+ */
+static void klog_console_flush_emergency(void) {
+  int locked = spinlock_trylock(&klog_console_lock);
+  while (klog_console_emit_next() >= 0)
+    ;
+  if (locked)
+    spinlock_unlock(&klog_console_lock);
+}
 
 static int early_printk_recursion = 0;
 
@@ -232,162 +443,98 @@ int __no_cfi log_write_str(int level, const char *msg) {
     return 0;
   }
 
-  // Compute message length
+  // Compute message length, capped to what a record holds
   size_t len = 0;
-  for (const char *p = msg; *p; ++p)
+  for (const char *p = msg; *p && len < KLOG_TEXT_MAX; ++p)
     len++;
 
-  // Cap length to ring size - header - 1 to ensure progress
-  size_t max_payload = (size_t)KLOG_RING_SIZE - sizeof(klog_hdr_t) - 1;
-  if (len > max_payload)
-    len = max_payload;
+  // A truncated line still ends the record with its newline
+  bool newline = false;
+  if (msg[len]) {
+    const char *end = msg + len;
+    while (end[1])
+      end++;
+    newline = *end == '\n';
+  }
 
   // Producer timestamp captured once
   uint64_t ts_ns = get_time_ns();
 
-  // Decide whether to emit synchronously.
-  int do_sync_emit = 0;
-  int effective_console_level = klog_console_level;
-  if (klog_debug_enabled)
-    effective_console_level = KLOG_DEBUG;
-
-  if (klog_console_sink && level <= effective_console_level) {
-    if (level <= effective_console_level)
-      do_sync_emit = ((!klog_async_enabled && !klog_console_sink_async_hint) ||
-                      (level <= klog_sync_threshold));
-  }
-
-  // Nested calls never emit synchronously to avoid deadlocking console_lock
-  if (rec > 0)
-    do_sync_emit = 0;
-
-  uint8_t flags_hdr = 0;
-  if (do_sync_emit) {
-    irq_flags_t f;
-    f = spinlock_lock_irqsave(&klog_console_lock);
-    console_emit_prefix_ts(level, ts_ns);
-    const char *p = msg;
-    while (*p)
-      klog_console_sink(*p++);
-    spinlock_unlock_irqrestore(&klog_console_lock, f);
-    flags_hdr |= KLOGF_SYNC_EMITTED;
+  // Interrupts stay off only while the slot is claimed and filled, which
+  // keeps the window in which readers see it busy as short as possible.
+  irq_flags_t flags = local_irq_save();
+  klog_store(level, msg, len, newline, ts_ns);
+  local_irq_restore(flags);
+
+  // Nested calls never touch the console: the outer call may hold it.
+  // Once klogd runs, only the panicking CPU prints synchronously.
+  if (rec == 0) {
+    int panic_cpu = READ_ONCE(klog_panic_cpu);
+    if (panic_cpu >= 0) {
+      if (panic_cpu == (int)smp_get_id())
+        klog_console_flush_emergency();
+    } else if (!klog_async_enabled) {
+      klog_console_try_flush();
+    }
   }
 
-  // Always store in ring buffer regardless of sink presence
-  irq_flags_t flags;
-  flags = spinlock_lock_irqsave(&klog_lock);
-  uint32_t need = (uint32_t)(sizeof(klog_hdr_t) + (uint32_t)len);
-  if (ringbuf_space(&klog_ring) < need)
-    drop_oldest(need);
-
-  // Write header and payload
-  klog_hdr_t hdr = {.level = (uint8_t)level,
-                    .flags = flags_hdr,
-                    .len = (uint16_t)len,
-                    .ts_ns = ts_ns};
-  ringbuf_write(&klog_ring, &hdr, sizeof(hdr));
-  ringbuf_write(&klog_ring, msg, len);
-
-  spinlock_unlock_irqrestore(&klog_lock, flags);
-
   if (percpu_ready())
     this_cpu_dec(printk_recursion);
   else
     early_printk_recursion--;
 
-  // Don't check_preempt here - IRQ state may be inconsistent immediately
-  // after spinlock_unlock_irqrestore(). The scheduler will preempt naturally
-  // on the next timer tick or syscall return.
-
   return (int)len;
 }
 
 // Background logger thread: drains ring buffer to console
 static int __no_cfi klogd_thread(void *data) {
   (void)data;
-  char out_buf[512];
+  uint64_t idle_ns = KLOGD_MIN_IDLE_NS;
+
   while (1) {
     uint64_t slice_start = get_time_ns();
     int records = 0;
     size_t bytes = 0;
+    bool drained_any = false;
+
     for (;;) {
-      int lvl = KLOG_INFO;
-      uint64_t ts = 0;
-      uint8_t flags_local = 0;
-      // internal read to obtain ts/flags
-      size_t n = 0;
-      {
-        // inline internal reader: duplicated logic of log_read to also fetch
-        // ts/flags
-        uint64_t lflags = spinlock_lock_irqsave(&klog_lock);
-        if (!ringbuf_empty(&klog_ring)) {
-          klog_hdr_t hdr;
-          if (ringbuf_read(&klog_ring, &hdr, sizeof(hdr)) == sizeof(hdr)) {
-            lvl = hdr.level;
-            ts = hdr.ts_ns;
-            flags_local = hdr.flags;
-            size_t to_copy = hdr.len;
-            if (to_copy > sizeof(out_buf) - 1)
-              to_copy = sizeof(out_buf) - 1;
-            n = ringbuf_read(&klog_ring, out_buf, to_copy);
-            if (n < to_copy && hdr.len > to_copy) {
-              ringbuf_skip(&klog_ring, hdr.len - to_copy);
-            }
-            out_buf[n] = '\0';
-          }
-        }
-        spinlock_unlock_irqrestore(&klog_lock, lflags);
-      }
-      if (n == 0)
+      irq_flags_t cf = spinlock_lock_irqsave(&klog_console_lock);
+      int n = klog_console_emit_next();
+      spinlock_unlock_irqrestore(&klog_console_lock, cf);
+      if (n < 0)
         break;
 
-      // Recompute effective console level here as well so background
-      // consumer honors the runtime debug enable flag.
-      int effective_console_level_klogd = klog_console_level;
-      if (klog_debug_enabled)
-        effective_console_level_klogd = KLOG_DEBUG;
-
-      if (!(flags_local & KLOGF_SYNC_EMITTED) && klog_console_sink &&
-          lvl <= effective_console_level_klogd) {
-        // In klogd context, avoid disabling IRQs while emitting to slow sinks
-        // to reduce system-wide latency. Console lock still protects output
-        // order.
-        irq_flags_t cf = spinlock_lock_irqsave(&klog_console_lock);
-        console_emit_prefix_ts(lvl, ts);
-        for (size_t j = 0; j < n; ++j)
-          klog_console_sink(out_buf[j]);
-        spinlock_unlock_irqrestore(&klog_console_lock, cf);
-      }
+      drained_any = true;
       records++;
-      bytes += n;
+      bytes += (size_t)n;
 
       // Cooperative yield if we exceed any budget to avoid starving others
       uint64_t now = get_time_ns();
       if (records >= KLOGD_MAX_BATCH_RECORDS ||
           bytes >= (size_t)KLOGD_MAX_BATCH_BYTES ||
           (now - slice_start) >= KLOGD_MAX_SLICE_NS) {
-        // Cooperative yield - only schedule once to prevent stack buildup.
         schedule();
         slice_start = get_time_ns();
         records = 0;
         bytes = 0;
       }
     }
-    // No explicit schedule() needed here here, loop back to wait_event
+
+    if (drained_any)
+      idle_ns = KLOGD_MIN_IDLE_NS;
+    else if (idle_ns < KLOGD_MAX_IDLE_NS)
+      idle_ns *= 2;
+    set_current_state(TASK_INTERRUPTIBLE);
+    schedule_timeout(idle_ns);
   }
+  return 0;
 }
 
 void log_init_async(void) {
   if (klog_async_enabled)
     return;
-  // Create a low-priority kernel thread to drain the ring buffer
-  // Drop any pre-existing buffered records to avoid duplicate console output
-  {
-    uint64_t f = spinlock_lock_irqsave(&klog_lock);
-    ringbuf_init(&klog_ring, klog_ring_data, KLOG_RING_SIZE);
-    spinlock_unlock_irqrestore(&klog_lock, f);
-  }
-
+  // Create a low-priority kernel thread to drain the ring buffer. Records
+  // the early path hasn't printed yet stay queued for it.
   struct task_struct *t = kthread_create(klogd_thread, nullptr, "kthread/klogd");
   if (t) {
     kthread_run(t);
@@ -400,33 +547,182 @@ int log_read(char *out_buf, int out_buf_len, int *out_level) {
   if (!out_buf || out_buf_len <= 0)
     return 0;
 
-  uint64_t flags = spinlock_lock_irqsave(&klog_lock);
+  struct klog_record rec;
+  uint64_t lost = 0;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&klog_read_lock);
+  bool found = klog_read_record(&klog_read_seq, &rec, &lost);
+  spinlock_unlock_irqrestore(&klog_read_lock, flags);
 
-  if (ringbuf_empty(&klog_ring)) {
-    spinlock_unlock_irqrestore(&klog_lock, flags);
+  if (!found)
     return 0; // empty
+
+  int to_copy = rec.len;
+  if (to_copy > out_buf_len - 1)
+    to_copy = out_buf_len - 1; // reserve NUL
+
+  memcpy(out_buf, rec.text, (size_t)to_copy);
+  out_buf[to_copy] = '\0';
+  if (out_level)
+    *out_level = rec.level;
+
+  return to_copy;
+}
+
+#ifdef CONFIG_PRINTK_BENCH
+
+#include <aerosync/atomic.h>
+#include <aerosync/classes.h>
+#include <aerosync/completion.h>
+#include <aerosync/sched/cpumask.h>
+
+#define PRINTK_BENCH_OPS         4000
+#define PRINTK_BENCH_MAX_THREADS 32
+#define PRINTK_BENCH_BUCKETS     32 /* log2(ns) latency histogram */
+
+static struct {
+  int nr_threads;
+  int go;
+  atomic_t arrived;
+  atomic_t running;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t hist[PRINTK_BENCH_BUCKETS];
+  struct completion done;
+} printk_bench_state;
+
+static void printk_bench_arrive(void) {
+  if (atomic_inc_return(&printk_bench_state.arrived) ==
+      printk_bench_state.nr_threads) {
+    printk_bench_state.start_ns = get_time_ns();
+    WRITE_ONCE(printk_bench_state.go, 1);
   }
+}
 
-  klog_hdr_t hdr;
-  if (ringbuf_read(&klog_ring, &hdr, sizeof(hdr)) < sizeof(hdr)) {
-    spinlock_unlock_irqrestore(&klog_lock, flags);
-    return 0;
+static void printk_bench_leave(void) {
+  if (atomic_dec_and_test(&printk_bench_state.running)) {
+    printk_bench_state.end_ns = get_time_ns();
+    complete(&printk_bench_state.done);
   }
+}
 
-  int to_copy = hdr.len;
-  if (to_copy > out_buf_len - 1)
-    to_copy = out_buf_len - 1; // reserve NUL
+static int printk_bench_worker(void *data) {
+  int id = (int)(uintptr_t)data;
+  uint64_t hist[PRINTK_BENCH_BUCKETS] = {0};
+  uint64_t total = 0, max = 0;
+
+  printk_bench_arrive();
+  while (!READ_ONCE(printk_bench_state.go))
+    cpu_relax();
+
+  for (int i = 0; i < PRINTK_BENCH_OPS; i++) {
+    uint64_t t0 = get_time_ns();
+    printk(KERN_INFO KERN_CLASS "printkbench: cpu %d message %d\n", id, i);
+    uint64_t ns = get_time_ns() - t0;
+
+    total += ns;
+    if (ns > max)
+      max = ns;
+    int b = ns ? 64 - __builtin_clzll(ns) : 0;
+    hist[b < PRINTK_BENCH_BUCKETS ? b : PRINTK_BENCH_BUCKETS - 1]++;
+  }
+
+  __atomic_fetch_add(&printk_bench_state.total_ns, total, __ATOMIC_RELAXED);
+  uint64_t cur = __atomic_load_n(&printk_bench_state.max_ns, __ATOMIC_RELAXED);
+  while (max > cur &&
+         !__atomic_compare_exchange_n(&printk_bench_state.max_ns, &cur, max,
+                                      false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  for (int b = 0; b < PRINTK_BENCH_BUCKETS; b++)
+    if (hist[b])
+      __atomic_fetch_add(&printk_bench_state.hist[b], hist[b], __ATOMIC_RELAXED);
+
+  printk_bench_leave();
+  return 0;
+}
+
+static void printk_bench_run(int nr_threads, int console_level) {
+  memset(&printk_bench_state, 0, sizeof(printk_bench_state));
+  printk_bench_state.nr_threads = nr_threads;
+  atomic_set(&printk_bench_state.arrived, 0);
+  atomic_set(&printk_bench_state.running, nr_threads);
+  init_completion(&printk_bench_state.done);
+
+  int started = 0;
+  for (int cpu = 0; cpu < nr_threads; cpu++) {
+    struct task_struct *task =
+        kthread_create(printk_bench_worker, (void *)(uintptr_t)cpu,
+                       "printkbench/%d", cpu);
+    if (!task) {
+      printk_bench_arrive();
+      printk_bench_leave();
+      continue;
+    }
 
-  size_t actual = ringbuf_read(&klog_ring, out_buf, (size_t)to_copy);
-  if (actual < (size_t)to_copy && hdr.len > (size_t)to_copy) {
-    // Skip remaining data we couldn't fit
-    ringbuf_skip(&klog_ring, hdr.len - (size_t)to_copy);
+    cpumask_clear(&task->cpus_allowed);
+    cpumask_set_cpu(cpu, &task->cpus_allowed);
+    task->nr_cpus_allowed = 1;
+    set_task_cpu(task, cpu);
+    kthread_run(task);
+    started++;
   }
 
-  out_buf[actual] = '\0';
-  if (out_level)
-    *out_level = hdr.level;
+  wait_for_completion(&printk_bench_state.done);
+
+  // Let the console consumer catch up before the level goes back up
+  for (int i = 0; i < 1000 && klog_console_ready(); i++) {
+    set_current_state(TASK_UNINTERRUPTIBLE);
+    schedule_timeout(NSEC_PER_MSEC);
+  }
+
+  irq_flags_t f = spinlock_lock_irqsave(&klog_console_lock);
+  uint64_t lost = klog_console_lost;
+  klog_console_lost = 0;
+  spinlock_unlock_irqrestore(&klog_console_lock, f);
 
-  spinlock_unlock_irqrestore(&klog_lock, flags);
-  return (int)actual;
+  log_set_console_level(console_level);
+  if (!started)
+    return;
+
+  uint64_t ops = (uint64_t)started * PRINTK_BENCH_OPS;
+  uint64_t us = (printk_bench_state.end_ns - printk_bench_state.start_ns) / 1000;
+  uint64_t p99_target = ops - ops / 100, seen = 0;
+  int p99 = 0;
+  for (; p99 < PRINTK_BENCH_BUCKETS; p99++) {
+    seen += printk_bench_state.hist[p99];
+    if (seen >= p99_target)
+      break;
+  }
+
+  printk(KERN_INFO KERN_CLASS
+         "printkbench: %2d threads: %llu msgs/ms, avg %llu ns, p99 < %llu ns, "
+         "max %llu ns, %llu lost to overrun\n",
+         started, ops * 1000 / (us ? us : 1),
+         printk_bench_state.total_ns / ops, 1ULL << p99,
+         printk_bench_state.max_ns, lost);
 }
+
+void printk_bench(void) {
+  int cpus = (int)smp_get_cpu_count();
+  if (cpus > PRINTK_BENCH_MAX_THREADS)
+    cpus = PRINTK_BENCH_MAX_THREADS;
+
+  int saved_level = log_get_console_level();
+
+  printk(KERN_INFO KERN_CLASS
+         "printkbench: %d messages per thread, %d record ring\n",
+         PRINTK_BENCH_OPS, KLOG_RING_RECORDS);
+
+  for (int n = 1;; n = n * 2 < cpus ? n * 2 : cpus) {
+    // Records still go through the ring and klogd, but none reach the
+    // console: the run measures the writers, not the UART.
+    log_set_console_level(KLOG_EMERG - 1);
+    printk_bench_run(n, saved_level);
+    if (n == cpus)
+      break;
+  }
+}
+
+#endif /* CONFIG_PRINTK_BENCH */
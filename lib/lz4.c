@@ -0,0 +1,242 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file lib/lz4.c
+ * @brief LZ4 block compression
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <lib/lz4.h>
+#include <lib/string.h>
+#include <aerosync/errno.h>
+#include <aerosync/export.h>
+#include <compiler.h>
+
+/*
+ * Sequence layout: token (literal length << 4 | match length - 4), optional
+ * literal length bytes, literals, 16-bit little endian offset, optional match
+ * length bytes. The last 5 bytes are always literals and no match starts in
+ * the last 12 bytes, as required by the block format.
+ */
+#define LZ4_LASTLITERALS    5
+#define LZ4_MFLIMIT         12
+#define LZ4_MIN_LENGTH      (LZ4_MFLIMIT + 1)
+#define LZ4_RUN_MASK        15
+#define LZ4_ML_MASK         15
+#define LZ4_SKIP_TRIGGER    6
+
+static __always_inline uint32_t lz4_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static __always_inline uint32_t lz4_hash(uint32_t seq) {
+  return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static __always_inline uint8_t *lz4_put_length(uint8_t *op, size_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+/* Emit literals [anchor, anchor + lit) followed by an optional match */
+static __always_inline uint8_t *lz4_put_sequence(uint8_t *op, const uint8_t *anchor, size_t lit,
+                                                 size_t offset, size_t mlen, bool has_match) {
+  uint8_t *token = op++;
+
+  if (lit >= LZ4_RUN_MASK) {
+    *token = LZ4_RUN_MASK << 4;
+    op = lz4_put_length(op, lit - LZ4_RUN_MASK);
+  } else {
+    *token = (uint8_t) (lit << 4);
+  }
+
+  memcpy(op, anchor, lit);
+  op += lit;
+
+  if (!has_match)
+    return op;
+
+  *op++ = (uint8_t) offset;
+  *op++ = (uint8_t) (offset >> 8);
+
+  if (mlen >= LZ4_ML_MASK) {
+    *token |= LZ4_ML_MASK;
+    op = lz4_put_length(op, mlen - LZ4_ML_MASK);
+  } else {
+    *token |= (uint8_t) mlen;
+  }
+
+  return op;
+}
+
+static __always_inline size_t lz4_sequence_cost(size_t lit, size_t mlen) {
+  return 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1;
+}
+
+size_t lz4_compress(const void *source, size_t src_len, void *dest, size_t dst_cap, void *wrkmem) {
+  const uint8_t *src = source;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *const iend = src + src_len;
+  uint8_t *op = dest;
+  uint8_t *const oend = op + dst_cap;
+  uint16_t *table = wrkmem;
+
+  if (src_len > LZ4_MAX_INPUT_SIZE)
+    return 0;
+
+  if (src_len >= LZ4_MIN_LENGTH) {
+    const uint8_t *const mflimit = iend - LZ4_MFLIMIT;
+    const uint8_t *const matchlimit = iend - LZ4_LASTLITERALS;
+
+    memset(table, 0, LZ4_MEM_COMPRESS);
+    ip++;
+
+    while (ip < mflimit) {
+      uint32_t seq = lz4_read32(ip);
+      uint32_t h = lz4_hash(seq);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = (uint16_t) (ip - src);
+
+      if (ref >= ip || lz4_read32(ref) != seq) {
+        /* Step faster through data that keeps missing */
+        ip += 1 + ((size_t) (ip - anchor) >> LZ4_SKIP_TRIGGER);
+        continue;
+      }
+
+      /* Extend backwards into pending literals */
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+
+      const uint8_t *mp = ip + LZ4_MINMATCH;
+      const uint8_t *rp = ref + LZ4_MINMATCH;
+      while (mp < matchlimit && *mp == *rp) {
+        mp++;
+        rp++;
+      }
+
+      size_t lit = (size_t) (ip - anchor);
+      size_t mlen = (size_t) (mp - ip) - LZ4_MINMATCH;
+
+      if (lz4_sequence_cost(lit, mlen) > (size_t) (oend - op))
+        return 0;
+
+      op = lz4_put_sequence(op, anchor, lit, (size_t) (ip - ref), mlen, true);
+
+      ip = mp;
+      anchor = ip;
+
+      /* Seed the table with a position inside the match */
+      if (ip - 2 > src && ip < mflimit)
+        table[lz4_hash(lz4_read32(ip - 2))] = (uint16_t) (ip - 2 - src);
+    }
+  }
+
+  size_t lit = (size_t) (iend - anchor);
+  if (1 + lit + lit / 255 + 1 > (size_t) (oend - op))
+    return 0;
+
+  op = lz4_put_sequence(op, anchor, lit, 0, 0, false);
+  return (size_t) (op - (uint8_t *) dest);
+}
+EXPORT_SYMBOL(lz4_compress);
+
+int lz4_decompress(const void *source, size_t src_len, void *dest, size_t dst_cap) {
+  const uint8_t *ip = source;
+  const uint8_t *const iend = ip + src_len;
+  uint8_t *op = dest;
+  uint8_t *const ostart = dest;
+  uint8_t *const oend = op + dst_cap;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t lit = token >> 4;
+
+    if (lit == LZ4_RUN_MASK) {
+      uint8_t b;
+      do {
+        if (unlikely(ip >= iend))
+          return -EINVAL;
+        b = *ip++;
+        lit += b;
+      } while (b == 255);
+    }
+
+    if (unlikely(lit > (size_t) (iend - ip) || lit > (size_t) (oend - op)))
+      return -EINVAL;
+
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+
+    /* The last sequence carries literals only */
+    if (ip >= iend)
+      break;
+
+    if (unlikely(iend - ip < 2))
+      return -EINVAL;
+
+    size_t offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+    ip += 2;
+    if (unlikely(offset == 0 || offset > (size_t) (op - ostart)))
+      return -EINVAL;
+
+    size_t mlen = token & LZ4_ML_MASK;
+    if (mlen == LZ4_ML_MASK) {
+      uint8_t b;
+      do {
+        if (unlikely(ip >= iend))
+          return -EINVAL;
+        b = *ip++;
+        mlen += b;
+      } while (b == 255);
+    }
+    mlen += LZ4_MINMATCH;
+
+    if (unlikely(mlen > (size_t) (oend - op)))
+      return -EINVAL;
+
+    const uint8_t *match = op - offset;
+    if (offset >= mlen) {
+      memcpy(op, match, mlen);
+      op += mlen;
+    } else if (offset >= 8) {
+      /* Overlapping, but each 8-byte chunk reads only already written bytes */
+      while (mlen >= 8) {
+        memcpy(op, match, 8);
+        op += 8;
+        match += 8;
+        mlen -= 8;
+      }
+      while (mlen--)
+        *op++ = *match++;
+    } else {
+      while (mlen--)
+        *op++ = *match++;
+    }
+  }
+
+  return (int) (op - ostart);
+}
+EXPORT_SYMBOL(lz4_decompress);
@@ -114,6 +114,8 @@ int __no_cfi printk_set_sink(const char *backend_name, bool cleanup) {
     const printk_backend_t *b = registered_backends[i];
     if (b && b->name && strcmp(b->name, backend_name) == 0) {
       if (active_backend && active_backend->cleanup && cleanup) {
+        if (active_backend->flush)
+          active_backend->flush();
         active_backend->cleanup();
       }
 
@@ -192,6 +194,8 @@ EXPORT_SYMBOL(printk_auto_select_backend);
 
 void __no_cfi printk_shutdown(void) {
   if (active_backend && active_backend->cleanup) {
+    if (active_backend->flush)
+      active_backend->flush();
     active_backend->cleanup();
   }
   active_backend = nullptr;
@@ -297,4 +301,64 @@ int ___ratelimit(ratelimit_state_t *rs, const char *func) {
   spinlock_unlock_irqrestore(&rs->lock, flags);
   return 0;
 }
-EXPORT_SYMBOL(___ratelimit);
\ No newline at end of file
+EXPORT_SYMBOL(___ratelimit);
+#ifdef CONFIG_CONSOLE_BENCH
+
+#define CONSOLE_BENCH_LINES 100000
+
+/* Push boot-log-like lines straight into @b, bypassing the log ring */
+static uint64_t __no_cfi console_bench_pass(const printk_backend_t *b, bool flush_each) {
+  char line[96];
+  uint64_t chars = 0;
+  uint64_t start = get_time_ns();
+
+  for (int i = 0; i < CONSOLE_BENCH_LINES; i++) {
+    int n = snprintf(line, sizeof(line),
+                     "[%5d.%06d] consolebench: boot log line %d of %d\n",
+                     i / 1000, (i % 1000) * 1000, i, CONSOLE_BENCH_LINES);
+    for (int j = 0; j < n; j++) {
+      b->putc(line[j]);
+      if (flush_each && b->flush)
+        b->flush();
+    }
+    chars += (uint64_t)n;
+  }
+  if (b->flush)
+    b->flush();
+
+  uint64_t ns = get_time_ns() - start;
+  return chars * 1000000000ULL / (ns ? ns : 1);
+}
+
+void console_bench(void) {
+  const printk_backend_t *b = active_backend;
+  if (!b || !b->putc) {
+    printk(KERN_ERR KERN_CLASS "consolebench: no active console\n");
+    return;
+  }
+
+  // Keep klogd's output from interleaving with ours
+  log_set_console_sink(nullptr);
+
+  // Baseline: the backend's old renderer, which flushes every character
+  uint64_t legacy = 0;
+  if (b->bench_legacy) {
+    b->bench_legacy(true);
+    legacy = console_bench_pass(b, false);
+    b->bench_legacy(false);
+  }
+
+  uint64_t each = console_bench_pass(b, true);
+  uint64_t batched = console_bench_pass(b, false);
+  log_set_console_sink(b->putc);
+
+  if (b->bench_legacy)
+    printk(KERN_INFO KERN_CLASS "consolebench: %s, %d lines: legacy renderer %llu chars/s\n",
+           b->name, CONSOLE_BENCH_LINES, legacy);
+  printk(KERN_INFO KERN_CLASS
+         "consolebench: %s, %d lines: flush per char %llu chars/s, "
+         "batched %llu chars/s\n",
+         b->name, CONSOLE_BENCH_LINES, each, batched);
+}
+
+#endif /* CONFIG_CONSOLE_BENCH */
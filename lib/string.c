@@ -21,7 +21,6 @@
 #include <lib/string.h>
 #include <aerosync/export.h>
 #include <mm/slub.h>
-#include <arch/x86_64/features/features.h>
 #include <aerosync/ctype.h>
 #include <aerosync/errno.h>
 #include <aerosync/stdarg.h>
@@ -432,21 +431,14 @@ char *strtok_r(char *s, const char *ct, char **last) {
 }
 #endif
 
-void *memset(void *s, int c, size_t n) {
+/*
+ * Portable fallbacks. memcpy(), memset() and memmove() themselves are static
+ * calls bound at boot by arch/x86_64/lib/string.c, which also holds the
+ * string-instruction variants.
+ */
+void *memset_generic(void *s, int c, size_t n) {
   if (n == 0) return s;
 
-#ifdef CONFIG_OPTIMIZED_STRING
-  cpu_features_t *features = get_cpu_features();
-  if (features->fsrm || (features->erms && n >= 64)) {
-    __asm__ volatile("cld\n\t"
-      "rep stosb"
-      : "+D"(s), "+c"(n)
-      : "a"((unsigned char) c)
-      : "memory");
-    return s;
-  }
-#endif
-
   unsigned char *mem = (unsigned char *) s;
   unsigned char x = (unsigned char) c;
 
@@ -489,21 +481,9 @@ void *memset(void *s, int c, size_t n) {
   return s;
 }
 
-void *memcpy(void *d, const void *s, size_t n) {
+void *memcpy_generic(void *d, const void *s, size_t n) {
   if (n == 0) return d;
 
-#ifdef CONFIG_OPTIMIZED_STRING
-  cpu_features_t *features = get_cpu_features();
-  if (features->fsrm || (features->erms && n >= 64)) {
-    __asm__ volatile("cld\n\t"
-      "rep movsb"
-      : "+D"(d), "+S"(s), "+c"(n)
-      :
-      : "memory");
-    return d;
-  }
-#endif
-
   unsigned char *dst = (unsigned char *) d;
   const unsigned char *src = (const unsigned char *) s;
 
@@ -561,28 +541,13 @@ void *memcpy(void *d, const void *s, size_t n) {
   return d;
 }
 
-void *memmove(void *dest, const void *src, size_t n) {
+void *memmove_generic(void *dest, const void *src, size_t n) {
   if (n == 0 || dest == src) return dest;
 
   if (dest < src) {
     return memcpy(dest, src, n);
   }
 
-#ifdef CONFIG_OPTIMIZED_STRING
-  cpu_features_t *features = get_cpu_features();
-  if (features->fsrm || (features->erms && n >= 64)) {
-    void *d_end = (char *) dest + n - 1;
-    const void *s_end = (const char *) src + n - 1;
-    __asm__ volatile("std\n\t"
-      "rep movsb\n\t"
-      "cld"
-      : "+D"(d_end), "+S"(s_end), "+c"(n)
-      :
-      : "memory");
-    return dest;
-  }
-#endif
-
   unsigned char *d = (unsigned char *) dest + n;
   const unsigned char *s = (const unsigned char *) src + n;
 
@@ -1,15 +1,14 @@
 #include <lib/uaccess.h>
 #include <aerosync/export.h>
 
-/* These are implemented in arch/x86_64/lib/uaccess.asm */
-extern size_t __copy_from_user(void *to, const void *from, size_t n);
-extern size_t __copy_to_user(void *to, const void *from, size_t n);
+/* Bound at boot to one of the copy loops in arch/x86_64/lib/uaccess.asm */
+extern size_t __copy_user(void *to, const void *from, size_t n);
 
 size_t copy_from_user(void *to, const void *from, size_t n) {
     if (!access_ok(from, n))
         return n;
 
-    return __copy_from_user(to, from, n);
+    return __copy_user(to, from, n);
 }
 EXPORT_SYMBOL(copy_from_user);
 
@@ -17,6 +16,6 @@ size_t copy_to_user(void *to, const void *from, size_t n) {
     if (!access_ok(to, n))
         return n;
 
-    return __copy_to_user(to, from, n);
+    return __copy_user(to, from, n);
 }
 EXPORT_SYMBOL(copy_to_user);
\ No newline at end of file
@@ -106,7 +106,7 @@ static int migrate_pages(struct compact_control *cc) {
       /* 2. Copy data */
       void *s_virt = page_address(&src_folio->page);
       void *d_virt = page_address(dst_page);
-      memcpy(d_virt, s_virt, PAGE_SIZE);
+      copy_page(d_virt, s_virt);
 
       /* 3. Swap the page in the object/anon_vma */
       void *mapping = src_folio->mapping;
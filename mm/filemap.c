@@ -19,6 +19,10 @@
 #include <lib/uaccess.h>
 #include <aerosync/fkx/fkx.h>
 #include <aerosync/resdomain.h>
+#include <aerosync/sysintf/bio.h>
+
+/* Upper bound of pages submitted by one readahead pass */
+#define UBC_RA_BATCH 64
 
 /**
  * ubc_readahead - Advanced adaptive readahead logic.
@@ -57,14 +61,27 @@ static void ubc_readahead(struct vm_object *obj, uint64_t pgoff) {
   }
 
   uint32_t count = obj->readahead.size;
+  if (count > UBC_RA_BATCH) count = UBC_RA_BATCH;
+
+  /*
+   * Build the whole window first so the backend sees it as one batch:
+   * read_folios can issue a single multi-page I/O, and per-folio readers
+   * run under a plug so their bios are merged before dispatch.
+   */
+  struct folio *batch[UBC_RA_BATCH];
+  uint32_t nr = 0;
+
   for (uint32_t i = 1; i <= count; i++) {
     uint64_t next_off = pgoff + i;
 
     /* Check EOF */
     if (obj->size && (next_off << PAGE_SHIFT) >= obj->size) break;
 
-    /* Fast check if already present */
-    if (vm_object_find_folio(obj, next_off)) continue;
+    /* Fast check if already present; a hole ends the contiguous batch */
+    if (vm_object_find_folio(obj, next_off)) {
+      if (nr) break;
+      continue;
+    }
 
     struct folio *folio = alloc_pages_node(obj->preferred_node, GFP_KERNEL, 0);
     if (!folio) break;
@@ -75,35 +92,58 @@ static void ubc_readahead(struct vm_object *obj, uint64_t pgoff) {
       break;
     }
     folio->page.rd = obj->rd;
+    folio->index = next_off;
+    batch[nr++] = folio;
+  }
 
-    if (obj->ops && obj->ops->read_folio) {
-      if (obj->ops->read_folio(obj, folio) < 0) {
-        if (obj->rd) resdomain_uncharge_mem(obj->rd, PAGE_SIZE);
-        folio_put(folio);
+  if (!nr) return;
+
+  int ret = 0;
+  if (obj->ops && obj->ops->read_folios) {
+    ret = obj->ops->read_folios(obj, batch, nr);
+  } else if (obj->ops && obj->ops->read_folio) {
+    struct blk_plug plug;
+    blk_start_plug(&plug);
+    for (uint32_t i = 0; i < nr; i++) {
+      ret = obj->ops->read_folio(obj, batch[i]);
+      if (ret < 0) {
+        /* Keep the successfully read prefix */
+        for (uint32_t j = i; j < nr; j++) {
+          if (obj->rd) resdomain_uncharge_mem(obj->rd, PAGE_SIZE);
+          folio_put(batch[j]);
+        }
+        nr = i;
+        ret = 0;
         break;
       }
-    } else {
-      memset(folio_address(folio), 0, PAGE_SIZE);
     }
+    blk_finish_plug(&plug);
+  } else {
+    for (uint32_t i = 0; i < nr; i++)
+      clear_page(folio_address(batch[i]));
+  }
 
-    down_write(&obj->lock);
-    if (vm_object_find_folio(obj, next_off)) {
-      up_write(&obj->lock);
+  for (uint32_t i = 0; i < nr; i++) {
+    struct folio *folio = batch[i];
+    uint64_t off = folio->index;
+
+    if (ret < 0) {
       if (obj->rd) resdomain_uncharge_mem(obj->rd, PAGE_SIZE);
       folio_put(folio);
       continue;
     }
 
-    if (vm_object_add_folio(obj, next_off, folio) < 0) {
+    down_write(&obj->lock);
+    if (vm_object_find_folio(obj, off) || vm_object_add_folio(obj, off, folio) < 0) {
       up_write(&obj->lock);
       if (obj->rd) resdomain_uncharge_mem(obj->rd, PAGE_SIZE);
       folio_put(folio);
-      break;
+      continue;
     }
     atomic_long_inc(&obj->nr_pages);
     up_write(&obj->lock);
 
-    folio_add_file_rmap(folio, obj, next_off);
+    folio_add_file_rmap(folio, obj, off);
   }
 #else
   (void) obj; (void) pgoff;
@@ -124,7 +164,7 @@ int filemap_fault(struct vm_object *obj, struct vm_area_struct *vma, struct vm_f
     folio_get(folio);
     vmf->folio = folio;
     vmf->prot = vma ? vma->vm_page_prot : vm_get_page_prot(VM_READ);
-    if (!(vma->vm_flags & VM_SHARED)) vmf->prot &= ~PTE_RW;
+    if (vma && !(vma->vm_flags & VM_SHARED)) vmf->prot &= ~PTE_RW;
     up_read(&obj->lock);
     return 0;
   }
@@ -153,7 +193,7 @@ int filemap_fault(struct vm_object *obj, struct vm_area_struct *vma, struct vm_f
       return VM_FAULT_SIGBUS;
     }
   } else {
-    memset(folio_address(folio), 0, PAGE_SIZE);
+    clear_page(folio_address(folio));
   }
 
   down_write(&obj->lock);
@@ -25,6 +25,7 @@
 #include <mm/page.h>
 #include <mm/slub.h>
 #include <mm/mmu_gather.h>
+#include <mm/numa_balancing.h>
 #include <mm/workingset.h>
 #include <mm/swap.h>
 #include <arch/x86_64/mm/pmm.h>
@@ -414,7 +415,7 @@ int try_to_unmap_folio(struct folio *folio, struct mmu_gather *tlb) {
         if (tlb) {
           uint64_t phys = vmm_unmap_page_no_flush(vma->vm_mm, address);
           if (phys) {
-            tlb->mm = vma->vm_mm; // Track last modified mm
+            tlb_gather_set_mm(tlb, vma->vm_mm);
             tlb_remove_folio(tlb, folio, address);
           }
         } else {
@@ -446,7 +447,7 @@ int try_to_unmap_folio(struct folio *folio, struct mmu_gather *tlb) {
       if (tlb) {
         uint64_t phys = vmm_unmap_page_no_flush(vma->vm_mm, address);
         if (phys) {
-          tlb->mm = vma->vm_mm;
+          tlb_gather_set_mm(tlb, vma->vm_mm);
           tlb_remove_folio(tlb, folio, address);
         }
       } else {
@@ -590,43 +591,54 @@ int folio_reclaim(struct folio *folio, struct mmu_gather *tlb) {
     if (swap_is_enabled()) {
       swp_entry_t entry = get_swap_page(folio);
       if (!non_swap_entry(entry)) {
-        /* Write page to swap */
-        int ret = swap_writepage(folio, entry);
-        if (ret == 0) {
-          down_write(&obj->lock);
-
-          /*
-           * Store swap entry in XArray.
-           * We use a special encoding: swap entries have bits [1:0] = 0b10
-           * to distinguish from folios (0b00) and ZMM (0b01).
-           */
-          void *swap_exceptional = (void *) ((entry.val << 2) | 0x2);
-          xa_store(&obj->page_tree, folio->index, swap_exceptional, GFP_ATOMIC);
-
-          /* Track swap usage */
-          atomic_long_inc(&obj->nr_swap);
-          obj->flags |= VM_OBJECT_SWAP_BACKED;
+        /*
+         * The swap cache keeps the folio alive (and findable by refaults)
+         * until the write has completed.
+         */
+        if (add_to_swap_cache(folio, entry) != 0) {
+          swap_free(entry);
+          return -ENOMEM;
+        }
+
+        down_write(&obj->lock);
+
+        /*
+         * Store swap entry in XArray.
+         * We use a special encoding: swap entries have bits [1:0] = 0b10
+         * to distinguish from folios (0b00) and ZMM (0b01).
+         */
+        void *swap_exceptional = (void *) ((entry.val << 2) | 0x2);
+        xa_store(&obj->page_tree, folio->index, swap_exceptional, GFP_ATOMIC);
+
+        /* Track swap usage */
+        atomic_long_inc(&obj->nr_swap);
+        obj->flags |= VM_OBJECT_SWAP_BACKED;
 
 #ifdef CONFIG_MM_WORKINGSET
-          /* Store shadow entry for refault detection */
-          void *shadow = workingset_eviction(folio, obj);
-          /* Shadow is stored implicitly via the swap entry */
-          (void) shadow;
+        /* Store shadow entry for refault detection */
+        void *shadow = workingset_eviction(folio, obj);
+        /* Shadow is stored implicitly via the swap entry */
+        (void) shadow;
 #endif
 
-          /* Unmap from all users */
-          try_to_unmap_folio(folio, tlb);
+        /* Unmap from all users before the device reads the contents */
+        try_to_unmap_folio(folio, tlb);
 
-          up_write(&obj->lock);
+        up_write(&obj->lock);
 
-          if (!tlb) {
-            pmm_free_pages(folio_to_phys(folio), folio_nr_pages(folio));
-          }
-          return 0;
+        if (tlb && tlb->swap_plug) {
+          /* Written after the batched TLB shootdown */
+          if (swap_plug_add(tlb->swap_plug, folio, entry))
+            tlb_flush_mmu(tlb);
         } else {
-          /* Write failed, free the swap slot */
-          swap_free(entry);
+          swap_writepage(folio, entry);
         }
+
+        if (!tlb) {
+          /* Drop the mapping reference; the swap cache still holds one */
+          folio_put(folio);
+        }
+        return 0;
       }
     }
 #endif
@@ -717,7 +729,14 @@ size_t shrink_inactive_list(size_t nr_to_scan) {
    * This prevents "IPI Storms" on SMP.
    */
   struct mmu_gather tlb;
-  tlb_gather_mmu(&tlb, &init_mm, 0, 0); // Dynamic range
+  tlb_gather_mmu(&tlb, &init_mm, 0, 0); // Widened by tlb_remove_folio()
+
+#ifdef CONFIG_MM_SWAP
+  /* Swap-outs of this pass are issued together once unmapped */
+  struct swap_plug swap_plug;
+  swap_start_plug(&swap_plug);
+  tlb.swap_plug = &swap_plug;
+#endif
 
   struct list_head *pos, *q;
   list_for_each_safe(pos, q, &folio_list)
@@ -776,6 +795,12 @@ static size_t scan_gen(struct pglist_data *pgdat, int gen, int type, struct scan
   struct mmu_gather tlb;
   tlb_gather_mmu(&tlb, &init_mm, 0, 0);
 
+#ifdef CONFIG_MM_SWAP
+  struct swap_plug swap_plug;
+  swap_start_plug(&swap_plug);
+  tlb.swap_plug = &swap_plug;
+#endif
+
   /* Get stats tracker */
   struct lru_gen_stats *stats = node_lru_stats[pgdat->node_id];
 
@@ -1231,71 +1256,145 @@ const struct vm_operations_struct shmem_vm_ops = {
   .fault = shmem_fault,
 };
 
+#ifdef CONFIG_MM_NUMA_BALANCING
+#ifdef CONFIG_MM_MGLRU
+/*
+ * Take @folio off its generation list. Fails for folios still sitting in a
+ * per-CPU add batch and for folios reclaim has already isolated.
+ */
+static bool folio_isolate_lru(struct folio *folio) {
+  struct pglist_data *pgdat = node_data[folio->node];
+  bool isolated = false;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&pgdat->lru_lock);
+  if (folio->flags & PG_lru) {
+    list_del(&folio->lru);
+    atomic_long_dec(&pgdat->lrugen.nr_pages[folio_lru_gen(folio)][!folio_is_file(folio)]);
+    __atomic_and_fetch(&folio->flags, ~(unsigned long) PG_lru, __ATOMIC_SEQ_CST);
+    isolated = true;
+  }
+  spinlock_unlock_irqrestore(&pgdat->lru_lock, flags);
+
+  return isolated;
+}
+#else
+/* The classic LRU lists are per-CPU and cannot be isolated from here */
+static bool folio_isolate_lru(struct folio *folio) {
+  (void) folio;
+  return false;
+}
+#endif
+
 /**
- * migrate_folio_to_node - Physically move a folio to a different NUMA node.
+ * migrate_folio_to_node - Move a hinted private anonymous page to @nid
+ *
+ * Only order-0 pages of an anonymous object that has a single mapping and
+ * no shadow children qualify: then the hinted PTE at @address is the only
+ * way to reach the page besides the object itself, whose lock we hold.
+ * The caller holds mmap_lock and one reference.
  */
-static int migrate_folio_to_node(struct folio *folio, int nid) {
-  if (!folio || folio->node == nid) return 0;
+static int migrate_folio_to_node(struct vm_area_struct *vma, uint64_t address,
+                                 struct folio *folio, int nid) {
+  struct vm_object *obj = vma->vm_obj;
+  uint64_t pgoff = ((address - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+  uint64_t old_phys = folio_to_phys(folio);
+
+  if (!obj || obj->type != VM_OBJECT_ANON)
+    return -EINVAL;
+  if (folio_order(folio) != 0 || PageReserved(&folio->page))
+    return -EINVAL;
+
+  /* The charge moves over with the data, so don't charge the copy again */
+  struct folio *new_folio = alloc_pages_node(nid, GFP_HIGHUSER_MOVABLE | __GFP_THISNODE | __GFP_NORETRY |
+                                             __GFP_NOWARN | ___GFP_NO_CHARGE, 0);
+  if (!new_folio)
+    return -ENOMEM;
+  if (new_folio->node != (uint32_t) nid) {
+    folio_put(new_folio);
+    return -ENOMEM;
+  }
 
-  struct folio *new_folio = alloc_pages_node(nid, GFP_KERNEL, folio_order(folio));
-  if (!new_folio) return -ENOMEM;
+  down_write(&obj->lock);
 
-  /* 1. Unmap all users to freeze the page */
-  if (try_to_unmap_folio(folio, nullptr) != 0) {
+  /* References: the object, the hinted PTE and our caller */
+  if (!list_is_singular(&obj->i_mmap) || atomic_read(&obj->shadow_children) ||
+      xa_load(&obj->page_tree, pgoff) != folio || folio_ref_count(folio) != 3 ||
+      !folio_isolate_lru(folio)) {
+    up_write(&obj->lock);
     folio_put(new_folio);
     return -EBUSY;
   }
 
-  /* 2. Copy data */
-  memcpy(folio_address(new_folio), folio_address(folio), folio_size(folio));
-
-  /* 3. Update mapping */
-  void *mapping = folio->mapping;
-  if (mapping) {
-    if (!((uintptr_t) mapping & 0x1)) {
-      struct vm_object *obj = (struct vm_object *) mapping;
-      down_write(&obj->lock);
-      xa_store(&obj->page_tree, folio->index, new_folio, GFP_ATOMIC);
-      up_write(&obj->lock);
-    }
+  /* Park the PTE so nobody can write the page while it is copied */
+  if (!vmm_numa_freeze(vma->vm_mm, address, old_phys)) {
+    up_write(&obj->lock);
+    folio_add_lru(folio);
+    folio_put(new_folio);
+    return -EAGAIN;
   }
 
-  new_folio->mapping = mapping;
+  copy_page(folio_address(new_folio), folio_address(folio));
+
+  new_folio->mapping = folio->mapping;
   new_folio->index = folio->index;
-  new_folio->page.flags = folio->page.flags;
+  new_folio->flags |= folio->flags & (PG_dirty | PG_referenced | PG_active);
+  new_folio->page.rd = folio->page.rd;
+  folio_xchg_last_nid(new_folio, nid);
 
-  /* 4. The old folio will be freed by the caller or by its last put */
+  xa_store(&obj->page_tree, pgoff, new_folio, GFP_ATOMIC);
+  folio_get(new_folio);
+  vmm_numa_unfreeze(vma->vm_mm, address, old_phys, folio_to_phys(new_folio));
+
+  up_write(&obj->lock);
+
+  folio_add_lru(new_folio);
+
+  /* Drop the object's and the PTE's references; our caller drops the last */
+  folio->page.rd = nullptr;
+  folio->mapping = nullptr;
+  folio_put(folio);
+  folio_put(folio);
   return 0;
 }
 
 /**
  * do_numa_page - Handle a NUMA hint fault.
- * Triggers when a page is accessed that belongs to a remote node.
+ *
+ * Decides whether the page should follow the faulting CPU, accounts the
+ * fault to the task and makes the PTE present again, on whichever copy.
  */
-static int do_numa_page(struct vm_area_struct *vma, uint64_t address, struct folio *folio) {
-  int target_node = this_node();
-  int source_node = folio->node;
-
-  /* If already on the right node, just restore the PTE */
-  if (source_node == target_node) {
-    vmm_map_page(vma->vm_mm, address, folio_to_phys(folio), vma->vm_page_prot);
-    return VM_FAULT_COMPLETED;
+static int do_numa_page(struct vm_area_struct *vma, uint64_t address, struct folio *folio,
+                        unsigned int flags) {
+  int this_nid = this_node();
+  int mem_nid = folio->node;
+  uint64_t phys = folio_to_phys(folio);
+  bool migrated = false;
+
+  address &= PAGE_MASK;
+
+  if (mem_nid != this_nid &&
+      numa_migrate_check(folio, this_nid, flags & FAULT_FLAG_SPECULATIVE)) {
+    /* Copying needs the object lock: redo the fault under mmap_lock */
+    if (flags & FAULT_FLAG_SPECULATIVE)
+      return VM_FAULT_RETRY;
+
+    if (migrate_folio_to_node(vma, address, folio, this_nid) == 0) {
+      migrated = true;
+      numa_stat_inc(NUMA_PAGES_MIGRATED);
+    } else {
+      numa_stat_inc(NUMA_MIGRATE_FAILED);
+    }
   }
 
-  /*
-   * NUMA Balancing: Migrate if the remote latency is significantly higher.
-   * In a real kernel, we would track "access density" here.
-   */
-  if (migrate_folio_to_node(folio, target_node) == 0) {
-    /* Migration succeeded, map the new location */
-    vmm_map_page(vma->vm_mm, address, folio_to_phys(folio), vma->vm_page_prot);
-  } else {
-    /* Migration failed, just restore access to the remote page */
-    vmm_map_page(vma->vm_mm, address, folio_to_phys(folio), vma->vm_page_prot);
-  }
+  task_numa_fault(vma->vm_mm, mem_nid, this_nid, migrated);
+
+  /* Fails harmlessly if another thread got here first */
+  if (!migrated)
+    vmm_numa_restore(vma->vm_mm, address, phys, phys);
 
   return VM_FAULT_COMPLETED;
 }
+#endif /* CONFIG_MM_NUMA_BALANCING */
 
 /**
  * handle_mm_fault - Generic fault handler that dispatches to VMA-specific operations.
@@ -1309,15 +1408,17 @@ int handle_mm_fault(struct vm_area_struct *vma, uint64_t address, unsigned int f
   struct mm_struct *mm = vma->vm_mm;
   uint32_t vma_seq = vma->vma_seq;
 
-  /* Check for NUMA hint faults first if the PTE is present but marked for hinting */
+#ifdef CONFIG_MM_NUMA_BALANCING
+  /* Hinting faults: the PTE is not present but still carries the page */
   if (vmm_is_numa_hint(mm, address)) {
     struct folio *folio = vmm_get_folio(mm, address);
     if (folio) {
-      int ret = do_numa_page(vma, address, folio);
+      int ret = do_numa_page(vma, address, folio, flags);
       folio_put(folio);
-      return ret;
+      return ret == VM_FAULT_COMPLETED ? 0 : ret;
     }
   }
+#endif
 
   struct vm_fault vmf;
   vmf.address = address & PAGE_MASK;
@@ -22,6 +22,7 @@
 #include <arch/x86_64/mm/tlb.h>
 #include <arch/x86_64/mm/pmm.h>
 #include <mm/page.h>
+#include <mm/swap.h>
 
 void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm, uint64_t start, uint64_t end) {
     tlb->mm = mm;
@@ -29,29 +30,73 @@ void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm, uint64_t start
     tlb->end = end;
     tlb->nr_folios = 0;
     tlb->full_flush = false;
+#ifdef CONFIG_MM_SWAP
+    tlb->swap_plug = nullptr;
+#endif
+}
+
+static void tlb_release_batch(struct mmu_gather *tlb) {
+#ifdef CONFIG_MM_SWAP
+    // No CPU can write the unmapped folios anymore, start their swap-out
+    if (tlb->swap_plug)
+        swap_flush_plug(tlb->swap_plug);
+#endif
+
+    for (size_t i = 0; i < tlb->nr_folios; i++) {
+        folio_put(tlb->folios[i]);
+    }
+    tlb->nr_folios = 0;
+}
+
+void tlb_flush_mmu(struct mmu_gather *tlb) {
+    vmm_tlb_shootdown(tlb->mm, tlb->start, tlb->end);
+    tlb_release_batch(tlb);
+    tlb->full_flush = true;
+}
+
+void tlb_gather_set_mm(struct mmu_gather *tlb, struct mm_struct *mm) {
+    if (tlb->mm == mm)
+        return;
+
+    // The gathered range belongs to the old mm, shoot it down there
+    if (tlb->end > tlb->start)
+        vmm_tlb_shootdown(tlb->mm, tlb->start, tlb->end);
+
+    tlb->mm = mm;
+    tlb->start = 0;
+    tlb->end = 0;
 }
 
 void tlb_remove_folio(struct mmu_gather *tlb, struct folio *folio, uint64_t virt) {
-    (void)virt;
     if (tlb->nr_folios >= MAX_GATHER_PAGES) {
         // Overflow, flush now
-        vmm_tlb_shootdown(tlb->mm, tlb->start, tlb->end);
-        for (size_t i = 0; i < tlb->nr_folios; i++) {
-            folio_put(tlb->folios[i]);
-        }
-        tlb->nr_folios = 0;
-        tlb->full_flush = true;
+        tlb_flush_mmu(tlb);
     }
     tlb->folios[tlb->nr_folios++] = folio;
+
+    // Widen the flush range to cover the unmapped page
+    if (tlb->end <= tlb->start) {
+        tlb->start = virt;
+        tlb->end = virt + PAGE_SIZE;
+    } else {
+        if (virt < tlb->start)
+            tlb->start = virt;
+        if (virt + PAGE_SIZE > tlb->end)
+            tlb->end = virt + PAGE_SIZE;
+    }
 }
 
 void tlb_finish_mmu(struct mmu_gather *tlb) {
-    if (tlb->nr_folios > 0 || !tlb->full_flush) {
+    bool pending = tlb->nr_folios > 0;
+
+#ifdef CONFIG_MM_SWAP
+    if (tlb->swap_plug && tlb->swap_plug->nr)
+        pending = true;
+#endif
+
+    if ((pending || !tlb->full_flush) && tlb->end > tlb->start) {
         vmm_tlb_shootdown(tlb->mm, tlb->start, tlb->end);
     }
-    
-    for (size_t i = 0; i < tlb->nr_folios; i++) {
-        folio_put(tlb->folios[i]);
-    }
-    tlb->nr_folios = 0;
+
+    tlb_release_batch(tlb);
 }
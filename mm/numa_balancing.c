@@ -0,0 +1,470 @@
+/// SPDX-License-Identifier: GPL-2.0-only
+/**
+ * AeroSync monolithic kernel
+ *
+ * @file mm/numa_balancing.c
+ * @brief Automatic NUMA page and task placement
+ * @copyright (C) 2025-2026 assembler-0
+ *
+ * This file is part of the AeroSync kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Every user address space is on knumad's list from mm_create() until
+ * mm_free(). Once per scan period knumad takes the next slice of the
+ * space's private anonymous memory and turns its PTEs into NUMA hints
+ * (not present, PTE_NUMA_HINT set). The next touch of such a page lands
+ * in do_numa_page(), which may migrate it and reports the fault here.
+ *
+ * Faults are accumulated per task and per node. When a full pass over the
+ * address space completes, each task folds the faults of the pass into a
+ * decaying average and may pick a new preferred node. The scan period
+ * doubles after mostly-local passes and halves after mostly-remote ones.
+ */
+
+#include <aerosync/atomic.h>
+#include <aerosync/classes.h>
+#include <aerosync/export.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sched/process.h>
+#include <aerosync/sched/sched.h>
+#include <aerosync/spinlock.h>
+#include <aerosync/timer.h>
+#include <arch/x86_64/mm/vmm.h>
+#include <fs/procfs.h>
+#include <fs/vfs.h>
+#include <lib/math.h>
+#include <lib/printk.h>
+#include <lib/vsprintf.h>
+#include <linux/list.h>
+#include <mm/mm_types.h>
+#include <mm/numa_balancing.h>
+#include <mm/vm_object.h>
+#include <mm/vma.h>
+
+#ifdef CONFIG_MM_NUMA_BALANCING
+
+#ifndef CONFIG_MM_NUMA_BALANCING_SCAN_PERIOD_MIN_MS
+#define NUMA_SCAN_PERIOD_MIN_MS 1000
+#else
+#define NUMA_SCAN_PERIOD_MIN_MS CONFIG_MM_NUMA_BALANCING_SCAN_PERIOD_MIN_MS
+#endif
+
+#ifndef CONFIG_MM_NUMA_BALANCING_SCAN_PERIOD_MAX_MS
+#define NUMA_SCAN_PERIOD_MAX_MS 60000
+#else
+#define NUMA_SCAN_PERIOD_MAX_MS CONFIG_MM_NUMA_BALANCING_SCAN_PERIOD_MAX_MS
+#endif
+
+#ifndef CONFIG_MM_NUMA_BALANCING_SCAN_SIZE_MB
+#define NUMA_SCAN_SIZE_MB 256
+#else
+#define NUMA_SCAN_SIZE_MB CONFIG_MM_NUMA_BALANCING_SCAN_SIZE_MB
+#endif
+
+#ifndef CONFIG_MM_NUMA_BALANCING_RATE_LIMIT_MB
+#define NUMA_RATE_LIMIT_MB 256
+#else
+#define NUMA_RATE_LIMIT_MB CONFIG_MM_NUMA_BALANCING_RATE_LIMIT_MB
+#endif
+
+#define NUMA_SCAN_PAGES ((unsigned long) NUMA_SCAN_SIZE_MB << (20 - PAGE_SHIFT))
+
+/* knumad wakes up this often and scans at most this many spaces per round */
+#define KNUMAD_INTERVAL_NS (100 * NSEC_PER_MSEC)
+#define KNUMAD_MAX_MMS 16
+
+/* A pass is "local" when at least this share (%) of its faults were local */
+#define NUMA_SCAN_LOCAL_SHARE 80
+
+/*
+ * A node becomes preferred once it holds this share (%) of a task's
+ * faults, and replaces an existing preference only when it has this much
+ * more (%) than the current node, so tasks do not flip between nodes.
+ */
+#define NUMA_PREFERRED_MIN_SHARE 50
+#define NUMA_PREFERRED_HYSTERESIS 125
+
+/* The rate limit is enforced over windows of this length */
+#define NUMA_RATELIMIT_WINDOW_NS (100 * NSEC_PER_MSEC)
+#define NUMA_RATELIMIT_PAGES \
+  (((unsigned long) NUMA_RATE_LIMIT_MB << (20 - PAGE_SHIFT)) * NUMA_RATELIMIT_WINDOW_NS / NSEC_PER_SEC)
+
+extern int numa_enabled;
+extern int nr_node_ids;
+extern const struct cpumask *cpumask_of_node(int node);
+
+atomic_long_t numa_stats[NR_NUMA_STAT_ITEMS];
+
+static bool numa_balancing_active;
+
+static LIST_HEAD(numa_mm_list);
+static DEFINE_SPINLOCK(numa_mm_lock);
+
+struct numa_ratelimit {
+  spinlock_t lock;
+  uint64_t window_start;
+  unsigned long nr_pages;
+};
+
+static struct numa_ratelimit numa_ratelimit[MAX_NUMNODES];
+
+/* ========================================================================
+ * Task placement
+ * ======================================================================== */
+
+static int task_numa_preferred(struct task_struct *p) {
+  if (!numa_balancing_active || (p->flags & PF_KTHREAD) || !p->mm)
+    return NUMA_NO_NODE;
+  return READ_ONCE(p->numa_preferred_nid);
+}
+
+void task_numa_init(struct task_struct *p, struct task_struct *parent, bool share_mm) {
+  for (int nid = 0; nid < MAX_NUMNODES; nid++) {
+    p->numa_faults[nid] = 0;
+    p->numa_faults_buf[nid] = 0;
+  }
+
+  p->numa_preferred_nid = NUMA_NO_NODE;
+  p->numa_scan_seq = 0;
+
+  if (share_mm && parent) {
+    p->numa_preferred_nid = parent->numa_preferred_nid;
+    p->numa_scan_seq = parent->numa_scan_seq;
+  }
+}
+
+/* Fold the faults of the last pass in and reconsider the preferred node */
+static void task_numa_placement(struct task_struct *p) {
+  unsigned long total = 0, best_faults = 0;
+  int best_nid = NUMA_NO_NODE;
+
+  for (int nid = 0; nid < MAX_NUMNODES; nid++) {
+    unsigned long faults = p->numa_faults[nid] / 2 + p->numa_faults_buf[nid];
+
+    p->numa_faults[nid] = faults;
+    p->numa_faults_buf[nid] = 0;
+    total += faults;
+
+    if (faults > best_faults) {
+      best_faults = faults;
+      best_nid = nid;
+    }
+  }
+
+  int cur = p->numa_preferred_nid;
+  if (best_nid == NUMA_NO_NODE || best_nid == cur)
+    return;
+  if (best_faults * 100 < total * NUMA_PREFERRED_MIN_SHARE)
+    return;
+  if (cur != NUMA_NO_NODE && best_faults * 100 < p->numa_faults[cur] * NUMA_PREFERRED_HYSTERESIS)
+    return;
+
+  WRITE_ONCE(p->numa_preferred_nid, best_nid);
+  numa_stat_inc(NUMA_PREFERRED_CHANGES);
+}
+
+void task_numa_fault(struct mm_struct *mm, int mem_nid, int this_nid, bool migrated) {
+  int nid = migrated ? this_nid : mem_nid;
+
+  numa_stat_inc(NUMA_HINT_FAULTS);
+  if (mem_nid == this_nid)
+    numa_stat_inc(NUMA_HINT_FAULTS_LOCAL);
+
+  if (nid == this_nid)
+    atomic_long_inc(&mm->numa_faults_local);
+  else
+    atomic_long_inc(&mm->numa_faults_remote);
+
+  struct task_struct *p = current;
+  if (p->mm != mm || nid < 0 || nid >= MAX_NUMNODES)
+    return;
+
+  int seq = READ_ONCE(mm->numa_scan_seq);
+  if (p->numa_scan_seq != seq) {
+    p->numa_scan_seq = seq;
+    task_numa_placement(p);
+  }
+
+  p->numa_faults_buf[nid]++;
+}
+
+int task_numa_select_cpu(struct task_struct *p, int prev_cpu, int target) {
+  int nid = task_numa_preferred(p);
+  if (nid == NUMA_NO_NODE || cpu_to_node(target) == nid)
+    return -1;
+
+  if (cpu_to_node(prev_cpu) == nid && cpumask_test_cpu(prev_cpu, &p->cpus_allowed) &&
+      per_cpu_ptr(runqueues, prev_cpu)->nr_running == 0)
+    return prev_cpu;
+
+  /* Otherwise only move to a CPU that is less busy than the one picked */
+  unsigned int best_nr = per_cpu_ptr(runqueues, target)->nr_running;
+  int best = -1;
+  int cpu;
+
+  for_each_cpu(cpu, cpumask_of_node(nid)) {
+    if (!cpumask_test_cpu(cpu, &p->cpus_allowed) || !cpumask_test_cpu(cpu, &cpu_online_mask))
+      continue;
+
+    unsigned int nr = per_cpu_ptr(runqueues, cpu)->nr_running;
+    if (nr < best_nr) {
+      best_nr = nr;
+      best = cpu;
+      if (!nr)
+        break;
+    }
+  }
+
+  if (best >= 0 && cpu_to_node(prev_cpu) != nid)
+    numa_stat_inc(NUMA_TASK_MOVES);
+  return best;
+}
+
+bool task_numa_improves_locality(struct task_struct *p, int src_cpu, int dst_cpu) {
+  int nid = task_numa_preferred(p);
+  return nid != NUMA_NO_NODE && cpu_to_node(src_cpu) != nid && cpu_to_node(dst_cpu) == nid;
+}
+
+bool task_numa_degrades_locality(struct task_struct *p, int src_cpu, int dst_cpu) {
+  int nid = task_numa_preferred(p);
+  return nid != NUMA_NO_NODE && cpu_to_node(src_cpu) == nid && cpu_to_node(dst_cpu) != nid;
+}
+
+/* ========================================================================
+ * Page placement
+ * ======================================================================== */
+
+static bool numa_migrate_ratelimit(int nid) {
+  struct numa_ratelimit *rl = &numa_ratelimit[nid];
+  uint64_t now = get_time_ns();
+  bool allowed;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&rl->lock);
+  if (now - rl->window_start >= NUMA_RATELIMIT_WINDOW_NS) {
+    rl->window_start = now;
+    rl->nr_pages = 0;
+  }
+  allowed = rl->nr_pages < NUMA_RATELIMIT_PAGES;
+  if (allowed)
+    rl->nr_pages++;
+  spinlock_unlock_irqrestore(&rl->lock, flags);
+
+  return allowed;
+}
+
+bool numa_migrate_check(struct folio *folio, int this_nid, bool speculative) {
+  /*
+   * Two-stage filter: a single access from a node says little, two
+   * consecutive hinting faults from it say the page is being used there.
+   */
+  if (folio_xchg_last_nid(folio, this_nid) != this_nid)
+    return false;
+
+  int nid = task_numa_preferred(current);
+  if (nid != NUMA_NO_NODE && nid != this_nid)
+    return false;
+
+  if (speculative)
+    return true;
+
+  if (!numa_migrate_ratelimit(this_nid)) {
+    numa_stat_inc(NUMA_MIGRATE_RATELIMITED);
+    return false;
+  }
+  return true;
+}
+
+/* ========================================================================
+ * knumad
+ * ======================================================================== */
+
+void numa_balancing_mm_init(struct mm_struct *mm) {
+  mm->numa_scan_period = NUMA_SCAN_PERIOD_MIN_MS;
+  mm->numa_next_scan = get_time_ns() + NUMA_SCAN_PERIOD_MIN_MS * NSEC_PER_MSEC;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&numa_mm_lock);
+  list_add_tail(&mm->numa_scan_list, &numa_mm_list);
+  spinlock_unlock_irqrestore(&numa_mm_lock, flags);
+}
+
+void numa_balancing_mm_exit(struct mm_struct *mm) {
+  if (list_empty(&mm->numa_scan_list))
+    return;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&numa_mm_lock);
+  list_del_init(&mm->numa_scan_list);
+  spinlock_unlock_irqrestore(&numa_mm_lock, flags);
+}
+
+/*
+ * Claim the next address space that is due. A space whose last reference
+ * is already gone stays on the list until mm_free() takes it off; skip it.
+ */
+static struct mm_struct *knumad_next_mm(uint64_t now) {
+  struct mm_struct *mm, *found = nullptr;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&numa_mm_lock);
+  list_for_each_entry(mm, &numa_mm_list, numa_scan_list) {
+    if (now < mm->numa_next_scan)
+      continue;
+    if (!atomic_inc_not_zero(&mm->mm_count))
+      continue;
+
+    mm->numa_next_scan = now + mm->numa_scan_period * NSEC_PER_MSEC;
+    list_move_tail(&mm->numa_scan_list, &numa_mm_list);
+    found = mm;
+    break;
+  }
+  spinlock_unlock_irqrestore(&numa_mm_lock, flags);
+
+  return found;
+}
+
+/* Only private anonymous memory is migrated by hinting faults */
+static bool vma_numa_eligible(struct vm_area_struct *vma) {
+  if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_HUGETLB | VM_SHARED | VM_VMALLOC))
+    return false;
+  return vma->vm_obj && vma->vm_obj->type == VM_OBJECT_ANON;
+}
+
+static void numa_scan_pass_done(struct mm_struct *mm) {
+  long local = atomic_long_xchg(&mm->numa_faults_local, 0);
+  long remote = atomic_long_xchg(&mm->numa_faults_remote, 0);
+  unsigned int period = mm->numa_scan_period;
+
+  if (local * 100 >= (local + remote) * NUMA_SCAN_LOCAL_SHARE)
+    period = min(period * 2, (unsigned int) NUMA_SCAN_PERIOD_MAX_MS);
+  else
+    period = max(period / 2, (unsigned int) NUMA_SCAN_PERIOD_MIN_MS);
+
+  mm->numa_scan_period = period;
+  WRITE_ONCE(mm->numa_scan_seq, mm->numa_scan_seq + 1);
+}
+
+static void numa_scan_mm(struct mm_struct *mm) {
+  unsigned long budget = NUMA_SCAN_PAGES;
+  uint64_t start = mm->numa_scan_offset;
+  struct vm_area_struct *vma;
+  size_t armed = 0;
+
+  down_read(&mm->mmap_lock);
+
+  for_each_vma_range(mm, vma, start, ULONG_MAX) {
+    if (!vma_numa_eligible(vma))
+      continue;
+
+    uint64_t from = max(start, vma->vm_start);
+    uint64_t to = vma->vm_end;
+    if (((to - from) >> PAGE_SHIFT) > budget)
+      to = from + (budget << PAGE_SHIFT);
+
+    armed += vmm_set_numa_hint_range(mm, from, to);
+    budget -= (to - from) >> PAGE_SHIFT;
+    start = to;
+
+    if (!budget)
+      break;
+  }
+
+  /* Ran off the end of the address space: the pass is complete */
+  if (!vma) {
+    start = 0;
+    numa_scan_pass_done(mm);
+  }
+  mm->numa_scan_offset = start;
+
+  up_read(&mm->mmap_lock);
+
+  numa_stat_add(NUMA_PTE_UPDATES, (long) armed);
+}
+
+static int knumad_thread(void *data) {
+  (void) data;
+
+  while (1) {
+    set_current_state(TASK_INTERRUPTIBLE);
+    schedule_timeout(KNUMAD_INTERVAL_NS);
+
+    uint64_t now = get_time_ns();
+    for (int i = 0; i < KNUMAD_MAX_MMS; i++) {
+      struct mm_struct *mm = knumad_next_mm(now);
+      if (!mm)
+        break;
+
+      numa_scan_mm(mm);
+      mm_put(mm);
+    }
+  }
+  return 0;
+}
+
+/* ========================================================================
+ * /proc/vmstat
+ * ======================================================================== */
+
+#define VMSTAT_BUF_SIZE 1024
+
+static const char *const numa_stat_names[NR_NUMA_STAT_ITEMS] = {
+  [NUMA_PTE_UPDATES] = "numa_pte_updates",
+  [NUMA_HINT_FAULTS] = "numa_hint_faults",
+  [NUMA_HINT_FAULTS_LOCAL] = "numa_hint_faults_local",
+  [NUMA_PAGES_MIGRATED] = "numa_pages_migrated",
+  [NUMA_MIGRATE_FAILED] = "numa_migrate_failed",
+  [NUMA_MIGRATE_RATELIMITED] = "numa_migrate_ratelimited",
+  [NUMA_PREFERRED_CHANGES] = "numa_preferred_changes",
+  [NUMA_TASK_MOVES] = "numa_task_moves",
+};
+
+static ssize_t proc_vmstat_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  char kbuf[VMSTAT_BUF_SIZE];
+  int len = 0;
+
+  for (int i = 0; i < NR_NUMA_STAT_ITEMS && len < VMSTAT_BUF_SIZE; i++)
+    len += snprintf(kbuf + len, VMSTAT_BUF_SIZE - len, "%s %ld\n",
+                    numa_stat_names[i], atomic_long_read(&numa_stats[i]));
+
+  if (len > VMSTAT_BUF_SIZE)
+    len = VMSTAT_BUF_SIZE;
+
+  return simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+}
+
+static const struct file_operations proc_vmstat_fops = {
+  .read = proc_vmstat_read,
+};
+
+void numa_balancing_init(void) {
+  proc_create("vmstat", &proc_vmstat_fops);
+
+  if (!numa_enabled || nr_node_ids < 2) {
+    printk(KERN_INFO NUMA_CLASS "Single node, NUMA balancing disabled\n");
+    return;
+  }
+
+  for (int nid = 0; nid < MAX_NUMNODES; nid++)
+    spinlock_init(&numa_ratelimit[nid].lock);
+
+  struct task_struct *k = kthread_create(knumad_thread, nullptr, "knumad");
+  if (!k) {
+    printk(KERN_ERR NUMA_CLASS "Failed to start knumad\n");
+    return;
+  }
+  set_task_nice(k, MAX_NICE);
+
+  numa_balancing_active = true;
+  kthread_run(k);
+
+  printk(KERN_INFO NUMA_CLASS "NUMA balancing: %d nodes, scan %d-%d ms, %d MB per slice\n",
+         nr_node_ids, NUMA_SCAN_PERIOD_MIN_MS, NUMA_SCAN_PERIOD_MAX_MS, NUMA_SCAN_SIZE_MB);
+}
+
+#endif /* CONFIG_MM_NUMA_BALANCING */
@@ -20,9 +20,12 @@
 
 #include <aerosync/classes.h>
 #include <aerosync/panic.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sched/process.h>
 #include <aerosync/sched/sched.h>
 #include <aerosync/spinlock.h>
 #include <aerosync/timer.h>
+#include <aerosync/wait.h>
 #include <arch/x86_64/cpu.h>
 #include <lib/math.h>
 #include <lib/printk.h>
@@ -112,6 +115,13 @@ static void kernel_poison_pages(struct page *page, int numpages, uint8_t val) {
 #endif
 }
 
+static void clear_pages(struct page *page, int numpages) {
+  char *addr = page_address(page);
+
+  for (int i = 0; i < numpages; i++)
+    clear_page(addr + ((size_t)i << PAGE_SHIFT));
+}
+
 static void check_page_poison(struct page *page, int numpages) {
 #ifdef MM_HARDENING
   uint64_t *p = (uint64_t *)page_address(page);
@@ -719,6 +729,195 @@ static bool zone_watermark_ok(struct zone *z, unsigned int order,
 /*
  * Core Allocator
  */
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+/*
+ * Pre-zeroed page pool
+ *
+ * kzerod pulls order-0 pages off the buddy lists of its node while the node
+ * has memory to spare, clears them with non-temporal stores so the faulting
+ * CPU's cache is left alone, and parks them here. Order-0 movable
+ * __GFP_ZERO allocations take from the pool and skip the clear.
+ */
+
+#ifndef CONFIG_MM_PMM_ZERO_POOL_PAGES
+#define ZERO_POOL_PAGES 1024
+#else
+#define ZERO_POOL_PAGES CONFIG_MM_PMM_ZERO_POOL_PAGES
+#endif
+
+#define ZERO_POOL_BATCH 32
+
+extern const struct cpumask *cpumask_of_node(int node);
+
+/* The zone the pool draws from: the highest populated one up to Normal */
+static struct zone *zero_pool_zone(struct pglist_data *pgdat) {
+  for (int i = ZONE_NORMAL; i >= ZONE_DMA32; i--) {
+    if (pgdat->node_zones[i].present_pages)
+      return &pgdat->node_zones[i];
+  }
+  return nullptr;
+}
+
+/* Only fill while the zone stays well clear of reclaim */
+static bool zero_pool_headroom(struct zone *z, struct zero_pool *zp) {
+  return z->nr_free_pages > z->watermark[WMARK_HIGH] + zp->high;
+}
+
+static bool zero_pool_should_fill(struct pglist_data *pgdat) {
+  struct zero_pool *zp = &pgdat->zero_pool;
+  struct zone *z = zero_pool_zone(pgdat);
+
+  return READ_ONCE(zp->nr_pages) < zp->low && z && zero_pool_headroom(z, zp);
+}
+
+static void zero_pool_fill(struct pglist_data *pgdat) {
+  struct zero_pool *zp = &pgdat->zero_pool;
+  struct zone *z = zero_pool_zone(pgdat);
+  struct page *page;
+
+  while (READ_ONCE(zp->nr_pages) < zp->high && zero_pool_headroom(z, zp)) {
+    LIST_HEAD(batch);
+
+    /* rmqueue_bulk takes zone->lock without disabling interrupts */
+    irq_flags_t irq_flags = local_irq_save();
+    int count = rmqueue_bulk(z, 0, ZERO_POOL_BATCH, &batch, MIGRATE_MOVABLE);
+    local_irq_restore(irq_flags);
+    if (!count)
+      break;
+
+    list_for_each_entry(page, &batch, list) {
+      check_page_poison(page, 1);
+      clear_page_nocache(page_address(page));
+    }
+
+    unsigned long flags = spinlock_lock_irqsave(&zp->lock);
+    list_splice_tail(&batch, &zp->pages);
+    zp->nr_pages += count;
+    spinlock_unlock_irqrestore(&zp->lock, flags);
+
+    atomic_long_add(count, &zp->filled);
+
+    if (this_cpu_read(need_resched))
+      schedule();
+  }
+}
+
+static struct page *zero_pool_take(struct pglist_data *pgdat) {
+  struct zero_pool *zp = &pgdat->zero_pool;
+  struct page *page = nullptr;
+  unsigned long nr = 0;
+
+  if (READ_ONCE(zp->nr_pages)) {
+    unsigned long flags = spinlock_lock_irqsave(&zp->lock);
+    if (!list_empty(&zp->pages)) {
+      page = list_first_entry(&zp->pages, struct page, list);
+      list_del(&page->list);
+      nr = --zp->nr_pages;
+    }
+    spinlock_unlock_irqrestore(&zp->lock, flags);
+  }
+
+  if (page) {
+    atomic_long_inc(&zp->hits);
+    /* Wake kzerod once, when the pool crosses the low mark */
+    if (nr + 1 == zp->low)
+      wake_up(&zp->wait);
+  } else {
+    atomic_long_inc(&zp->misses);
+    wake_up(&zp->wait);
+  }
+  return page;
+}
+
+/* Give the whole pool back to the buddy allocator; returns the page count */
+static unsigned long zero_pool_drain(struct pglist_data *pgdat) {
+  struct zero_pool *zp = &pgdat->zero_pool;
+  struct page *page;
+  LIST_HEAD(list);
+
+  if (!READ_ONCE(zp->nr_pages))
+    return 0;
+
+  unsigned long flags = spinlock_lock_irqsave(&zp->lock);
+  list_splice_init(&zp->pages, &list);
+  unsigned long nr = zp->nr_pages;
+  zp->nr_pages = 0;
+  spinlock_unlock_irqrestore(&zp->lock, flags);
+
+  if (!nr)
+    return 0;
+
+  list_for_each_entry(page, &list, list)
+    kernel_poison_pages(page, 1, PAGE_POISON_FREE);
+
+  free_pcp_pages(zero_pool_zone(pgdat), (int)nr, &list, 0);
+  atomic_long_add(nr, &zp->drained);
+  return nr;
+}
+
+static int kzerod_thread(void *data) {
+  struct pglist_data *pgdat = data;
+
+  while (1) {
+    wait_event(pgdat->zero_pool.wait, zero_pool_should_fill(pgdat));
+    zero_pool_fill(pgdat);
+  }
+  return 0;
+}
+
+void zero_pool_init(void) {
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    struct pglist_data *pgdat = node_data[n];
+    if (!pgdat)
+      continue;
+
+    struct zone *z = zero_pool_zone(pgdat);
+    if (!z)
+      continue;
+
+    struct zero_pool *zp = &pgdat->zero_pool;
+    zp->high = min((unsigned long)ZERO_POOL_PAGES, z->present_pages / 64);
+    zp->low = zp->high / 2;
+    if (!zp->low)
+      continue;
+
+    struct task_struct *k = kthread_create(kzerod_thread, pgdat, "kzerod%d", n);
+    if (!k)
+      continue;
+
+    /* Clear node memory from the node's own CPUs, at the lowest priority */
+    const struct cpumask *mask = cpumask_of_node(n);
+    if (!cpumask_empty(mask)) {
+      cpumask_copy(&k->cpus_allowed, mask);
+      k->nr_cpus_allowed = cpumask_weight(mask);
+      set_task_cpu(k, cpumask_first(mask));
+    }
+    set_task_nice(k, MAX_NICE);
+
+    zp->task = k;
+    kthread_run(k);
+  }
+}
+
+void zero_pool_get_stats(struct zero_pool_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+
+  for (int n = 0; n < MAX_NUMNODES; n++) {
+    struct pglist_data *pgdat = node_data[n];
+    if (!pgdat)
+      continue;
+
+    struct zero_pool *zp = &pgdat->zero_pool;
+    stats->nr_pages += READ_ONCE(zp->nr_pages);
+    stats->hits += atomic_long_read(&zp->hits);
+    stats->misses += atomic_long_read(&zp->misses);
+    stats->filled += atomic_long_read(&zp->filled);
+    stats->drained += atomic_long_read(&zp->drained);
+  }
+}
+EXPORT_SYMBOL(zero_pool_get_stats);
+#endif /* CONFIG_MM_PMM_ZERO_POOL */
+
 struct folio *alloc_pages_node(int nid, gfp_t gfp_mask, unsigned int order) {
   struct page *page = nullptr;
   struct pglist_data *pgdat = nullptr;
@@ -728,6 +927,7 @@ struct folio *alloc_pages_node(int nid, gfp_t gfp_mask, unsigned int order) {
   int reclaim_retries = 3;
   int migratetype = gfp_to_migratetype(gfp_mask);
   struct resdomain *rd = nullptr;
+  bool prezeroed = false;
 
   /*
    * Resource Domain Charge
@@ -771,6 +971,18 @@ retry:
 
   pgdat = node_data[nid];
 
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+  /* The pool is filled from MIGRATE_MOVABLE, so it only serves those */
+  if (order == 0 && (gfp_mask & __GFP_ZERO) && start_zone_idx == ZONE_NORMAL &&
+      migratetype == MIGRATE_MOVABLE && pgdat->zero_pool.task) {
+    page = zero_pool_take(pgdat);
+    if (page) {
+      prezeroed = true;
+      goto found;
+    }
+  }
+#endif
+
   /*
    * PCP Fastpath (Orders 0-3, Local Node)
    */
@@ -833,7 +1045,7 @@ retry:
 
         check_page_poison(page, 1 << order);
         if (gfp_mask & __GFP_ZERO) {
-          memset(page_address(page), 0, (size_t)(1UL << order) << PAGE_SHIFT);
+          clear_pages(page, 1 << order);
         } else {
           kernel_poison_pages(page, 1 << order, PAGE_POISON_ALLOC);
         }
@@ -933,6 +1145,21 @@ retry:
     }
   }
 
+#ifdef CONFIG_MM_PMM_DEFERRED_INIT
+  /*
+   * Deferred init may not have reached the memory we need yet; pull in
+   * the next chunk of the node ourselves before resorting to reclaim.
+   */
+  if (start_zone_idx == ZONE_NORMAL && pmm_deferred_grow(pgdat))
+    goto retry;
+#endif
+
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+  /* Pre-zeroed pages are still free memory; hand them back before reclaim */
+  if (zero_pool_drain(pgdat))
+    goto retry;
+#endif
+
   /*
    * Direct Reclaim
    */
@@ -967,7 +1194,8 @@ found:
   check_page_poison(page, 1 << order);
   
   if (gfp_mask & __GFP_ZERO) {
-    memset(page_address(page), 0, (size_t)(1UL << order) << PAGE_SHIFT);
+    if (!prezeroed)
+      clear_pages(page, 1 << order);
   } else {
     /* Poison as allocated */
     kernel_poison_pages(page, 1 << order, PAGE_POISON_ALLOC);
@@ -1075,7 +1303,7 @@ unsigned long alloc_pages_bulk_array(int nid, gfp_t gfp_mask,
 
         check_page_poison(page, 1 << order);
         if (gfp_mask & __GFP_ZERO) {
-          memset(page_address(page), 0, (size_t)(1UL << order) << PAGE_SHIFT);
+          clear_pages(page, 1 << order);
         } else {
           kernel_poison_pages(page, 1 << order, PAGE_POISON_ALLOC);
         }
@@ -1113,7 +1341,7 @@ unsigned long alloc_pages_bulk_array(int nid, gfp_t gfp_mask,
 
       check_page_poison(page, 1 << order);
       if (gfp_mask & __GFP_ZERO) {
-        memset(page_address(page), 0, (size_t)(1UL << order) << PAGE_SHIFT);
+        clear_pages(page, 1 << order);
       } else {
         kernel_poison_pages(page, 1 << order, PAGE_POISON_ALLOC);
       }
@@ -1239,17 +1467,17 @@ EXPORT_SYMBOL(put_page);
  * @page:  Head page of the block.
  * @order: Buddy order.
  *
- * This is used exclusively during pmm_init() to populate the buddy free
- * lists from bootloader-provided usable memory.  It deliberately skips:
+ * This is used exclusively during pmm_init() and deferred struct page
+ * initialization to populate the buddy free lists from bootloader-provided
+ * usable memory.  It deliberately skips:
  *
  *   - Page poisoning:      Pages haven't been used; nothing to poison.
  *   - PCP / deferred:      Per-CPU structures are not ready at boot.
- *   - Locking:             BSP is single-threaded during pmm_init().
- *   - IRQ save/restore:    Interrupts are disabled at boot.
- *   - Double-free check:   Only called once per page from pmm_init().
+ *   - Double-free check:   Only called once per page.
  *
- * Context: Boot only.  Must NOT be called after pmm_initialized is set.
- * Locking: None.  Single-threaded boot path only.
+ * Context: Boot only.
+ * Locking: None inside pmm_init() (BSP, single-threaded).  Deferred init
+ *          workers and on-demand growth hold zone->lock with IRQs saved.
  */
 void __free_pages_boot_core(struct page *page, unsigned int order) {
   unsigned long pfn = (unsigned long)(page - mem_map);
@@ -1388,6 +1616,20 @@ void free_area_init(void) {
     init_waitqueue_head(&pgdat->kswapd_wait);
     pgdat->kswapd_task = nullptr;
 
+#ifdef CONFIG_MM_PMM_ZERO_POOL
+    spinlock_init(&pgdat->zero_pool.lock);
+    INIT_LIST_HEAD(&pgdat->zero_pool.pages);
+    pgdat->zero_pool.nr_pages = 0;
+    pgdat->zero_pool.low = 0;
+    pgdat->zero_pool.high = 0;
+    init_waitqueue_head(&pgdat->zero_pool.wait);
+    pgdat->zero_pool.task = nullptr;
+    atomic_long_set(&pgdat->zero_pool.hits, 0);
+    atomic_long_set(&pgdat->zero_pool.misses, 0);
+    atomic_long_set(&pgdat->zero_pool.filled, 0);
+    atomic_long_set(&pgdat->zero_pool.drained, 0);
+#endif
+
     spinlock_init(&pgdat->lru_lock);
     for (int gen = 0; gen < MAX_NR_GENS; gen++) {
       for (int type = 0; type < 2; type++) {
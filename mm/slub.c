@@ -28,6 +28,7 @@
 #include <arch/x86_64/smp.h>
 #include <lib/printk.h>
 #include <lib/string.h>
+#include <lib/vsprintf.h>
 #include <linux/container_of.h>
 #include <mm/gfp.h>
 #include <mm/page.h>
@@ -36,6 +37,8 @@
 #include <mm/zone.h>
 #include <aerosync/crypto.h>
 #include <mm/ssp.h>
+#include <fs/vfs.h>
+#include <fs/procfs.h>
 
 static LIST_HEAD(slab_caches);
 static DEFINE_SPINLOCK(slab_lock);
@@ -177,6 +180,75 @@ static inline void set_freelist_next(void *obj, int offset, void *next) {
   *(uint64_t *)((char *)obj + offset) = val;
 }
 
+/*
+ * Statistics are only written by their own CPU. A memory-destination add is
+ * a single instruction, so an allocation from IRQ context on the same CPU
+ * cannot land between the load and the store and be lost. The caller must
+ * keep @c pinned (preemption or IRQs off).
+ */
+static inline void __slub_stat_add(struct kmem_cache_cpu *c,
+                                   enum slub_stat_item si, unsigned long n) {
+  __asm__ volatile("addq %1, %0" : "+m"(c->stat[si]) : "er"(n));
+}
+
+static inline void __slub_stat_inc(struct kmem_cache_cpu *c,
+                                   enum slub_stat_item si) {
+  __slub_stat_add(c, si, 1);
+}
+
+/* For callers that are neither pinned nor holding a kmem_cache_cpu */
+static inline void slub_stat_inc(kmem_cache_t *s, enum slub_stat_item si) {
+  preempt_disable();
+  __slub_stat_inc(&s->cpu_slab[smp_get_id()], si);
+  preempt_enable();
+}
+
+static unsigned long slub_stat_sum(kmem_cache_t *s, enum slub_stat_item si) {
+  unsigned long sum = 0;
+  int cpu;
+
+  for_each_online_cpu(cpu)
+    sum += READ_ONCE(s->cpu_slab[cpu].stat[si]);
+  return sum;
+}
+
+static void __slab_free(kmem_cache_t *s, struct page *page, void *x);
+
+/*
+ * Take back the objects other CPUs freed into slabs frozen to this one, in
+ * one batch. Must be called with IRQs disabled on the owning CPU; the tid
+ * bump makes any fastpath interrupted on this CPU start over.
+ */
+static void drain_remote_free(kmem_cache_t *s, struct kmem_cache_cpu *c) {
+  struct llist_node *head;
+  int node;
+
+  if (llist_empty(&c->remote_free))
+    return;
+
+  head = llist_del_all(&c->remote_free);
+  node = this_node();
+
+  while (head) {
+    struct llist_node *next = head->next;
+    void *x = (char *)head - s->offset;
+    struct page *page = virt_to_head_page(x);
+
+    if (page == c->page) {
+      set_freelist_next(x, s->offset, c->freelist);
+      c->freelist = x;
+    } else if (page->node == (uint32_t)node && c->mag_count < SLAB_MAG_SIZE) {
+      c->mag[c->mag_count++] = x;
+    } else {
+      /* The slab was unfrozen after the object was queued */
+      __slab_free(s, page, x);
+    }
+    head = next;
+  }
+
+  c->tid = next_tid(c->tid);
+}
+
 static struct page *allocate_slab(kmem_cache_t *s, gfp_t flags, int node) {
   struct folio *folio;
   struct page *page;
@@ -236,6 +308,17 @@ static void *__slab_alloc(kmem_cache_t *s, gfp_t gfpflags, int node,
    */
   flags = local_irq_save();
 
+  /* We may have moved since the caller looked the CPU up */
+  c = &s->cpu_slab[smp_get_id()];
+  drain_remote_free(s, c);
+  if (c->freelist && (!c->page || c->page->node == (uint32_t)node)) {
+    freelist = c->freelist;
+    c->freelist = get_freelist_next(freelist, s->offset);
+    c->tid = next_tid(c->tid);
+    local_irq_restore(flags);
+    return freelist;
+  }
+
   /* Check if we have a page but no freelist (slab frozen) */
   page = c->page;
   if (!page)
@@ -243,9 +326,19 @@ static void *__slab_alloc(kmem_cache_t *s, gfp_t gfpflags, int node,
 
   /* If page is from wrong node, unfreeze it and get a new one */
   if (node != -1 && page->node != node) {
+    void *obj = c->freelist;
+
     page->frozen = 0;
     c->page = nullptr;
     c->freelist = nullptr;
+    c->tid = next_tid(c->tid);
+
+    /* Give back what we still held of it, or it stays allocated for good */
+    while (obj) {
+      void *next = get_freelist_next(obj, s->offset);
+      __slab_free(s, page, obj);
+      obj = next;
+    }
     goto find_slab;
   }
 
@@ -288,8 +381,6 @@ find_slab:;
     page = list_first_entry(&target_node->partial, struct page, list);
     list_del(&page->list);
     target_node->nr_partial--;
-    atomic_long_inc(&target_node->alloc_hits);
-    atomic_long_inc(&target_node->alloc_from_partial);
     spinlock_unlock(&target_node->list_lock);
     alloc_node = cpu_node;
     goto freeze;
@@ -308,12 +399,10 @@ find_slab:;
         page = list_first_entry(&target_node->partial, struct page, list);
         list_del(&page->list);
         target_node->nr_partial--;
-        atomic_long_inc(&target_node->alloc_from_partial);
         spinlock_unlock(&target_node->list_lock);
 
         /* Track cross-node allocation */
-        atomic_long_inc(&s->node[cpu_node]->alloc_misses);
-        atomic_long_inc(&target_node->alloc_hits);
+        __slub_stat_inc(c, ALLOC_NODE_MISS);
 
         alloc_node = nid;
         goto freeze;
@@ -328,10 +417,12 @@ find_slab:;
     restore_irq_flags(flags);
     return nullptr;
   }
-  atomic_long_inc(&s->active_slabs);
-  atomic_long_inc(&s->node[alloc_node]->alloc_refills);
+  __slub_stat_inc(c, SLAB_ALLOCATED);
 
 freeze:
+  /* Remote frees read the owner once they see the slab frozen */
+  WRITE_ONCE(page->slab_cpu, smp_get_id());
+  smp_wmb();
   page->frozen = 1;
   c->page = page;
   freelist = page->freelist;
@@ -397,6 +488,7 @@ static void *refill_magazine(kmem_cache_t *s, struct kmem_cache_cpu *c,
     spinlock_unlock(&n->list_lock);
 
     if (c->mag_count > 0) {
+      __slub_stat_inc(c, ALLOC_REFILL);
       return c->mag[--c->mag_count];
     }
   } else {
@@ -405,7 +497,10 @@ static void *refill_magazine(kmem_cache_t *s, struct kmem_cache_cpu *c,
 
   /* Fallback to normal slab allocation if magazine couldn't be refilled from
    * partials */
-  return __slab_alloc(s, GFP_KERNEL, node, c);
+  object = __slab_alloc(s, GFP_KERNEL, node, c);
+  if (object)
+    __slub_stat_inc(c, ALLOC_SLOWPATH);
+  return object;
 }
 
 void *kmem_cache_alloc_node(kmem_cache_t *s, int node) {
@@ -429,10 +524,10 @@ redo:
   if (likely(object && (node == -1 || (c->page && c->page->node == node)))) {
     void *next = get_freelist_next(object, s->offset);
     if (unlikely(!cmpxchg16b_local(c, object, tid, next, next_tid(tid)))) {
-      atomic_long_inc(&s->alloc_fastpath);
       preempt_enable();
       goto redo;
     }
+    __slub_stat_inc(c, ALLOC_FASTPATH);
     preempt_enable();
   } else {
     preempt_enable();
@@ -440,8 +535,10 @@ redo:
     if (node == -1 || node == this_node()) {
       irq_flags_t flags = local_irq_save();
       c = &s->cpu_slab[smp_get_id()];
+      drain_remote_free(s, c);
       if (c->mag_count > 0) {
         object = c->mag[--c->mag_count];
+        __slub_stat_inc(c, ALLOC_MAGAZINE);
         local_irq_restore(flags);
         goto found;
       }
@@ -454,8 +551,9 @@ redo:
     }
 
     /* Slowpath: Either no objects or wrong node */
-    atomic_long_inc(&s->alloc_slowpath);
     object = __slab_alloc(s, GFP_KERNEL, node, c);
+    if (object)
+      slub_stat_inc(s, ALLOC_SLOWPATH);
   }
 
 found:
@@ -463,7 +561,6 @@ found:
     if (s->flags & SLAB_POISON)
       check_poison(s, object);
     check_redzone(s, object);
-    atomic_long_inc(&s->total_objects);
   }
 
   return object;
@@ -471,6 +568,7 @@ found:
 
 void *kmem_cache_alloc(kmem_cache_t *s) { return kmem_cache_alloc_node(s, -1); }
 
+/* Callers account the free; only slab turnover is counted here */
 static void __slab_free(kmem_cache_t *s, struct page *page, void *x) {
   void *prior;
   int was_frozen;
@@ -489,7 +587,6 @@ static void __slab_free(kmem_cache_t *s, struct page *page, void *x) {
     if (__atomic_compare_exchange_n(&page->freelist, &prior, x, false,
                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
       page->inuse--;
-      atomic_long_inc(&s->free_fastpath);
       return; /* Fast path success */
     }
     /* CAS failed, fall through to slowpath */
@@ -499,7 +596,6 @@ static void __slab_free(kmem_cache_t *s, struct page *page, void *x) {
    * Slowpath: Use per-page bit-spinlock for partial/full slabs
    * This is much more fine-grained than the old node-level lock
    */
-  atomic_long_inc(&s->free_slowpath);
   lock_page_slab(page);
 
   prior = page->freelist;
@@ -525,7 +621,7 @@ static void __slab_free(kmem_cache_t *s, struct page *page, void *x) {
       spinlock_unlock_irqrestore(&n->list_lock, flags);
 
       __free_slab(s, page);
-      atomic_long_dec(&s->active_slabs);
+      slub_stat_inc(s, SLAB_FREED);
       return;
     }
   }
@@ -562,7 +658,6 @@ void kmem_cache_free(kmem_cache_t *s, void *x) {
     poison_obj(s, x, POISON_FREE);
 
   page = virt_to_head_page(x);
-  atomic_long_dec(&s->total_objects);
 
 redo:
   preempt_disable();
@@ -578,6 +673,7 @@ redo:
       preempt_enable();
       goto redo;
     }
+    __slub_stat_inc(c, FREE_FASTPATH);
     preempt_enable();
   } else {
     preempt_enable();
@@ -587,13 +683,26 @@ redo:
       c = &s->cpu_slab[smp_get_id()];
       if (c->mag_count < SLAB_MAG_SIZE) {
         c->mag[c->mag_count++] = x;
+        __slub_stat_inc(c, FREE_MAGAZINE);
         local_irq_restore(flags);
         return;
       }
       local_irq_restore(flags);
     }
 
+    /*
+     * Slab frozen to some CPU: hand the object to that CPU's queue instead
+     * of racing it for the slab. The free pointer slot doubles as the node.
+     */
+    if (page->frozen) {
+      struct kmem_cache_cpu *owner = &s->cpu_slab[READ_ONCE(page->slab_cpu)];
+      llist_add((struct llist_node *)((char *)x + s->offset), &owner->remote_free);
+      slub_stat_inc(s, FREE_REMOTE);
+      return;
+    }
+
     /* Slowpath: Different slab or magazine full */
+    slub_stat_inc(s, FREE_SLOWPATH);
     __slab_free(s, page, x);
   }
 }
@@ -649,8 +758,7 @@ int kmem_cache_alloc_bulk(kmem_cache_t *s, gfp_t flags, size_t size, void **p) {
 
         curr = get_freelist_next(curr, s->offset);
       }
-      atomic_long_add(size, &s->total_objects);
-      atomic_long_add(size, &s->alloc_fastpath);
+      __slub_stat_add(c, ALLOC_FASTPATH, size);
       preempt_enable();
       return (int)size;
     }
@@ -678,8 +786,14 @@ slowpath:;
 
 void kmem_cache_free_bulk(kmem_cache_t *s, size_t size, void **p) {
   for (size_t i = 0; i < size; i++) {
-    if (p[i])
+    if (!p[i])
+      continue;
+
+    /* No cache given: the objects came from kmalloc() (see kfree_bulk()) */
+    if (s)
       kmem_cache_free(s, p[i]);
+    else
+      kfree(p[i]);
   }
 }
 
@@ -688,12 +802,6 @@ static void init_kmem_cache_node(struct kmem_cache_node *n) {
   n->nr_partial = 0;
   INIT_LIST_HEAD(&n->partial);
 
-  /* Initialize NUMA statistics */
-  atomic_long_set(&n->alloc_hits, 0);
-  atomic_long_set(&n->alloc_misses, 0);
-  atomic_long_set(&n->alloc_from_partial, 0);
-  atomic_long_set(&n->alloc_refills, 0);
-
   /* Per-node tuning - can be adjusted based on node memory */
   n->min_partial = 5;
   n->max_partial = 30;
@@ -703,6 +811,8 @@ static void init_kmem_cache_cpu(struct kmem_cache_cpu *c) {
   c->freelist = nullptr;
   c->page = nullptr;
   c->tid = 0;
+  init_llist_head(&c->remote_free);
+  memset(c->stat, 0, sizeof(c->stat));
 }
 
 #define ALIGNED_MAGIC 0xDEADBEEFCAFEBABE
@@ -1292,33 +1402,41 @@ EXPORT_SYMBOL(kmem_cache_free_bulk);
  * slab_numa_stats - Print NUMA statistics for all caches
  *
  * Displays per-node allocation statistics for debugging and profiling.
+ * Slowpath allocations are attributed to the node of the allocating CPU.
  */
 void slab_numa_stats(void) {
   kmem_cache_t *s;
+  int cpu;
 
   printk(KERN_INFO SLAB_CLASS "SLUB NUMA Statistics\n");
 
   list_for_each_entry(s, &slab_caches, list) {
+    unsigned long slow[MAX_NUMNODES] = {0};
+    unsigned long misses[MAX_NUMNODES] = {0};
+
+    for_each_online_cpu(cpu) {
+      int nid = cpu_to_node(cpu);
+      if (nid < 0 || nid >= MAX_NUMNODES)
+        continue;
+      slow[nid] += READ_ONCE(s->cpu_slab[cpu].stat[ALLOC_SLOWPATH]);
+      misses[nid] += READ_ONCE(s->cpu_slab[cpu].stat[ALLOC_NODE_MISS]);
+    }
+
     printk(KERN_INFO SLAB_CLASS "Cache: %s (object_size=%d)\n", s->name,
            s->object_size);
 
     for (int nid = 0; nid < MAX_NUMNODES; nid++) {
       struct kmem_cache_node *n = s->node[nid];
-      long hits = atomic_long_read(&n->alloc_hits);
-      long misses = atomic_long_read(&n->alloc_misses);
-      long from_partial = atomic_long_read(&n->alloc_from_partial);
-      long refills = atomic_long_read(&n->alloc_refills);
 
-      if (hits + misses == 0)
+      if (!n || !slow[nid])
         continue; /* Skip nodes with no activity */
 
-      long total = hits + misses;
-      int hit_rate = total > 0 ? (int)((hits * 100) / total) : 0;
+      unsigned long hits = slow[nid] > misses[nid] ? slow[nid] - misses[nid] : 0;
+      int hit_rate = (int)((hits * 100) / slow[nid]);
 
       printk(KERN_INFO SLAB_CLASS
-             "  Node %d: hits=%ld misses=%ld (hit_rate=%d%%) partial=%ld "
-             "refills=%ld nr_partial=%lu\n",
-             nid, hits, misses, hit_rate, from_partial, refills, n->nr_partial);
+             "  Node %d: hits=%lu misses=%lu (hit_rate=%d%%) nr_partial=%lu\n",
+             nid, hits, misses[nid], hit_rate, n->nr_partial);
     }
   }
 
@@ -1326,3 +1444,88 @@ void slab_numa_stats(void) {
 }
 
 EXPORT_SYMBOL(slab_numa_stats);
+
+/* --- /proc/slabinfo --- */
+
+#define SLABINFO_BUF_SIZE (16 * PAGE_SIZE)
+
+/* Share of @part in @total, in tenths of a percent */
+static unsigned long slabinfo_permille(unsigned long part, unsigned long total) {
+  return total ? part * 1000 / total : 0;
+}
+
+static int slabinfo_show_cache(char *kbuf, int len, kmem_cache_t *s) {
+  unsigned long st[NR_SLUB_STAT_ITEMS];
+
+  for (int i = 0; i < NR_SLUB_STAT_ITEMS; i++)
+    st[i] = slub_stat_sum(s, (enum slub_stat_item)i);
+
+  unsigned long allocs = st[ALLOC_FASTPATH] + st[ALLOC_MAGAZINE] +
+                         st[ALLOC_REFILL] + st[ALLOC_SLOWPATH];
+  unsigned long frees = st[FREE_FASTPATH] + st[FREE_MAGAZINE] +
+                        st[FREE_REMOTE] + st[FREE_SLOWPATH];
+  unsigned long slabs = st[SLAB_ALLOCATED] > st[SLAB_FREED]
+                            ? st[SLAB_ALLOCATED] - st[SLAB_FREED] : 0;
+  unsigned long active = allocs > frees ? allocs - frees : 0;
+  unsigned long per_slab = (PAGE_SIZE << s->order) / s->size;
+
+  unsigned long af = slabinfo_permille(st[ALLOC_FASTPATH] + st[ALLOC_MAGAZINE], allocs);
+  unsigned long as = slabinfo_permille(st[ALLOC_SLOWPATH], allocs);
+  unsigned long ff = slabinfo_permille(st[FREE_FASTPATH] + st[FREE_MAGAZINE], frees);
+  unsigned long fr = slabinfo_permille(st[FREE_REMOTE], frees);
+  unsigned long fs = slabinfo_permille(st[FREE_SLOWPATH], frees);
+
+  return snprintf(kbuf + len, SLABINFO_BUF_SIZE - len,
+                  "%-18s %10lu %10lu %7d %6lu %5lu %7lu %12lu %12lu"
+                  " %3lu.%lu%% %3lu.%lu%% %3lu.%lu%% %3lu.%lu%% %3lu.%lu%%\n",
+                  s->name, active, slabs * per_slab, s->size, per_slab,
+                  1UL << s->order, slabs, allocs, frees,
+                  af / 10, af % 10, as / 10, as % 10,
+                  ff / 10, ff % 10, fr / 10, fr % 10, fs / 10, fs % 10);
+}
+
+static ssize_t proc_slabinfo_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  kmem_cache_t *s;
+
+  char *kbuf = kmalloc(SLABINFO_BUF_SIZE);
+  if (!kbuf)
+    return -ENOMEM;
+
+  /*
+   * fast = CPU freelist or magazine, slow = through the slab/node lists,
+   * remote = queued to the CPU owning the slab. Percentages of all
+   * allocations or frees since boot.
+   */
+  int len = snprintf(kbuf, SLABINFO_BUF_SIZE,
+                     "%-18s %10s %10s %7s %6s %5s %7s %12s %12s %7s %7s %7s %7s %7s\n",
+                     "name", "active_obj", "num_objs", "objsize", "objper",
+                     "pages", "slabs", "allocs", "frees", "a_fast", "a_slow",
+                     "f_fast", "f_remot", "f_slow");
+
+  irq_flags_t flags = spinlock_lock_irqsave(&slab_lock);
+  list_for_each_entry(s, &slab_caches, list) {
+    if (len >= SLABINFO_BUF_SIZE)
+      break;
+    len += slabinfo_show_cache(kbuf, len, s);
+  }
+  spinlock_unlock_irqrestore(&slab_lock, flags);
+
+  if (len > SLABINFO_BUF_SIZE)
+    len = SLABINFO_BUF_SIZE;
+
+  ssize_t ret = simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+  kfree(kbuf);
+  return ret;
+}
+
+static const struct file_operations proc_slabinfo_fops = {
+  .read = proc_slabinfo_read,
+};
+
+/**
+ * slabinfo_init - Publish /proc/slabinfo once the VFS is up
+ */
+void slabinfo_init(void) {
+  proc_create("slabinfo", &proc_slabinfo_fops);
+}
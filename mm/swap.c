@@ -20,6 +20,11 @@
  *   1. ZMM compression (fast, in-memory)
  *   2. Swap to SSD (slower, but unlimited capacity)
  *   3. OOM kill (last resort)
+ *
+ * Swap devices are partitions/disks (I/O through the bio layer) or regular
+ * files (synchronous VFS I/O). Slot N of a block device lives at sector
+ * N * (PAGE_SIZE / block_size); reclaim batches swap-outs per pass and
+ * writes runs of consecutive slots with one multi-page bio.
  */
 
 #include <mm/swap.h>
@@ -32,8 +37,38 @@
 #include <aerosync/errno.h>
 #include <aerosync/classes.h>
 
+#include <aerosync/sched/sched.h>
+#include <aerosync/sched/cpumask.h>
+#include <aerosync/sysintf/bio.h>
+#include <aerosync/sysintf/block.h>
+#include <aerosync/percpu.h>
+#include <fs/vfs.h>
+#include <fs/file.h>
+
 #ifdef CONFIG_MM_SWAP
 
+#ifndef SWAP_MAX_INFLIGHT
+#ifndef CONFIG_MM_SWAP_MAX_INFLIGHT
+#define SWAP_MAX_INFLIGHT 1024
+#else
+#define SWAP_MAX_INFLIGHT CONFIG_MM_SWAP_MAX_INFLIGHT
+#endif
+#endif
+
+#ifndef SWAP_RA_PAGES
+#ifndef CONFIG_MM_SWAP_READAHEAD
+#define SWAP_RA_PAGES 1
+#else
+#define SWAP_RA_PAGES CONFIG_MM_SWAP_READAHEAD
+#endif
+#endif
+
+/* Slots reserved per CPU at a time */
+#define SWAP_SLOTS_CACHE_SIZE 64
+
+/* Readahead stops populating the swap cache beyond this many pages */
+#define SWAP_RA_CACHE_LIMIT 4096
+
 /* Global swap state */
 struct swap_info_struct *swap_info[MAX_SWAPFILES];
 int nr_swapfiles = 0;
@@ -46,15 +81,55 @@ static DEFINE_SPINLOCK(swap_lock);
 #define SWAP_CACHE_SIZE     1024
 #define SWAP_CACHE_MASK     (SWAP_CACHE_SIZE - 1)
 
+/*
+ * Bucket locks are taken with interrupts disabled: write completions drop
+ * their folios from the cache in BLOCK_SOFTIRQ.
+ */
 static struct {
   spinlock_t lock;
   struct list_head entries;
 } swap_cache[SWAP_CACHE_SIZE];
 
+static kmem_cache_t *swap_cache_entry_cache;
+static atomic_long_t swap_cache_pages = {0};
+
+/* On-disk header written by mkswap(8) into slot 0 */
+struct swap_header_info {
+  char bootbits[1024];
+  uint32_t version;
+  uint32_t last_page;
+  uint32_t nr_badpages;
+  uint8_t uuid[16];
+  char volume_name[16];
+  uint32_t padding[117];
+  uint32_t badpages[];
+};
+
+#define SWAP_HEADER_MAGIC     "SWAPSPACE2"
+#define SWAP_HEADER_MAGIC_LEN 10
+#define SWAP_HEADER_MAX_BAD \
+  ((PAGE_SIZE - SWAP_HEADER_MAGIC_LEN - sizeof(struct swap_header_info)) / sizeof(uint32_t))
+
 static inline unsigned int swap_cache_hash(swp_entry_t entry) {
   return (swp_type(entry) ^ swp_offset(entry)) & SWAP_CACHE_MASK;
 }
 
+static inline struct swap_info_struct *swap_entry_info(swp_entry_t entry) {
+  unsigned int type = swp_type(entry);
+
+  if (type >= MAX_SWAPFILES)
+    return nullptr;
+  return swap_info[type];
+}
+
+static inline uint64_t swap_offset_to_sector(struct swap_info_struct *si, unsigned long offset) {
+  return si->start_sector + (uint64_t) offset * si->sectors_per_page;
+}
+
+static inline bool swap_device_congested(struct swap_info_struct *si) {
+  return (unsigned int) atomic_read(&si->nr_inflight) >= si->max_inflight;
+}
+
 /**
  * swap_init - Initialize the swap subsystem
  */
@@ -68,17 +143,24 @@ int swap_init(void) {
     swap_info[i] = nullptr;
   }
 
-  printk(KERN_INFO "swap: " "Swap subsystem initialized (max %d devices)\n",
+  swap_cache_entry_cache = kmem_cache_create("swap_cache_entry",
+                                             sizeof(struct swap_cache_entry), 0, 0);
+  if (!swap_cache_entry_cache)
+    return -ENOMEM;
+
+  printk(KERN_INFO SWAP_CLASS "Swap subsystem initialized (max %d devices)\n",
          MAX_SWAPFILES);
   return 0;
 }
 
 /**
- * find_free_swap_slot - Find a swap device with free capacity
+ * find_swap_device - Find a swap device with free capacity
+ *
+ * Devices with too much I/O in flight are skipped so that reclaim moves on
+ * to another device (or another page) instead of queueing behind them.
  */
 static struct swap_info_struct *find_swap_device(void) {
   struct swap_info_struct *best = nullptr;
-  int best_prio = -1;
 
   for (int i = 0; i < nr_swapfiles; i++) {
     struct swap_info_struct *si = swap_info[i];
@@ -90,15 +172,58 @@ static struct swap_info_struct *find_swap_device(void) {
     if (free <= 0)
       continue;
 
-    if (si->prio > best_prio) {
+    if (swap_device_congested(si))
+      continue;
+
+    /* Default-priority devices are -1, so the first candidate always wins */
+    if (!best || si->prio > best->prio)
       best = si;
-      best_prio = si->prio;
-    }
   }
 
   return best;
 }
 
+/**
+ * swap_claim_run - Claim a run of contiguous free slots
+ * @si: Swap device, si->lock held
+ * @first: Returns the first claimed slot
+ * @max: Maximum run length
+ *
+ * Returns the number of slots claimed (0 if the device is full).
+ */
+static unsigned int swap_claim_run(struct swap_info_struct *si, unsigned long *first,
+                                   unsigned int max) {
+  unsigned long scan_limit = si->highest_bit - si->lowest_bit + 1;
+  unsigned long offset = si->cluster_next;
+  unsigned int n = 0;
+  bool found = false;
+
+  /* offset is only dereferenced once wrapped into [lowest_bit, highest_bit] */
+  for (unsigned long i = 0; i < scan_limit; i++, offset++) {
+    if (offset > si->highest_bit || offset < si->lowest_bit)
+      offset = si->lowest_bit;
+    if (si->swap_map[offset] == SWAP_MAP_FREE) {
+      found = true;
+      break;
+    }
+  }
+
+  if (!found)
+    return 0;
+
+  *first = offset;
+  while (n < max && offset <= si->highest_bit &&
+         si->swap_map[offset] == SWAP_MAP_FREE) {
+    si->swap_map[offset++] = 1;
+    n++;
+  }
+
+  si->cluster_next = offset;
+  atomic_long_add(n, &si->inuse_pages);
+  atomic_long_sub(n, &nr_swap_pages);
+  return n;
+}
+
 /**
  * scan_swap_map - Find a free slot in a swap device
  * @si: Swap device to search
@@ -106,54 +231,95 @@ static struct swap_info_struct *find_swap_device(void) {
  * Returns the slot offset, or 0 on failure.
  */
 static unsigned long scan_swap_map(struct swap_info_struct *si) {
-  unsigned long offset;
-  unsigned long scan_limit;
+  unsigned long offset = 0;
 
   if (!si || !si->swap_map)
     return 0;
 
   spin_lock(&si->lock);
+  if (!swap_claim_run(si, &offset, 1))
+    offset = 0;
+  spin_unlock(&si->lock);
 
-  scan_limit = si->highest_bit - si->lowest_bit + 1;
-  offset = si->cluster_next;
+  return offset;
+}
 
-  /* Scan for a free slot */
-  for (unsigned long i = 0; i < scan_limit; i++) {
-    if (offset > si->highest_bit)
-      offset = si->lowest_bit;
+#ifdef CONFIG_MM_SWAP_SLOTS_CACHE
+/**
+ * swap_slots_alloc - Allocate a slot from this CPU's reserved run
+ */
+static unsigned long swap_slots_alloc(struct swap_info_struct *si) {
+  unsigned long offset = 0;
 
-    if (si->swap_map[offset] == SWAP_MAP_FREE) {
-      si->swap_map[offset] = 1;
-      si->cluster_next = offset + 1;
-      atomic_long_inc(&si->inuse_pages);
-      atomic_long_dec(&nr_swap_pages);
-      spin_unlock(&si->lock);
-      return offset;
-    }
-    offset++;
+  if (!si->slots_cache)
+    return scan_swap_map(si);
+
+  struct swap_slots_cache *cache = this_cpu_ptr(*si->slots_cache);
+
+  spin_lock(&cache->lock);
+  if (cache->nr == 0) {
+    spin_lock(&si->lock);
+    cache->nr = swap_claim_run(si, &cache->next, SWAP_SLOTS_CACHE_SIZE);
+    spin_unlock(&si->lock);
   }
+  if (cache->nr) {
+    offset = cache->next++;
+    cache->nr--;
+  }
+  spin_unlock(&cache->lock);
 
-  spin_unlock(&si->lock);
-  return 0; /* No free slots */
+  return offset;
+}
+
+/**
+ * swap_slots_drain - Return all per-CPU reserved slots to the device
+ */
+static void swap_slots_drain(struct swap_info_struct *si) {
+  int cpu;
+
+  if (!si->slots_cache)
+    return;
+
+  for_each_possible_cpu(cpu) {
+    struct swap_slots_cache *cache = per_cpu_ptr(*si->slots_cache, cpu);
+
+    spin_lock(&cache->lock);
+    spin_lock(&si->lock);
+    for (unsigned int i = 0; i < cache->nr; i++)
+      si->swap_map[cache->next + i] = SWAP_MAP_FREE;
+    atomic_long_sub(cache->nr, &si->inuse_pages);
+    atomic_long_add(cache->nr, &nr_swap_pages);
+    spin_unlock(&si->lock);
+    cache->nr = 0;
+    spin_unlock(&cache->lock);
+  }
+}
+#else
+static inline unsigned long swap_slots_alloc(struct swap_info_struct *si) {
+  return scan_swap_map(si);
 }
 
+static inline void swap_slots_drain(struct swap_info_struct *si) { (void) si; }
+#endif
+
 /**
  * get_swap_page - Allocate a swap slot for a folio
  * @folio: The folio to be swapped out
  *
- * Returns a swap entry, or a zero entry on failure.
+ * Returns a swap entry, or a zero entry on failure (including when every
+ * device with free space is congested).
  */
 swp_entry_t get_swap_page(struct folio *folio) {
   swp_entry_t entry = {.val = 0};
 
-  if (!swap_is_enabled())
+  if (!swap_is_enabled() || folio_nr_pages(folio) != 1)
     return entry;
 
   struct swap_info_struct *si = find_swap_device();
   if (!si)
     return entry;
 
-  unsigned long offset = scan_swap_map(si);
+  unsigned long offset = swap_slots_alloc(si);
   if (offset == 0)
     return entry;
 
@@ -161,35 +327,42 @@ swp_entry_t get_swap_page(struct folio *folio) {
   return entry;
 }
 
+static void swap_cache_drop(swp_entry_t entry);
+
 /**
  * swap_free - Release a swap slot
  * @entry: The swap entry to free
+ *
+ * When the last reference goes away, a folio still cached for the slot
+ * (readahead or a failed write) is released as well.
  */
 void swap_free(swp_entry_t entry) {
   if (non_swap_entry(entry))
     return;
 
-  unsigned int type = swp_type(entry);
   unsigned long offset = swp_offset(entry);
-
-  if (type >= MAX_SWAPFILES)
-    return;
-
-  struct swap_info_struct *si = swap_info[type];
+  struct swap_info_struct *si = swap_entry_info(entry);
   if (!si || !si->swap_map)
     return;
 
+  bool freed = false;
+
   spin_lock(&si->lock);
 
-  if (offset <= si->highest_bit && si->swap_map[offset] > 0) {
+  if (offset <= si->highest_bit && si->swap_map[offset] > 0 &&
+      si->swap_map[offset] != SWAP_MAP_BAD) {
     si->swap_map[offset]--;
     if (si->swap_map[offset] == SWAP_MAP_FREE) {
       atomic_long_dec(&si->inuse_pages);
       atomic_long_inc(&nr_swap_pages);
+      freed = true;
     }
   }
 
   spin_unlock(&si->lock);
+
+  if (freed)
+    swap_cache_drop(entry);
 }
 
 /**
@@ -202,13 +375,8 @@ int swap_duplicate(swp_entry_t entry) {
   if (non_swap_entry(entry))
     return -EINVAL;
 
-  unsigned int type = swp_type(entry);
   unsigned long offset = swp_offset(entry);
-
-  if (type >= MAX_SWAPFILES)
-    return -EINVAL;
-
-  struct swap_info_struct *si = swap_info[type];
+  struct swap_info_struct *si = swap_entry_info(entry);
   if (!si || !si->swap_map)
     return -EINVAL;
 
@@ -226,49 +394,231 @@ int swap_duplicate(swp_entry_t entry) {
   return -ENOENT;
 }
 
+/* --- Swap I/O --- */
+
+/**
+ * swap_rw_file - Synchronous page I/O on a swap file
+ */
+static int swap_rw_file(struct swap_info_struct *si, struct folio *folio,
+                        unsigned long offset, bool write) {
+  vfs_loff_t pos = (vfs_loff_t) offset << PAGE_SHIFT;
+  ssize_t ret;
+
+  if (write)
+    ret = kernel_write(si->swap_file, folio_address(folio), PAGE_SIZE, &pos);
+  else
+    ret = kernel_read(si->swap_file, folio_address(folio), PAGE_SIZE, &pos);
+
+  return ret == (ssize_t) PAGE_SIZE ? 0 : -EIO;
+}
+
+static void __delete_from_swap_cache(struct folio *folio, atomic_long_t *seq);
+
+/**
+ * swap_end_write - Finish the swap-out of one folio
+ *
+ * On success the swap cache reference is dropped, which frees the folio
+ * once reclaim has released the mapping reference. On failure the folio
+ * stays in the swap cache, so a refault still finds the only good copy.
+ */
+static void swap_end_write(struct swap_info_struct *si, struct folio *folio, int status) {
+  if (status) {
+    atomic_long_inc(&si->nr_io_errors);
+    return;
+  }
+
+  __delete_from_swap_cache(folio, &si->write_seq);
+}
+
+static void swap_write_endio(struct bio *bio) {
+  struct swap_info_struct *si = bio->bi_private;
+  struct bio_vec *bv;
+  unsigned int nr_pages = 0;
+  int i;
+
+  if (bio->bi_status)
+    printk(KERN_ERR SWAP_CLASS "write error %d on %s (%u pages)\n",
+           bio->bi_status, si->name, bio->bi_size >> PAGE_SHIFT);
+
+  /* bio_add_page() merges physically contiguous folios into one bvec */
+  bio_for_each_bvec(bv, bio, i) {
+    uint64_t phys = page_to_phys(bv->bv_page) + bv->bv_offset;
+    uint64_t end = phys + bv->bv_len;
+
+    while (phys < end) {
+      struct folio *folio = page_folio(phys_to_page(phys));
+      size_t nr = folio_nr_pages(folio);
+
+      swap_end_write(si, folio, bio->bi_status);
+      folio_put(folio); /* I/O reference */
+      phys += nr << PAGE_SHIFT;
+      nr_pages += nr;
+    }
+  }
+
+  atomic_sub(nr_pages, &si->nr_inflight);
+  wake_up(&si->inflight_wait);
+  bio_put(bio);
+}
+
+/**
+ * swap_submit_write - Write @nr folios to consecutive slots with one bio
+ */
+static void swap_submit_write(struct swap_info_struct *si, struct folio **folios,
+                              unsigned long offset, unsigned int nr) {
+  struct bio *bio = bio_alloc(si->bdev, nr, REQ_OP_WRITE);
+
+  if (!bio) {
+    for (unsigned int i = 0; i < nr; i++)
+      swap_end_write(si, folios[i], -ENOMEM);
+    return;
+  }
+
+  bio->bi_sector = swap_offset_to_sector(si, offset);
+  bio->bi_end_io = swap_write_endio;
+  bio->bi_private = si;
+
+  for (unsigned int i = 0; i < nr; i++) {
+    folio_get(folios[i]);
+    bio_add_folio(bio, folios[i]);
+  }
+
+  atomic_add(nr, &si->nr_inflight);
+  atomic_long_add(nr, &si->nr_pageouts);
+  atomic_long_inc(&si->nr_write_bios);
+
+  submit_bio(bio);
+}
+
 /**
  * swap_writepage - Write a folio to swap
- * @folio: The folio to write
+ * @folio: The folio to write (already in the swap cache)
  * @entry: The swap entry (slot) to write to
  *
- * Returns 0 on success, negative on failure.
+ * Returns 0 if the write was issued, negative on failure.
  */
 int swap_writepage(struct folio *folio, swp_entry_t entry) {
   if (non_swap_entry(entry))
     return -EINVAL;
 
-  unsigned int type = swp_type(entry);
   unsigned long offset = swp_offset(entry);
-
-  if (type >= MAX_SWAPFILES)
-    return -EINVAL;
-
-  struct swap_info_struct *si = swap_info[type];
+  struct swap_info_struct *si = swap_entry_info(entry);
   if (!si)
     return -EINVAL;
 
-  /*
-   * NOTE: Actual I/O to block device requires integration with
-   * the block layer (submit_bio).
-   *
-   * In a production implementation:
-   *   1. Build a bio for the swap page
-   *   2. Calculate the sector from offset
-   *   3. Submit async I/O
-   *   4. Handle completion callback
-   */
   if (si->flags & SWP_SYNTHETIC) {
-      /* Synthetic swap for testing: just mark as in cache */
-      folio->flags |= (1UL << 20); /* PG_swapcache */
-      return 0;
+    /* Synthetic swap for testing: the data is discarded */
+    swap_end_write(si, folio, 0);
+    return 0;
   }
 
-  /* Real I/O would go here */
-  return -EIO;
+  if (si->swap_file) {
+    int ret = swap_rw_file(si, folio, offset, true);
+    if (ret == 0)
+      atomic_long_inc(&si->nr_pageouts);
+    swap_end_write(si, folio, ret);
+    return ret;
+  }
 
+  swap_submit_write(si, &folio, offset, 1);
   return 0;
 }
 
+bool swap_plug_add(struct swap_plug *plug, struct folio *folio, swp_entry_t entry) {
+  plug->entries[plug->nr] = entry;
+  plug->folios[plug->nr] = folio;
+  plug->nr++;
+  return plug->nr >= SWAP_PLUG_MAX;
+}
+
+/**
+ * swap_flush_plug - Issue the queued swap-outs
+ *
+ * Entries are sorted by (device, slot); every run of consecutive slots on a
+ * block device becomes one multi-page write bio.
+ */
+void swap_flush_plug(struct swap_plug *plug) {
+  struct blk_plug bplug;
+  unsigned int i = 0;
+
+  if (!plug->nr)
+    return;
+
+  /* Insertion sort: the batch is small and usually nearly sorted */
+  for (unsigned int a = 1; a < plug->nr; a++) {
+    swp_entry_t e = plug->entries[a];
+    struct folio *f = plug->folios[a];
+    unsigned int b = a;
+
+    while (b > 0 && plug->entries[b - 1].val > e.val) {
+      plug->entries[b] = plug->entries[b - 1];
+      plug->folios[b] = plug->folios[b - 1];
+      b--;
+    }
+    plug->entries[b] = e;
+    plug->folios[b] = f;
+  }
+
+  blk_start_plug(&bplug);
+
+  while (i < plug->nr) {
+    swp_entry_t first = plug->entries[i];
+    struct swap_info_struct *si = swap_entry_info(first);
+    unsigned int j = i + 1;
+
+    if (!si || !si->bdev || (si->flags & SWP_SYNTHETIC)) {
+      swap_writepage(plug->folios[i], first);
+      i++;
+      continue;
+    }
+
+    while (j < plug->nr && j - i < BIO_MAX_VECS &&
+           swp_type(plug->entries[j]) == swp_type(first) &&
+           swp_offset(plug->entries[j]) == swp_offset(first) + (j - i))
+      j++;
+
+    swap_submit_write(si, &plug->folios[i], swp_offset(first), j - i);
+    i = j;
+  }
+
+  blk_finish_plug(&bplug);
+  plug->nr = 0;
+}
+
+/**
+ * swap_read_folio - Fill a folio from its swap slot (synchronous)
+ */
+static int swap_read_folio(struct swap_info_struct *si, struct folio *folio,
+                           unsigned long offset) {
+  int ret;
+
+  if (si->flags & SWP_SYNTHETIC) {
+    /* Synthetic swap: return zeroed page (simulates successful read) */
+    clear_page(folio_address(folio));
+    return 0;
+  }
+
+  if (si->swap_file) {
+    ret = swap_rw_file(si, folio, offset, false);
+  } else {
+    struct bio *bio = bio_alloc(si->bdev, 1, REQ_OP_READ);
+    if (!bio)
+      return -ENOMEM;
+
+    bio->bi_sector = swap_offset_to_sector(si, offset);
+    bio_add_folio(bio, folio);
+    ret = submit_bio_wait(bio);
+    bio_put(bio);
+    atomic_long_inc(&si->nr_read_bios);
+  }
+
+  if (ret)
+    atomic_long_inc(&si->nr_io_errors);
+  else
+    atomic_long_inc(&si->nr_pageins);
+  return ret;
+}
+
 /**
  * swap_readpage - Read a folio from swap
  * @entry: The swap entry to read from
@@ -284,11 +634,7 @@ struct folio *swap_readpage(swp_entry_t entry) {
   if (folio)
     return folio;
 
-  unsigned int type = swp_type(entry);
-  if (type >= MAX_SWAPFILES)
-    return nullptr;
-
-  struct swap_info_struct *si = swap_info[type];
+  struct swap_info_struct *si = swap_entry_info(entry);
   if (!si)
     return nullptr;
 
@@ -297,17 +643,9 @@ struct folio *swap_readpage(swp_entry_t entry) {
   if (!folio)
     return nullptr;
 
-  /*
-   * NOTE: Actual I/O from block device requires bio submission.
-   * Similar to swap_writepage, this would submit a read bio.
-   */
-  if (si->flags & SWP_SYNTHETIC) {
-      /* Synthetic swap: return zeroed page (simulates successful read) */
-      memset(folio_address(folio), 0, PAGE_SIZE);
-  } else {
-      /* Real I/O would go here */
-      folio_put(folio);
-      return nullptr;
+  if (swap_read_folio(si, folio, swp_offset(entry)) != 0) {
+    folio_put(folio);
+    return nullptr;
   }
 
   /* Add to swap cache for concurrent access */
@@ -327,19 +665,19 @@ struct folio *swap_readpage(swp_entry_t entry) {
 struct folio *lookup_swap_cache(swp_entry_t entry) {
   unsigned int hash = swap_cache_hash(entry);
 
-  spin_lock(&swap_cache[hash].lock);
+  irq_flags_t flags = spinlock_lock_irqsave(&swap_cache[hash].lock);
 
   struct swap_cache_entry *sce;
   list_for_each_entry(sce, &swap_cache[hash].entries, list) {
     if (sce->entry.val == entry.val) {
       struct folio *folio = sce->folio;
       folio_get(folio);
-      spin_unlock(&swap_cache[hash].lock);
+      spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
       return folio;
     }
   }
 
-  spin_unlock(&swap_cache[hash].lock);
+  spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
   return nullptr;
 }
 
@@ -350,10 +688,11 @@ struct folio *lookup_swap_cache(swp_entry_t entry) {
  *
  * Returns 0 on success, -EEXIST if already present.
  */
-int add_to_swap_cache(struct folio *folio, swp_entry_t entry) {
+static int __add_to_swap_cache(struct folio *folio, swp_entry_t entry,
+                               atomic_long_t *seq, long seq_snap) {
   unsigned int hash = swap_cache_hash(entry);
 
-  struct swap_cache_entry *sce = kmalloc(sizeof(*sce));
+  struct swap_cache_entry *sce = kmem_cache_alloc(swap_cache_entry_cache);
   if (!sce)
     return -ENOMEM;
 
@@ -361,54 +700,133 @@ int add_to_swap_cache(struct folio *folio, swp_entry_t entry) {
   sce->folio = folio;
   atomic_set(&sce->refcount, 1);
 
-  spin_lock(&swap_cache[hash].lock);
+  irq_flags_t flags = spinlock_lock_irqsave(&swap_cache[hash].lock);
+
+  /* A swap-out completed since the caller read the disk: its copy may be stale */
+  if (seq && atomic_long_read(seq) != seq_snap) {
+    spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
+    kmem_cache_free(swap_cache_entry_cache, sce);
+    return -EAGAIN;
+  }
 
   /* Check if already present */
   struct swap_cache_entry *existing;
   list_for_each_entry(existing, &swap_cache[hash].entries, list) {
     if (existing->entry.val == entry.val) {
-      spin_unlock(&swap_cache[hash].lock);
-      kfree(sce);
+      spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
+      kmem_cache_free(swap_cache_entry_cache, sce);
       return -EEXIST;
     }
   }
 
   list_add(&sce->list, &swap_cache[hash].entries);
   folio_get(folio); /* Cache holds a reference */
+  folio->private = (void *) entry.val;
+  folio->flags |= PG_swapcache;
+  atomic_long_inc(&swap_cache_pages);
 
-  spin_unlock(&swap_cache[hash].lock);
+  spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
   return 0;
 }
 
+int add_to_swap_cache(struct folio *folio, swp_entry_t entry) {
+  return __add_to_swap_cache(folio, entry, nullptr, 0);
+}
+
+/* Whether a folio is cached for @entry, without taking a reference */
+static bool swap_cache_present(swp_entry_t entry) {
+  unsigned int hash = swap_cache_hash(entry);
+  bool found = false;
+
+  irq_flags_t flags = spinlock_lock_irqsave(&swap_cache[hash].lock);
+
+  struct swap_cache_entry *sce;
+  list_for_each_entry(sce, &swap_cache[hash].entries, list) {
+    if (sce->entry.val == entry.val) {
+      found = true;
+      break;
+    }
+  }
+
+  spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
+  return found;
+}
+
 /**
- * delete_from_swap_cache - Remove a folio from the swap cache
- * @folio: The folio to remove
+ * __swap_cache_remove - Unlink a cache entry, caller holds the bucket lock
  */
-void delete_from_swap_cache(struct folio *folio) {
-  /*
-   * This requires walking all cache buckets or storing the entry
-   * in the folio. For now, we rely on the folio's private field
-   * to store the swap entry.
-   */
+static struct folio *__swap_cache_remove(struct swap_cache_entry *sce) {
+  struct folio *folio = sce->folio;
+
+  list_del(&sce->list);
+  folio->private = nullptr;
+  folio->flags &= ~PG_swapcache;
+  atomic_long_dec(&swap_cache_pages);
+  kmem_cache_free(swap_cache_entry_cache, sce);
+  return folio;
+}
+
+/*
+ * @seq, when set, is bumped under the bucket lock so that readahead can tell
+ * a slot whose write completed while it was reading the old disk copy.
+ */
+static void __delete_from_swap_cache(struct folio *folio, atomic_long_t *seq) {
+  struct folio *victim = nullptr;
+
+  /* The swap entry is stored in folio->private while cached */
   if (!folio->private)
     return;
 
-  swp_entry_t entry = *(swp_entry_t *) &folio->private;
+  swp_entry_t entry = {.val = (unsigned long) folio->private};
   unsigned int hash = swap_cache_hash(entry);
 
-  spin_lock(&swap_cache[hash].lock);
+  irq_flags_t flags = spinlock_lock_irqsave(&swap_cache[hash].lock);
 
   struct swap_cache_entry *sce, *tmp;
+  if (seq)
+    atomic_long_inc(seq);
   list_for_each_entry_safe(sce, tmp, &swap_cache[hash].entries, list) {
     if (sce->folio == folio) {
-      list_del(&sce->list);
-      folio_put(folio); /* Release cache's reference */
-      kfree(sce);
+      victim = __swap_cache_remove(sce);
       break;
     }
   }
 
-  spin_unlock(&swap_cache[hash].lock);
+  spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
+
+  if (victim)
+    folio_put(victim); /* Release cache's reference */
+}
+
+/**
+ * delete_from_swap_cache - Remove a folio from the swap cache
+ * @folio: The folio to remove
+ */
+void delete_from_swap_cache(struct folio *folio) {
+  __delete_from_swap_cache(folio, nullptr);
+}
+
+/**
+ * swap_cache_drop - Drop whatever folio is cached for a freed slot
+ */
+static void swap_cache_drop(swp_entry_t entry) {
+  struct folio *victim = nullptr;
+  unsigned int hash = swap_cache_hash(entry);
+
+  irq_flags_t flags = spinlock_lock_irqsave(&swap_cache[hash].lock);
+
+  struct swap_cache_entry *sce;
+  list_for_each_entry(sce, &swap_cache[hash].entries, list) {
+    if (sce->entry.val == entry.val) {
+      victim = __swap_cache_remove(sce);
+      break;
+    }
+  }
+
+  spinlock_unlock_irqrestore(&swap_cache[hash].lock, flags);
+
+  if (victim)
+    folio_put(victim);
 }
 
 /**
@@ -416,45 +834,252 @@ void delete_from_swap_cache(struct folio *folio) {
  * @entry: The swap entry that triggered the fault
  * @gfp_mask: Allocation flags
  *
- * Returns the requested folio, with neighbors queued for async read.
+ * The readahead window (CONFIG_MM_SWAP_READAHEAD slots, aligned and kept
+ * inside the slot's cluster) is trimmed to the in-use slots around the
+ * target and fetched with a single bio. Neighbours are left in the swap
+ * cache; pages read for free slots inside the window are discarded.
+ *
+ * A cached neighbour may still be under a swap-out write that the read
+ * would overtake, so the window stops short of it. Neighbours are only
+ * cached if no swap-out completed on the device during the read (checked
+ * under the swap cache lock) and their slot count is unchanged.
+ *
+ * Returns the requested folio.
  */
 struct folio *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask) {
-#ifdef CONFIG_MM_SWAP_READAHEAD
-  unsigned long offset = swp_offset(entry);
+  struct folio *folio = lookup_swap_cache(entry);
+  if (folio)
+    return folio;
+
+  struct swap_info_struct *si = swap_entry_info(entry);
+  if (!si)
+    return nullptr;
+
+  if (SWAP_RA_PAGES <= 1 || !si->bdev || (si->flags & SWP_SYNTHETIC) ||
+      atomic_long_read(&swap_cache_pages) > SWAP_RA_CACHE_LIMIT)
+    return swap_readpage(entry);
+
   unsigned int type = swp_type(entry);
+  unsigned long offset = swp_offset(entry);
+
+  /* Calculate window boundaries */
+  unsigned long cluster_start = offset & ~((unsigned long) SWAP_CLUSTER_SIZE - 1);
+  unsigned long start = offset - (offset % SWAP_RA_PAGES);
+  unsigned long end = start + SWAP_RA_PAGES;
+
+  if (start < cluster_start)
+    start = cluster_start;
+  if (start < si->lowest_bit)
+    start = si->lowest_bit;
+  if (end > cluster_start + SWAP_CLUSTER_SIZE)
+    end = cluster_start + SWAP_CLUSTER_SIZE;
+  if (end > si->highest_bit + 1)
+    end = si->highest_bit + 1;
+
+  bool want[SWAP_RA_PAGES];
+  unsigned char counts[SWAP_RA_PAGES];
+  struct folio *folios[SWAP_RA_PAGES];
+  long write_seq = atomic_long_read(&si->write_seq);
+
+  /* Stop at the nearest cached neighbours on either side of the target */
+  for (unsigned long off = offset; off-- > start;) {
+    if (swap_cache_present(swp_entry(type, off))) {
+      start = off + 1;
+      break;
+    }
+  }
+  for (unsigned long off = offset + 1; off < end; off++) {
+    if (swap_cache_present(swp_entry(type, off))) {
+      end = off;
+      break;
+    }
+  }
+
+  spin_lock(&si->lock);
+  for (unsigned long off = start; off < end; off++) {
+    unsigned char count = si->swap_map[off];
+    counts[off - start] = count;
+    want[off - start] = count > 0 && count != SWAP_MAP_BAD;
+  }
+  spin_unlock(&si->lock);
+  want[offset - start] = true;
 
-  /* Calculate cluster boundaries */
-  unsigned long cluster_start = offset & ~(SWAP_CLUSTER_SIZE - 1);
-  unsigned long cluster_end = cluster_start + SWAP_CLUSTER_SIZE;
+  /* Trim free slots at the edges of the window */
+  while (start < offset && !want[0]) {
+    memmove(want, want + 1, (end - start - 1) * sizeof(bool));
+    memmove(counts, counts + 1, (end - start - 1) * sizeof(unsigned char));
+    start++;
+  }
+  while (end > offset + 1 && !want[end - start - 1])
+    end--;
 
-  if (type >= MAX_SWAPFILES || !swap_info[type])
+  unsigned int nr = (unsigned int) (end - start);
+  if (nr == 1)
     return swap_readpage(entry);
 
-  struct swap_info_struct *si = swap_info[type];
-  if (cluster_end > si->highest_bit)
-    cluster_end = si->highest_bit + 1;
+  struct bio *bio = bio_alloc(si->bdev, nr, REQ_OP_READ);
+  if (!bio)
+    return swap_readpage(entry);
+  bio->bi_sector = swap_offset_to_sector(si, start);
+
+  for (unsigned int i = 0; i < nr; i++) {
+    folios[i] = alloc_pages(gfp_mask, 0);
+    if (!folios[i]) {
+      while (i--)
+        folio_put(folios[i]);
+      bio_put(bio);
+      return swap_readpage(entry);
+    }
+    bio_add_folio(bio, folios[i]);
+  }
 
-  /* Read the cluster asynchronously */
-  for (unsigned long off = cluster_start; off < cluster_end; off++) {
-    if (off == offset)
-      continue; /* We'll read this one synchronously */
+  int ret = submit_bio_wait(bio);
+  bio_put(bio);
+  atomic_long_inc(&si->nr_read_bios);
 
-    swp_entry_t ra_entry = swp_entry(type, off);
+  if (ret) {
+    atomic_long_inc(&si->nr_io_errors);
+    for (unsigned int i = 0; i < nr; i++)
+      folio_put(folios[i]);
+    return nullptr;
+  }
 
-    /* Check if slot is in use */
-    spin_lock(&si->lock);
-    bool in_use = (si->swap_map[off] > 0);
-    spin_unlock(&si->lock);
+  struct folio *target = folios[offset - start];
+
+  /* Slots freed or re-referenced meanwhile no longer match what was read */
+  spin_lock(&si->lock);
+  for (unsigned int i = 0; i < nr; i++) {
+    if (want[i] && si->swap_map[start + i] != counts[i])
+      want[i] = false;
+  }
+  spin_unlock(&si->lock);
+
+  for (unsigned int i = 0; i < nr; i++) {
+    if (folios[i] == target)
+      continue;
+
+    /* A folio already cached for the slot is newer than the disk copy */
+    if (want[i] && __add_to_swap_cache(folios[i], swp_entry(type, start + i),
+                                       &si->write_seq, write_seq) == 0)
+      atomic_long_inc(&si->nr_pageins);
+    folio_put(folios[i]);
+  }
+
+  atomic_long_inc(&si->nr_pageins);
+  if (add_to_swap_cache(target, entry) != 0) {
+    folio_put(target);
+    return lookup_swap_cache(entry);
+  }
+
+  return target;
+}
+
+/* --- swapon / swapoff --- */
 
-    if (in_use && !lookup_swap_cache(ra_entry)) {
-      /* Queue async read (placeholder) */
-      /* In reality, we'd submit a bio without waiting */
+/**
+ * swap_open_backing - Resolve @path to a block device or regular file
+ *
+ * Absolute paths are opened through the VFS (a block special file or a
+ * regular swap file); bare names are looked up as block devices ("sda2").
+ */
+static int swap_open_backing(struct swap_info_struct *si, const char *path,
+                             unsigned long *nr_pages) {
+  struct block_device *bdev = nullptr;
+
+  if (path[0] == '/') {
+    struct file *file = vfs_open(path, O_RDWR, 0);
+    if (!file)
+      return -ENOENT;
+
+    struct inode *inode = file->f_inode;
+    if (S_ISBLK(inode->i_mode)) {
+      bdev = blkdev_lookup(inode->i_rdev);
+      vfs_close(file);
+      if (!bdev)
+        return -ENODEV;
+    } else if (S_ISREG(inode->i_mode)) {
+      si->swap_file = file;
+      si->flags |= SWP_FILE;
+      *nr_pages = (unsigned long) (inode->i_size >> PAGE_SHIFT);
+      return *nr_pages > 1 ? 0 : -EINVAL;
+    } else {
+      vfs_close(file);
+      return -EINVAL;
     }
+  } else {
+    bdev = block_device_find(path);
+    if (!bdev)
+      return -ENODEV;
+    get_device(&bdev->dev);
   }
-#endif
 
-  /* Read the requested page synchronously */
-  return swap_readpage(entry);
+  si->bdev = bdev;
+  if (!bdev->block_size || bdev->block_size > PAGE_SIZE ||
+      PAGE_SIZE % bdev->block_size)
+    return -EINVAL;
+
+  si->sectors_per_page = PAGE_SIZE / bdev->block_size;
+  si->start_sector = 0;
+  *nr_pages = (unsigned long) (block_device_size_bytes(bdev) >> PAGE_SHIFT);
+  return *nr_pages > 1 ? 0 : -EINVAL;
+}
+
+/**
+ * swap_read_header - Apply an mkswap(8) header found in slot 0
+ *
+ * Limits the device to last_page and marks listed bad slots. A device
+ * without a header is used whole (slot 0 is never allocated either way).
+ */
+static void swap_read_header(struct swap_info_struct *si, unsigned long *nr_pages) {
+  struct folio *folio = alloc_pages(GFP_KERNEL, 0);
+  if (!folio)
+    return;
+
+  struct bio *bio = bio_alloc(si->bdev, 1, REQ_OP_READ | REQ_META);
+  if (!bio) {
+    folio_put(folio);
+    return;
+  }
+
+  bio->bi_sector = si->start_sector;
+  bio_add_folio(bio, folio);
+  int ret = submit_bio_wait(bio);
+  bio_put(bio);
+
+  char *page = folio_address(folio);
+  struct swap_header_info *hdr = (struct swap_header_info *) page;
+
+  if (ret || memcmp(page + PAGE_SIZE - SWAP_HEADER_MAGIC_LEN, SWAP_HEADER_MAGIC,
+                    SWAP_HEADER_MAGIC_LEN) != 0) {
+    printk(KERN_WARNING SWAP_CLASS "%s: no swap signature, using the whole device\n",
+           si->name);
+    folio_put(folio);
+    return;
+  }
+
+  if (hdr->version == 1 && hdr->last_page > 0 && hdr->last_page < *nr_pages)
+    *nr_pages = (unsigned long) hdr->last_page + 1;
+
+  /* Mark the slots mkswap found unusable */
+  uint32_t nr_bad = hdr->nr_badpages;
+  if (nr_bad > SWAP_HEADER_MAX_BAD)
+    nr_bad = SWAP_HEADER_MAX_BAD;
+
+  for (uint32_t i = 0; i < nr_bad && si->swap_map; i++) {
+    if (hdr->badpages[i] > 0 && hdr->badpages[i] < *nr_pages)
+      si->swap_map[hdr->badpages[i]] = SWAP_MAP_BAD;
+  }
+
+  folio_put(folio);
+}
+
+static void swap_release_backing(struct swap_info_struct *si) {
+  if (si->swap_file)
+    vfs_close(si->swap_file);
+  if (si->bdev)
+    put_device(&si->bdev->dev);
+  si->swap_file = nullptr;
+  si->bdev = nullptr;
 }
 
 /**
@@ -465,8 +1090,12 @@ struct folio *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask) {
  * Returns 0 on success, negative on failure.
  */
 int sys_swapon(const char *path, int flags) {
-  if (nr_swapfiles >= MAX_SWAPFILES)
-    return -EPERM;
+  unsigned long nr_pages = 0;
+  int type = -1;
+  int ret;
+
+  if (!path)
+    return -EINVAL;
 
   /* Allocate swap_info_struct */
   struct swap_info_struct *si = kmalloc(sizeof(*si));
@@ -479,6 +1108,10 @@ int sys_swapon(const char *path, int flags) {
   INIT_LIST_HEAD(&si->free_clusters);
   INIT_LIST_HEAD(&si->partial_clusters);
   INIT_LIST_HEAD(&si->extent_list);
+  init_waitqueue_head(&si->inflight_wait);
+  atomic_set(&si->nr_inflight, 0);
+  atomic_long_set(&si->write_seq, 0);
+  si->max_inflight = SWAP_MAX_INFLIGHT;
 
   si->prio = (flags >> 16) & 0x7FFF; /* Priority in high bits */
   if (si->prio == 0)
@@ -491,48 +1124,93 @@ int sys_swapon(const char *path, int flags) {
   memcpy(si->name, path, len);
   si->name[len] = '\0';
 
-  /*
-   * NOTE: Actual swap device initialization requires reading the swap header
-   * from the block device or file.
-   */
   if (flags & SWP_SYNTHETIC) {
-      /* Create a synthetic swap device for testing/benchmarking */
-      si->flags |= SWP_SYNTHETIC;
+    /* Create a synthetic swap device for testing/benchmarking (256MB) */
+    si->flags |= SWP_SYNTHETIC;
+    nr_pages = 65536;
+  } else {
+    ret = swap_open_backing(si, path, &nr_pages);
+    if (ret)
+      goto out_free;
   }
 
-  /* Placeholder: Allocate 256MB of swap (65536 pages) */
-  unsigned long nr_pages = 65536;
-
   si->swap_map = kmalloc(nr_pages);
   if (!si->swap_map) {
-    kfree(si);
-    return -ENOMEM;
+    ret = -ENOMEM;
+    goto out_free;
   }
   memset(si->swap_map, SWAP_MAP_FREE, nr_pages);
 
+  if (si->bdev)
+    swap_read_header(si, &nr_pages);
+
+  unsigned long nr_bad = 0;
+  for (unsigned long i = 1; i < nr_pages; i++) {
+    if (si->swap_map[i] == SWAP_MAP_BAD)
+      nr_bad++;
+  }
+
   si->lowest_bit = 1; /* Slot 0 is reserved */
   si->highest_bit = nr_pages - 1;
   si->cluster_next = 1;
 
-  atomic_long_set(&si->total_pages, nr_pages - 1);
+#ifdef CONFIG_MM_SWAP_SLOTS_CACHE
+  si->slots_cache = alloc_percpu(struct swap_slots_cache);
+  if (si->slots_cache) {
+    int cpu;
+    for_each_possible_cpu(cpu) {
+      struct swap_slots_cache *cache = per_cpu_ptr(*si->slots_cache, cpu);
+      cache->next = 0;
+      cache->nr = 0;
+      spinlock_init(&cache->lock);
+    }
+  }
+#endif
+
+  unsigned long usable = nr_pages - 1 - nr_bad;
+  atomic_long_set(&si->total_pages, usable);
   atomic_long_set(&si->inuse_pages, 0);
 
   /* Register the swap device */
   spin_lock(&swap_lock);
-  si->type = nr_swapfiles;
-  swap_info[nr_swapfiles] = si;
-  nr_swapfiles++;
+  for (int i = 0; i < MAX_SWAPFILES; i++) {
+    if (!swap_info[i]) {
+      type = i;
+      break;
+    }
+  }
+  if (type < 0) {
+    spin_unlock(&swap_lock);
+    ret = -EPERM;
+    goto out_free;
+  }
 
-  atomic_long_add(nr_pages - 1, &total_swap_pages);
-  atomic_long_add(nr_pages - 1, &nr_swap_pages);
+  si->type = type;
+  swap_info[type] = si;
+  if (type >= nr_swapfiles)
+    nr_swapfiles = type + 1;
 
-  si->flags = SWP_USED | SWP_WRITEOK | SWP_SYNTHETIC;
+  atomic_long_add(usable, &total_swap_pages);
+  atomic_long_add(usable, &nr_swap_pages);
+
+  si->flags |= SWP_USED | SWP_WRITEOK;
   spin_unlock(&swap_lock);
 
-  printk(KERN_INFO "swap: " "Activated swap: %s (%lu pages, priority %d)\n",
-         si->name, nr_pages - 1, si->prio);
+  printk(KERN_INFO SWAP_CLASS "Activated swap: %s (%lu pages, priority %d, %s)\n",
+         si->name, usable, si->prio,
+         (si->flags & SWP_SYNTHETIC) ? "synthetic" : (si->swap_file ? "file" : "block"));
 
   return 0;
+
+out_free:
+#ifdef CONFIG_MM_SWAP_SLOTS_CACHE
+  if (si->slots_cache)
+    free_percpu(si->slots_cache);
+#endif
+  swap_release_backing(si);
+  kfree(si->swap_map);
+  kfree(si);
+  return ret;
 }
 
 /**
@@ -551,34 +1229,50 @@ int sys_swapoff(const char *path) {
       break;
     }
   }
+  if (si)
+    si->flags &= ~SWP_WRITEOK;
   spin_unlock(&swap_lock);
 
   if (!si)
     return -ENOENT;
 
+  /* Give back reserved slots and let outstanding writes finish */
+  swap_slots_drain(si);
+  wait_event(si->inflight_wait, atomic_read(&si->nr_inflight) == 0);
+
   /* Check if any pages are still swapped */
   if (atomic_long_read(&si->inuse_pages) > 0) {
     /*
      * TODO: Migrate all swapped pages back to RAM.
      * This requires walking all address spaces and swapping in pages.
      */
+    spin_lock(&swap_lock);
+    si->flags |= SWP_WRITEOK;
+    spin_unlock(&swap_lock);
     return -EBUSY;
   }
 
   spin_lock(&swap_lock);
-  si->flags &= ~SWP_WRITEOK;
+  swap_info[si->type] = nullptr;
 
   atomic_long_sub(atomic_long_read(&si->total_pages), &total_swap_pages);
   atomic_long_sub(atomic_long_read(&si->total_pages) -
                   atomic_long_read(&si->inuse_pages), &nr_swap_pages);
   spin_unlock(&swap_lock);
 
+  printk(KERN_INFO SWAP_CLASS "Deactivated swap: %s (%ld pages out in %ld writes, %ld in, %ld errors)\n",
+         path, atomic_long_read(&si->nr_pageouts), atomic_long_read(&si->nr_write_bios),
+         atomic_long_read(&si->nr_pageins), atomic_long_read(&si->nr_io_errors));
+
   /* Free resources */
+#ifdef CONFIG_MM_SWAP_SLOTS_CACHE
+  if (si->slots_cache)
+    free_percpu(si->slots_cache);
+#endif
+  swap_release_backing(si);
   kfree(si->swap_map);
   kfree(si);
 
-  printk(KERN_INFO "swap: " "Deactivated swap: %s\n", path);
-
   return 0;
 }
 
@@ -600,6 +1294,13 @@ int swap_writepage(struct folio *folio, swp_entry_t entry) {
   (void) entry;
   return -ENOSYS;
 }
+bool swap_plug_add(struct swap_plug *plug, struct folio *folio, swp_entry_t entry) {
+  (void) plug;
+  (void) folio;
+  (void) entry;
+  return false;
+}
+void swap_flush_plug(struct swap_plug *plug) { plug->nr = 0; }
 struct folio *swap_readpage(swp_entry_t entry) {
   (void) entry;
   return nullptr;
@@ -273,7 +273,7 @@ static int anon_obj_fault(struct vm_object *obj, struct vm_area_struct *vma, str
         up_write(&obj->lock);
         return VM_FAULT_OOM;
     }
-    memset(folio_address(new_folio), 0, PAGE_SIZE);
+    clear_page(folio_address(new_folio));
 
     if (vm_object_add_folio(obj, vmf->pgoff, new_folio) < 0) {
         up_write(&obj->lock);
@@ -491,7 +491,7 @@ allocate_new_with_shadow:
     if (!folio) {
       return VM_FAULT_OOM;
     }
-    memset(pmm_phys_to_virt(folio_to_phys(folio)), 0, PAGE_SIZE);
+    clear_page(pmm_phys_to_virt(folio_to_phys(folio)));
   }
 
   /* 4. Try to insert the new folio (RACING RE-CHECK) */
@@ -648,7 +648,7 @@ static int vnode_obj_fault(struct vm_object *obj, struct vm_area_struct *vma, st
     }
   } else {
     /* Generic case: just zero the page if no read_folio (simulates a hole) */
-    memset(folio_address(folio), 0, PAGE_SIZE);
+    clear_page(folio_address(folio));
   }
 
   /* 5. Insert into the page tree (RACING CHECK) */
@@ -908,7 +908,7 @@ int vm_object_try_collapse_async(struct vm_object *obj) {
   vm_object_get(obj); /* Keep obj alive until work completes */
   cw->obj = obj;
   INIT_WORK(&cw->work, collapse_work_fn);
-  schedule_work(&cw->work);
+  queue_work(system_unbound_wq, &cw->work);
 
   return 1;
 }
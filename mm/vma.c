@@ -33,6 +33,7 @@
 #include <linux/list.h>
 #include <linux/maple_tree.h>
 #include <mm/mmu_gather.h>
+#include <mm/numa_balancing.h>
 #include <mm/slub.h>
 #include <mm/vma.h>
 #include <mm/vm_object.h>
@@ -168,7 +169,11 @@ void mm_init(struct mm_struct *mm) {
   mm->vmacache_seqnum = 0;
   mm->preferred_node = -1;
   cpumask_clear(&mm->cpu_mask);
+  tlb_init_mm_context(mm);
   atomic_set(&mm->mmap_seq, 0);
+#ifdef CONFIG_MM_NUMA_BALANCING
+  INIT_LIST_HEAD(&mm->numa_scan_list);
+#endif
 
   /* Initialize memory layout fields */
   mm->start_code = 0;
@@ -211,6 +216,8 @@ void mm_free(struct mm_struct *mm) {
   if (!mm)
     return;
 
+  numa_balancing_mm_exit(mm);
+
   if (mm->rd) {
     resdomain_put(mm->rd);
     mm->rd = nullptr;
@@ -260,6 +267,7 @@ struct mm_struct *mm_create(void) {
   memcpy(pml4_virt + 256, kernel_pml_virt + 256, 256 * sizeof(uint64_t));
 
   mm->pml_root = (uint64_t *) pml_root_phys;
+  numa_balancing_mm_init(mm);
   return mm;
 }
 EXPORT_SYMBOL(mm_create);
@@ -375,6 +383,8 @@ void mm_destroy(struct mm_struct *mm) {
 
   /* Free the page tables if it's not the kernel's */
   if (mm->pml_root && (uint64_t) mm->pml_root != g_kernel_pml_root) {
+    /* Lazy CPUs may still have them in CR3 */
+    tlb_release_mm(mm);
     vmm_free_page_tables(mm);
     mm->pml_root = nullptr;
   }
@@ -1274,7 +1284,7 @@ int mm_populate_user_range(struct mm_struct *mm, uint64_t start, size_t size, ui
 
     /* Zero the page */
     void *page_virt = pmm_phys_to_virt(folio_to_phys(folio));
-    memset(page_virt, 0, PAGE_SIZE);
+    clear_page(page_virt);
 
     /* Map it directly */
     vmm_map_page(mm, addr, folio_to_phys(folio), vma->vm_page_prot);
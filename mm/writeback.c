@@ -21,6 +21,7 @@
 #include <linux/list.h>
 #include <linux/container_of.h>
 #include <aerosync/classes.h>
+#include <aerosync/sysintf/bio.h>
 
 /* Global Dirty Page Tracking */
 static LIST_HEAD(dirty_objects);
@@ -144,6 +145,13 @@ void balance_dirty_pages_ratelimited(struct vm_object *obj) {
 static void writeback_object(struct vm_object *obj) {
   if (!obj || !obj->ops) return;
 
+  /*
+   * Plug the whole pass: bios issued by write_folio(s) for neighbouring
+   * clusters are merged and reach the disk as a few large requests.
+   */
+  struct blk_plug plug;
+  blk_start_plug(&plug);
+
   down_write(&obj->lock);
 
   unsigned long index = 0;
@@ -225,6 +233,7 @@ static void writeback_object(struct vm_object *obj) {
   }
 
   up_write(&obj->lock);
+  blk_finish_plug(&plug);
 }
 
 /**
@@ -1,46 +1,141 @@
 #include <mm/zmm.h>
 #include <mm/slub.h>
 #include <mm/page.h>
+#include <mm/zone.h>
+#include <mm/gfp.h>
 #include <lib/string.h>
+#include <lib/lz4.h>
+#include <lib/vsprintf.h>
 #include <arch/x86_64/mm/pmm.h>
+#include <arch/x86_64/percpu.h>
 #include <lib/printk.h>
 #include <aerosync/classes.h>
 #include <aerosync/errno.h>
 #include <aerosync/spinlock.h>
-#include <aerosync/errno.h>
+#include <aerosync/mutex.h>
+#include <aerosync/atomic.h>
+#include <aerosync/sched/cpumask.h>
+#include <fs/vfs.h>
+#include <fs/procfs.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_MM_ZMM
 
 /*
  * ZMM Implementation
- * 
- * Uses a simplified RLE + Raw fallback for speed.
- * Storage is managed via kmalloc (for now, but using a custom slab cache).
+ *
+ * Pages are first checked for a repeating machine word; such pages are
+ * stored as the fill value alone. Everything else is compressed (LZ4 by
+ * default) into a per-CPU scratch buffer and, if the result beats the
+ * threshold, copied into the pool.
+ *
+ * The pool is a zsmalloc-style allocator: objects are rounded up to one of
+ * PAGE_SIZE / ZMM_CLASS_DELTA size classes, and each class carves its
+ * objects out of dedicated "zspages" (1, 2 or 4 physically contiguous
+ * pages, whichever wastes the least for that size). A zspage is returned to
+ * the page allocator as soon as its last object is freed.
  */
 
-static struct kmem_cache *zmm_cache;
+#ifndef ZMM_COMPRESSION_THRESHOLD
+#ifndef CONFIG_ZMM_COMPRESSION_THRESHOLD
+#define ZMM_COMPRESSION_THRESHOLD 75
+#else
+#define ZMM_COMPRESSION_THRESHOLD CONFIG_ZMM_COMPRESSION_THRESHOLD
+#endif
+#endif
 
-int zmm_init(void) {
-  zmm_cache = kmem_cache_create("zmm_entries", 64, 0, SLAB_HWCACHE_ALIGN);
-  printk(KERN_INFO VMM_CLASS "ZMM Anonymous memory compression pool initialized.\n");
-  return 0;
-}
+#define ZMM_MAX_CSIZE         (PAGE_SIZE * ZMM_COMPRESSION_THRESHOLD / 100)
+
+#define ZMM_CLASS_DELTA       32
+#define ZMM_NR_CLASSES        (PAGE_SIZE / ZMM_CLASS_DELTA)
+#define ZMM_MAX_ZSPAGE_ORDER  2
+#define ZMM_OBJ_NONE          0xFFFFFFFFu
+
+enum zmm_store_type {
+  ZMM_STORE_SAME = 0,   /* Page is one repeated word, nothing in the pool */
+  ZMM_STORE_LZ4,
+  ZMM_STORE_RLE,
+  ZMM_STORE_RAW,
+};
+
+struct zmm_class;
+
+/* A run of pages holding objects of one size class */
+struct zmm_zspage {
+  struct list_head list;      /* On class->partial or class->full */
+  struct zmm_class *class;
+  struct folio *folio;
+  uint8_t *base;
+  uint32_t freelist;          /* Index of the first free object */
+  uint32_t inuse;
+};
+
+struct zmm_class {
+  spinlock_t lock;
+  uint32_t size;              /* Object size */
+  uint32_t order;             /* zspage = 1 << order pages */
+  uint32_t objs_per_zspage;
+  struct list_head partial;
+  struct list_head full;
+  unsigned long nr_zspages;
+  unsigned long nr_objs;      /* Objects in use */
+};
 
 struct zmm_entry {
-  void *data;
-  uint32_t size;
-  bool is_rle;
+  struct zmm_zspage *zspage;  /* nullptr for ZMM_STORE_SAME */
+  union {
+    uint8_t *obj;
+    unsigned long fill;
+  };
+  uint32_t size;              /* Payload bytes */
+  uint8_t type;               /* enum zmm_store_type */
 };
 
+/*
+ * Per-CPU compression scratch. The mutex only matters if the task migrates
+ * mid-compression; storing the result may allocate and therefore sleep.
+ */
+struct zmm_pcpu {
+  mutex_t lock;
+  uint8_t *dst;               /* PAGE_SIZE output buffer */
+  void *wrkmem;               /* Compressor state */
+};
+
+static struct kmem_cache *zmm_cache;
+static struct kmem_cache *zmm_zspage_cache;
+static struct zmm_class zmm_classes[ZMM_NR_CLASSES];
+static DEFINE_PER_CPU(struct zmm_pcpu, zmm_pcpu);
+
+static struct {
+  atomic_long_t stored_pages;     /* Pages currently held */
+  atomic_long_t same_filled_pages;
+  atomic_long_t payload_bytes;    /* Compressed bytes currently held */
+  atomic_long_t pool_pages;       /* Pages backing zspages */
+  atomic_long_t nr_stores;        /* Cumulative */
+  atomic_long_t nr_loads;
+  atomic_long_t reject_poor;      /* Did not compress below the threshold */
+  atomic_long_t reject_nomem;
+} zmm_stats;
+
+#if defined(CONFIG_ZMM_ALGO_RLE)
+#define ZMM_DEFAULT_TYPE ZMM_STORE_RLE
+#elif defined(CONFIG_ZMM_ALGO_NONE)
+#define ZMM_DEFAULT_TYPE ZMM_STORE_RAW
+#else
+#define ZMM_DEFAULT_TYPE ZMM_STORE_LZ4
+#endif
+
+/* --- Compressors --- */
+
 /* Simple RLE for extremely fast compression of zero-heavy pages */
-static uint32_t rle_compress(const uint8_t *src, uint8_t *dst, uint32_t src_len) {
+static uint32_t rle_compress(const uint8_t *src, uint8_t *dst, uint32_t src_len, uint32_t dst_cap) {
   uint32_t i = 0, j = 0;
   while (i < src_len) {
     uint8_t count = 1;
     while (i + count < src_len && src[i + count] == src[i] && count < 255) {
       count++;
     }
-    if (j + 2 > src_len) return 0; /* Compression failed/expanded */
+    if (j + 2 > dst_cap) return 0; /* Compression failed/expanded */
     dst[j++] = count;
     dst[j++] = src[i];
     i += count;
@@ -50,58 +145,232 @@ static uint32_t rle_compress(const uint8_t *src, uint8_t *dst, uint32_t src_len)
 
 static void rle_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst) {
   uint32_t i = 0, j = 0;
-  while (i < src_len) {
+  while (i + 1 < src_len && j < PAGE_SIZE) {
     uint8_t count = src[i++];
     uint8_t val = src[i++];
+    if (count > PAGE_SIZE - j) count = (uint8_t) (PAGE_SIZE - j);
     memset(dst + j, val, count);
     j += count;
   }
 }
 
-#ifndef ZMM_COMPRESSION_THRESHOLD
-#ifndef CONFIG_ZMM_COMPRESSION_THRESHOLD
-#define ZMM_COMPRESSION_THRESHOLD 75
-#else
-#define ZMM_COMPRESSION_THRESHOLD CONFIG_ZMM_COMPRESSION_THRESHOLD
-#endif
-#endif
+/**
+ * zmm_page_same_filled - Check whether a page is one repeated machine word
+ */
+static bool zmm_page_same_filled(const void *page, unsigned long *fill) {
+  const unsigned long *words = page;
+  const unsigned long val = words[0];
+  const size_t nr = PAGE_SIZE / sizeof(unsigned long);
 
-zmm_handle_t zmm_compress_folio(struct folio *folio) {
-  uint8_t *src = folio_address(folio);
-  uint8_t *tmp = kmalloc(PAGE_SIZE);
-  if (!tmp) return 0;
-
-  /* Try RLE */
-  uint32_t csize = rle_compress(src, tmp, PAGE_SIZE);
-  bool is_rle = true;
-
-  /* If RLE failed or ratio is bad (> threshold), don't bother */
-  if (csize == 0 || csize > (PAGE_SIZE * ZMM_COMPRESSION_THRESHOLD / 100)) {
-    /* Raw fallback (not saving much memory, but keeps the infrastructure exercised) */
-    /* For now, let's only store if it really compresses. */
-    kfree(tmp);
-    return 0;
+  /* Cheap early exit on the last word before scanning */
+  if (words[nr - 1] != val)
+    return false;
+
+  for (size_t i = 1; i < nr - 1; i++) {
+    if (words[i] != val)
+      return false;
+  }
+
+  *fill = val;
+  return true;
+}
+
+static void zmm_fill_page(void *page, unsigned long val) {
+  unsigned long *words = page;
+  for (size_t i = 0; i < PAGE_SIZE / sizeof(unsigned long); i++)
+    words[i] = val;
+}
+
+/* --- Size class pool --- */
+
+static inline struct zmm_class *zmm_size_class(uint32_t size) {
+  uint32_t idx = (size + ZMM_CLASS_DELTA - 1) / ZMM_CLASS_DELTA;
+  return &zmm_classes[idx ? idx - 1 : 0];
+}
+
+/**
+ * zmm_class_order - Pick the zspage size that wastes the least for @size
+ */
+static uint32_t zmm_class_order(uint32_t size) {
+  uint32_t best_order = 0;
+  unsigned long best_usage = 0;
+
+  for (uint32_t order = 0; order <= ZMM_MAX_ZSPAGE_ORDER; order++) {
+    unsigned long bytes = PAGE_SIZE << order;
+    unsigned long usage = (bytes / size) * size * 100 / bytes;
+    if (usage > best_usage) {
+      best_usage = usage;
+      best_order = order;
+    }
+  }
+
+  return best_order;
+}
+
+static struct zmm_zspage *zmm_zspage_create(struct zmm_class *class) {
+  struct zmm_zspage *zsp = kmem_cache_alloc(zmm_zspage_cache);
+  if (!zsp)
+    return nullptr;
+
+  /* Called from reclaim: never recurse into direct reclaim */
+  zsp->folio = alloc_pages(GFP_NOWAIT, class->order);
+  if (!zsp->folio) {
+    kmem_cache_free(zmm_zspage_cache, zsp);
+    return nullptr;
+  }
+
+  zsp->class = class;
+  zsp->base = folio_address(zsp->folio);
+  zsp->inuse = 0;
+  zsp->freelist = 0;
+
+  /* Free objects link to the next one through their first word */
+  for (uint32_t i = 0; i < class->objs_per_zspage; i++) {
+    uint32_t next = (i + 1 < class->objs_per_zspage) ? i + 1 : ZMM_OBJ_NONE;
+    *(uint32_t *) (zsp->base + (size_t) i * class->size) = next;
+  }
+
+  atomic_long_add(1L << class->order, &zmm_stats.pool_pages);
+  return zsp;
+}
+
+static void zmm_zspage_destroy(struct zmm_zspage *zsp) {
+  atomic_long_sub(1L << zsp->class->order, &zmm_stats.pool_pages);
+  folio_put(zsp->folio);
+  kmem_cache_free(zmm_zspage_cache, zsp);
+}
+
+static uint8_t *zmm_obj_alloc(struct zmm_class *class, struct zmm_zspage **out) {
+  struct zmm_zspage *zsp;
+
+  spin_lock(&class->lock);
+  if (list_empty(&class->partial)) {
+    spin_unlock(&class->lock);
+
+    struct zmm_zspage *fresh = zmm_zspage_create(class);
+    if (!fresh)
+      return nullptr;
+
+    spin_lock(&class->lock);
+    list_add(&fresh->list, &class->partial);
+    class->nr_zspages++;
+  }
+
+  zsp = list_first_entry(&class->partial, struct zmm_zspage, list);
+
+  uint32_t idx = zsp->freelist;
+  uint8_t *obj = zsp->base + (size_t) idx * class->size;
+  zsp->freelist = *(uint32_t *) obj;
+  zsp->inuse++;
+  class->nr_objs++;
+
+  if (zsp->freelist == ZMM_OBJ_NONE)
+    list_move(&zsp->list, &class->full);
+
+  spin_unlock(&class->lock);
+
+  *out = zsp;
+  return obj;
+}
+
+static void zmm_obj_free(struct zmm_zspage *zsp, uint8_t *obj) {
+  struct zmm_class *class = zsp->class;
+  bool release = false;
+
+  spin_lock(&class->lock);
+
+  uint32_t idx = (uint32_t) ((size_t) (obj - zsp->base) / class->size);
+  *(uint32_t *) obj = zsp->freelist;
+  zsp->freelist = idx;
+
+  if (zsp->inuse-- == class->objs_per_zspage)
+    list_move(&zsp->list, &class->partial);
+  class->nr_objs--;
+
+  if (zsp->inuse == 0) {
+    list_del(&zsp->list);
+    class->nr_zspages--;
+    release = true;
   }
 
+  spin_unlock(&class->lock);
+
+  if (release)
+    zmm_zspage_destroy(zsp);
+}
+
+/* --- Public API --- */
+
+static zmm_handle_t zmm_store(uint8_t type, const void *payload, uint32_t size,
+                              unsigned long fill) {
   struct zmm_entry *entry = kmem_cache_alloc(zmm_cache);
-  if (!entry) {
-    kfree(tmp);
-    return 0;
+  if (!entry)
+    goto nomem;
+
+  entry->type = type;
+  entry->size = size;
+  entry->zspage = nullptr;
+
+  if (type == ZMM_STORE_SAME) {
+    entry->fill = fill;
+    atomic_long_inc(&zmm_stats.same_filled_pages);
+  } else {
+    entry->obj = zmm_obj_alloc(zmm_size_class(size), &entry->zspage);
+    if (!entry->obj) {
+      kmem_cache_free(zmm_cache, entry);
+      goto nomem;
+    }
+    memcpy(entry->obj, payload, size);
+    atomic_long_add(size, &zmm_stats.payload_bytes);
   }
 
-  entry->data = kmalloc(csize);
-  if (!entry->data) {
-    kmem_cache_free(zmm_cache, entry);
-    kfree(tmp);
+  atomic_long_inc(&zmm_stats.stored_pages);
+  atomic_long_inc(&zmm_stats.nr_stores);
+  return (zmm_handle_t) entry;
+
+nomem:
+  atomic_long_inc(&zmm_stats.reject_nomem);
+  return 0;
+}
+
+zmm_handle_t zmm_compress_folio(struct folio *folio) {
+  uint8_t *src = folio_address(folio);
+  unsigned long fill;
+
+  /* Handles describe exactly one page */
+  if (folio_nr_pages(folio) != 1)
+    return 0;
+
+  if (zmm_page_same_filled(src, &fill))
+    return zmm_store(ZMM_STORE_SAME, nullptr, 0, fill);
+
+  if (ZMM_DEFAULT_TYPE == ZMM_STORE_RAW)
+    return zmm_store(ZMM_STORE_RAW, src, PAGE_SIZE, 0);
+
+  struct zmm_pcpu *pc = this_cpu_ptr(zmm_pcpu);
+  zmm_handle_t handle = 0;
+  uint32_t csize;
+
+  mutex_lock(&pc->lock);
+  if (unlikely(!pc->dst)) {
+    mutex_unlock(&pc->lock);
+    atomic_long_inc(&zmm_stats.reject_nomem);
     return 0;
   }
 
-  memcpy(entry->data, tmp, csize);
-  entry->size = csize;
-  entry->is_rle = is_rle;
-  kfree(tmp);
+  if (ZMM_DEFAULT_TYPE == ZMM_STORE_RLE)
+    csize = rle_compress(src, pc->dst, PAGE_SIZE, ZMM_MAX_CSIZE);
+  else
+    csize = (uint32_t) lz4_compress(src, PAGE_SIZE, pc->dst, ZMM_MAX_CSIZE, pc->wrkmem);
 
-  return (zmm_handle_t) entry;
+  /* Zero means the output did not fit below the threshold */
+  if (csize == 0)
+    atomic_long_inc(&zmm_stats.reject_poor);
+  else
+    handle = zmm_store(ZMM_DEFAULT_TYPE, pc->dst, csize, 0);
+
+  mutex_unlock(&pc->lock);
+  return handle;
 }
 
 int zmm_decompress_to_folio(zmm_handle_t handle, struct folio *folio) {
@@ -109,12 +378,24 @@ int zmm_decompress_to_folio(zmm_handle_t handle, struct folio *folio) {
   if (!entry) return -EINVAL;
 
   uint8_t *dst = folio_address(folio);
-  if (entry->is_rle) {
-    rle_decompress(entry->data, entry->size, dst);
-  } else {
-    memcpy(dst, entry->data, entry->size);
+
+  switch (entry->type) {
+    case ZMM_STORE_SAME:
+      zmm_fill_page(dst, entry->fill);
+      break;
+    case ZMM_STORE_LZ4:
+      if (lz4_decompress(entry->obj, entry->size, dst, PAGE_SIZE) != (int) PAGE_SIZE)
+        return -EIO;
+      break;
+    case ZMM_STORE_RLE:
+      rle_decompress(entry->obj, entry->size, dst);
+      break;
+    default:
+      memcpy(dst, entry->obj, entry->size);
+      break;
   }
 
+  atomic_long_inc(&zmm_stats.nr_loads);
   return 0;
 }
 
@@ -122,8 +403,121 @@ void zmm_free_handle(zmm_handle_t handle) {
   struct zmm_entry *entry = (struct zmm_entry *) handle;
   if (!entry) return;
 
-  kfree(entry->data);
+  if (entry->type == ZMM_STORE_SAME) {
+    atomic_long_dec(&zmm_stats.same_filled_pages);
+  } else {
+    atomic_long_sub(entry->size, &zmm_stats.payload_bytes);
+    zmm_obj_free(entry->zspage, entry->obj);
+  }
+
+  atomic_long_dec(&zmm_stats.stored_pages);
   kmem_cache_free(zmm_cache, entry);
 }
 
+/* --- /proc/zmminfo --- */
+
+#define ZMMINFO_BUF_SIZE (3 * PAGE_SIZE)
+
+static ssize_t proc_zmminfo_read(struct file *file, char *buf, size_t count, vfs_loff_t *ppos) {
+  (void) file;
+  char *kbuf = kmalloc(ZMMINFO_BUF_SIZE);
+  if (!kbuf)
+    return -ENOMEM;
+
+  long stored = atomic_long_read(&zmm_stats.stored_pages);
+  long same = atomic_long_read(&zmm_stats.same_filled_pages);
+  long payload = atomic_long_read(&zmm_stats.payload_bytes);
+  long pool_bytes = atomic_long_read(&zmm_stats.pool_pages) * (long) PAGE_SIZE;
+  long orig_bytes = (stored - same) * (long) PAGE_SIZE;
+
+  /* Ratios in hundredths: original / compressed, original / pool footprint */
+  long ratio = payload ? orig_bytes * 100 / payload : 0;
+  long eff_ratio = pool_bytes ? stored * (long) PAGE_SIZE * 100 / pool_bytes : 0;
+  long frag = pool_bytes ? (pool_bytes - payload) * 100 / pool_bytes : 0;
+
+  int len = snprintf(kbuf, ZMMINFO_BUF_SIZE,
+                     "StoredPages:    %ld\n"
+                     "SameFilled:     %ld\n"
+                     "PayloadKB:      %ld\n"
+                     "PoolKB:         %ld\n"
+                     "CompressRatio:  %ld.%02ld\n"
+                     "EffectiveRatio: %ld.%02ld\n"
+                     "Fragmentation:  %ld%%\n"
+                     "Stores:         %ld\n"
+                     "Loads:          %ld\n"
+                     "RejectPoor:     %ld\n"
+                     "RejectNoMem:    %ld\n"
+                     "\nclass  size  pages/zspage  objs/zspage  zspages  inuse  capacity\n",
+                     stored, same, payload / 1024, pool_bytes / 1024,
+                     ratio / 100, ratio % 100, eff_ratio / 100, eff_ratio % 100, frag,
+                     atomic_long_read(&zmm_stats.nr_stores),
+                     atomic_long_read(&zmm_stats.nr_loads),
+                     atomic_long_read(&zmm_stats.reject_poor),
+                     atomic_long_read(&zmm_stats.reject_nomem));
+
+  for (int i = 0; i < ZMM_NR_CLASSES && len < ZMMINFO_BUF_SIZE; i++) {
+    struct zmm_class *class = &zmm_classes[i];
+    unsigned long zspages = READ_ONCE(class->nr_zspages);
+    if (!zspages)
+      continue;
+
+    len += snprintf(kbuf + len, ZMMINFO_BUF_SIZE - len,
+                    "%5d %5u %13u %12u %8lu %6lu %9lu\n",
+                    i, class->size, 1u << class->order, class->objs_per_zspage,
+                    zspages, READ_ONCE(class->nr_objs), zspages * class->objs_per_zspage);
+  }
+
+  if (len > ZMMINFO_BUF_SIZE)
+    len = ZMMINFO_BUF_SIZE;
+
+  ssize_t ret = simple_read_from_buffer(buf, count, ppos, kbuf, (size_t) len);
+  kfree(kbuf);
+  return ret;
+}
+
+static const struct file_operations proc_zmminfo_fops = {
+  .read = proc_zmminfo_read,
+};
+
+int zmm_init(void) {
+  int cpu;
+
+  zmm_cache = kmem_cache_create("zmm_entries", sizeof(struct zmm_entry), 0, SLAB_HWCACHE_ALIGN);
+  zmm_zspage_cache = kmem_cache_create("zmm_zspages", sizeof(struct zmm_zspage), 0, 0);
+  if (!zmm_cache || !zmm_zspage_cache)
+    return -ENOMEM;
+
+  for (int i = 0; i < ZMM_NR_CLASSES; i++) {
+    struct zmm_class *class = &zmm_classes[i];
+
+    spinlock_init(&class->lock);
+    INIT_LIST_HEAD(&class->partial);
+    INIT_LIST_HEAD(&class->full);
+    class->size = (uint32_t) (i + 1) * ZMM_CLASS_DELTA;
+    class->order = zmm_class_order(class->size);
+    class->objs_per_zspage = (uint32_t) ((PAGE_SIZE << class->order) / class->size);
+  }
+
+  for_each_online_cpu(cpu) {
+    struct zmm_pcpu *pc = per_cpu_ptr(zmm_pcpu, cpu);
+
+    mutex_init(&pc->lock);
+    pc->dst = kmalloc(PAGE_SIZE);
+    pc->wrkmem = kmalloc(LZ4_MEM_COMPRESS);
+    if (!pc->dst || !pc->wrkmem) {
+      kfree(pc->dst);
+      kfree(pc->wrkmem);
+      pc->dst = nullptr;
+      pc->wrkmem = nullptr;
+    }
+  }
+
+  proc_create("zmminfo", &proc_zmminfo_fops);
+
+  printk(KERN_INFO VMM_CLASS "ZMM Anonymous memory compression pool initialized (%s, %d size classes).\n",
+         ZMM_DEFAULT_TYPE == ZMM_STORE_LZ4 ? "lz4" : (ZMM_DEFAULT_TYPE == ZMM_STORE_RLE ? "rle" : "raw"),
+         ZMM_NR_CLASSES);
+  return 0;
+}
+
 #endif